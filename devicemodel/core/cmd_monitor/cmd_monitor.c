@@ -32,7 +32,7 @@ static char socket_path[UNIX_SOCKET_PATH_MAX];
 
 static struct command *parse_command(char *cmd_msg, int fd)
 {
-	struct command *cmd = NULL;
+	struct command *cmd = NULL, *copy = NULL;
 	const cJSON *execute;
 	const cJSON *arguments;
 	cJSON *cmd_json;
@@ -51,18 +51,28 @@ static struct command *parse_command(char *cmd_msg, int fd)
 
 		cmd = find_command(execute->valuestring);
 		if (cmd != NULL) {
-			cmd->para.fd = fd;
-			arguments = cJSON_GetObjectItemCaseSensitive(cmd_json, "arguments");
-			if (cJSON_IsString(arguments) && (arguments->valuestring != NULL)) {
-				pr_info("Command arguments: \"%s\"\n", arguments->valuestring);
-				strncpy(cmd->para.option, arguments->valuestring, CMD_ARG_MAX - 1U);
+			/* dispatch on a private copy: clients are served on
+			 * different worker loops and may issue commands
+			 * concurrently
+			 */
+			copy = calloc(1, sizeof(*copy));
+			if (copy != NULL) {
+				memcpy(copy, cmd, sizeof(*copy));
+				copy->para.fd = fd;
+				arguments = cJSON_GetObjectItemCaseSensitive(cmd_json, "arguments");
+				if (cJSON_IsString(arguments) && (arguments->valuestring != NULL)) {
+					pr_info("Command arguments: \"%s\"\n", arguments->valuestring);
+					strncpy(copy->para.option, arguments->valuestring, CMD_ARG_MAX - 1U);
+				}
+			} else {
+				pr_err("Failed to allocate command instance.\n");
 			}
 		} else {
 			pr_err("Command [%s] is not supported.\n", execute->valuestring);
 		}
 	}
 	cJSON_Delete(cmd_json);
-	return cmd;
+	return copy;
 }
 static void monitor_cmd_dispatch(char *cmd_msg, int fd)
 {
@@ -71,10 +81,39 @@ static void monitor_cmd_dispatch(char *cmd_msg, int fd)
 	cmd = parse_command(cmd_msg, fd);
 	if (cmd != NULL) {
 		dispatch_command_handlers(cmd);
+		free(cmd);
 	}
 	return;
 }
 
+void monitor_broadcast_event(const char *event, const char *detail)
+{
+	cJSON *obj;
+	char *msg, *framed;
+	int len;
+
+	if (sock_server == NULL)
+		return;
+
+	obj = cJSON_CreateObject();
+	if (obj == NULL)
+		return;
+	cJSON_AddStringToObject(obj, "event", event);
+	if (detail != NULL)
+		cJSON_AddStringToObject(obj, "detail", detail);
+	msg = cJSON_PrintUnformatted(obj);
+	cJSON_Delete(obj);
+	if (msg == NULL)
+		return;
+
+	len = asprintf(&framed, "%s\n", msg);
+	free(msg);
+	if (len < 0)
+		return;
+	broadcast_socket_event(sock_server, framed, (size_t)len);
+	free(framed);
+}
+
 int init_socket_server(void)
 {
 	int ret = 0;
@@ -99,6 +138,10 @@ static void register_socket_message_handlers(struct vmctx *ctx)
 	arg.ctx_arg = ctx;
 	register_command_handler(user_vm_destroy_handler, &arg, DESTROY);
 	register_command_handler(user_vm_blkrescan_handler, &arg, BLKRESCAN);
+	register_command_handler(user_vm_snapshot_handler, &arg, SNAPSHOT);
+	register_command_handler(user_vm_blkrate_handler, &arg, BLKRATE);
+	register_command_handler(user_vm_vssram_handler, &arg, VSSRAM);
+	register_command_handler(user_vm_subscribe_handler, &arg, SUBSCRIBE);
 }
 
 int init_cmd_monitor(struct vmctx *ctx)
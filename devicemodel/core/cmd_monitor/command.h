@@ -10,8 +10,12 @@
 
 #define DESTROY "destroy"
 #define BLKRESCAN "blkrescan"
+#define SNAPSHOT "snapshot"
+#define BLKRATE "blkrate"
+#define VSSRAM "vssram"
+#define SUBSCRIBE "subscribe"
 
-#define CMDS_NUM 2U
+#define CMDS_NUM 6U
 #define CMD_NAME_MAX 32U
 #define CMD_ARG_MAX 320U
 
@@ -18,6 +18,7 @@
 #include "dm.h"
 #include "pm.h"
 #include "vmmapi.h"
+#include "snapshot.h"
 #include "log.h"
 #include "monitor.h"
 
@@ -82,6 +83,8 @@ int user_vm_destroy_handler(void *arg, void *command_para)
 
 	if (!is_rtvm) {
 		pr_info("%s: setting VM state to %s.\n", __func__, vm_state_to_str(VM_SUSPEND_POWEROFF));
+		/* an explicit destroy overrides --keepalive */
+		vm_set_keepalive(false);
 		vm_set_suspend_mode(VM_SUSPEND_POWEROFF);
 		cmd_completed = true;
 	} else {
@@ -96,6 +99,38 @@ int user_vm_destroy_handler(void *arg, void *command_para)
 	return ret;
 }
 
+int user_vm_snapshot_handler(void *arg, void *command_para)
+{
+	int ret = 0;
+	struct command_parameters *cmd_para = (struct command_parameters *)command_para;
+	struct handler_args *hdl_arg = (struct handler_args *)arg;
+	struct socket_dev *sock = (struct socket_dev *)hdl_arg->channel_arg;
+	struct socket_client *client = NULL;
+	bool cmd_completed = false;
+
+	client = find_socket_client(sock, cmd_para->fd);
+	if (client == NULL)
+		return -1;
+
+	if (strnlen(cmd_para->option, CMD_ARG_MAX) == 0) {
+		pr_err("Snapshot command requires an image path argument.\n");
+	} else {
+		ret = vm_snapshot_save(hdl_arg->ctx_arg, cmd_para->option);
+		if (ret == 0) {
+			cmd_completed = true;
+		} else {
+			pr_err("Failed to save VM snapshot to %s.\n",
+				cmd_para->option);
+		}
+	}
+
+	ret = send_socket_ack(sock, cmd_para->fd, cmd_completed);
+	if (ret < 0) {
+		pr_err("Failed to send ACK by socket.\n");
+	}
+	return ret;
+}
+
 int user_vm_blkrescan_handler(void *arg, void *command_para)
 {
 	int ret = 0;
@@ -122,3 +157,81 @@ int user_vm_blkrescan_handler(void *arg, void *command_para)
 	}
 	return ret;
 }
+
+int user_vm_blkrate_handler(void *arg, void *command_para)
+{
+	int ret = 0;
+	struct command_parameters *cmd_para = (struct command_parameters *)command_para;
+	struct handler_args *hdl_arg = (struct handler_args *)arg;
+	struct socket_dev *sock = (struct socket_dev *)hdl_arg->channel_arg;
+	struct socket_client *client = NULL;
+	bool cmd_completed = false;
+
+	client = find_socket_client(sock, cmd_para->fd);
+	if (client == NULL)
+		return -1;
+
+	ret = vm_monitor_blkrate(hdl_arg->ctx_arg, cmd_para->option);
+	if (ret >= 0) {
+		cmd_completed = true;
+	} else {
+		pr_err("Failed to update virtio-blk rate limits.\n");
+	}
+
+	ret = send_socket_ack(sock, cmd_para->fd, cmd_completed);
+	if (ret < 0) {
+		pr_err("Failed to send ACK by socket.\n");
+	}
+	return ret;
+}
+
+int user_vm_subscribe_handler(void *arg, void *command_para)
+{
+	int ret;
+	struct command_parameters *cmd_para = (struct command_parameters *)command_para;
+	struct handler_args *hdl_arg = (struct handler_args *)arg;
+	struct socket_dev *sock = (struct socket_dev *)hdl_arg->channel_arg;
+	struct socket_client *client = NULL;
+
+	client = find_socket_client(sock, cmd_para->fd);
+	if (client == NULL)
+		return -1;
+
+	/* "off" stops the event stream, anything else starts it */
+	client->subscribed = (strncmp(cmd_para->option, "off", CMD_ARG_MAX) != 0);
+	pr_info("Monitor client %d %s events.\n", cmd_para->fd,
+		client->subscribed ? "subscribed to" : "unsubscribed from");
+
+	ret = send_socket_ack(sock, cmd_para->fd, true);
+	if (ret < 0) {
+		pr_err("Failed to send ACK by socket.\n");
+	}
+	return ret;
+}
+
+int user_vm_vssram_handler(void *arg, void *command_para)
+{
+	int ret = 0;
+	struct command_parameters *cmd_para = (struct command_parameters *)command_para;
+	struct handler_args *hdl_arg = (struct handler_args *)arg;
+	struct socket_dev *sock = (struct socket_dev *)hdl_arg->channel_arg;
+	struct socket_client *client = NULL;
+	bool cmd_completed = false;
+
+	client = find_socket_client(sock, cmd_para->fd);
+	if (client == NULL)
+		return -1;
+
+	ret = vm_monitor_vssram(hdl_arg->ctx_arg, cmd_para->option);
+	if (ret >= 0) {
+		cmd_completed = true;
+	} else {
+		pr_err("Failed to handle vSSRAM request.\n");
+	}
+
+	ret = send_socket_ack(sock, cmd_para->fd, cmd_completed);
+	if (ret < 0) {
+		pr_err("Failed to send ACK by socket.\n");
+	}
+	return ret;
+}
@@ -9,4 +9,8 @@ extern struct socket_dev *sock_server;
 
 int user_vm_destroy_handler(void *arg, void *command_para);
 int user_vm_blkrescan_handler(void *arg, void *command_para);
+int user_vm_blkrate_handler(void *arg, void *command_para);
+int user_vm_snapshot_handler(void *arg, void *command_para);
+int user_vm_vssram_handler(void *arg, void *command_para);
+int user_vm_subscribe_handler(void *arg, void *command_para);
 #endif
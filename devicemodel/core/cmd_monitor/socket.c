@@ -25,7 +25,7 @@ static int setup_and_listen_unix_socket(const char *sock_path, int num)
 	struct sockaddr_un s_un;
 	int sock_fd, ret;
 
-	sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 	if (sock_fd < 0)
 		goto err;
 	s_un.sun_family = AF_UNIX;
@@ -45,14 +45,17 @@ err_close_socket:
 err:
 	return -1;
 }
-static void free_socket_client(struct socket_dev *sock, struct socket_client *client)
+
+/* runs when the worker loop drops the client event; the fd is already closed */
+static void socket_client_teardown(void *param)
 {
+	struct socket_client *client = param;
+	struct socket_dev *sock = client->sock;
+
 	pthread_mutex_lock(&sock->client_mtx);
 	LIST_REMOVE(client, list);
+	sock->num_client--;
 	pthread_mutex_unlock(&sock->client_mtx);
-
-	close(client->fd);
-	client->fd = -1;
 	free(client);
 }
 
@@ -89,148 +92,139 @@ int write_socket_char(struct socket_client *client)
 	return ret;
 }
 
-int read_socket_char(struct socket_dev *sock, struct socket_client *client)
+void broadcast_socket_event(struct socket_dev *sock, const char *msg, size_t len)
 {
-	struct iovec iov;
-	struct msghdr msg;
-	struct cmsghdr *cmsg;
-	char buf[CMSG_SPACE(sizeof(int))];
-	int fdflags_recvmsg = MSG_CMSG_CLOEXEC;
+	struct socket_client *client;
+	ssize_t ret;
 
-	memset(&msg, 0, sizeof(msg));
-	memset(client->buf, '\0', CLIENT_BUF_LEN);
-	iov.iov_base = client->buf;
-	iov.iov_len = CLIENT_BUF_LEN;
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_name = NULL;
-	msg.msg_namelen = 0;
+	pthread_mutex_lock(&sock->client_mtx);
+	LIST_FOREACH(client, &sock->client_head, list) {
+		if (!client->subscribed)
+			continue;
+		/* never block on a slow consumer: drop the event for that
+		 * client and let it resynchronize with a regular query
+		 */
+		do {
+			ret = send(client->fd, msg, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		} while (ret < 0 && errno == EINTR);
+		if (ret < (ssize_t)len)
+			pr_warn("Dropped event for slow monitor client %d.\n", client->fd);
+	}
+	pthread_mutex_unlock(&sock->client_mtx);
+}
 
-	msg.msg_control = buf;
-	msg.msg_controllen = sizeof(buf);
-	cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+/* dispatch every complete frame in client->buf, keeping any partial tail */
+static void socket_dispatch_frames(struct socket_dev *sock, struct socket_client *client)
+{
+	char *sol = client->buf;
+	char *eol;
+	size_t tail;
+
+	client->buf[client->len] = '\0';
+	while ((eol = strchr(sol, '\n')) != NULL) {
+		*eol = '\0';
+		if ((eol > sol) && (sock->data_handler != NULL))
+			sock->data_handler(sol, client->fd);
+		sol = eol + 1;
+	}
 
-	client->len = recvmsg(client->fd, &msg, fdflags_recvmsg);
-	if (client->len <= 0) {
-		pr_err("Socket Disconnect: %d.\r\n", client->fd);
-		free_socket_client(sock, client);
-		sock->num_client--;
-		return -1;
+	tail = (size_t)(&client->buf[client->len] - sol);
+	/* compatibility with unframed senders: a chunk that ends on a
+	 * closing brace is taken as one complete JSON request
+	 */
+	if ((tail > 0U) && (sol[tail - 1U] == '}') && (sock->data_handler != NULL)) {
+		sock->data_handler(sol, client->fd);
+		tail = 0U;
 	}
-	if (client->len == CLIENT_BUF_LEN) {
-		pr_err("Socket buffer overflow!\r\n");
-		return -1;
+	if (tail == (size_t)(CLIENT_BUF_LEN - 1U)) {
+		pr_err("Socket buffer overflow, dropping request.\r\n");
+		tail = 0U;
 	}
-	for (unsigned int i = 0U; i < CLIENT_BUF_LEN; i++)
-		if (client->buf[i] == 0xa)
-			client->buf[i] = '\0';
-	pr_info("Receive data:(%s)\n", client->buf);
-	if (sock->data_handler != NULL)
-		sock->data_handler(client->buf, client->fd);
-	return 0;
+	memmove(client->buf, sol, tail);
+	client->len = (int)tail;
 }
-static struct socket_client *new_socket_client(struct socket_dev *sock)
+
+static void socket_client_event(int fd, enum ev_type type, void *arg)
 {
+	struct socket_client *client = arg;
+	ssize_t n;
+
+	do {
+		n = recv(fd, client->buf + client->len,
+			 (CLIENT_BUF_LEN - 1U) - client->len, MSG_DONTWAIT);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n <= 0) {
+		pr_err("Socket Disconnect: %d.\r\n", fd);
+		/* deferred deletion; teardown unlinks and frees the client */
+		mevent_delete_close(client->mev);
+		return;
+	}
+	client->len += (int)n;
+	socket_dispatch_frames(client->sock, client);
+}
+
+static void socket_accept_event(int fd, enum ev_type type, void *arg)
+{
+	struct socket_dev *sock = arg;
 	struct socket_client *client;
 
 	client = calloc(1, sizeof(*client));
 	if (!client) {
-		pr_err("%s: failed to allocate memory for client\n",
-					__func__);
-		goto alloc_client;
+		pr_err("%s: failed to allocate memory for client\n", __func__);
+		return;
 	}
 
 	client->addr_len = sizeof(client->addr);
-	client->fd =
-	    accept(sock->sock_fd, (struct sockaddr *)&client->addr,
-		   &client->addr_len);
+	client->fd = accept4(fd, (struct sockaddr *)&client->addr,
+			     &client->addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
 	if (client->fd < 0) {
-		if (sock->listening)
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
 			pr_err("%s: Failed to accept from fd %d, err: %s\n",
-					__func__, sock->sock_fd, strerror(errno));
-		goto accept_con;
+					__func__, fd, strerror(errno));
+		free(client);
+		return;
+	}
+
+	if (sock->num_client >= SOCKET_MAX_CLIENT) {
+		pr_err("Too many monitor clients, rejecting fd %d.\n", client->fd);
+		close(client->fd);
+		free(client);
+		return;
 	}
 
+	client->sock = sock;
 	pthread_mutex_lock(&sock->client_mtx);
 	LIST_INSERT_HEAD(&sock->client_head, client, list);
+	sock->num_client++;
 	pthread_mutex_unlock(&sock->client_mtx);
 
-	return client;
-
- accept_con:
-	free(client);
- alloc_client:
-	return NULL;
-}
-static void *listen_socket_client(void *arg)
-{
-	struct socket_dev *sock = (struct socket_dev *)arg;
-	struct socket_client *client;
-
-	pr_info("Socket Listening %d...\n", sock->sock_fd);
-	while (sock->listening) {
-		/* wait connection */
-		if (sock->num_client >= SOCKET_MAX_CLIENT) {
-			usleep(500000);
-			continue;
-		}
-
-		client = new_socket_client(sock);
-		if (!client) {
-			usleep(500000);
-			continue;
-		}
-		pr_info("Socket Connected:%d\n", client->fd);
-		sock->num_client++;
-	}
-	pr_info("Stop listening %d.\n", sock->sock_fd);
-	return NULL;
-}
-static void *socket_poll_events(void *arg)
-{
-	struct socket_dev *sock = (struct socket_dev *)arg;
-	struct socket_client *client;
-	fd_set rfd;
-	int max_fd = 0;
-	struct timeval timeout;
-	struct socket_client *poll_client[SOCKET_MAX_CLIENT];
-	int nfd, i;
-
-	pr_info("Polling socket %d.\n", sock->sock_fd);
-	while (sock->polling) {
-		max_fd = 0;
-		nfd = 0;
+	/* spread clients over the worker loops so one slow command only
+	 * stalls the client that issued it
+	 */
+	client->mev = mevent_add_affinity(client->fd, EVF_READ, socket_client_event,
+					  client, socket_client_teardown, client, -1);
+	if (client->mev == NULL) {
+		pr_err("%s: failed to register client fd %d\n", __func__, client->fd);
 		pthread_mutex_lock(&sock->client_mtx);
-		FD_ZERO(&rfd);
-		LIST_FOREACH(client, &sock->client_head, list) {
-			FD_SET(client->fd, &rfd);
-			poll_client[nfd] = client;
-			nfd++;
-			if (client->fd > max_fd)
-				max_fd = client->fd;
-		}
+		LIST_REMOVE(client, list);
+		sock->num_client--;
 		pthread_mutex_unlock(&sock->client_mtx);
-
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 10000;
-		select(max_fd + 1, &rfd, NULL, NULL, &timeout);
-
-		for (i = 0; i < nfd; i++) {
-			client = poll_client[i];
-			if (!FD_ISSET(client->fd, &rfd))
-				continue;
-
-			if (read_socket_char(sock, client) < 0)
-				continue;
-		}
+		close(client->fd);
+		free(client);
+		return;
 	}
-	pr_info("Stop polling on socket %d.\n", sock->sock_fd);
+	pr_info("Socket Connected:%d\n", client->fd);
+}
+
+static void socket_listen_teardown(void *param)
+{
+	struct socket_dev *sock = param;
 
-	return NULL;
+	sock->listen_mev = NULL;
 }
+
 struct socket_client *find_socket_client(struct socket_dev *sock, int fd)
 {
 	struct socket_client *client = NULL;
@@ -244,16 +238,20 @@ struct socket_client *find_socket_client(struct socket_dev *sock, int fd)
 }
 int open_socket(struct socket_dev *sock, data_handler_f *fn)
 {
-	sock->listening = true;
-	sock->polling = true;
 	sock->data_handler = fn;
 	pthread_mutex_init(&sock->client_mtx, NULL);
 	unlink(sock->unix_sock_path);
 	sock->sock_fd = setup_and_listen_unix_socket(sock->unix_sock_path, SOCKET_MAX_CLIENT);
 	if (sock->sock_fd < 0)
 		return -1;
-	pthread_create(&sock->listen_thread, NULL, listen_socket_client, sock);
-	pthread_create(&sock->connect_thread, NULL, socket_poll_events, sock);
+	sock->listen_mev = mevent_add(sock->sock_fd, EVF_READ, socket_accept_event,
+				      sock, socket_listen_teardown, sock);
+	if (sock->listen_mev == NULL) {
+		pr_err("%s: failed to register listening socket\n", __func__);
+		close(sock->sock_fd);
+		unlink(sock->unix_sock_path);
+		return -1;
+	}
 	return 0;
 }
 
@@ -261,23 +259,16 @@ void close_socket(struct socket_dev *sock)
 {
 	struct socket_client *client, *tclient;
 
-	sock->listening = false;
-	sock->polling = false;
-	shutdown(sock->sock_fd, SHUT_RDWR);
-
-	pthread_join(sock->listen_thread, NULL);
-	pthread_join(sock->connect_thread, NULL);
+	if (sock->listen_mev != NULL)
+		mevent_delete_close(sock->listen_mev);
 
 	pthread_mutex_lock(&sock->client_mtx);
 	list_foreach_safe(client, &sock->client_head, list, tclient) {
-		LIST_REMOVE(client, list);
-		close(client->fd);
-		client->fd = -1;
-		free(client);
+		/* deferred deletion; teardown unlinks and frees each client */
+		mevent_delete_close(client->mev);
 	}
 	pthread_mutex_unlock(&sock->client_mtx);
 
-	close(sock->sock_fd);
 	unlink(sock->unix_sock_path);
 }
 struct socket_dev *init_socket(char *path)
@@ -297,4 +288,4 @@ void deinit_socket(struct socket_dev *sock)
 {
 	if (sock != NULL)
 		free(sock);
-}
\ No newline at end of file
+}
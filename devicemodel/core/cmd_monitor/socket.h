@@ -7,20 +7,27 @@
 #include <sys/queue.h>
 #include <pthread.h>
 #include <sys/un.h>
+#include "mevent.h"
 
 #define BUFFER_SIZE 16U
 #define UNIX_SOCKET_PATH_MAX 1024U
 #define CLIENT_BUF_LEN 4096U
-#define SOCKET_MAX_CLIENT		1
+#define SOCKET_MAX_CLIENT		8
 
 typedef void data_handler_f(char *cmd_name, int fd);
 
+struct socket_dev;
+
 struct socket_client {
+	struct socket_dev *sock;
 	struct sockaddr_un addr;
 	int fd;
 	socklen_t addr_len;
 	char buf[CLIENT_BUF_LEN];
-	int len; /* buf len */
+	int len; /* filled bytes in buf, may hold a partial frame */
+
+	struct mevent *mev;
+	bool subscribed; /* receives broadcast events */
 
 	LIST_ENTRY(socket_client) list;
 };
@@ -32,10 +39,7 @@ struct socket_dev {
 
 	data_handler_f *data_handler;
 
-	bool listening;
-	bool polling;
-	pthread_t listen_thread;
-	pthread_t connect_thread;
+	struct mevent *listen_mev;
 
 	LIST_HEAD(client_list, socket_client) client_head;        /* clients for this server */
 	pthread_mutex_t client_mtx;
@@ -51,8 +55,16 @@ int write_socket_char(struct socket_client *client);
  */
 struct socket_client *find_socket_client(struct socket_dev *sock, int fd);
 /**
- * @brief Open one unix domain socket server, initialize a socket,
- * create one thread to listen to client, another thread to poll message from client.
+ * @brief Send one newline-framed message to every subscribed client.
+ *
+ * Non-blocking: a client too slow to drain its socket has the event
+ * dropped rather than stalling the caller.
+ */
+void broadcast_socket_event(struct socket_dev *sock, const char *msg, size_t len);
+/**
+ * @brief Open one unix domain socket server and register it with the
+ * mevent loop; connects and client requests are served as events, with
+ * clients spread round-robin over the worker loops.
  */
 int open_socket(struct socket_dev *sock, data_handler_f *fn);
 /**
@@ -37,8 +37,13 @@
 #include <errno.h>
 #include <log.h>
 #include <linux/memfd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <lz4.h>
 
 #include "vmmapi.h"
+#include "mem.h"
+#include "dm.h"
 
 extern char *vmname;
 
@@ -143,6 +148,73 @@ static size_t total_size;
 static int hugetlb_lv_max;
 static int lock_fd;
 
+#define MAX_TOUCH_WORKERS	16
+
+struct touch_pages_stripe {
+	char *addr;
+	size_t len;
+	size_t pagesz;
+};
+
+static void *touch_pages_worker(void *arg)
+{
+	struct touch_pages_stripe *stripe = arg;
+	char *addr = stripe->addr;
+	char *end = stripe->addr + stripe->len;
+
+	/* Access to the address will trigger hugetlb_fault() in kernel,
+	 * it will allocate and clear the huge page.*/
+	for (; addr < end; addr += stripe->pagesz)
+		*(volatile char *)addr = *addr;
+
+	return NULL;
+}
+
+/*
+ * Fault in the hugepages backing [addr, addr+len) with one worker per host
+ * core. hugetlb_fault() spends its time clearing the page, and the clears
+ * of disjoint pages proceed independently, so striping the region across
+ * cores cuts the prefault stage roughly by the core count.
+ */
+static void touch_pages(char *addr, size_t len, size_t pagesz)
+{
+	struct touch_pages_stripe stripes[MAX_TOUCH_WORKERS];
+	pthread_t tids[MAX_TOUCH_WORKERS];
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t pages = len / pagesz;
+	size_t chunk, done = 0;
+	int i, nworkers = 0;
+
+	if (pages == 0)
+		return;
+
+	if (ncpus > MAX_TOUCH_WORKERS)
+		ncpus = MAX_TOUCH_WORKERS;
+	if (ncpus < 1)
+		ncpus = 1;
+
+	chunk = ((pages + ncpus - 1) / ncpus) * pagesz;
+	for (i = 0; (i < ncpus - 1) && (done + chunk < len); i++) {
+		stripes[i].addr = addr + done;
+		stripes[i].len = chunk;
+		stripes[i].pagesz = pagesz;
+		if (pthread_create(&tids[i], NULL, touch_pages_worker,
+					&stripes[i]) != 0)
+			break;
+		done += chunk;
+		nworkers++;
+	}
+
+	/* touch the remainder (or, without workers, everything) inline */
+	stripes[nworkers].addr = addr + done;
+	stripes[nworkers].len = len - done;
+	stripes[nworkers].pagesz = pagesz;
+	touch_pages_worker(&stripes[nworkers]);
+
+	for (i = 0; i < nworkers; i++)
+		pthread_join(tids[i], NULL);
+}
+
 static int lock_acrn_hugetlb(void)
 {
 	int ret;
@@ -205,13 +277,14 @@ static bool should_enable_hugetlb_level(int level)
  * len	  : region length for mmap
  * offset : region start offset from ctx->baseaddr
  * skip   : skip offset in different level hugetlbfs fd
+ * touch  : pre-allocate the hugepages by touching them
  */
 static int mmap_hugetlbfs_from_level(struct vmctx *ctx, int level, size_t len,
-		size_t offset, size_t skip, char **addr_out)
+		size_t offset, size_t skip, char **addr_out, bool touch)
 {
 	char *addr;
 	size_t pagesz = 0;
-	int fd, i;
+	int fd;
 
 	if (level >= HUGETLB_LV_MAX) {
 		pr_err("exceed max hugetlb level");
@@ -241,15 +314,12 @@ static int mmap_hugetlbfs_from_level(struct vmctx *ctx, int level, size_t len,
 	pr_info("mmap 0x%lx@%p\n", len, addr);
 
 	/* pre-allocate hugepages by touch them */
-	pagesz = hugetlb_priv[level].pg_size;
+	if (touch) {
+		pagesz = hugetlb_priv[level].pg_size;
 
-	pr_info("touch %ld pages with pagesz 0x%lx\n", len/pagesz, pagesz);
+		pr_info("touch %ld pages with pagesz 0x%lx\n", len/pagesz, pagesz);
 
-	/* Access to the address will trigger hugetlb_fault() in kernel,
-	 * it will allocate and clear the huge page.*/
-	for (i = 0; i < len/pagesz; i++) {
-		*(volatile char *)addr = *addr;
-		addr += pagesz;
+		touch_pages(addr, len, pagesz);
 	}
 
 	return 0;
@@ -257,7 +327,8 @@ static int mmap_hugetlbfs_from_level(struct vmctx *ctx, int level, size_t len,
 
 static int mmap_hugetlbfs(struct vmctx *ctx, size_t offset,
 		void (*get_param)(struct hugetlb_info *, size_t *, size_t *),
-		size_t (*adj_param)(struct hugetlb_info *, struct hugetlb_info *, int), char **addr)
+		size_t (*adj_param)(struct hugetlb_info *, struct hugetlb_info *, int),
+		char **addr, bool touch)
 {
 	size_t len, skip;
 	int level, ret = 0, pg_size;
@@ -267,7 +338,7 @@ static int mmap_hugetlbfs(struct vmctx *ctx, size_t offset,
 		pg_size = hugetlb_priv[level].pg_size;
 
 		while (len > 0) {
-			ret = mmap_hugetlbfs_from_level(ctx, level, len, offset, skip, addr);
+			ret = mmap_hugetlbfs_from_level(ctx, level, len, offset, skip, addr, touch);
 
 			if (ret < 0 && level > HUGETLB_LV1) {
 				len = adj_param(
@@ -600,6 +671,630 @@ void uninit_hugetlb(void)
 	close(lock_fd);
 }
 
+/*
+ * Lazy population of guest memory above 4G.
+ *
+ * With --lazy_highmem, highmem is mmap'ed but neither touched nor EPT-mapped
+ * at setup time, so a large guest does not pay the full allocate-and-clear
+ * cost before its firmware fetches the first instruction. A guest access to
+ * a not-yet-mapped page exits to the hypervisor, which forwards it to the DM
+ * as an MMIO request; the fallback handler below populates the containing
+ * 1G-aligned slab (touch the backing hugepages, then map the slab into EPT)
+ * and completes the trapped access against the backing memory directly.
+ * A service thread walks all the slabs in the background, so the guest only
+ * takes the slow trap path on slabs it touches ahead of the thread.
+ *
+ * Instruction fetches from an unmapped GPA cannot be completed this way,
+ * which is why lazy mode covers highmem only: firmware and early kernel code
+ * run from lowmem/biosmem, and those regions stay eagerly mapped.
+ */
+#define LAZY_SLAB_SIZE		(1UL * GB)
+
+static pthread_t lazy_populate_tid;
+static pthread_mutex_t lazy_slab_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *lazy_slab_mapped;
+static int lazy_slab_num;
+static bool lazy_populate_stop;
+static bool lazy_highmem_on;
+static bool lazy_thread_running;
+static bool lazy_range_registered;
+static struct mem_range lazy_highmem_range;
+
+/* When resuming from a snapshot image, highmem content is pulled from the
+ * image as slabs are populated, so restore cost follows the guest's actual
+ * working set instead of the full memory size.
+ */
+static int lazy_restore_fd = -1;
+static uint64_t lazy_restore_off;
+
+/* In fork mode (clone provisioning from a shared template image) slabs
+ * are pulled strictly on guest demand and the background populate
+ * thread is not started, so a clone's footprint stays at its touched
+ * set instead of growing to the full image.
+ */
+static bool lazy_on_demand;
+
+void hugetlb_set_lazy_restore(int fd, uint64_t off)
+{
+	lazy_restore_fd = fd;
+	lazy_restore_off = off;
+}
+
+void hugetlb_set_lazy_on_demand(void)
+{
+	lazy_on_demand = true;
+}
+
+static int populate_lazy_slab(struct vmctx *ctx, int idx)
+{
+	uint64_t gpa, len;
+	size_t pagesz = hugetlb_priv[HUGETLB_LV1].pg_size;
+	int ret = 0;
+
+	pthread_mutex_lock(&lazy_slab_mtx);
+	if (!lazy_slab_mapped[idx]) {
+		gpa = ctx->highmem_gpa_base + (uint64_t)idx * LAZY_SLAB_SIZE;
+		len = ctx->highmem - (uint64_t)idx * LAZY_SLAB_SIZE;
+		if (len > LAZY_SLAB_SIZE)
+			len = LAZY_SLAB_SIZE;
+
+		/* Touch with the smallest hugepage stride, a 1G backed range
+		 * just sees a few extra reads of the same page.
+		 */
+		touch_pages(ctx->baseaddr + gpa, len, pagesz);
+
+		if (lazy_restore_fd >= 0) {
+			/* a short read means the image was sparse there;
+			 * the freshly touched pages are already zero
+			 */
+			if (pread(lazy_restore_fd, ctx->baseaddr + gpa, len,
+					lazy_restore_off +
+					(gpa - ctx->highmem_gpa_base)) < 0)
+				pr_err("lazy restore: read 0x%lx@0x%lx failed\n",
+					len, gpa);
+		}
+
+		ret = vm_map_memseg_vma(ctx, len, gpa,
+				(uint64_t)(ctx->baseaddr + gpa), PROT_ALL);
+		if (ret == 0) {
+			lazy_slab_mapped[idx] = 1;
+			pr_dbg("lazy highmem: mapped 0x%lx@0x%lx\n", len, gpa);
+		} else {
+			pr_err("lazy highmem: map 0x%lx@0x%lx failed\n", len, gpa);
+		}
+	}
+	pthread_mutex_unlock(&lazy_slab_mtx);
+
+	return ret;
+}
+
+/* the compression tier below shares the fallback handler and slab mutex */
+static bool mem_compress_on;
+static int restore_zchunk(struct vmctx *ctx, uint64_t addr);
+
+static int highmem_fault(struct vmctx *ctx, int vcpu, int dir, uint64_t addr,
+		int size, uint64_t *val, void *arg1, long arg2)
+{
+	void *hva;
+	int ret = 0;
+
+	if (lazy_highmem_on)
+		ret = populate_lazy_slab(ctx,
+			(addr - ctx->highmem_gpa_base) / LAZY_SLAB_SIZE);
+	if ((ret == 0) && mem_compress_on)
+		ret = restore_zchunk(ctx, addr);
+	if (ret == 0) {
+		/* complete the access which trapped before the range was mapped */
+		hva = ctx->baseaddr + addr;
+		if (dir == MEM_F_READ) {
+			*val = 0UL;
+			memcpy(val, hva, size);
+		} else {
+			memcpy(hva, val, size);
+		}
+	}
+
+	return ret;
+}
+
+static void *lazy_populate_thread(void *arg)
+{
+	struct vmctx *ctx = arg;
+	int i;
+
+	for (i = 0; i < lazy_slab_num; i++) {
+		if (lazy_populate_stop || (populate_lazy_slab(ctx, i) != 0))
+			break;
+	}
+
+	return NULL;
+}
+
+int hugetlb_start_lazy_highmem(struct vmctx *ctx)
+{
+	if (!lazy_highmem_on)
+		return 0;
+
+	lazy_highmem_range.name = "lazy_highmem";
+	lazy_highmem_range.flags = MEM_F_RW;
+	lazy_highmem_range.handler = highmem_fault;
+	lazy_highmem_range.arg1 = NULL;
+	lazy_highmem_range.arg2 = 0;
+	lazy_highmem_range.base = ctx->highmem_gpa_base;
+	lazy_highmem_range.size = ctx->highmem;
+	if (register_mem_fallback(&lazy_highmem_range) != 0) {
+		pr_err("lazy highmem: register fallback range failed\n");
+		return -1;
+	}
+	lazy_range_registered = true;
+
+	if (!lazy_on_demand) {
+		if (pthread_create(&lazy_populate_tid, NULL,
+					lazy_populate_thread, ctx) != 0) {
+			pr_err("lazy highmem: create populate thread failed\n");
+			unregister_mem_fallback(&lazy_highmem_range);
+			lazy_range_registered = false;
+			return -1;
+		}
+		pthread_setname_np(lazy_populate_tid, "lazy_highmem");
+		lazy_thread_running = true;
+	}
+
+	return 0;
+}
+
+static void lazy_highmem_cleanup(void)
+{
+	if (lazy_highmem_on) {
+		if (lazy_thread_running) {
+			lazy_populate_stop = true;
+			pthread_join(lazy_populate_tid, NULL);
+			lazy_thread_running = false;
+		}
+		if (lazy_range_registered) {
+			unregister_mem_fallback(&lazy_highmem_range);
+			lazy_range_registered = false;
+		}
+		free(lazy_slab_mapped);
+		lazy_slab_mapped = NULL;
+		lazy_slab_num = 0;
+		lazy_populate_stop = false;
+		lazy_highmem_on = false;
+		lazy_on_demand = false;
+	}
+}
+
+/*
+ * Transparent compression tier for idle guest memory.
+ *
+ * With --mem_compress <sec>, a reclaim thread samples the hypervisor's
+ * EPT dirty log every <sec> seconds. A 2M chunk of highmem that stays
+ * clean for MEM_COMPRESS_IDLE_ROUNDS consecutive samples is unmapped
+ * from EPT, LZ4-compressed into an in-DM pool, and its hugetlb backing
+ * is hole-punched so the pages go back to the host pool. The first
+ * guest access to a reclaimed chunk traps like a lazy-highmem fault;
+ * highmem_fault() then decompresses the chunk back into freshly
+ * faulted backing pages and restores the EPT mapping.
+ *
+ * The dirty log records writes only, so a chunk the guest reads but
+ * never writes can be reclaimed and pays one restore fault before its
+ * idle counter restarts. Like lazy mode this covers highmem only, as
+ * instruction fetches cannot be completed from the fallback handler.
+ * Only 2M-backed ranges are reclaimed; punching a 2M hole in a 1G
+ * hugepage would free nothing.
+ */
+#define MEM_COMPRESS_CHUNK_SIZE		(2UL * MB)
+#define MEM_COMPRESS_IDLE_ROUNDS	3
+
+struct zchunk {
+	void		*zbuf;	/* non-NULL while the chunk is compressed out */
+	uint32_t	zlen;
+	uint8_t		idle;	/* consecutive clean scan rounds */
+};
+
+static pthread_t reclaim_tid;
+static struct zchunk *zchunks;
+static int zchunk_num;
+static int *zchunk_cand;
+static uint64_t *dirty_bitmap;
+static uint64_t dirty_bitmap_size;
+static struct mem_range mem_compress_range;
+static bool mem_compress_range_on;
+static bool reclaim_stop;
+static bool reclaim_thread_running;
+static uint64_t zpool_bytes;
+
+static uint64_t zchunk_gpa(struct vmctx *ctx, int idx)
+{
+	return ctx->highmem_gpa_base + (uint64_t)idx * MEM_COMPRESS_CHUNK_SIZE;
+}
+
+static uint64_t zchunk_len(struct vmctx *ctx, int idx)
+{
+	uint64_t len = ctx->highmem - (uint64_t)idx * MEM_COMPRESS_CHUNK_SIZE;
+
+	return (len > MEM_COMPRESS_CHUNK_SIZE) ? MEM_COMPRESS_CHUNK_SIZE : len;
+}
+
+/* read and clear the dirty bits covering one chunk; chunks are 2M
+ * aligned so they never share a bitmap word
+ */
+static bool zchunk_was_dirty(struct vmctx *ctx, int idx)
+{
+	uint64_t gpa = zchunk_gpa(ctx, idx);
+	uint64_t first = gpa / 4096 / 64;
+	uint64_t last = (gpa + zchunk_len(ctx, idx) - 1) / 4096 / 64;
+	bool dirty = false;
+	uint64_t i;
+
+	for (i = first; (i <= last) && (i < dirty_bitmap_size / 8); i++) {
+		if (dirty_bitmap[i] != 0) {
+			dirty_bitmap[i] = 0;
+			dirty = true;
+		}
+	}
+
+	return dirty;
+}
+
+/* called from highmem_fault() on the first guest access to a reclaimed
+ * chunk; a fault racing the reclaim thread waits on lazy_slab_mtx and
+ * sees either the chunk untouched or fully compressed
+ */
+static int restore_zchunk(struct vmctx *ctx, uint64_t addr)
+{
+	int idx = (addr - ctx->highmem_gpa_base) / MEM_COMPRESS_CHUNK_SIZE;
+	struct zchunk *zc = &zchunks[idx];
+	uint64_t gpa, len;
+	int ret = 0;
+
+	pthread_mutex_lock(&lazy_slab_mtx);
+	if (zc->zbuf != NULL) {
+		gpa = zchunk_gpa(ctx, idx);
+		len = zchunk_len(ctx, idx);
+
+		/* writing the data refaults the hole-punched backing pages */
+		if (LZ4_decompress_safe(zc->zbuf, ctx->baseaddr + gpa,
+				zc->zlen, len) != (int)len) {
+			pr_err("mem compress: chunk 0x%lx corrupt\n", gpa);
+			ret = -1;
+		} else {
+			ret = vm_map_memseg_vma(ctx, len, gpa,
+				(uint64_t)(ctx->baseaddr + gpa), PROT_ALL);
+		}
+		if (ret == 0) {
+			zpool_bytes -= zc->zlen;
+			free(zc->zbuf);
+			zc->zbuf = NULL;
+			zc->zlen = 0;
+			zc->idle = 0;
+			pr_dbg("mem compress: restored 0x%lx@0x%lx\n", len, gpa);
+		}
+	}
+	pthread_mutex_unlock(&lazy_slab_mtx);
+
+	return ret;
+}
+
+/* compress one EPT-unmapped chunk and punch its backing, or put the
+ * chunk back into service if that is not worthwhile; lazy_slab_mtx held
+ */
+static void compress_zchunk(struct vmctx *ctx, int idx)
+{
+	struct zchunk *zc = &zchunks[idx];
+	uint64_t gpa = zchunk_gpa(ctx, idx);
+	uint64_t len = zchunk_len(ctx, idx);
+	struct vm_mem_region region;
+	void *zbuf, *shrunk;
+	int zlen;
+
+	zbuf = malloc(LZ4_compressBound(len));
+	if (zbuf == NULL)
+		goto keep;
+
+	zlen = LZ4_compress_default((const char *)(ctx->baseaddr + gpa),
+			zbuf, len, LZ4_compressBound(len));
+	/* skip chunks that would free less than a quarter of their size */
+	if ((zlen <= 0) || ((uint64_t)zlen > (len * 3) / 4)) {
+		free(zbuf);
+		goto keep;
+	}
+
+	if (!vm_find_memfd_region(ctx, gpa, &region) ||
+			(region.fd != hugetlb_priv[HUGETLB_LV1].fd)) {
+		free(zbuf);
+		goto keep;
+	}
+
+	shrunk = realloc(zbuf, zlen);
+	if (shrunk != NULL)
+		zbuf = shrunk;
+
+	/* the memfd is sealed against resizing, not against hole punch */
+	if (fallocate(region.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			region.fd_offset, len) != 0) {
+		pr_warn("mem compress: punch 0x%lx@0x%lx failed: %s\n",
+			len, gpa, strerror(errno));
+		free(zbuf);
+		goto keep;
+	}
+
+	zc->zbuf = zbuf;
+	zc->zlen = zlen;
+	zpool_bytes += zlen;
+	pr_dbg("mem compress: 0x%lx@0x%lx -> %d bytes\n", len, gpa, zlen);
+	return;
+
+keep:
+	if (vm_map_memseg_vma(ctx, len, gpa,
+			(uint64_t)(ctx->baseaddr + gpa), PROT_ALL) != 0)
+		pr_err("mem compress: remap 0x%lx@0x%lx failed\n", len, gpa);
+	zc->idle = 0;
+}
+
+static void *reclaim_thread(void *arg)
+{
+	struct vmctx *ctx = arg;
+	int i, s, idx, ncand;
+
+	while (!reclaim_stop) {
+		for (s = 0; (s < mem_compress_sec) && !reclaim_stop; s++)
+			sleep(1);
+		if (reclaim_stop)
+			break;
+
+		if (vm_dirty_track_harvest(ctx) != 0)
+			break;
+
+		pthread_mutex_lock(&lazy_slab_mtx);
+		ncand = 0;
+		for (i = 0; i < zchunk_num; i++) {
+			struct zchunk *zc = &zchunks[i];
+
+			if (zc->zbuf != NULL)
+				continue;
+			/* nothing to reclaim in never-populated lazy slabs */
+			if (lazy_highmem_on &&
+			    !lazy_slab_mapped[(uint64_t)i *
+					MEM_COMPRESS_CHUNK_SIZE / LAZY_SLAB_SIZE])
+				continue;
+			if (zchunk_was_dirty(ctx, i)) {
+				zc->idle = 0;
+				continue;
+			}
+			if (zc->idle < MEM_COMPRESS_IDLE_ROUNDS) {
+				zc->idle++;
+				continue;
+			}
+			if (vm_unmap_memseg_vma(ctx, zchunk_len(ctx, i),
+					zchunk_gpa(ctx, i)) == 0)
+				zchunk_cand[ncand++] = i;
+		}
+
+		if (ncand > 0) {
+			/* one more harvest catches writes which raced the
+			 * unmap; later writes trap and wait on the mutex in
+			 * highmem_fault() until the chunk is compressed
+			 */
+			bool valid = (vm_dirty_track_harvest(ctx) == 0);
+
+			for (i = 0; i < ncand; i++) {
+				idx = zchunk_cand[i];
+				if (!valid || zchunk_was_dirty(ctx, idx)) {
+					if (vm_map_memseg_vma(ctx,
+							zchunk_len(ctx, idx),
+							zchunk_gpa(ctx, idx),
+							(uint64_t)(ctx->baseaddr +
+							zchunk_gpa(ctx, idx)),
+							PROT_ALL) != 0)
+						pr_err("mem compress: remap 0x%lx failed\n",
+							zchunk_gpa(ctx, idx));
+					zchunks[idx].idle = 0;
+				} else {
+					compress_zchunk(ctx, idx);
+				}
+			}
+			pr_info("mem compress: pool holds %lu bytes\n",
+				zpool_bytes);
+		}
+		pthread_mutex_unlock(&lazy_slab_mtx);
+	}
+
+	return NULL;
+}
+
+int hugetlb_start_mem_compress(struct vmctx *ctx)
+{
+	uint64_t top;
+
+	if (mem_compress_sec == 0)
+		return 0;
+
+	if (ctx->highmem == 0) {
+		pr_warn("mem compress: guest has no highmem, disabled\n");
+		return 0;
+	}
+
+	zchunk_num = (ctx->highmem + MEM_COMPRESS_CHUNK_SIZE - 1) /
+			MEM_COMPRESS_CHUNK_SIZE;
+	zchunks = calloc(zchunk_num, sizeof(*zchunks));
+	zchunk_cand = calloc(zchunk_num, sizeof(*zchunk_cand));
+	top = ctx->highmem_gpa_base + ctx->highmem;
+	dirty_bitmap_size = ALIGN_UP(top / 4096 / 8, 8);
+	dirty_bitmap = calloc(1, dirty_bitmap_size);
+	if ((zchunks == NULL) || (zchunk_cand == NULL) ||
+			(dirty_bitmap == NULL))
+		goto fail;
+
+	if (vm_dirty_track_start(ctx, dirty_bitmap, dirty_bitmap_size) != 0)
+		goto fail;
+
+	/* lazy mode already registered a fallback range over highmem */
+	if (!lazy_highmem_on) {
+		mem_compress_range.name = "mem_compress";
+		mem_compress_range.flags = MEM_F_RW;
+		mem_compress_range.handler = highmem_fault;
+		mem_compress_range.arg1 = NULL;
+		mem_compress_range.arg2 = 0;
+		mem_compress_range.base = ctx->highmem_gpa_base;
+		mem_compress_range.size = ctx->highmem;
+		if (register_mem_fallback(&mem_compress_range) != 0) {
+			pr_err("mem compress: register fallback range failed\n");
+			vm_dirty_track_stop(ctx);
+			goto fail;
+		}
+		mem_compress_range_on = true;
+	}
+
+	mem_compress_on = true;
+	if (pthread_create(&reclaim_tid, NULL, reclaim_thread, ctx) != 0) {
+		pr_err("mem compress: create reclaim thread failed\n");
+		mem_compress_on = false;
+		if (mem_compress_range_on) {
+			unregister_mem_fallback(&mem_compress_range);
+			mem_compress_range_on = false;
+		}
+		vm_dirty_track_stop(ctx);
+		goto fail;
+	}
+	pthread_setname_np(reclaim_tid, "mem_compress");
+	reclaim_thread_running = true;
+
+	return 0;
+
+fail:
+	free(zchunks);
+	zchunks = NULL;
+	free(zchunk_cand);
+	zchunk_cand = NULL;
+	free(dirty_bitmap);
+	dirty_bitmap = NULL;
+	zchunk_num = 0;
+	return -1;
+}
+
+static void mem_compress_cleanup(struct vmctx *ctx)
+{
+	int i;
+
+	if (!mem_compress_on)
+		return;
+
+	if (reclaim_thread_running) {
+		reclaim_stop = true;
+		pthread_join(reclaim_tid, NULL);
+		reclaim_thread_running = false;
+	}
+	vm_dirty_track_stop(ctx);
+	if (mem_compress_range_on) {
+		unregister_mem_fallback(&mem_compress_range);
+		mem_compress_range_on = false;
+	}
+	for (i = 0; i < zchunk_num; i++)
+		free(zchunks[i].zbuf);
+	free(zchunks);
+	zchunks = NULL;
+	free(zchunk_cand);
+	zchunk_cand = NULL;
+	free(dirty_bitmap);
+	dirty_bitmap = NULL;
+	zchunk_num = 0;
+	zpool_bytes = 0;
+	reclaim_stop = false;
+	mem_compress_on = false;
+}
+
+/*
+ * Carve the guest RAM (lowmem below 4G plus highmem above
+ * highmem_gpa_base) into vnuma_nodes equal shares, 2M aligned, and
+ * return the gpa ranges {base, len} belonging to the given node; a
+ * node share straddling the PCI hole yields two ranges. The SRAT
+ * generator and the host-side memory policy below both derive the
+ * node layout from here so they can never disagree.
+ */
+int vnuma_node_ranges(struct vmctx *ctx, int node, uint64_t ranges[2][2])
+{
+	uint64_t total = ctx->lowmem + ctx->highmem;
+	uint64_t share, start, end, off = 0;
+	int i, cnt = 0;
+	struct {
+		uint64_t gpa;
+		uint64_t size;
+	} segs[2] = {
+		{ 0, ctx->lowmem },
+		{ ctx->highmem_gpa_base, ctx->highmem },
+	};
+
+	if (node < 0 || node >= vnuma_nodes || total == 0)
+		return 0;
+
+	share = ALIGN_DOWN(total / vnuma_nodes, 2 * MB);
+	if (share == 0)
+		return 0;
+
+	start = (uint64_t)node * share;
+	end = (node == vnuma_nodes - 1) ? total : start + share;
+
+	for (i = 0; i < 2; i++) {
+		/* linear RAM offsets covered by this segment */
+		uint64_t s = off, e = off + segs[i].size;
+		uint64_t lo = (start > s) ? start : s;
+		uint64_t hi = (end < e) ? end : e;
+
+		if (lo < hi) {
+			ranges[cnt][0] = segs[i].gpa + (lo - s);
+			ranges[cnt][1] = hi - lo;
+			cnt++;
+		}
+		off = e;
+	}
+
+	return cnt;
+}
+
+#define MPOL_BIND	2
+#define MPOL_MF_MOVE	(1 << 1)
+
+/*
+ * Bind every guest node's memory to the same-numbered host node, so
+ * the locality the SRAT promises the guest actually holds on the
+ * machine. Pages already faulted by the populating mmap above are
+ * migrated (MPOL_MF_MOVE); a flat host or a failed mbind only costs
+ * locality, never the boot.
+ */
+static void hugetlb_bind_vnuma(struct vmctx *ctx)
+{
+	uint64_t ranges[2][2];
+	unsigned long nodemask;
+	char path[MAX_PATH_LEN];
+	int node, i, cnt;
+
+	if (vnuma_nodes <= 1)
+		return;
+
+	for (node = 0; node < vnuma_nodes; node++) {
+		snprintf(path, sizeof(path),
+			"/sys/devices/system/node/node%d", node);
+		if (access(path, F_OK) != 0) {
+			pr_warn("vnuma: no host node %d, guest node %d memory left unbound\n",
+				node, node);
+			continue;
+		}
+
+		nodemask = 1UL << node;
+		cnt = vnuma_node_ranges(ctx, node, ranges);
+		for (i = 0; i < cnt; i++) {
+			if (syscall(SYS_mbind,
+				ctx->baseaddr + ranges[i][0], ranges[i][1],
+				MPOL_BIND, &nodemask,
+				sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0)
+				pr_warn("vnuma: mbind node %d gpa 0x%lx+0x%lx failed: %s\n",
+					node, ranges[i][0], ranges[i][1],
+					strerror(errno));
+		}
+	}
+}
+
 int hugetlb_setup_memory(struct vmctx *ctx)
 {
 	int level;
@@ -735,32 +1430,38 @@ int hugetlb_setup_memory(struct vmctx *ctx)
 	pr_info("mmap ptr 0x%p -> baseaddr 0x%p\n", ptr, ctx->baseaddr);
 
 	/* mmap lowmem */
-	if (mmap_hugetlbfs(ctx, 0, get_lowmem_param, adj_lowmem_param, NULL) < 0) {
+	if (mmap_hugetlbfs(ctx, 0, get_lowmem_param, adj_lowmem_param,
+				NULL, true) < 0) {
 		pr_err("lowmem mmap failed");
 		goto err_lock;
 	}
 
-	/* mmap highmem */
+	/* mmap highmem, in lazy mode the slabs are touched on first use */
 	if (mmap_hugetlbfs(ctx, ctx->highmem_gpa_base,
-				get_highmem_param, adj_highmem_param, NULL) < 0) {
+				get_highmem_param, adj_highmem_param,
+				NULL, !lazy_highmem) < 0) {
 		pr_err("highmem mmap failed");
 		goto err_lock;
 	}
 
 	/* mmap biosmem */
 	if (mmap_hugetlbfs(ctx, 4 * GB - ctx->biosmem,
-				get_biosmem_param, adj_biosmem_param, NULL) < 0) {
+				get_biosmem_param, adj_biosmem_param,
+				NULL, true) < 0) {
 		pr_err("biosmem mmap failed");
 		goto err_lock;
 	}
 
 	/* mmap fbmem */
 	if (mmap_hugetlbfs(ctx, 4 * GB - ctx->biosmem - ctx->fbmem,
-		get_fbmem_param, adj_fbmem_param, (char **)&ctx->fb_base) < 0) {
+		get_fbmem_param, adj_fbmem_param, (char **)&ctx->fb_base, true) < 0) {
 		pr_err("fbmem mmap failed");
 		goto err_lock;
 	}
 
+	/* place each guest node's RAM on the matching host node */
+	hugetlb_bind_vnuma(ctx);
+
 	/* resize the memfd to meet with the size requirement and add the
 	 * F_SEAL_SEAL flag
 	 */
@@ -818,7 +1519,21 @@ int hugetlb_setup_memory(struct vmctx *ctx)
 
 	/* map ept for highmem */
 	if (ctx->highmem > 0) {
-		if (vm_map_memseg_vma(ctx, ctx->highmem, ctx->highmem_gpa_base,
+		if (lazy_highmem) {
+			/*
+			 * Defer the EPT mapping to first touch; the fault
+			 * handler and the populate thread are started by
+			 * hugetlb_start_lazy_highmem() once init_mem() has
+			 * set up the MMIO range trees.
+			 */
+			lazy_slab_num = (ctx->highmem + LAZY_SLAB_SIZE - 1) /
+					LAZY_SLAB_SIZE;
+			lazy_slab_mapped = calloc(lazy_slab_num,
+					sizeof(uint8_t));
+			if (lazy_slab_mapped == NULL)
+				goto err;
+			lazy_highmem_on = true;
+		} else if (vm_map_memseg_vma(ctx, ctx->highmem, ctx->highmem_gpa_base,
 			(uint64_t)(ctx->baseaddr + ctx->highmem_gpa_base),
 			PROT_ALL) < 0)
 			goto err;
@@ -844,6 +1559,9 @@ void hugetlb_unsetup_memory(struct vmctx *ctx)
 {
 	int level;
 
+	mem_compress_cleanup(ctx);
+	lazy_highmem_cleanup();
+
 	if (total_size > 0) {
 		munmap(ptr, total_size);
 		total_size = 0;
@@ -883,6 +1601,70 @@ vm_find_memfd_region(struct vmctx *ctx, vm_paddr_t gpa,
 	return ret;
 }
 
+/*
+ * fallocate() over the hugetlbfs files backing [gpa, gpa + len), crossing
+ * region boundaries when the range spans several mmap'ed segments.  The
+ * kernel only releases (or allocates) huge pages fully covered by the
+ * range; 4K-granular callers get a best-effort result on the edges.
+ */
+static int hugetlb_fallocate_gpa_range(struct vmctx *ctx, vm_paddr_t gpa,
+		size_t len, int mode)
+{
+	struct vm_mmap_mem_region *region;
+	size_t chunk;
+	int i;
+
+	while (len > 0) {
+		region = NULL;
+		for (i = 0; i < mem_idx; i++) {
+			if ((gpa >= mmap_mem_regions[i].gpa_start) &&
+				(gpa < mmap_mem_regions[i].gpa_end)) {
+				region = &mmap_mem_regions[i];
+				break;
+			}
+		}
+		if (region == NULL) {
+			pr_err("%s: gpa 0x%lx is not backed by hugetlbfs\n",
+				__func__, gpa);
+			return -EINVAL;
+		}
+
+		chunk = region->gpa_end - gpa;
+		if (chunk > len)
+			chunk = len;
+
+		if (fallocate(region->fd, mode,
+				region->fd_offset + (gpa - region->gpa_start),
+				chunk) < 0) {
+			pr_err("%s: fallocate(0x%x) 0x%lx@0x%lx failed: %s\n",
+				__func__, mode, chunk, gpa, strerror(errno));
+			return -errno;
+		}
+
+		gpa += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+/* release the huge pages backing [gpa, gpa + len) back to the host pool */
+int hugetlb_punch_gpa_hole(struct vmctx *ctx, vm_paddr_t gpa, size_t len)
+{
+	return hugetlb_fallocate_gpa_range(ctx, gpa, len,
+			FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE);
+}
+
+/*
+ * Re-allocate the backing pages of a previously punched range.  Unlike a
+ * plain touch of the mapping, an allocation failure is reported as -ENOMEM
+ * instead of a SIGBUS on first guest access.
+ */
+int hugetlb_plug_gpa_hole(struct vmctx *ctx, vm_paddr_t gpa, size_t len)
+{
+	return hugetlb_fallocate_gpa_range(ctx, gpa, len, 0);
+}
+
 bool vm_allow_dmabuf(struct vmctx *ctx)
 {
 	uint32_t mem_flags;
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Guest launch-phase timeline.
+ *
+ * The launch path records a mark when each phase completes (hugetlb
+ * setup, memory setup, every PCI device init, ACPI build, sw_load,
+ * vCPU start), and launch_prof_report() prints the whole timeline once
+ * the guest is running, merged with the stamps the hypervisor recorded
+ * in create_vm()/launch_vcpu() and fetched via
+ * ACRN_IOCTL_GET_LAUNCH_PROFILE.
+ *
+ * Hypervisor stamps are TSC values; they are placed on the same
+ * timeline by pairing one RDTSC reading with CLOCK_MONOTONIC at report
+ * time and converting through the TSC frequency the hypervisor
+ * reports.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "vmmapi.h"
+#include "launch_prof.h"
+#include "log.h"
+
+#define LPROF_MAX_MARKS		128
+#define LPROF_LABEL_LEN		48
+
+static struct {
+	uint64_t ns;
+	char label[LPROF_LABEL_LEN];
+} lprof_marks[LPROF_MAX_MARKS];
+
+static int lprof_nmarks;
+static int lprof_dropped;
+
+static uint64_t
+lprof_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t
+lprof_rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32U) | lo;
+}
+
+void
+launch_prof_mark(const char *fmt, ...)
+{
+	va_list args;
+
+	if (lprof_nmarks >= LPROF_MAX_MARKS) {
+		lprof_dropped++;
+		return;
+	}
+
+	lprof_marks[lprof_nmarks].ns = lprof_now_ns();
+	va_start(args, fmt);
+	vsnprintf(lprof_marks[lprof_nmarks].label, LPROF_LABEL_LEN, fmt, args);
+	va_end(args);
+	lprof_nmarks++;
+}
+
+/* map a hypervisor TSC stamp onto the CLOCK_MONOTONIC timeline */
+static uint64_t
+lprof_tsc_to_ns(uint64_t tsc, uint64_t now_tsc, uint64_t now_ns,
+		uint32_t tsc_khz)
+{
+	uint64_t behind_ns;
+
+	if (tsc == 0 || tsc > now_tsc)
+		return 0;
+
+	behind_ns = ((now_tsc - tsc) * 1000000UL) / tsc_khz;
+	return (behind_ns > now_ns) ? 0 : (now_ns - behind_ns);
+}
+
+static void
+lprof_print_row(uint64_t ns, uint64_t base_ns, uint64_t prev_ns,
+		const char *who, const char *label)
+{
+	pr_notice("  %9.3f  +%8.3f  %-3s %s\n",
+		  (double)(ns - base_ns) / 1e6,
+		  (double)(ns - prev_ns) / 1e6,
+		  who, label);
+}
+
+void
+launch_prof_report(struct vmctx *ctx)
+{
+	struct acrn_vm_launch_profile hv;
+	uint64_t base_ns, prev_ns, now_ns, now_tsc;
+	uint64_t hv_ns[3];
+	const char *hv_label[3] = {
+		"create_vm entry", "create_vm done", "first vcpu launch"
+	};
+	int i, have_hv;
+
+	if (lprof_nmarks == 0)
+		return;
+
+	now_tsc = lprof_rdtsc();
+	now_ns = lprof_now_ns();
+
+	memset(&hv, 0, sizeof(hv));
+	have_hv = (vm_get_launch_profile(ctx, &hv) == 0 && hv.tsc_khz != 0);
+	if (have_hv) {
+		hv_ns[0] = lprof_tsc_to_ns(hv.create_vm_entry, now_tsc,
+					   now_ns, hv.tsc_khz);
+		hv_ns[1] = lprof_tsc_to_ns(hv.create_vm_exit, now_tsc,
+					   now_ns, hv.tsc_khz);
+		hv_ns[2] = lprof_tsc_to_ns(hv.first_vcpu_launch, now_tsc,
+					   now_ns, hv.tsc_khz);
+	}
+
+	base_ns = lprof_marks[0].ns;
+	prev_ns = base_ns;
+
+	pr_notice("guest launch timeline (ms since first mark, +delta):\n");
+	for (i = 0; i < lprof_nmarks; i++) {
+		/* interleave hypervisor rows at their place in time */
+		if (have_hv) {
+			int j;
+
+			for (j = 0; j < 3; j++) {
+				if (hv_ns[j] != 0 && hv_ns[j] >= prev_ns &&
+				    hv_ns[j] <= lprof_marks[i].ns) {
+					lprof_print_row(hv_ns[j], base_ns,
+						prev_ns, "hv", hv_label[j]);
+					prev_ns = hv_ns[j];
+					hv_ns[j] = 0;
+				}
+			}
+		}
+		lprof_print_row(lprof_marks[i].ns, base_ns, prev_ns,
+				"dm", lprof_marks[i].label);
+		prev_ns = lprof_marks[i].ns;
+	}
+	if (have_hv) {
+		/* stamps later than the last mark (e.g. vcpu launch) */
+		for (i = 0; i < 3; i++) {
+			if (hv_ns[i] != 0 && hv_ns[i] >= prev_ns) {
+				lprof_print_row(hv_ns[i], base_ns, prev_ns,
+						"hv", hv_label[i]);
+				prev_ns = hv_ns[i];
+			}
+		}
+	} else {
+		pr_notice("  (hypervisor launch profile unavailable)\n");
+	}
+	if (lprof_dropped != 0)
+		pr_notice("  (%d marks dropped)\n", lprof_dropped);
+
+	/* start a fresh timeline for a reboot of the guest */
+	lprof_nmarks = 0;
+	lprof_dropped = 0;
+}
@@ -37,9 +37,11 @@
 #include <sysexits.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "vmmapi.h"
 #include "sw_load.h"
+#include "snapshot.h"
 #include "cpuset.h"
 #include "dm.h"
 #include "acpi.h"
@@ -66,10 +68,12 @@
 #include "virtio.h"
 #include "pm_vuart.h"
 #include "log.h"
+#include "launch_prof.h"
 #include "pci_util.h"
 #include "vssram.h"
 #include "cmd_monitor.h"
 #include "vdisplay.h"
+#include "stallmon.h"
 
 #define	VM_MAXCPU		16	/* maximum virtual cpus */
 
@@ -94,6 +98,9 @@ uint8_t trusty_enabled;
 bool stdio_in_use;
 bool lapic_pt;
 bool is_rtvm;
+bool lazy_highmem;
+int mem_compress_sec;
+static int stall_watchdog_sec;
 bool pt_tpm2;
 bool ssram;
 bool vtpm2;
@@ -101,11 +108,17 @@ bool is_winvm;
 bool skip_pci_mem64bar_workaround = false;
 bool gfx_ui = false;
 
-static int guest_ncpus;
+int guest_ncpus;
+int vnuma_nodes = 1;
 static int virtio_msix = 1;
 static bool debugexit_enabled;
 static int pm_notify_channel;
 static bool cmd_monitor;
+static bool ioreq_poll_enabled;
+static int ioreq_poll_pcpu = -1;
+static bool ioreq_affinity_enabled;
+static bool ioreq_prio_enabled;
+static bool ioreq_rt_boost_enabled;
 
 static char *progname;
 static const int BSP;
@@ -148,10 +161,13 @@ usage(int code)
 		"       %*s [-s pci] [--ovmf ovmf_file_path]\n"
 		"       %*s [--enable_trusty] [--intr_monitor param_setting]\n"
 		"       %*s [--acpidev_pt HID] [--mmiodev_pt MMIO_Regions]\n"
-		"       %*s [--vtpm2 sock_path] [--virtio_poll interval]\n"
+		"       %*s [--vtpm2 sock_path] [--virtio_poll interval] [--polling devname[@pcpu]]\n"
 		"       %*s [--cpu_affinity lapic_id] [--lapic_pt] [--rtvm] [--windows]\n"
 		"       %*s [--debugexit] [--logger_setting param_setting]\n"
-		"       %*s [--ssram] <vm>\n"
+		"       %*s [--ssram] [--lazy_highmem] [--ioreq_poll pcpu_id] [--ioreq_affinity]\n"
+		"       %*s [--ioreq_prio] [--ioreq_rt_boost] [--virtio_doorbell]\n"
+		"       %*s [--stall_watchdog timeout] [--keepalive]\n"
+		"       %*s [--resume snapshot_file] [--fork template_file] <vm>\n"
 		"       -B: bootargs for kernel\n"
 		"       -E: elf image path\n"
 		"       -h: help\n"
@@ -172,6 +188,18 @@ usage(int code)
 		"       --cmd_monitor: enable command monitor\n"
 		"            its params: unix domain socket path\n"
 		"       --virtio_poll: enable virtio poll mode with poll interval with ns\n"
+		"       --polling: busy-poll the avail rings of the given virtio device type\n"
+		"            (e.g. virtio-console), optionally pinning the poller to pcpu\n"
+		"       --ioreq_poll: busy-poll I/O requests on the given host pcpu instead\n"
+		"            of sleeping in the HSM, trading a dedicated core for latency\n"
+		"       --ioreq_affinity: follow the hypervisor's placement hints and keep\n"
+		"            the ioreq service thread on the same cpu as its busiest client\n"
+		"       --ioreq_prio: service latency-sensitive (PIO/PCI cfg) and bulk (MMIO)\n"
+		"            requests from separate threads, with aging against starvation\n"
+		"       --ioreq_rt_boost: elevate the ioreq thread to SCHED_FIFO while it\n"
+		"            services requests from RT vCPUs, dropping back afterwards\n"
+		"       --virtio_doorbell: back the notify window of busy-polled virtio\n"
+		"            devices with guest-writable RAM, making kicks exit-free\n"
 		"       --acpidev_pt: acpi device ID args: HID in ACPI Table\n"
 		"       --mmiodev_pt: MMIO resources args: physical MMIO regions\n"
 		"       --vtpm2: Virtual TPM2 args: sock_path=$PATH_OF_SWTPM_SOCKET\n"
@@ -180,12 +208,27 @@ usage(int code)
 		"       --logger_setting: params like console,level=4;kmsg,level=3\n"
 		"       --windows: support Oracle virtio-blk, virtio-net and virtio-input devices\n"
 		"            for windows guest with secure boot\n"
-		"       --virtio_msi: force virtio to use single-vector MSI\n",
+		"       --virtio_msi: force virtio to use single-vector MSI\n"
+		"       --lazy_highmem: map guest RAM above 4G on first touch instead of up front\n"
+		"       --vnuma: expose the given number of NUMA nodes to the guest via SRAT/SLIT,\n"
+		"            striping vCPUs and RAM evenly across them\n"
+		"       --mem_compress: scan guest RAM above 4G every given number of seconds and\n"
+		"            compress ranges the guest has not touched, restoring them on access\n"
+		"       --stall_watchdog: report worker threads busy on one work item for more\n"
+		"            than the given number of seconds, escalating to life_mngr\n"
+		"       --keepalive: on guest poweroff or reset, restart the guest in place\n"
+		"            instead of exiting, keeping memory and ioreq setup warm\n"
+		"       --resume: restore guest state from a snapshot image taken with the\n"
+		"            command monitor snapshot command\n"
+		"       --fork: provision a clone from a template snapshot image; implies\n"
+		"            lazy highmem pulled strictly on guest demand, so clones start\n"
+		"            in tens of ms and cost only their touched memory\n",
 		progname, (int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "",
 		(int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "",
 		(int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "",
 		(int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "",
-		(int)strnlen(progname, PATH_MAX), "");
+		(int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "",
+		(int)strnlen(progname, PATH_MAX), "", (int)strnlen(progname, PATH_MAX), "");
 
 	exit(code);
 }
@@ -217,7 +260,7 @@ print_version(void)
 void *
 paddr_guest2host(struct vmctx *ctx, uintptr_t gaddr, size_t len)
 {
-	return vm_map_gpa(ctx, gaddr, len);
+	return vm_gpa2hva(ctx, gaddr, len);
 }
 
 int
@@ -393,7 +436,7 @@ static vmexit_handler_t handler[VM_EXITCODE_MAX] = {
 	[VM_EXITCODE_PCI_CFG] = vmexit_pci_emul,
 };
 
-static void
+static int
 handle_vmexit(struct vmctx *ctx, struct acrn_io_request *io_req, int vcpu)
 {
 	enum vm_exitcode exitcode;
@@ -416,9 +459,9 @@ handle_vmexit(struct vmctx *ctx, struct acrn_io_request *io_req, int vcpu)
 	 */
 	if ((VM_SUSPEND_SYSTEM_RESET == vm_get_suspend_mode()) ||
 		(VM_SUSPEND_SUSPEND == vm_get_suspend_mode()))
-		return;
+		return -1;
 
-	vm_notify_request_done(ctx, vcpu);
+	return 0;
 }
 
 static int
@@ -570,12 +613,24 @@ vm_deinit_vdevs(struct vmctx *ctx)
 static void
 vm_reset_vdevs(struct vmctx *ctx)
 {
+	bool fast_reset = false;
+
 	/*
 	 * Write ovmf NV storage back to the original file from guest
 	 * memory before deinit operations.
 	 */
 	acrn_writeback_ovmf_nvstorage(ctx);
 
+	/*
+	 * Under --keepalive try to reset the PCI devices in place: BAR
+	 * and interrupt assignments survive, so the pci/ioapic
+	 * deinit/init cycle and the acpi rebuild below are skipped.
+	 * The fast path only engages when every instantiated device
+	 * class implements the reset-fast callback.
+	 */
+	if (vm_get_keepalive())
+		fast_reset = (pci_reset_devices_fast(ctx) == 0);
+
 	/*
 	 * The current virtual devices doesn't define virtual
 	 * device reset function. So we call vdev deinit/init
@@ -599,11 +654,13 @@ vm_reset_vdevs(struct vmctx *ctx)
 	vpit_deinit(ctx);
 	vrtc_deinit(ctx);
 
-	deinit_pci(ctx);
-	pci_irq_deinit(ctx);
-	ioapic_deinit();
+	if (!fast_reset) {
+		deinit_pci(ctx);
+		pci_irq_deinit(ctx);
+		ioapic_deinit();
 
-	pci_irq_init(ctx);
+		pci_irq_init(ctx);
+	}
 	atkbdc_init(ctx);
 	vrtc_init(ctx);
 	vpit_init(ctx);
@@ -615,10 +672,12 @@ vm_reset_vdevs(struct vmctx *ctx)
 	if (ssram)
 		init_vssram(ctx);
 
-	ioapic_init(ctx);
-	init_pci(ctx);
+	if (!fast_reset) {
+		ioapic_init(ctx);
+		init_pci(ctx);
 
-	acpi_build(ctx, guest_ncpus);
+		acpi_build(ctx, guest_ncpus);
+	}
 }
 
 static void
@@ -693,6 +752,324 @@ vm_suspend_resume(struct vmctx *ctx)
 	vm_run(ctx);
 }
 
+/*
+ * Latency-class servicing (--ioreq_prio): the hypervisor stamps each
+ * request as latency-sensitive (PIO/PCI cfg, the vCPU typically spins on
+ * the result) or bulk (MMIO). The main ioreq thread keeps the latency
+ * class and hands bulk requests to a dedicated worker, so a slow MMIO
+ * handler no longer delays a trivial PIO read sitting in a neighbouring
+ * request slot. Starvation is bounded by aging: once the oldest queued
+ * bulk request exceeds IOREQ_BULK_AGING_US the main thread reclaims and
+ * services it inline instead of leaving it behind a wedged worker.
+ */
+#define IOREQ_BULK_AGING_US	2000
+
+static pthread_mutex_t bulk_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bulk_cv = PTHREAD_COND_INITIALIZER;
+static int bulk_queue[VM_MAXCPU];
+static uint64_t bulk_enq_us[VM_MAXCPU];
+static int bulk_head, bulk_cnt;
+/* set while a slot is queued for or being serviced by the bulk worker */
+static bool bulk_inflight[VM_MAXCPU];
+static struct vmctx *bulk_ctx;
+
+static uint64_t
+mono_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000UL + (uint64_t)ts.tv_nsec / 1000UL;
+}
+
+static void
+bulk_service(int vcpu_id)
+{
+	int done;
+
+	done = handle_vmexit(bulk_ctx, &ioreq_buf[vcpu_id], vcpu_id);
+
+	/* clear before notifying: the guest cannot refill the slot until
+	 * the completion is posted, so the main thread never sees a new
+	 * request in a slot still marked in flight
+	 */
+	pthread_mutex_lock(&bulk_mtx);
+	bulk_inflight[vcpu_id] = false;
+	pthread_mutex_unlock(&bulk_mtx);
+
+	if (done == 0)
+		vm_notify_request_done(bulk_ctx, vcpu_id);
+}
+
+/* called from the main ioreq thread only */
+static void
+bulk_enqueue(int vcpu_id)
+{
+	pthread_mutex_lock(&bulk_mtx);
+	if (!bulk_inflight[vcpu_id]) {
+		int tail = (bulk_head + bulk_cnt) % VM_MAXCPU;
+
+		bulk_inflight[vcpu_id] = true;
+		bulk_queue[tail] = vcpu_id;
+		bulk_enq_us[tail] = mono_us();
+		bulk_cnt++;
+		pthread_cond_signal(&bulk_cv);
+	}
+	pthread_mutex_unlock(&bulk_mtx);
+}
+
+/* reclaim the oldest bulk request once it has aged past the bound */
+static void
+bulk_reclaim_aged(void)
+{
+	int vcpu_id = -1;
+
+	pthread_mutex_lock(&bulk_mtx);
+	if ((bulk_cnt > 0) &&
+	    ((mono_us() - bulk_enq_us[bulk_head]) > IOREQ_BULK_AGING_US)) {
+		vcpu_id = bulk_queue[bulk_head];
+		bulk_head = (bulk_head + 1) % VM_MAXCPU;
+		bulk_cnt--;
+	}
+	pthread_mutex_unlock(&bulk_mtx);
+
+	if (vcpu_id >= 0)
+		bulk_service(vcpu_id);
+}
+
+static void *
+bulk_thread(void *arg __attribute__((unused)))
+{
+	int vcpu_id;
+
+	for (;;) {
+		pthread_mutex_lock(&bulk_mtx);
+		while (bulk_cnt == 0)
+			pthread_cond_wait(&bulk_cv, &bulk_mtx);
+		vcpu_id = bulk_queue[bulk_head];
+		bulk_head = (bulk_head + 1) % VM_MAXCPU;
+		bulk_cnt--;
+		pthread_mutex_unlock(&bulk_mtx);
+
+		bulk_service(vcpu_id);
+	}
+	return NULL;
+}
+
+/*
+ * Priority propagation (--ioreq_rt_boost): the hypervisor stamps each
+ * request with the requestor's scheduling class; while the ioreq thread
+ * services requests from an RT vCPU it runs SCHED_FIFO so bulk Service
+ * VM work (compile jobs and the like) cannot preempt it and invert
+ * priority across the VM boundary. The boost is dropped as soon as the
+ * batch holds no RT request, so the thread never monopolizes a core.
+ */
+#define IOREQ_RT_BOOST_PRIO	1
+
+static bool rt_boosted;
+static uint64_t rt_window_start_us;
+static uint64_t rt_boost_cnt;		/* SCHED_FIFO elevations */
+static uint64_t rt_boosted_us;		/* RT service time, elevated */
+static uint64_t rt_inversion_us;	/* RT service time at default prio */
+static uint64_t rt_inversion_cnt;	/* inverted service windows */
+
+static void
+ioreq_rt_boost(bool want)
+{
+	struct sched_param sp = { .sched_priority = want ? IOREQ_RT_BOOST_PRIO : 0 };
+
+	if (!ioreq_rt_boost_enabled || (want == rt_boosted))
+		return;
+
+	if (pthread_setschedparam(pthread_self(),
+			want ? SCHED_FIFO : SCHED_OTHER, &sp)) {
+		/* no privilege for RT scheduling; stop trying */
+		pr_warn("%s, failed to set ioreq thread policy, errno %d\n",
+			__func__, errno);
+		ioreq_rt_boost_enabled = false;
+	} else {
+		rt_boosted = want;
+		if (want)
+			rt_boost_cnt++;
+	}
+}
+
+/* called when a request stamped ACRN_IOREQ_REQUESTOR_RT enters service */
+static void
+ioreq_rt_service_begin(void)
+{
+	if (rt_window_start_us == 0)
+		rt_window_start_us = mono_us();
+	ioreq_rt_boost(true);
+}
+
+/* close the RT service window after the batch; time spent servicing RT
+ * requests without the boost in effect is recorded as inversion time */
+static void
+ioreq_rt_service_end(void)
+{
+	uint64_t span;
+
+	if (rt_window_start_us != 0) {
+		span = mono_us() - rt_window_start_us;
+		if (rt_boosted) {
+			rt_boosted_us += span;
+		} else {
+			rt_inversion_us += span;
+			rt_inversion_cnt++;
+		}
+		rt_window_start_us = 0;
+	}
+	ioreq_rt_boost(false);
+}
+
+#define IOREQ_POLL_SPIN_COUNT	(100 * 1000)
+#define IOREQ_POLL_MAX_SLEEP_US	1000
+
+/*
+ * Busy-poll the shared I/O request page instead of sleeping in the
+ * ATTACH ioctl. The HSM marks a slot ACRN_IOREQ_STATE_PROCESSING from
+ * its upcall handler well before the client thread would have been
+ * woken up, so spinning here removes the wakeup from the
+ * exit-to-dispatch path. Back off to short sleeps while the guest is
+ * quiet so an idle VM does not keep the host core at 100%.
+ */
+static void
+ioreq_poll_wait(void)
+{
+	useconds_t backoff = 1;
+	int vcpu_id, spin;
+
+	for (spin = 0; ; spin++) {
+		for (vcpu_id = 0; vcpu_id < guest_ncpus; vcpu_id++)
+			if ((atomic_load(&ioreq_buf[vcpu_id].processed) ==
+					ACRN_IOREQ_STATE_PROCESSING) &&
+			    !bulk_inflight[vcpu_id])
+				return;
+
+		if (vm_get_suspend_mode() != VM_SUSPEND_NONE)
+			return;
+
+		if (spin < IOREQ_POLL_SPIN_COUNT) {
+			__builtin_ia32_pause();
+			continue;
+		}
+
+		usleep(backoff);
+		if (backoff < IOREQ_POLL_MAX_SLEEP_US)
+			backoff *= 2;
+	}
+}
+
+#define IOREQ_SPIN_GROW_START_US	10UL
+#define IOREQ_SPIN_MAX_US		200UL
+/* blocking waits longer than this mean the guest went quiet */
+#define IOREQ_SPIN_IDLE_US		2000UL
+
+static bool
+ioreq_pending_scan(void)
+{
+	int vcpu_id;
+
+	for (vcpu_id = 0; vcpu_id < guest_ncpus; vcpu_id++) {
+		struct acrn_io_request *io_req = &ioreq_buf[vcpu_id];
+
+		if ((atomic_load(&io_req->processed) ==
+				ACRN_IOREQ_STATE_PROCESSING) &&
+		    !io_req->kernel_handled && !bulk_inflight[vcpu_id])
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Hybrid wait for the next request batch: spin on the shared ioreq page
+ * for a short budget before falling back to the blocking ATTACH ioctl.
+ * The HSM marks a slot PROCESSING from its upcall handler well before
+ * this thread would have been woken up through the kernel, so a request
+ * arriving inside the spin window skips the whole wakeup path.
+ *
+ * The budget is tuned from how long each wait actually took, the same
+ * way the hypervisor tunes halt-polling: a wait satisfied shortly after
+ * the spin expired means a slightly longer spin would have caught it,
+ * so the budget doubles; a long blocking wait means the guest is quiet
+ * and the budget collapses to zero, so an idle VM costs no host cpu.
+ */
+static int
+ioreq_hybrid_wait(struct vmctx *ctx)
+{
+	static uint64_t spin_budget_us;
+	uint64_t start = mono_us();
+	uint64_t waited;
+	int error;
+
+	while ((mono_us() - start) < spin_budget_us) {
+		if (ioreq_pending_scan())
+			return 0;
+		if (vm_get_suspend_mode() != VM_SUSPEND_NONE)
+			return 0;
+		__builtin_ia32_pause();
+	}
+
+	error = vm_attach_ioreq_client(ctx);
+
+	waited = mono_us() - start;
+	if (waited < IOREQ_SPIN_IDLE_US) {
+		if (spin_budget_us == 0UL)
+			spin_budget_us = IOREQ_SPIN_GROW_START_US;
+		else if (spin_budget_us < IOREQ_SPIN_MAX_US) {
+			spin_budget_us *= 2UL;
+			if (spin_budget_us > IOREQ_SPIN_MAX_US)
+				spin_budget_us = IOREQ_SPIN_MAX_US;
+		}
+	} else {
+		spin_budget_us = 0UL;
+	}
+	return error;
+}
+
+#define IOREQ_AFFINITY_STREAK	64
+
+/*
+ * Follow the placement hint the hypervisor stamps into each request
+ * (client_pcpu_id) and keep the ioreq service thread on the same cpu as
+ * its busiest client vCPU, so completion wakeups stay core-local instead
+ * of crossing sockets. Re-pin only after a long streak of hints pointing
+ * at the same cpu; a vCPU bouncing between cores must not drag this
+ * thread along with it.
+ */
+static void
+ioreq_affinity_update(int hint)
+{
+	static int cur_cpu = -1, cand_cpu = -1, streak;
+	cpuset_t mask;
+
+	if (hint == cur_cpu) {
+		streak = 0;
+		return;
+	}
+
+	if (hint != cand_cpu) {
+		cand_cpu = hint;
+		streak = 0;
+	}
+
+	if (++streak < IOREQ_AFFINITY_STREAK)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cand_cpu, &mask);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask)) {
+		/* hinted cpu is not in the Service VM; stop trying */
+		pr_warn("%s, failed to move ioreq thread to cpu %d\n",
+			__func__, cand_cpu);
+		ioreq_affinity_enabled = false;
+	} else {
+		cur_cpu = cand_cpu;
+	}
+	streak = 0;
+}
+
 static void
 vm_loop(struct vmctx *ctx)
 {
@@ -704,29 +1081,111 @@ vm_loop(struct vmctx *ctx)
 		return;
 	}
 
+	if (ioreq_poll_enabled && ioreq_affinity_enabled) {
+		pr_warn("%s, --ioreq_affinity ignored with --ioreq_poll\n",
+			__func__);
+		ioreq_affinity_enabled = false;
+	}
+
+	if (ioreq_poll_enabled) {
+		cpuset_t poll_mask;
+
+		CPU_ZERO(&poll_mask);
+		CPU_SET(ioreq_poll_pcpu, &poll_mask);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(poll_mask),
+				&poll_mask))
+			pr_warn("%s, failed to pin ioreq thread to pcpu %d\n",
+				__func__, ioreq_poll_pcpu);
+	}
+
+	if (ioreq_prio_enabled) {
+		pthread_t bulk_tid;
+
+		bulk_ctx = ctx;
+		if (pthread_create(&bulk_tid, NULL, bulk_thread, NULL)) {
+			pr_warn("%s, failed to create bulk ioreq thread\n",
+				__func__);
+			ioreq_prio_enabled = false;
+		} else {
+			pthread_setname_np(bulk_tid, "ioreq_bulk");
+		}
+	}
+
 	if (vm_run(ctx) != 0) {
 		pr_err("%s, failed to run VM.\n", __func__);
 		return;
 	}
 
+	launch_prof_mark("vm_run");
+	launch_prof_report(ctx);
+
 	while (1) {
-		int vcpu_id;
+		int vcpu_id, i;
+		int completed[VM_MAXCPU];
+		int nr_completed = 0;
 		struct acrn_io_request *io_req;
 
-		error = vm_attach_ioreq_client(ctx);
-		if (error)
-			break;
+		if (ioreq_poll_enabled) {
+			ioreq_poll_wait();
+		} else {
+			error = ioreq_hybrid_wait(ctx);
+			if (error)
+				break;
+		}
 
+		/*
+		 * Drain every request slot first and reap the completions in one
+		 * batch afterwards, so N pending requests cost one notification
+		 * round-trip instead of N.
+		 */
 		for (vcpu_id = 0; vcpu_id < guest_ncpus; vcpu_id++) {
 			io_req = &ioreq_buf[vcpu_id];
 			if ((atomic_load(&io_req->processed) == ACRN_IOREQ_STATE_PROCESSING)
-				&& !io_req->kernel_handled)
-				handle_vmexit(ctx, io_req, vcpu_id);
+				&& !io_req->kernel_handled) {
+				if (ioreq_affinity_enabled)
+					ioreq_affinity_update((int)io_req->client_pcpu_id);
+				/* RT requests stay on this (boostable) thread
+				 * even when their latency class is bulk */
+				if (ioreq_prio_enabled &&
+				    (io_req->latency_class == ACRN_IOREQ_CLASS_BULK) &&
+				    (io_req->requestor_class != ACRN_IOREQ_REQUESTOR_RT)) {
+					bulk_enqueue(vcpu_id);
+					continue;
+				}
+				if (io_req->requestor_class == ACRN_IOREQ_REQUESTOR_RT)
+					ioreq_rt_service_begin();
+				if (handle_vmexit(ctx, io_req, vcpu_id) == 0)
+					completed[nr_completed++] = vcpu_id;
+			}
+		}
+
+		ioreq_rt_service_end();
+
+		if (ioreq_prio_enabled)
+			bulk_reclaim_aged();
+
+		if ((nr_completed <= 1) || (vm_notify_all_request_done(ctx) != 0)) {
+			for (i = 0; i < nr_completed; i++)
+				vm_notify_request_done(ctx, completed[i]);
 		}
 
 		if (VM_SUSPEND_FULL_RESET == vm_get_suspend_mode() ||
 		    VM_SUSPEND_POWEROFF == vm_get_suspend_mode()) {
-			break;
+			/*
+			 * --keepalive: restart the guest in place instead of
+			 * tearing the DM down.  The HSM fd, memory mapping,
+			 * ioreq client and monitor socket stay warm; only the
+			 * device models are reset and the guest images
+			 * reloaded, so restart cost is the sw_load time.
+			 * Explicit stop paths clear keepalive first and still
+			 * break out here.
+			 */
+			if (vm_get_keepalive() && !is_rtvm) {
+				pr_info("%s: keepalive restart\n", __func__);
+				vm_system_reset(ctx);
+			} else {
+				break;
+			}
 		}
 
 		/* RTVM can't be reset */
@@ -738,6 +1197,11 @@ vm_loop(struct vmctx *ctx)
 			vm_suspend_resume(ctx);
 		}
 	}
+	if ((rt_boost_cnt != 0) || (rt_inversion_cnt != 0))
+		pr_info("ioreq rt service: %lu boosts (%lu us), "
+			"%lu inverted windows (%lu us)\n",
+			rt_boost_cnt, rt_boosted_us,
+			rt_inversion_cnt, rt_inversion_us);
 	pr_err("VM loop exit\n");
 }
 
@@ -755,6 +1219,8 @@ sig_handler_term(int signo)
 {
 	pr_info("Received SIGINT to terminate application...\n");
 	pr_info("%s: setting VM state to %s\n", __func__, vm_state_to_str(VM_SUSPEND_POWEROFF));
+	/* a signal is an operator request to exit, not a guest restart */
+	vm_set_keepalive(false);
 	vm_set_suspend_mode(VM_SUSPEND_POWEROFF);
 	mevent_notify();
 }
@@ -766,6 +1232,9 @@ enum {
 	CMD_OPT_PART_INFO,
 	CMD_OPT_TRUSTY_ENABLE,
 	CMD_OPT_VIRTIO_POLL_ENABLE,
+	CMD_OPT_POLLING,
+	CMD_OPT_RESUME,
+	CMD_OPT_FORK,
 	CMD_OPT_MAC_SEED,
 	CMD_OPT_DEBUGEXIT,
 	CMD_OPT_VMCFG,
@@ -783,6 +1252,16 @@ enum {
 	CMD_OPT_PM_BY_VUART,
 	CMD_OPT_WINDOWS,
 	CMD_OPT_FORCE_VIRTIO_MSI,
+	CMD_OPT_LAZY_HIGHMEM,
+	CMD_OPT_IOREQ_POLL,
+	CMD_OPT_IOREQ_AFFINITY,
+	CMD_OPT_IOREQ_PRIO,
+	CMD_OPT_IOREQ_RT_BOOST,
+	CMD_OPT_VIRTIO_DOORBELL,
+	CMD_OPT_VNUMA,
+	CMD_OPT_MEM_COMPRESS,
+	CMD_OPT_STALL_WATCHDOG,
+	CMD_OPT_KEEPALIVE,
 };
 
 static struct option long_options[] = {
@@ -811,6 +1290,9 @@ static struct option long_options[] = {
 	{"enable_trusty",	no_argument,		0,
 					CMD_OPT_TRUSTY_ENABLE},
 	{"virtio_poll",		required_argument,	0, CMD_OPT_VIRTIO_POLL_ENABLE},
+	{"polling",		required_argument,	0, CMD_OPT_POLLING},
+	{"resume",		required_argument,	0, CMD_OPT_RESUME},
+	{"fork",		required_argument,	0, CMD_OPT_FORK},
 	{"debugexit",		no_argument,		0, CMD_OPT_DEBUGEXIT},
 	{"intr_monitor",	required_argument,	0, CMD_OPT_INTR_MONITOR},
 	{"cmd_monitor",		required_argument,	0, CMD_OPT_CMD_MONITOR},
@@ -825,6 +1307,16 @@ static struct option long_options[] = {
 	{"pm_by_vuart",	required_argument,	0, CMD_OPT_PM_BY_VUART},
 	{"windows",		no_argument,		0, CMD_OPT_WINDOWS},
 	{"virtio_msi",		no_argument,		0, CMD_OPT_FORCE_VIRTIO_MSI},
+	{"lazy_highmem",	no_argument,		0, CMD_OPT_LAZY_HIGHMEM},
+	{"ioreq_poll",		required_argument,	0, CMD_OPT_IOREQ_POLL},
+	{"ioreq_affinity",	no_argument,		0, CMD_OPT_IOREQ_AFFINITY},
+	{"ioreq_prio",		no_argument,		0, CMD_OPT_IOREQ_PRIO},
+	{"ioreq_rt_boost",	no_argument,		0, CMD_OPT_IOREQ_RT_BOOST},
+	{"virtio_doorbell",	no_argument,		0, CMD_OPT_VIRTIO_DOORBELL},
+	{"vnuma",		required_argument,	0, CMD_OPT_VNUMA},
+	{"mem_compress",	required_argument,	0, CMD_OPT_MEM_COMPRESS},
+	{"stall_watchdog",	required_argument,	0, CMD_OPT_STALL_WATCHDOG},
+	{"keepalive",		no_argument,		0, CMD_OPT_KEEPALIVE},
 	{0,			0,			0,  0  },
 };
 
@@ -943,6 +1435,28 @@ main(int argc, char *argv[])
 					optarg);
 			}
 			break;
+		case CMD_OPT_POLLING:
+			if (acrn_parse_virtio_polling(optarg) != 0) {
+				errx(EX_USAGE,
+					"invalid polling option %s",
+					optarg);
+			}
+			break;
+		case CMD_OPT_RESUME:
+			if (acrn_parse_resume_file(optarg) != 0) {
+				errx(EX_USAGE,
+					"invalid snapshot file %s",
+					optarg);
+			}
+			break;
+		case CMD_OPT_FORK:
+			if (acrn_parse_fork_file(optarg) != 0) {
+				errx(EX_USAGE,
+					"invalid template file %s",
+					optarg);
+			}
+			lazy_highmem = true;
+			break;
 		case CMD_OPT_MAC_SEED:
 			pr_warn("The \"--mac_seed\" parameter is obsolete\n");
 			pr_warn("Please use the \"virtio-net,<device_type>=<name> mac_seed=<seed_string>\"\n");
@@ -1014,6 +1528,49 @@ main(int argc, char *argv[])
 		case CMD_OPT_FORCE_VIRTIO_MSI:
 			virtio_msix = 0;
 			break;
+		case CMD_OPT_LAZY_HIGHMEM:
+			lazy_highmem = true;
+			break;
+		case CMD_OPT_IOREQ_POLL:
+			if (dm_strtoi(optarg, NULL, 10, &ioreq_poll_pcpu) ||
+			    ioreq_poll_pcpu < 0)
+				errx(EX_USAGE, "invalid ioreq_poll pcpu %s",
+					optarg);
+			ioreq_poll_enabled = true;
+			break;
+		case CMD_OPT_IOREQ_AFFINITY:
+			ioreq_affinity_enabled = true;
+			break;
+		case CMD_OPT_IOREQ_PRIO:
+			ioreq_prio_enabled = true;
+			break;
+		case CMD_OPT_IOREQ_RT_BOOST:
+			ioreq_rt_boost_enabled = true;
+			break;
+		case CMD_OPT_VIRTIO_DOORBELL:
+			acrn_enable_virtio_doorbell();
+			break;
+		case CMD_OPT_VNUMA:
+			if (dm_strtoi(optarg, NULL, 10, &vnuma_nodes) ||
+			    vnuma_nodes < 1 || vnuma_nodes > VNUMA_NODES_MAX)
+				errx(EX_USAGE, "invalid vnuma node count %s",
+					optarg);
+			break;
+		case CMD_OPT_MEM_COMPRESS:
+			if (dm_strtoi(optarg, NULL, 10, &mem_compress_sec) ||
+			    mem_compress_sec < 1)
+				errx(EX_USAGE, "invalid mem_compress interval %s",
+					optarg);
+			break;
+		case CMD_OPT_STALL_WATCHDOG:
+			if (dm_strtoi(optarg, NULL, 10, &stall_watchdog_sec) ||
+			    stall_watchdog_sec < 1)
+				errx(EX_USAGE, "invalid stall_watchdog timeout %s",
+					optarg);
+			break;
+		case CMD_OPT_KEEPALIVE:
+			vm_set_keepalive(true);
+			break;
 		case 'h':
 			usage(0);
 		default:
@@ -1039,10 +1596,16 @@ main(int argc, char *argv[])
 		exit(1);
 	}
 
+	launch_prof_mark("dm start");
+
+	if (stall_watchdog_sec > 0)
+		stallmon_init(stall_watchdog_sec);
+
 	if (!init_hugetlb()) {
 		pr_err("init_hugetlb failed\n");
 		exit(1);
 	}
+	launch_prof_mark("init_hugetlb");
 
 	if (gfx_ui) {
 		if(gfx_ui_init()) {
@@ -1071,12 +1634,15 @@ main(int argc, char *argv[])
 			goto fail;
 		}
 
+		launch_prof_mark("vm_create");
+
 		pr_notice("vm_setup_memory: size=0x%lx\n", memsize);
 		error = vm_setup_memory(ctx, memsize);
 		if (error) {
 			pr_err("Unable to setup memory (%d)\n", errno);
 			goto fail;
 		}
+		launch_prof_mark("vm_setup_memory");
 
 		error = mevent_init();
 		if (error) {
@@ -1089,6 +1655,18 @@ main(int argc, char *argv[])
 			pr_err("Unable to init vdev (%d)\n", errno);
 			goto dev_fail;
 		}
+		launch_prof_mark("vm_init_vdevs");
+
+		/* needs the MMIO range trees which init_mem() just set up */
+		if (hugetlb_start_lazy_highmem(ctx) < 0) {
+			pr_err("Unable to start lazy highmem population\n");
+			goto vm_fail;
+		}
+
+		if (hugetlb_start_mem_compress(ctx) < 0) {
+			pr_err("Unable to start memory compression\n");
+			goto vm_fail;
+		}
 
 		/*
 		 * build the guest tables, MP etc.
@@ -1105,6 +1683,7 @@ main(int argc, char *argv[])
 			pr_err("acpi_build failed, error=%d\n", error);
 			goto vm_fail;
 		}
+		launch_prof_mark("acpi_build");
 
 		pr_notice("acrn_sw_load\n");
 		error = acrn_sw_load(ctx);
@@ -1112,6 +1691,16 @@ main(int argc, char *argv[])
 			pr_err("acrn_sw_load failed, error=%d\n", error);
 			goto vm_fail;
 		}
+		launch_prof_mark("sw_load");
+
+		/* resuming from a snapshot overrides the cold-boot state the
+		 * software load just set up
+		 */
+		if (vm_resume_from_snapshot(ctx) != 0) {
+			pr_err("Unable to restore VM snapshot\n");
+			goto vm_fail;
+		}
+		launch_prof_mark("snapshot_restore");
 
 		/*
 		 * Change the proc title to include the VM name.
@@ -1172,6 +1761,7 @@ create_fail:
 	if (gfx_ui) {
 		gfx_ui_deinit();
 	}
+	stallmon_deinit();
 	uninit_hugetlb();
 	deinit_loggers();
 	exit(ret);
@@ -30,6 +30,11 @@
  * Memory ranges are represented with an RB tree. On insertion, the range
  * is checked for overlaps. On lookup, the key has the same base and limit
  * so it can be searched within the range.
+ *
+ * The RB tree stays the authoritative structure for (rare) registration
+ * changes, but the hot MMIO lookup goes through an immutable sorted
+ * array republished on every change and validated with a generation
+ * counter, so it runs without taking mmio_rwlock.
  */
 
 #include <errno.h>
@@ -40,6 +45,8 @@
 
 #include "mem.h"
 #include "tree.h"
+#include "dm.h"
+#include "vmmapi.h"
 
 #define MEMNAMESZ (80)
 
@@ -53,14 +60,35 @@ struct mmio_rb_range {
 static RB_HEAD(mmio_rb_tree, mmio_rb_range) mmio_rb_root, mmio_rb_fallback;
 RB_PROTOTYPE_STATIC(mmio_rb_tree, mmio_rb_range, mr_link, mmio_rb_range_compare);
 
+static pthread_rwlock_t mmio_rwlock;
+
 /*
- * Per-VM cache. Since most accesses from a vCPU will be to
- * consecutive addresses in a range, it makes sense to cache the
- * result of a lookup.
+ * Flat sorted copy of the primary tree for lock-free lookup.  Writers
+ * bump mmio_flat_gen to an odd value, rebuild the array under
+ * mmio_rwlock, and bump it even again; readers copy the entry they
+ * found and retry if the generation moved under them.  Entries are
+ * held by value, so no reclamation is needed.
  */
-static struct mmio_rb_range	*mmio_hint __aligned(sizeof(struct mmio_rb_range *));
+#define MMIO_FLAT_MAX	256
 
-static pthread_rwlock_t mmio_rwlock;
+struct mmio_flat_range {
+	uint64_t		base;
+	uint64_t		end;
+	struct mem_range	param;
+};
+
+static struct mmio_flat_range mmio_flat[MMIO_FLAT_MAX];
+static int mmio_flat_n;
+static uint32_t mmio_flat_gen;
+
+/*
+ * Last-hit cache. Since most accesses from a vCPU will be to
+ * consecutive addresses in a range, it makes sense to cache the
+ * result of a lookup.  One entry per emulation thread, validated
+ * against the flat table generation.
+ */
+static __thread struct mmio_flat_range mmio_last_hit;
+static __thread uint32_t mmio_last_hit_gen;
 
 static int
 mmio_rb_range_compare(struct mmio_rb_range *a, struct mmio_rb_range *b)
@@ -127,6 +155,76 @@ mmio_rb_dump(struct mmio_rb_tree *rbt)
 
 RB_GENERATE_STATIC(mmio_rb_tree, mmio_rb_range, mr_link, mmio_rb_range_compare);
 
+/* must be called with mmio_rwlock held for writing */
+static void
+mmio_flat_rebuild(void)
+{
+	struct mmio_rb_range *np;
+	int n = 0;
+
+	__atomic_store_n(&mmio_flat_gen, mmio_flat_gen + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	RB_FOREACH(np, mmio_rb_tree, &mmio_rb_root) {
+		if (n == MMIO_FLAT_MAX) {
+			/* too many ranges: force the locked slow path */
+			n = -1;
+			break;
+		}
+		mmio_flat[n].base = np->mr_base;
+		mmio_flat[n].end = np->mr_end;
+		mmio_flat[n].param = np->mr_param;
+		n++;
+	}
+	mmio_flat_n = n;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	__atomic_store_n(&mmio_flat_gen, mmio_flat_gen + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Lock-free lookup in the flat table; on success *res holds a copy of
+ * the matching range and *genp the generation it came from.  Returns
+ * -EAGAIN if the table is being rebuilt or has overflowed, -ESRCH if
+ * the address is not covered.
+ */
+static int
+mmio_flat_lookup(uint64_t addr, struct mmio_flat_range *res, uint32_t *genp)
+{
+	uint32_t gen;
+	int lo, hi, mid, found;
+
+	do {
+		gen = __atomic_load_n(&mmio_flat_gen, __ATOMIC_ACQUIRE);
+		if ((gen & 1) || mmio_flat_n < 0)
+			return -EAGAIN;
+
+		found = 0;
+		lo = 0;
+		hi = mmio_flat_n - 1;
+		while (lo <= hi) {
+			mid = (lo + hi) / 2;
+			if (addr < mmio_flat[mid].base)
+				hi = mid - 1;
+			else if (addr > mmio_flat[mid].end)
+				lo = mid + 1;
+			else {
+				*res = mmio_flat[mid];
+				found = 1;
+				break;
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&mmio_flat_gen, __ATOMIC_ACQUIRE) != gen);
+
+	if (!found)
+		return -ESRCH;
+
+	*genp = gen;
+	return 0;
+}
+
 static int
 mem_read(void *ctx, int vcpu, uint64_t gpa, uint64_t *rval, int size, void *arg)
 {
@@ -149,46 +247,157 @@ mem_write(void *ctx, int vcpu, uint64_t gpa, uint64_t wval, int size, void *arg)
 	return error;
 }
 
-int
-emulate_mem(struct vmctx *ctx, struct acrn_mmio_request *mmio_req)
+static int
+emulate_mem_one(struct vmctx *ctx, struct acrn_mmio_request *mmio_req)
 {
 	uint64_t paddr = mmio_req->address;
 	int size = mmio_req->size;
-	struct mmio_rb_range *hint, *entry = NULL;
+	struct mmio_rb_range *entry;
+	struct mem_range mr;
+	uint32_t gen;
 	int err;
 
-	pthread_rwlock_rdlock(&mmio_rwlock);
-
 	/*
-	 * First check the per-VM cache
+	 * First check the per-thread last-hit cache: most accesses from
+	 * a vCPU go to the same range repeatedly.
 	 */
-	hint = mmio_hint;
-
-	if (hint && paddr >= hint->mr_base && paddr <= hint->mr_end)
-		entry = hint;
-	else if (mmio_rb_lookup(&mmio_rb_root, paddr, &entry) == 0)
-		/* Update the per-VM cache */
-		mmio_hint = entry;
-	else if (mmio_rb_lookup(&mmio_rb_fallback, paddr, &entry)) {
-		pthread_rwlock_unlock(&mmio_rwlock);
-		return -ESRCH;
+	gen = __atomic_load_n(&mmio_flat_gen, __ATOMIC_ACQUIRE);
+	if (!(gen & 1) && gen == mmio_last_hit_gen &&
+	    mmio_last_hit.end != 0 &&
+	    paddr >= mmio_last_hit.base && paddr <= mmio_last_hit.end) {
+		mr = mmio_last_hit.param;
+	} else {
+		err = mmio_flat_lookup(paddr, &mmio_last_hit, &gen);
+		if (err == 0) {
+			mmio_last_hit_gen = gen;
+			mr = mmio_last_hit.param;
+		} else {
+			/*
+			 * Rebuild in flight, flat table overflowed, or a
+			 * fallback range: take the locked slow path.
+			 */
+			mmio_last_hit.end = 0;	/* invalidate the cache */
+			entry = NULL;
+			pthread_rwlock_rdlock(&mmio_rwlock);
+			if (err == -ESRCH ||
+			    mmio_rb_lookup(&mmio_rb_root, paddr, &entry) != 0)
+				if (mmio_rb_lookup(&mmio_rb_fallback, paddr,
+						   &entry)) {
+					pthread_rwlock_unlock(&mmio_rwlock);
+					return -ESRCH;
+				}
+			mr = entry->mr_param;
+			pthread_rwlock_unlock(&mmio_rwlock);
+		}
 	}
 
-	pthread_rwlock_unlock(&mmio_rwlock);
-
-	if (entry == NULL)
-		return -EINVAL;
-
 	if (mmio_req->direction == ACRN_IOREQ_DIR_READ)
 		err = mem_read(ctx, 0, paddr, (uint64_t *)&mmio_req->value,
-				size, &entry->mr_param);
+				size, &mr);
 	else
 		err = mem_write(ctx, 0, paddr, mmio_req->value,
-				size, &entry->mr_param);
+				size, &mr);
+
+	return err;
+}
+
+/*
+ * Write-coalescing for doorbell-style registers.  The hypervisor absorbs
+ * guest writes to registered ranges into a ring in the page below the MP
+ * table and only the next non-coalescible exit reaches us; the parked
+ * writes are replayed here before that request is handled, so a device
+ * model observes the same ordered write sequence, minus the exits.
+ */
+#define	COALESCED_RING_GPA	0xE0000UL
+#define	COALESCED_RING_SIZE	4096UL
+
+static struct acrn_coalesced_mmio_ring *coalesced_ring;
+
+void
+mmio_coalesced_drain(struct vmctx *ctx)
+{
+	struct acrn_coalesced_mmio_ring *ring = coalesced_ring;
+	struct acrn_mmio_request req;
+	uint32_t first, last;
+
+	if (ring == NULL)
+		return;
+
+	first = ring->first;
+	last = __atomic_load_n(&ring->last, __ATOMIC_ACQUIRE);
+	while (first != last) {
+		req.direction = ACRN_IOREQ_DIR_WRITE;
+		req.address = ring->entry[first].address;
+		req.size = ring->entry[first].size;
+		req.value = ring->entry[first].value;
+		(void)emulate_mem_one(ctx, &req);
+
+		first = (first + 1) % ACRN_COALESCED_MMIO_MAX;
+		__atomic_store_n(&ring->first, first, __ATOMIC_RELEASE);
+		if (first == last)
+			last = __atomic_load_n(&ring->last, __ATOMIC_ACQUIRE);
+	}
+}
+
+int
+mmio_coalesce_register(struct vmctx *ctx, uint64_t base, uint64_t size)
+{
+	struct acrn_mmiodev dev;
+
+	if (coalesced_ring == NULL) {
+		struct acrn_coalesced_mmio_ring *ring;
+
+		ring = paddr_guest2host(ctx, COALESCED_RING_GPA,
+				COALESCED_RING_SIZE);
+		if (ring == NULL)
+			return -1;
+		ring->first = 0;
+		ring->last = 0;
+		coalesced_ring = ring;
+	}
+
+	memset(&dev, 0, sizeof(dev));
+	strncpy(dev.name, "wcmmio", sizeof(dev.name));
+	dev.res[0].user_vm_pa = base;
+	dev.res[0].size = size;
+	dev.res[0].mem_type = ACRN_MEM_TYPE_WC_DOORBELL;
+	dev.res[1].user_vm_pa = COALESCED_RING_GPA;
+	dev.res[1].size = COALESCED_RING_SIZE;
+	dev.res[1].mem_type = ACRN_MEM_TYPE_WC_DOORBELL;
+
+	return vm_assign_mmiodev(ctx, &dev);
+}
+
+int
+mmio_coalesce_unregister(struct vmctx *ctx, uint64_t base, uint64_t size)
+{
+	struct acrn_mmiodev dev;
+	int err;
+
+	memset(&dev, 0, sizeof(dev));
+	strncpy(dev.name, "wcmmio", sizeof(dev.name));
+	dev.res[0].user_vm_pa = base;
+	dev.res[0].size = size;
+	dev.res[0].mem_type = ACRN_MEM_TYPE_WC_DOORBELL;
+
+	err = vm_deassign_mmiodev(ctx, &dev);
+
+	/* replay whatever was parked before the range went away */
+	mmio_coalesced_drain(ctx);
 
 	return err;
 }
 
+int
+emulate_mem(struct vmctx *ctx, struct acrn_mmio_request *mmio_req)
+{
+	/* writes parked in the coalesced ring precede this access */
+	if (coalesced_ring != NULL)
+		mmio_coalesced_drain(ctx);
+
+	return emulate_mem_one(ctx, mmio_req);
+}
+
 static int
 register_mem_int(struct mmio_rb_tree *rbt, struct mem_range *memp)
 {
@@ -206,6 +415,8 @@ register_mem_int(struct mmio_rb_tree *rbt, struct mem_range *memp)
 		pthread_rwlock_wrlock(&mmio_rwlock);
 		if (mmio_rb_lookup(rbt, memp->base, &entry) != 0)
 			err = mmio_rb_add(rbt, mrp);
+		if (err == 0 && rbt == &mmio_rb_root)
+			mmio_flat_rebuild();
 		pthread_rwlock_unlock(&mmio_rwlock);
 		if (err)
 			free(mrp);
@@ -244,9 +455,9 @@ unregister_mem_int(struct mmio_rb_tree *rbt, struct mem_range *memp)
 		} else {
 			RB_REMOVE(mmio_rb_tree, rbt, entry);
 
-			/* flush Per-VM cache */
-			if (mmio_hint == entry)
-				mmio_hint = NULL;
+			/* republishing flushes the per-thread caches too */
+			if (rbt == &mmio_rb_root)
+				mmio_flat_rebuild();
 
 			free(entry);
 		}
@@ -27,8 +27,10 @@
  */
 
 /*
- * Micro event library for FreeBSD, designed for a single i/o thread
- * using EPOLL, and having events be persistent by default.
+ * Micro event library for FreeBSD, designed for a small set of i/o
+ * worker threads using EPOLL, and having events be persistent by
+ * default.  Each event is pinned to one worker loop when it is added,
+ * so a busy device cannot head-of-line block events of another one.
  */
 #include <errno.h>
 #include <stdlib.h>
@@ -43,17 +45,17 @@
 #include "mevent.h"
 #include "vmmapi.h"
 #include "log.h"
+#include "stallmon.h"
 
 #define	MEVENT_MAX	64
 
+#define	MEVENT_MAX_WORKERS	4
+
 #define	MEV_ADD		1
 #define	MEV_ENABLE	2
 #define	MEV_DISABLE	3
 #define	MEV_DEL_PENDING	4
 
-static int epoll_fd;
-static pthread_t mevent_tid;
-static int mevent_pipefd[2];
 static pthread_mutex_t mevent_lmutex;
 
 struct mevent {
@@ -66,14 +68,29 @@ struct mevent {
 	enum			ev_type me_type;
 	int			me_cq;
 	int			me_state;
+	int			me_wkr;
 
 	int			closefd;
 	LIST_ENTRY(mevent)	me_list;
 };
 
+/*
+ * Each worker runs its own epoll loop over the events sharded to it.
+ * Worker 0 is the thread calling mevent_dispatch().
+ */
+struct mevent_worker {
+	int		epoll_fd;
+	pthread_t	tid;
+	int		pipefd[2];
+	/* List holds the mevent node which is requested to deleted */
+	LIST_HEAD(del_listhead, mevent) del_head;
+};
+
+static struct mevent_worker mevent_workers[MEVENT_MAX_WORKERS];
+static int mevent_nworkers = 1;
+static int mevent_next_worker;
+
 static LIST_HEAD(listhead, mevent) global_head;
-/* List holds the mevent node which is requested to deleted */
-static LIST_HEAD(del_listhead, mevent) del_head;
 
 static void
 mevent_qlock(void)
@@ -87,10 +104,17 @@ mevent_qunlock(void)
 	pthread_mutex_unlock(&mevent_lmutex);
 }
 
-static bool
-is_dispatch_thread(void)
+static struct mevent_worker *
+mevent_find_self(void)
 {
-	return (pthread_self() == mevent_tid);
+	pthread_t self = pthread_self();
+	int i;
+
+	for (i = 0; i < mevent_nworkers; i++)
+		if (pthread_equal(self, mevent_workers[i].tid))
+			return &mevent_workers[i];
+
+	return NULL;
 }
 
 static void
@@ -113,14 +137,20 @@ int
 mevent_notify(void)
 {
 	char c = 0;
+	pthread_t self = pthread_self();
+	int i;
 
 	/*
-	 * If calling from outside the i/o thread, write a byte on the
-	 * pipe to force the i/o thread to exit the blocking epoll call.
+	 * For every worker loop we are not running on, write a byte on
+	 * its pipe to force the blocking epoll call to exit.
 	 */
-	if (mevent_pipefd[1] != 0 && !is_dispatch_thread())
-		if (write(mevent_pipefd[1], &c, 1) <= 0)
-			return -1;
+	for (i = 0; i < mevent_nworkers; i++) {
+		struct mevent_worker *wkr = &mevent_workers[i];
+
+		if (wkr->pipefd[1] != 0 && !pthread_equal(self, wkr->tid))
+			if (write(wkr->pipefd[1], &c, 1) <= 0)
+				return -1;
+	}
 	return 0;
 }
 
@@ -150,11 +180,13 @@ static void
 mevent_destroy(void)
 {
 	struct mevent *mevp, *tmpp;
+	int i;
 
 	mevent_qlock();
 	list_foreach_safe(mevp, &global_head, me_list, tmpp) {
 		LIST_REMOVE(mevp, me_list);
-		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, mevp->me_fd, NULL);
+		epoll_ctl(mevent_workers[mevp->me_wkr].epoll_fd,
+			  EPOLL_CTL_DEL, mevp->me_fd, NULL);
 
                if ((mevp->me_type == EVF_READ ||
                     mevp->me_type == EVF_READ_ET ||
@@ -172,8 +204,10 @@ mevent_destroy(void)
 	/* the mevp in del_head was removed from epoll when add it
 	 * to del_head already.
 	 */
-	list_foreach_safe(mevp, &del_head, me_list, tmpp) {
-		LIST_REMOVE(mevp, me_list);
+	for (i = 0; i < mevent_nworkers; i++) {
+		list_foreach_safe(mevp, &mevent_workers[i].del_head,
+				  me_list, tmpp) {
+			LIST_REMOVE(mevp, me_list);
 
                if ((mevp->me_type == EVF_READ ||
                     mevp->me_type == EVF_READ_ET ||
@@ -182,16 +216,17 @@ mevent_destroy(void)
                     mevp->me_fd != STDIN_FILENO)
                        close(mevp->me_fd);
 
-		if (mevp->teardown)
-			mevp->teardown(mevp->teardown_param);
+			if (mevp->teardown)
+				mevp->teardown(mevp->teardown_param);
 
-		free(mevp);
+			free(mevp);
+		}
 	}
 	mevent_qunlock();
 }
 
 static void
-mevent_handle(struct epoll_event *kev, int numev)
+mevent_handle(struct epoll_event *kev, int numev, struct stallmon_worker *mon)
 {
 	int i;
 	struct mevent *mevp;
@@ -199,15 +234,19 @@ mevent_handle(struct epoll_event *kev, int numev)
 	for (i = 0; i < numev; i++) {
 		mevp = kev[i].data.ptr;
 
-		if (mevp->me_state)
+		if (mevp->me_state) {
+			stallmon_begin(mon, "callback %p, fd %d, type %d",
+				       mevp->run, mevp->me_fd, mevp->me_type);
 			(*mevp->run)(mevp->me_fd, mevp->me_type, mevp->run_param);
+			stallmon_end(mon);
+		}
 	}
 }
 
 struct mevent *
-mevent_add(int tfd, enum ev_type type,
+mevent_add_affinity(int tfd, enum ev_type type,
 	   void (*run)(int, enum ev_type, void *), void *run_param,
-	   void (*teardown)(void *), void *teardown_param)
+	   void (*teardown)(void *), void *teardown_param, int affinity)
 {
 	int ret;
 	struct epoll_event ee;
@@ -245,9 +284,25 @@ mevent_add(int tfd, enum ev_type type,
 	mevp->teardown = teardown;
 	mevp->teardown_param = teardown_param;
 
+	/*
+	 * Shard the event over the worker loops: callers with related
+	 * events pass an affinity hint, everyone else is spread
+	 * round-robin.
+	 */
+	mevent_qlock();
+	if (affinity >= 0)
+		mevp->me_wkr = affinity % mevent_nworkers;
+	else {
+		mevp->me_wkr = mevent_next_worker;
+		mevent_next_worker = (mevent_next_worker + 1) %
+			mevent_nworkers;
+	}
+	mevent_qunlock();
+
 	ee.events = mevent_kq_filter(mevp);
 	ee.data.ptr = mevp;
-	ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mevp->me_fd, &ee);
+	ret = epoll_ctl(mevent_workers[mevp->me_wkr].epoll_fd,
+			EPOLL_CTL_ADD, mevp->me_fd, &ee);
 
 	if (ret == 0) {
 		mevent_qlock();
@@ -261,6 +316,15 @@ mevent_add(int tfd, enum ev_type type,
 	}
 }
 
+struct mevent *
+mevent_add(int tfd, enum ev_type type,
+	   void (*run)(int, enum ev_type, void *), void *run_param,
+	   void (*teardown)(void *), void *teardown_param)
+{
+	return mevent_add_affinity(tfd, type, run, run_param, teardown,
+				   teardown_param, -1);
+}
+
 int
 mevent_enable(struct mevent *evp)
 {
@@ -283,7 +347,8 @@ mevent_enable(struct mevent *evp)
 
 	ee.events = mevent_kq_filter(mevp);
 	ee.data.ptr = mevp;
-	ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mevp->me_fd, &ee);
+	ret = epoll_ctl(mevent_workers[mevp->me_wkr].epoll_fd,
+			EPOLL_CTL_ADD, mevp->me_fd, &ee);
 	if (ret < 0 && errno == EEXIST)
 		ret = 0;
 
@@ -295,7 +360,8 @@ mevent_disable(struct mevent *evp)
 {
 	int ret;
 
-	ret = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, evp->me_fd, NULL);
+	ret = epoll_ctl(mevent_workers[evp->me_wkr].epoll_fd,
+			EPOLL_CTL_DEL, evp->me_fd, NULL);
 	if (ret < 0 && errno == ENOENT)
 		ret = 0;
 
@@ -303,22 +369,22 @@ mevent_disable(struct mevent *evp)
 }
 
 static void
-mevent_add_to_del_list(struct mevent *evp, int closefd)
+mevent_add_to_del_list(struct mevent *evp, struct mevent_worker *wkr)
 {
 	mevent_qlock();
-	LIST_INSERT_HEAD(&del_head, evp, me_list);
+	LIST_INSERT_HEAD(&wkr->del_head, evp, me_list);
 	mevent_qunlock();
 
 	mevent_notify();
 }
 
 static void
-mevent_drain_del_list(void)
+mevent_drain_del_list(struct mevent_worker *wkr)
 {
 	struct mevent *evp, *tmpp;
 
 	mevent_qlock();
-	list_foreach_safe(evp, &del_head, me_list, tmpp) {
+	list_foreach_safe(evp, &wkr->del_head, me_list, tmpp) {
 		LIST_REMOVE(evp, me_list);
 		if (evp->closefd) {
 			close(evp->me_fd);
@@ -334,15 +400,18 @@ mevent_drain_del_list(void)
 static int
 mevent_delete_event(struct mevent *evp, int closefd)
 {
+	struct mevent_worker *wkr = &mevent_workers[evp->me_wkr];
+
 	mevent_qlock();
 	LIST_REMOVE(evp, me_list);
 	mevent_qunlock();
 	evp->me_state = 0;
 	evp->closefd = closefd;
 
-	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, evp->me_fd, NULL);
-	if (!is_dispatch_thread()) {
-		mevent_add_to_del_list(evp, closefd);
+	epoll_ctl(wkr->epoll_fd, EPOLL_CTL_DEL, evp->me_fd, NULL);
+	if (mevent_find_self() != wkr) {
+		/* the owning loop frees the node once it is quiesced */
+		mevent_add_to_del_list(evp, wkr);
 	} else {
 		if (evp->closefd) {
 			close(evp->me_fd);
@@ -367,71 +436,65 @@ mevent_delete_close(struct mevent *evp)
 	return mevent_delete_event(evp, 1);
 }
 
-static void
-mevent_set_name(void)
-{
-	pthread_setname_np(mevent_tid, "mevent");
-}
-
 int
 mevent_init(void)
 {
 	pthread_mutexattr_t attr;
+	int ncpu, i;
 
 	pthread_mutexattr_init(&attr);
 	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&mevent_lmutex, &attr);
 	pthread_mutexattr_destroy(&attr);
 
-	epoll_fd = epoll_create1(0);
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	mevent_nworkers = (ncpu < 1) ? 1 : ncpu;
+	if (mevent_nworkers > MEVENT_MAX_WORKERS)
+		mevent_nworkers = MEVENT_MAX_WORKERS;
 
-	if (epoll_fd >= 0)
-		return 0;
-	else
-		return -1;
+	/*
+	 * Events are sharded over the workers already at mevent_add()
+	 * time, so every epoll fd must exist before device init runs.
+	 */
+	for (i = 0; i < mevent_nworkers; i++) {
+		mevent_workers[i].epoll_fd = epoll_create1(0);
+		if (mevent_workers[i].epoll_fd < 0)
+			return -1;
+		LIST_INIT(&mevent_workers[i].del_head);
+	}
+
+	return 0;
 }
 
 void
 mevent_deinit(void)
 {
+	int i;
+
+	/* wake the worker loops so their threads can exit */
+	mevent_notify();
+	for (i = 1; i < mevent_nworkers; i++)
+		if (mevent_workers[i].tid)
+			pthread_join(mevent_workers[i].tid, NULL);
+
 	mevent_destroy();
-	close(epoll_fd);
-	if (mevent_pipefd[1] != 0)
-		close(mevent_pipefd[1]);
+	for (i = 0; i < mevent_nworkers; i++) {
+		close(mevent_workers[i].epoll_fd);
+		if (mevent_workers[i].pipefd[1] != 0)
+			close(mevent_workers[i].pipefd[1]);
+	}
 
 	pthread_mutex_destroy(&mevent_lmutex);
 }
 
-void
-mevent_dispatch(void)
+static void
+mevent_dispatch_loop(struct mevent_worker *wkr)
 {
 	struct epoll_event eventlist[MEVENT_MAX];
-
-	struct mevent *pipev;
+	struct stallmon_worker *mon;
 	int ret;
 
-	mevent_tid = pthread_self();
-	mevent_set_name();
-
-	/*
-	 * Open the pipe that will be used for other threads to force
-	 * the blocking kqueue call to exit by writing to it. Set the
-	 * descriptor to non-blocking.
-	 */
-	ret = pipe2(mevent_pipefd, O_NONBLOCK);
-	if (ret < 0) {
-		pr_err("pipe");
-		exit(0);
-	}
-
-	/*
-	 * Add internal event handler for the pipe write fd
-	 */
-	pipev = mevent_add(mevent_pipefd[0], EVF_READ, mevent_pipe_read, NULL, NULL, NULL);
-	if (!pipev) {
-		pr_err("pipefd mevent_add failed\n");
-		exit(0);
-	}
+	mon = stallmon_register("mevent-%ld", (long)(wkr - mevent_workers));
 
 	for (;;) {
 		int suspend_mode;
@@ -439,7 +502,7 @@ mevent_dispatch(void)
 		/*
 		 * Block awaiting events
 		 */
-		ret = epoll_wait(epoll_fd, eventlist, MEVENT_MAX, -1);
+		ret = epoll_wait(wkr->epoll_fd, eventlist, MEVENT_MAX, -1);
 
 		if (ret == -1 && errno != EINTR)
 			pr_err("Error return from epoll_wait");
@@ -447,8 +510,8 @@ mevent_dispatch(void)
 		/*
 		 * Handle reported events
 		 */
-		mevent_handle(eventlist, ret);
-		mevent_drain_del_list();
+		mevent_handle(eventlist, ret, mon);
+		mevent_drain_del_list(wkr);
 
 		suspend_mode = vm_get_suspend_mode();
 		if ((suspend_mode != VM_SUSPEND_NONE) &&
@@ -457,3 +520,68 @@ mevent_dispatch(void)
 			break;
 	}
 }
+
+static void *
+mevent_worker_loop(void *param)
+{
+	mevent_dispatch_loop(param);
+	return NULL;
+}
+
+static int
+mevent_worker_start(struct mevent_worker *wkr, int idx)
+{
+	struct mevent *pipev;
+	int ret;
+
+	/*
+	 * Open the pipe that will be used for other threads to force
+	 * the blocking kqueue call to exit by writing to it. Set the
+	 * descriptor to non-blocking.
+	 */
+	ret = pipe2(wkr->pipefd, O_NONBLOCK);
+	if (ret < 0)
+		return -1;
+
+	/*
+	 * Add internal event handler for the pipe write fd
+	 */
+	pipev = mevent_add_affinity(wkr->pipefd[0], EVF_READ,
+				    mevent_pipe_read, NULL, NULL, NULL, idx);
+	if (!pipev)
+		return -1;
+
+	return 0;
+}
+
+void
+mevent_dispatch(void)
+{
+	char tname[16];
+	int i, ret;
+
+	mevent_workers[0].tid = pthread_self();
+	pthread_setname_np(mevent_workers[0].tid, "mevent");
+
+	for (i = 0; i < mevent_nworkers; i++) {
+		ret = mevent_worker_start(&mevent_workers[i], i);
+		if (ret < 0) {
+			pr_err("pipe");
+			exit(0);
+		}
+	}
+
+	/* shards 1..N-1 get their own threads; this thread runs shard 0 */
+	for (i = 1; i < mevent_nworkers; i++) {
+		ret = pthread_create(&mevent_workers[i].tid, NULL,
+				     mevent_worker_loop, &mevent_workers[i]);
+		if (ret) {
+			pr_err("mevent worker create failed\n");
+			exit(0);
+		}
+		snprintf(tname, sizeof(tname), "mevent-%d", i);
+		pthread_setname_np(mevent_workers[i].tid, tname);
+	}
+
+	mevent_dispatch_loop(&mevent_workers[0]);
+}
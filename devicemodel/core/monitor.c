@@ -352,6 +352,8 @@ static void handle_stop(struct mngr_msg *msg, int client_fd, void *param)
 
 	if (msg->data.acrnd_stop.force && !is_rtvm) {
 		pr_info("%s: setting VM state to %s\n", __func__, vm_state_to_str(VM_SUSPEND_POWEROFF));
+		/* an explicit stop overrides --keepalive */
+		vm_set_keepalive(false);
 		vm_set_suspend_mode(VM_SUSPEND_POWEROFF);
 		ack.data.err = 0;
 	} else {
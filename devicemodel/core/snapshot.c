@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * VM snapshot/restore engine.
+ *
+ * A snapshot image holds, in order: a fixed header, one acrn_vcpu_regs
+ * record per vCPU read back through ACRN_IOCTL_GET_VCPU_REGS, the emulated
+ * PCI device sections (see pci_snapshot_devices) and the raw guest memory
+ * image, lowmem followed by highmem. Memory is written in chunks with
+ * all-zero chunks seeked over, so the image is sparse on filesystems that
+ * support holes; on restore a short read is equivalent to reading zeroes.
+ *
+ * Restore replays the image into a freshly launched DM that was started
+ * with the same memory and device configuration. With --lazy_highmem the
+ * highmem part of the image is not read up front: the lazy population path
+ * pulls each slab from the image on first guest touch, so resume latency
+ * follows the guest's working set rather than its memory size.
+ *
+ * The image does not yet carry interrupt controller or guest MSR state,
+ * so guests should be snapshotted at a quiescent point (e.g. a prewarmed
+ * pool guest idling after boot).
+ *
+ * Fork mode (--fork) provisions clones from one template image. It is
+ * restore with two twists: highmem is always pulled lazily and only on
+ * guest demand - the background populate thread is not started - so a
+ * clone is serving requests after reading just the header, device state
+ * and lowmem, and its memory cost stays at its touched set. All clones
+ * read the same template file, so the bytes are shared through the host
+ * page cache and the farm pays one cold read of the image, not N. The
+ * hypervisor pins each VM's frames when its EPT is built, so the clones'
+ * own RAM cannot share host frames; pair the template disk with sparse
+ * overlay images (block_sparse backing files) for the disk side of the
+ * clone.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmmapi.h"
+#include "macros.h"
+#include "dm.h"
+#include "pci_core.h"
+#include "snapshot.h"
+#include "log.h"
+
+#define VM_SNAPSHOT_MAGIC	0x4e534341U	/* "ACSN" */
+#define VM_SNAPSHOT_VERSION	1U
+
+#define SNAPSHOT_MEM_CHUNK	(2UL * MB)
+
+struct vm_snapshot_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint16_t	ncpu;
+	uint16_t	reserved[3];
+	uint64_t	lowmem;
+	uint64_t	highmem;
+	uint64_t	highmem_gpa_base;
+};
+
+static char resume_path[256];
+static bool fork_mode;
+
+static bool
+mem_chunk_is_zero(const void *buf, size_t len)
+{
+	const uint64_t *p = buf;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(uint64_t); i++) {
+		if (p[i] != 0UL)
+			return false;
+	}
+	return true;
+}
+
+static int
+save_mem_blob(FILE *fp, const void *base, uint64_t len)
+{
+	uint64_t off = 0, chunk;
+	long start = ftell(fp);
+
+	while (off < len) {
+		chunk = len - off;
+		if (chunk > SNAPSHOT_MEM_CHUNK)
+			chunk = SNAPSHOT_MEM_CHUNK;
+
+		if (mem_chunk_is_zero((const char *)base + off, chunk)) {
+			if (fseek(fp, chunk, SEEK_CUR) != 0)
+				return -1;
+		} else if (fwrite((const char *)base + off, chunk, 1, fp) != 1) {
+			return -1;
+		}
+		off += chunk;
+	}
+
+	/* land the next section at start + len even if the tail was a hole;
+	 * the file may stay shorter than that, which readers treat as zeroes
+	 */
+	return fseek(fp, start + len, SEEK_SET);
+}
+
+static int
+load_mem_blob(FILE *fp, void *base, uint64_t len, uint64_t file_off)
+{
+	ssize_t n;
+	uint64_t off = 0;
+
+	while (off < len) {
+		n = pread(fileno(fp), (char *)base + off, len - off,
+				file_off + off);
+		if (n < 0)
+			return -1;
+		if (n == 0)	/* sparse tail, memory is already zeroed */
+			break;
+		off += n;
+	}
+	return 0;
+}
+
+int
+vm_snapshot_save(struct vmctx *ctx, const char *path)
+{
+	struct vm_snapshot_hdr hdr;
+	struct acrn_vcpu_regs regs;
+	FILE *fp;
+	int i;
+
+	/* drain the vCPUs so registers and memory form a consistent image */
+	vm_pause(ctx);
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		pr_err("snapshot: failed to create %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = VM_SNAPSHOT_MAGIC;
+	hdr.version = VM_SNAPSHOT_VERSION;
+	hdr.ncpu = guest_ncpus;
+	hdr.lowmem = ctx->lowmem;
+	hdr.highmem = ctx->highmem;
+	hdr.highmem_gpa_base = ctx->highmem_gpa_base;
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto fail;
+
+	for (i = 0; i < guest_ncpus; i++) {
+		memset(&regs, 0, sizeof(regs));
+		regs.vcpu_id = i;
+		if (vm_get_vcpu_regs(ctx, &regs) == 0) {
+			regs.reserved[0] = 1;	/* record is valid */
+		} else {
+			/* e.g. an AP which never left wait-for-SIPI */
+			pr_warn("snapshot: vcpu %d state not saved\n", i);
+			memset(&regs, 0, sizeof(regs));
+			regs.vcpu_id = i;
+		}
+		if (fwrite(&regs, sizeof(regs), 1, fp) != 1)
+			goto fail;
+	}
+
+	if (pci_snapshot_devices(ctx, fp) < 0)
+		goto fail;
+
+	if (save_mem_blob(fp, ctx->baseaddr, ctx->lowmem) < 0)
+		goto fail;
+	if (save_mem_blob(fp, ctx->baseaddr + ctx->highmem_gpa_base,
+			ctx->highmem) < 0)
+		goto fail;
+
+	if (ferror(fp))
+		goto fail;
+	fclose(fp);
+	pr_notice("snapshot: VM state saved to %s\n", path);
+	return 0;
+
+fail:
+	pr_err("snapshot: failed to write %s\n", path);
+	fclose(fp);
+	remove(path);
+	return -1;
+}
+
+int
+vm_snapshot_load(struct vmctx *ctx, const char *path)
+{
+	struct vm_snapshot_hdr hdr;
+	struct acrn_vcpu_regs regs;
+	uint64_t mem_off;
+	FILE *fp;
+	int i, fd;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		pr_err("snapshot: failed to open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto fail;
+	if (hdr.magic != VM_SNAPSHOT_MAGIC ||
+	    hdr.version != VM_SNAPSHOT_VERSION) {
+		pr_err("snapshot: %s is not a version %u snapshot image\n",
+			path, VM_SNAPSHOT_VERSION);
+		goto fail;
+	}
+	if (hdr.ncpu != guest_ncpus || hdr.lowmem != ctx->lowmem ||
+	    hdr.highmem != ctx->highmem ||
+	    hdr.highmem_gpa_base != ctx->highmem_gpa_base) {
+		pr_err("snapshot: %s was taken with a different cpu/memory configuration\n",
+			path);
+		goto fail;
+	}
+
+	for (i = 0; i < guest_ncpus; i++) {
+		if (fread(&regs, sizeof(regs), 1, fp) != 1)
+			goto fail;
+		if (regs.reserved[0] == 0)
+			continue;
+		regs.reserved[0] = 0;
+		if (i == 0) {
+			/* the BSP regs are (re)applied by add_cpu */
+			ctx->bsp_regs = regs;
+		} else if (vm_set_vcpu_regs(ctx, &regs) != 0) {
+			goto fail;
+		}
+	}
+
+	if (pci_restore_devices(ctx, fp) < 0)
+		goto fail;
+
+	mem_off = ftell(fp);
+	if (load_mem_blob(fp, ctx->baseaddr, ctx->lowmem, mem_off) < 0)
+		goto fail;
+
+	if (lazy_highmem) {
+		/* keep the image open; slabs are pulled on first touch */
+		fd = dup(fileno(fp));
+		if (fd < 0)
+			goto fail;
+		hugetlb_set_lazy_restore(fd, mem_off + ctx->lowmem);
+		if (fork_mode)
+			hugetlb_set_lazy_on_demand();
+	} else if (load_mem_blob(fp, ctx->baseaddr + ctx->highmem_gpa_base,
+			ctx->highmem, mem_off + ctx->lowmem) < 0) {
+		goto fail;
+	}
+
+	fclose(fp);
+	pr_notice("snapshot: VM state restored from %s\n", path);
+	return 0;
+
+fail:
+	pr_err("snapshot: failed to restore from %s\n", path);
+	fclose(fp);
+	return -1;
+}
+
+int
+acrn_parse_resume_file(char *arg)
+{
+	size_t len = strnlen(arg, sizeof(resume_path));
+
+	if (len == 0 || len >= sizeof(resume_path))
+		return -1;
+	strncpy(resume_path, arg, len + 1);
+	return 0;
+}
+
+int
+acrn_parse_fork_file(char *arg)
+{
+	if (acrn_parse_resume_file(arg) != 0)
+		return -1;
+	fork_mode = true;
+	return 0;
+}
+
+int
+vm_resume_from_snapshot(struct vmctx *ctx)
+{
+	if (resume_path[0] == '\0')
+		return 0;
+
+	return vm_snapshot_load(ctx, resume_path);
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Stall detection for DM worker threads.
+ *
+ * Every pool worker keeps a heartbeat slot: a sequence counter that is
+ * odd while a work item is in flight, the monotonic time the item was
+ * taken, and a short description of it. The watchdog thread samples the
+ * slots once a second without taking any lock the workers use - a torn
+ * read can at worst delay or misattribute one report, never corrupt
+ * anything - and reports each stalled item exactly once, with a
+ * recovery line when the worker eventually moves on.
+ *
+ * Escalation reuses the life_mngr monitor socket: the message is
+ * "<vmname>:dm_stall", the same "name:command" framing the socket
+ * channel already speaks, so policy (alerting, resetting the guest)
+ * stays in life_mngr where the rest of the lifecycle policy lives.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dm.h"
+#include "stallmon.h"
+#include "log.h"
+
+#define STALLMON_MAX_WORKERS	96
+#define STALLMON_NAME_LEN	32
+#define STALLMON_DESC_LEN	128
+#define STALLMON_SCAN_MS	1000
+
+#define LIFE_MNGR_SOCKET	"/var/lib/life_mngr/monitor.sock"
+#define DM_STALL_CMD		"dm_stall"
+
+struct stallmon_worker {
+	bool used;
+	char name[STALLMON_NAME_LEN];
+	char desc[STALLMON_DESC_LEN];
+	pthread_t tid;
+	uint64_t seq;		/* odd while an item is in flight */
+	uint64_t busy_since_ms;
+	uint64_t reported_seq;	/* watchdog thread only */
+};
+
+static struct stallmon_worker stallmon_workers[STALLMON_MAX_WORKERS];
+/* overflow slot handed out when the table is full; never scanned */
+static struct stallmon_worker stallmon_discard;
+static pthread_mutex_t stallmon_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t stallmon_tid;
+static uint64_t stallmon_timeout_ms;
+static bool stallmon_running;
+
+static uint64_t
+stallmon_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000UL + (uint64_t)ts.tv_nsec / 1000000UL;
+}
+
+struct stallmon_worker *
+stallmon_register(const char *fmt, ...)
+{
+	struct stallmon_worker *wkr = &stallmon_discard;
+	va_list ap;
+	int i;
+
+	pthread_mutex_lock(&stallmon_mtx);
+	for (i = 0; i < STALLMON_MAX_WORKERS; i++) {
+		if (!stallmon_workers[i].used) {
+			stallmon_workers[i].used = true;
+			wkr = &stallmon_workers[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stallmon_mtx);
+
+	if (wkr == &stallmon_discard)
+		pr_warn("stallmon: worker table full, worker not monitored\n");
+
+	va_start(ap, fmt);
+	vsnprintf(wkr->name, sizeof(wkr->name), fmt, ap);
+	va_end(ap);
+	return wkr;
+}
+
+void
+stallmon_begin(struct stallmon_worker *wkr, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(wkr->desc, sizeof(wkr->desc), fmt, ap);
+	va_end(ap);
+	wkr->tid = pthread_self();
+	wkr->busy_since_ms = stallmon_now_ms();
+	/* becomes odd: the item is now in flight */
+	__atomic_add_fetch(&wkr->seq, 1UL, __ATOMIC_RELEASE);
+}
+
+void
+stallmon_end(struct stallmon_worker *wkr)
+{
+	__atomic_add_fetch(&wkr->seq, 1UL, __ATOMIC_RELEASE);
+}
+
+/*
+ * One-shot notification to life_mngr. Failure is logged once: a board
+ * without life_mngr still gets the local stall dump.
+ */
+static void
+stallmon_escalate(const struct stallmon_worker *wkr)
+{
+	static bool escalate_warned;
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	char msg[STALLMON_NAME_LEN + 64];
+	char ack[32];
+	int fd, len;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		goto fail;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, LIFE_MNGR_SOCKET, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		goto fail;
+	}
+
+	len = snprintf(msg, sizeof(msg), "%s:%s", vmname, DM_STALL_CMD);
+	if (write(fd, msg, len) != len) {
+		close(fd);
+		goto fail;
+	}
+
+	/* drain the ack briefly; the report must not block the watchdog */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 1000) > 0)
+		(void)!read(fd, ack, sizeof(ack));
+	close(fd);
+	return;
+
+fail:
+	if (!escalate_warned) {
+		escalate_warned = true;
+		pr_warn("stallmon: cannot reach life_mngr at %s: %s\n",
+			LIFE_MNGR_SOCKET, strerror(errno));
+	}
+}
+
+static void
+stallmon_scan(void)
+{
+	uint64_t now = stallmon_now_ms();
+	int i;
+
+	for (i = 0; i < STALLMON_MAX_WORKERS; i++) {
+		struct stallmon_worker *wkr = &stallmon_workers[i];
+		uint64_t seq;
+
+		if (!wkr->used)
+			continue;
+		seq = __atomic_load_n(&wkr->seq, __ATOMIC_ACQUIRE);
+
+		if (((seq & 1UL) != 0UL) &&
+				((now - wkr->busy_since_ms) >= stallmon_timeout_ms)) {
+			if (wkr->reported_seq != seq) {
+				wkr->reported_seq = seq;
+				pr_err("stallmon: worker %s (tid %lx) stalled "
+					"for %lus on: %s\n",
+					wkr->name, (unsigned long)wkr->tid,
+					(now - wkr->busy_since_ms) / 1000UL,
+					wkr->desc);
+				stallmon_escalate(wkr);
+			}
+		} else if (wkr->reported_seq != 0UL) {
+			pr_err("stallmon: worker %s recovered\n", wkr->name);
+			wkr->reported_seq = 0UL;
+		}
+	}
+}
+
+static void *
+stallmon_thread(void *arg __attribute__((unused)))
+{
+	while (stallmon_running) {
+		usleep(STALLMON_SCAN_MS * 1000);
+		stallmon_scan();
+	}
+	return NULL;
+}
+
+int
+stallmon_init(int timeout_sec)
+{
+	int ret;
+
+	stallmon_timeout_ms = (uint64_t)timeout_sec * 1000UL;
+	stallmon_running = true;
+	ret = pthread_create(&stallmon_tid, NULL, stallmon_thread, NULL);
+	if (ret != 0) {
+		pr_err("stallmon: watchdog thread create failed: %d\n", ret);
+		stallmon_running = false;
+		return -ret;
+	}
+	pthread_setname_np(stallmon_tid, "stallmon");
+	pr_info("stallmon: watching DM workers, stall timeout %ds\n",
+		timeout_sec);
+	return 0;
+}
+
+void
+stallmon_deinit(void)
+{
+	if (stallmon_running) {
+		stallmon_running = false;
+		pthread_join(stallmon_tid, NULL);
+	}
+}
@@ -163,47 +163,19 @@ acrn_parse_ramdisk(char *arg)
 static int
 acrn_prepare_ramdisk(struct vmctx *ctx)
 {
-	FILE *fp;
-	long len;
-	size_t read;
-
-	fp = fopen(ramdisk_path, "r");
-	if (fp == NULL) {
-		pr_err("SW_LOAD ERR: could not open ramdisk file %s\n",
-				ramdisk_path);
-		return -1;
-	}
-
-	fseek(fp, 0, SEEK_END);
-	len = ftell(fp);
-
-	if (len != ramdisk_size) {
-		fprintf(stderr,
-			"SW_LOAD ERR: ramdisk file changed\n");
-		fclose(fp);
-		return -1;
-	}
-
 	/* make sure there is enough room for the theoretical maximum ramdisk
 	 * size (kernel size is not yet available)
 	 */
 	if (ctx->lowmem <= (RAMDISK_LOAD_SIZE + 2*KB + KERNEL_LOAD_OFF(ctx))) {
 		pr_err("SW_LOAD ERR: the size of ramdisk file is too big"
-			" file len=0x%lx\n", len);
-		fclose(fp);
+			" file len=0x%lx\n", ramdisk_size);
 		return -1;
 	}
 
-	fseek(fp, 0, SEEK_SET);
-	read = fread(ctx->baseaddr + RAMDISK_LOAD_OFF(ctx),
-			sizeof(char), len, fp);
-	if (read < len) {
-		pr_err("SW_LOAD ERR: could not read the whole ramdisk file,"
-				" file len=%ld, read %lu\n", len, read);
-		fclose(fp);
+	if (load_image_file(ramdisk_path, ramdisk_size,
+			ctx->baseaddr + RAMDISK_LOAD_OFF(ctx)) != 0)
 		return -1;
-	}
-	fclose(fp);
+
 	pr_info("SW_LOAD: ramdisk %s size %lu copied to guest 0x%lx\n",
 			ramdisk_path, ramdisk_size, RAMDISK_LOAD_OFF(ctx));
 
@@ -213,43 +185,15 @@ acrn_prepare_ramdisk(struct vmctx *ctx)
 static int
 acrn_prepare_kernel(struct vmctx *ctx)
 {
-	FILE *fp;
-	long len;
-	size_t read;
-
-	fp = fopen(kernel_path, "r");
-	if (fp == NULL) {
-		pr_err("SW_LOAD ERR: could not open kernel file %s\n",
-				kernel_path);
-		return -1;
-	}
-
-	fseek(fp, 0, SEEK_END);
-	len = ftell(fp);
-
-	if (len != kernel_size) {
-		fprintf(stderr,
-			"SW_LOAD ERR: kernel file changed\n");
-		fclose(fp);
-		return -1;
-	}
-
-	if ((len + KERNEL_LOAD_OFF(ctx)) > RAMDISK_LOAD_OFF(ctx)) {
+	if ((kernel_size + KERNEL_LOAD_OFF(ctx)) > RAMDISK_LOAD_OFF(ctx)) {
 		pr_err("SW_LOAD ERR: need big system memory to fit image\n");
-		fclose(fp);
 		return -1;
 	}
 
-	fseek(fp, 0, SEEK_SET);
-	read = fread(ctx->baseaddr + KERNEL_LOAD_OFF(ctx),
-			sizeof(char), len, fp);
-	if (read < len) {
-		pr_err("SW_LOAD ERR: could not read the whole kernel file,"
-				" file len=%ld, read %lu\n", len, read);
-		fclose(fp);
+	if (load_image_file(kernel_path, kernel_size,
+			ctx->baseaddr + KERNEL_LOAD_OFF(ctx)) != 0)
 		return -1;
-	}
-	fclose(fp);
+
 	pr_info("SW_LOAD: kernel %s size %lu copied to guest 0x%lx\n",
 			kernel_path, kernel_size, KERNEL_LOAD_OFF(ctx));
 
@@ -28,6 +28,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "vmmapi.h"
 #include "sw_load.h"
@@ -159,6 +166,152 @@ check_image(char *path, size_t size_limit, size_t *size)
 	return 0;
 }
 
+/*
+ * Copy an image file into guest memory through a private file mapping.
+ *
+ * Guest RAM is a hugetlb backed shared mapping, so the file's page cache
+ * pages cannot simply be aliased into it; one copy is unavoidable. Mapping
+ * the file instead of fread()ing it skips the stdio layer, lets the kernel
+ * fault the image in with large readaheads, and leaves the pages in the
+ * page cache so back-to-back VM restarts reload the image from memory.
+ */
+int
+load_image_file(char *path, size_t expect_size, void *dest)
+{
+	int fd;
+	void *src;
+	struct stat st;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		pr_err("SW_LOAD ERR: could not open image file %s (%s)\n",
+			path, strerror(errno));
+		return -1;
+	}
+
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size != expect_size)) {
+		pr_err("SW_LOAD ERR: image file %s changed\n", path);
+		close(fd);
+		return -1;
+	}
+
+	src = mmap(NULL, expect_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (src == MAP_FAILED) {
+		pr_err("SW_LOAD ERR: could not mmap image file %s (%s)\n",
+			path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	stream_image_copy(path, src, dest, expect_size);
+
+	munmap(src, expect_size);
+	close(fd);
+	return 0;
+}
+
+/*
+ * Pipelined image placement.
+ *
+ * The loaders used to populate the whole source mapping (MAP_POPULATE)
+ * before the first byte was placed in guest memory, so load time was
+ * read time plus copy time. Here the copy walks the image in fixed
+ * chunks and asks the kernel to read the following window while the
+ * current chunk is placed, so the two stages overlap and load time
+ * approaches max(read, place). That is most visible when images sit on
+ * slow network-backed storage.
+ *
+ * A CRC32 of the image is computed on a worker thread alongside the
+ * copy and logged, so operators of network-fetched images can match a
+ * boot against a known-good image without a separate hashing pass.
+ * There is no manifest to verify against in the DM itself, and the
+ * load does not fail on checksum trouble - the thread is best-effort.
+ */
+#define SW_LOAD_CHUNK_SIZE	(2UL * 1024UL * 1024UL)
+/* how far the readahead window runs in front of the copy */
+#define SW_LOAD_RA_CHUNKS	2UL
+
+struct image_crc_job {
+	const uint8_t *base;
+	size_t size;
+	uint32_t crc;
+};
+
+/* CRC-32 (IEEE 802.3) over one chunk; state stays inverted between calls */
+static uint32_t
+crc32_chunk(uint32_t state, const uint8_t *data, size_t len)
+{
+	static const uint32_t tbl[16] = {
+		0x00000000U, 0x1db71064U, 0x3b6e20c8U, 0x26d930acU,
+		0x76dc4190U, 0x6b6b51f4U, 0x4db26158U, 0x5005713cU,
+		0xedb88320U, 0xf00f9344U, 0xd6d6a3e8U, 0xcb61b38cU,
+		0x9b64c2b0U, 0x86d3d2d4U, 0xa00ae278U, 0xbdbdf21cU
+	};
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		state ^= data[i];
+		state = (state >> 4) ^ tbl[state & 0xfU];
+		state = (state >> 4) ^ tbl[state & 0xfU];
+	}
+	return state;
+}
+
+static void *
+image_crc_thread(void *arg)
+{
+	struct image_crc_job *job = arg;
+	uint32_t state = ~0U;
+	size_t off, chunk;
+
+	/* walking the mapping sequentially faults the pages in, so this
+	 * thread doubles as the read stream whenever it runs ahead of
+	 * the copy
+	 */
+	for (off = 0; off < job->size; off += chunk) {
+		chunk = job->size - off;
+		if (chunk > SW_LOAD_CHUNK_SIZE)
+			chunk = SW_LOAD_CHUNK_SIZE;
+		state = crc32_chunk(state, job->base + off, chunk);
+	}
+	job->crc = ~state;
+	return NULL;
+}
+
+void
+stream_image_copy(char *path, void *src, void *dest, size_t size)
+{
+	struct image_crc_job job = { src, size, 0 };
+	pthread_t crc_tid;
+	bool crc_active;
+	size_t off, chunk, ra;
+
+	(void)madvise(src, size, MADV_SEQUENTIAL);
+	crc_active = (pthread_create(&crc_tid, NULL, image_crc_thread,
+			&job) == 0);
+
+	for (off = 0; off < size; off += chunk) {
+		chunk = size - off;
+		if (chunk > SW_LOAD_CHUNK_SIZE)
+			chunk = SW_LOAD_CHUNK_SIZE;
+		if ((off + chunk) < size) {
+			ra = size - (off + chunk);
+			if (ra > (SW_LOAD_RA_CHUNKS * SW_LOAD_CHUNK_SIZE))
+				ra = SW_LOAD_RA_CHUNKS * SW_LOAD_CHUNK_SIZE;
+			(void)madvise((uint8_t *)src + off + chunk, ra,
+					MADV_WILLNEED);
+		}
+		memcpy((uint8_t *)dest + off, (const uint8_t *)src + off,
+				chunk);
+	}
+
+	if (crc_active) {
+		pthread_join(crc_tid, NULL);
+		pr_info("SW_LOAD: %s size 0x%lx crc32 0x%08x\n",
+			path, size, job.crc);
+	}
+}
+
 /* Assumption:
  * the range [start, start + size] belongs to one entry of e820 table
  */
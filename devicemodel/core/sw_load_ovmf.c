@@ -150,10 +150,9 @@ static int
 acrn_prepare_ovmf(struct vmctx *ctx)
 {
 	int i, flags, fd;
-	char *path, *addr;
-	size_t size, size_limit, cur_size, read;
+	char *path, *addr, *src;
+	size_t size, size_limit, cur_size;
 	struct flock fl;
-	FILE *fp;
 
 	if (ovmf_file_name) {
 		path = ovmf_file_name;
@@ -231,25 +230,24 @@ acrn_prepare_ovmf(struct vmctx *ctx)
 			}
 		}
 
-		fp = fdopen(fd, "r");
+		/* map the blob and do the one unavoidable copy into the
+		 * hugetlb backed guest mapping, streamed so the disk read
+		 * overlaps the placement; the pages stay in the page cache
+		 * for the next VM start
+		 */
+		src = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-		if (fp == NULL) {
-			pr_err("SW_LOAD ERR: could not fdopen "
+		if (src == MAP_FAILED) {
+			pr_err("SW_LOAD ERR: could not mmap "
 				"ovmf file: %s (%s)\n",
 				path, strerror(errno));
 			close(fd);
 			return -1;
 		}
 
-		fseek(fp, 0, SEEK_SET);
-		read = fread(addr, sizeof(char), size, fp);
-		fclose(fp);
-
-		if (read < size) {
-			pr_err("SW_LOAD ERR: could not read whole partition blob %s\n",
-				path);
-			return -1;
-		}
+		stream_image_copy(path, src, addr, size);
+		munmap(src, size);
+		close(fd);
 
 		pr_info("SW_LOAD: partition blob %s size 0x%lx copied to addr %p\n",
 			path, size, addr);
@@ -42,6 +42,7 @@
 
 #include "vmmapi.h"
 #include "mevent.h"
+#include "cmd_monitor.h"
 #include "errno.h"
 
 #include "dm.h"
@@ -281,6 +282,30 @@ vm_notify_request_done(struct vmctx *ctx, int vcpu)
 	return error;
 }
 
+int
+vm_notify_all_request_done(struct vmctx *ctx)
+{
+	static bool batch_unsupported;
+	int error;
+	struct acrn_ioreq_notify notify;
+
+	if (batch_unsupported)
+		return -1;
+
+	bzero(&notify, sizeof(notify));
+	notify.vmid = ctx->vmid;
+	notify.vcpu = ACRN_IOREQ_VCPUID_ALL;
+
+	error = ioctl(ctx->fd, ACRN_IOCTL_NOTIFY_REQUEST_FINISH, &notify);
+
+	if (error) {
+		/* older HSM/hypervisor rejects the wildcard; fall back to per-vcpu notify */
+		batch_unsupported = true;
+	}
+
+	return error;
+}
+
 void
 vm_destroy(struct vmctx *ctx)
 {
@@ -350,6 +375,26 @@ vm_map_memseg_vma(struct vmctx *ctx, size_t len, vm_paddr_t gpa,
 	error = ioctl(ctx->fd, ACRN_IOCTL_SET_MEMSEG, &memmap);
 	if (error) {
 		pr_err("ACRN_IOCTL_SET_MEMSEG ioctl() returned an error: %s\n", errormsg(errno));
+	} else {
+		ctx->mem_gen++;
+	}
+	return error;
+}
+
+int
+vm_unmap_memseg_vma(struct vmctx *ctx, size_t len, vm_paddr_t gpa)
+{
+	struct acrn_vm_memmap memmap;
+	int error;
+	bzero(&memmap, sizeof(struct acrn_vm_memmap));
+	memmap.type = ACRN_MEMMAP_RAM;
+	memmap.len = len;
+	memmap.user_vm_pa = gpa;
+	error = ioctl(ctx->fd, ACRN_IOCTL_UNSET_MEMSEG, &memmap);
+	if (error) {
+		pr_err("ACRN_IOCTL_UNSET_MEMSEG ioctl() returned an error: %s\n", errormsg(errno));
+	} else {
+		ctx->mem_gen++;
 	}
 	return error;
 }
@@ -372,6 +417,12 @@ vm_setup_memory(struct vmctx *ctx, size_t memsize)
 	ctx->biosmem = high_bios_size();
 	ctx->fbmem = (16 * 1024 * 1024);
 
+	/*
+	 * The memory layout fields read by vm_gpa2hva() are about to
+	 * change; invalidate host pointers cached by device models
+	 */
+	ctx->mem_gen++;
+
 	return hugetlb_setup_memory(ctx);
 }
 
@@ -396,6 +447,7 @@ vm_unsetup_memory(struct vmctx *ctx)
 		bzero((void *)(ctx->baseaddr + ctx->highmem_gpa_base), ctx->highmem);
 	}
 
+	ctx->mem_gen++;
 	hugetlb_unsetup_memory(ctx);
 }
 
@@ -409,24 +461,13 @@ vm_unsetup_memory(struct vmctx *ctx)
 void *
 vm_map_gpa(struct vmctx *ctx, vm_paddr_t gaddr, size_t len)
 {
+	void *hva;
 
-	if (ctx->lowmem > 0) {
-		if (gaddr < ctx->lowmem && len <= ctx->lowmem &&
-		    gaddr + len <= ctx->lowmem)
-			return (ctx->baseaddr + gaddr);
-	}
-
-	if (ctx->highmem > 0) {
-		if (gaddr >= ctx->highmem_gpa_base) {
-			if (gaddr < ctx->highmem_gpa_base + ctx->highmem &&
-			    len <= ctx->highmem &&
-			    gaddr + len <= ctx->highmem_gpa_base + ctx->highmem)
-				return (ctx->baseaddr + gaddr);
-		}
-	}
+	hva = vm_gpa2hva(ctx, gaddr, len);
+	if (hva == NULL)
+		pr_dbg("%s context memory is not valid!\n", __func__);
 
-	pr_dbg("%s context memory is not valid!\n", __func__);
-	return NULL;
+	return hva;
 }
 
 size_t
@@ -484,6 +525,10 @@ vm_set_suspend_mode(enum vm_suspend_how how)
 {
 	pr_notice("VM state changed from[ %s ] to [ %s ]\n", vm_state_to_str(suspend_mode), vm_state_to_str(how));
 	suspend_mode = how;
+	/* push the transition to subscribed monitor clients instead of
+	 * making the orchestrator poll for it
+	 */
+	monitor_broadcast_event("vm_state", vm_state_to_str(how));
 }
 
 int
@@ -492,6 +537,27 @@ vm_get_suspend_mode(void)
 	return suspend_mode;
 }
 
+/*
+ * When set, a guest initiated poweroff or full reset restarts the guest
+ * in place instead of tearing the DM down: the HSM fd, memory mapping,
+ * ioreq client and monitor socket all survive and only the guest images
+ * are reloaded.  Explicit stop requests (signal, monitor) clear it so
+ * the operator can still take the VM down.
+ */
+static bool keepalive_mode = false;
+
+void
+vm_set_keepalive(bool enable)
+{
+	keepalive_mode = enable;
+}
+
+bool
+vm_get_keepalive(void)
+{
+	return keepalive_mode;
+}
+
 int
 vm_suspend(struct vmctx *ctx, enum vm_suspend_how how)
 {
@@ -691,6 +757,17 @@ vm_set_vcpu_regs(struct vmctx *ctx, struct acrn_vcpu_regs *vcpu_regs)
 	return error;
 }
 
+int
+vm_get_vcpu_regs(struct vmctx *ctx, struct acrn_vcpu_regs *vcpu_regs)
+{
+	int error;
+	error = ioctl(ctx->fd, ACRN_IOCTL_GET_VCPU_REGS, vcpu_regs);
+	if (error) {
+		pr_err("ACRN_IOCTL_GET_VCPU_REGS ioctl() returned an error: %s\n", errormsg(errno));
+	}
+	return error;
+}
+
 int
 vm_get_cpu_state(struct vmctx *ctx, void *state_buf)
 {
@@ -713,6 +790,69 @@ vm_intr_monitor(struct vmctx *ctx, void *intr_buf)
 	return error;
 }
 
+/*
+ * EPT dirty-page tracking, the building block of iterative pre-copy of
+ * live guest memory: start tracking once, then repeat cycles of
+ * vm_dirty_track_harvest() followed by an atomic read-and-clear of the
+ * bitmap bits and a copy of the pages found dirty, and take the final
+ * cycle with the guest paused before vm_dirty_track_stop().
+ */
+int
+vm_dirty_track_start(struct vmctx *ctx, void *bitmap, uint64_t bitmap_size)
+{
+	struct acrn_dirty_track dirty_track = {
+		.cmd = ACRN_DIRTY_TRACK_START,
+		.bitmap_uaddr = (uint64_t)bitmap,
+		.bitmap_size = bitmap_size,
+	};
+	int error;
+
+	error = ioctl(ctx->fd, ACRN_IOCTL_VM_DIRTY_TRACK, &dirty_track);
+	if (error) {
+		pr_err("ACRN_IOCTL_VM_DIRTY_TRACK ioctl() returned an error: %s\n", errormsg(errno));
+	}
+	return error;
+}
+
+int
+vm_dirty_track_harvest(struct vmctx *ctx)
+{
+	struct acrn_dirty_track dirty_track = {
+		.cmd = ACRN_DIRTY_TRACK_HARVEST,
+	};
+	int error;
+
+	error = ioctl(ctx->fd, ACRN_IOCTL_VM_DIRTY_TRACK, &dirty_track);
+	if (error) {
+		pr_err("ACRN_IOCTL_VM_DIRTY_TRACK ioctl() returned an error: %s\n", errormsg(errno));
+	}
+	return error;
+}
+
+int
+vm_dirty_track_stop(struct vmctx *ctx)
+{
+	struct acrn_dirty_track dirty_track = {
+		.cmd = ACRN_DIRTY_TRACK_STOP,
+	};
+	int error;
+
+	error = ioctl(ctx->fd, ACRN_IOCTL_VM_DIRTY_TRACK, &dirty_track);
+	if (error) {
+		pr_err("ACRN_IOCTL_VM_DIRTY_TRACK ioctl() returned an error: %s\n", errormsg(errno));
+	}
+	return error;
+}
+
+int
+vm_get_launch_profile(struct vmctx *ctx, struct acrn_vm_launch_profile *profile)
+{
+	/* no pr_err on failure: an HSM without this ioctl is expected and
+	 * the caller just drops the hypervisor rows from its report
+	 */
+	return ioctl(ctx->fd, ACRN_IOCTL_GET_LAUNCH_PROFILE, profile);
+}
+
 int
 vm_ioeventfd(struct vmctx *ctx, struct acrn_ioeventfd *args)
 {
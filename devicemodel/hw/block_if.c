@@ -30,8 +30,12 @@
 #include <sys/queue.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
 #include <linux/falloc.h>
 #include <linux/fs.h>
+#include <linux/io_uring.h>
 #include <errno.h>
 #include <err.h>
 #include <fcntl.h>
@@ -40,12 +44,17 @@
 #include <string.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "dm.h"
 #include "block_if.h"
+#include "block_sparse.h"
+#include "stallmon.h"
 #include "ahci.h"
 #include "dm_string.h"
+#include "mevent.h"
+#include "timer.h"
 #include "log.h"
 
 /*
@@ -62,10 +71,16 @@
 
 #define BLOCKIF_SIG	0xb109b109
 
-#define BLOCKIF_NUMTHR	8
-#define BLOCKIF_MAXREQ	(64 + BLOCKIF_NUMTHR)
+/* shared worker pool, sized to the host core count at startup */
+#define BLOCKIF_POOL_MINTHR	2
+#define BLOCKIF_POOL_MAXTHR	32
+/* ring size plus headroom for requests already claimed by workers */
+#define BLOCKIF_MAXREQ	(64 + 8)
 #define MAX_DISCARD_SEGMENT	256
 
+/* enough ring room for every request plus a linked fsync per write */
+#define BLOCKIF_URING_ENTRIES	(2 * BLOCKIF_MAXREQ)
+
 /*
  * Debug printf
  */
@@ -95,6 +110,34 @@ struct blockif_elem {
 	enum blockstat	     status;
 	pthread_t            tid;
 	off_t		     block;
+	int		     err;
+};
+
+/*
+ * io_uring backend state. The kernel accesses the rings directly; the
+ * submission side is serialized by the context mutex like the request
+ * queues, completions are harvested from the mevent dispatch loop via
+ * the registered eventfd.
+ */
+struct blockif_uring {
+	int			ring_fd;
+	int			evfd;
+	struct mevent		*mevp;
+	unsigned int		sq_entries;
+	unsigned int		*sq_head;
+	unsigned int		*sq_tail;
+	unsigned int		*sq_mask;
+	unsigned int		*sq_array;
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_sz;
+	unsigned int		*cq_head;
+	unsigned int		*cq_tail;
+	unsigned int		*cq_mask;
+	struct io_uring_cqe	*cqes;
+	void			*sq_ring;
+	size_t			sq_ring_sz;
+	void			*cq_ring;
+	size_t			cq_ring_sz;
 };
 
 struct blockif_ctxt {
@@ -113,18 +156,48 @@ struct blockif_ctxt {
 	int			max_discard_seg;
 	int			discard_sector_alignment;
 	int			closing;
-	pthread_t		btid[BLOCKIF_NUMTHR];
+	int			inflight;	/* requests held by pool workers */
+	TAILQ_ENTRY(blockif_ctxt) pool_link;
 	pthread_mutex_t		mtx;
 	pthread_cond_t		cond;
 
+	/* io_uring backend, used when "aio=io_uring" is requested */
+	int			use_uring;
+	struct blockif_uring	ur;
+
+	/* sparse image handle, used when "sparse" is requested */
+	struct sparse_disk	*sparse;
+
 	/* Request elements and free/pending/busy queues */
 	TAILQ_HEAD(, blockif_elem) freeq;
 	TAILQ_HEAD(, blockif_elem) pendq;
 	TAILQ_HEAD(, blockif_elem) busyq;
 	struct blockif_elem	reqs[BLOCKIF_MAXREQ];
 
+	/* token-bucket I/O shaping; a limit of 0 means unshaped */
+	uint64_t		iops_limit;
+	uint64_t		bps_limit;
+	uint64_t		iops_tokens;
+	uint64_t		bps_tokens;
+	uint64_t		iops_last_ns;
+	uint64_t		bps_last_ns;
+	int			throttled;	/* head request waits for tokens */
+
 	/* write cache enable */
 	uint8_t			wce;
+
+	/* write-back flush batching: completed writes accumulate in
+	 * dirty_bytes, guest flushes join sync epochs so any number of
+	 * concurrent flushes retire on a single fdatasync, and a full
+	 * dirty budget (dirtycap=, 0 means uncapped) parks further
+	 * writes in the pending queue until an epoch completes
+	 */
+	uint64_t		dirty_bytes;
+	uint64_t		dirty_cap;
+	uint64_t		flush_gen;	/* completed sync epochs */
+	int			flush_inflight;
+	int			flush_err;	/* result of last epoch */
+	pthread_cond_t		flush_cond;
 };
 
 static pthread_once_t blockif_once = PTHREAD_ONCE_INIT;
@@ -144,6 +217,8 @@ struct discard_range {
 
 static struct blockif_sig_elem *blockif_bse_head;
 
+static void blockif_pool_kick(void);
+
 static int
 blockif_flush_cache(struct blockif_ctxt *bc)
 {
@@ -157,11 +232,196 @@ blockif_flush_cache(struct blockif_ctxt *bc)
 	return err;
 }
 
+/*
+ * One fdatasync per epoch. A caller that arrives while a sync is
+ * already running cannot rely on it - fdatasync only covers data that
+ * was dirty when it was called - so it waits that epoch out and joins
+ * the next one; every caller waiting on the same epoch is retired by a
+ * single fdatasync no matter how many virtqueues flushed at once. The
+ * dirty counter is cleared when the sync starts, so writes landing
+ * while it runs are charged to the next epoch. Called without bc->mtx.
+ */
+static int
+blockif_flush_epoch(struct blockif_ctxt *bc)
+{
+	uint64_t target;
+	int err;
+
+	pthread_mutex_lock(&bc->mtx);
+	target = bc->flush_gen + (bc->flush_inflight ? 2 : 1);
+	while (bc->flush_gen < target) {
+		if (!bc->flush_inflight) {
+			bc->flush_inflight = 1;
+			bc->dirty_bytes = 0;
+			pthread_mutex_unlock(&bc->mtx);
+			err = fdatasync(bc->fd) ? errno : 0;
+			pthread_mutex_lock(&bc->mtx);
+			bc->flush_inflight = 0;
+			bc->flush_gen++;
+			bc->flush_err = err;
+			pthread_cond_broadcast(&bc->flush_cond);
+		} else {
+			pthread_cond_wait(&bc->flush_cond, &bc->mtx);
+		}
+	}
+	err = bc->flush_err;
+	pthread_mutex_unlock(&bc->mtx);
+
+	/* writes parked on the dirty budget are runnable again */
+	if (bc->dirty_cap != 0)
+		blockif_pool_kick();
+	return err;
+}
+
+/*
+ * Per-write cache bookkeeping. Writethrough keeps its synchronous
+ * fsync; write-back with a dirty cap counts the bytes and the writer
+ * that fills the budget pays for the sync, which is the backpressure
+ * that un-parks the queue.
+ */
+static int
+blockif_dirty_track(struct blockif_ctxt *bc, uint64_t len)
+{
+	int full;
+
+	if (!bc->wce)
+		return blockif_flush_cache(bc);
+	if (bc->dirty_cap == 0)
+		return 0;
+
+	pthread_mutex_lock(&bc->mtx);
+	bc->dirty_bytes += len;
+	full = (bc->dirty_bytes >= bc->dirty_cap);
+	pthread_mutex_unlock(&bc->mtx);
+
+	return full ? blockif_flush_epoch(bc) : 0;
+}
+
+/*
+ * A request must wait only for an earlier request whose byte range
+ * actually overlaps its own; be->block holds the exclusive end offset.
+ * The old test blocked any request starting exactly where an in-flight
+ * one ended, which serialized every sequential stream - a queue of 32
+ * adjacent NCQ reads would run strictly one at a time.  Flushes carry
+ * an empty range and order with nobody; fsync covers whatever has
+ * completed by the time it runs, as before.
+ */
+static int
+blockif_overlaps(struct blockif_elem *tbe, off_t start, off_t end)
+{
+	if (tbe->op == BOP_FLUSH)
+		return 0;
+	return (start < tbe->block && tbe->req->offset < end);
+}
+
+static int
+blockif_blocked(struct blockif_ctxt *bc, struct blockif_elem *be)
+{
+	struct blockif_elem *tbe;
+
+	if (be->op == BOP_FLUSH)
+		return 0;
+	TAILQ_FOREACH(tbe, &bc->pendq, link) {
+		if (tbe == be)
+			break;
+		if (blockif_overlaps(tbe, be->req->offset, be->block))
+			return 1;
+	}
+	TAILQ_FOREACH(tbe, &bc->busyq, link) {
+		if (blockif_overlaps(tbe, be->req->offset, be->block))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Token-bucket I/O shaping. Each context carries one bucket for request
+ * count and one for bytes; both refill continuously at the configured
+ * per-second rate and hold at most one second of burst. Dispatch charges
+ * the head request only - a request that cannot pay blocks the queue
+ * rather than letting smaller requests overtake it, so shaping never
+ * reorders beyond what blockif_blocked() already allows. A periodic
+ * timer re-kicks throttled contexts once tokens have accumulated.
+ */
+#define BLOCKIF_TB_TICK_MS	10
+
+static uint64_t
+blockif_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void
+blockif_tb_refill(uint64_t limit, uint64_t *tokens, uint64_t *last, uint64_t now)
+{
+	uint64_t delta, add;
+
+	if (limit == 0)
+		return;
+	delta = now - *last;
+	if (delta > NS_PER_SEC) {
+		delta = NS_PER_SEC;
+		*last = now - NS_PER_SEC;
+	}
+	add = (limit * delta) / NS_PER_SEC;
+	if (add > 0) {
+		/* advance by the time the granted tokens represent, so the
+		 * sub-token remainder is not lost between refills
+		 */
+		*last += (add * NS_PER_SEC) / limit;
+		*tokens += add;
+		if (*tokens >= limit) {
+			*tokens = limit;
+			*last = now;
+		}
+	}
+}
+
+/* charge one request against the buckets; called with bc->mtx held,
+ * returns 0 and marks the context throttled if tokens are short
+ */
+static int
+blockif_tb_charge(struct blockif_ctxt *bc, struct blockif_elem *be)
+{
+	uint64_t bytes = 0, now;
+
+	if (bc->iops_limit == 0 && bc->bps_limit == 0)
+		return 1;
+
+	now = blockif_now_ns();
+	blockif_tb_refill(bc->iops_limit, &bc->iops_tokens,
+			  &bc->iops_last_ns, now);
+	blockif_tb_refill(bc->bps_limit, &bc->bps_tokens,
+			  &bc->bps_last_ns, now);
+
+	if (be->op == BOP_READ || be->op == BOP_WRITE)
+		bytes = be->block - be->req->offset;
+
+	/* a request larger than a full bucket passes when the bucket is
+	 * full, else it could never be dispatched at all
+	 */
+	if ((bc->iops_limit != 0 && bc->iops_tokens == 0) ||
+	    (bc->bps_limit != 0 && bc->bps_tokens < bytes &&
+	     bc->bps_tokens < bc->bps_limit)) {
+		bc->throttled = 1;
+		return 0;
+	}
+	if (bc->iops_limit != 0)
+		bc->iops_tokens--;
+	if (bc->bps_limit != 0)
+		bc->bps_tokens -= (bc->bps_tokens > bytes) ? bytes
+							   : bc->bps_tokens;
+	return 1;
+}
+
 static int
 blockif_enqueue(struct blockif_ctxt *bc, struct blockif_req *breq,
 		enum blockop op)
 {
-	struct blockif_elem *be, *tbe;
+	struct blockif_elem *be;
 	off_t off;
 	int i;
 
@@ -182,25 +442,11 @@ blockif_enqueue(struct blockif_ctxt *bc, struct blockif_req *breq,
 			off += breq->iov[i].iov_len;
 		break;
 	default:
-		/* off = OFF_MAX; */
-		off = 1 << (sizeof(off_t) - 1);
+		off = breq->offset;	/* empty range */
 	}
 	be->block = off;
-	TAILQ_FOREACH(tbe, &bc->pendq, link) {
-		if (tbe->block == breq->offset)
-			break;
-	}
-	if (tbe == NULL) {
-		TAILQ_FOREACH(tbe, &bc->busyq, link) {
-			if (tbe->block == breq->offset)
-				break;
-		}
-	}
-	if (tbe == NULL)
-		be->status = BST_PEND;
-	else
-		be->status = BST_BLOCK;
 	TAILQ_INSERT_TAIL(&bc->pendq, be, link);
+	be->status = blockif_blocked(bc, be) ? BST_BLOCK : BST_PEND;
 	return (be->status == BST_PEND);
 }
 
@@ -210,11 +456,24 @@ blockif_dequeue(struct blockif_ctxt *bc, pthread_t t, struct blockif_elem **bep)
 	struct blockif_elem *be;
 
 	TAILQ_FOREACH(be, &bc->pendq, link) {
-		if (be->status == BST_PEND)
-			break;
+		if (be->status != BST_PEND)
+			continue;
+		/* dirty budget full: writes stay parked until an epoch
+		 * retires; flushes must keep flowing since they are what
+		 * drains the budget. A parked write has not completed, so
+		 * a flush passing it does not weaken flush semantics.
+		 * Teardown drains unconditionally or close would spin on
+		 * a parked write that no flush is coming for.
+		 */
+		if (be->op == BOP_WRITE && bc->wce && bc->dirty_cap != 0 &&
+		    bc->dirty_bytes >= bc->dirty_cap && !bc->closing)
+			continue;
+		break;
 	}
 	if (be == NULL)
 		return 0;
+	if (!blockif_tb_charge(bc, be))
+		return 0;
 	TAILQ_REMOVE(&bc->pendq, be, link);
 	be->status = BST_BUSY;
 	be->tid = t;
@@ -233,7 +492,7 @@ blockif_complete(struct blockif_ctxt *bc, struct blockif_elem *be)
 	else
 		TAILQ_REMOVE(&bc->pendq, be, link);
 	TAILQ_FOREACH(tbe, &bc->pendq, link) {
-		if (tbe->req->offset == be->block)
+		if (tbe->status == BST_BLOCK && !blockif_blocked(bc, tbe))
 			tbe->status = BST_PEND;
 	}
 	be->tid = 0;
@@ -302,6 +561,13 @@ blockif_process_discard(struct blockif_ctxt *bc, struct blockif_req *br)
 	for (i = 0; i < segment; i++) {
 		if (bc->isblk) {
 			err = ioctl(bc->fd, BLKDISCARD, arg[i]);
+		} else if (bc->sparse) {
+			/* punches the data of the covered clusters, the
+			 * cluster map itself stays intact
+			 */
+			err = sparse_discard(bc->sparse, arg[i][0], arg[i][1]);
+			if (!err)
+				err = fdatasync(bc->fd);
 		} else {
 			/* FALLOC_FL_PUNCH_HOLE:
 			 *	Deallocates space in the byte range starting at offset and
@@ -326,6 +592,33 @@ blockif_process_discard(struct blockif_ctxt *bc, struct blockif_req *br)
 	return 0;
 }
 
+/*
+ * Sparse images take the scatter list apart themselves: the sparse layer
+ * splits every segment on cluster boundaries anyway, so an iov loop over
+ * sparse_pread/sparse_pwrite costs nothing extra over a real preadv.
+ */
+static ssize_t
+blockif_sparse_rwv(struct blockif_ctxt *bc, const struct iovec *iov,
+		   int iovcnt, off_t offset, int iswrite)
+{
+	ssize_t total = 0, n;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iswrite)
+			n = sparse_pwrite(bc->sparse, iov[i].iov_base,
+					  iov[i].iov_len, offset);
+		else
+			n = sparse_pread(bc->sparse, iov[i].iov_base,
+					 iov[i].iov_len, offset);
+		if (n < 0)
+			return -1;
+		total += n;
+		offset += n;
+	}
+	return total;
+}
+
 static void
 blockif_proc(struct blockif_ctxt *bc, struct blockif_elem *be)
 {
@@ -337,8 +630,12 @@ blockif_proc(struct blockif_ctxt *bc, struct blockif_elem *be)
 	err = 0;
 	switch (be->op) {
 	case BOP_READ:
-		len = preadv(bc->fd, br->iov, br->iovcnt,
-				 br->offset + bc->sub_file_start_lba);
+		if (bc->sparse)
+			len = blockif_sparse_rwv(bc, br->iov, br->iovcnt,
+					br->offset, 0);
+		else
+			len = preadv(bc->fd, br->iov, br->iovcnt,
+					 br->offset + bc->sub_file_start_lba);
 		if (len < 0)
 			err = errno;
 		else
@@ -350,17 +647,23 @@ blockif_proc(struct blockif_ctxt *bc, struct blockif_elem *be)
 			break;
 		}
 
-		len = pwritev(bc->fd, br->iov, br->iovcnt,
-				  br->offset + bc->sub_file_start_lba);
+		if (bc->sparse)
+			len = blockif_sparse_rwv(bc, br->iov, br->iovcnt,
+					br->offset, 1);
+		else
+			len = pwritev(bc->fd, br->iov, br->iovcnt,
+					  br->offset + bc->sub_file_start_lba);
 		if (len < 0)
 			err = errno;
 		else {
 			br->resid -= len;
-			err = blockif_flush_cache(bc);
+			err = blockif_dirty_track(bc, (uint64_t)len);
 		}
 		break;
 	case BOP_FLUSH:
-		if (fsync(bc->fd))
+		if (bc->wce)
+			err = blockif_flush_epoch(bc);
+		else if (fsync(bc->fd))
 			err = errno;
 		break;
 	case BOP_DISCARD:
@@ -376,34 +679,511 @@ blockif_proc(struct blockif_ctxt *bc, struct blockif_elem *be)
 	(*br->callback)(br, err);
 }
 
-static void *
-blockif_thr(void *arg)
+/*
+ * All block contexts share one worker pool sized to the host core count.
+ * Workers sweep the registered contexts round-robin and take whatever
+ * request blockif_dequeue() hands out, so an idle disk's share of the
+ * pool flows to a busy one. The per-context queues are untouched, which
+ * keeps the same-block ordering guarantee of blockif_enqueue() intact.
+ *
+ * Lock order is pool mutex first, then a context mutex, and the context
+ * mutex is only ever taken with trylock from that path; everyone else
+ * holds no context mutex when taking the pool mutex.
+ */
+static struct blockif_pool {
+	pthread_mutex_t		mtx;
+	pthread_cond_t		cond;
+	TAILQ_HEAD(, blockif_ctxt) ctxts;
+	pthread_t		threads[BLOCKIF_POOL_MAXTHR];
+	int			nthreads;
+	uint64_t		gen;	/* bumped on every kick */
+} blockif_pool = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.ctxts = TAILQ_HEAD_INITIALIZER(blockif_pool.ctxts),
+};
+
+/* Tell the pool that new work may be runnable. Callers must not hold the
+ * mutex of the context the work belongs to, or a worker that fails the
+ * trylock right now could go to sleep without a later wakeup.
+ */
+static void
+blockif_pool_kick(void)
+{
+	pthread_mutex_lock(&blockif_pool.mtx);
+	blockif_pool.gen++;
+	pthread_cond_signal(&blockif_pool.cond);
+	pthread_mutex_unlock(&blockif_pool.mtx);
+}
+
+/*
+ * Steal one runnable request from any registered context and process it.
+ * Called and returns with the pool mutex held; returns 1 if a request
+ * was processed, 0 if every context came up empty.
+ */
+static const char *
+blockif_op_name(enum blockop op)
+{
+	switch (op) {
+	case BOP_READ:
+		return "read";
+	case BOP_WRITE:
+		return "write";
+	case BOP_FLUSH:
+		return "flush";
+	default:
+		return "discard";
+	}
+}
+
+static int
+blockif_pool_scan(pthread_t t, struct stallmon_worker *mon)
 {
 	struct blockif_ctxt *bc;
 	struct blockif_elem *be;
+
+	TAILQ_FOREACH(bc, &blockif_pool.ctxts, pool_link) {
+		if (pthread_mutex_trylock(&bc->mtx))
+			continue;
+		if (!blockif_dequeue(bc, t, &be)) {
+			pthread_mutex_unlock(&bc->mtx);
+			continue;
+		}
+		bc->inflight++;
+		/* rotate the winner to the tail for round-robin fairness */
+		TAILQ_REMOVE(&blockif_pool.ctxts, bc, pool_link);
+		TAILQ_INSERT_TAIL(&blockif_pool.ctxts, bc, pool_link);
+		/* let a peer pick up whatever is queued behind this one */
+		if (!TAILQ_EMPTY(&bc->pendq))
+			pthread_cond_signal(&blockif_pool.cond);
+		pthread_mutex_unlock(&bc->mtx);
+		pthread_mutex_unlock(&blockif_pool.mtx);
+
+		stallmon_begin(mon, "%s of %zd bytes @ offset 0x%lx, fd %d",
+			       blockif_op_name(be->op), be->req->resid,
+			       (long)be->req->offset, bc->fd);
+		blockif_proc(bc, be);
+		stallmon_end(mon);
+
+		pthread_mutex_lock(&bc->mtx);
+		blockif_complete(bc, be);
+		bc->inflight--;
+		if (bc->closing)
+			pthread_cond_signal(&bc->cond);
+		pthread_mutex_unlock(&bc->mtx);
+
+		pthread_mutex_lock(&blockif_pool.mtx);
+		return 1;
+	}
+	return 0;
+}
+
+static void *
+blockif_pool_thr(void *arg)
+{
+	struct stallmon_worker *mon;
 	pthread_t t;
+	uint64_t gen;
 
-	bc = arg;
 	t = pthread_self();
+	mon = stallmon_register("blk-pool-%d", (int)(intptr_t)arg);
+
+	pthread_mutex_lock(&blockif_pool.mtx);
+	for (;;) {
+		gen = blockif_pool.gen;
+		if (blockif_pool_scan(t, mon))
+			continue;
+		/* nothing runnable anywhere; sleep unless kicked meanwhile */
+		if (blockif_pool.gen == gen)
+			pthread_cond_wait(&blockif_pool.cond,
+					  &blockif_pool.mtx);
+	}
+	return NULL;
+}
+
+static void
+blockif_pool_register(struct blockif_ctxt *bc)
+{
+	pthread_mutex_lock(&blockif_pool.mtx);
+	TAILQ_INSERT_TAIL(&blockif_pool.ctxts, bc, pool_link);
+	pthread_mutex_unlock(&blockif_pool.mtx);
+}
+
+static void
+blockif_pool_unregister(struct blockif_ctxt *bc)
+{
+	pthread_mutex_lock(&blockif_pool.mtx);
+	TAILQ_REMOVE(&blockif_pool.ctxts, bc, pool_link);
+	pthread_mutex_unlock(&blockif_pool.mtx);
+}
+
+static int
+io_uring_setup_sys(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+io_uring_enter_sys(int fd, unsigned int to_submit, unsigned int min_complete,
+		unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+			NULL, 0);
+}
+
+static int
+io_uring_register_sys(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int
+blockif_uring_eligible(struct blockif_ctxt *bc, enum blockop op)
+{
+	/* discard needs ioctl/fallocate and stays on the thread pool, as
+	 * does a write on a read-only backend so the error path is shared */
+	return (op == BOP_READ || op == BOP_FLUSH ||
+		(op == BOP_WRITE && !bc->rdonly));
+}
+
+/*
+ * Fill submission entries for one request. Writethru writes chain a
+ * data sync behind the write with IOSQE_IO_LINK; the write completion
+ * carries the transfer length (tagged via bit 0 of user_data) and the
+ * fsync completion finishes the request.
+ * Returns the number of entries used, or -1 if the ring is full.
+ */
+static int
+blockif_uring_prep(struct blockif_ctxt *bc, struct blockif_elem *be)
+{
+	struct blockif_uring *ur = &bc->ur;
+	struct blockif_req *br = be->req;
+	struct io_uring_sqe *sqe;
+	unsigned int tail, mask;
+	int nsqe;
+
+	nsqe = (be->op == BOP_WRITE && !bc->wce) ? 2 : 1;
+	tail = *ur->sq_tail;
+	mask = *ur->sq_mask;
+	if ((tail + nsqe - *ur->sq_head) > ur->sq_entries)
+		return -1;
+
+	sqe = &ur->sqes[tail & mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = bc->fd;
+	sqe->user_data = (uintptr_t)be;
+	switch (be->op) {
+	case BOP_READ:
+		sqe->opcode = IORING_OP_READV;
+		sqe->addr = (uintptr_t)br->iov;
+		sqe->len = br->iovcnt;
+		sqe->off = br->offset + bc->sub_file_start_lba;
+		break;
+	case BOP_WRITE:
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (uintptr_t)br->iov;
+		sqe->len = br->iovcnt;
+		sqe->off = br->offset + bc->sub_file_start_lba;
+		if (!bc->wce) {
+			sqe->flags |= IOSQE_IO_LINK;
+			sqe->user_data |= 1;
+			ur->sq_array[tail & mask] = tail & mask;
+			tail++;
+			sqe = &ur->sqes[tail & mask];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_FSYNC;
+			sqe->fd = bc->fd;
+			sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+			sqe->user_data = (uintptr_t)be;
+		}
+		break;
+	case BOP_FLUSH:
+		sqe->opcode = IORING_OP_FSYNC;
+		break;
+	default:
+		return -1;
+	}
+	ur->sq_array[tail & mask] = tail & mask;
+	__atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return nsqe;
+}
 
+/*
+ * Move every unblocked, uring-eligible request from the pending queue
+ * into the ring and submit them in one io_uring_enter() call.
+ * Called with the context mutex held.
+ */
+static void
+blockif_uring_submit_pending(struct blockif_ctxt *bc)
+{
+	struct blockif_elem *be, *tbe;
+	unsigned int nr = 0;
+	int n;
+
+	be = TAILQ_FIRST(&bc->pendq);
+	while (be != NULL) {
+		tbe = TAILQ_NEXT(be, link);
+		if (be->status == BST_PEND && blockif_uring_eligible(bc, be->op)) {
+			if (!blockif_tb_charge(bc, be))
+				break;
+			n = blockif_uring_prep(bc, be);
+			if (n < 0) {
+				/* ring full, retried on the next completion;
+				 * refund what was just charged
+				 */
+				if (bc->iops_limit != 0)
+					bc->iops_tokens++;
+				if (bc->bps_limit != 0 &&
+				    (be->op == BOP_READ || be->op == BOP_WRITE)) {
+					bc->bps_tokens += be->block -
+							  be->req->offset;
+					if (bc->bps_tokens > bc->bps_limit)
+						bc->bps_tokens = bc->bps_limit;
+				}
+				break;
+			}
+			TAILQ_REMOVE(&bc->pendq, be, link);
+			be->status = BST_BUSY;
+			be->tid = 0;
+			TAILQ_INSERT_TAIL(&bc->busyq, be, link);
+			nr += n;
+		}
+		be = tbe;
+	}
+	if (nr > 0 && io_uring_enter_sys(bc->ur.ring_fd, nr, 0, 0) < 0)
+		WPRINTF(("%s: io_uring_enter failed: %d\n", __func__, errno));
+}
+
+/*
+ * Periodic re-dispatch of throttled contexts, running once any context
+ * has limits configured. Lock order matches blockif_pool_scan(): pool
+ * mutex first, context mutex by trylock only; a context whose lock is
+ * busy simply stays throttled until the next tick.
+ */
+static struct acrn_timer blockif_tb_timer;
+static int blockif_tb_timer_on;
+
+static void
+blockif_tb_timer_cb(void *arg __attribute__((unused)),
+		    uint64_t nexp __attribute__((unused)))
+{
+	struct blockif_ctxt *bc;
+	int kick = 0;
+
+	pthread_mutex_lock(&blockif_pool.mtx);
+	TAILQ_FOREACH(bc, &blockif_pool.ctxts, pool_link) {
+		if (!bc->throttled)
+			continue;
+		if (pthread_mutex_trylock(&bc->mtx)) {
+			kick = 1;
+			continue;
+		}
+		bc->throttled = 0;
+		if (bc->use_uring)
+			blockif_uring_submit_pending(bc);
+		else
+			kick = 1;
+		pthread_mutex_unlock(&bc->mtx);
+	}
+	pthread_mutex_unlock(&blockif_pool.mtx);
+	if (kick)
+		blockif_pool_kick();
+}
+
+static void
+blockif_tb_timer_start(void)
+{
+	struct itimerspec ts = {
+		.it_interval = { 0, BLOCKIF_TB_TICK_MS * 1000000L },
+		.it_value = { 0, BLOCKIF_TB_TICK_MS * 1000000L },
+	};
+
+	pthread_mutex_lock(&blockif_pool.mtx);
+	if (!blockif_tb_timer_on) {
+		blockif_tb_timer.clockid = CLOCK_MONOTONIC;
+		if (acrn_timer_init(&blockif_tb_timer, blockif_tb_timer_cb,
+				    NULL) == 0 &&
+		    acrn_timer_settime(&blockif_tb_timer, &ts) == 0)
+			blockif_tb_timer_on = 1;
+		else
+			WPRINTF(("%s: failed to start shaping timer\n",
+				 __func__));
+	}
+	pthread_mutex_unlock(&blockif_pool.mtx);
+}
+
+int
+blockif_set_rate(struct blockif_ctxt *bc, uint64_t iops, uint64_t bps)
+{
 	pthread_mutex_lock(&bc->mtx);
+	bc->iops_limit = iops;
+	bc->bps_limit = bps;
+	/* start with full buckets so the new rate takes effect smoothly */
+	bc->iops_tokens = iops;
+	bc->bps_tokens = bps;
+	bc->iops_last_ns = blockif_now_ns();
+	bc->bps_last_ns = bc->iops_last_ns;
+	bc->throttled = 0;
+	if (bc->use_uring)
+		blockif_uring_submit_pending(bc);
+	pthread_mutex_unlock(&bc->mtx);
 
-	for (;;) {
-		while (blockif_dequeue(bc, t, &be)) {
-			pthread_mutex_unlock(&bc->mtx);
-			blockif_proc(bc, be);
+	if (iops != 0 || bps != 0)
+		blockif_tb_timer_start();
+	blockif_pool_kick();
+	return 0;
+}
+
+void
+blockif_get_rate(struct blockif_ctxt *bc, uint64_t *iops, uint64_t *bps)
+{
+	pthread_mutex_lock(&bc->mtx);
+	*iops = bc->iops_limit;
+	*bps = bc->bps_limit;
+	pthread_mutex_unlock(&bc->mtx);
+}
+
+static void
+blockif_uring_completion(int fd, enum ev_type type __attribute__((unused)),
+		void *arg)
+{
+	struct blockif_ctxt *bc = arg;
+	struct blockif_uring *ur = &bc->ur;
+	struct blockif_elem *be;
+	struct blockif_req *br;
+	struct io_uring_cqe *cqe;
+	eventfd_t cnt;
+	unsigned int head;
+	int err;
+
+	if (eventfd_read(fd, &cnt) < 0 && errno != EAGAIN)
+		return;
+
+	head = *ur->cq_head;
+	while (head != __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &ur->cqes[head & *ur->cq_mask];
+		be = (struct blockif_elem *)(uintptr_t)(cqe->user_data & ~1ULL);
+		br = be->req;
+		if (cqe->user_data & 1) {
+			/* write half of a linked write+fsync pair */
+			if (cqe->res < 0)
+				be->err = -cqe->res;
+			else
+				br->resid -= cqe->res;
+		} else {
+			err = be->err;
+			be->err = 0;
+			if (cqe->res < 0) {
+				if (err == 0 && cqe->res != -ECANCELED)
+					err = -cqe->res;
+			} else {
+				br->resid -= cqe->res;
+			}
+
+			be->status = BST_DONE;
+			(*br->callback)(br, err);
 			pthread_mutex_lock(&bc->mtx);
 			blockif_complete(bc, be);
+			pthread_mutex_unlock(&bc->mtx);
 		}
-		/* Check ctxt status here to see if exit requested */
-		if (bc->closing)
-			break;
-		pthread_cond_wait(&bc->cond, &bc->mtx);
+		head++;
 	}
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
 
+	/* completions may have unblocked queued requests */
+	pthread_mutex_lock(&bc->mtx);
+	blockif_uring_submit_pending(bc);
+	if (bc->closing)
+		pthread_cond_signal(&bc->cond);
 	pthread_mutex_unlock(&bc->mtx);
-	pthread_exit(NULL);
-	return NULL;
+	blockif_pool_kick();
+}
+
+static int
+blockif_uring_setup(struct blockif_ctxt *bc)
+{
+	struct blockif_uring *ur = &bc->ur;
+	struct io_uring_params p;
+
+	ur->ring_fd = -1;
+	ur->evfd = -1;
+
+	memset(&p, 0, sizeof(p));
+	ur->ring_fd = io_uring_setup_sys(BLOCKIF_URING_ENTRIES, &p);
+	if (ur->ring_fd < 0) {
+		WPRINTF(("%s: io_uring_setup failed: %d\n", __func__, errno));
+		return -1;
+	}
+
+	ur->sq_entries = p.sq_entries;
+	ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+	ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_CQ_RING);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQES);
+	if (ur->sq_ring == MAP_FAILED || ur->cq_ring == MAP_FAILED ||
+			ur->sqes == MAP_FAILED) {
+		WPRINTF(("%s: failed to map io_uring rings\n", __func__));
+		goto fail;
+	}
+
+	ur->sq_head = ur->sq_ring + p.sq_off.head;
+	ur->sq_tail = ur->sq_ring + p.sq_off.tail;
+	ur->sq_mask = ur->sq_ring + p.sq_off.ring_mask;
+	ur->sq_array = ur->sq_ring + p.sq_off.array;
+	ur->cq_head = ur->cq_ring + p.cq_off.head;
+	ur->cq_tail = ur->cq_ring + p.cq_off.tail;
+	ur->cq_mask = ur->cq_ring + p.cq_off.ring_mask;
+	ur->cqes = ur->cq_ring + p.cq_off.cqes;
+
+	ur->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ur->evfd < 0) {
+		WPRINTF(("%s: failed to create eventfd\n", __func__));
+		goto fail;
+	}
+	if (io_uring_register_sys(ur->ring_fd, IORING_REGISTER_EVENTFD,
+			&ur->evfd, 1) < 0) {
+		WPRINTF(("%s: failed to register eventfd: %d\n", __func__, errno));
+		goto fail;
+	}
+
+	ur->mevp = mevent_add(ur->evfd, EVF_READ, blockif_uring_completion, bc,
+			NULL, NULL);
+	if (ur->mevp == NULL) {
+		WPRINTF(("%s: failed to add completion event\n", __func__));
+		goto fail;
+	}
+
+	return 0;
+fail:
+	if (ur->sqes != NULL && ur->sqes != MAP_FAILED)
+		munmap(ur->sqes, ur->sqes_sz);
+	if (ur->cq_ring != NULL && ur->cq_ring != MAP_FAILED)
+		munmap(ur->cq_ring, ur->cq_ring_sz);
+	if (ur->sq_ring != NULL && ur->sq_ring != MAP_FAILED)
+		munmap(ur->sq_ring, ur->sq_ring_sz);
+	if (ur->evfd >= 0)
+		close(ur->evfd);
+	close(ur->ring_fd);
+	return -1;
+}
+
+static void
+blockif_uring_teardown(struct blockif_ctxt *bc)
+{
+	struct blockif_uring *ur = &bc->ur;
+
+	mevent_delete(ur->mevp);
+	munmap(ur->sqes, ur->sqes_sz);
+	munmap(ur->cq_ring, ur->cq_ring_sz);
+	munmap(ur->sq_ring, ur->sq_ring_sz);
+	close(ur->evfd);
+	close(ur->ring_fd);
 }
 
 static void
@@ -437,7 +1217,26 @@ blockif_sigcont_handler(int signal)
 static void
 blockif_init(void)
 {
+	char tname[MAXCOMLEN + 1];
+	long ncpu;
+	int i;
+
 	signal(SIGCONT, blockif_sigcont_handler);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < BLOCKIF_POOL_MINTHR)
+		ncpu = BLOCKIF_POOL_MINTHR;
+	if (ncpu > BLOCKIF_POOL_MAXTHR)
+		ncpu = BLOCKIF_POOL_MAXTHR;
+	blockif_pool.nthreads = ncpu;
+	for (i = 0; i < blockif_pool.nthreads; i++) {
+		pthread_create(&blockif_pool.threads[i], NULL,
+			       blockif_pool_thr, (void *)(intptr_t)i);
+		if (snprintf(tname, sizeof(tname), "blk-pool-%d", i) >=
+				sizeof(tname))
+			pr_err("blk thread name too long");
+		pthread_setname_np(blockif_pool.threads[i], tname);
+	}
 }
 
 /*
@@ -490,7 +1289,6 @@ sub_file_unlock(struct blockif_ctxt *bc)
 struct blockif_ctxt *
 blockif_open(const char *optstr, const char *ident)
 {
-	char tname[MAXCOMLEN + 1];
 	/* char name[MAXPATHLEN]; */
 	char *nopt, *xopts, *cp;
 	struct blockif_ctxt *bc;
@@ -505,6 +1303,13 @@ blockif_open(const char *optstr, const char *ident)
 	off_t sub_file_start_lba, sub_file_size;
 	int sub_file_assign;
 	int max_discard_sectors, max_discard_seg, discard_sector_alignment;
+	int use_uring;
+	long iops_opt, bps_opt;
+	long dirtycap_opt;
+	int sparse_opt;
+	long sparse_mb;
+	char *sparse_backing;
+	struct sparse_disk *sparse;
 	off_t probe_arg[] = {0, 0};
 
 	pthread_once(&blockif_once, blockif_init);
@@ -525,6 +1330,14 @@ blockif_open(const char *optstr, const char *ident)
 	writeback = 0;
 
 	candiscard = 0;
+	use_uring = 0;
+	iops_opt = 0;
+	bps_opt = 0;
+	dirtycap_opt = 0;
+	sparse_opt = 0;
+	sparse_mb = 0;
+	sparse_backing = NULL;
+	sparse = NULL;
 
 	/*
 	 * The first element in the optstring is always a pathname.
@@ -570,6 +1383,59 @@ blockif_open(const char *optstr, const char *ident)
 			} else {
 				goto err;
 			}
+		} else if (!strncmp(cp, "aio", strlen("aio"))) {
+			/* aio=threads (default) or aio=io_uring */
+			strsep(&cp, "=");
+			if (cp == NULL)
+				goto err;
+			if (!strcmp(cp, "io_uring"))
+				use_uring = 1;
+			else if (!strcmp(cp, "threads"))
+				use_uring = 0;
+			else
+				goto err;
+		} else if (!strncmp(cp, "iops", strlen("iops"))) {
+			/* iops=<requests per second limit> */
+			if (!strsep(&cp, "=") ||
+				dm_strtol(cp, &cp, 10, &iops_opt) ||
+				iops_opt <= 0)
+				goto err;
+		} else if (!strncmp(cp, "bps", strlen("bps"))) {
+			/* bps=<bytes per second limit> */
+			if (!strsep(&cp, "=") ||
+				dm_strtol(cp, &cp, 10, &bps_opt) ||
+				bps_opt <= 0)
+				goto err;
+		} else if (!strncmp(cp, "dirtycap", strlen("dirtycap"))) {
+			/* dirtycap=<write-back dirty budget in MB> */
+			if (!strsep(&cp, "=") ||
+				dm_strtol(cp, &cp, 10, &dirtycap_opt) ||
+				dirtycap_opt <= 0)
+				goto err;
+		} else if (!strncmp(cp, "sparse", strlen("sparse"))) {
+			/*
+			 *  sparse
+			 * or
+			 *  sparse=create:<virtual size in MB>[:<backing image>]
+			 *
+			 * Never auto-detected: a guest could write the image
+			 * magic into a raw disk and change how its bytes are
+			 * interpreted on the next boot.
+			 */
+			sparse_opt = 1;
+			strsep(&cp, "=");
+			if (cp != NULL) {
+				if (strncmp(cp, "create:", strlen("create:")))
+					goto err;
+				cp += strlen("create:");
+				if (dm_strtol(cp, &cp, 10, &sparse_mb) ||
+					sparse_mb <= 0)
+					goto err;
+				if (*cp == ':')
+					sparse_backing = cp + 1;
+				else if (*cp != '\0')
+					goto err;
+			}
 		} else if (!strncmp(cp, "range", strlen("range"))) {
 			/* range=<start lba>/<subfile size> */
 			if (strsep(&cp, "=") &&
@@ -585,6 +1451,40 @@ blockif_open(const char *optstr, const char *ident)
 		}
 	}
 
+	if (dirtycap_opt > 0 && !writeback) {
+		WPRINTF(("dirtycap only applies to writeback, ignoring\n"));
+		dirtycap_opt = 0;
+	}
+	if (dirtycap_opt > 0 && use_uring) {
+		/* the ring completes writes on its own; the dirty budget
+		 * gate in blockif_dequeue() would never see them
+		 */
+		WPRINTF(("dirtycap not supported with aio=io_uring, "
+			 "ignoring\n"));
+		dirtycap_opt = 0;
+	}
+	if (sparse_opt && sub_file_assign) {
+		pr_err("sparse cannot be combined with range=\n");
+		goto err;
+	}
+	if (sparse_opt && use_uring) {
+		WPRINTF(("sparse images stay on the thread pool, "
+			 "ignoring aio=io_uring\n"));
+		use_uring = 0;
+	}
+	if (sparse_mb > 0) {
+		/* an existing image is simply opened, so a launch script can
+		 * carry the create syntax across reboots
+		 */
+		err_code = sparse_create(nopt, (uint64_t)sparse_mb << 20,
+					 sparse_backing);
+		if (err_code < 0 && err_code != -EEXIST) {
+			pr_err("Could not create sparse image %s: %d\n",
+				nopt, err_code);
+			goto err;
+		}
+	}
+
 	/*
 	 * To support "writeback" and "writethru" mode switch during runtime,
 	 * O_SYNC is not used directly, as O_SYNC flag cannot dynamic change
@@ -617,6 +1517,10 @@ blockif_open(const char *optstr, const char *ident)
 	psectsz = psectoff = 0;
 
 	if (S_ISBLK(sbuf.st_mode)) {
+		if (sparse_opt) {
+			pr_err("sparse requires a regular file, not %s\n", nopt);
+			goto err;
+		}
 		/* get size */
 		err_code = ioctl(fd, BLKGETSIZE, &sz);
 		if (err_code) {
@@ -658,6 +1562,16 @@ blockif_open(const char *optstr, const char *ident)
 		}
 
 	} else {
+		if (sparse_opt) {
+			/* size becomes the virtual capacity from the header,
+			 * not the (much smaller) on-disk file size
+			 */
+			sparse = sparse_open(fd, ro, &size);
+			if (sparse == NULL) {
+				pr_err("%s is not a valid sparse image\n", nopt);
+				goto err;
+			}
+		}
 		if (size < DEV_BSIZE || (size & (DEV_BSIZE - 1))) {
 			WPRINTF(("%s size not corret, should be multiple of %d\n",
 						nopt, DEV_BSIZE));
@@ -720,6 +1634,7 @@ blockif_open(const char *optstr, const char *ident)
 	}
 
 	bc->fd = fd;
+	bc->sparse = sparse;
 	bc->isblk = S_ISBLK(sbuf.st_mode);
 	bc->candiscard = candiscard;
 	if (candiscard) {
@@ -737,8 +1652,16 @@ blockif_open(const char *optstr, const char *ident)
 	bc->psectsz = psectsz;
 	bc->psectoff = psectoff;
 	bc->wce = writeback;
+	bc->dirty_cap = (uint64_t)dirtycap_opt << 20;
+	bc->iops_limit = iops_opt;
+	bc->bps_limit = bps_opt;
+	bc->iops_tokens = bc->iops_limit;
+	bc->bps_tokens = bc->bps_limit;
+	bc->iops_last_ns = blockif_now_ns();
+	bc->bps_last_ns = bc->iops_last_ns;
 	pthread_mutex_init(&bc->mtx, NULL);
 	pthread_cond_init(&bc->cond, NULL);
+	pthread_cond_init(&bc->flush_cond, NULL);
 	TAILQ_INIT(&bc->freeq);
 	TAILQ_INIT(&bc->pendq);
 	TAILQ_INIT(&bc->busyq);
@@ -747,15 +1670,19 @@ blockif_open(const char *optstr, const char *ident)
 		TAILQ_INSERT_HEAD(&bc->freeq, &bc->reqs[i], link);
 	}
 
-	for (i = 0; i < BLOCKIF_NUMTHR; i++) {
-		if (snprintf(tname, sizeof(tname), "blk-%s-%d",
-					ident, i) >= sizeof(tname)) {
-			pr_err("blk thread name too long");
-		}
-		pthread_create(&bc->btid[i], NULL, blockif_thr, bc);
-		pthread_setname_np(bc->btid[i], tname);
+	if (use_uring) {
+		if (blockif_uring_setup(bc) == 0)
+			bc->use_uring = 1;
+		else
+			WPRINTF(("%s: io_uring unavailable, falling back to "
+				 "the thread pool\n", __func__));
 	}
 
+	blockif_pool_register(bc);
+
+	if (bc->iops_limit != 0 || bc->bps_limit != 0)
+		blockif_tb_timer_start();
+
 	/* free strdup memory */
 	if (nopt) {
 		free(nopt);
@@ -768,6 +1695,8 @@ err:
 	if (nopt)
 		free(nopt);
 
+	if (sparse)
+		sparse_close(sparse);
 	if (fd >= 0)
 		close(fd);
 	return NULL;
@@ -784,11 +1713,19 @@ blockif_request(struct blockif_ctxt *bc, struct blockif_req *breq,
 	pthread_mutex_lock(&bc->mtx);
 	if (!TAILQ_EMPTY(&bc->freeq)) {
 		/*
-		 * Enqueue and inform the block i/o thread
-		 * that there is work available
+		 * Enqueue and submit straight into the io_uring from the
+		 * notify context, or kick the shared pool once the context
+		 * mutex is dropped below
 		 */
-		if (blockif_enqueue(bc, breq, op))
-			pthread_cond_signal(&bc->cond);
+		if (blockif_enqueue(bc, breq, op)) {
+			if (bc->use_uring && blockif_uring_eligible(bc, op)) {
+				blockif_uring_submit_pending(bc);
+			} else {
+				pthread_mutex_unlock(&bc->mtx);
+				blockif_pool_kick();
+				return err;
+			}
+		}
 	} else {
 		/*
 		 * Callers are not allowed to enqueue more than
@@ -865,6 +1802,15 @@ blockif_cancel(struct blockif_ctxt *bc, struct blockif_req *breq)
 		return -1;
 	}
 
+	if (be->tid == 0) {
+		/*
+		 * In flight in the io_uring; it cannot be interrupted and
+		 * will run to completion through the normal callback path.
+		 */
+		pthread_mutex_unlock(&bc->mtx);
+		return -EBUSY;
+	}
+
 	/*
 	 * Interrupt the processing thread to force it return
 	 * prematurely via it's normal callback path.
@@ -902,30 +1848,58 @@ blockif_cancel(struct blockif_ctxt *bc, struct blockif_req *breq)
 	return -EBUSY;
 }
 
+static int
+blockif_pendq_runnable(struct blockif_ctxt *bc)
+{
+	struct blockif_elem *be;
+
+	TAILQ_FOREACH(be, &bc->pendq, link) {
+		if (be->status == BST_PEND)
+			return 1;
+	}
+	return 0;
+}
+
 int
 blockif_close(struct blockif_ctxt *bc)
 {
-	void *jval;
-	int i;
+	struct timespec ts;
 
 	sub_file_unlock(bc);
 
 	/*
-	 * Stop the block i/o thread
+	 * Let the shared pool drain the requests already queued, then pull
+	 * the context out of the pool. The kick is re-issued on a short
+	 * period so a worker wakeup racing with teardown cannot wedge us.
 	 */
 	pthread_mutex_lock(&bc->mtx);
 	bc->closing = 1;
-	pthread_cond_broadcast(&bc->cond);
+	while (bc->inflight > 0 || blockif_pendq_runnable(bc)) {
+		pthread_mutex_unlock(&bc->mtx);
+		blockif_pool_kick();
+		pthread_mutex_lock(&bc->mtx);
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 10000000;	/* 10ms */
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&bc->cond, &bc->mtx, &ts);
+	}
 	pthread_mutex_unlock(&bc->mtx);
 
-	for (i = 0; i < BLOCKIF_NUMTHR; i++)
-		pthread_join(bc->btid[i], &jval);
+	blockif_pool_unregister(bc);
 
 	/* XXX Cancel queued i/o's ??? */
 
+	if (bc->use_uring)
+		blockif_uring_teardown(bc);
+
 	/*
 	 * Release resources
 	 */
+	if (bc->sparse)
+		sparse_close(bc->sparse);
 	close(bc->fd);
 	free(bc);
 
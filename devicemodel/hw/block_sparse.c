@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Native sparse image format for blockif file backends.
+ *
+ * Layout: a 4K header, a cluster mapping table, then data clusters
+ * appended in allocation order. The table holds one file offset per
+ * virtual cluster (0 = unallocated) and is mirrored in memory, so a
+ * lookup is one array load. Reads of unallocated clusters return zeroes
+ * without touching the disk, or read through to an optional backing
+ * image; the first write to such a cluster allocates it at the end of
+ * the file and copies the backing contents up (copy-on-write snapshots).
+ * Data space is grown with fallocate() in multi-cluster steps so the
+ * filesystem can hand out contiguous ranges, and sequential reads
+ * prefetch ahead across extent-contiguous clusters with fadvise().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "block_sparse.h"
+#include "log.h"
+
+#define SPARSE_MAGIC		"ACRNSPAR"
+#define SPARSE_MAGIC_LEN	8
+#define SPARSE_VERSION		1U
+#define SPARSE_HDR_SIZE		4096U
+#define SPARSE_CLUSTER_SHIFT	16U		/* 64 KiB clusters */
+#define SPARSE_BACKING_LEN	256
+
+/* grow the data area in steps of this many clusters */
+#define SPARSE_ALLOC_BATCH	8U
+
+/* how far a sequential reader is prefetched ahead */
+#define SPARSE_PREFETCH_BYTES	(1024U * 1024U)
+
+struct sparse_header {
+	char		magic[SPARSE_MAGIC_LEN];
+	uint32_t	version;
+	uint32_t	cluster_shift;
+	uint64_t	capacity;	/* virtual disk size in bytes */
+	uint64_t	table_offset;
+	uint32_t	table_entries;
+	uint32_t	flags;
+	char		backing[SPARSE_BACKING_LEN];
+} __attribute__((packed));
+
+struct sparse_disk {
+	int		fd;
+	int		rdonly;
+	uint32_t	cluster_size;
+	uint32_t	cluster_shift;
+	uint64_t	capacity;
+	uint64_t	table_offset;
+	uint32_t	table_entries;
+	uint64_t	*table;		/* in-memory mirror of the map */
+
+	/* backing image for copy-on-write, NULL if standalone */
+	struct sparse_disk *backing;
+	int		backing_fd;	/* raw backing, -1 if none/sparse */
+
+	/* end of the data area / next allocation, and how far space has
+	 * already been reserved with fallocate
+	 */
+	uint64_t	data_end;
+	uint64_t	reserved_end;
+
+	/* next offset a sequential reader would ask for */
+	off_t		seq_next;
+
+	/* serializes cluster allocation and table updates */
+	pthread_mutex_t	mtx;
+};
+
+static ssize_t
+full_pread(int fd, void *buf, size_t len, off_t off)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = pread(fd, (char *)buf + done, len - done, off + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0) {
+			/* short file: the tail reads as zeroes */
+			memset((char *)buf + done, 0, len - done);
+			break;
+		}
+		done += n;
+	}
+	return len;
+}
+
+static ssize_t
+full_pwrite(int fd, const void *buf, size_t len, off_t off)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < len) {
+		n = pwrite(fd, (const char *)buf + done, len - done, off + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += n;
+	}
+	return len;
+}
+
+int
+sparse_create(const char *path, uint64_t capacity, const char *backing)
+{
+	struct sparse_header hdr;
+	uint64_t table_bytes;
+	uint32_t entries;
+	int fd, err = 0;
+
+	if (capacity == 0 || (capacity & ((1UL << SPARSE_CLUSTER_SHIFT) - 1)))
+		return -EINVAL;
+	if (backing && strnlen(backing, SPARSE_BACKING_LEN) >= SPARSE_BACKING_LEN)
+		return -ENAMETOOLONG;
+
+	entries = capacity >> SPARSE_CLUSTER_SHIFT;
+	table_bytes = (uint64_t)entries * sizeof(uint64_t);
+
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return -errno;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SPARSE_MAGIC, SPARSE_MAGIC_LEN);
+	hdr.version = SPARSE_VERSION;
+	hdr.cluster_shift = SPARSE_CLUSTER_SHIFT;
+	hdr.capacity = capacity;
+	hdr.table_offset = SPARSE_HDR_SIZE;
+	hdr.table_entries = entries;
+	if (backing)
+		strncpy(hdr.backing, backing, SPARSE_BACKING_LEN - 1);
+
+	/* reserve header + table; an all-zero table means fully unallocated */
+	if (ftruncate(fd, SPARSE_HDR_SIZE + table_bytes) < 0)
+		err = -errno;
+	if (!err && full_pwrite(fd, &hdr, sizeof(hdr), 0) < 0)
+		err = -errno;
+	if (!err && fsync(fd) < 0)
+		err = -errno;
+
+	close(fd);
+	if (err)
+		unlink(path);
+	return err;
+}
+
+struct sparse_disk *
+sparse_open(int fd, int rdonly, off_t *capacity)
+{
+	struct sparse_header hdr;
+	struct sparse_disk *sp;
+	struct stat sbuf;
+	uint64_t table_bytes, end;
+	uint32_t i;
+
+	if (full_pread(fd, &hdr, sizeof(hdr), 0) < 0)
+		return NULL;
+	if (memcmp(hdr.magic, SPARSE_MAGIC, SPARSE_MAGIC_LEN) != 0) {
+		pr_err("%s: not a sparse image\n", __func__);
+		return NULL;
+	}
+	if (hdr.version != SPARSE_VERSION) {
+		pr_err("%s: unsupported sparse image version %u\n",
+		       __func__, hdr.version);
+		return NULL;
+	}
+	if (hdr.cluster_shift < 12U || hdr.cluster_shift > 21U ||
+	    hdr.table_entries !=
+	    (hdr.capacity >> hdr.cluster_shift) ||
+	    (hdr.capacity & ((1UL << hdr.cluster_shift) - 1))) {
+		pr_err("%s: corrupt sparse image header\n", __func__);
+		return NULL;
+	}
+
+	sp = calloc(1, sizeof(*sp));
+	if (sp == NULL)
+		return NULL;
+
+	sp->fd = fd;
+	sp->rdonly = rdonly;
+	sp->cluster_shift = hdr.cluster_shift;
+	sp->cluster_size = 1U << hdr.cluster_shift;
+	sp->capacity = hdr.capacity;
+	sp->table_offset = hdr.table_offset;
+	sp->table_entries = hdr.table_entries;
+	sp->backing_fd = -1;
+	pthread_mutex_init(&sp->mtx, NULL);
+
+	table_bytes = (uint64_t)sp->table_entries * sizeof(uint64_t);
+	sp->table = malloc(table_bytes);
+	if (sp->table == NULL)
+		goto fail;
+	if (full_pread(fd, sp->table, table_bytes, sp->table_offset) < 0)
+		goto fail;
+
+	/* next allocation goes after the furthest cluster seen */
+	sp->data_end = sp->table_offset + table_bytes;
+	for (i = 0; i < sp->table_entries; i++) {
+		end = sp->table[i] + sp->cluster_size;
+		if (sp->table[i] != 0 && end > sp->data_end)
+			sp->data_end = end;
+	}
+	if (fstat(fd, &sbuf) == 0 &&
+	    (uint64_t)sbuf.st_size > sp->data_end)
+		sp->reserved_end = sbuf.st_size;
+	else
+		sp->reserved_end = sp->data_end;
+
+	if (hdr.backing[0] != '\0') {
+		int bfd;
+		char magic[SPARSE_MAGIC_LEN];
+
+		hdr.backing[SPARSE_BACKING_LEN - 1] = '\0';
+		bfd = open(hdr.backing, O_RDONLY);
+		if (bfd < 0) {
+			pr_err("%s: cannot open backing image %s\n",
+			       __func__, hdr.backing);
+			goto fail;
+		}
+		/* a backing image may itself be sparse or a raw file */
+		if (full_pread(bfd, magic, sizeof(magic), 0) == sizeof(magic) &&
+		    memcmp(magic, SPARSE_MAGIC, SPARSE_MAGIC_LEN) == 0) {
+			off_t bcap;
+
+			sp->backing = sparse_open(bfd, 1, &bcap);
+			if (sp->backing == NULL) {
+				close(bfd);
+				goto fail;
+			}
+		} else {
+			sp->backing_fd = bfd;
+		}
+	}
+
+	*capacity = sp->capacity;
+	return sp;
+
+fail:
+	sparse_close(sp);
+	return NULL;
+}
+
+void
+sparse_close(struct sparse_disk *sp)
+{
+	if (sp == NULL)
+		return;
+	if (sp->backing != NULL) {
+		/* the nested open owns the backing fd */
+		close(sp->backing->fd);
+		sparse_close(sp->backing);
+	}
+	if (sp->backing_fd >= 0)
+		close(sp->backing_fd);
+	free(sp->table);
+	free(sp);
+}
+
+/* read one range that lies inside a single cluster of the backing chain */
+static ssize_t
+sparse_read_backing(struct sparse_disk *sp, void *buf, size_t len, off_t off)
+{
+	if (sp->backing != NULL)
+		return sparse_pread(sp->backing, buf, len, off);
+	if (sp->backing_fd >= 0)
+		return full_pread(sp->backing_fd, buf, len, off);
+	memset(buf, 0, len);
+	return len;
+}
+
+/*
+ * Prefetch ahead of a sequential reader: walk the map from the cluster
+ * after the current read and advise in the clusters whose data sits
+ * contiguously behind it, up to the prefetch window. Stops at the first
+ * unallocated or non-contiguous cluster, where readahead would only
+ * drag in unrelated data.
+ */
+static void
+sparse_prefetch(struct sparse_disk *sp, off_t off, size_t len)
+{
+	uint64_t idx, prev, run = 0;
+
+	if (off != sp->seq_next) {
+		sp->seq_next = off + len;
+		return;
+	}
+	sp->seq_next = off + len;
+
+	idx = (uint64_t)(off + len - 1) >> sp->cluster_shift;
+	prev = sp->table[idx];
+	if (prev == 0)
+		return;
+	while (++idx < sp->table_entries && run < SPARSE_PREFETCH_BYTES) {
+		if (sp->table[idx] != prev + sp->cluster_size)
+			break;
+		prev = sp->table[idx];
+		run += sp->cluster_size;
+	}
+	if (run != 0)
+		posix_fadvise(sp->fd, prev + sp->cluster_size - run,
+			      run, POSIX_FADV_WILLNEED);
+}
+
+ssize_t
+sparse_pread(struct sparse_disk *sp, void *buf, size_t len, off_t offset)
+{
+	size_t done = 0, chunk;
+	uint64_t idx, map, in_cluster;
+	ssize_t n;
+
+	if ((uint64_t)offset + len > sp->capacity) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (done < len) {
+		idx = (uint64_t)(offset + done) >> sp->cluster_shift;
+		in_cluster = (uint64_t)(offset + done) & (sp->cluster_size - 1);
+		chunk = sp->cluster_size - in_cluster;
+		if (chunk > len - done)
+			chunk = len - done;
+
+		map = sp->table[idx];
+		if (map != 0)
+			n = full_pread(sp->fd, (char *)buf + done, chunk,
+				       map + in_cluster);
+		else
+			n = sparse_read_backing(sp, (char *)buf + done, chunk,
+						offset + done);
+		if (n < 0)
+			return -1;
+		done += chunk;
+	}
+
+	pthread_mutex_lock(&sp->mtx);
+	sparse_prefetch(sp, offset, len);
+	pthread_mutex_unlock(&sp->mtx);
+
+	return len;
+}
+
+/*
+ * Allocate a cluster: reserve space (in batches, so the filesystem can
+ * keep the data area contiguous), fill it from the backing chain when
+ * the write does not cover it completely, then publish the mapping both
+ * on disk and in memory. Serialized by sp->mtx; concurrent writers to
+ * other clusters only contend for the short map check.
+ *
+ * Returns the data offset of the cluster or 0 on error.
+ */
+static uint64_t
+sparse_alloc_cluster(struct sparse_disk *sp, uint64_t idx,
+		     const void *buf, uint64_t in_cluster, size_t chunk)
+{
+	uint64_t map, off;
+	char *fill = NULL;
+
+	pthread_mutex_lock(&sp->mtx);
+	map = sp->table[idx];
+	if (map != 0) {
+		/* raced with another writer: the cluster exists, but its
+		 * copy-on-write fill did not include this chunk, so it
+		 * must be written here before reporting success
+		 */
+		if (full_pwrite(sp->fd, buf, chunk, map + in_cluster) < 0)
+			map = 0;
+		goto out;
+	}
+
+	off = sp->data_end;
+	if (off + sp->cluster_size > sp->reserved_end) {
+		/* preallocation hint; failure is not fatal, the writes
+		 * below extend the file on their own
+		 */
+		if (fallocate(sp->fd, 0, off,
+			      (uint64_t)SPARSE_ALLOC_BATCH * sp->cluster_size) == 0)
+			sp->reserved_end = off +
+				(uint64_t)SPARSE_ALLOC_BATCH * sp->cluster_size;
+	}
+
+	/* copy-on-write: build the full cluster, patch the new data in */
+	fill = malloc(sp->cluster_size);
+	if (fill == NULL)
+		goto out;
+	if (sparse_read_backing(sp, fill, sp->cluster_size,
+				(off_t)(idx << sp->cluster_shift)) < 0)
+		goto out;
+	memcpy(fill + in_cluster, buf, chunk);
+
+	if (full_pwrite(sp->fd, fill, sp->cluster_size, off) < 0)
+		goto out;
+
+	/* data is on disk, now publish the mapping */
+	if (full_pwrite(sp->fd, &off, sizeof(off),
+			sp->table_offset + idx * sizeof(uint64_t)) < 0)
+		goto out;
+	sp->table[idx] = off;
+	sp->data_end = off + sp->cluster_size;
+	map = off;
+
+out:
+	free(fill);
+	pthread_mutex_unlock(&sp->mtx);
+	return map;
+}
+
+ssize_t
+sparse_pwrite(struct sparse_disk *sp, const void *buf, size_t len, off_t offset)
+{
+	size_t done = 0, chunk;
+	uint64_t idx, map, in_cluster;
+
+	if (sp->rdonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if ((uint64_t)offset + len > sp->capacity) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (done < len) {
+		idx = (uint64_t)(offset + done) >> sp->cluster_shift;
+		in_cluster = (uint64_t)(offset + done) & (sp->cluster_size - 1);
+		chunk = sp->cluster_size - in_cluster;
+		if (chunk > len - done)
+			chunk = len - done;
+
+		map = sp->table[idx];
+		if (map == 0) {
+			/* allocation writes the new data as part of the
+			 * copy-on-write fill
+			 */
+			if (sparse_alloc_cluster(sp, idx, (const char *)buf + done,
+						 in_cluster, chunk) == 0)
+				return -1;
+			done += chunk;
+			continue;
+		}
+		if (full_pwrite(sp->fd, (const char *)buf + done, chunk,
+				map + in_cluster) < 0)
+			return -1;
+		done += chunk;
+	}
+	return len;
+}
+
+int
+sparse_discard(struct sparse_disk *sp, off_t offset, off_t len)
+{
+	uint64_t idx, first, last, map;
+	int err = 0;
+
+	if (sp->rdonly)
+		return EROFS;
+	if ((uint64_t)offset + len > sp->capacity)
+		return EINVAL;
+
+	/* only clusters fully inside the range; partial edges stay */
+	first = ((uint64_t)offset + sp->cluster_size - 1) >> sp->cluster_shift;
+	last = ((uint64_t)offset + len) >> sp->cluster_shift;
+
+	for (idx = first; idx < last; idx++) {
+		pthread_mutex_lock(&sp->mtx);
+		map = sp->table[idx];
+		pthread_mutex_unlock(&sp->mtx);
+		if (map == 0)
+			continue;
+		/* keep the mapping, punch the data: the cluster reads as
+		 * zeroes (not backing content, it was overwritten once)
+		 * and the space is reusable by the filesystem
+		 */
+		if (fallocate(sp->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			      map, sp->cluster_size) < 0) {
+			err = errno;
+			break;
+		}
+	}
+	return err;
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Host-local guest-to-guest switching fabric.
+ *
+ * Every DM that enables the "fabric" virtio-net option maps one shared
+ * POSIX shm segment holding a small forwarding table (one MAC per port)
+ * and a single-producer frame ring per port. A unicast frame whose
+ * destination MAC belongs to a peer port is copied into that port's ring
+ * and picked up by the peer's receiver thread, bypassing the Service VM
+ * bridge entirely: the path is guest A memory -> shared ring -> guest B
+ * memory, two copies and no syscalls.
+ *
+ * Broadcast/multicast (including ARP) and frames larger than a ring slot
+ * always take the TAP path, so peers are still reachable through the
+ * bridge and no frame is ever delivered twice. Ring-full also falls back
+ * to TAP, which can reorder a burst; like any learning switch topology
+ * change this is rare and TCP copes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "net_fabric.h"
+#include "log.h"
+
+#define NETFAB_SHM_NAME		"/acrn_net_fabric"
+#define NETFAB_MAGIC		0x4146544eU	/* "NTFA" */
+#define NETFAB_VERSION		1U
+
+#define NETFAB_PORTS		8
+#define NETFAB_RING_SLOTS	256	/* power of two */
+#define NETFAB_SLOT_SIZE	2048
+#define NETFAB_MAC_LEN		6
+
+/* receiver poll backoff, microseconds */
+#define NETFAB_POLL_MIN		1
+#define NETFAB_POLL_MAX		100
+
+struct netfab_slot {
+	uint32_t len;
+	uint8_t data[NETFAB_SLOT_SIZE];
+};
+
+struct netfab_ring {
+	volatile uint32_t head;	/* consumer index */
+	volatile uint32_t tail;	/* producer index */
+	struct netfab_slot slots[NETFAB_RING_SLOTS];
+};
+
+struct netfab_port_shm {
+	volatile uint32_t state;	/* 0 free, 1 active */
+	uint8_t mac[NETFAB_MAC_LEN];
+	uint8_t pad[6];
+	struct netfab_ring rx;
+};
+
+struct netfab_shm {
+	uint32_t magic;
+	uint32_t version;
+	pthread_mutex_t lock;	/* process-shared; port alloc/free only */
+	struct netfab_port_shm ports[NETFAB_PORTS];
+};
+
+struct net_fabric_port {
+	struct netfab_shm *shm;
+	int port_idx;
+	volatile bool closing;
+	pthread_t rx_thread;
+	void (*recv_cb)(void *arg, const void *frame, size_t len);
+	void *arg;
+};
+
+static void *
+netfab_rx_thread(void *param)
+{
+	struct net_fabric_port *port = param;
+	struct netfab_ring *ring = &port->shm->ports[port->port_idx].rx;
+	struct netfab_slot *slot;
+	uint32_t head;
+	int backoff = NETFAB_POLL_MIN;
+
+	while (!port->closing) {
+		head = ring->head;
+		if (head == ring->tail) {
+			usleep(backoff);
+			if (backoff < NETFAB_POLL_MAX)
+				backoff *= 2;
+			continue;
+		}
+		backoff = NETFAB_POLL_MIN;
+
+		slot = &ring->slots[head & (NETFAB_RING_SLOTS - 1)];
+		if (slot->len == 0) {
+			/* reserved by a producer but not yet published */
+			usleep(NETFAB_POLL_MIN);
+			continue;
+		}
+		port->recv_cb(port->arg, slot->data, slot->len);
+		/* the copy-out is done, hand the slot back to producers */
+		slot->len = 0;
+		__sync_synchronize();
+		ring->head = head + 1;
+	}
+
+	return NULL;
+}
+
+static struct netfab_shm *
+netfab_map_shm(void)
+{
+	struct netfab_shm *shm;
+	pthread_mutexattr_t attr;
+	bool creator = true;
+	int fd, i;
+
+	fd = shm_open(NETFAB_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		if (errno != EEXIST)
+			return NULL;
+		creator = false;
+		fd = shm_open(NETFAB_SHM_NAME, O_RDWR, 0600);
+		if (fd < 0)
+			return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(struct netfab_shm)) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	shm = mmap(NULL, sizeof(struct netfab_shm), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	if (creator) {
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(&shm->lock, &attr);
+		pthread_mutexattr_destroy(&attr);
+		shm->version = NETFAB_VERSION;
+		/* publishing the magic last makes the header valid */
+		__sync_synchronize();
+		shm->magic = NETFAB_MAGIC;
+	} else {
+		/* another DM may still be initializing the header */
+		for (i = 0; i < 100 && shm->magic != NETFAB_MAGIC; i++)
+			usleep(1000);
+		if (shm->magic != NETFAB_MAGIC ||
+		    shm->version != NETFAB_VERSION) {
+			munmap(shm, sizeof(struct netfab_shm));
+			return NULL;
+		}
+	}
+
+	return shm;
+}
+
+struct net_fabric_port *
+netfab_open(const uint8_t *mac,
+		void (*recv_cb)(void *arg, const void *frame, size_t len),
+		void *arg)
+{
+	struct net_fabric_port *port;
+	struct netfab_shm *shm;
+	int i, j;
+
+	shm = netfab_map_shm();
+	if (shm == NULL) {
+		pr_err("netfab: failed to map the fabric segment\n");
+		return NULL;
+	}
+
+	port = calloc(1, sizeof(*port));
+	if (port == NULL) {
+		munmap(shm, sizeof(struct netfab_shm));
+		return NULL;
+	}
+	port->shm = shm;
+	port->recv_cb = recv_cb;
+	port->arg = arg;
+
+	pthread_mutex_lock(&shm->lock);
+	for (i = 0; i < NETFAB_PORTS; i++) {
+		if (shm->ports[i].state == 0) {
+			memcpy(shm->ports[i].mac, mac, NETFAB_MAC_LEN);
+			shm->ports[i].rx.head = 0;
+			shm->ports[i].rx.tail = 0;
+			/* a previous owner may have closed with an undrained
+			 * ring; a stale non-zero len would make a reserved
+			 * slot look published before the producer fills it
+			 */
+			for (j = 0; j < NETFAB_RING_SLOTS; j++)
+				shm->ports[i].rx.slots[j].len = 0;
+			__sync_synchronize();
+			shm->ports[i].state = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&shm->lock);
+
+	if (i == NETFAB_PORTS) {
+		pr_err("netfab: no free fabric port\n");
+		munmap(shm, sizeof(struct netfab_shm));
+		free(port);
+		return NULL;
+	}
+	port->port_idx = i;
+
+	if (pthread_create(&port->rx_thread, NULL, netfab_rx_thread, port)) {
+		pr_err("netfab: failed to create the receiver thread\n");
+		shm->ports[i].state = 0;
+		munmap(shm, sizeof(struct netfab_shm));
+		free(port);
+		return NULL;
+	}
+	pthread_setname_np(port->rx_thread, "netfab_rx");
+
+	pr_info("netfab: port %d joined, mac %02x:%02x:%02x:%02x:%02x:%02x\n",
+		i, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	return port;
+}
+
+void
+netfab_close(struct net_fabric_port *port)
+{
+	if (port == NULL)
+		return;
+
+	port->closing = true;
+	pthread_join(port->rx_thread, NULL);
+
+	pthread_mutex_lock(&port->shm->lock);
+	port->shm->ports[port->port_idx].state = 0;
+	pthread_mutex_unlock(&port->shm->lock);
+
+	munmap(port->shm, sizeof(struct netfab_shm));
+	free(port);
+}
+
+/* fetch count bytes at offset off of the iov stream, for the MAC peek */
+static bool
+netfab_iov_peek(const struct iovec *iov, int iovcnt, size_t off,
+		uint8_t *buf, size_t count)
+{
+	size_t chunk;
+	int i;
+
+	for (i = 0; i < iovcnt && count > 0; i++) {
+		if (off >= iov[i].iov_len) {
+			off -= iov[i].iov_len;
+			continue;
+		}
+		chunk = iov[i].iov_len - off;
+		if (chunk > count)
+			chunk = count;
+		memcpy(buf, (uint8_t *)iov[i].iov_base + off, chunk);
+		buf += chunk;
+		count -= chunk;
+		off = 0;
+	}
+
+	return count == 0;
+}
+
+bool
+netfab_send(struct net_fabric_port *port, const struct iovec *iov,
+		int iovcnt, size_t skip, size_t len)
+{
+	struct netfab_shm *shm = port->shm;
+	struct netfab_port_shm *dst = NULL;
+	struct netfab_ring *ring;
+	struct netfab_slot *slot;
+	uint8_t dmac[NETFAB_MAC_LEN];
+	uint32_t tail;
+	int i;
+
+	if (len < NETFAB_MAC_LEN || len > NETFAB_SLOT_SIZE)
+		return false;
+
+	if (!netfab_iov_peek(iov, iovcnt, skip, dmac, NETFAB_MAC_LEN))
+		return false;
+
+	/* broadcast/multicast stays on the TAP so the bridge fans it out */
+	if ((dmac[0] & 0x01) != 0)
+		return false;
+
+	for (i = 0; i < NETFAB_PORTS; i++) {
+		if (i != port->port_idx && shm->ports[i].state != 0 &&
+		    memcmp(shm->ports[i].mac, dmac, NETFAB_MAC_LEN) == 0) {
+			dst = &shm->ports[i];
+			break;
+		}
+	}
+	if (dst == NULL)
+		return false;
+
+	/* several ports may produce into the same ring: reserve the slot
+	 * with a CAS on tail, then publish it through slot->len so the
+	 * consumer never reads a slot that is still being filled
+	 */
+	ring = &dst->rx;
+	do {
+		tail = ring->tail;
+		if (tail - ring->head >= NETFAB_RING_SLOTS)
+			return false;	/* peer is behind, fall back to TAP */
+	} while (!__sync_bool_compare_and_swap(&ring->tail, tail, tail + 1));
+
+	slot = &ring->slots[tail & (NETFAB_RING_SLOTS - 1)];
+	netfab_iov_peek(iov, iovcnt, skip, slot->data, len);
+	/* frame contents must land before the len store publishes the slot */
+	__sync_synchronize();
+	slot->len = len;
+
+	return true;
+}
@@ -43,6 +43,7 @@
 #include "ahci.h"
 #include "block_if.h"
 #include "ata.h"
+#include <atomic.h>
 
 #define	DEF_PORTS	6	/* Intel ICH8 AHCI supports 6 ports */
 #define	MAX_PORTS	32	/* AHCI supports 32 ports */
@@ -371,7 +372,7 @@ ahci_write_fis_sdb(struct ahci_port *p, int slot, uint8_t *cfis, uint32_t tfd)
 		memcpy(&p->err_cfis[4], cfis + 4, 16);
 	} else {
 		*(uint32_t *)(fis + 4) = (1 << slot);
-		p->sact &= ~(1 << slot);
+		atomic_fetch_and(&p->sact, ~(1 << slot));
 	}
 	p->tfd &= ~0x77;
 	p->tfd |= tfd;
@@ -406,7 +407,7 @@ ahci_write_fis_d2h(struct ahci_port *p, int slot, uint8_t *cfis, uint32_t tfd)
 		p->err_cfis[3] = error;
 		memcpy(&p->err_cfis[4], cfis + 4, 16);
 	} else
-		p->ci &= ~(1 << slot);
+		atomic_fetch_and(&p->ci, ~(1 << slot));
 	p->tfd = tfd;
 	ahci_write_fis(p, FIS_TYPE_REGD2H, fis);
 }
@@ -422,7 +423,7 @@ ahci_write_fis_d2h_ncq(struct ahci_port *p, int slot)
 	fis[1] = 0;			/* No interrupt */
 	fis[2] = p->tfd;		/* Status */
 	fis[3] = 0;			/* No error */
-	p->ci &= ~(1 << slot);
+	atomic_fetch_and(&p->ci, ~(1 << slot));
 	ahci_write_fis(p, FIS_TYPE_REGD2H, fis);
 }
 
@@ -455,8 +456,8 @@ ahci_check_stopped(struct ahci_port *p)
 		if (p->pending == 0) {
 			p->ccs = 0;
 			p->cmd &= ~(AHCI_P_CMD_CR | AHCI_P_CMD_CCS_MASK);
-			p->ci = 0;
-			p->sact = 0;
+			atomic_store(&p->ci, 0);
+			atomic_store(&p->sact, 0);
 			p->waitforclear = 0;
 		}
 	}
@@ -485,9 +486,9 @@ ahci_port_stop(struct ahci_port *p)
 		if (cfis[2] == ATA_WRITE_FPDMA_QUEUED ||
 		    cfis[2] == ATA_READ_FPDMA_QUEUED ||
 		    cfis[2] == ATA_SEND_FPDMA_QUEUED)
-			p->sact &= ~(1 << slot);	/* NCQ */
+			atomic_fetch_and(&p->sact, ~(1 << slot));	/* NCQ */
 		else
-			p->ci &= ~(1 << slot);
+			atomic_fetch_and(&p->ci, ~(1 << slot));
 
 		/*
 		 * This command is now done.
@@ -1858,7 +1859,7 @@ ahci_handle_slot(struct ahci_port *p, int slot)
 			p->reset = 0;
 			ahci_port_reset(p);
 		}
-		p->ci &= ~(1 << slot);
+		atomic_fetch_and(&p->ci, ~(1 << slot));
 	}
 }
 
@@ -2153,10 +2154,10 @@ pci_ahci_port_write(struct pci_ahci_vdev *ahci_dev, uint64_t offset,
 		p->serr &= ~value;
 		break;
 	case AHCI_P_SACT:
-		p->sact |= value;
+		atomic_fetch_or(&p->sact, value);
 		break;
 	case AHCI_P_CI:
-		p->ci |= value;
+		atomic_fetch_or(&p->ci, value);
 		ahci_handle_port(p);
 		break;
 	case AHCI_P_SNTF:
@@ -2251,7 +2252,7 @@ pci_ahci_host_read(struct pci_ahci_vdev *ahci_dev, uint64_t offset)
 		uint32_t *p = &ahci_dev->cap;
 
 		p += (offset - AHCI_CAP) / sizeof(uint32_t);
-		value = *p;
+		value = atomic_load(p);
 		break;
 	}
 	default:
@@ -2294,7 +2295,7 @@ pci_ahci_port_read(struct pci_ahci_vdev *ahci_dev, uint64_t offset)
 		uint32_t *p = &ahci_dev->port[port].clb;
 
 		p += (offset - AHCI_P_CLB) / sizeof(uint32_t);
-		value = *p;
+		value = atomic_load(p);
 		break;
 	}
 	default:
@@ -2330,8 +2331,14 @@ pci_ahci_read(struct vmctx *ctx, int vcpu, struct pci_vdev *dev, int baridx,
 		return value;
 	}
 
-	pthread_mutex_lock(&ahci_dev->mtx);
-
+	/*
+	 * Reads are served without taking the device mutex: every register
+	 * is a single aligned 32-bit word loaded atomically, and the
+	 * completion side updates PxCI/PxSACT with atomic ops.  Guests poll
+	 * those two registers heavily while NCQ commands are in flight, and
+	 * contending with the blockif callbacks here throttled the whole
+	 * port.
+	 */
 	offset = regoff & ~0x3;	    /* round down to a multiple of 4 bytes */
 	if (offset < AHCI_OFFSET)
 		value = pci_ahci_host_read(ahci_dev, offset);
@@ -2344,8 +2351,6 @@ pci_ahci_read(struct vmctx *ctx, int vcpu, struct pci_vdev *dev, int baridx,
 	}
 	value >>= 8 * (regoff & 0x3);
 
-	pthread_mutex_unlock(&ahci_dev->mtx);
-
 	return value;
 }
 
@@ -47,6 +47,8 @@
 #include "lpc.h"
 #include "sw_load.h"
 #include "log.h"
+#include "launch_prof.h"
+#include "dm_arena.h"
 #include "vdisplay.h"
 
 #define CONF1_ADDR_PORT    0x0cf8
@@ -96,6 +98,11 @@ extern bool gfx_ui;
 
 struct io_rsvd_rgn reserved_bar_regions[REGION_NUMS];
 
+/* serializes the shared resource pools (BAR address allocators, reserved
+ * regions, INTx pin counts) so that device inits may run concurrently
+ */
+static pthread_mutex_t pci_rsrc_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 #define	PCI_EMUL_IOBASE		0x2000
 #define	PCI_EMUL_IOLIMIT	0x10000
 
@@ -133,6 +140,7 @@ int reserve_io_rgn(uint64_t start,
 {
 	int i;
 
+	pthread_mutex_lock(&pci_rsrc_mtx);
 	for(i = 0; i < REGION_NUMS; i++){
 		if(reserved_bar_regions[i].vdev == NULL){
 			reserved_bar_regions[i].start = start;
@@ -146,9 +154,11 @@ int reserve_io_rgn(uint64_t start,
 			 */
 			qsort((void*)reserved_bar_regions, REGION_NUMS,
 					sizeof(reserved_bar_regions[0]),  compare_io_rgns);
+			pthread_mutex_unlock(&pci_rsrc_mtx);
 			return 0;
 		}
 	}
+	pthread_mutex_unlock(&pci_rsrc_mtx);
 
 	pr_err("reserved_bar_regions is overflow\n");
 	return -1;
@@ -839,14 +849,21 @@ pci_emul_alloc_pbar(struct pci_vdev *pdi, int idx, uint64_t hostbase,
 		return -1;
 	}
 
+	/* BAR address allocation and region registration pull from shared
+	 * pools; serialize them so device inits can run concurrently
+	 */
+	pthread_mutex_lock(&pci_rsrc_mtx);
+
 	region = get_io_rsvd_rgn_by_vdev_idx(pdi, idx);
 	if(region)
 		addr = region->start;
 
 	if (baseptr != NULL && !region) {
 		error = pci_emul_alloc_resource(baseptr, limit, size, &addr, type);
-		if (error != 0)
+		if (error != 0) {
+			pthread_mutex_unlock(&pci_rsrc_mtx);
 			return error;
+		}
 	}
 
 	pdi->bar[idx].type = type;
@@ -864,6 +881,8 @@ pci_emul_alloc_pbar(struct pci_vdev *pdi, int idx, uint64_t hostbase,
 
 	error = register_bar(pdi, idx);
 
+	pthread_mutex_unlock(&pci_rsrc_mtx);
+
 	if(error != 0){
 		/* FIXME: Currently, only gvt needs reserve regions.
 		 * because gvt isn't firstly initialized, previous pci
@@ -1008,14 +1027,24 @@ pci_emul_init(struct vmctx *ctx, struct pci_vdev_ops *ops, int bus, int slot,
 	      int func, struct funcinfo *fi)
 {
 	struct pci_vdev *pdi;
+	struct dm_arena *arena;
 	int err;
 
-	pdi = calloc(1, sizeof(struct pci_vdev));
+	/* a per-device arena keeps the emulation state contiguous and on
+	 * one 2 MiB TLB entry; fall back to the heap when mapping fails
+	 */
+	arena = dm_arena_create(ops->class_name, DM_ARENA_HUGEPAGE_SZ);
+	if (arena != NULL)
+		pdi = dm_arena_zalloc(arena, sizeof(struct pci_vdev));
+	else
+		pdi = calloc(1, sizeof(struct pci_vdev));
 	if (!pdi) {
-		pr_err("%s: calloc returns NULL\n", __func__);
+		pr_err("%s: failed to allocate pci_vdev\n", __func__);
+		dm_arena_destroy(arena);
 		return -1;
 	}
 
+	pdi->arena = arena;
 	pdi->vmctx = ctx;
 	pdi->bus = bus;
 	pdi->slot = slot;
@@ -1040,10 +1069,14 @@ pci_emul_init(struct vmctx *ctx, struct pci_vdev_ops *ops, int bus, int slot,
 	else
 		fi->fi_param = NULL;
 	err = (*ops->vdev_init)(ctx, pdi, fi->fi_param);
-	if (err == 0)
+	if (err == 0) {
 		fi->fi_devi = pdi;
-	else
-		free(pdi);
+	} else {
+		if (pdi->arena != NULL)
+			dm_arena_destroy(pdi->arena);
+		else
+			free(pdi);
+	}
 
 	return err;
 }
@@ -1061,8 +1094,107 @@ pci_emul_deinit(struct vmctx *ctx, struct pci_vdev_ops *ops, int bus, int slot,
 		pci_lintr_release(fi->fi_devi);
 		pci_emul_free_bars(fi->fi_devi);
 		pci_emul_free_msixcap(fi->fi_devi);
-		free(fi->fi_devi);
+		if (fi->fi_devi->arena != NULL)
+			dm_arena_destroy(fi->fi_devi->arena);
+		else
+			free(fi->fi_devi);
+	}
+}
+
+/*
+ * Parallel device initialization.
+ *
+ * Within each init_pci pass, devices whose class is marked parallel_init
+ * are initialized on a small worker pool instead of one after another;
+ * the heavyweight inits (xHCI enumerating a USB tree, passthrough
+ * resetting a physical function, block backends probing their media)
+ * then overlap instead of summing. The shared BAR, reserved-region and
+ * INTx pin allocators are serialized by pci_rsrc_mtx. Ordering edges
+ * are kept by structure: passthrough devices still run in a pass before
+ * the emulated ones, and classes with wider resource footprints (the
+ * LPC bridge reserving ISA IRQs) stay in the serial part of their pass.
+ */
+#define PCI_INIT_NWORKERS	4
+
+struct pci_init_work {
+	struct pci_vdev_ops *ops;
+	int bus, slot, func;
+	struct funcinfo *fi;
+	int error;
+};
+
+struct pci_init_queue {
+	struct vmctx *ctx;
+	struct pci_init_work items[MAXSLOTS * MAXFUNCS];
+	int nitems;
+	int next;
+	pthread_mutex_t mtx;
+};
+
+static void *
+pci_init_worker(void *arg)
+{
+	struct pci_init_queue *q = arg;
+	struct pci_init_work *w;
+
+	for (;;) {
+		pthread_mutex_lock(&q->mtx);
+		if (q->next >= q->nitems) {
+			pthread_mutex_unlock(&q->mtx);
+			break;
+		}
+		w = &q->items[q->next++];
+		pthread_mutex_unlock(&q->mtx);
+
+		pr_notice("pci init %s\r\n", w->fi->fi_name);
+		w->error = pci_emul_init(q->ctx, w->ops, w->bus, w->slot,
+				w->func, w->fi);
+
+		/* the mark buffer is not thread safe */
+		pthread_mutex_lock(&q->mtx);
+		launch_prof_mark("pci %d:%d.%d %s", w->bus, w->slot,
+				w->func, w->fi->fi_name);
+		pthread_mutex_unlock(&q->mtx);
+	}
+
+	return NULL;
+}
+
+/* returns the number of devices initialized, or -1 if any of them failed */
+static int
+pci_init_queue_run(struct pci_init_queue *q)
+{
+	pthread_t tid[PCI_INIT_NWORKERS];
+	int i, nworkers, error = 0;
+
+	if (q->nitems == 0)
+		return 0;
+
+	nworkers = q->nitems < PCI_INIT_NWORKERS ? q->nitems :
+		PCI_INIT_NWORKERS;
+	pthread_mutex_init(&q->mtx, NULL);
+
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&tid[i], NULL, pci_init_worker, q) != 0)
+			break;
+	}
+	if (i == 0) {
+		/* no worker came up, fall back to initializing inline */
+		pci_init_worker(q);
+	} else {
+		while (i-- > 0)
+			pthread_join(tid[i], NULL);
 	}
+	pthread_mutex_destroy(&q->mtx);
+
+	for (i = 0; i < q->nitems; i++) {
+		if (q->items[i].error) {
+			pr_err("pci %s init failed\n", q->items[i].fi->fi_name);
+			error = -1;
+		}
+	}
+
+	return error ? error : q->nitems;
 }
 
 static int
@@ -1474,6 +1606,7 @@ init_pci(struct vmctx *ctx)
 	int success_cnt[2] = {0};	/* 0 for passthru and 1 for others */
 	int error;
 	uint64_t bus0_memlimit;
+	static struct pci_init_queue queue;
 
 	pci_emul_iobase = PCI_EMUL_IOBASE;
 	pci_emul_membase32 = vm_get_lowmem_limit(ctx);
@@ -1501,6 +1634,10 @@ init_pci(struct vmctx *ctx)
 		 * Then initialize non pass-thru devices.
 		 */
 		for (i = 0; i < 2; i++) {
+			queue.ctx = ctx;
+			queue.nitems = 0;
+			queue.next = 0;
+
 			for (slot = 0; slot < MAXSLOTS; slot++) {
 				si = &bi->slotinfo[slot];
 				for (func = 0; func < MAXFUNCS; func++) {
@@ -1519,8 +1656,23 @@ init_pci(struct vmctx *ctx)
 						continue;
 					}
 
+					if (ops->parallel_init) {
+						struct pci_init_work *w =
+							&queue.items[queue.nitems++];
+
+						w->ops = ops;
+						w->bus = bus;
+						w->slot = slot;
+						w->func = func;
+						w->fi = fi;
+						w->error = 0;
+						continue;
+					}
+
 					pr_notice("pci init %s\r\n", fi->fi_name);
 					error = pci_emul_init(ctx, ops, bus, slot, func, fi);
+					launch_prof_mark("pci %d:%d.%d %s",
+						bus, slot, func, fi->fi_name);
 					if (error) {
 						pr_err("pci %s init failed\n", fi->fi_name);
 						goto pci_emul_init_fail;
@@ -1528,6 +1680,16 @@ init_pci(struct vmctx *ctx)
 					success_cnt[i]++;
 				}
 			}
+
+			error = pci_init_queue_run(&queue);
+			if (error < 0) {
+				/* unwind every attempted device in the pass;
+				 * deinit of one that failed is a no-op
+				 */
+				success_cnt[i] += queue.nitems;
+				goto pci_emul_init_fail;
+			}
+			success_cnt[i] += error;
 		}
 
 		/*
@@ -1750,6 +1912,240 @@ deinit_pci(struct vmctx *ctx)
 	}
 }
 
+/*
+ * PCI device state sections of a VM snapshot image.
+ *
+ * Each emulated function contributes one section: a fixed header, the raw
+ * config space, then an optional device-private payload written by the
+ * vdev_snapshot callback. A header with valid == 0 terminates the list.
+ * On restore the config space is not copied back verbatim; the saved BAR,
+ * capability and command registers are replayed through the normal cfgrw
+ * emulation path so BAR registration and MSI/MSI-X state are rebuilt the
+ * same way they would be by the guest reprogramming the device.
+ */
+struct pci_snapshot_hdr {
+	uint8_t		bus;
+	uint8_t		slot;
+	uint8_t		func;
+	uint8_t		valid;
+	char		name[PI_NAMESZ];
+	uint32_t	datalen;
+};
+
+static int
+pci_snapshot_dev(struct vmctx *ctx, struct pci_vdev *dev, FILE *fp)
+{
+	struct pci_snapshot_hdr hdr;
+	long hdr_pos, data_pos, end_pos;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.bus = dev->bus;
+	hdr.slot = dev->slot;
+	hdr.func = dev->func;
+	hdr.valid = 1;
+	strncpy(hdr.name, dev->name, PI_NAMESZ - 1);
+
+	hdr_pos = ftell(fp);
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(dev->cfgdata, sizeof(dev->cfgdata), 1, fp) != 1)
+		return -1;
+
+	data_pos = ftell(fp);
+	if (dev->dev_ops->vdev_snapshot != NULL &&
+	    dev->dev_ops->vdev_snapshot(ctx, dev, fp) < 0) {
+		pr_err("snapshot of %s failed\n", dev->name);
+		return -1;
+	}
+
+	/* patch the payload length now that the callback has written it */
+	end_pos = ftell(fp);
+	hdr.datalen = end_pos - data_pos;
+	if (fseek(fp, hdr_pos, SEEK_SET) != 0 ||
+	    fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fseek(fp, end_pos, SEEK_SET) != 0)
+		return -1;
+
+	return 0;
+}
+
+int
+pci_snapshot_devices(struct vmctx *ctx, FILE *fp)
+{
+	struct pci_snapshot_hdr hdr;
+	struct businfo *bi;
+	struct slotinfo *si;
+	struct funcinfo *fi;
+	struct pci_vdev *dev;
+	int bus, slot, func;
+
+	for (bus = 0; bus < MAXBUSES; bus++) {
+		bi = pci_businfo[bus];
+		if (bi == NULL)
+			continue;
+
+		for (slot = 0; slot < MAXSLOTS; slot++) {
+			si = &bi->slotinfo[slot];
+			for (func = 0; func < MAXFUNCS; func++) {
+				fi = &si->si_funcs[func];
+				dev = fi->fi_devi;
+				if (dev == NULL)
+					continue;
+				if (strcmp(dev->dev_ops->class_name,
+						"passthru") == 0) {
+					pr_err("snapshot with passthrough device %s is not supported\n",
+						dev->name);
+					return -1;
+				}
+				if (pci_snapshot_dev(ctx, dev, fp) < 0)
+					return -1;
+			}
+		}
+	}
+
+	/* terminator */
+	memset(&hdr, 0, sizeof(hdr));
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		return -1;
+
+	return 0;
+}
+
+static void
+pci_restore_cfgspace(struct vmctx *ctx, struct pci_vdev *dev,
+		uint8_t *cfgdata)
+{
+	uint32_t val;
+	int coff;
+
+	/* Replay the saved config space through the emulation path, BARs
+	 * and capabilities first and the command register last so decode
+	 * is enabled only once the BARs are back at their saved addresses.
+	 * Read-only registers simply ignore the write, as they would a
+	 * guest write.
+	 */
+	for (coff = PCIR_COMMAND; coff <= PCI_REGMAX - 3; coff += 4) {
+		if (coff == PCIR_COMMAND)
+			continue;
+		memcpy(&val, cfgdata + coff, 4);
+		pci_cfgrw(ctx, 0, 0, dev->bus, dev->slot, dev->func,
+				coff, 4, &val);
+	}
+	memcpy(&val, cfgdata + PCIR_COMMAND, 4);
+	pci_cfgrw(ctx, 0, 0, dev->bus, dev->slot, dev->func,
+			PCIR_COMMAND, 4, &val);
+}
+
+int
+pci_restore_devices(struct vmctx *ctx, FILE *fp)
+{
+	struct pci_snapshot_hdr hdr;
+	uint8_t cfgdata[PCI_REGMAX + 1];
+	struct businfo *bi;
+	struct pci_vdev *dev;
+
+	for (;;) {
+		if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+			return -1;
+		if (!hdr.valid)
+			break;
+		if (fread(cfgdata, sizeof(cfgdata), 1, fp) != 1)
+			return -1;
+
+		dev = NULL;
+		if (hdr.bus < MAXBUSES && hdr.slot < MAXSLOTS &&
+		    hdr.func < MAXFUNCS) {
+			bi = pci_businfo[hdr.bus];
+			if (bi != NULL)
+				dev = bi->slotinfo[hdr.slot].si_funcs[hdr.func].fi_devi;
+		}
+		if (dev == NULL ||
+		    strncmp(dev->name, hdr.name, PI_NAMESZ) != 0) {
+			pr_err("snapshot device %s at %x:%x.%x does not match current configuration\n",
+				hdr.name, hdr.bus, hdr.slot, hdr.func);
+			return -1;
+		}
+
+		pci_restore_cfgspace(ctx, dev, cfgdata);
+
+		if (dev->dev_ops->vdev_restore != NULL) {
+			long data_pos = ftell(fp);
+
+			if (dev->dev_ops->vdev_restore(ctx, dev, fp) < 0) {
+				pr_err("restore of %s failed\n", dev->name);
+				return -1;
+			}
+			/* realign in case the callback consumed less than
+			 * the section holds (older payload layout)
+			 */
+			if (fseek(fp, data_pos + hdr.datalen, SEEK_SET) != 0)
+				return -1;
+		} else if (hdr.datalen != 0) {
+			/* state saved by a build that had a callback */
+			pr_warn("%s: skipping %u bytes of unhandled device state\n",
+				dev->name, hdr.datalen);
+			if (fseek(fp, hdr.datalen, SEEK_CUR) != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * In-place warm reset for keepalive restarts: every device returns its
+ * emulated state to power-on defaults without the deinit/init cycle, so
+ * BAR and interrupt assignments (and the ACPI tables describing them)
+ * stay valid across the restart.  The topology is checked up front and
+ * -1 is returned without touching any device when a class has not
+ * implemented the callback yet; the caller then falls back to the full
+ * teardown.
+ */
+int
+pci_reset_devices_fast(struct vmctx *ctx)
+{
+	struct businfo *bi;
+	struct pci_vdev *dev;
+	int bus, slot, func;
+
+	for (bus = 0; bus < MAXBUSES; bus++) {
+		bi = pci_businfo[bus];
+		if (bi == NULL)
+			continue;
+		for (slot = 0; slot < MAXSLOTS; slot++) {
+			for (func = 0; func < MAXFUNCS; func++) {
+				dev = bi->slotinfo[slot].si_funcs[func].fi_devi;
+				if (dev == NULL)
+					continue;
+				if (dev->dev_ops->vdev_reset_fast == NULL) {
+					pr_notice("%s has no fast reset, falling back to full reset\n",
+						dev->name);
+					return -1;
+				}
+			}
+		}
+	}
+
+	for (bus = 0; bus < MAXBUSES; bus++) {
+		bi = pci_businfo[bus];
+		if (bi == NULL)
+			continue;
+		for (slot = 0; slot < MAXSLOTS; slot++) {
+			for (func = 0; func < MAXFUNCS; func++) {
+				dev = bi->slotinfo[slot].si_funcs[func].fi_devi;
+				if (dev == NULL)
+					continue;
+				if (dev->dev_ops->vdev_reset_fast(ctx, dev) < 0) {
+					pr_err("fast reset of %s failed\n",
+						dev->name);
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 static void
 pci_apic_prt_entry(int bus, int slot, int pin, int pirq_pin, int ioapic_irq,
 		   void *arg)
@@ -2062,6 +2458,7 @@ pci_lintr_request(struct pci_vdev *dev)
 	 * Just allocate a pin from our slot.  The pin will be
 	 * assigned IRQs later when interrupts are routed.
 	 */
+	pthread_mutex_lock(&pci_rsrc_mtx);
 	si = &bi->slotinfo[dev->slot];
 	bestpin = 0;
 	bestcount = si->si_intpins[0].ii_count;
@@ -2074,6 +2471,7 @@ pci_lintr_request(struct pci_vdev *dev)
 
 	si->si_intpins[bestpin].ii_count++;
 	dev->lintr.pin = bestpin + 1;
+	pthread_mutex_unlock(&pci_rsrc_mtx);
 	pci_set_cfgdata8(dev, PCIR_INTPIN, bestpin + 1);
 }
 
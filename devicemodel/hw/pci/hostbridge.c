@@ -53,14 +53,23 @@ pci_amd_hostbridge_init(struct vmctx *ctx, struct pci_vdev *pi, char *opts)
 	return 0;
 }
 
+static int
+pci_hostbridge_reset_fast(struct vmctx *ctx, struct pci_vdev *pi)
+{
+	/* no guest-visible runtime state beyond the generic config space */
+	return 0;
+}
+
 struct pci_vdev_ops pci_ops_amd_hostbridge = {
 	.class_name	= "amd_hostbridge",
 	.vdev_init	= pci_amd_hostbridge_init,
+	.vdev_reset_fast = pci_hostbridge_reset_fast,
 };
 DEFINE_PCI_DEVTYPE(pci_ops_amd_hostbridge);
 
 struct pci_vdev_ops pci_ops_hostbridge = {
 	.class_name	= "hostbridge",
 	.vdev_init	= pci_hostbridge_init,
+	.vdev_reset_fast = pci_hostbridge_reset_fast,
 };
 DEFINE_PCI_DEVTYPE(pci_ops_hostbridge);
@@ -1658,6 +1658,10 @@ passthru_write_dsdt(struct pci_vdev *dev)
 
 struct pci_vdev_ops passthru = {
 	.class_name		= "passthru",
+	/* the physical function reset dominates init time and touches
+	 * only the device's own sysfs nodes
+	 */
+	.parallel_init		= true,
 	.vdev_init		= passthru_init,
 	.vdev_deinit		= passthru_deinit,
 	.vdev_cfgwrite		= passthru_cfgwrite,
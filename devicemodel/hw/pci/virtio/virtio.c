@@ -25,15 +25,24 @@
  */
 
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <sched.h>
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "dm.h"
+#include "dm_string.h"
 #include "pci_core.h"
+#include "dm_arena.h"
 #include "virtio.h"
+#include "vmmapi.h"
+#include "mevent.h"
 #include "timer.h"
 #include <atomic.h>
 
@@ -51,6 +60,7 @@
 
 static uint8_t virtio_poll_enabled;
 static size_t virtio_poll_interval;
+static uint8_t virtio_doorbell_enabled;
 
 static void
 virtio_start_timer(struct acrn_timer *timer, time_t sec, time_t nsec)
@@ -91,7 +101,10 @@ virtio_poll_timer(void *arg, uint64_t nexp)
 		vq = &base->queues[i];
 		if(!vq_ring_ready(vq))
 			continue;
-		vq->used->flags |= VRING_USED_F_NO_NOTIFY;
+		if (vq_is_packed(vq))
+			vq->device_event->flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+		else
+			vq->used->flags |= VRING_USED_F_NO_NOTIFY;
 		/* TODO: call notify when necessary */
 		if (vq->notify)
 			(*vq->notify)(DEV_STRUCT(base), vq);
@@ -108,6 +121,402 @@ virtio_poll_timer(void *arg, uint64_t nexp)
 	virtio_start_timer(&base->polling_timer, 0, virtio_poll_interval);
 }
 
+/*
+ * Dedicated busy-poll mode, selected per device type with
+ * "--polling <devname>[@pcpu]". Unlike the global --virtio_poll timer
+ * above, one poller thread (pinned when a pcpu is given) scans the
+ * avail rings of the selected devices and runs their notify handlers
+ * directly. Guest notifications are suppressed while a ring is polled,
+ * and event-index suppression is withheld from the feature negotiation
+ * so the plain NO_NOTIFY flags stay effective. An adaptive backoff
+ * takes the thread off the pCPU when all rings stay idle.
+ */
+#define VIRTIO_POLLED_DEVS_MAX		8
+#define VIRTIO_POLL_IDLE_SPINS		2048U	/* idle scans before backing off */
+#define VIRTIO_POLL_BACKOFF_MIN_US	1U
+#define VIRTIO_POLL_BACKOFF_MAX_US	64U
+
+static struct {
+	char name[32];
+	int pcpu;
+} virtio_polled_conf[VIRTIO_POLLED_DEVS_MAX];
+static int virtio_polled_ndevs;
+
+static struct virtio_base *virtio_polled_bases[VIRTIO_POLLED_DEVS_MAX];
+static pthread_mutex_t virtio_poll_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t virtio_poll_tid;
+static int virtio_poll_pcpu = -1;
+static bool virtio_poll_started;
+
+static bool
+virtio_dev_polled(const char *name, int *pcpu)
+{
+	int i;
+
+	for (i = 0; i < virtio_polled_ndevs; i++) {
+		if (strcmp(virtio_polled_conf[i].name, name) == 0) {
+			if (pcpu)
+				*pcpu = virtio_polled_conf[i].pcpu;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+virtio_poll_scan(struct virtio_base *base)
+{
+	struct virtio_ops *vops = base->vops;
+	struct virtio_vq_info *vq;
+	bool did_work = false;
+	int i;
+
+	if (base->mtx)
+		pthread_mutex_lock(base->mtx);
+
+	for (i = 0; i < vops->nvq; i++) {
+		vq = &base->queues[i];
+		if (!vq_ring_ready(vq))
+			continue;
+		/* a polled ring does not need guest kicks */
+		if (vq_is_packed(vq))
+			vq->device_event->flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+		else
+			vq->used->flags |= VRING_USED_F_NO_NOTIFY;
+		if (!vq_has_descs(vq))
+			continue;
+		did_work = true;
+		if (vq->notify)
+			(*vq->notify)(DEV_STRUCT(base), vq);
+		else if (vops->qnotify)
+			(*vops->qnotify)(DEV_STRUCT(base), vq);
+	}
+
+	if (base->mtx)
+		pthread_mutex_unlock(base->mtx);
+
+	return did_work;
+}
+
+static void *
+virtio_poll_thread(void *arg)
+{
+	uint32_t idle = 0, backoff_us = 0;
+	bool did_work;
+	int i;
+
+	pthread_setname_np(pthread_self(), "virtio_poll");
+	if (virtio_poll_pcpu >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(virtio_poll_pcpu, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(),
+				sizeof(cpuset), &cpuset) != 0)
+			pr_err("virtio_poll: failed to pin to cpu %d\n",
+				virtio_poll_pcpu);
+	}
+
+	for (;;) {
+		did_work = false;
+		pthread_mutex_lock(&virtio_poll_mtx);
+		for (i = 0; i < VIRTIO_POLLED_DEVS_MAX; i++) {
+			if (virtio_polled_bases[i] != NULL)
+				did_work |= virtio_poll_scan(virtio_polled_bases[i]);
+		}
+		pthread_mutex_unlock(&virtio_poll_mtx);
+
+		if (did_work) {
+			idle = 0;
+			backoff_us = 0;
+		} else if (++idle >= VIRTIO_POLL_IDLE_SPINS) {
+			if (backoff_us < VIRTIO_POLL_BACKOFF_MIN_US)
+				backoff_us = VIRTIO_POLL_BACKOFF_MIN_US;
+			else if (backoff_us < VIRTIO_POLL_BACKOFF_MAX_US)
+				backoff_us *= 2;
+			usleep(backoff_us);
+		}
+	}
+	return NULL;
+}
+
+static void
+virtio_poll_add_dev(struct virtio_base *base, int pcpu)
+{
+	int i, slot = -1;
+
+	pthread_mutex_lock(&virtio_poll_mtx);
+	for (i = 0; i < VIRTIO_POLLED_DEVS_MAX; i++) {
+		if (virtio_polled_bases[i] == base) {
+			slot = -1;	/* already registered */
+			break;
+		}
+		if (virtio_polled_bases[i] == NULL && slot < 0)
+			slot = i;
+	}
+	if (slot >= 0) {
+		virtio_polled_bases[slot] = base;
+		if (!virtio_poll_started) {
+			virtio_poll_pcpu = pcpu;
+			if (pthread_create(&virtio_poll_tid, NULL,
+					virtio_poll_thread, NULL) == 0)
+				virtio_poll_started = true;
+			else
+				pr_err("%s: failed to create poller thread\n",
+					__func__);
+		}
+	}
+	pthread_mutex_unlock(&virtio_poll_mtx);
+}
+
+/*
+ * Exit-less kicks for busy-polled devices: back the notify window of the
+ * modern MMIO BAR (its own 4K page by layout) with a page of DM memory
+ * mapped into the guest as RAM. A kick then costs a cacheable store that
+ * never leaves the guest instead of an EPT-violation exit. Nobody needs
+ * to observe the stored value: the busy-poll thread watches the avail
+ * rings directly and kicks are redundant by construction, which is why
+ * the mapping is only installed for devices in dedicated poll mode.
+ * Mapped at DRIVER_OK, when the guest has finished programming the BAR;
+ * reset tears it down so a re-programmed BAR gets a fresh mapping.
+ */
+static void
+virtio_doorbell_map(struct virtio_base *base)
+{
+	struct pci_vdev *dev = base->dev;
+	uint64_t gpa;
+
+	if (!virtio_doorbell_enabled || (base->modern_mmio_bar_idx == 0) ||
+	    (base->doorbell_page != NULL))
+		return;
+
+	gpa = dev->bar[base->modern_mmio_bar_idx].addr + VIRTIO_CAP_NOTIFY_OFFSET;
+	if (posix_memalign(&base->doorbell_page, 4096, VIRTIO_CAP_NOTIFY_SIZE) != 0) {
+		base->doorbell_page = NULL;
+		return;
+	}
+	memset(base->doorbell_page, 0, VIRTIO_CAP_NOTIFY_SIZE);
+
+	if (vm_map_memseg_vma(dev->vmctx, VIRTIO_CAP_NOTIFY_SIZE, gpa,
+			(uint64_t)base->doorbell_page, PROT_RW) < 0) {
+		pr_err("%s: %s doorbell map failed, kicks stay trapped\n",
+			__func__, base->vops->name);
+		free(base->doorbell_page);
+		base->doorbell_page = NULL;
+	} else {
+		base->doorbell_gpa = gpa;
+		pr_info("%s: %s notify window backed by doorbell page @0x%lx\n",
+			__func__, base->vops->name, gpa);
+	}
+}
+
+static void
+virtio_doorbell_unmap(struct virtio_base *base)
+{
+	if (base->doorbell_page != NULL) {
+		vm_unmap_memseg_vma(base->dev->vmctx, VIRTIO_CAP_NOTIFY_SIZE,
+			base->doorbell_gpa);
+		free(base->doorbell_page);
+		base->doorbell_page = NULL;
+		base->doorbell_gpa = 0;
+	}
+}
+
+static void
+virtio_poll_del_dev(struct virtio_base *base)
+{
+	int i;
+
+	pthread_mutex_lock(&virtio_poll_mtx);
+	for (i = 0; i < VIRTIO_POLLED_DEVS_MAX; i++) {
+		if (virtio_polled_bases[i] == base)
+			virtio_polled_bases[i] = NULL;
+	}
+	pthread_mutex_unlock(&virtio_poll_mtx);
+}
+
+/*
+ * A busy-polled device suppresses kicks with VRING_USED_F_NO_NOTIFY
+ * (or the packed DISABLE flag), which the driver is free to ignore once
+ * event-index is negotiated; hide that feature from polled devices.
+ */
+static uint64_t
+virtio_device_caps(struct virtio_base *base)
+{
+	uint64_t caps = base->device_caps;
+
+	if (virtio_dev_polled(base->vops->name, NULL))
+		caps &= ~(1ULL << VIRTIO_RING_F_EVENT_IDX);
+
+	return caps;
+}
+
+/*
+ * ioeventfd/irqfd shortcut for kicks and interrupts.
+ *
+ * A doorbell write to a registered ioeventfd is completed in the Service
+ * VM kernel by signaling kick_fd, which feeds the mevent loop and runs
+ * the queue's notify handler there; the completion interrupt goes out
+ * through call_fd, an irqfd the kernel turns into an MSI-X injection.
+ * That removes the userspace I/O-request round trip in both directions.
+ * Registration happens at DRIVER_OK and is torn down on reset; when the
+ * HSM lacks the ioctls the trapped register path keeps working as is.
+ */
+static void
+virtio_kick_handler(int fd, enum ev_type type, void *arg)
+{
+	struct virtio_vq_info *vq = arg;
+	struct virtio_base *base = vq->base;
+	uint64_t count;
+
+	/* one read drains any number of coalesced kicks */
+	if (read(fd, &count, sizeof(count)) < 0)
+		return;
+
+	if (base->mtx)
+		pthread_mutex_lock(base->mtx);
+
+	if (vq->notify)
+		(*vq->notify)(DEV_STRUCT(base), vq);
+	else if (base->vops->qnotify)
+		(*base->vops->qnotify)(DEV_STRUCT(base), vq);
+
+	if (base->mtx)
+		pthread_mutex_unlock(base->mtx);
+}
+
+static int
+virtio_vq_assign_ioeventfd(struct virtio_base *base,
+			   struct virtio_vq_info *vq, bool assign)
+{
+	struct acrn_ioeventfd ioeventfd = {0};
+	struct pcibar *bar;
+
+	if (!assign)
+		ioeventfd.flags = ACRN_IOEVENTFD_FLAG_DEASSIGN;
+
+	if (base->device_caps & (1UL << VIRTIO_F_VERSION_1)) {
+		if (base->modern_pio_bar_idx) {
+			bar = &base->dev->bar[base->modern_pio_bar_idx];
+			ioeventfd.data = vq->num;
+			ioeventfd.addr = bar->addr;
+			ioeventfd.len = 2;
+			ioeventfd.flags |= (ACRN_IOEVENTFD_FLAG_DATAMATCH |
+				ACRN_IOEVENTFD_FLAG_PIO);
+		} else if (base->modern_mmio_bar_idx) {
+			bar = &base->dev->bar[base->modern_mmio_bar_idx];
+			ioeventfd.data = 0;
+			ioeventfd.addr = bar->addr + VIRTIO_CAP_NOTIFY_OFFSET +
+				vq->num * VIRTIO_MODERN_NOTIFY_OFF_MULT;
+			ioeventfd.len = 2;
+			/* no additional flag bit should be set for MMIO */
+		} else
+			return -1;
+	} else {
+		bar = &base->dev->bar[base->legacy_pio_bar_idx];
+		ioeventfd.data = vq->num;
+		ioeventfd.addr = bar->addr + VIRTIO_PCI_QUEUE_NOTIFY;
+		ioeventfd.len = 2;
+		ioeventfd.flags |= (ACRN_IOEVENTFD_FLAG_DATAMATCH |
+			ACRN_IOEVENTFD_FLAG_PIO);
+	}
+
+	ioeventfd.fd = vq->kick_fd;
+	return vm_ioeventfd(base->dev->vmctx, &ioeventfd);
+}
+
+static int
+virtio_vq_assign_irqfd(struct virtio_base *base,
+		       struct virtio_vq_info *vq, bool assign)
+{
+	struct acrn_irqfd irqfd = {0};
+	struct msix_table_entry *mte;
+
+	if (!assign)
+		irqfd.flags = ACRN_IRQFD_FLAG_DEASSIGN;
+
+	mte = &base->dev->msix.table[vq->msix_idx];
+	irqfd.fd = vq->call_fd;
+	irqfd.msi.msi_addr = mte->addr;
+	irqfd.msi.msi_data = mte->msg_data;
+	return vm_irqfd(base->dev->vmctx, &irqfd);
+}
+
+static void
+virtio_vq_eventfd_start(struct virtio_base *base, struct virtio_vq_info *vq)
+{
+	if (vq->kick_fd < 0 && (vq->notify || base->vops->qnotify)) {
+		vq->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (vq->kick_fd >= 0 &&
+		    virtio_vq_assign_ioeventfd(base, vq, true) < 0) {
+			close(vq->kick_fd);
+			vq->kick_fd = -1;
+		}
+		if (vq->kick_fd >= 0) {
+			vq->kick_mevp = mevent_add(vq->kick_fd, EVF_READ,
+				virtio_kick_handler, vq, NULL, NULL);
+			if (vq->kick_mevp == NULL) {
+				virtio_vq_assign_ioeventfd(base, vq, false);
+				close(vq->kick_fd);
+				vq->kick_fd = -1;
+			}
+		}
+	}
+
+	/* the interrupt side needs a valid MSI-X vector to mirror */
+	if (vq->call_fd < 0 && pci_msix_enabled(base->dev) &&
+	    vq->msix_idx != VIRTIO_MSI_NO_VECTOR) {
+		vq->call_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (vq->call_fd >= 0 &&
+		    virtio_vq_assign_irqfd(base, vq, true) < 0) {
+			close(vq->call_fd);
+			vq->call_fd = -1;
+		}
+	}
+}
+
+static void
+virtio_vq_eventfd_stop(struct virtio_base *base, struct virtio_vq_info *vq)
+{
+	if (vq->call_fd >= 0) {
+		virtio_vq_assign_irqfd(base, vq, false);
+		close(vq->call_fd);
+		vq->call_fd = -1;
+	}
+	if (vq->kick_fd >= 0) {
+		if (vq->kick_mevp) {
+			mevent_delete(vq->kick_mevp);
+			vq->kick_mevp = NULL;
+		}
+		virtio_vq_assign_ioeventfd(base, vq, false);
+		close(vq->kick_fd);
+		vq->kick_fd = -1;
+	}
+}
+
+static void
+virtio_register_eventfds(struct virtio_base *base, bool is_register)
+{
+	struct virtio_vq_info *vq;
+	int i;
+
+	/* vhost and the kernel backend register their own eventfds, and
+	 * polling mode must keep trapping (and ignoring) the doorbells
+	 */
+	if (is_register &&
+	    (base->backend_type != BACKEND_VBSU || virtio_poll_enabled))
+		return;
+
+	for (i = 0; i < base->vops->nvq; i++) {
+		vq = &base->queues[i];
+		if (is_register) {
+			if (vq_ring_ready(vq))
+				virtio_vq_eventfd_start(base, vq);
+		} else
+			virtio_vq_eventfd_stop(base, vq);
+	}
+}
+
 /**
  * @brief Link a virtio_base to its constants, the virtio device,
  * and the PCI emulation.
@@ -142,6 +551,8 @@ virtio_linkup(struct virtio_base *base, struct virtio_ops *vops,
 	for (i = 0; i < vops->nvq; i++) {
 		queues[i].base = base;
 		queues[i].num = i;
+		queues[i].kick_fd = -1;
+		queues[i].call_fd = -1;
 	}
 }
 
@@ -170,9 +581,12 @@ virtio_reset_dev(struct virtio_base *base)
 
 	acrn_timer_deinit(&base->polling_timer);
 	base->polling_in_progress = 0;
+	virtio_poll_del_dev(base);
+	virtio_doorbell_unmap(base);
 
 	nvq = base->vops->nvq;
 	for (vq = base->queues, i = 0; i < nvq; vq++, i++) {
+		virtio_vq_eventfd_stop(base, vq);
 		vq->flags = 0;
 		vq->last_avail = 0;
 		vq->save_used = 0;
@@ -185,6 +599,28 @@ virtio_reset_dev(struct virtio_base *base)
 		vq->gpa_used[0] = 0;
 		vq->gpa_used[1] = 0;
 		vq->enabled = 0;
+		vq->indir_hva = NULL;
+		/* arena-backed shadow state is sized for the full ring and
+		 * survives a reset for reuse
+		 */
+		if ((base->dev == NULL) || (base->dev->arena == NULL)) {
+			free(vq->chain_ndescs);
+			vq->chain_ndescs = NULL;
+			free(vq->chain_cache);
+			vq->chain_cache = NULL;
+		} else if (vq->chain_cache != NULL) {
+			/* the ring moves on re-enable, drop every entry */
+			memset(vq->chain_cache, 0,
+			    (size_t)vq->qsize * sizeof(struct vq_chain_cache));
+		}
+		vq->used_idx = 0;
+		vq->last_ndescs = 0;
+		vq->avail_wrap = false;
+		vq->used_wrap = false;
+		acrn_timer_deinit(&vq->intr_timer);
+		vq->last_intr_ns = 0;
+		vq->intr_streak = 0;
+		vq->intr_held = false;
 	}
 	base->negotiated_caps = 0;
 	base->curq = 0;
@@ -277,6 +713,27 @@ virtio_interrupt_init(struct virtio_base *base, int use_msix)
 	return virtio_intr_init(base, 1, use_msix);
 }
 
+/*
+ * (Re)allocate and clear the per-slot chain recycling cache for a
+ * split ring.  The cache is an optimization, so the queue simply runs
+ * without one when the allocation fails.
+ */
+static void
+vq_chain_cache_setup(struct virtio_base *base, struct virtio_vq_info *vq)
+{
+	size_t size = (size_t)vq->qsize * sizeof(struct vq_chain_cache);
+
+	if ((base->dev != NULL) && (base->dev->arena != NULL)) {
+		if (vq->chain_cache == NULL)
+			vq->chain_cache = dm_arena_zalloc(base->dev->arena, size);
+		else
+			memset(vq->chain_cache, 0, size);
+	} else {
+		free(vq->chain_cache);
+		vq->chain_cache = calloc(vq->qsize, sizeof(struct vq_chain_cache));
+	}
+}
+
 /*
  * Initialize the currently-selected virtio queue (base->curq).
  * The guest just gave us a page frame number, from which we can
@@ -316,6 +773,8 @@ virtio_vq_init(struct virtio_base *base, uint32_t pfn)
 	/* Start at 0 when we use it. */
 	vq->last_avail = 0;
 	vq->save_used = 0;
+	vq->indir_hva = NULL;
+	vq_chain_cache_setup(base, vq);
 
 	/* Mark queue as allocated after initialization is complete. */
 	mb();
@@ -346,34 +805,85 @@ virtio_vq_enable(struct virtio_base *base)
 	vq = &base->queues[base->curq];
 	qsz = vq->qsize;
 
-	/* descriptors */
-	phys = (((uint64_t)vq->gpa_desc[1]) << 32) | vq->gpa_desc[0];
-	size = qsz * sizeof(struct vring_desc);
-	vb = paddr_guest2host(base->dev->vmctx, phys, size);
-	if (!vb)
-		goto error;
-	vq->desc = (struct vring_desc *)vb;
-
-	/* available ring */
-	phys = (((uint64_t)vq->gpa_avail[1]) << 32) | vq->gpa_avail[0];
-	size = (2 + qsz + 1) * sizeof(uint16_t);
-	vb = paddr_guest2host(base->dev->vmctx, phys, size);
-	if (!vb)
-		goto error;
-
-	vq->avail = (struct vring_avail *)vb;
-
-	/* used ring */
-	phys = (((uint64_t)vq->gpa_used[1]) << 32) | vq->gpa_used[0];
-	size = sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * qsz;
-	vb = paddr_guest2host(base->dev->vmctx, phys, size);
-	if (!vb)
-		goto error;
-	vq->used = (struct vring_used *)vb;
+	if (base->negotiated_caps & (1ULL << VIRTIO_F_RING_PACKED)) {
+		/* packed descriptor ring */
+		phys = (((uint64_t)vq->gpa_desc[1]) << 32) | vq->gpa_desc[0];
+		size = qsz * sizeof(struct vring_packed_desc);
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+		vq->pdesc = (struct vring_packed_desc *)vb;
+
+		/* driver event suppression area, at the avail address */
+		phys = (((uint64_t)vq->gpa_avail[1]) << 32) | vq->gpa_avail[0];
+		size = sizeof(struct vring_packed_desc_event);
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+		vq->driver_event = (struct vring_packed_desc_event *)vb;
+
+		/* device event suppression area, at the used address */
+		phys = (((uint64_t)vq->gpa_used[1]) << 32) | vq->gpa_used[0];
+		size = sizeof(struct vring_packed_desc_event);
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+		vq->device_event = (struct vring_packed_desc_event *)vb;
+
+		if ((base->dev != NULL) && (base->dev->arena != NULL)) {
+			/* cache-line aligned and contiguous with the rest of
+			 * the device's state, qsz never exceeds vq->qsize
+			 */
+			if (vq->chain_ndescs == NULL)
+				vq->chain_ndescs = dm_arena_zalloc(base->dev->arena,
+					(size_t)qsz * sizeof(uint16_t));
+			else
+				memset(vq->chain_ndescs, 0, (size_t)qsz * sizeof(uint16_t));
+		} else {
+			free(vq->chain_ndescs);
+			vq->chain_ndescs = calloc(qsz, sizeof(uint16_t));
+		}
+		if (!vq->chain_ndescs)
+			goto error;
+
+		/* both rings start at slot 0 with the wrap counters set */
+		vq->used_idx = 0;
+		vq->last_ndescs = 0;
+		vq->avail_wrap = true;
+		vq->used_wrap = true;
+	} else {
+		/* descriptors */
+		phys = (((uint64_t)vq->gpa_desc[1]) << 32) | vq->gpa_desc[0];
+		size = qsz * sizeof(struct vring_desc);
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+		vq->desc = (struct vring_desc *)vb;
+
+		/* available ring */
+		phys = (((uint64_t)vq->gpa_avail[1]) << 32) | vq->gpa_avail[0];
+		size = (2 + qsz + 1) * sizeof(uint16_t);
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+
+		vq->avail = (struct vring_avail *)vb;
+
+		/* used ring */
+		phys = (((uint64_t)vq->gpa_used[1]) << 32) | vq->gpa_used[0];
+		size = sizeof(uint16_t) * 3 + sizeof(struct vring_used_elem) * qsz;
+		vb = paddr_guest2host(base->dev->vmctx, phys, size);
+		if (!vb)
+			goto error;
+		vq->used = (struct vring_used *)vb;
+
+		vq_chain_cache_setup(base, vq);
+	}
 
 	/* Start at 0 when we use it. */
 	vq->last_avail = 0;
 	vq->save_used = 0;
+	vq->indir_hva = NULL;
 
 	/* Mark queue as enabled. */
 	vq->enabled = true;
@@ -401,7 +911,7 @@ _vq_record(int i, volatile struct vring_desc *vd, struct vmctx *ctx,
 
 	if (i >= n_iov)
 		return -1;
-	host_addr = paddr_guest2host(ctx, vd->addr, vd->len);
+	host_addr = vm_gpa2hva(ctx, vd->addr, vd->len);
 	if (!host_addr)
 		return -1;
 	iov[i].iov_base = host_addr;
@@ -451,8 +961,8 @@ _vq_record(int i, volatile struct vring_desc *vd, struct vmctx *ctx,
  * You are assumed to have done a vq_ring_ready() if needed (note
  * that vq_has_descs() does one).
  */
-int
-vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
+static int
+vq_getchain_split(struct virtio_vq_info *vq, uint16_t *pidx,
 	    struct iovec *iov, int n_iov, uint16_t *flags)
 {
 	int i;
@@ -460,6 +970,7 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 	u_int idx, next;
 
 	volatile struct vring_desc *vdir, *vindir, *vp;
+	struct vq_chain_cache *cc = NULL;
 	struct vmctx *ctx;
 	struct virtio_base *base;
 	const char *name;
@@ -502,6 +1013,49 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 	ctx = base->dev->vmctx;
 	*pidx = next = vq->avail->ring[idx & (vq->qsize - 1)];
 	vq->last_avail++;
+	/*
+	 * With EVENT_IDX the guest only kicks once avail->idx passes
+	 * avail_event, so keep pushing it to the next unseen descriptor:
+	 * the guest stays silent for every chain we are going to drain
+	 * anyway. The fence orders the avail_event store against the
+	 * avail->idx re-check in the caller's drain loop, closing the
+	 * race where the guest publishes against the stale event index.
+	 */
+	if (base->negotiated_caps & (1 << VIRTIO_RING_F_EVENT_IDX)) {
+		VQ_AVAIL_EVENT_IDX(vq) = vq->last_avail;
+		atomic_thread_fence();
+	}
+	/*
+	 * Fast path: the chain headed at this slot usually has the exact
+	 * layout it had the last time the guest posted it.  Verify the
+	 * guest view against the cached copy and reuse the recorded
+	 * translations; a host address only depends on addr/len, so a
+	 * matching descriptor body makes the cached translation valid
+	 * regardless of which next links led to it.
+	 */
+	if (vq->chain_cache != NULL) {
+		cc = &vq->chain_cache[next];
+		if ((cc->nsegs != 0) && (cc->nsegs <= n_iov)) {
+			for (i = 0; i < cc->nsegs; i++) {
+				if (next >= vq->qsize)
+					break;
+				vdir = &vq->desc[next];
+				if ((vdir->addr != cc->desc[i].addr) ||
+				    (vdir->len != cc->desc[i].len) ||
+				    (vdir->flags != cc->desc[i].flags))
+					break;
+				iov[i].iov_base = cc->hva[i];
+				iov[i].iov_len = vdir->len;
+				if (flags != NULL)
+					flags[i] = vdir->flags;
+				next = vdir->next;
+			}
+			if (i == cc->nsegs)
+				return i;
+		}
+		cc->nsegs = 0;
+		next = *pidx;
+	}
 	for (i = 0; i < VQ_MAX_DESCRIPTORS; next = vdir->next) {
 		if (next >= vq->qsize) {
 			pr_err("%s: descriptor index %u out of range, "
@@ -511,10 +1065,20 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 		}
 		vdir = &vq->desc[next];
 		if ((vdir->flags & VRING_DESC_F_INDIRECT) == 0) {
+			if (vdir->flags & VRING_DESC_F_NEXT)
+				__builtin_prefetch(
+				    (const void *)&vq->desc[vdir->next]);
 			if (_vq_record(i, vdir, ctx, iov, n_iov, flags)) {
 				pr_err("%s: mapping to host failed\r\n", name);
 				return -1;
 			}
+			if ((cc != NULL) && (i < VQ_CHAIN_CACHE_SEGS)) {
+				cc->desc[i].addr = vdir->addr;
+				cc->desc[i].len = vdir->len;
+				cc->desc[i].flags = vdir->flags;
+				cc->desc[i].next = vdir->next;
+				cc->hva[i] = iov[i].iov_base;
+			}
 			i++;
 		} else if ((base->device_caps &
 		    (1 << VIRTIO_RING_F_INDIRECT_DESC)) == 0) {
@@ -523,6 +1087,8 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 			    name);
 			return -1;
 		} else {
+			/* indirect chains are served by the table cache */
+			cc = NULL;
 			n_indir = vdir->len / 16;
 			if ((vdir->len & 0xf) || n_indir == 0) {
 				pr_err("%s: invalid indir len 0x%x, "
@@ -530,12 +1096,28 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 				    name, (u_int)vdir->len);
 				return -1;
 			}
-			vindir = paddr_guest2host(ctx,
-			    vdir->addr, vdir->len);
+			/*
+			 * The whole table is validated and translated with a
+			 * single region check; cache the result, since guests
+			 * keep handing us the same preallocated tables.
+			 */
+			if ((vq->indir_hva != NULL) &&
+			    (vdir->addr == vq->indir_gpa) &&
+			    (vdir->len == vq->indir_len)) {
+				vindir = (volatile struct vring_desc *)
+				    vq->indir_hva;
+			} else {
+				vindir = vm_gpa2hva(ctx,
+				    vdir->addr, vdir->len);
 
-			if (!vindir) {
-				pr_err("%s cannot get host memory\r\n", name);
-				return -1;
+				if (!vindir) {
+					pr_err("%s cannot get host memory\r\n",
+					    name);
+					return -1;
+				}
+				vq->indir_gpa = vdir->addr;
+				vq->indir_len = vdir->len;
+				vq->indir_hva = (void *)vindir;
 			}
 			/*
 			 * Indirects start at the 0th, then follow
@@ -547,6 +1129,14 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 			next = 0;
 			for (;;) {
 				vp = &vindir[next];
+				/*
+				 * Stay a cache line ahead of the walk; the
+				 * embedded next fields are sequential for
+				 * every driver we care about.
+				 */
+				if (next + 4 < n_indir)
+					__builtin_prefetch(
+					    (const void *)&vindir[next + 4]);
 				if (vp->flags & VRING_DESC_F_INDIRECT) {
 					pr_err("%s: indirect desc has INDIR flag,"
 					    " driver confused?\r\n",
@@ -570,8 +1160,11 @@ vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
 				}
 			}
 		}
-		if ((vdir->flags & VRING_DESC_F_NEXT) == 0)
+		if ((vdir->flags & VRING_DESC_F_NEXT) == 0) {
+			if ((cc != NULL) && (i <= VQ_CHAIN_CACHE_SEGS))
+				cc->nsegs = i;
 			return i;
+		}
 	}
 loopy:
 	pr_err("%s: descriptor loop? count > %d - driver confused?\r\n",
@@ -579,6 +1172,151 @@ loopy:
 	return -1;
 }
 
+/*
+ * Helper inline for vq_getchain_packed(): same as _vq_record() but for
+ * the packed descriptor format.
+ */
+static inline int
+_vq_record_packed(int i, volatile struct vring_packed_desc *vd,
+		  struct vmctx *ctx, struct iovec *iov, int n_iov,
+		  uint16_t *flags) {
+
+	void *host_addr;
+
+	if (i >= n_iov)
+		return -1;
+	host_addr = vm_gpa2hva(ctx, vd->addr, vd->len);
+	if (!host_addr)
+		return -1;
+	iov[i].iov_base = host_addr;
+	iov[i].iov_len = vd->len;
+	if (flags != NULL)
+		flags[i] = vd->flags;
+	return 0;
+}
+
+/*
+ * Packed-ring variant of vq_getchain_split().  A chain occupies
+ * consecutive ring slots (each carrying its data flags in place, so the
+ * walk stays on a single cache-line stream), the buffer id lives in the
+ * chain's last descriptor, and an INDIRECT descriptor points to a plain
+ * array of len/16 packed descriptors with no chaining inside.
+ */
+static int
+vq_getchain_packed(struct virtio_vq_info *vq, uint16_t *pidx,
+	    struct iovec *iov, int n_iov, uint16_t *flags)
+{
+	int i;
+	u_int ndescs, n_indir, j;
+	u_int idx;
+	bool wrap;
+
+	volatile struct vring_packed_desc *vdir, *vindir;
+	struct vmctx *ctx;
+	struct virtio_base *base;
+	const char *name;
+
+	base = vq->base;
+	name = base->vops->name;
+
+	if (!vq_packed_has_descs(vq))
+		return 0;
+
+	/*
+	 * The driver publishes a chain by flipping the head's AVAIL flag
+	 * last; fence so the descriptor bodies are not read ahead of
+	 * that flip.
+	 */
+	atomic_thread_fence();
+
+	ctx = base->dev->vmctx;
+	idx = vq->last_avail;
+	wrap = vq->avail_wrap;
+	i = 0;
+	ndescs = 0;
+	for (;;) {
+		if (ndescs >= vq->qsize) {
+			pr_err("%s: descriptor loop? count > %u - driver confused?\r\n",
+			    name, ndescs);
+			return -1;
+		}
+		vdir = &vq->pdesc[idx];
+		ndescs++;
+		if ((vdir->flags & VRING_DESC_F_INDIRECT) == 0) {
+			if (_vq_record_packed(i, vdir, ctx, iov, n_iov, flags)) {
+				pr_err("%s: mapping to host failed\r\n", name);
+				return -1;
+			}
+			i++;
+		} else if ((base->device_caps &
+		    (1 << VIRTIO_RING_F_INDIRECT_DESC)) == 0) {
+			pr_err("%s: descriptor has forbidden INDIRECT flag, "
+			    "driver confused?\r\n",
+			    name);
+			return -1;
+		} else {
+			n_indir = vdir->len / 16;
+			if ((vdir->len & 0xf) || n_indir == 0) {
+				pr_err("%s: invalid indir len 0x%x, "
+				    "driver confused?\r\n",
+				    name, (u_int)vdir->len);
+				return -1;
+			}
+			vindir = vm_gpa2hva(ctx,
+			    vdir->addr, vdir->len);
+
+			if (!vindir) {
+				pr_err("%s cannot get host memory\r\n", name);
+				return -1;
+			}
+			for (j = 0; j < n_indir; j++) {
+				if (_vq_record_packed(i, &vindir[j], ctx, iov,
+				    n_iov, flags)) {
+					pr_err("%s: mapping to host failed\r\n",
+					    name);
+					return -1;
+				}
+				i++;
+			}
+		}
+		if (++idx >= vq->qsize) {
+			idx = 0;
+			wrap = !wrap;
+		}
+		if ((vdir->flags & VRING_DESC_F_NEXT) == 0)
+			break;
+	}
+
+	/* the buffer id rides in the last descriptor of the chain */
+	*pidx = vdir->id;
+	vq->chain_ndescs[*pidx] = ndescs;
+	vq->last_ndescs = ndescs;
+	vq->last_avail = idx;
+	vq->avail_wrap = wrap;
+	/*
+	 * Same kick suppression as the split path: with EVENT_IDX keep
+	 * the device event area pointed at the next unseen slot, so the
+	 * guest stays silent for chains we are going to drain anyway.
+	 */
+	if (base->negotiated_caps & (1 << VIRTIO_RING_F_EVENT_IDX)) {
+		vq->device_event->off_wrap = vq->last_avail |
+		    (vq->avail_wrap ? (1 << VRING_PACKED_EVENT_F_WRAP_CTR) : 0);
+		vq->device_event->flags = VRING_PACKED_EVENT_FLAG_DESC;
+		atomic_thread_fence();
+	}
+	return i;
+}
+
+int
+vq_getchain(struct virtio_vq_info *vq, uint16_t *pidx,
+	    struct iovec *iov, int n_iov, uint16_t *flags)
+{
+	if (vq_is_packed(vq))
+		return vq_getchain_packed(vq, pidx, iov, n_iov, flags);
+
+	return vq_getchain_split(vq, pidx, iov, n_iov, flags);
+}
+
 /*
  * Return the currently-first request chain back to the available queue.
  *
@@ -588,7 +1326,15 @@ loopy:
 void
 vq_retchain(struct virtio_vq_info *vq)
 {
-	vq->last_avail--;
+	if (vq_is_packed(vq)) {
+		/* step back over every slot the chain occupied */
+		if (vq->last_avail < vq->last_ndescs) {
+			vq->last_avail += vq->qsize;
+			vq->avail_wrap = !vq->avail_wrap;
+		}
+		vq->last_avail -= vq->last_ndescs;
+	} else
+		vq->last_avail--;
 }
 
 /*
@@ -601,9 +1347,37 @@ vq_retchain(struct virtio_vq_info *vq)
 void
 vq_relchain(struct virtio_vq_info *vq, uint16_t idx, uint32_t iolen)
 {
-	uint16_t uidx, mask;
+	uint16_t uidx, mask, dflags;
 	volatile struct vring_used *vuh;
 	volatile struct vring_used_elem *vue;
+	volatile struct vring_packed_desc *vd;
+
+	if (vq_is_packed(vq)) {
+		/*
+		 * One used descriptor covers the whole chain; the ring
+		 * then advances past every slot the chain occupied, so
+		 * the driver reclaims them wholesale.
+		 */
+		vd = &vq->pdesc[vq->used_idx];
+		vd->id = idx;
+		vd->len = iolen;
+
+		/* publish id/len before the flags flip hands the slot back */
+		mb();
+
+		dflags = 0;
+		if (vq->used_wrap)
+			dflags |= (1 << VRING_PACKED_DESC_F_AVAIL) |
+			    (1 << VRING_PACKED_DESC_F_USED);
+		vd->flags = dflags;
+
+		vq->used_idx += vq->chain_ndescs[idx];
+		if (vq->used_idx >= vq->qsize) {
+			vq->used_idx -= vq->qsize;
+			vq->used_wrap = !vq->used_wrap;
+		}
+		return;
+	}
 
 	/*
 	 * Notes:
@@ -625,6 +1399,89 @@ vq_relchain(struct virtio_vq_info *vq, uint16_t idx, uint32_t iolen)
 	vuh->idx = uidx;
 }
 
+/*
+ * Adaptive interrupt coalescing: when completion interrupts arrive in a
+ * sustained burst, park them on a per-queue timer and deliver one
+ * interrupt for the whole batch, at most VQ_COALESCE_HOLD_NS late. A
+ * completion whose gap to the previous one is below VQ_COALESCE_GAP_NS
+ * counts toward the burst; anything slower resets the streak and is
+ * delivered immediately, so lightly loaded queues never see added
+ * latency.
+ */
+#define	VQ_COALESCE_HOLD_NS	50000	/* max time to hold a completion */
+#define	VQ_COALESCE_GAP_NS	20000	/* gap counting toward a burst */
+#define	VQ_COALESCE_STREAK	16	/* burst length before holding */
+
+static void
+vq_coalesce_timer(void *arg, uint64_t nexp __attribute__((unused)))
+{
+	struct virtio_vq_info *vq = arg;
+	struct virtio_base *base = vq->base;
+	struct timespec now;
+
+	if (base->mtx)
+		pthread_mutex_lock(base->mtx);
+	if (vq->intr_held && vq_ring_ready(vq)) {
+		vq->intr_held = false;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		vq->last_intr_ns = now.tv_sec * 1000000000UL + now.tv_nsec;
+		vq_interrupt(base, vq);
+	} else {
+		vq->intr_held = false;
+	}
+	if (base->mtx)
+		pthread_mutex_unlock(base->mtx);
+}
+
+/*
+ * Decide whether an interrupt that is due on this queue should be held
+ * back. Returns 1 if it has been folded into the armed coalescing timer,
+ * 0 if the caller should inject it right away.
+ */
+static int
+vq_coalesce_hold(struct virtio_base *base, struct virtio_vq_info *vq)
+{
+	struct itimerspec ts;
+	struct timespec now;
+	uint64_t now_ns;
+
+	if (vq->intr_held)
+		/* already riding on the armed timer */
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = now.tv_sec * 1000000000UL + now.tv_nsec;
+
+	if (now_ns - vq->last_intr_ns >= VQ_COALESCE_GAP_NS) {
+		vq->intr_streak = 0;
+		goto deliver;
+	}
+	if (vq->intr_streak < VQ_COALESCE_STREAK) {
+		vq->intr_streak++;
+		goto deliver;
+	}
+
+	/* sustained burst: hold this one on the timer */
+	if (vq->intr_timer.fd <= 0) {
+		vq->intr_timer.clockid = CLOCK_MONOTONIC;
+		if (acrn_timer_init(&vq->intr_timer, vq_coalesce_timer,
+				vq) != 0)
+			goto deliver;
+	}
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+	ts.it_value.tv_sec = 0;
+	ts.it_value.tv_nsec = VQ_COALESCE_HOLD_NS;
+	if (acrn_timer_settime(&vq->intr_timer, &ts) != 0)
+		goto deliver;
+	vq->intr_held = true;
+	return 1;
+
+deliver:
+	vq->last_intr_ns = now_ns;
+	return 0;
+}
+
 /*
  * Driver has finished processing "available" chains and calling
  * vq_relchain on each one.  If driver used all the available
@@ -645,9 +1502,12 @@ vq_endchains(struct virtio_vq_info *vq, int used_all_avail)
 {
 	struct virtio_base *base;
 	uint16_t event_idx, new_idx, old_idx;
-	int intr;
+	uint16_t off_wrap, dflags;
+	int event_off, intr;
 
-	if (!vq || !vq->used)
+	if (!vq)
+		return;
+	if (vq_is_packed(vq) ? !vq->driver_event : !vq->used)
 		return;
 
 	/*
@@ -664,23 +1524,55 @@ vq_endchains(struct virtio_vq_info *vq, int used_all_avail)
 
 	base = vq->base;
 	old_idx = vq->save_used;
-	vq->save_used = new_idx = vq->used->idx;
-	if (used_all_avail &&
-	    (base->negotiated_caps & (1 << VIRTIO_F_NOTIFY_ON_EMPTY)))
-		intr = 1;
-	else if (base->negotiated_caps & (1 << VIRTIO_RING_F_EVENT_IDX)) {
-		event_idx = VQ_USED_EVENT_IDX(vq);
+	if (vq_is_packed(vq)) {
 		/*
-		 * This calculation is per docs and the kernel
-		 * (see src/sys/dev/virtio/virtio_ring.h).
+		 * The driver event suppression area steers packed-ring
+		 * interrupts; its flags select always/never/on a given
+		 * descriptor (the latter with EVENT_IDX).
 		 */
-		intr = (uint16_t)(new_idx - event_idx - 1) <
-			(uint16_t)(new_idx - old_idx);
+		vq->save_used = new_idx = vq->used_idx;
+		dflags = vq->driver_event->flags;
+		if (used_all_avail &&
+		    (base->negotiated_caps & (1 << VIRTIO_F_NOTIFY_ON_EMPTY)))
+			intr = 1;
+		else if (dflags == VRING_PACKED_EVENT_FLAG_DISABLE)
+			intr = 0;
+		else if (dflags == VRING_PACKED_EVENT_FLAG_DESC) {
+			off_wrap = vq->driver_event->off_wrap;
+			event_off = off_wrap &
+			    ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+			/*
+			 * An event slot tagged with the other wrap phase
+			 * lies one ring revolution behind the device's
+			 * current used index.
+			 */
+			if (vq->used_wrap !=
+			    ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) & 1))
+				event_off -= vq->qsize;
+			intr = (uint16_t)(new_idx - event_off - 1) <
+				(uint16_t)(new_idx - old_idx);
+		} else
+			intr = new_idx != old_idx;
 	} else {
-		intr = new_idx != old_idx &&
-		    !(vq->avail->flags & VRING_AVAIL_F_NO_INTERRUPT);
+		vq->save_used = new_idx = vq->used->idx;
+		if (used_all_avail &&
+		    (base->negotiated_caps & (1 << VIRTIO_F_NOTIFY_ON_EMPTY)))
+			intr = 1;
+		else if (base->negotiated_caps &
+		    (1 << VIRTIO_RING_F_EVENT_IDX)) {
+			event_idx = VQ_USED_EVENT_IDX(vq);
+			/*
+			 * This calculation is per docs and the kernel
+			 * (see src/sys/dev/virtio/virtio_ring.h).
+			 */
+			intr = (uint16_t)(new_idx - event_idx - 1) <
+				(uint16_t)(new_idx - old_idx);
+		} else {
+			intr = new_idx != old_idx &&
+			    !(vq->avail->flags & VRING_AVAIL_F_NO_INTERRUPT);
+		}
 	}
-	if (intr)
+	if (intr && !vq_coalesce_hold(base, vq))
 		vq_interrupt(base, vq);
 }
 
@@ -705,7 +1597,10 @@ void vq_clear_used_ring_flags(struct virtio_base *base, struct virtio_vq_info *v
 	if (virtio_poll_enabled && backend_type == BACKEND_VBSU && polling_in_progress == 1)
 		return;
 
-	vq->used->flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vq_is_packed(vq))
+		vq->device_event->flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+	else
+		vq->used->flags &= ~VRING_USED_F_NO_NOTIFY;
 }
 
 struct config_reg {
@@ -857,7 +1752,7 @@ bad:
 
 	switch (offset) {
 	case VIRTIO_PCI_HOST_FEATURES:
-		value = base->device_caps;
+		value = virtio_device_caps(base);
 		break;
 	case VIRTIO_PCI_GUEST_FEATURES:
 		value = base->negotiated_caps;
@@ -971,7 +1866,7 @@ bad:
 
 	switch (offset) {
 	case VIRTIO_PCI_GUEST_FEATURES:
-		base->negotiated_caps = value & base->device_caps;
+		base->negotiated_caps = value & virtio_device_caps(base);
 		if (vops->apply_features)
 			(*vops->apply_features)(DEV_STRUCT(base),
 			    base->negotiated_caps);
@@ -1010,6 +1905,16 @@ bad:
 			(*vops->set_status)(DEV_STRUCT(base), value);
 		if ((value == 0) && (vops->reset))
 			(*vops->reset)(DEV_STRUCT(base));
+		virtio_register_eventfds(base,
+			(value & VIRTIO_CONFIG_S_DRIVER_OK) != 0);
+		if (value & VIRTIO_CONFIG_S_DRIVER_OK) {
+			int poll_pcpu = -1;
+
+			if (virtio_dev_polled(vops->name, &poll_pcpu)) {
+				virtio_poll_add_dev(base, poll_pcpu);
+				virtio_doorbell_map(base);
+			}
+		}
 		if ((value & VIRTIO_CONFIG_S_DRIVER_OK) &&
 		     base->backend_type == BACKEND_VBSU &&
 		     virtio_poll_enabled) {
@@ -1297,9 +2202,9 @@ virtio_common_cfg_read(struct pci_vdev *dev, uint64_t offset, int size)
 		break;
 	case VIRTIO_PCI_COMMON_DF:
 		if (base->device_feature_select == 0)
-			value = base->device_caps & 0xffffffff;
+			value = virtio_device_caps(base) & 0xffffffff;
 		else if (base->device_feature_select == 1)
-			value = (base->device_caps >> 32) & 0xffffffff;
+			value = (virtio_device_caps(base) >> 32) & 0xffffffff;
 		else /* present 0, see 4.1.4.3.1 */
 			value = 0;
 		break;
@@ -1423,11 +2328,11 @@ virtio_common_cfg_write(struct pci_vdev *dev, uint64_t offset, int size,
 		if (base->driver_feature_select < 2) {
 			value &= 0xffffffff;
 			if (base->driver_feature_select == 0) {
-				features = base->device_caps & value;
+				features = virtio_device_caps(base) & value;
 				base->negotiated_caps &= ~0xffffffffULL;
 			} else {
 				features = (value << 32)
-					& base->device_caps;
+					& virtio_device_caps(base);
 				base->negotiated_caps &= 0xffffffffULL;
 			}
 			base->negotiated_caps |= features;
@@ -1445,7 +2350,17 @@ virtio_common_cfg_write(struct pci_vdev *dev, uint64_t offset, int size,
 			(*vops->set_status)(DEV_STRUCT(base), value);
 		if ((base->status == 0) && (vops->reset))
 			(*vops->reset)(DEV_STRUCT(base));
-		/* TODO: virtio poll mode for modern devices */
+		virtio_register_eventfds(base,
+			(base->status & VIRTIO_CONFIG_S_DRIVER_OK) != 0);
+		if (base->status & VIRTIO_CONFIG_S_DRIVER_OK) {
+			int poll_pcpu = -1;
+
+			if (virtio_dev_polled(vops->name, &poll_pcpu)) {
+				virtio_poll_add_dev(base, poll_pcpu);
+				virtio_doorbell_map(base);
+			}
+		}
+		/* TODO: timer-based virtio poll mode for modern devices */
 		break;
 	case VIRTIO_PCI_COMMON_Q_SELECT:
 		/*
@@ -1902,3 +2817,43 @@ acrn_parse_virtio_poll_interval(const char *optarg)
 
 	return 0;
 }
+
+/**
+ * @brief Register one device type for dedicated busy polling
+ *
+ * @param optarg Pointer to a "devname[@pcpu]" string.
+ *
+ * @return fail -1 success 0
+ */
+int
+acrn_parse_virtio_polling(const char *optarg)
+{
+	char *name, *cp;
+	int pcpu = -1;
+
+	if (virtio_polled_ndevs >= VIRTIO_POLLED_DEVS_MAX)
+		return -1;
+
+	name = virtio_polled_conf[virtio_polled_ndevs].name;
+	strncpy(name, optarg, sizeof(virtio_polled_conf[0].name) - 1);
+
+	cp = strchr(name, '@');
+	if (cp != NULL) {
+		*cp = '\0';
+		if (dm_strtoi(cp + 1, NULL, 10, &pcpu) != 0 || pcpu < 0)
+			return -1;
+	}
+	if (strlen(name) == 0)
+		return -1;
+
+	virtio_polled_conf[virtio_polled_ndevs].pcpu = pcpu;
+	virtio_polled_ndevs++;
+
+	return 0;
+}
+
+void
+acrn_enable_virtio_doorbell(void)
+{
+	virtio_doorbell_enabled = 1;
+}
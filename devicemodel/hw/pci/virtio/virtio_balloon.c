@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * virtio memory balloon emulation.
+ *
+ * Pages the guest hands over on the inflate queue are punched out of both
+ * the EPT (via the UNSET_MEMSEG path down to ept_del_mr()) and the
+ * hugetlbfs files backing guest RAM, so ballooned memory really returns
+ * to the host huge page pool.  The deflate queue re-allocates the backing
+ * pages and restores the EPT mapping.
+ *
+ * ACRN pins guest memory: the EPT caches host-physical translations taken
+ * when a region is mapped, so the guest must not touch a ballooned page
+ * until its deflate request has completed.  VIRTIO_BALLOON_F_MUST_TELL_HOST
+ * is therefore always offered.  The out-of-memory fast path relies on
+ * deflate requests being served synchronously in the notify context below:
+ * a guest under memory pressure gets its pages back after a single
+ * kick/used-ring round trip, with no worker thread wakeup in between.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "dm.h"
+#include "pci_core.h"
+#include "virtio.h"
+#include "vmmapi.h"
+
+#define VIRTIO_BALLOON_RINGSZ		128
+
+#define VIRTIO_BALLOON_PAGE_SHIFT	12
+#define VIRTIO_BALLOON_PAGE_SIZE	(1UL << VIRTIO_BALLOON_PAGE_SHIFT)
+#define VIRTIO_BALLOON_PAGES_PER_MB	(MB >> VIRTIO_BALLOON_PAGE_SHIFT)
+
+/* queue 0 inflates the balloon, queue 1 deflates it */
+#define VIRTIO_BALLOON_MAXQ		2
+
+/* number of page-frame descriptors accepted per chain */
+#define VIRTIO_BALLOON_MAXSEGS		8
+
+/* feature bits */
+#define VIRTIO_BALLOON_F_MUST_TELL_HOST	(1 << 0)
+#define VIRTIO_BALLOON_F_DEFLATE_ON_OOM	(1 << 2)
+
+struct virtio_balloon_config {
+	/* target balloon size, in guest pages; set by the host */
+	uint32_t num_pages;
+	/* pages actually in the balloon; updated by the guest */
+	uint32_t actual;
+} __attribute__((packed));
+
+/*
+ * Per-device struct
+ */
+struct virtio_balloon {
+	struct virtio_base base;
+	struct virtio_vq_info queues[VIRTIO_BALLOON_MAXQ];
+	pthread_mutex_t mtx;
+	struct virtio_balloon_config config;
+	uint64_t ballooned_pages;
+};
+
+static int virtio_balloon_debug;
+#define DPRINTF(params) do { if (virtio_balloon_debug) pr_dbg params; } while (0)
+#define WPRINTF(params) (pr_err params)
+
+static void virtio_balloon_reset(void *);
+static void virtio_balloon_notify(void *, struct virtio_vq_info *);
+static int virtio_balloon_cfgread(void *, int, int, uint32_t *);
+static int virtio_balloon_cfgwrite(void *, int, int, uint32_t);
+
+static struct virtio_ops virtio_balloon_ops = {
+	"virtio_balloon",		/* our name */
+	VIRTIO_BALLOON_MAXQ,		/* we support 2 virtqueues */
+	sizeof(struct virtio_balloon_config), /* config reg size */
+	virtio_balloon_reset,		/* reset */
+	virtio_balloon_notify,		/* device-wide qnotify */
+	virtio_balloon_cfgread,		/* read virtio config */
+	virtio_balloon_cfgwrite,	/* write virtio config */
+	NULL,				/* apply negotiated features */
+	NULL,				/* called on guest set status */
+};
+
+static void
+virtio_balloon_reset(void *vdev)
+{
+	struct virtio_balloon *balloon = vdev;
+
+	DPRINTF(("virtio_balloon: device reset requested!\n"));
+	virtio_reset_dev(&balloon->base);
+}
+
+/*
+ * Inflate or deflate one run of guest-contiguous pages.  The EPT mapping
+ * is always removed before the backing pages are released so the guest
+ * can never reach a page the host has already reclaimed.
+ */
+static void
+virtio_balloon_do_range(struct virtio_balloon *balloon, bool inflate,
+		uint64_t gpa, size_t len)
+{
+	struct vmctx *ctx = balloon->base.dev->vmctx;
+	struct vm_mem_region region;
+	void *hva;
+
+	/* only guest RAM backed by hugetlbfs may be ballooned */
+	if (!vm_find_memfd_region(ctx, gpa, &region) ||
+	    !vm_find_memfd_region(ctx, gpa + len - 1, &region)) {
+		WPRINTF(("virtio_balloon: pfn range 0x%lx@0x%lx not in guest RAM\n",
+			len, gpa));
+		return;
+	}
+
+	if (inflate) {
+		if (vm_unmap_memseg_vma(ctx, len, gpa) < 0) {
+			WPRINTF(("virtio_balloon: unmap 0x%lx@0x%lx failed\n",
+				len, gpa));
+			return;
+		}
+		hugetlb_punch_gpa_hole(ctx, gpa, len);
+		balloon->ballooned_pages += len >> VIRTIO_BALLOON_PAGE_SHIFT;
+	} else {
+		if (hugetlb_plug_gpa_hole(ctx, gpa, len) < 0) {
+			WPRINTF(("virtio_balloon: can not re-allocate 0x%lx@0x%lx\n",
+				len, gpa));
+			return;
+		}
+		hva = paddr_guest2host(ctx, gpa, len);
+		if (hva == NULL ||
+		    vm_map_memseg_vma(ctx, len, gpa, (uint64_t)hva, PROT_ALL) < 0) {
+			WPRINTF(("virtio_balloon: remap 0x%lx@0x%lx failed\n",
+				len, gpa));
+			return;
+		}
+		balloon->ballooned_pages -= len >> VIRTIO_BALLOON_PAGE_SHIFT;
+	}
+}
+
+/*
+ * Walk one buffer of 32-bit page frame numbers, coalescing ascending runs
+ * of contiguous pages so region crossings and ioctls happen per run rather
+ * than per page.
+ */
+static void
+virtio_balloon_process_pfns(struct virtio_balloon *balloon, bool inflate,
+		const uint32_t *pfns, size_t count)
+{
+	uint64_t run_gpa = 0, gpa;
+	size_t run_len = 0, i;
+
+	for (i = 0; i < count; i++) {
+		gpa = (uint64_t)pfns[i] << VIRTIO_BALLOON_PAGE_SHIFT;
+		if ((run_len > 0) && (gpa == run_gpa + run_len)) {
+			run_len += VIRTIO_BALLOON_PAGE_SIZE;
+			continue;
+		}
+		if (run_len > 0)
+			virtio_balloon_do_range(balloon, inflate,
+					run_gpa, run_len);
+		run_gpa = gpa;
+		run_len = VIRTIO_BALLOON_PAGE_SIZE;
+	}
+	if (run_len > 0)
+		virtio_balloon_do_range(balloon, inflate, run_gpa, run_len);
+}
+
+static void
+virtio_balloon_notify(void *vdev, struct virtio_vq_info *vq)
+{
+	struct virtio_balloon *balloon = vdev;
+	struct iovec iov[VIRTIO_BALLOON_MAXSEGS];
+	bool inflate = (vq == &balloon->queues[0]);
+	uint16_t idx;
+	int i, n;
+
+	while (vq_has_descs(vq)) {
+		n = vq_getchain(vq, &idx, iov, VIRTIO_BALLOON_MAXSEGS, NULL);
+		if (n < 1) {
+			WPRINTF(("virtio_balloon: fail to getchain!\n"));
+			return;
+		}
+
+		for (i = 0; i < n; i++)
+			virtio_balloon_process_pfns(balloon, inflate,
+					iov[i].iov_base,
+					iov[i].iov_len / sizeof(uint32_t));
+
+		/* release this chain and handle more */
+		vq_relchain(vq, idx, 0);
+	}
+	vq_endchains(vq, 1);
+
+	DPRINTF(("virtio_balloon: %s done, ballooned pages %lu\n",
+		inflate ? "inflate" : "deflate", balloon->ballooned_pages));
+}
+
+static int
+virtio_balloon_cfgread(void *vdev, int offset, int size, uint32_t *retval)
+{
+	struct virtio_balloon *balloon = vdev;
+	void *ptr;
+
+	/* our caller has already verified offset and size */
+	ptr = (uint8_t *)&balloon->config + offset;
+	memcpy(retval, ptr, size);
+	return 0;
+}
+
+static int
+virtio_balloon_cfgwrite(void *vdev, int offset, int size, uint32_t value)
+{
+	struct virtio_balloon *balloon = vdev;
+
+	if ((offset == offsetof(struct virtio_balloon_config, actual))
+		&& (size == 4)) {
+		balloon->config.actual = value;
+		DPRINTF(("virtio_balloon: guest reports %u pages ballooned\n",
+			value));
+		return 0;
+	}
+
+	WPRINTF(("virtio_balloon: write to readonly reg %d\n", offset));
+	return -1;
+}
+
+static int
+virtio_balloon_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
+{
+	struct virtio_balloon *balloon;
+	pthread_mutexattr_t attr;
+	uint64_t target_mb;
+	int i, rc;
+
+	balloon = calloc(1, sizeof(struct virtio_balloon));
+	if (!balloon) {
+		WPRINTF(("virtio_balloon: calloc returns NULL\n"));
+		return -1;
+	}
+
+	/* optional opts: initial balloon target in MB */
+	if (opts != NULL) {
+		target_mb = strtoul(opts, NULL, 10);
+		balloon->config.num_pages =
+			target_mb * VIRTIO_BALLOON_PAGES_PER_MB;
+	}
+
+	/* init mutex attribute properly to avoid deadlock */
+	rc = pthread_mutexattr_init(&attr);
+	if (rc)
+		DPRINTF(("mutexattr init failed with error %d!\n", rc));
+	rc = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (rc)
+		DPRINTF(("virtio_balloon: mutexattr_settype failed with "
+			"error %d!\n", rc));
+	rc = pthread_mutex_init(&balloon->mtx, &attr);
+	if (rc)
+		DPRINTF(("virtio_balloon: pthread_mutex_init failed with "
+			"error %d!\n", rc));
+
+	virtio_linkup(&balloon->base, &virtio_balloon_ops, balloon, dev,
+		      balloon->queues, BACKEND_VBSU);
+	balloon->base.mtx = &balloon->mtx;
+	balloon->base.device_caps = VIRTIO_BALLOON_F_MUST_TELL_HOST |
+				    VIRTIO_BALLOON_F_DEFLATE_ON_OOM;
+
+	for (i = 0; i < VIRTIO_BALLOON_MAXQ; i++)
+		balloon->queues[i].qsize = VIRTIO_BALLOON_RINGSZ;
+
+	/* initialize config space */
+	pci_set_cfgdata16(dev, PCIR_DEVICE, VIRTIO_DEV_BALLOON);
+	pci_set_cfgdata16(dev, PCIR_VENDOR, VIRTIO_VENDOR);
+	pci_set_cfgdata8(dev, PCIR_CLASS, PCIC_MEMORY);
+	pci_set_cfgdata16(dev, PCIR_SUBDEV_0, VIRTIO_TYPE_BALLOON);
+	pci_set_cfgdata16(dev, PCIR_SUBVEND_0, VIRTIO_VENDOR);
+
+	if (virtio_interrupt_init(&balloon->base, virtio_uses_msix())) {
+		pthread_mutex_destroy(&balloon->mtx);
+		free(balloon);
+		return -1;
+	}
+	virtio_set_io_bar(&balloon->base, 0);
+
+	return 0;
+}
+
+static void
+virtio_balloon_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
+{
+	struct virtio_balloon *balloon;
+
+	balloon = dev->arg;
+	if (balloon == NULL) {
+		DPRINTF(("%s: balloon is NULL\n", __func__));
+		return;
+	}
+
+	virtio_balloon_reset(balloon);
+	pthread_mutex_destroy(&balloon->mtx);
+	free(balloon);
+}
+
+struct pci_vdev_ops pci_ops_virtio_balloon = {
+	.class_name	= "virtio-balloon",
+	.vdev_init	= virtio_balloon_init,
+	.vdev_deinit	= virtio_balloon_deinit,
+	.vdev_barwrite	= virtio_pci_write,
+	.vdev_barread	= virtio_pci_read
+};
+DEFINE_PCI_DEVTYPE(pci_ops_virtio_balloon);
@@ -44,6 +44,7 @@
 #include "monitor.h"
 
 #define VIRTIO_BLK_RINGSZ	64
+#define VIRTIO_BLK_MAXQ		8
 #define VIRTIO_BLK_MAX_OPTS_LEN	256
 
 #define VIRTIO_BLK_S_OK	0
@@ -62,6 +63,8 @@
 /* Device can toggle its cache between writeback and writethrough modes */
 #define	VIRTIO_BLK_F_CONFIG_WCE	(1 << 11)
 
+#define	VIRTIO_BLK_F_MQ		(1 << 12)	/* Multiple request queues */
+
 #define	VIRTIO_BLK_F_DISCARD	(1 << 13)
 
 /*
@@ -101,8 +104,8 @@ struct virtio_blk_config {
 	} topology;
 	uint8_t	writeback;
 	uint8_t unused;
-	/* Reserve for num_queues when VIRTIO_BLK_F_MQ is support*/
-	uint16_t reserve;
+	/* The number of request queues, valid with VIRTIO_BLK_F_MQ */
+	uint16_t num_queues;
 	/* The maximum discard sectors (in 512-byte sectors) for one segment */
 	uint32_t max_discard_sectors;
 	/* The maximum number of discard segments */
@@ -146,6 +149,7 @@ static struct monitor_vm_ops virtio_blk_rescan_ops = {
 struct virtio_blk_ioreq {
 	struct blockif_req req;
 	struct virtio_blk *blk;
+	struct virtio_vq_info *vq;
 	uint8_t *status;
 	uint16_t idx;
 };
@@ -156,12 +160,16 @@ struct virtio_blk_ioreq {
 struct virtio_blk {
 	struct virtio_base base;
 	pthread_mutex_t mtx;
-	struct virtio_vq_info vq;
+	struct virtio_vq_info vqs[VIRTIO_BLK_MAXQ];
 	struct virtio_blk_config cfg;
 	bool dummy_bctxt; /* Used in blockrescan. Indicate if the bctxt can be used */
 	struct blockif_ctxt *bc;
+	int num_queues;
+	/* per-queue submission context; qbc[0] is an alias of bc */
+	struct blockif_ctxt *qbc[VIRTIO_BLK_MAXQ];
 	char ident[VIRTIO_BLK_BLK_ID_BYTES + 1];
-	struct virtio_blk_ioreq ios[VIRTIO_BLK_RINGSZ];
+	/* one VIRTIO_BLK_RINGSZ array of requests per active queue */
+	struct virtio_blk_ioreq *ios[VIRTIO_BLK_MAXQ];
 	uint8_t original_wce;
 };
 
@@ -172,7 +180,7 @@ static int virtio_blk_cfgwrite(void *, int, int, uint32_t);
 
 static struct virtio_ops virtio_blk_ops = {
 	"virtio_blk",		/* our name */
-	1,			/* we support 1 virtqueue */
+	VIRTIO_BLK_MAXQ,	/* we support up to VIRTIO_BLK_MAXQ virtqueues */
 	sizeof(struct virtio_blk_config), /* config reg size */
 	virtio_blk_reset,	/* reset */
 	virtio_blk_notify,	/* device-wide qnotify */
@@ -186,12 +194,15 @@ static void
 virtio_blk_reset(void *vdev)
 {
 	struct virtio_blk *blk = vdev;
+	int i;
 
 	DPRINTF(("virtio_blk: device reset requested !\n"));
 	virtio_reset_dev(&blk->base);
 	/* Reset virtio-blk device only on valid bctxt*/
-	if (!blk->dummy_bctxt)
-		blockif_set_wce(blk->bc, blk->original_wce);
+	if (!blk->dummy_bctxt) {
+		for (i = 0; i < blk->num_queues; i++)
+			blockif_set_wce(blk->qbc[i], blk->original_wce);
+	}
 }
 
 static void
@@ -216,8 +227,8 @@ virtio_blk_done(struct blockif_req *br, int err)
 	 * We wrote 1 byte (our status) to host.
 	 */
 	pthread_mutex_lock(&blk->mtx);
-	vq_relchain(&blk->vq, io->idx, 1);
-	vq_endchains(&blk->vq, !vq_has_descs(&blk->vq));
+	vq_relchain(io->vq, io->idx, 1);
+	vq_endchains(io->vq, !vq_has_descs(io->vq));
 	pthread_mutex_unlock(&blk->mtx);
 }
 
@@ -235,6 +246,7 @@ virtio_blk_proc(struct virtio_blk *blk, struct virtio_vq_info *vq)
 {
 	struct virtio_blk_hdr *vbh;
 	struct virtio_blk_ioreq *io;
+	struct blockif_ctxt *bc;
 	int i, n;
 	int err;
 	ssize_t iolen;
@@ -259,7 +271,9 @@ virtio_blk_proc(struct virtio_blk *blk, struct virtio_vq_info *vq)
 		return;
 	}
 
-	io = &blk->ios[idx];
+	/* submit on the blockif context bound to the notifying queue */
+	bc = blk->qbc[vq->num];
+	io = &blk->ios[vq->num][idx];
 	if ((flags[0] & VRING_DESC_F_WRITE) != 0) {
 		WPRINTF(("%s: the type for hdr should not be VRING_DESC_F_WRITE\n", __func__));
 		virtio_blk_abort(vq, idx);
@@ -299,7 +313,7 @@ virtio_blk_proc(struct virtio_blk *blk, struct virtio_vq_info *vq)
 		return;
 	}
 
-	if (writeop && blockif_is_ro(blk->bc)) {
+	if (writeop && blockif_is_ro(bc)) {
 		WPRINTF(("Cannot write to a read-only storage!\n"));
 		virtio_blk_done(&io->req, EROFS);
 		return;
@@ -350,14 +364,14 @@ virtio_blk_proc(struct virtio_blk *blk, struct virtio_vq_info *vq)
 		}
 
 		err = ((type == VBH_OP_READ) ? blockif_read : blockif_write)
-				(blk->bc, &io->req);
+				(bc, &io->req);
 		break;
 	case VBH_OP_DISCARD:
-		err = blockif_discard(blk->bc, &io->req);
+		err = blockif_discard(bc, &io->req);
 		break;
 	case VBH_OP_FLUSH:
 	case VBH_OP_FLUSH_OUT:
-		err = blockif_flush(blk->bc, &io->req);
+		err = blockif_flush(bc, &io->req);
 		break;
 	case VBH_OP_IDENT:
 		/* Assume a single buffer */
@@ -399,6 +413,9 @@ virtio_blk_get_caps(struct virtio_blk *blk, bool wb)
 	if (blockif_is_ro(blk->bc))
 		caps |= VIRTIO_BLK_F_RO;
 
+	if (blk->num_queues > 1)
+		caps |= VIRTIO_BLK_F_MQ;
+
 	return caps;
 }
 
@@ -425,6 +442,7 @@ virtio_blk_update_config_space(struct virtio_blk *blk)
 	blk->cfg.topology.alignment_offset =
 	    (sto != 0) ? ((sts - sto) / sectsz) : 0;
 	blk->cfg.topology.min_io_size = 0;
+	blk->cfg.num_queues = blk->num_queues;
 	blk->cfg.writeback = blockif_get_wce(blk->bc);
 	blk->original_wce = blk->cfg.writeback; /* save for reset */
 	if (blockif_candiscard(blk->bc)) {
@@ -435,6 +453,51 @@ virtio_blk_update_config_space(struct virtio_blk *blk)
 	blk->base.device_caps =
 		virtio_blk_get_caps(blk, !!blk->cfg.writeback);
 }
+
+/*
+ * Consume a "mq=<num queues>" element from opts, if present. It is parsed
+ * here rather than in blockif_open() since each request queue gets its own
+ * blockif context; the remaining options are handed to blockif_open()
+ * unchanged. Returns the requested queue count (1 if "mq" is absent) or -1
+ * on a malformed option.
+ */
+static int
+virtio_blk_parse_mq(char *opts)
+{
+	char *cp, *xopts, *nopt;
+	int nq = 1;
+
+	nopt = xopts = strdup(opts);
+	if (!nopt) {
+		WPRINTF(("virtio_blk: strdup returns NULL\n"));
+		return -1;
+	}
+
+	opts[0] = '\0';
+	while (xopts != NULL) {
+		cp = strsep(&xopts, ",");
+		if (!strncmp(cp, "mq", strlen("mq"))) {
+			strsep(&cp, "=");
+			if (cp == NULL || dm_strtoi(cp, &cp, 10, &nq) || nq < 1) {
+				free(nopt);
+				return -1;
+			}
+			continue;
+		}
+		if (opts[0] != '\0')
+			strcat(opts, ",");
+		strcat(opts, cp);
+	}
+	free(nopt);
+
+	if (nq > VIRTIO_BLK_MAXQ) {
+		WPRINTF(("virtio_blk: %d queues requested, using %d\n",
+			 nq, VIRTIO_BLK_MAXQ));
+		nq = VIRTIO_BLK_MAXQ;
+	}
+	return nq;
+}
+
 static int
 virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 {
@@ -443,7 +506,7 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	struct blockif_ctxt *bctxt;
 	u_char digest[16];
 	struct virtio_blk *blk;
-	int i;
+	int i, q, num_queues;
 	pthread_mutexattr_t attr;
 	int rc;
 
@@ -456,6 +519,12 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 		return -1;
 	}
 
+	num_queues = virtio_blk_parse_mq(opts);
+	if (num_queues < 0) {
+		pr_err("virtio_blk: invalid mq option\n");
+		return -1;
+	}
+
 	/*
 	 * The supplied backing file has to exist
 	 */
@@ -478,6 +547,16 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 		}
 	}
 
+	/*
+	 * A "range" sub-file holds an OFD lock, so it cannot be opened once
+	 * per queue; a dummy bctxt has nothing to open at all.
+	 */
+	if ((num_queues > 1) &&
+	    (dummy_bctxt || (strstr(opts, "range=") != NULL))) {
+		WPRINTF(("virtio_blk: multi-queue needs a dedicated backing "
+			 "file, using 1 queue\n"));
+		num_queues = 1;
+	}
 
 	blk = calloc(1, sizeof(struct virtio_blk));
 	if (!blk) {
@@ -488,14 +567,54 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	blk->bc = bctxt;
 	/* Update virtio-blk device struct of dummy ctxt*/
 	blk->dummy_bctxt = dummy_bctxt;
+	blk->num_queues = num_queues;
+	blk->qbc[0] = bctxt;
+
+	/* every other queue submits through its own blockif context */
+	for (q = 1; q < num_queues; q++) {
+		if (snprintf(bident, sizeof(bident), "%d:%d-%d",
+					dev->slot, dev->func, q) >= sizeof(bident)) {
+			WPRINTF(("bident error, please check slot and func\n"));
+		}
+		blk->qbc[q] = blockif_open(opts, bident);
+		if (blk->qbc[q] == NULL) {
+			pr_err("Could not open backing file for queue %d", q);
+			goto fail;
+		}
+	}
 
-	for (i = 0; i < VIRTIO_BLK_RINGSZ; i++) {
-		struct virtio_blk_ioreq *io = &blk->ios[i];
+	/*
+	 * Each queue context parsed the same iops=/bps= limits, so split
+	 * them across the queues to keep the device-wide rate as given.
+	 */
+	if (num_queues > 1) {
+		uint64_t iops, bps;
+
+		blockif_get_rate(blk->qbc[0], &iops, &bps);
+		if (iops != 0 || bps != 0) {
+			for (q = 0; q < num_queues; q++)
+				blockif_set_rate(blk->qbc[q],
+					(iops + num_queues - 1 - q) / num_queues,
+					(bps + num_queues - 1 - q) / num_queues);
+		}
+	}
 
-		io->req.callback = virtio_blk_done;
-		io->req.param = io;
-		io->blk = blk;
-		io->idx = i;
+	for (q = 0; q < num_queues; q++) {
+		blk->ios[q] = calloc(VIRTIO_BLK_RINGSZ,
+				     sizeof(struct virtio_blk_ioreq));
+		if (!blk->ios[q]) {
+			WPRINTF(("virtio_blk: calloc returns NULL\n"));
+			goto fail;
+		}
+		for (i = 0; i < VIRTIO_BLK_RINGSZ; i++) {
+			struct virtio_blk_ioreq *io = &blk->ios[q][i];
+
+			io->req.callback = virtio_blk_done;
+			io->req.param = io;
+			io->blk = blk;
+			io->vq = &blk->vqs[q];
+			io->idx = i;
+		}
 	}
 
 	/* init mutex attribute properly to avoid deadlock */
@@ -513,11 +632,12 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 					"error %d!\n", rc));
 
 	/* init virtio struct and virtqueues */
-	virtio_linkup(&blk->base, &virtio_blk_ops, blk, dev, &blk->vq, BACKEND_VBSU);
+	virtio_linkup(&blk->base, &virtio_blk_ops, blk, dev, blk->vqs, BACKEND_VBSU);
 	blk->base.mtx = &blk->mtx;
 
-	blk->vq.qsize = VIRTIO_BLK_RINGSZ;
-	/* blk->vq.vq_notify = we have no per-queue notify */
+	for (i = 0; i < VIRTIO_BLK_MAXQ; i++)
+		blk->vqs[i].qsize = VIRTIO_BLK_RINGSZ;
+	/* blk->vqs[i].vq_notify = we have no per-queue notify */
 
 	/*
 	 * Create an identifier for the backing file. Use parts of the
@@ -559,13 +679,8 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	else
 		pci_set_cfgdata16(dev, PCIR_SUBVEND_0, VIRTIO_VENDOR);
 
-	if (virtio_interrupt_init(&blk->base, virtio_uses_msix())) {
-		/* call close only for valid bctxt */
-		if (!blk->dummy_bctxt)
-			blockif_close(blk->bc);
-		free(blk);
-		return -1;
-	}
+	if (virtio_interrupt_init(&blk->base, virtio_uses_msix()))
+		goto fail;
 	virtio_set_io_bar(&blk->base, 0);
 
 	/*
@@ -580,6 +695,17 @@ virtio_blk_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	}
 
 	return 0;
+
+fail:
+	/* call close only for valid bctxt */
+	for (q = 0; q < num_queues; q++) {
+		if (blk->qbc[q] != NULL)
+			blockif_close(blk->qbc[q]);
+		if (blk->ios[q] != NULL)
+			free(blk->ios[q]);
+	}
+	free(blk);
+	return -1;
 }
 
 static void
@@ -587,18 +713,23 @@ virtio_blk_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 {
 	struct blockif_ctxt *bctxt;
 	struct virtio_blk *blk;
+	int i;
 
 	if (dev->arg) {
 		DPRINTF(("virtio_blk: deinit\n"));
 		blk = (struct virtio_blk *) dev->arg;
 		/* De-init virtio-blk device only on valid bctxt*/
 		if (!blk->dummy_bctxt) {
-			bctxt = blk->bc;
-			if (blockif_flush_all(bctxt))
-				WPRINTF(("vrito_blk: Failed to flush before close\n"));
-			blockif_close(bctxt);
+			for (i = 0; i < blk->num_queues; i++) {
+				bctxt = blk->qbc[i];
+				if (blockif_flush_all(bctxt))
+					WPRINTF(("vrito_blk: Failed to flush before close\n"));
+				blockif_close(bctxt);
+			}
 		}
 		virtio_reset_dev(&blk->base);
+		for (i = 0; i < blk->num_queues; i++)
+			free(blk->ios[i]);
 		free(blk);
 	}
 }
@@ -609,6 +740,7 @@ virtio_blk_cfgwrite(void *vdev, int offset, int size, uint32_t value)
 	struct virtio_blk *blk = vdev;
 	struct virtio_blk_config *blkcfg = &(blk->cfg);
 	void *ptr;
+	int i;
 
 	ptr = (uint8_t *)blkcfg + offset;
 
@@ -616,8 +748,10 @@ virtio_blk_cfgwrite(void *vdev, int offset, int size, uint32_t value)
 		&& (size == 1)) {
 		memcpy(ptr, &value, size);
 		/* Update write cache enable only on valid bctxt*/
-		if (!blk->dummy_bctxt)
-			blockif_set_wce(blk->bc, blkcfg->writeback);
+		if (!blk->dummy_bctxt) {
+			for (i = 0; i < blk->num_queues; i++)
+				blockif_set_wce(blk->qbc[i], blkcfg->writeback);
+		}
 		if (blkcfg->writeback)
 			blk->base.device_caps |= VIRTIO_BLK_F_FLUSH;
 		else
@@ -705,6 +839,7 @@ virtio_blk_rescan(struct vmctx *ctx, struct pci_vdev *dev, char *newpath)
 	}
 
 	blk->bc = bctxt;
+	blk->qbc[0] = bctxt;
 	blk->dummy_bctxt = false;
 
 	/* Update virtio-blk device configuration on valid file*/
@@ -769,6 +904,94 @@ end:
 	return error;
 }
 
+/* Update the I/O rate limits of a virtio-blk device at runtime.
+ * devargs is "slot,iops=<n>,bps=<n>"; a limit of 0 removes shaping,
+ * an omitted limit keeps its current value. Device-wide limits are
+ * split across the queue contexts like at init time.
+ */
+int
+vm_monitor_blkrate(void *arg, char *devargs)
+{
+	char *opts, *str, *cp;
+	int slot, q;
+	int error = -1;
+	long val;
+	uint64_t iops, bps;
+	struct pci_vdev *dev;
+	struct virtio_blk *blk;
+
+	opts = str = strdup(devargs);
+	if (!str) {
+		pr_err("%s: strdup returns NULL\n", __func__);
+		return -1;
+	}
+
+	cp = strsep(&str, ",");
+	if ((cp == NULL) || dm_strtoi(cp, &cp, 10, &slot)) {
+		pr_err("Incorrect slot info!\n");
+		goto end;
+	}
+
+	dev = pci_get_vdev_info(slot);
+	if (dev == NULL) {
+		pr_err("vdev info failed for Slot %d\n!", slot);
+		goto end;
+	}
+
+	if (strstr(dev->name, "virtio-blk") == NULL) {
+		pr_err("virtio-blk only supports blkrate: found %s at slot %d\n", dev->name, slot);
+		goto end;
+	}
+
+	blk = (struct virtio_blk *) dev->arg;
+	if (!blk || blk->dummy_bctxt) {
+		pr_err("no valid backend file to shape at slot %d\n", slot);
+		goto end;
+	}
+
+	/* current device-wide limits are the per-queue limits summed up */
+	iops = 0;
+	bps = 0;
+	for (q = 0; q < blk->num_queues; q++) {
+		uint64_t qiops, qbps;
+
+		blockif_get_rate(blk->qbc[q], &qiops, &qbps);
+		iops += qiops;
+		bps += qbps;
+	}
+
+	while (str != NULL) {
+		cp = strsep(&str, ",");
+		if (!strncmp(cp, "iops", strlen("iops"))) {
+			if (!strsep(&cp, "=") ||
+				dm_strtol(cp, &cp, 10, &val) || val < 0) {
+				pr_err("Incorrect iops limit!\n");
+				goto end;
+			}
+			iops = val;
+		} else if (!strncmp(cp, "bps", strlen("bps"))) {
+			if (!strsep(&cp, "=") ||
+				dm_strtol(cp, &cp, 10, &val) || val < 0) {
+				pr_err("Incorrect bps limit!\n");
+				goto end;
+			}
+			bps = val;
+		} else {
+			pr_err("Invalid blkrate option \"%s\"\n", cp);
+			goto end;
+		}
+	}
+
+	for (q = 0; q < blk->num_queues; q++)
+		blockif_set_rate(blk->qbc[q],
+			(iops + blk->num_queues - 1 - q) / blk->num_queues,
+			(bps + blk->num_queues - 1 - q) / blk->num_queues);
+	error = 0;
+end:
+	free(opts);
+	return error;
+}
+
 struct pci_vdev_ops pci_ops_virtio_blk = {
 	.class_name	= "virtio-blk",
 	.vdev_init	= virtio_blk_init,
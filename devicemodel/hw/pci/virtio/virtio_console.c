@@ -30,6 +30,7 @@
 
 #include <sys/uio.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <errno.h>
@@ -44,11 +45,14 @@
 #include <limits.h>
 
 #include "dm.h"
+#include "dm_string.h"
 #include "pci_core.h"
 #include "virtio.h"
 #include "mevent.h"
 
 #define	VIRTIO_CONSOLE_RINGSZ	64
+#define	VIRTIO_CONSOLE_LOG_LIMIT_DEFAULT	(16UL << 20)
+#define	VIRTIO_CONSOLE_LOG_KEEP_DEFAULT		4
 #define	VIRTIO_CONSOLE_MAXPORTS	16
 #define	VIRTIO_CONSOLE_MAXQ	(VIRTIO_CONSOLE_MAXPORTS * 2 + 2)
 
@@ -88,6 +92,7 @@ enum virtio_console_be_type {
 	VIRTIO_CONSOLE_BE_PTY,
 	VIRTIO_CONSOLE_BE_FILE,
 	VIRTIO_CONSOLE_BE_SOCKET,
+	VIRTIO_CONSOLE_BE_LOG,
 	VIRTIO_CONSOLE_BE_MAX,
 	VIRTIO_CONSOLE_BE_INVALID = VIRTIO_CONSOLE_BE_MAX
 };
@@ -113,10 +118,15 @@ struct virtio_console_backend {
 	int				fd;
 	int				server_fd;
 	bool				open;
+	bool				rx_blocked;
 	enum virtio_console_be_type	be_type;
 	int				pts_fd;	/* only valid for PTY */
 	const char 			*portpath;
 	const char 			*socket_type;
+	/* only valid for LOG */
+	uint64_t			log_size;
+	uint64_t			log_limit;
+	int				log_keep;
 };
 
 struct virtio_console {
@@ -161,6 +171,8 @@ static void virtio_console_control_send(struct virtio_console *,
 static void virtio_console_announce_port(struct virtio_console_port *);
 static void virtio_console_open_port(struct virtio_console_port *, bool);
 static void virtio_console_teardown_backend(void *);
+static void virtio_console_backend_write(struct virtio_console_port *, void *,
+	struct iovec *, int);
 
 static struct virtio_ops virtio_console_ops = {
 	"vtcon",			/* our name */
@@ -179,7 +191,8 @@ static const char *virtio_console_be_table[VIRTIO_CONSOLE_BE_MAX] = {
 	[VIRTIO_CONSOLE_BE_TTY]		= "tty",
 	[VIRTIO_CONSOLE_BE_PTY]		= "pty",
 	[VIRTIO_CONSOLE_BE_FILE]	= "file",
-	[VIRTIO_CONSOLE_BE_SOCKET]	= "socket"
+	[VIRTIO_CONSOLE_BE_SOCKET]	= "socket",
+	[VIRTIO_CONSOLE_BE_LOG]		= "log"
 };
 
 static struct termios virtio_console_saved_tio;
@@ -384,20 +397,24 @@ virtio_console_notify_tx(void *vdev, struct virtio_vq_info *vq)
 {
 	struct virtio_console *console;
 	struct virtio_console_port *port;
-	struct iovec iov[1];
+	struct iovec iov[VIRTIO_CONSOLE_RINGSZ];
 	uint16_t idx;
-	uint16_t flags[8];
+	uint16_t flags[VIRTIO_CONSOLE_RINGSZ];
+	int n;
 
 	console = vdev;
 	port = virtio_console_vq_to_port(console, vq);
 
 	while (vq_has_descs(vq)) {
-		if (vq_getchain(vq, &idx, iov, 1, flags) < 1) {
+		/* pass whole chains to the backend so one writev covers
+		 * every segment instead of one syscall per descriptor */
+		n = vq_getchain(vq, &idx, iov, VIRTIO_CONSOLE_RINGSZ, flags);
+		if (n < 1) {
 			pr_err("%s: fail to getchain!\n", __func__);
 			break;
 		}
 		if ((port != NULL) && (port->cb != NULL))
-			port->cb(port, port->arg, iov, 1);
+			port->cb(port, port->arg, iov, n);
 
 		/*
 		 * Release this chain and handle more
@@ -407,11 +424,38 @@ virtio_console_notify_tx(void *vdev, struct virtio_vq_info *vq)
 	vq_endchains(vq, 1);	/* Generate interrupt if appropriate. */
 }
 
+static inline struct mevent *
+virtio_console_rx_event(struct virtio_console_backend *be)
+{
+	/* socket servers read guest-bound data on the accepted fd */
+	return be->conn_evp ? be->conn_evp : be->evp;
+}
+
+/*
+ * The guest ran out of RX descriptors. Stop polling the backend fd so
+ * the kernel socket/tty buffer absorbs the burst rather than draining
+ * it into a scratch buffer and losing the data. Guest notifications on
+ * the RX queue are turned back on so the refill kick below unblocks us.
+ */
+static void
+virtio_console_rx_block(struct virtio_console_backend *be,
+			struct virtio_vq_info *vq)
+{
+	struct mevent *evp = virtio_console_rx_event(be);
+
+	if (evp)
+		mevent_disable(evp);
+	be->rx_blocked = true;
+	vq->used->flags &= ~VRING_USED_F_NO_NOTIFY;
+	vq_endchains(vq, 1);
+}
+
 static void
 virtio_console_notify_rx(void *vdev, struct virtio_vq_info *vq)
 {
 	struct virtio_console *console;
 	struct virtio_console_port *port;
+	struct virtio_console_backend *be;
 
 	console = vdev;
 	port = virtio_console_vq_to_port(console, vq);
@@ -421,6 +465,18 @@ virtio_console_notify_rx(void *vdev, struct virtio_vq_info *vq)
 		if (vq_has_descs(vq)) {
 			vq->used->flags |= VRING_USED_F_NO_NOTIFY;
 		}
+		return;
+	}
+
+	/* guest refilled the ring after the backend was throttled */
+	be = (port->cb == virtio_console_backend_write) ? port->arg : NULL;
+	if (be && be->rx_blocked && vq_has_descs(vq)) {
+		struct mevent *evp = virtio_console_rx_event(be);
+
+		if (evp)
+			mevent_enable(evp);
+		be->rx_blocked = false;
+		vq->used->flags |= VRING_USED_F_NO_NOTIFY;
 	}
 }
 
@@ -459,7 +515,7 @@ virtio_console_backend_read(int fd __attribute__((unused)),
 	struct virtio_console_port *port;
 	struct virtio_console_backend *be = arg;
 	struct virtio_vq_info *vq;
-	struct iovec iov;
+	struct iovec iov[VIRTIO_CONSOLE_RINGSZ];
 	static char dummybuf[2048];
 	int len, n;
 	uint16_t idx;
@@ -475,20 +531,17 @@ virtio_console_backend_read(int fd __attribute__((unused)),
 	}
 
 	if (!vq_has_descs(vq)) {
-		len = read(be->fd, dummybuf, sizeof(dummybuf));
-		vq_endchains(vq, 1);
-		if (len == 0)
-			goto close;
+		virtio_console_rx_block(be, vq);
 		return;
 	}
 
 	do {
-		n = vq_getchain(vq, &idx, &iov, 1, NULL);
+		n = vq_getchain(vq, &idx, iov, VIRTIO_CONSOLE_RINGSZ, NULL);
 		if (n < 1){
 			pr_err("%s: fail to getchain!\n", __func__);
 			break;
 		}
-		len = readv(be->fd, &iov, n);
+		len = readv(be->fd, iov, n);
 		if (len <= 0) {
 			vq_retchain(vq);
 			vq_endchains(vq, 0);
@@ -528,6 +581,63 @@ clear:
 	}
 }
 
+/*
+ * Direct-to-file log sink: once the live file grows past the limit it is
+ * renamed through numbered suffixes (path.1 the newest) and reopened, so
+ * the fast path stays one gathered writev plus a size check per chain.
+ */
+static void
+virtio_console_log_rotate(struct virtio_console_backend *be)
+{
+	char from[PATH_MAX], to[PATH_MAX];
+	int i;
+
+	close(be->fd);
+	for (i = be->log_keep - 1; i > 0; i--) {
+		snprintf(from, sizeof(from), "%s.%d", be->portpath, i);
+		snprintf(to, sizeof(to), "%s.%d", be->portpath, i + 1);
+		rename(from, to);
+	}
+	snprintf(to, sizeof(to), "%s.1", be->portpath);
+	rename(be->portpath, to);
+
+	be->fd = open(be->portpath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	be->log_size = 0UL;
+	if (be->fd < 0)
+		WPRINTF(("vtcon: log reopen failed: %s\n", be->portpath));
+}
+
+static void
+virtio_console_log_write(struct virtio_console_backend *be,
+			 struct iovec *iov, int niov)
+{
+	ssize_t ret;
+
+	while (niov > 0) {
+		ret = writev(be->fd, iov, niov);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			WPRINTF(("vtcon: log write failed! errno = %d\n",
+				errno));
+			return;
+		}
+		be->log_size += ret;
+		while (niov > 0 && ret >= (ssize_t)iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	if (be->log_size >= be->log_limit)
+		virtio_console_log_rotate(be);
+}
+
 static void
 virtio_console_backend_write(struct virtio_console_port *port, void *arg,
 			     struct iovec *iov, int niov)
@@ -540,7 +650,26 @@ virtio_console_backend_write(struct virtio_console_port *port, void *arg,
 	if (be->fd == -1)
 		return;
 
+	if (be->be_type == VIRTIO_CONSOLE_BE_LOG) {
+		virtio_console_log_write(be, iov, niov);
+		return;
+	}
+
 	ret = writev(be->fd, iov, niov);
+	while (ret > 0) {
+		/* short writes happen when a gathered chain overruns the
+		 * pty/socket buffer; push the remainder before returning */
+		while (niov > 0 && ret >= (int)iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov == 0)
+			return;
+		iov->iov_base = (uint8_t *)iov->iov_base + ret;
+		iov->iov_len -= ret;
+		ret = writev(be->fd, iov, niov);
+	}
 	if (ret <= 0) {
 		/* Case 1:backend cannot receive more data. For example when pts is
 		 * not connected to any client, its tty buffer will become full.
@@ -583,7 +712,8 @@ virtio_console_restore_stdio(void)
 static bool
 virtio_console_backend_can_read(enum virtio_console_be_type be_type)
 {
-	return (be_type == VIRTIO_CONSOLE_BE_FILE) ? false : true;
+	return (be_type == VIRTIO_CONSOLE_BE_FILE ||
+		be_type == VIRTIO_CONSOLE_BE_LOG) ? false : true;
 }
 
 static int
@@ -628,6 +758,13 @@ virtio_console_open_backend(const char *path,
 		if (fd < 0)
 			WPRINTF(("vtcon: open failed: %s\n", path));
 		break;
+	case VIRTIO_CONSOLE_BE_LOG:
+		/* regular file sink, no pts in between; blocking writes are
+		 * fine here since page cache absorbs them */
+		fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0644);
+		if (fd < 0)
+			WPRINTF(("vtcon: open failed: %s\n", path));
+		break;
 	case VIRTIO_CONSOLE_BE_SOCKET:
 		fd = socket(AF_UNIX, SOCK_STREAM, 0);
 		if (fd < 0)
@@ -798,7 +935,15 @@ virtio_console_config_backend(struct virtio_console_backend *be)
 			WPRINTF(("Socket type not exist\n"));
 			return -1;
 		}
+		break;
+	case VIRTIO_CONSOLE_BE_LOG: {
+		struct stat st;
 
+		/* resume accounting against an existing log file */
+		if (fstat(fd, &st) == 0)
+			be->log_size = (uint64_t)st.st_size;
+		break;
+	}
 	default:
 		break; /* nothing to do */
 	}
@@ -828,6 +973,8 @@ virtio_console_add_backend(struct virtio_console *console, char *opt)
 	char *portname = NULL;
 	char *portpath = NULL;
 	char *socket_type = NULL;
+	char *log_limit = NULL;
+	char *log_keep = NULL;
 	enum virtio_console_be_type be_type = VIRTIO_CONSOLE_BE_INVALID;
 
 	backend = strsep(&opt, ":");
@@ -856,6 +1003,11 @@ virtio_console_add_backend(struct virtio_console *console, char *opt)
 			portname = strsep(&opt, "=");
 			portpath = strsep(&opt, ":");
 			socket_type = opt;
+		} else if (be_type == VIRTIO_CONSOLE_BE_LOG) {
+			portname = strsep(&opt, "=");
+			portpath = strsep(&opt, ":");
+			log_limit = strsep(&opt, ":");
+			log_keep = opt;
 		} else {
 			portname = strsep(&opt, "=");
 			portpath = opt;
@@ -898,6 +1050,17 @@ virtio_console_add_backend(struct virtio_console *console, char *opt)
 	be->portpath = portpath;
 	be->socket_type = socket_type;
 
+	if (be_type == VIRTIO_CONSOLE_BE_LOG) {
+		unsigned long val;
+
+		be->log_limit = VIRTIO_CONSOLE_LOG_LIMIT_DEFAULT;
+		be->log_keep = VIRTIO_CONSOLE_LOG_KEEP_DEFAULT;
+		if (log_limit != NULL && dm_strtoul(log_limit, NULL, 10, &val) == 0 && val > 0)
+			be->log_limit = val << 20;
+		if (log_keep != NULL && dm_strtoul(log_keep, NULL, 10, &val) == 0 && val > 0)
+			be->log_keep = val;
+	}
+
 	if (virtio_console_config_backend(be) < 0) {
 		WPRINTF(("vtcon: virtio_console_config_backend failed\n"));
 		error = -1;
@@ -969,6 +1132,7 @@ virtio_console_add_backends(struct virtio_console *console, char *opts)
 
 	/* virtio-console,[@]stdio|tty|pty|file:portname[=portpath]
 	 * [,[@]stdio|tty|pty|file:portname[=portpath][:socket_type]]
+	 * [,log:portname=portpath[:limit_mb[:keep]]]
 	 */
 	while ((opt = strsep(&opts, ",")) != NULL) {
 		if (virtio_console_add_backend(console, opt))
@@ -0,0 +1,1147 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * virtio filesystem (virtio-fs) device model.
+ *
+ * Exports a host directory read-only to the guest through the FUSE
+ * protocol carried over virtqueues, so that several guests can share one
+ * rootfs image without each keeping a private copy in its page cache.
+ * With the optional DAX window, file extents are mmap()ed from the host
+ * page cache and mapped into a guest-visible shared memory region with
+ * the memseg EPT hypercalls, so guest reads hit the shared host pages
+ * directly - no request round trip, no data copy, and one physical copy
+ * of the content no matter how many guests map it.
+ *
+ * Usage:
+ *   -s <slot>,virtio-fs,tag=<tag>,path=<dir>[,dax=<size>]
+ *
+ * The backend is deliberately read-only: all mutating FUSE opcodes are
+ * answered with EROFS, and DAX mappings are established read-only so a
+ * misbehaving guest cannot scribble on pages other guests share.
+ * Requests are served synchronously in the notify context; the intended
+ * workload (DAX reads) does not go through the request queue at all.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/fuse.h>
+#include <linux/virtio_fs.h>
+
+#include "dm.h"
+#include "dm_string.h"
+#include "macros.h"
+#include "pci_core.h"
+#include "virtio.h"
+#include "vmmapi.h"
+
+#define VIRTIO_FS_RINGSZ	128
+#define VIRTIO_FS_MAXSEGS	64
+
+/* queue 0 is hiprio, queue 1 the (single) request queue */
+#define VIRTIO_FS_NVQ		2
+
+#define VIRTIO_FS_S_HOSTCAPS	(1UL << VIRTIO_F_VERSION_1)
+
+/* 64-bit DAX window BAR; 1 is MSI-X, 4+5 the modern MMIO BAR */
+#define VIRTIO_FS_DAX_BAR	2
+
+/* DAX mappings are established in host-page-sized units */
+#define VIRTIO_FS_MAP_ALIGN	4096UL
+
+#define VIRTIO_FS_MAX_INODES	(64 * 1024)
+#define VIRTIO_FS_MAX_OPEN	1024
+#define VIRTIO_FS_MAX_WRITE	(128 * 1024)
+
+/* modest timeout: the export is read-only but not guaranteed immutable */
+#define VIRTIO_FS_ENTRY_TIMEOUT	1U
+
+static int virtio_fs_debug;
+#define DPRINTF(params) do { if (virtio_fs_debug) pr_dbg params; } while (0)
+#define WPRINTF(params) (pr_err params)
+
+/*
+ * One host inode the guest holds a reference on. The O_PATH fd pins the
+ * identity; (dev, ino) dedupes hard links to the same inode.
+ */
+struct vfs_inode {
+	int fd;			/* O_PATH fd, -1 when the slot is free */
+	uint64_t nlookup;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct vfs_dax_map {
+	uint64_t moffset;
+	uint64_t len;
+	void *hva;
+	struct vfs_dax_map *next;
+};
+
+struct virtio_fs {
+	struct virtio_base base;
+	struct virtio_vq_info queues[VIRTIO_FS_NVQ];
+	pthread_mutex_t mtx;
+	struct vmctx *ctx;
+	struct virtio_fs_config config;
+
+	char *shared_dir;
+	struct vfs_inode *inodes;	/* nodeid = index + FUSE_ROOT_ID */
+	uint32_t ninodes;
+
+	/* guest file handles index these tables, never raw host fds */
+	int open_fds[VIRTIO_FS_MAX_OPEN];
+	DIR *open_dirs[VIRTIO_FS_MAX_OPEN];
+
+	uint64_t dax_size;
+	struct vfs_dax_map *dax_maps;
+
+	bool initialized;	/* FUSE_INIT seen */
+};
+
+/*
+ * Cursor over one side (readable or writable) of a descriptor chain, so
+ * request parsing and reply building need not care how the guest split
+ * its buffers.
+ */
+struct vfs_iovcur {
+	struct iovec *iov;
+	int niov;
+	size_t off;
+};
+
+static size_t
+vfs_cur_left(const struct vfs_iovcur *cur)
+{
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < cur->niov; i++)
+		total += cur->iov[i].iov_len;
+	return (total > cur->off) ? (total - cur->off) : 0;
+}
+
+static size_t
+vfs_cur_pull(struct vfs_iovcur *cur, void *buf, size_t len)
+{
+	size_t done = 0, skip = cur->off;
+	int i;
+
+	for (i = 0; (i < cur->niov) && (done < len); i++) {
+		size_t n = cur->iov[i].iov_len;
+		char *p = cur->iov[i].iov_base;
+
+		if (skip >= n) {
+			skip -= n;
+			continue;
+		}
+		n -= skip;
+		if (n > (len - done))
+			n = len - done;
+		memcpy((char *)buf + done, p + skip, n);
+		done += n;
+		skip = 0;
+	}
+	cur->off += done;
+	return done;
+}
+
+static size_t
+vfs_cur_push(struct vfs_iovcur *cur, const void *buf, size_t len)
+{
+	size_t done = 0, skip = cur->off;
+	int i;
+
+	for (i = 0; (i < cur->niov) && (done < len); i++) {
+		size_t n = cur->iov[i].iov_len;
+		char *p = cur->iov[i].iov_base;
+
+		if (skip >= n) {
+			skip -= n;
+			continue;
+		}
+		n -= skip;
+		if (n > (len - done))
+			n = len - done;
+		memcpy(p + skip, (const char *)buf + done, n);
+		done += n;
+		skip = 0;
+	}
+	cur->off += done;
+	return done;
+}
+
+/* pread() straight into the writable chain, at most len bytes */
+static ssize_t
+vfs_cur_pread(struct vfs_iovcur *cur, int fd, size_t len, uint64_t foffset)
+{
+	struct iovec riov[VIRTIO_FS_MAXSEGS];
+	size_t skip = cur->off, budget = len;
+	ssize_t done;
+	int i, nriov = 0;
+
+	for (i = 0; (i < cur->niov) && (budget > 0); i++) {
+		size_t n = cur->iov[i].iov_len;
+		char *p = cur->iov[i].iov_base;
+
+		if (skip >= n) {
+			skip -= n;
+			continue;
+		}
+		n -= skip;
+		if (n > budget)
+			n = budget;
+		riov[nriov].iov_base = p + skip;
+		riov[nriov].iov_len = n;
+		nriov++;
+		budget -= n;
+		skip = 0;
+	}
+
+	done = preadv(fd, riov, nriov, foffset);
+	if (done > 0)
+		cur->off += done;
+	return done;
+}
+
+/*
+ * Inode table. Slot 0 is the export root (FUSE_ROOT_ID); lookups return
+ * existing slots for already known (dev, ino) pairs so nlookup counting
+ * matches what the guest kernel believes.
+ */
+static struct vfs_inode *
+vfs_inode_get(struct virtio_fs *fs, uint64_t nodeid)
+{
+	uint32_t idx;
+
+	if (nodeid < FUSE_ROOT_ID)
+		return NULL;
+	idx = (uint32_t)(nodeid - FUSE_ROOT_ID);
+	if ((idx >= fs->ninodes) || (fs->inodes[idx].fd < 0))
+		return NULL;
+	return &fs->inodes[idx];
+}
+
+static int64_t
+vfs_inode_acquire(struct virtio_fs *fs, int fd, const struct stat *st)
+{
+	uint32_t i, free_slot = fs->ninodes;
+
+	for (i = 0; i < fs->ninodes; i++) {
+		struct vfs_inode *ino = &fs->inodes[i];
+
+		if (ino->fd < 0) {
+			if (free_slot == fs->ninodes)
+				free_slot = i;
+			continue;
+		}
+		if ((ino->dev == st->st_dev) && (ino->ino == st->st_ino)) {
+			ino->nlookup++;
+			close(fd);
+			return (int64_t)i + FUSE_ROOT_ID;
+		}
+	}
+
+	if (free_slot == fs->ninodes) {
+		struct vfs_inode *grown;
+		uint32_t newsz = (fs->ninodes == 0) ? 64 : (fs->ninodes * 2);
+
+		if (newsz > VIRTIO_FS_MAX_INODES)
+			return -ENFILE;
+		grown = realloc(fs->inodes, newsz * sizeof(*grown));
+		if (grown == NULL)
+			return -ENOMEM;
+		for (i = fs->ninodes; i < newsz; i++)
+			grown[i].fd = -1;
+		fs->inodes = grown;
+		fs->ninodes = newsz;
+	}
+
+	fs->inodes[free_slot].fd = fd;
+	fs->inodes[free_slot].nlookup = 1;
+	fs->inodes[free_slot].dev = st->st_dev;
+	fs->inodes[free_slot].ino = st->st_ino;
+	return (int64_t)free_slot + FUSE_ROOT_ID;
+}
+
+static void
+vfs_inode_forget(struct virtio_fs *fs, uint64_t nodeid, uint64_t nlookup)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+
+	if ((ino == NULL) || (nodeid == FUSE_ROOT_ID))
+		return;
+	ino->nlookup = (ino->nlookup > nlookup) ? (ino->nlookup - nlookup) : 0;
+	if (ino->nlookup == 0) {
+		close(ino->fd);
+		ino->fd = -1;
+	}
+}
+
+/* reopen an O_PATH fd with real access modes */
+static int
+vfs_reopen(int fd, int flags)
+{
+	char procpath[64];
+
+	snprintf(procpath, sizeof(procpath), "/proc/self/fd/%d", fd);
+	return open(procpath, flags);
+}
+
+static void
+vfs_stat_to_attr(const struct stat *st, struct fuse_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = st->st_ino;
+	attr->size = st->st_size;
+	attr->blocks = st->st_blocks;
+	attr->atime = st->st_atim.tv_sec;
+	attr->mtime = st->st_mtim.tv_sec;
+	attr->ctime = st->st_ctim.tv_sec;
+	attr->atimensec = st->st_atim.tv_nsec;
+	attr->mtimensec = st->st_mtim.tv_nsec;
+	attr->ctimensec = st->st_ctim.tv_nsec;
+	attr->mode = st->st_mode;
+	attr->nlink = st->st_nlink;
+	attr->uid = st->st_uid;
+	attr->gid = st->st_gid;
+	attr->rdev = st->st_rdev;
+	attr->blksize = st->st_blksize;
+}
+
+/*
+ * Opcode handlers. Each returns the number of reply bytes pushed past
+ * the fuse_out_header on success, or -errno.
+ */
+static int
+vfs_op_init(struct virtio_fs *fs, struct vfs_iovcur *in, struct vfs_iovcur *out)
+{
+	struct fuse_init_in ii;
+	struct fuse_init_out io;
+
+	if (vfs_cur_pull(in, &ii, sizeof(ii)) < sizeof(ii))
+		return -EINVAL;
+	if (ii.major != FUSE_KERNEL_VERSION)
+		return -EPROTO;
+
+	memset(&io, 0, sizeof(io));
+	io.major = FUSE_KERNEL_VERSION;
+	io.minor = FUSE_KERNEL_MINOR_VERSION;
+	io.max_readahead = ii.max_readahead;
+	io.max_write = VIRTIO_FS_MAX_WRITE;
+	io.time_gran = 1;
+	/* DAX requires the guest to honor our map alignment */
+	io.flags = ii.flags & FUSE_MAP_ALIGNMENT;
+	io.map_alignment = 12;	/* log2(PAGE_SIZE) */
+
+	fs->initialized = true;
+	vfs_cur_push(out, &io, sizeof(io));
+	return sizeof(io);
+}
+
+static int
+vfs_op_lookup(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *in,
+	      struct vfs_iovcur *out)
+{
+	struct vfs_inode *parent = vfs_inode_get(fs, nodeid);
+	struct fuse_entry_out eo;
+	char name[NAME_MAX + 1];
+	struct stat st;
+	size_t namelen;
+	int64_t id;
+	int fd;
+
+	if (parent == NULL)
+		return -ENOENT;
+	namelen = vfs_cur_left(in);
+	if ((namelen == 0) || (namelen > NAME_MAX))
+		return -ENAMETOOLONG;
+	vfs_cur_pull(in, name, namelen);
+	name[namelen] = '\0';	/* guest sends it NUL terminated already */
+	if ((strchr(name, '/') != NULL) || (strcmp(name, "..") == 0))
+		return -EACCES;
+
+	fd = openat(parent->fd, name, O_PATH | O_NOFOLLOW);
+	if (fd < 0)
+		return -errno;
+	if (fstatat(fd, "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) < 0) {
+		int err = -errno;
+
+		close(fd);
+		return err;
+	}
+
+	id = vfs_inode_acquire(fs, fd, &st);
+	if (id < 0) {
+		close(fd);
+		return (int)id;
+	}
+
+	memset(&eo, 0, sizeof(eo));
+	eo.nodeid = (uint64_t)id;
+	eo.entry_valid = VIRTIO_FS_ENTRY_TIMEOUT;
+	eo.attr_valid = VIRTIO_FS_ENTRY_TIMEOUT;
+	vfs_stat_to_attr(&st, &eo.attr);
+	vfs_cur_push(out, &eo, sizeof(eo));
+	return sizeof(eo);
+}
+
+static int
+vfs_op_getattr(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *out)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+	struct fuse_attr_out ao;
+	struct stat st;
+
+	if (ino == NULL)
+		return -ENOENT;
+	if (fstatat(ino->fd, "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	memset(&ao, 0, sizeof(ao));
+	ao.attr_valid = VIRTIO_FS_ENTRY_TIMEOUT;
+	vfs_stat_to_attr(&st, &ao.attr);
+	vfs_cur_push(out, &ao, sizeof(ao));
+	return sizeof(ao);
+}
+
+static int
+vfs_op_readlink(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *out)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+	char target[PATH_MAX];
+	ssize_t n;
+
+	if (ino == NULL)
+		return -ENOENT;
+	n = readlinkat(ino->fd, "", target, sizeof(target));
+	if (n < 0)
+		return -errno;
+	vfs_cur_push(out, target, n);
+	return (int)n;
+}
+
+static int
+vfs_fh_alloc(struct virtio_fs *fs, int fd, DIR *dp, uint64_t *fh)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_FS_MAX_OPEN; i++) {
+		if ((fs->open_fds[i] < 0) && (fs->open_dirs[i] == NULL)) {
+			fs->open_fds[i] = fd;
+			fs->open_dirs[i] = dp;
+			*fh = (uint64_t)i;
+			return 0;
+		}
+	}
+	return -ENFILE;
+}
+
+static int
+vfs_op_open(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *in,
+	    struct vfs_iovcur *out)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+	struct fuse_open_in oi;
+	struct fuse_open_out oo;
+	int fd, err;
+
+	if (ino == NULL)
+		return -ENOENT;
+	if (vfs_cur_pull(in, &oi, sizeof(oi)) < sizeof(oi))
+		return -EINVAL;
+	if ((oi.flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+
+	fd = vfs_reopen(ino->fd, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	memset(&oo, 0, sizeof(oo));
+	err = vfs_fh_alloc(fs, fd, NULL, &oo.fh);
+	if (err < 0) {
+		close(fd);
+		return err;
+	}
+	oo.open_flags = FOPEN_KEEP_CACHE;
+	vfs_cur_push(out, &oo, sizeof(oo));
+	return sizeof(oo);
+}
+
+static int
+vfs_op_read(struct virtio_fs *fs, struct vfs_iovcur *in, struct vfs_iovcur *out)
+{
+	struct fuse_read_in ri;
+	ssize_t n;
+
+	if (vfs_cur_pull(in, &ri, sizeof(ri)) < sizeof(ri))
+		return -EINVAL;
+	if ((ri.fh >= VIRTIO_FS_MAX_OPEN) || (fs->open_fds[ri.fh] < 0))
+		return -EBADF;
+	if (ri.size > vfs_cur_left(out))
+		ri.size = vfs_cur_left(out);
+
+	n = vfs_cur_pread(out, fs->open_fds[ri.fh], ri.size, ri.offset);
+	if (n < 0)
+		return -errno;
+	return (int)n;
+}
+
+static int
+vfs_op_release(struct virtio_fs *fs, struct vfs_iovcur *in)
+{
+	struct fuse_release_in rl;
+
+	if (vfs_cur_pull(in, &rl, sizeof(rl)) < sizeof(rl))
+		return -EINVAL;
+	if ((rl.fh >= VIRTIO_FS_MAX_OPEN) || (fs->open_fds[rl.fh] < 0))
+		return -EBADF;
+	close(fs->open_fds[rl.fh]);
+	fs->open_fds[rl.fh] = -1;
+	return 0;
+}
+
+static int
+vfs_op_opendir(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *out)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+	struct fuse_open_out oo;
+	DIR *dp;
+	int fd, err;
+
+	if (ino == NULL)
+		return -ENOENT;
+	fd = vfs_reopen(ino->fd, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -errno;
+	dp = fdopendir(fd);
+	if (dp == NULL) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	memset(&oo, 0, sizeof(oo));
+	err = vfs_fh_alloc(fs, -1, dp, &oo.fh);
+	if (err < 0) {
+		closedir(dp);
+		return err;
+	}
+	vfs_cur_push(out, &oo, sizeof(oo));
+	return sizeof(oo);
+}
+
+static int
+vfs_op_readdir(struct virtio_fs *fs, struct vfs_iovcur *in, struct vfs_iovcur *out)
+{
+	struct fuse_read_in ri;
+	struct dirent *de;
+	DIR *dp;
+	size_t pushed = 0;
+
+	if (vfs_cur_pull(in, &ri, sizeof(ri)) < sizeof(ri))
+		return -EINVAL;
+	if ((ri.fh >= VIRTIO_FS_MAX_OPEN) || (fs->open_dirs[ri.fh] == NULL))
+		return -EBADF;
+	dp = fs->open_dirs[ri.fh];
+
+	if (ri.offset == 0)
+		rewinddir(dp);
+	else
+		seekdir(dp, (long)ri.offset);
+	if (ri.size > vfs_cur_left(out))
+		ri.size = vfs_cur_left(out);
+
+	for (;;) {
+		char rec[FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + NAME_MAX + 1)];
+		struct fuse_dirent *fde = (struct fuse_dirent *)rec;
+		long before = telldir(dp);
+		size_t namelen, entlen;
+
+		de = readdir(dp);
+		if (de == NULL)
+			break;
+		namelen = strlen(de->d_name);
+		entlen = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+
+		if ((pushed + entlen) > ri.size) {
+			/* put it back for the next call */
+			seekdir(dp, before);
+			break;
+		}
+		memset(rec, 0, entlen);
+		fde->ino = de->d_ino;
+		fde->off = (uint64_t)de->d_off;
+		fde->namelen = namelen;
+		fde->type = de->d_type;
+		memcpy(fde->name, de->d_name, namelen);
+		vfs_cur_push(out, rec, entlen);
+		pushed += entlen;
+	}
+	return (int)pushed;
+}
+
+static int
+vfs_op_releasedir(struct virtio_fs *fs, struct vfs_iovcur *in)
+{
+	struct fuse_release_in rl;
+
+	if (vfs_cur_pull(in, &rl, sizeof(rl)) < sizeof(rl))
+		return -EINVAL;
+	if ((rl.fh >= VIRTIO_FS_MAX_OPEN) || (fs->open_dirs[rl.fh] == NULL))
+		return -EBADF;
+	closedir(fs->open_dirs[rl.fh]);
+	fs->open_dirs[rl.fh] = NULL;
+	return 0;
+}
+
+static int
+vfs_op_statfs(struct virtio_fs *fs, uint64_t nodeid, struct vfs_iovcur *out)
+{
+	struct vfs_inode *ino = vfs_inode_get(fs, nodeid);
+	struct fuse_statfs_out so;
+	struct statfs stf;
+	int fd;
+
+	if (ino == NULL)
+		return -ENOENT;
+	fd = vfs_reopen(ino->fd, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (fstatfs(fd, &stf) < 0) {
+		int err = -errno;
+
+		close(fd);
+		return err;
+	}
+	close(fd);
+
+	memset(&so, 0, sizeof(so));
+	so.st.blocks = stf.f_blocks;
+	so.st.bfree = stf.f_bfree;
+	so.st.bavail = stf.f_bavail;
+	so.st.files = stf.f_files;
+	so.st.ffree = stf.f_ffree;
+	so.st.bsize = stf.f_bsize;
+	so.st.namelen = stf.f_namelen;
+	so.st.frsize = stf.f_frsize;
+	vfs_cur_push(out, &so, sizeof(so));
+	return sizeof(so);
+}
+
+static void
+vfs_dax_drop_overlap(struct virtio_fs *fs, uint64_t moffset, uint64_t len)
+{
+	struct vfs_dax_map **pp = &fs->dax_maps;
+
+	while (*pp != NULL) {
+		struct vfs_dax_map *map = *pp;
+
+		if ((map->moffset < (moffset + len)) &&
+				(moffset < (map->moffset + map->len))) {
+			uint64_t gpa = fs->base.dev->bar[VIRTIO_FS_DAX_BAR].addr
+					+ map->moffset;
+
+			vm_unmap_memseg_vma(fs->ctx, map->len, gpa);
+			munmap(map->hva, map->len);
+			*pp = map->next;
+			free(map);
+		} else {
+			pp = &map->next;
+		}
+	}
+}
+
+static int
+vfs_op_setupmapping(struct virtio_fs *fs, struct vfs_iovcur *in)
+{
+	struct fuse_setupmapping_in sm;
+	struct vfs_dax_map *map;
+	uint64_t gpa;
+	void *hva;
+
+	if (fs->dax_size == 0)
+		return -EOPNOTSUPP;
+	if (vfs_cur_pull(in, &sm, sizeof(sm)) < sizeof(sm))
+		return -EINVAL;
+	if ((sm.flags & FUSE_SETUPMAPPING_FLAG_WRITE) != 0)
+		return -EROFS;
+	if ((sm.fh >= VIRTIO_FS_MAX_OPEN) || (fs->open_fds[sm.fh] < 0))
+		return -EBADF;
+	if ((sm.len == 0) || ((sm.moffset & (VIRTIO_FS_MAP_ALIGN - 1)) != 0) ||
+			((sm.len & (VIRTIO_FS_MAP_ALIGN - 1)) != 0) ||
+			(sm.moffset >= fs->dax_size) ||
+			(sm.len > (fs->dax_size - sm.moffset)))
+		return -EINVAL;
+
+	hva = mmap(NULL, sm.len, PROT_READ, MAP_SHARED,
+			fs->open_fds[sm.fh], sm.foffset);
+	if (hva == MAP_FAILED)
+		return -errno;
+
+	map = calloc(1, sizeof(*map));
+	if (map == NULL) {
+		munmap(hva, sm.len);
+		return -ENOMEM;
+	}
+
+	/* the guest reuses window slots without an explicit remove */
+	vfs_dax_drop_overlap(fs, sm.moffset, sm.len);
+
+	gpa = fs->base.dev->bar[VIRTIO_FS_DAX_BAR].addr + sm.moffset;
+	if (vm_map_memseg_vma(fs->ctx, sm.len, gpa, (uint64_t)hva,
+			PROT_READ) < 0) {
+		munmap(hva, sm.len);
+		free(map);
+		return -EFAULT;
+	}
+
+	map->moffset = sm.moffset;
+	map->len = sm.len;
+	map->hva = hva;
+	map->next = fs->dax_maps;
+	fs->dax_maps = map;
+	return 0;
+}
+
+static int
+vfs_op_removemapping(struct virtio_fs *fs, struct vfs_iovcur *in)
+{
+	struct fuse_removemapping_in rm;
+	struct fuse_removemapping_one one;
+	uint32_t i;
+
+	if (fs->dax_size == 0)
+		return -EOPNOTSUPP;
+	if (vfs_cur_pull(in, &rm, sizeof(rm)) < sizeof(rm))
+		return -EINVAL;
+	for (i = 0; i < rm.count; i++) {
+		if (vfs_cur_pull(in, &one, sizeof(one)) < sizeof(one))
+			return -EINVAL;
+		vfs_dax_drop_overlap(fs, one.moffset, one.len);
+	}
+	return 0;
+}
+
+static void
+vfs_op_batch_forget(struct virtio_fs *fs, struct vfs_iovcur *in)
+{
+	struct fuse_batch_forget_in bf;
+	struct fuse_forget_one one;
+	uint32_t i;
+
+	if (vfs_cur_pull(in, &bf, sizeof(bf)) < sizeof(bf))
+		return;
+	for (i = 0; i < bf.count; i++) {
+		if (vfs_cur_pull(in, &one, sizeof(one)) < sizeof(one))
+			return;
+		vfs_inode_forget(fs, one.nodeid, one.nlookup);
+	}
+}
+
+/*
+ * Parse one descriptor chain as a FUSE request and produce the reply in
+ * its writable part. Returns the number of reply bytes, 0 for opcodes
+ * that must not be answered (FORGET and friends).
+ */
+static uint32_t
+vfs_handle_request(struct virtio_fs *fs, struct iovec *iov, int n,
+		   uint16_t *flags)
+{
+	struct vfs_iovcur in, out;
+	struct fuse_in_header ih;
+	struct fuse_out_header oh;
+	struct fuse_forget_in fi;
+	int nin, ret;
+
+	for (nin = 0; nin < n; nin++) {
+		if ((flags[nin] & VRING_DESC_F_WRITE) != 0)
+			break;
+	}
+	in.iov = iov;
+	in.niov = nin;
+	in.off = 0;
+	out.iov = iov + nin;
+	out.niov = n - nin;
+	out.off = sizeof(oh);	/* reply payload goes past the header */
+
+	if (vfs_cur_pull(&in, &ih, sizeof(ih)) < sizeof(ih))
+		return 0;
+
+	/* FUSE_INIT must come first; everything else waits for it */
+	if (!fs->initialized && (ih.opcode != FUSE_INIT)) {
+		ret = -EIO;
+		goto reply;
+	}
+
+	switch (ih.opcode) {
+	case FUSE_INIT:
+		ret = vfs_op_init(fs, &in, &out);
+		break;
+	case FUSE_LOOKUP:
+		ret = vfs_op_lookup(fs, ih.nodeid, &in, &out);
+		break;
+	case FUSE_FORGET:
+		if (vfs_cur_pull(&in, &fi, sizeof(fi)) == sizeof(fi))
+			vfs_inode_forget(fs, ih.nodeid, fi.nlookup);
+		return 0;	/* no reply by protocol */
+	case FUSE_BATCH_FORGET:
+		vfs_op_batch_forget(fs, &in);
+		return 0;	/* no reply by protocol */
+	case FUSE_GETATTR:
+		ret = vfs_op_getattr(fs, ih.nodeid, &out);
+		break;
+	case FUSE_READLINK:
+		ret = vfs_op_readlink(fs, ih.nodeid, &out);
+		break;
+	case FUSE_OPEN:
+		ret = vfs_op_open(fs, ih.nodeid, &in, &out);
+		break;
+	case FUSE_READ:
+		ret = vfs_op_read(fs, &in, &out);
+		break;
+	case FUSE_RELEASE:
+		ret = vfs_op_release(fs, &in);
+		break;
+	case FUSE_OPENDIR:
+		ret = vfs_op_opendir(fs, ih.nodeid, &out);
+		break;
+	case FUSE_READDIR:
+		ret = vfs_op_readdir(fs, &in, &out);
+		break;
+	case FUSE_RELEASEDIR:
+		ret = vfs_op_releasedir(fs, &in);
+		break;
+	case FUSE_STATFS:
+		ret = vfs_op_statfs(fs, ih.nodeid, &out);
+		break;
+	case FUSE_SETUPMAPPING:
+		ret = vfs_op_setupmapping(fs, &in);
+		break;
+	case FUSE_REMOVEMAPPING:
+		ret = vfs_op_removemapping(fs, &in);
+		break;
+	case FUSE_FLUSH:
+	case FUSE_FSYNC:
+	case FUSE_FSYNCDIR:
+	case FUSE_DESTROY:
+		ret = 0;
+		break;
+	case FUSE_WRITE:
+	case FUSE_SETATTR:
+	case FUSE_MKNOD:
+	case FUSE_MKDIR:
+	case FUSE_UNLINK:
+	case FUSE_RMDIR:
+	case FUSE_SYMLINK:
+	case FUSE_RENAME:
+	case FUSE_RENAME2:
+	case FUSE_LINK:
+	case FUSE_CREATE:
+	case FUSE_SETXATTR:
+	case FUSE_FALLOCATE:
+	case FUSE_REMOVEXATTR:
+		ret = -EROFS;
+		break;
+	default:
+		DPRINTF(("virtio-fs: unsupported opcode %u\n", ih.opcode));
+		ret = -ENOSYS;
+		break;
+	}
+
+reply:
+	memset(&oh, 0, sizeof(oh));
+	oh.unique = ih.unique;
+	if (ret < 0) {
+		oh.error = ret;
+		oh.len = sizeof(oh);
+	} else {
+		oh.len = sizeof(oh) + (uint32_t)ret;
+	}
+	out.off = 0;	/* rewind to the header slot */
+	vfs_cur_push(&out, &oh, sizeof(oh));
+	return oh.len;
+}
+
+static void
+virtio_fs_notify(void *vdev, struct virtio_vq_info *vq)
+{
+	struct virtio_fs *fs = vdev;
+	struct iovec iov[VIRTIO_FS_MAXSEGS];
+	uint16_t flags[VIRTIO_FS_MAXSEGS];
+	uint16_t idx;
+	int n;
+
+	while (vq_has_descs(vq)) {
+		n = vq_getchain(vq, &idx, iov, VIRTIO_FS_MAXSEGS, flags);
+		if (n <= 0)
+			break;
+		vq_relchain(vq, idx, vfs_handle_request(fs, iov, n, flags));
+	}
+	vq_endchains(vq, 1);
+}
+
+static void
+vfs_drop_state(struct virtio_fs *fs)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_FS_MAX_OPEN; i++) {
+		if (fs->open_fds[i] >= 0) {
+			close(fs->open_fds[i]);
+			fs->open_fds[i] = -1;
+		}
+		if (fs->open_dirs[i] != NULL) {
+			closedir(fs->open_dirs[i]);
+			fs->open_dirs[i] = NULL;
+		}
+	}
+	if (fs->ninodes > 0)
+		vfs_dax_drop_overlap(fs, 0, fs->dax_size);
+	/* keep the root pinned, drop everything the guest looked up */
+	for (i = 1; i < (int)fs->ninodes; i++) {
+		if (fs->inodes[i].fd >= 0) {
+			close(fs->inodes[i].fd);
+			fs->inodes[i].fd = -1;
+		}
+	}
+	fs->initialized = false;
+}
+
+static void
+virtio_fs_reset(void *vdev)
+{
+	struct virtio_fs *fs = vdev;
+
+	DPRINTF(("virtio-fs: device reset requested\n"));
+	vfs_drop_state(fs);
+	virtio_reset_dev(&fs->base);
+}
+
+static int
+virtio_fs_cfgread(void *vdev, int offset, int size, uint32_t *retval)
+{
+	struct virtio_fs *fs = vdev;
+	void *ptr;
+
+	ptr = (uint8_t *)&fs->config + offset;
+	memcpy(retval, ptr, size);
+	return 0;
+}
+
+static struct virtio_ops virtio_fs_ops = {
+	"virtio_fs",			/* our name */
+	VIRTIO_FS_NVQ,			/* we support 2 virtqueues */
+	sizeof(struct virtio_fs_config), /* config reg size */
+	virtio_fs_reset,		/* reset */
+	NULL,				/* device-wide qnotify */
+	virtio_fs_cfgread,		/* read virtio config */
+	NULL,				/* write virtio config */
+	NULL,				/* apply negotiated features */
+	NULL,				/* called on guest set status */
+};
+
+static int
+vfs_parse_opts(struct virtio_fs *fs, char *opts)
+{
+	char *devopts, *vtopts, *opt;
+	uint64_t val;
+	int rc = 0;
+
+	if (opts == NULL) {
+		WPRINTF(("virtio-fs: tag= and path= are required\n"));
+		return -EINVAL;
+	}
+	devopts = vtopts = strdup(opts);
+	if (devopts == NULL)
+		return -ENOMEM;
+
+	while (rc == 0 && (opt = strsep(&vtopts, ",")) != NULL) {
+		if (strncmp(opt, "tag=", 4) == 0) {
+			if (strnlen(opt + 4, sizeof(fs->config.tag) + 1) >
+					sizeof(fs->config.tag)) {
+				WPRINTF(("virtio-fs: tag too long\n"));
+				rc = -EINVAL;
+			} else {
+				/* not NUL terminated by spec, NUL padded */
+				strncpy((char *)fs->config.tag, opt + 4,
+					sizeof(fs->config.tag));
+			}
+		} else if (strncmp(opt, "path=", 5) == 0) {
+			fs->shared_dir = strdup(opt + 5);
+			if (fs->shared_dir == NULL)
+				rc = -ENOMEM;
+		} else if (strncmp(opt, "dax=", 4) == 0) {
+			if (dm_strtoul(opt + 4, NULL, 10, &val) == 0) {
+				fs->dax_size = roundup2(val * MB, 2 * MB);
+			} else {
+				WPRINTF(("virtio-fs: bad dax size %s\n", opt + 4));
+				rc = -EINVAL;
+			}
+		} else {
+			WPRINTF(("virtio-fs: unknown option %s\n", opt));
+			rc = -EINVAL;
+		}
+	}
+	free(devopts);
+
+	if ((rc == 0) && ((fs->config.tag[0] == '\0') ||
+			(fs->shared_dir == NULL))) {
+		WPRINTF(("virtio-fs: tag= and path= are required\n"));
+		rc = -EINVAL;
+	}
+	return rc;
+}
+
+static int
+virtio_fs_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
+{
+	struct virtio_fs *fs;
+	pthread_mutexattr_t attr;
+	struct stat st;
+	int i, rc, rootfd = -1;
+
+	fs = calloc(1, sizeof(struct virtio_fs));
+	if (fs == NULL) {
+		WPRINTF(("virtio-fs: calloc failed\n"));
+		return -ENOMEM;
+	}
+	for (i = 0; i < VIRTIO_FS_MAX_OPEN; i++)
+		fs->open_fds[i] = -1;
+	fs->ctx = ctx;
+	fs->config.num_request_queues = VIRTIO_FS_NVQ - 1;
+
+	rc = vfs_parse_opts(fs, opts);
+	if (rc != 0)
+		goto fail;
+
+	rootfd = open(fs->shared_dir, O_PATH | O_DIRECTORY);
+	if ((rootfd < 0) || (fstat(rootfd, &st) < 0)) {
+		WPRINTF(("virtio-fs: cannot open shared dir %s\n",
+			fs->shared_dir));
+		rc = -errno;
+		goto fail;
+	}
+	if (vfs_inode_acquire(fs, rootfd, &st) != FUSE_ROOT_ID) {
+		rc = -EINVAL;
+		goto fail;
+	}
+	rootfd = -1;	/* owned by the inode table now */
+
+	rc = pthread_mutexattr_init(&attr);
+	if (rc == 0)
+		rc = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (rc == 0)
+		rc = pthread_mutex_init(&fs->mtx, &attr);
+	if (rc != 0) {
+		WPRINTF(("virtio-fs: mutex init failed with %d\n", rc));
+		rc = -rc;
+		goto fail;
+	}
+
+	virtio_linkup(&fs->base, &virtio_fs_ops, fs, dev, fs->queues,
+		BACKEND_VBSU);
+	fs->base.mtx = &fs->mtx;
+	fs->base.device_caps = VIRTIO_FS_S_HOSTCAPS;
+
+	for (i = 0; i < VIRTIO_FS_NVQ; i++) {
+		fs->queues[i].qsize = VIRTIO_FS_RINGSZ;
+		fs->queues[i].notify = virtio_fs_notify;
+	}
+
+	/* initialize config space */
+	pci_set_cfgdata16(dev, PCIR_DEVICE, VIRTIO_DEV_FS);
+	pci_set_cfgdata16(dev, PCIR_VENDOR, VIRTIO_VENDOR);
+	pci_set_cfgdata8(dev, PCIR_CLASS, PCIC_STORAGE);
+	pci_set_cfgdata16(dev, PCIR_REVID, 1);
+
+	rc = virtio_set_modern_bar(&fs->base, false);
+	if (rc != 0)
+		goto mtx_fail;
+
+	if (fs->dax_size != 0) {
+		/* the DAX window: a 64-bit BAR advertised to the guest via
+		 * the virtio shared memory capability; populated at
+		 * FUSE_SETUPMAPPING time with memseg-mapped host page cache.
+		 */
+		struct virtio_pci_cap64 shm = {
+			.cap.cap_vndr = PCIY_VENDOR,
+			.cap.cap_len = sizeof(shm),
+			.cap.cfg_type = VIRTIO_PCI_CAP_SHARED_MEMORY_CFG,
+			.cap.bar = VIRTIO_FS_DAX_BAR,
+			.cap.id = VIRTIO_FS_SHMCAP_ID_CACHE,
+			.cap.offset = 0,
+			.cap.length = (uint32_t)fs->dax_size,
+			.length_hi = (uint32_t)(fs->dax_size >> 32),
+		};
+
+		rc = pci_emul_alloc_bar(dev, VIRTIO_FS_DAX_BAR, PCIBAR_MEM64,
+			fs->dax_size);
+		if (rc != 0)
+			goto mtx_fail;
+		rc = pci_emul_add_capability(dev, (u_char *)&shm, sizeof(shm));
+		if (rc != 0)
+			goto mtx_fail;
+	}
+
+	if (virtio_interrupt_init(&fs->base, virtio_uses_msix())) {
+		rc = -1;
+		goto mtx_fail;
+	}
+	return 0;
+
+mtx_fail:
+	pthread_mutex_destroy(&fs->mtx);
+fail:
+	if (rootfd >= 0)
+		close(rootfd);
+	if ((fs->ninodes > 0) && (fs->inodes[0].fd >= 0))
+		close(fs->inodes[0].fd);
+	free(fs->inodes);
+	free(fs->shared_dir);
+	free(fs);
+	dev->arg = NULL;
+	return rc;
+}
+
+static void
+virtio_fs_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
+{
+	struct virtio_fs *fs = dev->arg;
+
+	if (fs == NULL)
+		return;
+	vfs_drop_state(fs);
+	if ((fs->ninodes > 0) && (fs->inodes[0].fd >= 0))
+		close(fs->inodes[0].fd);
+	pthread_mutex_destroy(&fs->mtx);
+	free(fs->inodes);
+	free(fs->shared_dir);
+	free(fs);
+	dev->arg = NULL;
+}
+
+struct pci_vdev_ops pci_ops_virtio_fs = {
+	.class_name	= "virtio-fs",
+	.vdev_init	= virtio_fs_init,
+	.vdev_deinit	= virtio_fs_deinit,
+	.vdev_barwrite	= virtio_pci_write,
+	.vdev_barread	= virtio_pci_read,
+};
+DEFINE_PCI_DEVTYPE(pci_ops_virtio_fs);
@@ -6,6 +6,8 @@
  */
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -23,6 +25,7 @@
 #include "pci_core.h"
 #include "mevent.h"
 #include "virtio.h"
+#include "vmmapi.h"
 #include "gpio_dm.h"
 
 /*
@@ -108,6 +111,17 @@ static int gpio_debug;
 /* Virtio GPIO virtqueue numbers*/
 #define VIRTIO_GPIO_MAXQ	3
 
+/* Line-state page shared read-only with the guest, mapped at BAR 2 */
+#define VIRTIO_GPIO_STATE_BAR	2
+#define VIRTIO_GPIO_STATE_SIZE	4096
+
+/*
+ * All line event fds and the IRQ flush eventfd are pinned to the same
+ * mevent worker, so the callbacks of one epoll scan run back to back
+ * and the flush always runs after them.
+ */
+#define VIRTIO_GPIO_IRQ_AFFINITY	0
+
 /* Virtio GPIO capabilities */
 #define VIRTIO_GPIO_F_CHIP	1
 #define VIRTIO_GPIO_S_HOSTCAPS	VIRTIO_GPIO_F_CHIP
@@ -206,6 +220,17 @@ struct virtio_gpio_irq_request {
 	uint8_t mode;
 } __attribute__((packed));
 
+/*
+ * Layout of the line-state page. The guest reads it seqlock style:
+ * retry while gen is odd or changes across the level read, then line n
+ * level is bit n of level. Input line reads are served from here
+ * without leaving the guest; only IRQ events cross the transport.
+ */
+struct virtio_gpio_state_page {
+	uint64_t	gen;	/* odd while an update is in progress */
+	uint64_t	level;	/* current level of each virtual line */
+} __attribute__((packed));
+
 
 struct gpio_line {
 	char	name[32];		/* native gpio name */
@@ -249,6 +274,8 @@ struct gpio_irq_chip {
 	uint64_t		intr_pending;	/* pending interrupts */
 	uint64_t		intr_service;	/* service interrupts */
 	uint64_t		intr_stat;	/* all interrupts count */
+	int			flush_fd;	/* batches event delivery */
+	struct mevent		*flush_mevt;
 };
 
 struct virtio_gpio {
@@ -261,6 +288,7 @@ struct virtio_gpio {
 	uint32_t		nvline;
 	struct virtio_gpio_config	config;
 	struct gpio_irq_chip		irq_chip;
+	struct virtio_gpio_state_page	*state_page;
 };
 
 static void print_gpio_info(struct virtio_gpio *gpio);
@@ -386,6 +414,26 @@ native_gpio_open_line(struct gpio_line *line, unsigned int flags,
 	return rc;
 }
 
+static void
+gpio_update_line_state(struct virtio_gpio *gpio, unsigned int pin, int value)
+{
+	struct virtio_gpio_state_page *sp = gpio->state_page;
+
+	if (!sp || value < 0 || pin >= VIRTIO_GPIO_MAX_VLINES)
+		return;
+
+	pthread_mutex_lock(&gpio->irq_chip.intr_mtx);
+	sp->gen++;
+	__sync_synchronize();
+	if (value)
+		sp->level |= (1UL << pin);
+	else
+		sp->level &= ~(1UL << pin);
+	__sync_synchronize();
+	sp->gen++;
+	pthread_mutex_unlock(&gpio->irq_chip.intr_mtx);
+}
+
 static int
 gpio_set_value(struct virtio_gpio *gpio, unsigned int offset,
 		unsigned int value)
@@ -410,6 +458,7 @@ gpio_set_value(struct virtio_gpio *gpio, unsigned int offset,
 		return -1;
 	}
 	line->value = value;
+	gpio_update_line_state(gpio, offset, value);
 	return 0;
 }
 
@@ -449,6 +498,7 @@ gpio_get_value(struct virtio_gpio *gpio, unsigned int offset)
 				strerror(errno)));
 		return -1;
 	}
+	gpio_update_line_state(gpio, offset, data.values[0]);
 	return data.values[0];
 }
 
@@ -466,9 +516,13 @@ gpio_set_direction_output(struct virtio_gpio *gpio, unsigned int offset,
 		int value)
 {
 	struct gpio_line *line;
+	int rc;
 
 	line = gpio->vlines[offset];
-	return native_gpio_open_line(line, GPIOHANDLE_REQUEST_OUTPUT, value);
+	rc = native_gpio_open_line(line, GPIOHANDLE_REQUEST_OUTPUT, value);
+	if (rc == 0)
+		gpio_update_line_state(gpio, offset, value);
+	return rc;
 }
 
 static int
@@ -938,29 +992,44 @@ gpio_irq_deliver_intr(struct virtio_gpio *gpio, uint64_t mask)
 		WPRINTF(("virtio gpio failed to send an IRQ, mask %lu", mask));
 }
 
+/*
+ * Ask the flush handler to deliver the pending mask. The eventfd shares
+ * the mevent worker with all line event fds, so when several lines
+ * change in one epoll scan, every callback has accumulated its bit into
+ * intr_pending before the flush runs and the whole scan is delivered as
+ * a single IRQ event. Called with intr_mtx held.
+ */
 static void
-gpio_irq_generate_intr(struct virtio_gpio *gpio, int pin)
+gpio_irq_arm_flush(struct gpio_irq_chip *chip)
 {
+	uint64_t cnt = 1;
+
+	if (chip->flush_fd < 0 ||
+			write(chip->flush_fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+		WPRINTF(("virtio gpio, failed to arm IRQ flush %s\n",
+				strerror(errno)));
+}
+
+static void
+gpio_irq_flush(int fd, enum ev_type t __attribute__((unused)), void *arg)
+{
+	struct virtio_gpio *gpio;
 	struct gpio_irq_chip *chip;
-	struct gpio_irq_desc *desc;
+	uint64_t cnt;
 
+	gpio = (struct virtio_gpio *) arg;
 	chip = &gpio->irq_chip;
-	desc = &chip->descs[pin];
 
-	/* Ignore interrupt until it is unmasked */
-	if (desc->mask)
+	if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt))
 		return;
 
 	pthread_mutex_lock(&chip->intr_mtx);
 
-	/* set it to pending mask */
-	chip->intr_pending |= BIT(pin);
-
 	/*
 	 * if all interrupts in service are acknowledged, then send pending
 	 * interrupts.
 	 */
-	if (!chip->intr_service) {
+	if (!chip->intr_service && chip->intr_pending) {
 		chip->intr_service = chip->intr_pending;
 		chip->intr_pending = 0;
 
@@ -970,6 +1039,30 @@ gpio_irq_generate_intr(struct virtio_gpio *gpio, int pin)
 	pthread_mutex_unlock(&chip->intr_mtx);
 }
 
+static void
+gpio_irq_generate_intr(struct virtio_gpio *gpio, int pin)
+{
+	struct gpio_irq_chip *chip;
+	struct gpio_irq_desc *desc;
+
+	chip = &gpio->irq_chip;
+	desc = &chip->descs[pin];
+
+	/* Ignore interrupt until it is unmasked */
+	if (desc->mask)
+		return;
+
+	pthread_mutex_lock(&chip->intr_mtx);
+
+	/* set it to pending mask */
+	chip->intr_pending |= BIT(pin);
+
+	/* delivery is batched in the flush handler */
+	if (!chip->intr_service)
+		gpio_irq_arm_flush(chip);
+	pthread_mutex_unlock(&chip->intr_mtx);
+}
+
 static void
 gpio_irq_set_pin_state(int fd __attribute__((unused)),
 		enum ev_type t __attribute__((unused)),
@@ -996,6 +1089,7 @@ gpio_irq_set_pin_state(int fd __attribute__((unused)),
 
 		/* pin level is high */
 		desc->level = 1;
+		gpio_update_line_state(gpio, desc->pin, 1);
 
 		/* jitter protection */
 		if ((desc->mode & IRQ_TYPE_EDGE_RISING)
@@ -1006,6 +1100,7 @@ gpio_irq_set_pin_state(int fd __attribute__((unused)),
 
 		/* pin level is low */
 		desc->level = 0;
+		gpio_update_line_state(gpio, desc->pin, 0);
 
 		/* jitter protection */
 		if ((desc->mode & IRQ_TYPE_EDGE_FALLING)
@@ -1113,9 +1208,10 @@ gpio_irq_enable(struct virtio_gpio *gpio, unsigned int pin,
 	}
 
 	desc->fd = req.fd;
-	desc->mevt = mevent_add(desc->fd, EVF_READ,
+	desc->mevt = mevent_add_affinity(desc->fd, EVF_READ,
 			gpio_irq_set_pin_state, desc,
-			gpio_irq_teardown, desc);
+			gpio_irq_teardown, desc,
+			VIRTIO_GPIO_IRQ_AFFINITY);
 	if (!desc->mevt) {
 		WPRINTF(("failed to enable IRQ pin %d, mevent add error\n",
 				pin));
@@ -1151,6 +1247,10 @@ gpio_irq_clear_intr(struct gpio_irq_chip *chip, int pin)
 {
 	pthread_mutex_lock(&chip->intr_mtx);
 	chip->intr_service &= ~BIT(pin);
+
+	/* deliver interrupts accumulated while in service */
+	if (!chip->intr_service && chip->intr_pending)
+		gpio_irq_arm_flush(chip);
 	pthread_mutex_unlock(&chip->intr_mtx);
 }
 
@@ -1262,6 +1362,12 @@ gpio_irq_deinit(struct virtio_gpio *gpio)
 
 	chip = &gpio->irq_chip;
 	pthread_mutex_destroy(&chip->intr_mtx);
+	if (chip->flush_mevt) {
+		/* the eventfd is closed by mevent */
+		mevent_delete_close(chip->flush_mevt);
+		chip->flush_mevt = NULL;
+		chip->flush_fd = -1;
+	}
 	for (i = 0; i < gpio->nvline; i++) {
 		desc = &chip->descs[i];
 		if (desc->mevt) {
@@ -1288,6 +1394,22 @@ gpio_irq_init(struct virtio_gpio *gpio)
 		WPRINTF(("IRQ pthread_mutex_init failed with error %d!\n", rc));
 		return -1;
 	}
+	chip->flush_fd = eventfd(0, EFD_NONBLOCK);
+	if (chip->flush_fd < 0) {
+		WPRINTF(("%s", "IRQ flush eventfd creation failed!\n"));
+		pthread_mutex_destroy(&chip->intr_mtx);
+		return -1;
+	}
+	chip->flush_mevt = mevent_add_affinity(chip->flush_fd, EVF_READ,
+			gpio_irq_flush, gpio, NULL, NULL,
+			VIRTIO_GPIO_IRQ_AFFINITY);
+	if (!chip->flush_mevt) {
+		WPRINTF(("%s", "IRQ flush mevent add failed!\n"));
+		close(chip->flush_fd);
+		chip->flush_fd = -1;
+		pthread_mutex_destroy(&chip->intr_mtx);
+		return -1;
+	}
 	for (i = 0; i < gpio->nvline; i++) {
 		desc = &chip->descs[i];
 		line = gpio->vlines[i];
@@ -1301,6 +1423,45 @@ gpio_irq_init(struct virtio_gpio *gpio)
 	return 0;
 }
 
+/*
+ * Back the line-state BAR with an anonymous page and map it read-only
+ * into the guest, so line level reads are served guest-side without a
+ * vm exit.
+ */
+static int
+virtio_gpio_map_state_page(struct vmctx *ctx, struct pci_vdev *dev,
+		struct virtio_gpio *gpio)
+{
+	struct virtio_gpio_state_page *page;
+	uint64_t bar_addr;
+	int i;
+
+	pci_emul_alloc_bar(dev, VIRTIO_GPIO_STATE_BAR, PCIBAR_MEM64,
+			VIRTIO_GPIO_STATE_SIZE);
+
+	page = mmap(NULL, VIRTIO_GPIO_STATE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (page == MAP_FAILED) {
+		WPRINTF(("%s", "virtio gpio, failed to mmap state page\n"));
+		return -1;
+	}
+
+	bar_addr = dev->bar[VIRTIO_GPIO_STATE_BAR].addr;
+	if (vm_map_memseg_vma(ctx, VIRTIO_GPIO_STATE_SIZE, bar_addr,
+			(uint64_t)page, PROT_READ) < 0) {
+		WPRINTF(("%s", "virtio gpio, failed to map state page\n"));
+		munmap(page, VIRTIO_GPIO_STATE_SIZE);
+		return -1;
+	}
+
+	/* populate the initial line levels */
+	for (i = 0; i < gpio->nvline; i++)
+		if (gpio->vlines[i]->value > 0)
+			page->level |= (1UL << i);
+	gpio->state_page = page;
+	return 0;
+}
+
 static int
 virtio_gpio_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 {
@@ -1395,6 +1556,12 @@ virtio_gpio_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	gpio_pio_start = dev->bar[0].addr + VIRTIO_PCI_CONFIG_OFF(1) +
 		sizeof(struct virtio_gpio_config);
 
+	/* use BAR 2 to share the line-state page with the guest */
+	if (virtio_gpio_map_state_page(ctx, dev, gpio)) {
+		rc = -1;
+		goto fail;
+	}
+
 	virtio_gpio_is_active = true;
 
 	/* dump gpio information */
@@ -1431,6 +1598,10 @@ virtio_gpio_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	if (gpio) {
 		pthread_mutex_destroy(&gpio->mtx);
 		gpio_irq_deinit(gpio);
+		if (gpio->state_page) {
+			munmap(gpio->state_page, VIRTIO_GPIO_STATE_SIZE);
+			gpio->state_page = NULL;
+		}
 		for (i = 0; i < gpio->nchip; i++)
 			native_gpio_close_chip(&gpio->chips[i]);
 		virtio_gpio_reset(gpio);
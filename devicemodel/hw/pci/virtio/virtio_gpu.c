@@ -734,7 +734,7 @@ virtio_gpu_cmd_resource_attach_backing(struct virtio_gpu_command *cmd)
 			pbuf += cmd->iov[i].iov_len;
 		}
 		for (i = 0; i < req.nr_entries; i++) {
-			r2d->iov[i].iov_base = paddr_guest2host(
+			r2d->iov[i].iov_base = vm_gpa2hva(
 					cmd->gpu->base.dev->vmctx,
 					entries[i].addr,
 					entries[i].length);
@@ -930,10 +930,31 @@ virtio_gpu_cmd_resource_flush(struct virtio_gpu_command *cmd)
 		memcpy(cmd->iov[1].iov_base, &resp, sizeof(resp));
 		return;
 	}
+
+	/* a zero-area flush means the scanout content is unchanged;
+	 * skip upload and composition entirely
+	 */
+	if ((req.r.width == 0) || (req.r.height == 0)) {
+		cmd->iolen = sizeof(resp);
+		resp.type = VIRTIO_GPU_RESP_OK_NODATA;
+		memcpy(cmd->iov[1].iov_base, &resp, sizeof(resp));
+		return;
+	}
+
+	memset(&surf, 0, sizeof(surf));
+	surf.damage_x = req.r.x;
+	surf.damage_y = req.r.y;
+	surf.damage_w = req.r.width;
+	surf.damage_h = req.r.height;
 	if (r2d->blob) {
+		/* the dma-buf is the guest backing store imported as a GPU
+		 * texture, so no pixels move here; present the new content
+		 */
 		virtio_gpu_dmabuf_ref(r2d->dma_info);
 		surf.dma_info.dmabuf_fd = r2d->dma_info->dmabuf_fd;
 		surf.surf_type = SURFACE_DMABUF;
+		surf.width = r2d->width;
+		surf.height = r2d->height;
 		vdpy_surface_update(gpu->vdpy_handle, &surf);
 		resp.type = VIRTIO_GPU_RESP_OK_NODATA;
 		memcpy(cmd->iov[1].iov_base, &resp, sizeof(resp));
@@ -1107,7 +1128,7 @@ virtio_gpu_cmd_create_blob(struct virtio_gpu_command *cmd)
 		r2d->iov = malloc(req.nr_entries * sizeof(struct iovec));
 		r2d->iovcnt = req.nr_entries;
 		for (i = 0; i < req.nr_entries; i++) {
-			r2d->iov[i].iov_base = paddr_guest2host(
+			r2d->iov[i].iov_base = vm_gpa2hva(
 					cmd->gpu->base.dev->vmctx,
 					entries[i].addr,
 					entries[i].length);
@@ -73,6 +73,9 @@ static int virtio_i2c_debug=0;
 #define I2C_MSG_ERR	1
 #define I2C_NO_DEV	2
 
+/* one pipeline slot per virtqueue entry (vq.qsize) */
+#define VIRTIO_I2C_BATCH_MAX	64
+
 static int acpi_i2c_adapter_num = 0;
 static void acpi_add_i2c_adapter(struct pci_vdev *dev, int i2c_bus);
 static void acpi_add_cam1(struct pci_vdev *dev, int i2c_bus);
@@ -99,6 +102,13 @@ struct virtio_i2c_hdr {
 	uint16_t len;       /*msg length*/
 }__attribute__((packed));
 
+/* a descriptor chain drained from the vq, pending on the native adapter */
+struct virtio_i2c_req {
+	uint16_t idx;       /* head descriptor index for vq_relchain */
+	struct i2c_msg msg;
+	uint8_t *status;
+};
+
 struct native_i2c_adapter {
 	int 		fd;
 	int 		bus;
@@ -429,6 +439,49 @@ native_adapter_proc(struct virtio_i2c *vi2c, struct i2c_msg *msg)
 	return status;
 }
 
+/*
+ * Issue a run of requests for the same client address as one I2C_RDWR
+ * combined transaction (repeated start between msgs, single stop), so a
+ * register-select write followed by a read goes on the wire back to back.
+ * If the combined transfer fails, replay the msgs one by one to recover
+ * an accurate per-msg status.
+ */
+static void
+native_adapter_proc_batch(struct virtio_i2c *vi2c, struct virtio_i2c_req *reqs, int nmsgs)
+{
+	struct i2c_msg msgs[I2C_RDRW_IOCTL_MAX_MSGS];
+	struct i2c_rdwr_ioctl_data work_queue;
+	struct native_i2c_adapter *adapter;
+	int i;
+
+	adapter = native_adapter_find(vi2c, reqs[0].msg.addr);
+	if (!adapter) {
+		for (i = 0; i < nmsgs; i++)
+			*reqs[i].status = I2C_NO_DEV;
+		return;
+	}
+
+	if (nmsgs == 1) {
+		*reqs[0].status = native_adapter_proc(vi2c, &reqs[0].msg);
+		return;
+	}
+
+	for (i = 0; i < nmsgs; i++)
+		msgs[i] = reqs[i].msg;
+	work_queue.nmsgs = nmsgs;
+	work_queue.msgs = msgs;
+
+	if (ioctl(adapter->fd, I2C_RDWR, &work_queue) < 0) {
+		for (i = 0; i < nmsgs; i++)
+			*reqs[i].status = native_adapter_proc(vi2c, &reqs[i].msg);
+	} else {
+		for (i = 0; i < nmsgs; i++)
+			*reqs[i].status = I2C_MSG_OK;
+	}
+	DPRINTF("i2c_core: combined transaction: addr=0x%x, nmsgs=%d\n",
+			reqs[0].msg.addr, nmsgs);
+}
+
 static struct native_i2c_adapter *
 native_adapter_create(int bus, uint16_t client_addr[], int n_client)
 {
@@ -511,12 +564,12 @@ virtio_i2c_proc_thread(void *arg)
 {
 	struct virtio_i2c *vi2c = arg;
 	struct virtio_vq_info *vq = &vi2c->vq;
+	struct virtio_i2c_req reqs[VIRTIO_I2C_BATCH_MAX];
+	struct virtio_i2c_req *req;
 	struct iovec iov[3];
 	uint16_t idx, flags[3];
 	struct virtio_i2c_hdr *hdr;
-	struct i2c_msg msg;
-	uint8_t *status;
-	int n;
+	int i, j, n, nreq;
 
 	for (;;) {
 		pthread_mutex_lock(&vi2c->req_mtx);
@@ -532,25 +585,45 @@ virtio_i2c_proc_thread(void *arg)
 		vi2c->in_process = 1;
 		pthread_mutex_unlock(&vi2c->req_mtx);
 		do {
-			n = vq_getchain(vq, &idx, iov, 3, flags);
-			if (n < 2 || n > 3) {
-				WPRINTF("virtio_i2c_proc: failed to get iov from virtqueue\n");
-				continue;
+			/* drain the vq into the request pipeline */
+			nreq = 0;
+			while (nreq < VIRTIO_I2C_BATCH_MAX && vq_has_descs(vq)) {
+				n = vq_getchain(vq, &idx, iov, 3, flags);
+				if (n < 2 || n > 3) {
+					WPRINTF("virtio_i2c_proc: failed to get iov from virtqueue\n");
+					continue;
+				}
+				hdr = iov[0].iov_base;
+				req = &reqs[nreq];
+				req->idx = idx;
+				req->msg.addr = hdr->addr;
+				req->msg.flags = hdr->flags;
+				if (hdr->len) {
+					req->msg.buf = iov[1].iov_base;
+					req->msg.len = iov[1].iov_len;
+					req->status = iov[2].iov_base;
+				} else {
+					req->msg.buf = NULL;
+					req->msg.len = 0;
+					req->status = iov[1].iov_base;
+				}
+				nreq++;
 			}
-			hdr = iov[0].iov_base;
-			msg.addr = hdr->addr;
-			msg.flags = hdr->flags;
-			if (hdr->len) {
-				msg.buf = iov[1].iov_base;
-				msg.len = iov[1].iov_len;
-				status = iov[2].iov_base;
-			} else {
-				msg.buf = NULL;
-				msg.len = 0;
-				status = iov[1].iov_base;
+
+			/* service runs of adjacent same-address msgs together */
+			i = 0;
+			while (i < nreq) {
+				j = i + 1;
+				while (j < nreq &&
+					(j - i) < I2C_RDRW_IOCTL_MAX_MSGS &&
+					reqs[j].msg.addr == reqs[i].msg.addr)
+					j++;
+				native_adapter_proc_batch(vi2c, &reqs[i], j - i);
+				i = j;
 			}
-			*status = native_adapter_proc(vi2c, &msg);
-			vq_relchain(vq, idx, 1);
+
+			for (i = 0; i < nreq; i++)
+				vq_relchain(vq, reqs[i].idx, 1);
 		} while (vq_has_descs(vq));
 		vq_endchains(vq, 0);
 	}
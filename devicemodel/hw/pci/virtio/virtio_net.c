@@ -51,10 +51,19 @@
 #include "virtio.h"
 #include "vhost.h"
 #include "dm_string.h"
+#include "net_fabric.h"
 
 #define VIRTIO_NET_RINGSZ	1024
 #define VIRTIO_NET_MAXSEGS	256
 
+/*
+ * With host TSO enabled the tap can deliver coalesced frames of up to
+ * 64KB which span several guest buffers when mergeable rx bufs are in
+ * use.
+ */
+#define VIRTIO_NET_MAXBUFS	64
+#define VIRTIO_NET_MAXPKTLEN	(65535 + 64)
+
 /*
  * Host capabilities.  Note that we only offer a few of these.
  */
@@ -77,10 +86,12 @@
 #define	VIRTIO_NET_F_CTRL_VLAN	(1 << 19) /* control channel VLAN filtering */
 #define	VIRTIO_NET_F_GUEST_ANNOUNCE \
 				(1 << 21) /* guest can send gratuitous pkts */
+#define	VIRTIO_NET_F_MQ		(1 << 22) /* host supports multiple queues */
 
 #define VIRTIO_NET_S_HOSTCAPS      \
 	(VIRTIO_NET_F_MAC | VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS | \
-	(1 << VIRTIO_F_NOTIFY_ON_EMPTY) | (1 << VIRTIO_RING_F_INDIRECT_DESC))
+	(1 << VIRTIO_F_NOTIFY_ON_EMPTY) | (1 << VIRTIO_RING_F_INDIRECT_DESC) | \
+	(1 << VIRTIO_RING_F_EVENT_IDX))
 
 #define VIRTIO_NET_S_VHOSTCAPS      \
 	((1 << VIRTIO_F_NOTIFY_ON_EMPTY) | (1 << VIRTIO_RING_F_INDIRECT_DESC) | \
@@ -90,22 +101,48 @@
 /* is address mcast/bcast? */
 #define ETHER_IS_MULTICAST(addr) (*(addr) & 0x01)
 
+/*
+ * vnet header fields, consumed by the software offload path when the
+ * tap cannot handle the header itself
+ */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM	0x01
+#define VIRTIO_NET_HDR_GSO_NONE		0
+#define VIRTIO_NET_HDR_GSO_TCPV4	1
+#define VIRTIO_NET_HDR_GSO_TCPV6	4
+#define VIRTIO_NET_HDR_GSO_ECN		0x80
+
 /*
  * PCI config-space "registers"
  */
 struct virtio_net_config {
 	uint8_t  mac[6];
 	uint16_t status;
+	uint16_t max_virtqueue_pairs;
 } __attribute__((packed));
 
 /*
- * Queue definitions.
+ * Queue definitions: rx/tx queue pairs first, with the control queue
+ * directly after the last data queue (virtio spec queue numbering).
  */
-#define VIRTIO_NET_RXQ	0
-#define VIRTIO_NET_TXQ	1
-#define VIRTIO_NET_CTLQ	2	/* NB: not yet supported */
+#define VIRTIO_NET_MAXQP	4
+#define VIRTIO_NET_RXQ(p)	(2 * (p))
+#define VIRTIO_NET_TXQ(p)	(2 * (p) + 1)
+
+#define VIRTIO_NET_MAXQ		(2 * VIRTIO_NET_MAXQP + 1)
+
+/*
+ * Control queue commands (only the MQ class is handled)
+ */
+#define VIRTIO_NET_CTRL_MQ		4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET	0
+
+#define VIRTIO_NET_OK	0
+#define VIRTIO_NET_ERR	1
 
-#define VIRTIO_NET_MAXQ	3
+struct virtio_net_ctrl_hdr {
+	uint8_t class;
+	uint8_t cmd;
+} __attribute__((packed));
 
 /*
  * Fixed network header size
@@ -128,50 +165,73 @@ static int virtio_net_debug;
 #define WPRINTF(params) (pr_err params)
 
 /*
- * vhost device struct
+ * vhost device struct: one instance per queue pair, each with its own
+ * /dev/vhost-net fd and tap queue
  */
 struct vhost_net {
 	struct vhost_dev vdev;
-	struct vhost_vq vqs[VIRTIO_NET_MAXQ - 1];
+	struct vhost_vq vqs[2];		/* the pair's RX and TX rings */
 	int tapfd;
 	bool vhost_started;
 };
 
+struct virtio_net;
+
+/*
+ * Per-queue-pair state: every pair owns its tap queue fd, its RX event
+ * registration and its TX processing thread.
+ */
+struct virtio_net_pair {
+	struct virtio_net *net;
+	int		idx;		/* pair number */
+	int		tapfd;
+	struct mevent	*mevp;
+
+	int		rx_ready;
+	pthread_mutex_t	rx_mtx;
+	int		rx_in_progress;
+
+	pthread_t	tx_tid;
+	pthread_mutex_t	tx_mtx;
+	pthread_cond_t	tx_cond;
+	int		tx_in_progress;
+
+	uint8_t		*txbuf;		/* linearized frame for soft offloads */
+};
+
 /*
  * Per-device struct
  */
 struct virtio_net {
 	struct virtio_base base;
-	struct virtio_vq_info queues[VIRTIO_NET_MAXQ - 1];
+	struct virtio_vq_info queues[VIRTIO_NET_MAXQ];
 	pthread_mutex_t mtx;
-	struct mevent	*mevp;
 
-	int		tapfd;
-
-	int		rx_ready;
+	struct virtio_net_pair pairs[VIRTIO_NET_MAXQP];
+	int		num_pairs;	/* queue pairs offered to the guest */
+	int		active_pairs;	/* pairs enabled by the guest */
+	int		open_pairs;	/* pairs with a live mevent */
 
 	volatile int	resetting;	/* set and checked outside lock */
-	volatile int	closing;	/* stop the tx i/o thread */
+	volatile int	closing;	/* stop the tx i/o threads */
 
 	uint64_t	features;	/* negotiated features */
 
 	struct virtio_net_config config;
 
-	pthread_mutex_t	rx_mtx;
-	int		rx_in_progress;
 	int		rx_vhdrlen;
 	int		rx_merge;	/* merged rx bufs in use */
-	pthread_t	tx_tid;
-	pthread_mutex_t	tx_mtx;
-	pthread_cond_t	tx_cond;
-	int		tx_in_progress;
+	bool		vnet_hdr;	/* tap produces/consumes vnet hdr */
 
-	void (*virtio_net_rx)(struct virtio_net *net);
-	void (*virtio_net_tx)(struct virtio_net *net, struct iovec *iov,
+	void (*virtio_net_rx)(struct virtio_net_pair *pair);
+	void (*virtio_net_tx)(struct virtio_net_pair *pair, struct iovec *iov,
 			     int iovcnt, int len);
 
-	struct vhost_net *vhost_net;
+	struct vhost_net *vhost_nets[VIRTIO_NET_MAXQP];
 	bool		use_vhost;
+
+	struct net_fabric_port *fab_port;
+	bool		use_fabric;	/* shared-memory guest-to-guest path */
 };
 
 static void virtio_net_reset(void *vdev);
@@ -191,7 +251,7 @@ static int vhost_net_stop(struct vhost_net *vhost_net);
 
 static struct virtio_ops virtio_net_ops = {
 	"vtnet",			/* our name */
-	VIRTIO_NET_MAXQ - 1,		/* we currently support 2 virtqueues */
+	VIRTIO_NET_MAXQ,		/* up to 4 queue pairs plus control */
 	sizeof(struct virtio_net_config), /* config reg size */
 	virtio_net_reset,		/* reset */
 	NULL,				/* device-wide qnotify -- not used */
@@ -265,39 +325,83 @@ ether_aton(const char *a, struct ether_addr *e)
 }
 
 /*
- * If the transmit thread is active then stall until it is done.
+ * If any transmit thread is active then stall until it is done.
  */
 static void
 virtio_net_txwait(struct virtio_net *net)
 {
-	pthread_mutex_lock(&net->tx_mtx);
-	while (net->tx_in_progress) {
-		pthread_mutex_unlock(&net->tx_mtx);
-		usleep(10000);
-		pthread_mutex_lock(&net->tx_mtx);
+	struct virtio_net_pair *pair;
+	int i;
+
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		pthread_mutex_lock(&pair->tx_mtx);
+		while (pair->tx_in_progress) {
+			pthread_mutex_unlock(&pair->tx_mtx);
+			usleep(10000);
+			pthread_mutex_lock(&pair->tx_mtx);
+		}
+		pthread_mutex_unlock(&pair->tx_mtx);
 	}
-	pthread_mutex_unlock(&net->tx_mtx);
 }
 
 /*
- * If the receive thread is active then stall until it is done.
+ * If any receive path is active then stall until it is done.
  */
 static void
 virtio_net_rxwait(struct virtio_net *net)
 {
-	pthread_mutex_lock(&net->rx_mtx);
-	while (net->rx_in_progress) {
-		pthread_mutex_unlock(&net->rx_mtx);
-		usleep(10000);
-		pthread_mutex_lock(&net->rx_mtx);
+	struct virtio_net_pair *pair;
+	int i;
+
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		pthread_mutex_lock(&pair->rx_mtx);
+		while (pair->rx_in_progress) {
+			pthread_mutex_unlock(&pair->rx_mtx);
+			usleep(10000);
+			pthread_mutex_lock(&pair->rx_mtx);
+		}
+		pthread_mutex_unlock(&pair->rx_mtx);
 	}
-	pthread_mutex_unlock(&net->rx_mtx);
+}
+
+/*
+ * Attach or detach one tap queue from the kernel's flow steering; a
+ * detached queue receives nothing and keeps its fd.
+ */
+static int
+virtio_net_tap_queue_attach(struct virtio_net_pair *pair, int attach)
+{
+	struct ifreq ifr;
+
+	if (pair->tapfd < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = attach ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE;
+	return ioctl(pair->tapfd, TUNSETQUEUE, (void *)&ifr);
+}
+
+/*
+ * Make the first "pairs" queue pairs eligible for traffic. Pair 0 is
+ * always attached; the kernel spreads flows over whatever is attached.
+ */
+static void
+virtio_net_set_active_pairs(struct virtio_net *net, int pairs)
+{
+	int i;
+
+	for (i = 1; i < net->num_pairs; i++)
+		virtio_net_tap_queue_attach(&net->pairs[i], i < pairs);
+	net->active_pairs = pairs;
 }
 
 static void
 virtio_net_reset(void *vdev)
 {
 	struct virtio_net *net = vdev;
+	int i;
 
 	DPRINTF(("vtnet: device reset requested !\n"));
 
@@ -310,7 +414,10 @@ virtio_net_reset(void *vdev)
 	virtio_net_txwait(net);
 	virtio_net_rxwait(net);
 
-	net->rx_ready = 0;
+	for (i = 0; i < net->num_pairs; i++)
+		net->pairs[i].rx_ready = 0;
+	if (net->num_pairs > 1)
+		virtio_net_set_active_pairs(net, 1);
 	net->rx_merge = 1;
 	net->rx_vhdrlen = sizeof(struct virtio_net_rxhdr);
 
@@ -322,32 +429,38 @@ virtio_net_reset(void *vdev)
 }
 
 /*
- * Send signal to tx I/O thread and wait till it exits
+ * Send signal to the tx I/O threads and wait till they exit
  */
 static void
 virtio_net_tx_stop(struct virtio_net *net)
 {
+	struct virtio_net_pair *pair;
 	void *jval;
+	int i;
 
-	pthread_mutex_lock(&net->tx_mtx);
 	net->closing = 1;
-	pthread_cond_broadcast(&net->tx_cond);
-	pthread_mutex_unlock(&net->tx_mtx);
 
-	pthread_join(net->tx_tid, &jval);
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		pthread_mutex_lock(&pair->tx_mtx);
+		pthread_cond_broadcast(&pair->tx_cond);
+		pthread_mutex_unlock(&pair->tx_mtx);
+
+		pthread_join(pair->tx_tid, &jval);
+	}
 }
 
 /*
  * Called to send a buffer chain out to the tap device
  */
 static void
-virtio_net_tap_tx(struct virtio_net *net, struct iovec *iov, int iovcnt,
+virtio_net_tap_tx(struct virtio_net_pair *pair, struct iovec *iov, int iovcnt,
 		  int len)
 {
 	static char pad[60]; /* all zero bytes */
 	ssize_t ret;
 
-	if (net->tapfd == -1)
+	if (pair->tapfd == -1)
 		return;
 
 	/*
@@ -360,10 +473,208 @@ virtio_net_tap_tx(struct virtio_net *net, struct iovec *iov, int iovcnt,
 		iov[iovcnt].iov_len = 60 - len;
 		iovcnt++;
 	}
-	ret = writev(net->tapfd, iov, iovcnt);
+	ret = writev(pair->tapfd, iov, iovcnt);
 	(void)ret; /*avoid compiler warning*/
 }
 
+/*
+ * Software TX offloads for a raw tap (no IFF_VNET_HDR): the guest still
+ * negotiates VIRTIO_NET_F_CSUM/HOST_TSO and hands over frames of up to
+ * 64KB with a partial checksum; the DM finishes the checksum and cuts
+ * TSO frames into wire-sized segments before they reach the tap.
+ */
+
+/*
+ * RFC 1071 one's complement sum over native 16-bit words: a plain
+ * reduction loop the compiler can vectorize, and the folded result is
+ * stored back in the same byte order it was summed in.
+ */
+static uint32_t
+net_cksum_add(uint32_t sum, const void *buf, size_t len)
+{
+	const uint16_t *p = (const uint16_t *)buf;
+	uint64_t acc = sum;
+	size_t i, n = len >> 1;
+
+	for (i = 0; i < n; i++)
+		acc += p[i];
+	if ((len & 1UL) != 0UL)
+		acc += ((const uint8_t *)buf)[len - 1];
+
+	while ((acc >> 32) != 0UL)
+		acc = (acc & 0xffffffffUL) + (acc >> 32);
+	return (uint32_t)acc;
+}
+
+/* fold a big-endian 16-bit value into a memory-order sum */
+static uint32_t
+net_cksum_add16be(uint32_t sum, uint16_t val)
+{
+	uint8_t be[2] = { (uint8_t)(val >> 8), (uint8_t)val };
+
+	return net_cksum_add(sum, be, 2);
+}
+
+static uint16_t
+net_cksum_fin(uint32_t sum)
+{
+	while ((sum >> 16) != 0U)
+		sum = (sum & 0xffffU) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+static uint16_t
+net_get16(const uint8_t *p)
+{
+	return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static void
+net_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)(v >> 8);
+	p[1] = (uint8_t)v;
+}
+
+static uint32_t
+net_get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+}
+
+static void
+net_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void
+virtio_net_soft_tx(struct virtio_net_pair *pair, struct iovec *iov, int iovcnt,
+		   int plen)
+{
+	struct virtio_net_rxhdr hdr;
+	struct iovec siov[3];
+	uint8_t seghdr[ETHER_HDR_LEN + 60 + 60];
+	uint8_t *buf;
+	uint32_t sum, seq;
+	uint16_t cs, id;
+	int i, off, seg, mss, hlen, l2, l4, iphl, thl, v4;
+
+	if (iov[0].iov_len < 10) {
+		WPRINTF(("vtnet: soft tx: runt vnet header\n"));
+		return;
+	}
+	memcpy(&hdr, iov[0].iov_base, 10);
+
+	/* nothing requested: keep the zero-copy writev */
+	if (hdr.vrh_gso_type == VIRTIO_NET_HDR_GSO_NONE &&
+	    (hdr.vrh_flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) == 0) {
+		pair->net->virtio_net_tx(pair, &iov[1], iovcnt - 1, plen);
+		return;
+	}
+
+	if (plen <= 0 || plen > VIRTIO_NET_MAXPKTLEN)
+		return;
+
+	if (pair->txbuf == NULL) {
+		pair->txbuf = malloc(VIRTIO_NET_MAXPKTLEN);
+		if (pair->txbuf == NULL) {
+			WPRINTF(("vtnet: soft tx buffer alloc failed\n"));
+			return;
+		}
+	}
+	buf = pair->txbuf;
+
+	/* linearize the payload; the checksum passes below then run over
+	 * lines this copy just pulled into the cache, so the frame body is
+	 * only traversed once more after the copy
+	 */
+	for (i = 1, off = 0; i < iovcnt; i++) {
+		if (off + (int)iov[i].iov_len > plen)
+			break;
+		memcpy(buf + off, iov[i].iov_base, iov[i].iov_len);
+		off += iov[i].iov_len;
+	}
+
+	if (hdr.vrh_gso_type == VIRTIO_NET_HDR_GSO_NONE) {
+		if ((int)hdr.vrh_csum_start + hdr.vrh_csum_offset + 2 <= plen) {
+			/* the checksum field seeds the pseudo-header sum */
+			cs = net_cksum_fin(net_cksum_add(0,
+					buf + hdr.vrh_csum_start,
+					plen - hdr.vrh_csum_start));
+			memcpy(buf + hdr.vrh_csum_start + hdr.vrh_csum_offset,
+					&cs, 2);
+		}
+		siov[0].iov_base = buf;
+		siov[0].iov_len = plen;
+		virtio_net_tap_tx(pair, siov, 1, plen);
+		return;
+	}
+
+	/* TCP segmentation; only untagged TSOv4/v6 frames are cut here */
+	v4 = ((hdr.vrh_gso_type & ~VIRTIO_NET_HDR_GSO_ECN) ==
+			VIRTIO_NET_HDR_GSO_TCPV4);
+	l2 = ETHER_HDR_LEN;
+	iphl = v4 ? ((buf[l2] & 0x0f) << 2) : 40;
+	l4 = l2 + iphl;
+	mss = hdr.vrh_gso_size;
+	if ((v4 && iphl < 20) || l4 + 20 > plen) {
+		WPRINTF(("vtnet: soft tx: bad TSO header\n"));
+		return;
+	}
+	thl = ((buf[l4 + 12] >> 4) & 0x0f) << 2;
+	hlen = l4 + thl;
+	if (thl < 20 || hlen >= plen || mss <= 0) {
+		WPRINTF(("vtnet: soft tx: bad TSO frame (hlen %d plen %d mss %d)\n",
+				hlen, plen, mss));
+		return;
+	}
+
+	seq = net_get32(buf + l4 + 4);
+	id = v4 ? net_get16(buf + l2 + 4) : 0;
+
+	for (off = hlen; off < plen; off += seg) {
+		seg = ((plen - off) > mss) ? mss : (plen - off);
+
+		memcpy(seghdr, buf, hlen);
+		if (v4) {
+			net_put16(seghdr + l2 + 2, (uint16_t)(iphl + thl + seg));
+			net_put16(seghdr + l2 + 4, id);
+			id++;
+			net_put16(seghdr + l2 + 10, 0);
+			cs = net_cksum_fin(net_cksum_add(0, seghdr + l2, iphl));
+			memcpy(seghdr + l2 + 10, &cs, 2);
+		} else {
+			net_put16(seghdr + l2 + 4, (uint16_t)(thl + seg));
+		}
+
+		net_put32(seghdr + l4 + 4, seq + (uint32_t)(off - hlen));
+		if (off + seg < plen)
+			seghdr[l4 + 13] &= ~(0x01 | 0x08);	/* FIN | PSH */
+
+		/* transport checksum: pseudo header + TCP header + payload */
+		net_put16(seghdr + l4 + 16, 0);
+		sum = v4 ? net_cksum_add(0, seghdr + l2 + 12, 8) :
+			net_cksum_add(0, seghdr + l2 + 8, 32);
+		sum = net_cksum_add16be(sum, 6);	/* IPPROTO_TCP */
+		sum = net_cksum_add16be(sum, (uint16_t)(thl + seg));
+		sum = net_cksum_add(sum, seghdr + l4, thl);
+		sum = net_cksum_add(sum, buf + off, seg);
+		cs = net_cksum_fin(sum);
+		memcpy(seghdr + l4 + 16, &cs, 2);
+
+		siov[0].iov_base = seghdr;
+		siov[0].iov_len = hlen;
+		siov[1].iov_base = buf + off;
+		siov[1].iov_len = seg;
+		virtio_net_tap_tx(pair, siov, 2, hlen + seg);
+	}
+}
+
 /*
  *  Called when there is read activity on the tap file descriptor.
  * Each buffer posted by the guest is assumed to be able to contain
@@ -401,8 +712,9 @@ rx_iov_trim(struct iovec *iov, int *niov, int tlen)
 }
 
 static void
-virtio_net_tap_rx(struct virtio_net *net)
+virtio_net_tap_rx(struct virtio_net_pair *pair)
 {
+	struct virtio_net *net = pair->net;
 	struct iovec iov[VIRTIO_NET_MAXSEGS], *riov;
 	struct virtio_vq_info *vq;
 	void *vrx;
@@ -413,7 +725,7 @@ virtio_net_tap_rx(struct virtio_net *net)
 	/*
 	 * Should never be called without a valid tap fd
 	 */
-	if (net->tapfd == -1) {
+	if (pair->tapfd == -1) {
 		WPRINTF(("vtnet: tapfd == -1\n"));
 		return;
 	}
@@ -422,11 +734,11 @@ virtio_net_tap_rx(struct virtio_net *net)
 	 * But, will be called when the rx ring hasn't yet
 	 * been set up or the guest is resetting the device.
 	 */
-	if (!net->rx_ready || net->resetting) {
+	if (!pair->rx_ready || net->resetting) {
 		/*
 		 * Drop the packet and try later.
 		 */
-		ret = read(net->tapfd, dummybuf, sizeof(dummybuf));
+		ret = read(pair->tapfd, dummybuf, sizeof(dummybuf));
 		(void)ret; /*avoid compiler warning*/
 
 		return;
@@ -435,13 +747,13 @@ virtio_net_tap_rx(struct virtio_net *net)
 	/*
 	 * Check for available rx buffers
 	 */
-	vq = &net->queues[VIRTIO_NET_RXQ];
+	vq = &net->queues[VIRTIO_NET_RXQ(pair->idx)];
 	if (!vq_has_descs(vq)) {
 		/*
 		 * Drop the packet and try later.  Interrupt on
 		 * empty, if that's negotiated.
 		 */
-		ret = read(net->tapfd, dummybuf, sizeof(dummybuf));
+		ret = read(pair->tapfd, dummybuf, sizeof(dummybuf));
 		(void)ret; /*avoid compiler warning*/
 
 		vq_endchains(vq, 1);
@@ -466,7 +778,7 @@ virtio_net_tap_rx(struct virtio_net *net)
 		if (riov == NULL)
 			return;
 
-		len = readv(net->tapfd, riov, n);
+		len = readv(pair->tapfd, riov, n);
 
 		if (len < 0 && errno == EWOULDBLOCK) {
 			/*
@@ -501,16 +813,237 @@ virtio_net_tap_rx(struct virtio_net *net)
 	vq_endchains(vq, 1);
 }
 
+/*
+ * RX when the tap produces the vnet header itself (IFF_VNET_HDR): the
+ * header is written by the kernel straight into the guest buffer, and
+ * with mergeable rx bufs a coalesced TSO frame is spread over as many
+ * guest chains as it needs in a single readv.  Only the num_buffers
+ * field is filled in here.
+ */
 static void
-virtio_net_rx_callback(int fd, enum ev_type type, void *param)
+virtio_net_tap_rx_vnet(struct virtio_net_pair *pair)
+{
+	struct virtio_net *net = pair->net;
+	struct iovec iov[VIRTIO_NET_MAXSEGS];
+	struct virtio_vq_info *vq;
+	struct virtio_net_rxhdr *vrxh;
+	uint16_t idx[VIRTIO_NET_MAXBUFS];
+	uint32_t cap[VIRTIO_NET_MAXBUFS];
+	uint32_t total, left, used;
+	int nchains, niov, nbufs, n, i;
+	int len;
+	ssize_t ret;
+
+	/*
+	 * Should never be called without a valid tap fd
+	 */
+	if (pair->tapfd == -1) {
+		WPRINTF(("vtnet: tapfd == -1\n"));
+		return;
+	}
+
+	/*
+	 * But, will be called when the rx ring hasn't yet
+	 * been set up or the guest is resetting the device.
+	 */
+	if (!pair->rx_ready || net->resetting) {
+		/*
+		 * Drop the packet and try later.
+		 */
+		ret = read(pair->tapfd, dummybuf, sizeof(dummybuf));
+		(void)ret; /*avoid compiler warning*/
+
+		return;
+	}
+
+	/*
+	 * Check for available rx buffers
+	 */
+	vq = &net->queues[VIRTIO_NET_RXQ(pair->idx)];
+	if (!vq_has_descs(vq)) {
+		/*
+		 * Drop the packet and try later.  Interrupt on
+		 * empty, if that's negotiated.
+		 */
+		ret = read(pair->tapfd, dummybuf, sizeof(dummybuf));
+		(void)ret; /*avoid compiler warning*/
+
+		vq_endchains(vq, 1);
+		return;
+	}
+
+	do {
+		/*
+		 * Gather enough chains to hold the largest frame the tap
+		 * may hand us, so one readv lands the whole packet in
+		 * guest memory.  Without mergeable rx bufs a packet must
+		 * fit a single chain.
+		 */
+		nchains = 0;
+		niov = 0;
+		total = 0;
+		while (total < VIRTIO_NET_MAXPKTLEN &&
+		       nchains < VIRTIO_NET_MAXBUFS &&
+		       niov < VIRTIO_NET_MAXSEGS && vq_has_descs(vq)) {
+			n = vq_getchain(vq, &idx[nchains], &iov[niov],
+					VIRTIO_NET_MAXSEGS - niov, NULL);
+			if (n < 1 || n > VIRTIO_NET_MAXSEGS - niov) {
+				WPRINTF(("vtnet: virtio_net_tap_rx_vnet: "
+					"vq_getchain = %d\n", n));
+				while (nchains-- > 0)
+					vq_retchain(vq);
+				return;
+			}
+			cap[nchains] = 0;
+			for (i = 0; i < n; i++)
+				cap[nchains] += iov[niov + i].iov_len;
+			total += cap[nchains];
+			niov += n;
+			nchains++;
+			if (!net->rx_merge)
+				break;
+		}
+		if (nchains == 0)
+			break;
+
+		len = readv(pair->tapfd, iov, niov);
+
+		if (len < 0) {
+			/*
+			 * No more packets (or a transient tap error), but
+			 * still some avail ring entries.  Return the
+			 * unused chains and interrupt if appropriate.
+			 */
+			while (nchains-- > 0)
+				vq_retchain(vq);
+			vq_endchains(vq, 0);
+			return;
+		}
+
+		/*
+		 * Count the chains the packet actually used and expose
+		 * that in the header before any of them is released.
+		 */
+		nbufs = 0;
+		left = len;
+		while (left > 0) {
+			left -= (cap[nbufs] < left) ? cap[nbufs] : left;
+			nbufs++;
+		}
+		if (nbufs == 0)
+			nbufs = 1;
+
+		if (net->rx_merge) {
+			vrxh = iov[0].iov_base;
+			vrxh->vrh_bufs = nbufs;
+		}
+
+		left = len;
+		for (i = 0; i < nbufs; i++) {
+			used = (cap[i] < left) ? cap[i] : left;
+			vq_relchain(vq, idx[i], used);
+			left -= used;
+		}
+		/* hand back the chains the packet did not reach */
+		for (i = nbufs; i < nchains; i++)
+			vq_retchain(vq);
+	} while (vq_has_descs(vq));
+
+	/* Interrupt if needed, including for NOTIFY_ON_EMPTY. */
+	vq_endchains(vq, 1);
+}
+
+/*
+ * A peer DM delivered a frame over the shared-memory fabric; called from
+ * the netfab receiver thread.  Inject it into the first rx queue the way
+ * a tap read would.  If the guest has no buffer ready the frame is
+ * dropped, exactly as a tap overrun would be.
+ */
+static void
+virtio_net_fabric_recv(void *param, const void *frame, size_t len)
 {
 	struct virtio_net *net = param;
+	struct virtio_net_pair *pair = &net->pairs[0];
+	struct iovec iov[VIRTIO_NET_MAXSEGS], *riov;
+	struct virtio_vq_info *vq;
+	void *vrx;
+	size_t left, chunk;
+	uint16_t idx;
+	int n, i;
+
+	pthread_mutex_lock(&pair->rx_mtx);
 
-	pthread_mutex_lock(&net->rx_mtx);
-	net->rx_in_progress = 1;
-	net->virtio_net_rx(net);
-	net->rx_in_progress = 0;
-	pthread_mutex_unlock(&net->rx_mtx);
+	if (!pair->rx_ready || net->resetting) {
+		pthread_mutex_unlock(&pair->rx_mtx);
+		return;
+	}
+
+	vq = &net->queues[VIRTIO_NET_RXQ(0)];
+	if (!vq_has_descs(vq)) {
+		vq_endchains(vq, 1);
+		pthread_mutex_unlock(&pair->rx_mtx);
+		return;
+	}
+
+	n = vq_getchain(vq, &idx, iov, VIRTIO_NET_MAXSEGS, NULL);
+	if (n < 1 || n > VIRTIO_NET_MAXSEGS) {
+		WPRINTF(("vtnet: virtio_net_fabric_recv: vq_getchain = %d\n", n));
+		pthread_mutex_unlock(&pair->rx_mtx);
+		return;
+	}
+
+	vrx = iov[0].iov_base;
+	riov = rx_iov_trim(iov, &n, net->rx_vhdrlen);
+	if (riov == NULL) {
+		vq_retchain(vq);
+		pthread_mutex_unlock(&pair->rx_mtx);
+		return;
+	}
+
+	/* scatter the flat frame into the guest chain */
+	left = len;
+	for (i = 0; i < n && left > 0; i++) {
+		chunk = (riov[i].iov_len < left) ? riov[i].iov_len : left;
+		memcpy(riov[i].iov_base, (const uint8_t *)frame + (len - left),
+		       chunk);
+		left -= chunk;
+	}
+	if (left > 0) {
+		/* chain too small for the frame, drop it */
+		vq_retchain(vq);
+		vq_endchains(vq, 0);
+		pthread_mutex_unlock(&pair->rx_mtx);
+		return;
+	}
+
+	/*
+	 * Fabric frames carry no offload work, so the header is all
+	 * zeroes but for the buffer count.
+	 */
+	memset(vrx, 0, net->rx_vhdrlen);
+	if (net->rx_merge) {
+		struct virtio_net_rxhdr *vrxh;
+
+		vrxh = vrx;
+		vrxh->vrh_bufs = 1;
+	}
+
+	vq_relchain(vq, idx, len + net->rx_vhdrlen);
+	vq_endchains(vq, 1);
+
+	pthread_mutex_unlock(&pair->rx_mtx);
+}
+
+static void
+virtio_net_rx_callback(int fd, enum ev_type type, void *param)
+{
+	struct virtio_net_pair *pair = param;
+
+	pthread_mutex_lock(&pair->rx_mtx);
+	pair->rx_in_progress = 1;
+	pair->net->virtio_net_rx(pair);
+	pair->rx_in_progress = 0;
+	pthread_mutex_unlock(&pair->rx_mtx);
 
 }
 
@@ -518,20 +1051,42 @@ static void
 virtio_net_ping_rxq(void *vdev, struct virtio_vq_info *vq)
 {
 	struct virtio_net *net = vdev;
+	struct virtio_net_pair *pair = &net->pairs[vq->num >> 1];
 
 	/*
 	 * A qnotify means that the rx process can now begin
 	 */
-	if (net->rx_ready == 0) {
-		net->rx_ready = 1;
+	if (pair->rx_ready == 0) {
+		pair->rx_ready = 1;
 		if (vq->used != NULL) {
 			vq->used->flags |= VRING_USED_F_NO_NOTIFY;
 		}
 	}
 }
 
+/*
+ * True when the chain is a frame the fabric can carry: the leading
+ * descriptor holds nothing but the vnet header and that header requests
+ * no checksum or GSO work from the tap.  A raw tap always qualifies
+ * since the guest then computes full checksums itself.
+ */
+static bool
+virtio_net_fabric_eligible(struct virtio_net *net, struct iovec *iov, int n)
+{
+	uint8_t *hdr = iov[0].iov_base;
+
+	if (net->fab_port == NULL || n < 2)
+		return false;
+	if (!net->vnet_hdr)
+		/* with soft offloads the header may request checksum/GSO
+		 * work the fabric peer would not perform */
+		return (iov[0].iov_len >= 2 && hdr[0] == 0 && hdr[1] == 0);
+	return (iov[0].iov_len == (size_t)net->rx_vhdrlen &&
+		hdr[0] == 0 && hdr[1] == 0);
+}
+
 static void
-virtio_net_proctx(struct virtio_net *net, struct virtio_vq_info *vq)
+virtio_net_proctx(struct virtio_net_pair *pair, struct virtio_vq_info *vq)
 {
 	struct iovec iov[VIRTIO_NET_MAXSEGS + 1];
 	int i, n;
@@ -556,7 +1111,18 @@ virtio_net_proctx(struct virtio_net *net, struct virtio_vq_info *vq)
 	}
 
 	DPRINTF(("virtio: packet send, %d bytes, %d segs\n\r", plen, n));
-	net->virtio_net_tx(net, &iov[1], n - 1, plen);
+	if (pair->idx == 0 &&
+	    virtio_net_fabric_eligible(pair->net, iov, n) &&
+	    netfab_send(pair->net->fab_port, &iov[1], n - 1, 0, plen)) {
+		/* delivered straight to the peer guest's rx ring */
+	} else if (pair->net->vnet_hdr)
+		/* the tap consumes the leading vnet header itself */
+		pair->net->virtio_net_tx(pair, iov, n, plen);
+	else if ((pair->net->features & (VIRTIO_NET_F_CSUM |
+			VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_HOST_TSO6)) != 0)
+		virtio_net_soft_tx(pair, iov, n, plen);
+	else
+		pair->net->virtio_net_tx(pair, &iov[1], n - 1, plen);
 
 	/* chain is processed, release it and set tlen */
 	vq_relchain(vq, idx, tlen);
@@ -566,6 +1132,7 @@ static void
 virtio_net_ping_txq(void *vdev, struct virtio_vq_info *vq)
 {
 	struct virtio_net *net = vdev;
+	struct virtio_net_pair *pair = &net->pairs[vq->num >> 1];
 
 	/*
 	 * Any ring entries to process?
@@ -573,41 +1140,42 @@ virtio_net_ping_txq(void *vdev, struct virtio_vq_info *vq)
 	if (!vq_has_descs(vq))
 		return;
 
-	/* Signal the tx thread for processing */
-	pthread_mutex_lock(&net->tx_mtx);
+	/* Signal the pair's tx thread for processing */
+	pthread_mutex_lock(&pair->tx_mtx);
 	vq->used->flags |= VRING_USED_F_NO_NOTIFY;
-	if (net->tx_in_progress == 0)
-		pthread_cond_signal(&net->tx_cond);
-	pthread_mutex_unlock(&net->tx_mtx);
+	if (pair->tx_in_progress == 0)
+		pthread_cond_signal(&pair->tx_cond);
+	pthread_mutex_unlock(&pair->tx_mtx);
 }
 
 /*
- * Thread which will handle processing of TX desc
+ * Thread which will handle processing of TX desc for one queue pair
  */
 static void *
 virtio_net_tx_thread(void *param)
 {
-	struct virtio_net *net = param;
-	struct virtio_vq_info *vq = &net->queues[VIRTIO_NET_TXQ];
+	struct virtio_net_pair *pair = param;
+	struct virtio_net *net = pair->net;
+	struct virtio_vq_info *vq = &net->queues[VIRTIO_NET_TXQ(pair->idx)];
 
 	/*
 	 * Let us wait till the tx queue pointers get initialised &
 	 * first tx signaled
 	 */
-	pthread_mutex_lock(&net->tx_mtx);
+	pthread_mutex_lock(&pair->tx_mtx);
 
 	while (!net->closing && !vq_ring_ready(vq))
-		pthread_cond_wait(&net->tx_cond, &net->tx_mtx);
+		pthread_cond_wait(&pair->tx_cond, &pair->tx_mtx);
 
 	if (net->closing) {
 		WPRINTF(("vtnet tx thread closing...\n"));
-		pthread_mutex_unlock(&net->tx_mtx);
+		pthread_mutex_unlock(&pair->tx_mtx);
 		return NULL;
 	}
 
 	for (;;) {
 		/* note - tx mutex is locked here */
-		net->tx_in_progress = 0;
+		pair->tx_in_progress = 0;
 
 		/*
 		 * Checking the avail ring here serves two purposes:
@@ -621,18 +1189,18 @@ virtio_net_tx_thread(void *param)
 			if (!net->resetting && vq_has_descs(vq))
 				break;
 
-			pthread_cond_wait(&net->tx_cond, &net->tx_mtx);
+			pthread_cond_wait(&pair->tx_cond, &pair->tx_mtx);
 
 			if (net->closing) {
 				WPRINTF(("vtnet tx thread closing...\n"));
-				pthread_mutex_unlock(&net->tx_mtx);
+				pthread_mutex_unlock(&pair->tx_mtx);
 				return NULL;
 			}
 		}
 
 		vq->used->flags |= VRING_USED_F_NO_NOTIFY;
-		net->tx_in_progress = 1;
-		pthread_mutex_unlock(&net->tx_mtx);
+		pair->tx_in_progress = 1;
+		pthread_mutex_unlock(&pair->tx_mtx);
 
 		do {
 			/*
@@ -640,7 +1208,7 @@ virtio_net_tx_thread(void *param)
 			 * iovecs and sending when an end-of-packet
 			 * is found
 			 */
-			virtio_net_proctx(net, vq);
+			virtio_net_proctx(pair, vq);
 		} while (vq_has_descs(vq));
 
 		/*
@@ -648,17 +1216,50 @@ virtio_net_tx_thread(void *param)
 		 */
 		vq_endchains(vq, 1);
 
-		pthread_mutex_lock(&net->tx_mtx);
+		pthread_mutex_lock(&pair->tx_mtx);
 	}
 }
 
-#ifdef notyet
+/*
+ * Control queue: only the MQ class is recognized; the guest uses it to
+ * choose how many queue pairs take traffic.
+ */
 static void
-virtio_net_ping_ctlq(void *vdev, struct virtio_vq_info *vq)
+virtio_net_ping_ctrlq(void *vdev, struct virtio_vq_info *vq)
 {
-	DPRINTF(("vtnet: control qnotify!\n\r"));
+	struct virtio_net *net = vdev;
+	struct iovec iov[VIRTIO_NET_MAXSEGS];
+	struct virtio_net_ctrl_hdr *hdr;
+	uint16_t idx, pairs;
+	uint8_t *ack;
+	int n;
+
+	while (vq_has_descs(vq)) {
+		n = vq_getchain(vq, &idx, iov, VIRTIO_NET_MAXSEGS, NULL);
+		if (n < 2 || n > VIRTIO_NET_MAXSEGS) {
+			WPRINTF(("vtnet: virtio_net_ping_ctrlq: vq_getchain = %d\n", n));
+			return;
+		}
+
+		/* command header first, writable ack byte last */
+		ack = iov[n - 1].iov_base;
+		*ack = VIRTIO_NET_ERR;
+		if (iov[0].iov_len >= sizeof(*hdr) && iov[n - 1].iov_len >= 1) {
+			hdr = iov[0].iov_base;
+			if (hdr->class == VIRTIO_NET_CTRL_MQ &&
+			    hdr->cmd == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET &&
+			    n >= 3 && iov[1].iov_len >= sizeof(uint16_t)) {
+				pairs = *(uint16_t *)iov[1].iov_base;
+				if (pairs >= 1 && pairs <= net->num_pairs) {
+					virtio_net_set_active_pairs(net, pairs);
+					*ack = VIRTIO_NET_OK;
+				}
+			}
+		}
+		vq_relchain(vq, idx, 1);
+	}
+	vq_endchains(vq, 1);
 }
-#endif
 
 static int
 virtio_net_parsemac(char *mac_str, uint8_t *mac_addr)
@@ -738,7 +1339,7 @@ virtio_net_is_macvtap(char *devname, int *ifindex)
 }
 
 static int
-virtio_net_tap_open(char *devname)
+virtio_net_tap_open(char *devname, int multi_queue, int *vnet_hdr)
 {
 	char tbuf[IFNAMSIZ];
 	int tunfd, rc, macvtap_index;
@@ -764,6 +1365,18 @@ virtio_net_tap_open(char *devname)
 
 	memset(&ifr, 0, sizeof(ifr));
 	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	if (multi_queue)
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
+	if (*vnet_hdr) {
+		unsigned int features;
+
+		/* let the kernel produce/consume the virtio header */
+		if (ioctl(tunfd, TUNGETFEATURES, &features) == 0 &&
+		    (features & IFF_VNET_HDR))
+			ifr.ifr_flags |= IFF_VNET_HDR;
+		else
+			*vnet_hdr = 0;
+	}
 
 	if (*devname) {
 		strncpy(ifr.ifr_name, devname, IFNAMSIZ);
@@ -782,12 +1395,51 @@ virtio_net_tap_open(char *devname)
 	return tunfd;
 }
 
+static int
+virtio_net_vhost_setup(struct virtio_net *net)
+{
+	struct virtio_net_pair *pair;
+	int vhost_fd;
+	int i;
+
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		vhost_fd = open("/dev/vhost-net", O_RDWR);
+		if (vhost_fd < 0) {
+			WPRINTF(("open of vhost-net failed (%s), fallback "
+				"to userspace virtio\n", strerror(errno)));
+			break;
+		}
+		net->vhost_nets[i] = vhost_net_init(&net->base, vhost_fd,
+			pair->tapfd, VIRTIO_NET_RXQ(i));
+		if (!net->vhost_nets[i]) {
+			WPRINTF(("vhost_net_init failed for pair %d, fallback "
+				"to userspace virtio\n", i));
+			close(vhost_fd);
+			break;
+		}
+	}
+
+	if (i < net->num_pairs) {
+		/* vhost covers all queue pairs or none */
+		while (--i >= 0) {
+			vhost_net_deinit(net->vhost_nets[i]);
+			free(net->vhost_nets[i]);
+			net->vhost_nets[i] = NULL;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
 static void
 virtio_net_tap_setup(struct virtio_net *net, char *devname)
 {
 	char tbuf[IFNAMSIZ];
-	int vhost_fd = -1;
-	int rc;
+	struct virtio_net_pair *pair;
+	int want_vnet;
+	int rc, i, j;
 
 	rc = snprintf(tbuf, IFNAMSIZ, "%s", devname);
 	if (rc < 0 || rc >= IFNAMSIZ) /* give warning if error or truncation happens */
@@ -796,49 +1448,93 @@ virtio_net_tap_setup(struct virtio_net *net, char *devname)
 	net->virtio_net_rx = virtio_net_tap_rx;
 	net->virtio_net_tx = virtio_net_tap_tx;
 
-	net->tapfd = virtio_net_tap_open(tbuf);
-	if (net->tapfd == -1) {
-		WPRINTF(("open of tap device %s failed\n", tbuf));
-		return;
-	}
-	DPRINTF(("open of tap device %s success!\n", tbuf));
+	/*
+	 * Keep the vnet header on for vhost too: when the tap supplies the
+	 * header, vhost passes it straight through and the guest can be
+	 * offered the same checksum/TSO offloads as the userspace path.
+	 */
+	want_vnet = 1;
 
 	/*
-	 * Set non-blocking and register for read
-	 * notifications with the event loop
+	 * Open one tap fd per queue pair.  With IFF_MULTI_QUEUE each open
+	 * of the same interface yields an independent queue; the kernel
+	 * steers flows across the attached queues for us.
 	 */
-	int opt = 1;
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		pair->tapfd = virtio_net_tap_open(tbuf, net->num_pairs > 1,
+						  &want_vnet);
+		if (pair->tapfd == -1) {
+			if (i == 0) {
+				WPRINTF(("open of tap device %s failed\n",
+					tbuf));
+				return;
+			}
+			WPRINTF(("tap %s: only %d of %d queue pairs "
+				"available\n", tbuf, i, net->num_pairs));
+			net->num_pairs = i;
+			break;
+		}
+		DPRINTF(("open of tap device %s queue %d success!\n",
+			tbuf, i));
 
-	if (ioctl(net->tapfd, FIONBIO, &opt) < 0) {
-		WPRINTF(("tap device O_NONBLOCK failed\n"));
-		close(net->tapfd);
-		net->tapfd = -1;
+		/*
+		 * Set non-blocking; queue pairs beyond the first stay
+		 * detached until the guest enables them via the control
+		 * queue.
+		 */
+		int opt = 1;
+
+		if (ioctl(pair->tapfd, FIONBIO, &opt) < 0) {
+			WPRINTF(("tap device O_NONBLOCK failed\n"));
+			close(pair->tapfd);
+			pair->tapfd = -1;
+			if (i == 0)
+				return;
+			net->num_pairs = i;
+			break;
+		}
+		if (i > 0)
+			virtio_net_tap_queue_attach(pair, 0);
 	}
 
-	if (net->use_vhost) {
-		vhost_fd = open("/dev/vhost-net", O_RDWR);
-		if (vhost_fd < 0)
-			WPRINTF(("open of vhost-net failed\n"));
-		else {
-			net->vhost_net = vhost_net_init(&net->base, vhost_fd,
-				net->tapfd, 0);
-			if (!net->vhost_net) {
-				WPRINTF(("vhost_net_init failed, fallback "
-					"to userspace virtio\n"));
-				close(vhost_fd);
-				vhost_fd = -1;
-			}
-		}
+	net->vnet_hdr = want_vnet && net->pairs[0].tapfd >= 0;
+	if (net->vnet_hdr)
+		net->virtio_net_rx = virtio_net_tap_rx_vnet;
+
+	/*
+	 * One vhost-net instance per queue pair; if the kernel lacks
+	 * vhost-net (ENOENT) or any pair fails to set up, tear down and
+	 * fall back to the userspace datapath for all pairs.
+	 */
+	if (net->use_vhost && net->pairs[0].tapfd >= 0 &&
+	    virtio_net_vhost_setup(net) < 0) {
+		net->use_vhost = false;
+		net->base.backend_type = BACKEND_VBSU;
 	}
 
-	if (vhost_fd < 0) {
-		net->mevp = mevent_add(net->tapfd, EVF_READ,
-				       virtio_net_rx_callback, net,
-				       virtio_net_teardown, net);
-		if (net->mevp == NULL) {
-			WPRINTF(("Could not register event\n"));
-			close(net->tapfd);
-			net->tapfd = -1;
+	if (!net->use_vhost || !net->vhost_nets[0]) {
+		/* register for read notifications with the event loop */
+		for (i = 0; i < net->num_pairs; i++) {
+			pair = &net->pairs[i];
+			pair->mevp = mevent_add_affinity(pair->tapfd, EVF_READ,
+					       virtio_net_rx_callback, pair,
+					       virtio_net_teardown, pair, i);
+			if (pair->mevp == NULL) {
+				WPRINTF(("Could not register event\n"));
+				close(pair->tapfd);
+				pair->tapfd = -1;
+				if (i > 0) {
+					for (j = i + 1; j < net->num_pairs;
+					     j++) {
+						close(net->pairs[j].tapfd);
+						net->pairs[j].tapfd = -1;
+					}
+					net->num_pairs = i;
+					break;
+				}
+			} else
+				net->open_pairs++;
 		}
 	}
 }
@@ -858,9 +1554,10 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	char *tmp;
 	char *vtopts;
 	char *opt;
+	struct virtio_net_pair *pair;
 	int mac_provided;
 	pthread_mutexattr_t attr;
-	int rc;
+	int rc, i;
 
 	net = calloc(1, sizeof(struct virtio_net));
 	if (!net) {
@@ -886,7 +1583,11 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	 * Read the MAC address if specified
 	 */
 	mac_provided = 0;
-	net->vhost_net = NULL;
+	/* vhost-net is the default datapath; tap setup falls back to the
+	 * userspace path when the kernel module is absent
+	 */
+	net->use_vhost = true;
+	net->num_pairs = 1;
 	if (opts != NULL) {
 		int err;
 
@@ -902,7 +1603,13 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 		while ((opt = strsep(&vtopts, ",")) != NULL) {
 			if (strcmp("vhost", opt) == 0)
 				net->use_vhost = true;
-			else if (!strncmp(opt, "mac=", 4)) {
+			else if (strcmp("novhost", opt) == 0)
+				net->use_vhost = false;
+			else if (strcmp("fabric", opt) == 0) {
+				/* the fastpath taps the userspace tx path */
+				net->use_fabric = true;
+				net->use_vhost = false;
+			} else if (!strncmp(opt, "mac=", 4)) {
 				err = virtio_net_parsemac(opt,
 					net->config.mac);
 				if (err != 0) {
@@ -911,6 +1618,16 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 					return err;
 				}
 				mac_provided = 1;
+			} else if (!strncmp(opt, "mq=", 3)) {
+				err = dm_strtoi(opt + 3, NULL, 10,
+					&net->num_pairs);
+				if (err || net->num_pairs < 1 ||
+				    net->num_pairs > VIRTIO_NET_MAXQP) {
+					WPRINTF(("vtnet: invalid mq %s, "
+						"expect 1~%d\n", opt + 3,
+						VIRTIO_NET_MAXQP));
+					net->num_pairs = 1;
+				}
 			}
 		}
 	}
@@ -920,19 +1637,27 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	net->base.mtx = &net->mtx;
 	net->base.device_caps = VIRTIO_NET_S_HOSTCAPS;
 
-	net->queues[VIRTIO_NET_RXQ].qsize = VIRTIO_NET_RINGSZ;
-	net->queues[VIRTIO_NET_RXQ].notify = virtio_net_ping_rxq;
-	net->queues[VIRTIO_NET_TXQ].qsize = VIRTIO_NET_RINGSZ;
-	net->queues[VIRTIO_NET_TXQ].notify = virtio_net_ping_txq;
-#ifdef notyet
-	net->queues[VIRTIO_NET_CTLQ].qsize = VIRTIO_NET_RINGSZ;
-	net->queues[VIRTIO_NET_CTLQ].notify = virtio_net_ping_ctlq;
-#endif
+	for (i = 0; i < net->num_pairs; i++) {
+		net->queues[VIRTIO_NET_RXQ(i)].qsize = VIRTIO_NET_RINGSZ;
+		net->queues[VIRTIO_NET_RXQ(i)].notify = virtio_net_ping_rxq;
+		net->queues[VIRTIO_NET_TXQ(i)].qsize = VIRTIO_NET_RINGSZ;
+		net->queues[VIRTIO_NET_TXQ(i)].notify = virtio_net_ping_txq;
+	}
+	if (net->num_pairs > 1) {
+		/* control queue follows the data queue pairs */
+		net->queues[2 * net->num_pairs].qsize = VIRTIO_NET_RINGSZ;
+		net->queues[2 * net->num_pairs].notify = virtio_net_ping_ctrlq;
+	}
 
 	/*
 	 * Attempt to open the tap device
 	 */
-	net->tapfd = -1;
+	for (i = 0; i < VIRTIO_NET_MAXQP; i++) {
+		net->pairs[i].net = net;
+		net->pairs[i].idx = i;
+		net->pairs[i].tapfd = -1;
+	}
+	net->active_pairs = 1;
 
 	if (!devopts) {
 		WPRINTF(("virtio_net: invalid optional argument\n"));
@@ -989,6 +1714,14 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 	free(vtopts);
 	free(devopts);
 
+	/* with the MAC settled the device can join the switching fabric */
+	if (net->use_fabric) {
+		net->fab_port = netfab_open(net->config.mac,
+				virtio_net_fabric_recv, net);
+		if (net->fab_port == NULL)
+			WPRINTF(("vtnet: fabric unavailable, tap only\n"));
+	}
+
 	/* initialize config space */
 	pci_set_cfgdata16(dev, PCIR_DEVICE, VIRTIO_DEV_NET);
 	pci_set_cfgdata16(dev, PCIR_VENDOR, VIRTIO_VENDOR);
@@ -1000,7 +1733,31 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 		pci_set_cfgdata16(dev, PCIR_SUBVEND_0, VIRTIO_VENDOR);
 
 	/* Link is up if we managed to open tap device */
-	net->config.status = (opts == NULL || net->tapfd >= 0);
+	net->config.status = (opts == NULL || net->pairs[0].tapfd >= 0);
+
+	/*
+	 * Advertise multi-queue only once tap setup has settled on the
+	 * number of pairs actually available.
+	 */
+	net->config.max_virtqueue_pairs = net->num_pairs;
+	if (net->num_pairs > 1)
+		net->base.device_caps |= VIRTIO_NET_F_MQ |
+			VIRTIO_NET_F_CTRL_VQ;
+
+	/* checksum/TSO offloads need the tap to speak the vnet header */
+	if (net->vnet_hdr)
+		net->base.device_caps |= VIRTIO_NET_F_CSUM |
+			VIRTIO_NET_F_GUEST_CSUM |
+			VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_HOST_TSO6 |
+			VIRTIO_NET_F_GUEST_TSO4 | VIRTIO_NET_F_GUEST_TSO6;
+	else if (!net->use_vhost && net->pairs[0].tapfd >= 0)
+		/* raw tap: the DM emulates TX checksum and segmentation so
+		 * the guest still skips per-byte work and sends 64KB frames;
+		 * RX offloads stay off since the tap delivers wire frames
+		 * with complete checksums anyway
+		 */
+		net->base.device_caps |= VIRTIO_NET_F_CSUM |
+			VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_HOST_TSO6;
 
 	/* use BAR 1 to map MSI-X table and PBA, if we're using MSI-X */
 	if (virtio_interrupt_init(&net->base, virtio_uses_msix())) {
@@ -1017,22 +1774,25 @@ virtio_net_init(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 
 	net->rx_merge = 1;
 	net->rx_vhdrlen = sizeof(struct virtio_net_rxhdr);
-	net->rx_in_progress = 0;
-	pthread_mutex_init(&net->rx_mtx, NULL);
 
 	/*
-	 * Initialize tx semaphore & spawn TX processing thread.
-	 * As of now, only one thread for TX desc processing is
-	 * spawned.
+	 * Initialize per-pair rx state, tx semaphore & spawn one TX
+	 * processing thread per queue pair.
 	 */
-	net->tx_in_progress = 0;
-	pthread_mutex_init(&net->tx_mtx, NULL);
-	pthread_cond_init(&net->tx_cond, NULL);
-	pthread_create(&net->tx_tid, NULL, virtio_net_tx_thread,
-		       (void *)net);
-	snprintf(tname, sizeof(tname), "vtnet-%d:%d tx", dev->slot,
-		 dev->func);
-	pthread_setname_np(net->tx_tid, tname);
+	for (i = 0; i < net->num_pairs; i++) {
+		pair = &net->pairs[i];
+		pair->rx_in_progress = 0;
+		pthread_mutex_init(&pair->rx_mtx, NULL);
+
+		pair->tx_in_progress = 0;
+		pthread_mutex_init(&pair->tx_mtx, NULL);
+		pthread_cond_init(&pair->tx_cond, NULL);
+		pthread_create(&pair->tx_tid, NULL, virtio_net_tx_thread,
+			       (void *)pair);
+		snprintf(tname, sizeof(tname), "vtnet-%d:%d tx%d", dev->slot,
+			 dev->func, i);
+		pthread_setname_np(pair->tx_tid, tname);
+	}
 
 	return 0;
 }
@@ -1076,6 +1836,8 @@ static void
 virtio_net_neg_features(void *vdev, uint64_t negotiated_features)
 {
 	struct virtio_net *net = vdev;
+	unsigned int offload = 0;
+	int i;
 
 	net->features = negotiated_features;
 
@@ -1084,75 +1846,142 @@ virtio_net_neg_features(void *vdev, uint64_t negotiated_features)
 		/* non-merge rx header is 2 bytes shorter */
 		net->rx_vhdrlen -= 2;
 	}
+
+	if (!net->vnet_hdr)
+		return;
+
+	/*
+	 * Tell the tap which header the guest negotiated and which
+	 * offloads the guest agreed to receive.
+	 */
+	if (net->features & VIRTIO_NET_F_GUEST_CSUM) {
+		offload |= TUN_F_CSUM;
+		if (net->features & VIRTIO_NET_F_GUEST_TSO4)
+			offload |= TUN_F_TSO4;
+		if (net->features & VIRTIO_NET_F_GUEST_TSO6)
+			offload |= TUN_F_TSO6;
+	}
+	for (i = 0; i < net->num_pairs; i++) {
+		int fd = net->pairs[i].tapfd;
+
+		if (fd < 0)
+			continue;
+		if (ioctl(fd, TUNSETVNETHDRSZ, &net->rx_vhdrlen) < 0)
+			WPRINTF(("vtnet: TUNSETVNETHDRSZ failed\n"));
+		if (ioctl(fd, TUNSETOFFLOAD, offload) < 0)
+			WPRINTF(("vtnet: TUNSETOFFLOAD failed\n"));
+	}
 }
 
 static void
 virtio_net_set_status(void *vdev, uint64_t status)
 {
 	struct virtio_net *net = vdev;
-	int rc;
+	struct vhost_net *vhost_net;
+	int rc, i;
 
-	if (!net->vhost_net)
+	if (!net->vhost_nets[0])
 		return;
 
-	if (!net->vhost_net->vhost_started &&
-		(status & VIRTIO_CONFIG_S_DRIVER_OK)) {
-		if (net->mevp)
-			mevent_disable(net->mevp);
-
-		rc = vhost_net_start(net->vhost_net);
-		if (rc < 0) {
-			WPRINTF(("vhost_net_start failed\n"));
-			return;
+	for (i = 0; i < net->num_pairs; i++) {
+		vhost_net = net->vhost_nets[i];
+		if (!vhost_net)
+			continue;
+
+		if (!vhost_net->vhost_started &&
+			(status & VIRTIO_CONFIG_S_DRIVER_OK)) {
+			/* skip pairs whose rings the guest never set up */
+			if (!vq_ring_ready(&net->queues[VIRTIO_NET_RXQ(i)]))
+				continue;
+			if (net->pairs[i].mevp)
+				mevent_disable(net->pairs[i].mevp);
+
+			rc = vhost_net_start(vhost_net);
+			if (rc < 0)
+				WPRINTF(("vhost_net_start failed, pair %d\n",
+					i));
+		} else if (vhost_net->vhost_started &&
+			((status & VIRTIO_CONFIG_S_DRIVER_OK) == 0)) {
+			rc = vhost_net_stop(vhost_net);
+			if (rc < 0)
+				WPRINTF(("vhost_net_stop failed, pair %d\n",
+					i));
 		}
-	} else if (net->vhost_net->vhost_started &&
-		((status & VIRTIO_CONFIG_S_DRIVER_OK) == 0)) {
-		rc = vhost_net_stop(net->vhost_net);
-		if (rc < 0)
-			WPRINTF(("vhost_net_stop failed\n"));
 	}
 }
 
 static void
 virtio_net_teardown(void *param)
 {
+	struct virtio_net_pair *pair;
 	struct virtio_net *net;
 
-	net = (struct virtio_net *)param;
-	if (!net)
+	pair = (struct virtio_net_pair *)param;
+	if (!pair)
 		return;
+	net = pair->net;
 
-	if (net->tapfd >= 0) {
-		close(net->tapfd);
-		net->tapfd = -1;
+	if (pair->tapfd >= 0) {
+		close(pair->tapfd);
+		pair->tapfd = -1;
 	} else
-		pr_err("net->tapfd is -1!\n");
+		pr_err("pair->tapfd is -1!\n");
 
-	virtio_reset_dev(&net->base);
-	free(net);
+	/* the device itself goes away with the last queue pair */
+	net->open_pairs--;
+	if (net->open_pairs <= 0) {
+		virtio_reset_dev(&net->base);
+		free(net);
+	}
 }
 
 static void
 virtio_net_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 {
 	struct virtio_net *net;
+	int i, nevents = 0;
 
 	if (dev->arg) {
 		net = (struct virtio_net *) dev->arg;
 
 		virtio_net_tx_stop(net);
 
-		if (net->vhost_net) {
-			vhost_net_stop(net->vhost_net);
-			vhost_net_deinit(net->vhost_net);
-			free(net->vhost_net);
-			net->vhost_net = NULL;
+		if (net->fab_port != NULL) {
+			netfab_close(net->fab_port);
+			net->fab_port = NULL;
 		}
 
-		if (net->mevp != NULL)
-			mevent_delete(net->mevp);
-		else
-			virtio_net_teardown(net);
+		for (i = 0; i < net->num_pairs; i++) {
+			if (net->vhost_nets[i]) {
+				vhost_net_stop(net->vhost_nets[i]);
+				vhost_net_deinit(net->vhost_nets[i]);
+				free(net->vhost_nets[i]);
+				net->vhost_nets[i] = NULL;
+			}
+		}
+
+		for (i = 0; i < net->num_pairs; i++) {
+			free(net->pairs[i].txbuf);
+			net->pairs[i].txbuf = NULL;
+		}
+
+		for (i = 0; i < net->num_pairs; i++) {
+			if (net->pairs[i].mevp != NULL) {
+				mevent_delete(net->pairs[i].mevp);
+				nevents++;
+			}
+		}
+		if (nevents == 0) {
+			/* no events registered (e.g. vhost), free directly */
+			for (i = 0; i < net->num_pairs; i++) {
+				if (net->pairs[i].tapfd >= 0) {
+					close(net->pairs[i].tapfd);
+					net->pairs[i].tapfd = -1;
+				}
+			}
+			virtio_reset_dev(&net->base);
+			free(net);
+		}
 
 		DPRINTF(("%s: done\n", __func__));
 	} else
@@ -1162,12 +1991,21 @@ virtio_net_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 static struct vhost_net *
 vhost_net_init(struct virtio_base *base, int vhostfd, int tapfd, int vq_idx)
 {
+	struct virtio_net *net = (struct virtio_net *)base;
 	struct vhost_net *vhost_net = NULL;
 	uint64_t vhost_features = VIRTIO_NET_S_VHOSTCAPS;
-	uint64_t vhost_ext_features = VHOST_NET_F_VIRTIO_NET_HDR;
+	uint64_t vhost_ext_features = 0;
 	uint32_t busyloop_timeout = 0;
 	int rc;
 
+	/*
+	 * A vnet-hdr-capable tap supplies the virtio header itself and the
+	 * guest offloads negotiated via TUNSETOFFLOAD flow through; only a
+	 * raw tap needs vhost to fabricate the header.
+	 */
+	if (!net->vnet_hdr)
+		vhost_ext_features = VHOST_NET_F_VIRTIO_NET_HDR;
+
 	vhost_net = calloc(1, sizeof(struct vhost_net));
 	if (!vhost_net) {
 		WPRINTF(("vhost init out of memory\n"));
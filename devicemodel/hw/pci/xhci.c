@@ -437,7 +437,7 @@ struct pci_xhci_vdev {
 #define	XHCI_PORTREG_PTR(x, n)	(&(x)->portregs[(n)])
 #define	XHCI_SLOTDEV_PTR(x, n)	((x)->slots[(n)])
 #define	XHCI_HALTED(xdev)	((xdev)->opregs.usbsts & XHCI_STS_HCH)
-#define	XHCI_GADDR(xdev, a)	paddr_guest2host((xdev)->dev->vmctx, (a), \
+#define	XHCI_GADDR(xdev, a)	vm_gpa2hva((xdev)->dev->vmctx, (a), \
 				XHCI_PADDR_SZ - ((a) & (XHCI_PADDR_SZ-1)))
 
 /* port mapping status */
@@ -3274,6 +3274,15 @@ retry:
 		/* handle current batch that requires interrupt on complete */
 		if (trbflags & XHCI_TRB_3_IOC_BIT) {
 			UPRINTF(LDBG, "trb IOC bit set\r\n");
+			/* For data endpoints keep walking the ring so every
+			 * TD the guest has queued goes out as one aggregated
+			 * submission instead of one URB per TD. Completion
+			 * still produces an event TRB per IOC block. Fall
+			 * back to submit-and-retry once the block ring is
+			 * half full to keep room for TDs already in flight.
+			 */
+			if (epid != 1 && xfer->ndata < xfer->max_blk_cnt / 2)
+				continue;
 			do_retry = 1;
 			break;
 		}
@@ -4605,6 +4614,10 @@ pci_xhci_deinit(struct vmctx *ctx, struct pci_vdev *dev, char *opts)
 
 struct pci_vdev_ops pci_ops_xhci = {
 	.class_name	= "xhci",
+	/* USB device enumeration dominates init time and is local to
+	 * the controller instance
+	 */
+	.parallel_init	= true,
 	.vdev_init	= pci_xhci_init,
 	.vdev_deinit	= pci_xhci_deinit,
 	.vdev_barwrite	= pci_xhci_write,
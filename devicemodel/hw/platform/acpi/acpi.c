@@ -91,21 +91,32 @@
 #define NHLT_OFFSET		0x400
 #define TPM2_OFFSET		0xC00
 #define RTCT_OFFSET		0xF00
-#define DSDT_OFFSET		0x1100
+#define SRAT_OFFSET		0x1100
+#define SLIT_OFFSET		0x1900
+#define DSDT_OFFSET		0x1A00
 
 #define	ASL_TEMPLATE	"dm.XXXXXXX"
 #define ASL_SUFFIX	".aml"
 #ifndef ASL_COMPILER
 #define ASL_COMPILER	"/usr/sbin/iasl"
 #endif
+#ifndef ASL_CACHE_DIR
+#define ASL_CACHE_DIR	"/var/cache/acrn/acpi"
+#endif
 
 uint64_t audio_nhlt_len = 0;
 
 static int basl_keep_temps;
 static int basl_verbose_iasl;
+static int basl_use_cache;
 static int basl_ncpu;
 static uint32_t basl_acpi_base = ACPI_BASE;
 
+/*
+ * Directory holding compiled table images reused across launches
+ */
+static char basl_cachedir[MAXPATHLEN];
+
 /*
  * Contains the full pathname of the template to be passed
  * to mkstemp/mktemps(3)
@@ -194,6 +205,13 @@ basl_fwrite_rsdt(FILE *fp, struct vmctx *ctx)
 			    basl_acpi_base + RTCT_OFFSET);
 	}
 
+	if (vnuma_nodes > 1) {
+		EFPRINTF(fp, "[0004]\t\tACPI Table Address %u : %08X\n", num++,
+		    basl_acpi_base + SRAT_OFFSET);
+		EFPRINTF(fp, "[0004]\t\tACPI Table Address %u : %08X\n", num++,
+		    basl_acpi_base + SLIT_OFFSET);
+	}
+
 	EFFLUSH(fp);
 
 	return 0;
@@ -241,6 +259,13 @@ basl_fwrite_xsdt(FILE *fp, struct vmctx *ctx)
 			    basl_acpi_base + RTCT_OFFSET);
 	}
 
+	if (vnuma_nodes > 1) {
+		EFPRINTF(fp, "[0004]\t\tACPI Table Address %u : 00000000%08X\n", num++,
+		    basl_acpi_base + SRAT_OFFSET);
+		EFPRINTF(fp, "[0004]\t\tACPI Table Address %u : 00000000%08X\n", num++,
+		    basl_acpi_base + SLIT_OFFSET);
+	}
+
 	EFFLUSH(fp);
 
 	return 0;
@@ -679,6 +704,140 @@ basl_fwrite_mcfg(FILE *fp, struct vmctx *ctx)
 	return 0;
 }
 
+/*
+ * System Resource Affinity Table: one Processor Local APIC affinity
+ * entry per vCPU (same LAPIC IDs as the MADT) plus the memory ranges
+ * of each vNUMA node as carved out by vnuma_node_ranges(), so the
+ * guest kernel sees exactly the layout the memory policy enforces.
+ */
+static int
+basl_fwrite_srat(FILE *fp, struct vmctx *ctx)
+{
+	uint64_t ranges[2][2];
+	uint64_t guest_pcpu_bitmask;
+	int i, node, cnt;
+
+	guest_pcpu_bitmask = vm_get_cpu_affinity_dm();
+	if (guest_pcpu_bitmask == 0) {
+		pr_err("%s,Err: Invalid guest_pcpu_bitmask.\n", __func__);
+		return -1;
+	}
+
+	EFPRINTF(fp, "/*\n");
+	EFPRINTF(fp, " * dm SRAT template\n");
+	EFPRINTF(fp, " */\n");
+	EFPRINTF(fp, "[0004]\t\tSignature : \"SRAT\"\n");
+	EFPRINTF(fp, "[0004]\t\tTable Length : 00000000\n");
+	EFPRINTF(fp, "[0001]\t\tRevision : 03\n");
+	EFPRINTF(fp, "[0001]\t\tChecksum : 00\n");
+	EFPRINTF(fp, "[0006]\t\tOem ID : \"DM \"\n");
+	EFPRINTF(fp, "[0008]\t\tOem Table ID : \"DMSRAT  \"\n");
+	EFPRINTF(fp, "[0004]\t\tOem Revision : 00000001\n");
+
+	/* iasl will fill in the compiler ID/revision fields */
+	EFPRINTF(fp, "[0004]\t\tAsl Compiler ID : \"xxxx\"\n");
+	EFPRINTF(fp, "[0004]\t\tAsl Compiler Revision : 00000000\n");
+	EFPRINTF(fp, "\n");
+	EFPRINTF(fp, "[0004]\t\tTable Revision : 00000001\n");
+	EFPRINTF(fp, "[0008]\t\tReserved : 0000000000000000\n");
+	EFPRINTF(fp, "\n");
+
+	for (i = 0; i < basl_ncpu; i++) {
+		int pcpu_id = pcpuid_from_vcpuid(guest_pcpu_bitmask, i);
+		int lapic_id;
+
+		if (pcpu_id < 0 || pcpu_id >= ACRN_PLATFORM_LAPIC_IDS_MAX) {
+			pr_err("%s,Err: pcpu id is not found in guest_pcpu_bitmask.\n", __func__);
+			return -1;
+		}
+
+		lapic_id = lapicid_from_pcpuid(pcpu_id);
+		if (lapic_id == -1) {
+			pr_err("Failed to retrieve the local APIC ID for pCPU %u\n", pcpu_id);
+			return -1;
+		}
+
+		node = i * vnuma_nodes / basl_ncpu;
+
+		EFPRINTF(fp, "[0001]\t\tSubtable Type : 00\n");
+		EFPRINTF(fp, "[0001]\t\tLength : 10\n");
+		EFPRINTF(fp, "[0001]\t\tProximity Domain Low(8) : %02x\n", node);
+		EFPRINTF(fp, "[0001]\t\tApic ID : %02x\n", lapic_id);
+		EFPRINTF(fp, "[0004]\t\tFlags (decoded below) : 00000001\n");
+		EFPRINTF(fp, "\t\t\tEnabled : 1\n");
+		EFPRINTF(fp, "[0001]\t\tLocal Sapic EID : 00\n");
+		EFPRINTF(fp, "[0003]\t\tProximity Domain High(24) : 000000\n");
+		EFPRINTF(fp, "[0004]\t\tClock Domain : 00000000\n");
+		EFPRINTF(fp, "\n");
+	}
+
+	for (node = 0; node < vnuma_nodes; node++) {
+		cnt = vnuma_node_ranges(ctx, node, ranges);
+		for (i = 0; i < cnt; i++) {
+			EFPRINTF(fp, "[0001]\t\tSubtable Type : 01\n");
+			EFPRINTF(fp, "[0001]\t\tLength : 28\n");
+			EFPRINTF(fp, "[0004]\t\tProximity Domain : %08x\n",
+			    node);
+			EFPRINTF(fp, "[0002]\t\tReserved1 : 0000\n");
+			EFPRINTF(fp, "[0008]\t\tBase Address : %016lX\n",
+			    ranges[i][0]);
+			EFPRINTF(fp, "[0008]\t\tAddress Length : %016lX\n",
+			    ranges[i][1]);
+			EFPRINTF(fp, "[0004]\t\tReserved2 : 00000000\n");
+			EFPRINTF(fp, "[0004]\t\tFlags (decoded below) : 00000001\n");
+			EFPRINTF(fp, "\t\t\tEnabled : 1\n");
+			EFPRINTF(fp, "\t\t\tHot Pluggable : 0\n");
+			EFPRINTF(fp, "\t\t\tNon-Volatile : 0\n");
+			EFPRINTF(fp, "[0008]\t\tReserved3 : 0000000000000000\n");
+			EFPRINTF(fp, "\n");
+		}
+	}
+
+	EFFLUSH(fp);
+
+	return 0;
+}
+
+/*
+ * System Locality Information Table: a flat distance matrix with the
+ * conventional 10 for local and 21 for remote accesses, enough for
+ * the guest scheduler to prefer node-local placement.
+ */
+static int
+basl_fwrite_slit(FILE *fp, struct vmctx *ctx)
+{
+	int i, j;
+
+	EFPRINTF(fp, "/*\n");
+	EFPRINTF(fp, " * dm SLIT template\n");
+	EFPRINTF(fp, " */\n");
+	EFPRINTF(fp, "[0004]\t\tSignature : \"SLIT\"\n");
+	EFPRINTF(fp, "[0004]\t\tTable Length : 00000000\n");
+	EFPRINTF(fp, "[0001]\t\tRevision : 01\n");
+	EFPRINTF(fp, "[0001]\t\tChecksum : 00\n");
+	EFPRINTF(fp, "[0006]\t\tOem ID : \"DM \"\n");
+	EFPRINTF(fp, "[0008]\t\tOem Table ID : \"DMSLIT  \"\n");
+	EFPRINTF(fp, "[0004]\t\tOem Revision : 00000001\n");
+
+	/* iasl will fill in the compiler ID/revision fields */
+	EFPRINTF(fp, "[0004]\t\tAsl Compiler ID : \"xxxx\"\n");
+	EFPRINTF(fp, "[0004]\t\tAsl Compiler Revision : 00000000\n");
+	EFPRINTF(fp, "\n");
+	EFPRINTF(fp, "[0008]\t\tLocalities : %016lX\n", (uint64_t)vnuma_nodes);
+	EFPRINTF(fp, "\n");
+
+	for (i = 0; i < vnuma_nodes; i++) {
+		EFPRINTF(fp, "[%04X]\t\tLocality %3d :", vnuma_nodes, i);
+		for (j = 0; j < vnuma_nodes; j++)
+			EFPRINTF(fp, " %02X", (i == j) ? 10 : 21);
+		EFPRINTF(fp, "\n");
+	}
+
+	EFFLUSH(fp);
+
+	return 0;
+}
+
 static int
 basl_fwrite_nhlt(FILE *fp, struct vmctx *ctx)
 {
@@ -966,6 +1125,140 @@ basl_load(struct vmctx *ctx, int fd, uint64_t off)
 	return 0;
 }
 
+/*
+ * FNV-1a hash of the generated ASL source. The source text encodes
+ * every input that influences the compiled image (vCPU count, device
+ * configuration, memory layout), so identical source across launches
+ * is guaranteed to compile to an identical image.
+ */
+static int
+basl_source_hash(struct basl_fio *in, uint64_t *hash)
+{
+	uint64_t h;
+	size_t n, j;
+	uint8_t buf[4096];
+	FILE *fp;
+
+	fp = fopen(in->f_name, "r");
+	if (fp == NULL)
+		return -1;
+
+	h = 0xcbf29ce484222325UL;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (j = 0; j < n; j++) {
+			h ^= buf[j];
+			h *= 0x100000001b3UL;
+		}
+	}
+
+	fclose(fp);
+	*hash = h;
+
+	return 0;
+}
+
+static int
+basl_cache_path(char *path, size_t size, uint64_t offset, uint64_t hash)
+{
+	int n;
+
+	n = snprintf(path, size, "%s/dm-%03lx-%016lx" ASL_SUFFIX,
+			basl_cachedir, offset, hash);
+	if (n < 0 || n >= size) {
+		path[0] = '\0';
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+basl_cache_load(struct vmctx *ctx, const char *path, uint64_t offset)
+{
+	struct stat sb;
+	int fd, err;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	/*
+	 * Discard truncated leftovers rather than loading them
+	 */
+	if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	err = basl_load(ctx, fd, offset);
+	close(fd);
+
+	return err;
+}
+
+/*
+ * Store a freshly compiled image under its source hash. The copy goes
+ * to a private temporary name first and is renamed into place so that
+ * concurrent device model instances never observe a partial image.
+ */
+static void
+basl_cache_store(const char *path, const char *aml_name)
+{
+	char tmp_path[MAXPATHLEN];
+	uint8_t buf[4096];
+	ssize_t n;
+	int in_fd, out_fd;
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d",
+			path, getpid()) >= sizeof(tmp_path))
+		return;
+
+	in_fd = open(aml_name, O_RDONLY);
+	if (in_fd < 0)
+		return;
+
+	out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) {
+		close(in_fd);
+		return;
+	}
+
+	while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+		if (write(out_fd, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	}
+
+	close(in_fd);
+	close(out_fd);
+
+	if (n < 0 || rename(tmp_path, path) < 0)
+		unlink(tmp_path);
+}
+
+static void
+basl_cache_init(void)
+{
+	const char *dir;
+
+	dir = getenv("ACPI_CACHEDIR");
+	if (dir == NULL || *dir == '\0')
+		dir = ASL_CACHE_DIR;
+
+	if (strnlen(dir, MAXPATHLEN) >= MAXPATHLEN)
+		return;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		pr_warn("ACPI table cache disabled, cannot create %s\n", dir);
+		return;
+	}
+
+	strncpy(basl_cachedir, dir, MAXPATHLEN);
+	basl_use_cache = 1;
+}
+
 static int
 basl_compile(struct vmctx *ctx,
 		int (*fwrite_section)(FILE *, struct vmctx *),
@@ -973,13 +1266,33 @@ basl_compile(struct vmctx *ctx,
 {
 	struct basl_fio io[2];
 	static char iaslbuf[3*MAXPATHLEN + 10];
+	char cache_path[MAXPATHLEN];
+	uint64_t hash;
+	bool in_cache;
 	int err;
 
+	in_cache = false;
+	cache_path[0] = '\0';
+
 	err = basl_start(&io[0], &io[1]);
 	if (!err) {
 		err = (*fwrite_section)(io[0].fp, ctx);
 
-		if (!err) {
+		if (!err && basl_use_cache &&
+		    !basl_source_hash(&io[0], &hash) &&
+		    !basl_cache_path(cache_path, sizeof(cache_path),
+					offset, hash)) {
+			/*
+			 * The generated source captures every input to
+			 * the table, so an image compiled from matching
+			 * source by an earlier launch can be loaded
+			 * directly without running iasl at all
+			 */
+			in_cache = (basl_cache_load(ctx, cache_path,
+						offset) == 0);
+		}
+
+		if (!err && !in_cache) {
 			/*
 			 * iasl sends the results of the compilation to
 			 * stdout. Shut this down by using the shell to
@@ -1006,6 +1319,10 @@ basl_compile(struct vmctx *ctx,
 				 * memory at the specified location
 				 */
 				err = basl_load(ctx, io[1].fd, offset);
+
+				if (!err && cache_path[0] != '\0')
+					basl_cache_store(cache_path,
+							io[1].f_name);
 			} else
 				err = -1;
 		}
@@ -1078,6 +1395,8 @@ static struct {
 	{ basl_fwrite_facs, FACS_OFFSET, true  },
 	{ basl_fwrite_nhlt, NHLT_OFFSET, false }, /*valid with audio ptdev*/
 	{ basl_fwrite_tpm2, TPM2_OFFSET, false },
+	{ basl_fwrite_srat, SRAT_OFFSET, false }, /*valid with vnuma*/
+	{ basl_fwrite_slit, SLIT_OFFSET, false }, /*valid with vnuma*/
 	{ basl_fwrite_dsdt, DSDT_OFFSET, true  }
 };
 
@@ -1135,6 +1454,14 @@ acpi_build(struct vmctx *ctx, int ncpu)
 	if (getenv("ACPI_KEEPTMPS"))
 		basl_keep_temps = 1;
 
+	/*
+	 * Compiled table images are cached across launches, keyed by a
+	 * hash of the generated ASL source; set ACPI_NOCACHE to force
+	 * iasl to run for every table
+	 */
+	if (!getenv("ACPI_NOCACHE"))
+		basl_cache_init();
+
 	i = 0;
 	err = basl_make_templates();
 
@@ -1148,6 +1475,12 @@ acpi_build(struct vmctx *ctx, int ncpu)
 				basl_ftables[i].valid = true;
 		}
 
+		if (((basl_ftables[i].offset == SRAT_OFFSET) ||
+			(basl_ftables[i].offset == SLIT_OFFSET)) &&
+			(vnuma_nodes > 1)) {
+				basl_ftables[i].valid = true;
+		}
+
 		if (acpi_table_is_valid(i))
 			err = basl_compile(ctx, basl_ftables[i].wsect,
 					basl_ftables[i].offset);
@@ -813,6 +813,85 @@ ioc_ch_deinit(void)
 	}
 }
 
+/*
+ * Watermark batching of the rx/tx worker wakeups. At high frame rates a
+ * wakeup per frame dominates the mediator cost, so ordinary protocol
+ * frames only accumulate bytes until the watermark is crossed or the
+ * flush deadline of the first deferred frame expires. Lifecycle frames
+ * and event requests carry wakeup reasons and must stay immediate.
+ */
+#define CBC_WM_BYTES		512
+#define CBC_WM_DELAY_NS		2000000
+
+static bool
+cbc_wm_immediate(struct cbc_request *req)
+{
+	return (req->rtype != CBC_REQ_T_PROT) || (req->id == IOC_NATIVE_LFCC);
+}
+
+/*
+ * Called with the queue mutex held, signals the worker right away or
+ * arms the flush deadline for deferred frames.
+ */
+static void
+cbc_wm_account(struct cbc_watermark *wm, struct cbc_request *req,
+		pthread_cond_t *cond)
+{
+	wm->bytes += (req->srv_len > 0) ? req->srv_len : req->link_len;
+	if (cbc_wm_immediate(req) || wm->bytes >= CBC_WM_BYTES) {
+		wm->kick = true;
+		pthread_cond_signal(cond);
+	} else if (!wm->armed) {
+		clock_gettime(CLOCK_REALTIME, &wm->deadline);
+		wm->deadline.tv_nsec += CBC_WM_DELAY_NS;
+		if (wm->deadline.tv_nsec >= 1000000000L) {
+			wm->deadline.tv_nsec -= 1000000000L;
+			wm->deadline.tv_sec += 1;
+		}
+		wm->armed = true;
+	}
+}
+
+/*
+ * Called with the queue mutex held, blocks the worker until the queue
+ * has work to drain: a wakeup was requested, the flush deadline of
+ * deferred frames expired, or the device is closing.
+ */
+static void
+cbc_wm_wait(struct ioc_dev *ioc, struct cbc_qhead *qhead,
+		struct cbc_watermark *wm, pthread_cond_t *cond,
+		pthread_mutex_t *mtx)
+{
+	while (!ioc->closing) {
+		if (!SIMPLEQ_EMPTY(qhead)) {
+			if (wm->kick || !wm->armed)
+				break;
+			if (pthread_cond_timedwait(cond, mtx,
+					&wm->deadline) == ETIMEDOUT) {
+				/* flush, drain the whole batch */
+				wm->kick = true;
+				break;
+			}
+		} else {
+			pthread_cond_wait(cond, mtx);
+		}
+	}
+}
+
+/*
+ * Called with the queue mutex held after a request is removed, resets
+ * the batch state once the queue has been fully drained.
+ */
+static void
+cbc_wm_reset(struct cbc_qhead *qhead, struct cbc_watermark *wm)
+{
+	if (SIMPLEQ_EMPTY(qhead)) {
+		wm->bytes = 0;
+		wm->armed = false;
+		wm->kick = false;
+	}
+}
+
 /*
  * Called to put a cbc_request to a specific queue
  */
@@ -823,6 +902,7 @@ cbc_request_enqueue(struct ioc_dev *ioc, struct cbc_request *req,
 	pthread_cond_t *cond;
 	pthread_mutex_t *mtx;
 	struct cbc_qhead *qhead;
+	struct cbc_watermark *wm;
 
 	if (!req)
 		return;
@@ -831,14 +911,17 @@ cbc_request_enqueue(struct ioc_dev *ioc, struct cbc_request *req,
 		cond = &ioc->rx_cond;
 		mtx = &ioc->rx_mtx;
 		qhead = &ioc->rx_qhead;
+		wm = &ioc->rx_wm;
 	} else if (qtype == CBC_QUEUE_T_TX) {
 		cond = &ioc->tx_cond;
 		mtx = &ioc->tx_mtx;
 		qhead = &ioc->tx_qhead;
+		wm = &ioc->tx_wm;
 	} else {
 		cond = NULL;
 		mtx = &ioc->free_mtx;
 		qhead = &ioc->free_qhead;
+		wm = NULL;
 	}
 
 	pthread_mutex_lock(mtx);
@@ -847,7 +930,7 @@ cbc_request_enqueue(struct ioc_dev *ioc, struct cbc_request *req,
 	else
 		SIMPLEQ_INSERT_TAIL(qhead, req, me_queue);
 	if (cond != NULL)
-		pthread_cond_signal(cond);
+		cbc_wm_account(wm, req, cond);
 	pthread_mutex_unlock(mtx);
 }
 
@@ -1093,6 +1176,9 @@ ioc_build_request(struct ioc_dev *ioc, int32_t link_len, int32_t srv_len)
 	req->srv_len = srv_len;
 	req->link_len = link_len;
 	req->rtype = CBC_REQ_T_PROT;
+
+	/* requests are recycled, avoid stale ids in the wakeup batching */
+	req->id = IOC_VIRTUAL_UART;
 	cbc_request_enqueue(ioc, req, CBC_QUEUE_T_RX, false);
 }
 
@@ -1249,17 +1335,15 @@ ioc_rx_thread(void *arg)
 
 	for (;;) {
 		pthread_mutex_lock(&ioc->rx_mtx);
-		while (SIMPLEQ_EMPTY(&ioc->rx_qhead)) {
-			pthread_cond_wait(&ioc->rx_cond, &ioc->rx_mtx);
-			if (ioc->closing)
-				goto exit;
-		}
+		cbc_wm_wait(ioc, &ioc->rx_qhead, &ioc->rx_wm,
+				&ioc->rx_cond, &ioc->rx_mtx);
 		if (ioc->closing)
 			goto exit;
 
 		/* Get a cbc request from the queue head */
 		req = SIMPLEQ_FIRST(&ioc->rx_qhead);
 		SIMPLEQ_REMOVE_HEAD(&ioc->rx_qhead, me_queue);
+		cbc_wm_reset(&ioc->rx_qhead, &ioc->rx_wm);
 		pthread_mutex_unlock(&ioc->rx_mtx);
 		packet.req = req;
 
@@ -1300,17 +1384,15 @@ ioc_tx_thread(void *arg)
 
 	for (;;) {
 		pthread_mutex_lock(&ioc->tx_mtx);
-		while (SIMPLEQ_EMPTY(&ioc->tx_qhead)) {
-			pthread_cond_wait(&ioc->tx_cond, &ioc->tx_mtx);
-			if (ioc->closing)
-				goto exit;
-		}
+		cbc_wm_wait(ioc, &ioc->tx_qhead, &ioc->tx_wm,
+				&ioc->tx_cond, &ioc->tx_mtx);
 		if (ioc->closing)
 			goto exit;
 
 		/* Get a cbc request from the queue head */
 		req = SIMPLEQ_FIRST(&ioc->tx_qhead);
 		SIMPLEQ_REMOVE_HEAD(&ioc->tx_qhead, me_queue);
+		cbc_wm_reset(&ioc->tx_qhead, &ioc->tx_wm);
 		pthread_mutex_unlock(&ioc->tx_mtx);
 		packet.req = req;
 
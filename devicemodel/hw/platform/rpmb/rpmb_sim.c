@@ -29,6 +29,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <openssl/hmac.h>
 #include <openssl/opensslv.h>
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
@@ -66,7 +67,14 @@ static int virtio_rpmb_debug = 1;
 #define DPRINTF(params) do { if (virtio_rpmb_debug) pr_dbg params; } while (0)
 #define WPRINTF(params) (pr_err params)
 
-/* Make rpmb_mac compatible for different openssl versions */
+/* Make rpmb_mac compatible for different openssl versions.
+ *
+ * The RPMB MAC chains every frame of a request into one HMAC-SHA256, so
+ * frames cannot be hashed in independent lanes; throughput comes from
+ * OpenSSL's SHA-256 backend (SHA-NI/AVX2 when available) plus keeping a
+ * single context alive across requests instead of re-fetching and
+ * re-allocating it per call, which dominated short multi-frame bursts.
+ */
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 			size_t frame_cnt, uint8_t *mac)
@@ -108,6 +116,10 @@ err:
 	return hmac_ret ? 0 : -1;
 }
 #elif OPENSSL_VERSION_NUMBER >= 0x30000000L
+static pthread_mutex_t hmac_mtx = PTHREAD_MUTEX_INITIALIZER;
+static EVP_MAC *hmac_impl;
+static EVP_MAC_CTX *hmac_cached_ctx;
+
 int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 			size_t frame_cnt, uint8_t *mac)
 {
@@ -115,15 +127,22 @@ int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 	int hmac_ret;
 	size_t md_len;
 	EVP_MAC_CTX *hmac_ctx;
-	EVP_MAC *hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
 
-	hmac_ctx = EVP_MAC_CTX_new(hmac);
-	if (hmac_ctx == NULL) {
-		DPRINTF(("get hmac_ctx failed\n"));
-		EVP_MAC_free(hmac);
-		return -1;
+	pthread_mutex_lock(&hmac_mtx);
+	if (hmac_cached_ctx == NULL) {
+		hmac_impl = EVP_MAC_fetch(NULL, "HMAC", NULL);
+		hmac_cached_ctx = EVP_MAC_CTX_new(hmac_impl);
+		if (hmac_cached_ctx == NULL) {
+			DPRINTF(("get hmac_ctx failed\n"));
+			EVP_MAC_free(hmac_impl);
+			hmac_impl = NULL;
+			pthread_mutex_unlock(&hmac_mtx);
+			return -1;
+		}
 	}
+	hmac_ctx = hmac_cached_ctx;
 
+	/* re-keying resets the cached context for this request */
 	hmac_ret = EVP_MAC_init(hmac_ctx, key, 32, NULL);
 	if (!hmac_ret) {
 		DPRINTF(("HMAC_Init_ex failed\n"));
@@ -150,12 +169,14 @@ int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 	}
 
 err:
-	EVP_MAC_CTX_free(hmac_ctx);
-	EVP_MAC_free(hmac);
+	pthread_mutex_unlock(&hmac_mtx);
 
 	return hmac_ret ? 0 : -1;
 }
 #else
+static pthread_mutex_t hmac_mtx = PTHREAD_MUTEX_INITIALIZER;
+static HMAC_CTX *hmac_cached_ctx;
+
 int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 			size_t frame_cnt, uint8_t *mac)
 {
@@ -164,12 +185,18 @@ int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 	unsigned int md_len;
 	HMAC_CTX *hmac_ctx;
 
-	hmac_ctx = HMAC_CTX_new();
-	if (hmac_ctx == NULL) {
-		DPRINTF(("get hmac_ctx failed\n"));
-		return -1;
+	pthread_mutex_lock(&hmac_mtx);
+	if (hmac_cached_ctx == NULL) {
+		hmac_cached_ctx = HMAC_CTX_new();
+		if (hmac_cached_ctx == NULL) {
+			DPRINTF(("get hmac_ctx failed\n"));
+			pthread_mutex_unlock(&hmac_mtx);
+			return -1;
+		}
 	}
+	hmac_ctx = hmac_cached_ctx;
 
+	/* re-keying resets the cached context for this request */
 	hmac_ret = HMAC_Init_ex(hmac_ctx, key, 32, EVP_sha256(), NULL);
 	if (!hmac_ret) {
 		DPRINTF(("HMAC_Init_ex failed\n"));
@@ -196,7 +223,7 @@ int rpmb_mac(const uint8_t *key, const struct rpmb_frame *frames,
 	}
 
 err:
-	HMAC_CTX_free(hmac_ctx);
+	pthread_mutex_unlock(&hmac_mtx);
 
 	return hmac_ret ? 0 : -1;
 }
@@ -512,7 +539,6 @@ static int rpmb_sim_read(const struct rpmb_frame* in_frame, uint32_t in_cnt,
 	uint8_t key[32];
 	uint8_t mac[32];
 	uint16_t addr;
-	uint8_t data[256*out_cnt];
 
 	if (in_cnt != 1 || in_frame == NULL)
 		return -EINVAL;
@@ -535,11 +561,6 @@ static int rpmb_sim_read(const struct rpmb_frame* in_frame, uint32_t in_cnt,
 		goto out;
 	}
 
-	if (file_read(rpmb_fd, data, sizeof(data), 256 * addr) < 0) {
-		DPRINTF(("%s read_with_retry failed.\n", __func__));
-		goto out;
-	}
-
 	err = RPMB_RES_OK;
 
 out:
@@ -550,7 +571,15 @@ out:
 			out_frame[i].req_resp = swap16(RPMB_RESP_DATA_READ);
 			out_frame[i].block_count = swap16(out_cnt);
 			out_frame[i].addr = in_frame[0].addr;
-			memcpy(out_frame[i].data, data+256*i, 256);
+			/* read each block straight into its response frame so the
+			 * MAC below runs over data the page cache just filled,
+			 * instead of staging all blocks in a bounce buffer first
+			 */
+			if ((err == RPMB_RES_OK) &&
+				(file_read(rpmb_fd, out_frame[i].data, 256, 256 * (addr + i)) < 0)) {
+				DPRINTF(("%s read_with_retry failed.\n", __func__));
+				err = RPMB_RES_READ_FAILURE;
+			}
 		}
 		if (get_key(key))
 			DPRINTF(("%s, get_key failed.\n", __func__));
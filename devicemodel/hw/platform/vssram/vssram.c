@@ -19,12 +19,14 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "pci_core.h"
 #include "vmmapi.h"
 #include "acpi.h"
 #include "dm_string.h"
 #include "log.h"
+#include "monitor.h"
 #include "vssram.h"
 #include "tcc_buffer.h"
 
@@ -83,6 +85,17 @@ static int	tcc_buffer_fd = INVALID_FD;
 static struct	vssram_buf *vssram_buffers;
 static struct   vssram_buf_param *vssram_buf_params;
 
+/*
+ * Runtime carve-out state: requests arriving through the command monitor
+ * are served from the same TCC software SRAM regions as the
+ * integration-time buffers and mapped into the spare tail of the vSSRAM
+ * GPA window reserved at boot.
+ */
+static pthread_mutex_t vssram_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t vssram_gpa_next;
+static uint32_t vssram_rt_requests;
+static uint32_t vssram_rt_failures;
+
 #define vcpuid2pcpuid(vcpuid) pcpuid_from_vcpuid(guest_pcpumask, vcpuid)
 
 static inline uint64_t vcpuid2lapicid(int vcpuid)
@@ -919,6 +932,9 @@ static void vssram_config_buffers_gpa(void)
 			}
 		}
 	}
+
+	/* runtime carve-outs are mapped into the spare tail of the window */
+	vssram_gpa_next = gpa;
 }
 
 /**
@@ -1250,6 +1266,244 @@ uint8_t *get_vssram_vrtct(void)
 	return (uint8_t *)vrtct_table;
 }
 
+/**
+ * @brief  Carve out an additional vSSRAM buffer at runtime.
+ *
+ *         The buffer is requested from the TCC buffer driver like the
+ *         integration-time buffers, so its cache ways stay pinned by the
+ *         native RTCM stack, and it is EPT-mapped into the spare tail of
+ *         the vSSRAM GPA window reserved at boot. Runtime buffers always
+ *         get a standalone GPA mapping; the L3-inclusive-of-L2 region
+ *         merging only applies to buffers configured before the vRTCT
+ *         is generated.
+ *
+ * @param ctx      Pointer to context of user VM.
+ * @param level    Cache level of the buffer, L2_CACHE or L3_CACHE.
+ * @param size     Size of the buffer in bytes, page aligned.
+ * @param vcpumask Bitmask of vCPUs sharing the buffer.
+ *
+ * @return 0 on success and -1 on fail.
+ *
+ * @pre vssram_mtx is held by the caller.
+ */
+static int vssram_runtime_request(struct vmctx *ctx, int level, uint32_t size, uint64_t vcpumask)
+{
+	struct tcc_memory_info mem_info;
+	struct vssram_buf *vbuf = NULL;
+	int i, pcpuid, cacheid = INVALID_CACHE_ID;
+	int ret = -1;
+
+	if (((level != L2_CACHE) && (level != L3_CACHE)) ||
+		(size == 0) || ((size & 0xfff) != 0)) {
+		pr_err("%s, invalid carve-out request: level:%d, size:0x%x.\n",
+			__func__, level, size);
+		return -1;
+	}
+
+	if (vcpumask == VSSRAM_VCPUMASK_ALL) {
+		vcpumask = 0;
+		for (i = 0; i < guest_vcpu_num; i++)
+			vcpumask |= (1UL << i);
+	}
+
+	/* all vCPUs in the mask must share the level specific cache */
+	for (i = 0; i < ACRN_PLATFORM_LAPIC_IDS_MAX; i++) {
+		if ((vcpumask >> i) & 0x1) {
+			if (cacheid == INVALID_CACHE_ID) {
+				cacheid = vcpuid2cacheid(i, level);
+			} else if (cacheid != vcpuid2cacheid(i, level)) {
+				pr_err("%s, vCPU mask and cache hierarchy are mismatched.\n",
+					__func__);
+				return -1;
+			}
+		}
+	}
+	if (cacheid == INVALID_CACHE_ID)
+		return -1;
+
+	if ((vssram_gpa_next + size) > (vssram_gpa_base + vssram_size)) {
+		pr_err("%s, no spare GPA in the vSSRAM window for 0x%x bytes.\n",
+			__func__, size);
+		return -1;
+	}
+
+	/* take a free slot; a mapped buffer is never grown at runtime */
+	for (i = 0; i < MAX_VSSRAM_BUFFER_NUM; i++) {
+		if (vssram_buffers[i].size == 0) {
+			vbuf = &vssram_buffers[i];
+			break;
+		}
+	}
+	if (vbuf == NULL) {
+		pr_err("%s, no free vSSRAM buffer slot.\n", __func__);
+		return -1;
+	}
+
+	vbuf->level = level;
+	vbuf->cache_id = cacheid;
+	vbuf->size = size;
+	for (i = 0; i < ACRN_PLATFORM_LAPIC_IDS_MAX; i++) {
+		if ((vcpumask >> i) & 0x1) {
+			pcpuid = vcpuid2pcpuid(i);
+			if ((pcpuid < 0) || (pcpuid >= ACRN_PLATFORM_LAPIC_IDS_MAX)) {
+				pr_err("%s, invalid pcpuid(%d) from vcpuid(%d).\n",
+					__func__, pcpuid, i);
+				goto reset_vbuf;
+			}
+			CPU_SET(pcpuid, &vbuf->pcpumask);
+		}
+	}
+
+	memset(&mem_info, 0, sizeof(struct tcc_memory_info));
+	if (load_tcc_memory_info(&mem_info) < 0) {
+		pr_err("%s, load TCC memory configurations failed.\n", __func__);
+		goto reset_vbuf;
+	}
+
+	if (vssram_setup_buffer(vbuf, &mem_info) < 0) {
+		pr_err("%s, allocate cache(level:%d, size:%x) failed.\n",
+			__func__, level, size);
+		goto free_mem_info;
+	}
+
+	vbuf->gpa_base = vssram_gpa_next;
+	if (vssram_ept_map_buffer(ctx, vbuf) < 0) {
+		pr_err("%s, setup EPT mapping for cache buffer failed.\n", __func__);
+		munmap((void *)vbuf->vma_base, vbuf->size);
+		close(vbuf->fd);
+		goto free_mem_info;
+	}
+
+	vssram_gpa_next += size;
+	pr_info("%s, L%d buffer locked at runtime: gpa:0x%lx, size:0x%x, waymask:0x%x.\n",
+		__func__, level, vbuf->gpa_base, vbuf->size, vbuf->waymask);
+	ret = 0;
+
+free_mem_info:
+	if (mem_info.region_configs)
+		free(mem_info.region_configs);
+	if (mem_info.cpuset)
+		free(mem_info.cpuset);
+reset_vbuf:
+	if (ret < 0) {
+		memset(vbuf, 0, sizeof(struct vssram_buf));
+		vbuf->fd = INVALID_FD;
+		vbuf->cache_id = INVALID_CACHE_ID;
+	}
+	return ret;
+}
+
+/**
+ * @brief  Log vSSRAM usage telemetry.
+ *
+ *         Locked buffers are never evicted, so usage plus the carve-out
+ *         failure counter is what signals over-commit of the software
+ *         SRAM regions or of the GPA window.
+ *
+ * @pre vssram_mtx is held by the caller.
+ */
+static void vssram_log_telemetry(void)
+{
+	int i;
+	uint64_t used = 0;
+	struct vssram_buf *vbuf;
+
+	pr_info("vSSRAM window: gpa:0x%lx~0x%lx, carve-out requests:%u, failures:%u.\n",
+		vssram_gpa_base, vssram_gpa_base + vssram_size,
+		vssram_rt_requests, vssram_rt_failures);
+
+	for (i = 0; i < MAX_VSSRAM_BUFFER_NUM; i++) {
+		vbuf = &vssram_buffers[i];
+		if (vbuf->size == 0)
+			break;
+		pr_info("vSSRAM buf%d: L%d, cache_id:%d, gpa:0x%lx, size:0x%x, "
+			"waymask:0x%x, pinned_cpus:%d.\n",
+			i, vbuf->level, vbuf->cache_id, vbuf->gpa_base,
+			vbuf->size, vbuf->waymask, CPU_COUNT(&vbuf->pcpumask));
+		used += vbuf->size;
+	}
+	pr_info("vSSRAM usage: 0x%lx of 0x%lx bytes carved out.\n", used, vssram_size);
+}
+
+/**
+ * @brief  Command monitor entry for runtime vSSRAM management.
+ *
+ *         Supported arguments:
+ *          - "stat": log usage telemetry of all vSSRAM buffers.
+ *          - "req,level=<2|3>,size=<bytes>[,vcpus=<mask>]": carve out
+ *            and lock an additional buffer at runtime.
+ *
+ * @param arg          Pointer to context of user VM.
+ * @param vssram_opts  Option string of the monitor command.
+ *
+ * @return 0 on success and -1 on fail.
+ */
+int vm_monitor_vssram(void *arg, char *vssram_opts)
+{
+	struct vmctx *ctx = (struct vmctx *)arg;
+	char *opts, *opt, *token;
+	uint64_t vcpumask = VSSRAM_VCPUMASK_ALL;
+	uint32_t size = 0;
+	int level = 0, ret = -1;
+
+	if ((ctx == NULL) || (vssram_opts == NULL))
+		return -1;
+
+	if ((vssram_buffers == NULL) || (vrtct_table == NULL)) {
+		pr_err("%s, vSSRAM is not initialized for this VM.\n", __func__);
+		return -1;
+	}
+
+	opts = opt = strdup(vssram_opts);
+	if (opt == NULL) {
+		pr_err("%s, strdup returns NULL.\n", __func__);
+		return -1;
+	}
+
+	token = strsep(&opt, ",");
+	if (token == NULL) {
+		free(opts);
+		return -1;
+	}
+
+	if (strcmp(token, "stat") == 0) {
+		pthread_mutex_lock(&vssram_mtx);
+		vssram_log_telemetry();
+		pthread_mutex_unlock(&vssram_mtx);
+		ret = 0;
+	} else if (strcmp(token, "req") == 0) {
+		while ((token = strsep(&opt, ",")) != NULL) {
+			if (strncmp(token, "level=", 6) == 0) {
+				if (dm_strtoi(token + 6, NULL, 10, &level) != 0)
+					break;
+			} else if (strncmp(token, "size=", 5) == 0) {
+				if (dm_strtoui(token + 5, NULL, 0, &size) != 0)
+					break;
+			} else if (strncmp(token, "vcpus=", 6) == 0) {
+				if (dm_strtoul(token + 6, NULL, 0, &vcpumask) != 0)
+					break;
+			} else {
+				pr_err("%s, unknown option: %s.\n", __func__, token);
+				break;
+			}
+		}
+
+		if (token == NULL) {
+			pthread_mutex_lock(&vssram_mtx);
+			vssram_rt_requests++;
+			ret = vssram_runtime_request(ctx, level, size, vcpumask);
+			if (ret < 0)
+				vssram_rt_failures++;
+			pthread_mutex_unlock(&vssram_mtx);
+		}
+	} else {
+		pr_err("%s, unknown sub-command: %s.\n", __func__, token);
+	}
+
+	free(opts);
+	return ret;
+}
+
 /**
  * @brief Initialize software SRAM device for user VM.
  *
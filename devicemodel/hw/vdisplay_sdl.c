@@ -768,10 +768,42 @@ vdpy_surface_update(int handle, struct surface *surf)
 	        return;
 	}
 
-	if (surf->surf_type == SURFACE_PIXMAN)
-		SDL_UpdateTexture(vdpy.dpy_texture, NULL,
-			  surf->pixel,
-			  surf->stride);
+	if (surf->surf_type == SURFACE_PIXMAN) {
+		uint32_t dmg_x = surf->damage_x;
+		uint32_t dmg_y = surf->damage_y;
+		uint32_t dmg_w = surf->damage_w;
+		uint32_t dmg_h = surf->damage_h;
+
+		/* clamp the damage rectangle against the surface; a guest
+		 * that tracks no damage (w/h of 0) uploads the full surface
+		 */
+		if (dmg_x >= surf->width || dmg_y >= surf->height) {
+			dmg_w = 0;
+			dmg_h = 0;
+		}
+		if (dmg_w > surf->width - dmg_x)
+			dmg_w = surf->width - dmg_x;
+		if (dmg_h > surf->height - dmg_y)
+			dmg_h = surf->height - dmg_y;
+
+		if ((dmg_w != 0) && (dmg_h != 0) &&
+		    ((dmg_w < surf->width) || (dmg_h < surf->height))) {
+			/* all supported pixman formats are 32bpp */
+			SDL_Rect damage_rect = {
+				.x = dmg_x, .y = dmg_y,
+				.w = dmg_w, .h = dmg_h,
+			};
+
+			SDL_UpdateTexture(vdpy.dpy_texture, &damage_rect,
+				  (uint8_t *)surf->pixel +
+				  dmg_y * surf->stride + dmg_x * 4,
+				  surf->stride);
+		} else {
+			SDL_UpdateTexture(vdpy.dpy_texture, NULL,
+				  surf->pixel,
+				  surf->stride);
+		}
+	}
 
 	SDL_RenderClear(vdpy.dpy_renderer);
 	SDL_RenderCopy(vdpy.dpy_renderer, vdpy.dpy_texture, NULL, NULL);
@@ -68,6 +68,10 @@ int	blockif_cancel(struct blockif_ctxt *bc, struct blockif_req *breq);
 int	blockif_close(struct blockif_ctxt *bc);
 uint8_t	blockif_get_wce(struct blockif_ctxt *bc);
 void	blockif_set_wce(struct blockif_ctxt *bc, uint8_t wce);
+void	blockif_get_rate(struct blockif_ctxt *bc, uint64_t *iops,
+			 uint64_t *bps);
+int	blockif_set_rate(struct blockif_ctxt *bc, uint64_t iops,
+			 uint64_t bps);
 int	blockif_flush_all(struct blockif_ctxt *bc);
 int	blockif_max_discard_sectors(struct blockif_ctxt *bc);
 int	blockif_max_discard_seg(struct blockif_ctxt *bc);
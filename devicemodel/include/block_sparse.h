@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Native sparse image format for blockif file backends: a cluster map
+ * kept in memory, lazy allocation on first write, optional copy-on-write
+ * backing file, and sequential-read prefetch over contiguous extents.
+ */
+
+#ifndef _BLOCK_SPARSE_H_
+#define _BLOCK_SPARSE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct sparse_disk;
+
+/*
+ * Create an empty sparse image of the given virtual capacity at path.
+ * backing may name an existing image (sparse or raw) to snapshot:
+ * unwritten clusters then read through to it, first writes copy the
+ * cluster up (the A/B image flow). Returns 0 or -errno.
+ */
+int sparse_create(const char *path, uint64_t capacity, const char *backing);
+
+/*
+ * Open a sparse image on an already opened fd. The fd is owned by the
+ * caller (blockif) and must stay open for the life of the handle; the
+ * backing file, if any, is opened and owned by the handle. On success
+ * *capacity returns the virtual disk size.
+ */
+struct sparse_disk *sparse_open(int fd, int rdonly, off_t *capacity);
+
+ssize_t sparse_pread(struct sparse_disk *sp, void *buf, size_t len, off_t offset);
+ssize_t sparse_pwrite(struct sparse_disk *sp, const void *buf, size_t len, off_t offset);
+
+/* punch the data of fully covered, allocated clusters */
+int sparse_discard(struct sparse_disk *sp, off_t offset, off_t len);
+
+void sparse_close(struct sparse_disk *sp);
+
+#endif /* _BLOCK_SPARSE_H_ */
@@ -8,4 +8,15 @@
 int init_cmd_monitor(struct vmctx *ctx);
 void deinit_cmd_monitor(void);
 int acrn_parse_cmd_monitor(char *arg);
+/**
+ * @brief Push an asynchronous event to all subscribed monitor clients.
+ *
+ * The event goes out as one newline-framed JSON object
+ * {"event": ..., "detail": ...}; clients opt in with the "subscribe"
+ * command. No-op while the command monitor is not running.
+ *
+ * @param event the event type, e.g. "vm_state"
+ * @param detail optional free-form detail string, may be NULL
+ */
+void monitor_broadcast_event(const char *event, const char *detail);
 #endif
@@ -47,6 +47,14 @@ extern bool stdio_in_use;
 extern char *mac_seed;
 extern bool lapic_pt;
 extern bool is_rtvm;
+extern bool lazy_highmem;
+/* idle-memory scan interval in seconds; 0 disables the compression tier */
+extern int mem_compress_sec;
+extern int guest_ncpus;
+
+/* number of NUMA nodes exposed to the guest; 1 means flat (no SRAT/SLIT) */
+#define VNUMA_NODES_MAX		8
+extern int vnuma_nodes;
 extern bool pt_tpm2;
 extern bool ssram;
 extern bool vtpm2;
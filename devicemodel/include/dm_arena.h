@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _DM_ARENA_H_
+#define _DM_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DM_ARENA_NAMESZ		32
+#define DM_ARENA_ALIGN		64UL	/* cache line */
+#define DM_ARENA_HUGEPAGE_SZ	(2UL * 1024UL * 1024UL)
+
+/*
+ * Bump allocator over one hugepage-backed mapping. Device emulation
+ * state allocated from an arena stays contiguous and on as few 2 MiB
+ * TLB entries as possible, unlike malloc spreading it across the heap.
+ * Allocations are cache-line aligned and are only released by
+ * destroying the whole arena.
+ */
+struct dm_arena {
+	char name[DM_ARENA_NAMESZ];
+	uint8_t *base;
+	size_t size;
+	size_t off;
+};
+
+/**
+ * @brief Create an arena of at least \p size bytes, rounded up to 2 MiB.
+ *
+ * Backed by MAP_HUGETLB when hugepages are available, otherwise by an
+ * anonymous mapping with MADV_HUGEPAGE so THP can still supply 2 MiB
+ * TLB entries.
+ *
+ * @return the arena, or NULL when the mapping fails
+ */
+struct dm_arena *dm_arena_create(const char *name, size_t size);
+
+/**
+ * @brief Allocate \p size zeroed, cache-line aligned bytes from \p arena.
+ *
+ * @return the allocation, or NULL when the arena is exhausted
+ */
+void *dm_arena_zalloc(struct dm_arena *arena, size_t size);
+
+/**
+ * @brief Destroy \p arena and release every allocation made from it.
+ */
+void dm_arena_destroy(struct dm_arena *arena);
+
+#endif /* _DM_ARENA_H_ */
@@ -722,6 +722,19 @@ struct cbc_request {
 	SIMPLEQ_ENTRY(cbc_request) me_queue;
 };
 
+/*
+ * Watermark batching state of one direction queue, guarded by the
+ * queue's mutex. Ordinary protocol frames are accumulated until a byte
+ * watermark or a flush deadline is reached before the worker thread is
+ * woken up; lifecycle and event requests wake it up immediately.
+ */
+struct cbc_watermark {
+	uint32_t bytes;			/* Bytes accumulated since last wakeup */
+	bool armed;			/* Deadline is valid */
+	bool kick;			/* Wakeup requested, drain the queue */
+	struct timespec deadline;	/* Flush time for deferred frames */
+};
+
 /*
  * IOC state types.
  */
@@ -798,6 +811,7 @@ struct ioc_dev {
 	char rx_name[16];		/* Rx thread name */
 	struct cbc_qhead rx_qhead;	/* Rx queue head */
 	struct cbc_config rx_config;	/* Rx configuration */
+	struct cbc_watermark rx_wm;	/* Rx wakeup batching */
 	pthread_t rx_tid;
 	pthread_cond_t rx_cond;
 	pthread_mutex_t rx_mtx;
@@ -806,6 +820,7 @@ struct ioc_dev {
 	char tx_name[16];		/* Tx thread name */
 	struct cbc_qhead tx_qhead;	/* Tx queue head */
 	struct cbc_config tx_config;	/* Tx configuration */
+	struct cbc_watermark tx_wm;	/* Tx wakeup batching */
 	pthread_t tx_tid;
 	pthread_cond_t tx_cond;
 	pthread_mutex_t tx_mtx;
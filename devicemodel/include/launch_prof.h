@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _LAUNCH_PROF_H_
+#define _LAUNCH_PROF_H_
+
+#include "vmmapi.h"
+
+/*
+ * Guest launch-phase timeline. Call launch_prof_mark() when a launch
+ * phase completes; launch_prof_report() merges the device-model marks
+ * with the hypervisor-side stamps (create_vm, first vCPU wake) and
+ * prints one timeline once the guest is running.
+ */
+void	launch_prof_mark(const char *fmt, ...);
+void	launch_prof_report(struct vmctx *ctx);
+
+#endif /* _LAUNCH_PROF_H_ */
@@ -51,6 +51,9 @@ struct mem_range {
 #define	MEM_F_IMMUTABLE		0x4	/* mem_range cannot be unregistered */
 
 int	emulate_mem(struct vmctx *ctx, struct acrn_mmio_request *mmio_req);
+int	mmio_coalesce_register(struct vmctx *ctx, uint64_t base, uint64_t size);
+int	mmio_coalesce_unregister(struct vmctx *ctx, uint64_t base, uint64_t size);
+void	mmio_coalesced_drain(struct vmctx *ctx);
 int	register_mem(struct mem_range *memp);
 int	register_mem_fallback(struct mem_range *memp);
 int	unregister_mem(struct mem_range *memp);
@@ -43,6 +43,15 @@ struct mevent;
 struct mevent *mevent_add(int fd, enum ev_type type,
 			  void (*run)(int, enum ev_type, void *), void *param,
 			  void (*teardown)(void *), void *teardown_param);
+/*
+ * As mevent_add, but with a hint pinning the event to one of the worker
+ * event loops; events sharing an affinity value run on the same loop.
+ * A negative affinity spreads events round-robin.
+ */
+struct mevent *mevent_add_affinity(int fd, enum ev_type type,
+			  void (*run)(int, enum ev_type, void *), void *param,
+			  void (*teardown)(void *), void *teardown_param,
+			  int affinity);
 int	mevent_enable(struct mevent *evp);
 int	mevent_disable(struct mevent *evp);
 int	mevent_delete(struct mevent *evp);
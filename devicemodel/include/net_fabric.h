@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _NET_FABRIC_H_
+#define _NET_FABRIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+struct net_fabric_port;
+
+/*
+ * Join the host-local guest-to-guest switching fabric. The port announces
+ * the given MAC in the shared segment's forwarding table and spawns a
+ * receiver thread that invokes recv_cb (from that thread) for each frame
+ * a peer DM delivers. Returns NULL if the fabric segment cannot be set up
+ * or all ports are taken; the caller then simply keeps the TAP-only path.
+ */
+struct net_fabric_port *netfab_open(const uint8_t *mac,
+		void (*recv_cb)(void *arg, const void *frame, size_t len),
+		void *arg);
+
+void netfab_close(struct net_fabric_port *port);
+
+/*
+ * Try to deliver one outgoing frame directly to a peer guest. The frame
+ * is the iov stream with the first skip bytes (virtio header) dropped and
+ * len payload bytes following. Returns true only for a unicast frame
+ * whose destination MAC is registered by another port and whose ring had
+ * room - the caller must then *not* send the frame to the TAP, everything
+ * else falls back to the normal path.
+ */
+bool netfab_send(struct net_fabric_port *port, const struct iovec *iov,
+		int iovcnt, size_t skip, size_t len);
+
+#endif /* _NET_FABRIC_H_ */
@@ -33,6 +33,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "types.h"
 #include "pcireg.h"
 #include "log.h"
@@ -61,6 +62,14 @@ struct memory_region;
 struct pci_vdev_ops {
 	char	*class_name;		/* Name of device class */
 
+	/* Instances of this class may be initialized concurrently with
+	 * other parallel-safe devices during init_pci. Classes that
+	 * reserve fixed platform resources beyond the locked BAR and
+	 * INTx pin allocators (e.g. the LPC bridge claiming ISA IRQs)
+	 * must leave this clear so they keep their serial ordering.
+	 */
+	bool	parallel_init;
+
 	/* instance creation */
 	int	(*vdev_init)(struct vmctx *, struct pci_vdev *,
 			     char *opts);
@@ -90,8 +99,30 @@ struct pci_vdev_ops {
 	uint64_t  (*vdev_barread)(struct vmctx *ctx, int vcpu,
 				struct pci_vdev *pi, int baridx,
 				uint64_t offset, int size);
+
+	/* VM snapshot/restore callbacks, both optional. Called with the
+	 * guest paused; the device writes/reads its private runtime state
+	 * to/from the stream. Config space is saved generically.
+	 */
+	int	(*vdev_snapshot)(struct vmctx *ctx, struct pci_vdev *dev,
+			FILE *fp);
+	int	(*vdev_restore)(struct vmctx *ctx, struct pci_vdev *dev,
+			FILE *fp);
+
+	/* In-place warm reset, optional. Called with the guest paused
+	 * when the DM keeps the VM shell alive across guest restarts
+	 * (--keepalive); the device returns its emulated state to
+	 * power-on defaults without releasing BARs, interrupt pins or
+	 * host resources. Classes without this callback force the
+	 * caller back onto the full deinit/init cycle.
+	 */
+	int	(*vdev_reset_fast)(struct vmctx *ctx, struct pci_vdev *dev);
 };
 
+int	pci_snapshot_devices(struct vmctx *ctx, FILE *fp);
+int	pci_restore_devices(struct vmctx *ctx, FILE *fp);
+int	pci_reset_devices_fast(struct vmctx *ctx);
+
 /*
  * Put all PCI instances' addresses into one section named pci_devemu_set
  * so that DM could enumerate and initialize each of them.
@@ -138,6 +169,10 @@ enum lintr_stat {
 struct pci_vdev {
 	struct pci_vdev_ops *dev_ops;
 	struct vmctx *vmctx;
+	/* hugepage-backed arena for this device's emulation state; NULL
+	 * when the mapping failed and allocations fell back to the heap
+	 */
+	struct dm_arena *arena;
 	uint8_t	bus, slot, func;
 	char	name[PI_NAMESZ];
 	int	bar_getsize;
@@ -81,6 +81,12 @@
 	_IO(ACRN_IOCTL_TYPE, 0x15)
 #define ACRN_IOCTL_SET_VCPU_REGS	\
 	_IOW(ACRN_IOCTL_TYPE, 0x16, struct acrn_vcpu_regs)
+#define ACRN_IOCTL_GET_LAUNCH_PROFILE	\
+	_IOR(ACRN_IOCTL_TYPE, 0x17, struct acrn_vm_launch_profile)
+#define ACRN_IOCTL_GET_VCPU_REGS	\
+	_IOWR(ACRN_IOCTL_TYPE, 0x18, struct acrn_vcpu_regs)
+#define ACRN_IOCTL_SET_RDT_CONFIG	\
+	_IOW(ACRN_IOCTL_TYPE, 0x19, struct acrn_rdt_config)
 
 /* IRQ and Interrupts */
 #define ACRN_IOCTL_INJECT_MSI		\
@@ -107,6 +113,8 @@
 	_IOW(ACRN_IOCTL_TYPE, 0x41, struct acrn_vm_memmap)
 #define ACRN_IOCTL_UNSET_MEMSEG		\
 	_IOW(ACRN_IOCTL_TYPE, 0x42, struct acrn_vm_memmap)
+#define ACRN_IOCTL_VM_DIRTY_TRACK	\
+	_IOW(ACRN_IOCTL_TYPE, 0x43, struct acrn_dirty_track)
 
 /* PCI assignment*/
 #define ACRN_IOCTL_SET_PTDEV_INTR	\
@@ -181,6 +189,71 @@ struct acrn_vm_memmap {
 	__u64	len;
 };
 
+/* Commands of ACRN_IOCTL_VM_DIRTY_TRACK */
+#define ACRN_DIRTY_TRACK_START		0
+#define ACRN_DIRTY_TRACK_HARVEST	1
+#define ACRN_DIRTY_TRACK_STOP		2
+
+/**
+ * @brief EPT dirty-page tracking control for iterative pre-copy of
+ *        live guest memory
+ *
+ * The hypervisor sets one bit per dirtied 4K guest page in the caller
+ * provided bitmap. The caller atomically reads and clears bitmap bits
+ * after a harvest re-armed the logging; the final round must be taken
+ * with the guest paused.
+ */
+struct acrn_dirty_track {
+	/** ACRN_DIRTY_TRACK_START/HARVEST/STOP */
+	__u32	cmd;
+	__u32	reserved;
+	/** user virtual address of the dirty bitmap, one bit per 4K guest
+	 *  page, 8 byte aligned; only used by ACRN_DIRTY_TRACK_START
+	 */
+	__u64	bitmap_uaddr;
+	/** size of the bitmap in bytes */
+	__u64	bitmap_size;
+};
+
+/**
+ * @brief TSC stamps the hypervisor recorded while bringing the VM up,
+ *        filled in by ACRN_IOCTL_GET_LAUNCH_PROFILE
+ *
+ * Stamps of phases that have not happened yet read as 0.
+ */
+struct acrn_vm_launch_profile {
+	/** TSC frequency in kHz, for converting stamps to wall time */
+	__u32	tsc_khz;
+	__u32	reserved;
+	/** TSC when create_vm() was entered */
+	__u64	create_vm_entry;
+	/** TSC when create_vm() returned */
+	__u64	create_vm_exit;
+	/** TSC when the BSP was first woken to run */
+	__u64	first_vcpu_launch;
+};
+
+/* RDT resource ids for struct acrn_rdt_config */
+#define ACRN_RDT_RES_L3		0U
+#define ACRN_RDT_RES_L2		1U
+#define ACRN_RDT_RES_MBA	2U
+
+/**
+ * @brief RDT CLOS configuration, passed to ACRN_IOCTL_SET_RDT_CONFIG
+ *
+ * Reprograms one CLOS of one RDT resource on every domain instance
+ * at runtime, Service VM only.
+ */
+struct acrn_rdt_config {
+	/** resource to program: one of ACRN_RDT_RES_* */
+	__u32	res;
+	/** CLOS id to program */
+	__u16	clos;
+	__u16	reserved;
+	/** capacity bitmask (L3/L2) or delay throttling value (MBA) */
+	__u64	value;
+};
+
 /* Type of interrupt of a passthrough device */
 #define ACRN_PTDEV_IRQ_INTX	0
 #define ACRN_PTDEV_IRQ_MSI	1
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+struct vmctx;
+
+/**
+ * @brief Save a snapshot of the paused guest to an image file.
+ *
+ * Serializes vCPU register state, emulated PCI device state and the guest
+ * memory image. The VM is paused before the state is read and is left
+ * paused; the caller decides whether to destroy or resume it.
+ *
+ * @param ctx Pointer to context of current virtual machine.
+ * @param path Image file to create.
+ *
+ * @return 0 on success and non-zero on fail.
+ */
+int vm_snapshot_save(struct vmctx *ctx, const char *path);
+
+/**
+ * @brief Restore guest state from a snapshot image before vCPUs start.
+ *
+ * Must be called after device init and software load and before the BSP
+ * is started; the DM must have been launched with the same memory and
+ * device configuration the image was taken with.
+ *
+ * @param ctx Pointer to context of current virtual machine.
+ * @param path Image file to restore from.
+ *
+ * @return 0 on success and non-zero on fail.
+ */
+int vm_snapshot_load(struct vmctx *ctx, const char *path);
+
+int acrn_parse_resume_file(char *arg);
+int acrn_parse_fork_file(char *arg);
+int vm_resume_from_snapshot(struct vmctx *ctx);
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _STALLMON_H_
+#define _STALLMON_H_
+
+/*
+ * Liveness instrumentation for DM worker threads.
+ *
+ * A worker registers once, then brackets every work item between
+ * stallmon_begin() (which records a one-line description of the item)
+ * and stallmon_end(). The begin/end path is a couple of stores plus one
+ * small snprintf and is always active; the watchdog thread that turns a
+ * long-running item into a stall report only exists when the DM is
+ * started with --stall_watchdog. A detected stall is dumped to the log
+ * and escalated once to life_mngr over its monitor socket.
+ */
+
+struct stallmon_worker;
+
+/* start the watchdog thread; items busy longer than timeout_sec stall */
+int stallmon_init(int timeout_sec);
+void stallmon_deinit(void);
+
+/* never fails: when the worker table is full a discard slot is returned */
+struct stallmon_worker *stallmon_register(const char *fmt, ...);
+
+void stallmon_begin(struct stallmon_worker *wkr, const char *fmt, ...);
+void stallmon_end(struct stallmon_worker *wkr);
+
+#endif
@@ -63,6 +63,13 @@ struct surface {
 	uint32_t height;
 	uint32_t bpp;
 	uint32_t stride;
+	/* damage rectangle of this update; zero width/height means the
+	 * caller did not track damage and the full surface is uploaded
+	 */
+	uint32_t damage_x;
+	uint32_t damage_y;
+	uint32_t damage_w;
+	uint32_t damage_h;
 	void *pixel;
 	struct  {
 		int dmabuf_fd;
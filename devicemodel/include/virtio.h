@@ -130,9 +130,13 @@
 #include <linux/virtio_config.h>
 #include <linux/virtio_pci.h>
 
+#include <unistd.h>
+
 #include "types.h"
 #include "timer.h"
 
+struct mevent;
+
 /**
  * @brief virtio API
  *
@@ -193,6 +197,7 @@ enum {
 #define	VIRTIO_TYPE_SCSI	8
 #define	VIRTIO_TYPE_9P		9
 #define	VIRTIO_TYPE_INPUT	18
+#define	VIRTIO_TYPE_FS		26
 
 /*
  * ACRN virtio device types
@@ -218,10 +223,12 @@ enum {
 #define	VIRTIO_VENDOR		0x1AF4
 #define	VIRTIO_DEV_NET		0x1000
 #define	VIRTIO_DEV_BLOCK	0x1001
+#define	VIRTIO_DEV_BALLOON	0x1002
 #define	VIRTIO_DEV_CONSOLE	0x1003
 #define	VIRTIO_DEV_RANDOM	0x1005
 #define	VIRTIO_DEV_GPU		0x1050
 #define	VIRTIO_DEV_VSOCK	0x1053
+#define	VIRTIO_DEV_FS		0x105a
 
 /*
  * ACRN virtio device IDs
@@ -245,6 +252,22 @@ enum {
 #define VIRTIO_CONFIG_S_NEEDS_RESET	0x40
 #endif
 
+/*
+ * VIRTIO_F_RING_PACKED is not defined
+ * in some environments's virtio_config.h
+ */
+#ifndef VIRTIO_F_RING_PACKED
+#define VIRTIO_F_RING_PACKED		34
+#endif
+
+/*
+ * VIRTIO_RING_F_EVENT_IDX is not defined
+ * in some environments's virtio_config.h
+ */
+#ifndef VIRTIO_RING_F_EVENT_IDX
+#define VIRTIO_RING_F_EVENT_IDX		29
+#endif
+
 /*
  * Bits in VIRTIO_PCI_ISR.  These apply only if not using MSI-X.
  *
@@ -364,6 +387,8 @@ struct virtio_base {
 	int backend_type;               /**< VBSU, VBSK or VHOST */
 	struct acrn_timer polling_timer; /**< timer for polling mode */
 	int polling_in_progress;        /**< The polling status */
+	void *doorbell_page;		/**< RAM backing the notify window */
+	uint64_t doorbell_gpa;		/**< guest address of the mapping */
 };
 
 #define	VIRTIO_BASE_LOCK(vb)					\
@@ -420,6 +445,19 @@ struct virtio_ops {
  * (but more easily) computable, and this time we'll compute them:
  * they're just XX_ring[N].
  */
+#define VQ_CHAIN_CACHE_SEGS	4	/* short direct chains only */
+
+/**
+ * @brief Cached layout of one translated descriptor chain.
+ */
+struct vq_chain_cache {
+	uint16_t nsegs;		/**< 0 while the entry is invalid */
+	struct vring_desc desc[VQ_CHAIN_CACHE_SEGS];
+				/**< guest view when it was translated */
+	void *hva[VQ_CHAIN_CACHE_SEGS];
+				/**< recorded host translations */
+};
+
 struct virtio_vq_info {
 	uint16_t qsize;		/**< size of this queue (a power of 2) */
 	void	(*notify)(void *, struct virtio_vq_info *);
@@ -447,6 +485,65 @@ struct virtio_vq_info {
 	uint32_t gpa_avail[2];	/**< gpa of avail_ring */
 	uint32_t gpa_used[2];	/**< gpa of used_ring */
 	bool enabled;		/**< whether the virtqueue is enabled */
+
+	/*
+	 * One-entry translation cache for the most recent indirect
+	 * descriptor table (VIRTIO_RING_F_INDIRECT_DESC).  Guests that
+	 * preallocate and reuse their indirect tables hit it on nearly
+	 * every chain, skipping the guest-to-host region lookup.
+	 */
+	uint64_t indir_gpa;	/**< gpa of the cached indirect table */
+	uint32_t indir_len;	/**< byte length of the cached table */
+	void *indir_hva;	/**< host address of the cached table */
+
+	/*
+	 * Per-slot chain recycling cache (split ring only).  Guests
+	 * repost the same buffers into the same ring slots -- the RX
+	 * fill path in particular reuses identical chains forever --
+	 * so remember the translated layout of the last chain headed
+	 * at each slot and reuse it when the guest hands back an
+	 * identical one, skipping the per-descriptor guest-to-host
+	 * translations.
+	 */
+	struct vq_chain_cache *chain_cache;
+				/**< one entry per ring slot, or NULL */
+
+	/*
+	 * Packed ring layout (VIRTIO_F_RING_PACKED).  The gpa_desc/
+	 * gpa_avail/gpa_used registers double as the descriptor ring,
+	 * driver event suppression and device event suppression
+	 * addresses; the split-ring pointers above stay unused while
+	 * the queue runs packed.
+	 */
+	volatile struct vring_packed_desc *pdesc;
+				/**< packed descriptor ring */
+	volatile struct vring_packed_desc_event *driver_event;
+				/**< driver event suppression area */
+	volatile struct vring_packed_desc_event *device_event;
+				/**< device event suppression area */
+	uint16_t *chain_ndescs;	/**< ring slots per buffer id, for reclaim */
+	uint16_t used_idx;	/**< next ring slot for a used descriptor */
+	uint16_t last_ndescs;	/**< slots of the last returned chain */
+	bool avail_wrap;	/**< driver ring wrap counter */
+	bool used_wrap;		/**< device ring wrap counter */
+
+	/*
+	 * Kernel shortcut for kicks and interrupts: the doorbell write is
+	 * completed by signaling kick_fd (registered as an ioeventfd with
+	 * the HSM) and interrupts are injected by writing call_fd (an
+	 * irqfd), so neither direction takes the userspace I/O-request
+	 * detour.  Both stay -1 when the shortcut is unavailable.
+	 */
+	int kick_fd;		/**< ioeventfd fed by doorbell writes */
+	int call_fd;		/**< irqfd injecting this queue's MSI-X */
+	struct mevent *kick_mevp;
+				/**< event loop registration of kick_fd */
+
+	struct acrn_timer intr_timer;
+				/**< interrupt coalescing timer, lazily set up */
+	uint64_t last_intr_ns;	/**< CLOCK_MONOTONIC time of last interrupt */
+	uint16_t intr_streak;	/**< consecutive closely-spaced interrupts */
+	bool intr_held;		/**< a deferred interrupt rides on intr_timer */
 };
 
 /* as noted above, these are sort of backwards, name-wise */
@@ -468,6 +565,34 @@ vq_ring_ready(struct virtio_vq_info *vq)
 	return ((vq->flags & VQ_ALLOC) == VQ_ALLOC);
 }
 
+/**
+ * @brief Is this queue using the packed ring layout?
+ *
+ * @param vq Pointer to struct virtio_vq_info.
+ *
+ * @return false on split ring and true on packed ring.
+ */
+static inline bool
+vq_is_packed(struct virtio_vq_info *vq)
+{
+	return (vq->base->negotiated_caps &
+		(1ULL << VIRTIO_F_RING_PACKED)) != 0;
+}
+
+/*
+ * A packed descriptor is available when its AVAIL flag matches the
+ * driver's wrap counter and its USED flag does not, see spec 2.7.1.
+ */
+static inline bool
+vq_packed_has_descs(struct virtio_vq_info *vq)
+{
+	uint16_t flags = vq->pdesc[vq->last_avail].flags;
+	bool avail = (flags & (1 << VRING_PACKED_DESC_F_AVAIL)) != 0;
+	bool used = (flags & (1 << VRING_PACKED_DESC_F_USED)) != 0;
+
+	return (avail == vq->avail_wrap) && (avail != used);
+}
+
 /**
  * @brief Are there "available" descriptors?
  *
@@ -481,11 +606,15 @@ static inline bool
 vq_has_descs(struct virtio_vq_info *vq)
 {
 	bool ret = false;
-	if (vq_ring_ready(vq) && vq->last_avail != vq->avail->idx) {
-		if ((uint16_t)((u_int)vq->avail->idx - vq->last_avail) > vq->qsize)
-			pr_err ("%s: no valid descriptor\n", vq->base->vops->name);
-		else
-			ret = true;
+	if (vq_ring_ready(vq)) {
+		if (vq_is_packed(vq))
+			ret = vq_packed_has_descs(vq);
+		else if (vq->last_avail != vq->avail->idx) {
+			if ((uint16_t)((u_int)vq->avail->idx - vq->last_avail) > vq->qsize)
+				pr_err ("%s: no valid descriptor\n", vq->base->vops->name);
+			else
+				ret = true;
+		}
 	}
 	return ret;
 
@@ -504,9 +633,15 @@ vq_has_descs(struct virtio_vq_info *vq)
 static inline void
 vq_interrupt(struct virtio_base *vb, struct virtio_vq_info *vq)
 {
-	if (pci_msix_enabled(vb->dev))
+	if (pci_msix_enabled(vb->dev)) {
+		uint64_t one = 1;
+
+		/* a registered irqfd injects straight from the kernel */
+		if (vq->call_fd >= 0 &&
+		    write(vq->call_fd, &one, sizeof(one)) == sizeof(one))
+			return;
 		pci_generate_msix(vb->dev, vq->msix_idx);
-	else {
+	} else {
 		VIRTIO_BASE_LOCK(vb);
 		vb->isr |= VIRTIO_PCI_ISR_QUEUES;
 		pci_generate_msi(vb->dev, 0);
@@ -572,6 +707,17 @@ void virtio_linkup(struct virtio_base *base, struct virtio_ops *vops,
  */
 int acrn_parse_virtio_poll_interval(const char *optarg);
 
+/**
+ * @brief Register one device type for dedicated busy polling
+ *
+ * @param optarg "devname[@pcpu]", e.g. "virtio-console@3"; the pcpu, if
+ *               given, pins the poller thread.
+ *
+ * @return fail -1 success 0
+ */
+int acrn_parse_virtio_polling(const char *optarg);
+void acrn_enable_virtio_doorbell(void);
+
 /**
  * @brief Initialize MSI-X vector capabilities if we're to use MSI-X,
  * or MSI capabilities if not.
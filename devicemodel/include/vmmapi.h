@@ -56,6 +56,7 @@ struct vmctx {
 	size_t  biosmem;
 	size_t  highmem;
 	char    *baseaddr;
+	uint32_t mem_gen;
 	char    *name;
 
 	/* fields to track virtual devices */
@@ -78,6 +79,45 @@ struct vmctx {
 #define	PROT_RW		(PROT_READ | PROT_WRITE)
 #define	PROT_ALL	(PROT_READ | PROT_WRITE | PROT_EXEC)
 
+/*
+ * Guest physical memory is backed by a single contiguous reservation at
+ * ctx->baseaddr, so translation is a constant-offset addition guarded by
+ * bounds checks against the lowmem and highmem regions. Keep it inline;
+ * it sits on every virtio descriptor access.
+ *
+ * Returns a non-NULL pointer iff [gaddr, gaddr+len) is entirely contained
+ * in the lowmem or highmem regions. In particular the guest MMIO hole
+ * translates to NULL, which the instruction emulation code depends on.
+ */
+static inline void *
+vm_gpa2hva(struct vmctx *ctx, vm_paddr_t gaddr, size_t len)
+{
+	if (ctx->lowmem > 0 &&
+	    gaddr < ctx->lowmem && len <= ctx->lowmem &&
+	    gaddr + len <= ctx->lowmem)
+		return (ctx->baseaddr + gaddr);
+
+	if (ctx->highmem > 0 && gaddr >= ctx->highmem_gpa_base &&
+	    gaddr < ctx->highmem_gpa_base + ctx->highmem &&
+	    len <= ctx->highmem &&
+	    gaddr + len <= ctx->highmem_gpa_base + ctx->highmem)
+		return (ctx->baseaddr + gaddr);
+
+	return NULL;
+}
+
+/*
+ * Generation counter bumped whenever the guest memory layout changes
+ * (memory setup/teardown, memseg remap). Device models caching host
+ * pointers obtained from vm_gpa2hva() can snapshot the generation and
+ * retranslate when it no longer matches.
+ */
+static inline uint32_t
+vm_mem_generation(struct vmctx *ctx)
+{
+	return *(volatile uint32_t *)&ctx->mem_gen;
+}
+
 struct vm_lapic_msi {
 	uint64_t	msg;
 	uint64_t	addr;
@@ -107,6 +147,7 @@ int	vm_create_ioreq_client(struct vmctx *ctx);
 int	vm_destroy_ioreq_client(struct vmctx *ctx);
 int	vm_attach_ioreq_client(struct vmctx *ctx);
 int	vm_notify_request_done(struct vmctx *ctx, int vcpu);
+int	vm_notify_all_request_done(struct vmctx *ctx);
 void	vm_clear_ioreq(struct vmctx *ctx);
 const char *vm_state_to_str(enum vm_suspend_how idx);
 void	vm_set_suspend_mode(enum vm_suspend_how how);
@@ -114,17 +155,32 @@ void	vm_set_suspend_mode(enum vm_suspend_how how);
 void	notify_vmloop_thread(void);
 #endif
 int	vm_get_suspend_mode(void);
+void	vm_set_keepalive(bool enable);
+bool	vm_get_keepalive(void);
 void	vm_destroy(struct vmctx *ctx);
 int	vm_parse_memsize(const char *optarg, size_t *memsize);
 int	vm_map_memseg_vma(struct vmctx *ctx, size_t len, vm_paddr_t gpa,
 	uint64_t vma, int prot);
+int	vm_unmap_memseg_vma(struct vmctx *ctx, size_t len, vm_paddr_t gpa);
 int	vm_setup_memory(struct vmctx *ctx, size_t len);
 void	vm_unsetup_memory(struct vmctx *ctx);
 bool	init_hugetlb(void);
 void	uninit_hugetlb(void);
 int	hugetlb_setup_memory(struct vmctx *ctx);
+int	vnuma_node_ranges(struct vmctx *ctx, int node, uint64_t ranges[2][2]);
+int	hugetlb_start_lazy_highmem(struct vmctx *ctx);
+int	hugetlb_start_mem_compress(struct vmctx *ctx);
+void	hugetlb_set_lazy_restore(int fd, uint64_t off);
+void	hugetlb_set_lazy_on_demand(void);
 void	hugetlb_unsetup_memory(struct vmctx *ctx);
+int	hugetlb_punch_gpa_hole(struct vmctx *ctx, vm_paddr_t gpa, size_t len);
+int	hugetlb_plug_gpa_hole(struct vmctx *ctx, vm_paddr_t gpa, size_t len);
 void	*vm_map_gpa(struct vmctx *ctx, vm_paddr_t gaddr, size_t len);
+int	vm_dirty_track_start(struct vmctx *ctx, void *bitmap, uint64_t bitmap_size);
+int	vm_dirty_track_harvest(struct vmctx *ctx);
+int	vm_dirty_track_stop(struct vmctx *ctx);
+int	vm_get_launch_profile(struct vmctx *ctx,
+			      struct acrn_vm_launch_profile *profile);
 uint32_t vm_get_lowmem_limit(struct vmctx *ctx);
 size_t	vm_get_lowmem_size(struct vmctx *ctx);
 size_t	vm_get_highmem_size(struct vmctx *ctx);
@@ -150,6 +206,7 @@ int	vm_remove_hv_vdev(struct vmctx *ctx, struct acrn_vdev *dev);
 int	acrn_parse_cpu_affinity(char *arg);
 uint64_t vm_get_cpu_affinity_dm(void);
 int	vm_set_vcpu_regs(struct vmctx *ctx, struct acrn_vcpu_regs *cpu_regs);
+int	vm_get_vcpu_regs(struct vmctx *ctx, struct acrn_vcpu_regs *cpu_regs);
 
 int	vm_get_cpu_state(struct vmctx *ctx, void *state_buf);
 int	vm_intr_monitor(struct vmctx *ctx, void *intr_buf);
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "types.h"
+#include "dm_arena.h"
+#include "log.h"
+
+struct dm_arena *
+dm_arena_create(const char *name, size_t size)
+{
+	struct dm_arena *arena;
+	void *base;
+
+	arena = calloc(1, sizeof(struct dm_arena));
+	if (arena == NULL)
+		return NULL;
+
+	size = roundup2(size, DM_ARENA_HUGEPAGE_SZ);
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (base == MAP_FAILED) {
+		/* no preallocated hugepages; fall back to THP */
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			pr_err("%s: failed to map %lu bytes for %s\n",
+				__func__, size, name);
+			free(arena);
+			return NULL;
+		}
+		if (madvise(base, size, MADV_HUGEPAGE) != 0)
+			pr_notice("%s: MADV_HUGEPAGE failed for %s\n",
+				__func__, name);
+	}
+
+	strncpy(arena->name, name, sizeof(arena->name) - 1);
+	arena->base = base;
+	arena->size = size;
+	arena->off = 0;
+
+	return arena;
+}
+
+void *
+dm_arena_zalloc(struct dm_arena *arena, size_t size)
+{
+	void *ptr = NULL;
+
+	if (arena != NULL) {
+		size = roundup2(size, DM_ARENA_ALIGN);
+		if (size <= (arena->size - arena->off)) {
+			ptr = arena->base + arena->off;
+			arena->off += size;
+			/* the mapping is zero-filled already; touching it here
+			 * pays the fault cost at allocation time instead of in
+			 * the device's I/O path
+			 */
+			memset(ptr, 0, size);
+		} else {
+			pr_err("arena %s exhausted: %lu bytes used, %lu requested\n",
+				arena->name, arena->off, size);
+		}
+	}
+
+	return ptr;
+}
+
+void
+dm_arena_destroy(struct dm_arena *arena)
+{
+	if (arena != NULL) {
+		munmap(arena->base, arena->size);
+		free(arena);
+	}
+}
@@ -0,0 +1,589 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * dm-bench: microbenchmarks for the device-model building blocks that
+ * sit on every I/O path, linked against the very objects that go into
+ * acrn-dm (hw/pci/virtio/virtio.o, hw/block_if.o, core/mevent.o) so a
+ * code change shows up here before it shows up in a guest.
+ *
+ * Three synthetic drivers replace the pieces that normally need a
+ * running VM:
+ *
+ *  - vq_chain replays a canned split-ring descriptor stream through
+ *    vq_getchain()/vq_relchain()/vq_endchains(), with guest memory
+ *    faked by a flat buffer behind paddr_guest2host().
+ *  - blockif drives blockif_read() against a sparse temporary file
+ *    (a null backend as far as the queueing logic is concerned) and
+ *    measures submit-to-completion latency.
+ *  - mevent_wake measures eventfd write-to-dispatch latency through
+ *    the mevent epoll loop.
+ *
+ * Results are printed as JSON (min/mean/p50/p99/p999 nanoseconds per
+ * operation) so runs on the same host can be compared commit to
+ * commit.  Build with "make dm-bench" in devicemodel/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include "dm.h"
+#include "vmmapi.h"
+#include "pci_core.h"
+#include "virtio.h"
+#include "block_if.h"
+#include "mevent.h"
+#include "timer.h"
+#include "log.h"
+#include "pm.h"
+
+#define DEFAULT_SAMPLES		20000
+#define WARMUP_SAMPLES		200
+
+#define GUEST_MEM_SIZE		(4UL * 1024UL * 1024UL)
+#define VQ_QSIZE		256
+#define VQ_CHAIN_LEN		3	/* hdr + data + status, virtio-blk style */
+#define VQ_NCHAINS		(VQ_QSIZE / VQ_CHAIN_LEN)
+
+#define BLOCKIF_FILE_SIZE	(64UL * 1024UL * 1024UL)
+#define BLOCKIF_IO_SIZE		4096UL
+
+static int num_samples = DEFAULT_SAMPLES;
+
+/* flat stand-in for guest physical memory; gpa == offset */
+static uint8_t *guest_mem;
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int bench_printed;
+
+static void
+report(const char *name, uint64_t *samples, int n)
+{
+	uint64_t sum = 0;
+	int i;
+
+	qsort(samples, n, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+
+	printf("%s\n    \"%s\": { \"samples\": %d, \"min\": %lu, "
+	       "\"mean\": %lu, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu }",
+	       bench_printed ? "," : "", name, n,
+	       samples[0], sum / (uint64_t)n,
+	       samples[n / 2],
+	       samples[((long)n * 99L) / 100L],
+	       samples[((long)n * 999L) / 1000L]);
+	bench_printed = 1;
+}
+
+static void
+report_skipped(const char *name, const char *reason)
+{
+	printf("%s\n    \"%s\": { \"skipped\": \"%s\" }",
+	       bench_printed ? "," : "", name, reason);
+	bench_printed = 1;
+}
+
+/*
+ * Stubs for the acrn-dm services the linked objects expect from a live
+ * VM.  Interrupt delivery and kernel-side fds are counted no-ops; guest
+ * memory translation maps gpa straight into the flat buffer.
+ */
+
+static uint64_t stub_intr_cnt;
+
+void *
+paddr_guest2host(struct vmctx *ctx, uintptr_t gaddr, size_t len)
+{
+	if (gaddr + len > GUEST_MEM_SIZE)
+		return NULL;
+	return guest_mem + gaddr;
+}
+
+void
+output_log(uint8_t level, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+void
+pci_generate_msi(struct pci_vdev *dev, int index)
+{
+	stub_intr_cnt++;
+}
+
+void
+pci_generate_msix(struct pci_vdev *dev, int index)
+{
+	stub_intr_cnt++;
+}
+
+void
+pci_lintr_assert(struct pci_vdev *dev)
+{
+	stub_intr_cnt++;
+}
+
+void
+pci_lintr_deassert(struct pci_vdev *dev)
+{
+}
+
+void
+pci_lintr_request(struct pci_vdev *pi)
+{
+}
+
+int
+pci_msix_enabled(struct pci_vdev *pi)
+{
+	return 1;
+}
+
+int
+pci_msix_table_bar(struct pci_vdev *pi)
+{
+	return -1;
+}
+
+int
+pci_msix_pba_bar(struct pci_vdev *pi)
+{
+	return -1;
+}
+
+int
+pci_emul_alloc_bar(struct pci_vdev *pdi, int idx, enum pcibar_type type,
+		   uint64_t size)
+{
+	return 0;
+}
+
+int
+pci_emul_add_capability(struct pci_vdev *dev, u_char *capdata, int caplen)
+{
+	return 0;
+}
+
+int
+pci_emul_find_capability(struct pci_vdev *dev, uint8_t capid, int *p_capoff)
+{
+	return -1;
+}
+
+int
+pci_emul_add_msicap(struct pci_vdev *pi, int msgnum)
+{
+	return 0;
+}
+
+int
+pci_emul_add_msixcap(struct pci_vdev *pi, int msgnum, int barnum)
+{
+	return 0;
+}
+
+int
+pci_emul_msix_twrite(struct pci_vdev *pi, uint64_t offset, int size,
+		     uint64_t value)
+{
+	return 0;
+}
+
+uint64_t
+pci_emul_msix_tread(struct pci_vdev *pi, uint64_t offset, int size)
+{
+	return 0;
+}
+
+int
+vm_ioeventfd(struct vmctx *ctx, struct acrn_ioeventfd *args)
+{
+	return -1;
+}
+
+int
+vm_irqfd(struct vmctx *ctx, struct acrn_irqfd *args)
+{
+	return -1;
+}
+
+int
+acrn_timer_init(struct acrn_timer *timer, void (*cb)(void *, uint64_t),
+		void *param)
+{
+	return -1;
+}
+
+void
+acrn_timer_deinit(struct acrn_timer *timer)
+{
+}
+
+int
+acrn_timer_settime(struct acrn_timer *timer, const struct itimerspec *new_value)
+{
+	return -1;
+}
+
+int
+vm_get_suspend_mode(void)
+{
+	return VM_SUSPEND_NONE;
+}
+
+/*
+ * vq_chain: canned split-ring descriptor stream.
+ *
+ * Ring layout in fake guest memory:
+ *   0x0000  descriptor table (VQ_QSIZE * 16)
+ *   0x2000  avail ring
+ *   0x3000  used ring
+ *   0x10000 data buffers, VQ_CHAIN_LEN per slot
+ */
+static struct virtio_ops bench_vops = {
+	.name = "dm-bench",
+	.nvq = 1,
+};
+
+static void
+bench_vq_chain(void)
+{
+	struct pci_vdev dev;
+	struct virtio_base base;
+	struct virtio_vq_info vq;
+	volatile struct vring_desc *desc;
+	volatile struct vring_avail *avail;
+	struct iovec iov[VQ_CHAIN_LEN + 1];
+	uint64_t *samples;
+	uint16_t didx;
+	uint64_t t0;
+	int i, j, n;
+
+	memset(&dev, 0, sizeof(dev));
+	memset(&base, 0, sizeof(base));
+	memset(&vq, 0, sizeof(vq));
+
+	base.vops = &bench_vops;
+	base.dev = &dev;
+	base.queues = &vq;
+
+	vq.base = &base;
+	vq.qsize = VQ_QSIZE;
+	vq.flags = VQ_ALLOC;
+	vq.enabled = true;
+	vq.call_fd = -1;
+	vq.msix_idx = 0;
+	vq.desc = (volatile struct vring_desc *)(guest_mem + 0x0000);
+	vq.avail = (volatile struct vring_avail *)(guest_mem + 0x2000);
+	vq.used = (volatile struct vring_used *)(guest_mem + 0x3000);
+
+	desc = vq.desc;
+	avail = vq.avail;
+
+	/*
+	 * Pre-build VQ_QSIZE/VQ_CHAIN_LEN chains once; the replay loop
+	 * only republishes head indices, the way a driver reuses
+	 * descriptors.
+	 */
+	for (i = 0; i < VQ_NCHAINS; i++) {
+		for (j = 0; j < VQ_CHAIN_LEN; j++) {
+			int d = i * VQ_CHAIN_LEN + j;
+
+			desc[d].addr = 0x10000UL +
+				(uint64_t)d * BLOCKIF_IO_SIZE;
+			desc[d].len = BLOCKIF_IO_SIZE;
+			if (j < VQ_CHAIN_LEN - 1) {
+				desc[d].flags = VRING_DESC_F_NEXT;
+				desc[d].next = d + 1;
+			} else {
+				desc[d].flags = VRING_DESC_F_WRITE;
+				desc[d].next = 0;
+			}
+		}
+	}
+
+	samples = calloc(num_samples, sizeof(uint64_t));
+	if (samples == NULL) {
+		report_skipped("vq_chain", "out of memory");
+		return;
+	}
+
+	for (i = -WARMUP_SAMPLES; i < num_samples; i++) {
+		uint16_t head = (uint16_t)(((u_int)avail->idx % VQ_NCHAINS) *
+				VQ_CHAIN_LEN);
+
+		avail->ring[avail->idx % VQ_QSIZE] = head;
+		avail->idx++;
+
+		t0 = now_ns();
+		n = vq_getchain(&vq, &didx, iov, VQ_CHAIN_LEN + 1, NULL);
+		if (n != VQ_CHAIN_LEN) {
+			free(samples);
+			report_skipped("vq_chain", "vq_getchain failed");
+			return;
+		}
+		vq_relchain(&vq, didx, BLOCKIF_IO_SIZE);
+		vq_endchains(&vq, 1);
+		if (i >= 0)
+			samples[i] = now_ns() - t0;
+	}
+
+	report("vq_chain", samples, num_samples);
+	free(samples);
+}
+
+/*
+ * blockif: submit-to-completion latency of 4K reads against a sparse
+ * temporary file.  The file is never written, so every read is served
+ * from the page cache hole path; what remains is blockif's own
+ * queueing, worker wakeup and completion machinery.
+ */
+static sem_t blockif_done;
+static int blockif_err;
+
+static void
+blockif_cb(struct blockif_req *req, int err)
+{
+	blockif_err = err;
+	sem_post(&blockif_done);
+}
+
+static void
+bench_blockif(void)
+{
+	char path[] = "/tmp/dm-bench-XXXXXX";
+	char optstr[64];
+	struct blockif_ctxt *bc;
+	struct blockif_req req;
+	uint8_t *buf;
+	uint64_t *samples;
+	uint64_t t0;
+	int fd, i;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		report_skipped("blockif", "mkstemp failed");
+		return;
+	}
+	if (ftruncate(fd, BLOCKIF_FILE_SIZE) < 0) {
+		close(fd);
+		unlink(path);
+		report_skipped("blockif", "ftruncate failed");
+		return;
+	}
+	close(fd);
+
+	snprintf(optstr, sizeof(optstr), "%s", path);
+	bc = blockif_open(optstr, "dm-bench");
+	if (bc == NULL) {
+		unlink(path);
+		report_skipped("blockif", "blockif_open failed");
+		return;
+	}
+
+	buf = malloc(BLOCKIF_IO_SIZE);
+	samples = calloc(num_samples, sizeof(uint64_t));
+	if (buf == NULL || samples == NULL) {
+		free(buf);
+		free(samples);
+		blockif_close(bc);
+		unlink(path);
+		report_skipped("blockif", "out of memory");
+		return;
+	}
+
+	sem_init(&blockif_done, 0, 0);
+
+	memset(&req, 0, sizeof(req));
+	req.iov[0].iov_base = buf;
+	req.iov[0].iov_len = BLOCKIF_IO_SIZE;
+	req.iovcnt = 1;
+	req.callback = blockif_cb;
+
+	for (i = -WARMUP_SAMPLES; i < num_samples; i++) {
+		req.offset = (off_t)(((uint64_t)(i + WARMUP_SAMPLES) *
+				BLOCKIF_IO_SIZE) % BLOCKIF_FILE_SIZE);
+		req.resid = BLOCKIF_IO_SIZE;
+
+		t0 = now_ns();
+		if (blockif_read(bc, &req) != 0) {
+			report_skipped("blockif", "blockif_read failed");
+			goto out;
+		}
+		sem_wait(&blockif_done);
+		if (blockif_err != 0) {
+			report_skipped("blockif", "read completion error");
+			goto out;
+		}
+		if (i >= 0)
+			samples[i] = now_ns() - t0;
+	}
+
+	report("blockif", samples, num_samples);
+out:
+	sem_destroy(&blockif_done);
+	free(buf);
+	free(samples);
+	blockif_close(bc);
+	unlink(path);
+}
+
+/*
+ * mevent_wake: eventfd write-to-dispatch latency through the mevent
+ * epoll loop, the path every backend notification takes.
+ */
+static sem_t mevent_done;
+static volatile uint64_t mevent_t1;
+
+static void
+mevent_bench_handler(int fd, enum ev_type type, void *param)
+{
+	eventfd_t val;
+
+	mevent_t1 = now_ns();
+	eventfd_read(fd, &val);
+	sem_post(&mevent_done);
+}
+
+static void *
+mevent_loop(void *arg)
+{
+	mevent_dispatch();
+	return NULL;
+}
+
+static void
+bench_mevent(void)
+{
+	pthread_t thr;
+	struct mevent *evp;
+	uint64_t *samples;
+	uint64_t t0;
+	int efd, i;
+
+	if (mevent_init() < 0) {
+		report_skipped("mevent_wake", "mevent_init failed");
+		return;
+	}
+	if (pthread_create(&thr, NULL, mevent_loop, NULL) != 0) {
+		report_skipped("mevent_wake", "pthread_create failed");
+		return;
+	}
+
+	efd = eventfd(0, EFD_NONBLOCK);
+	if (efd < 0) {
+		report_skipped("mevent_wake", "eventfd failed");
+		return;
+	}
+
+	sem_init(&mevent_done, 0, 0);
+	evp = mevent_add(efd, EVF_READ, mevent_bench_handler, NULL,
+			 NULL, NULL);
+	if (evp == NULL) {
+		close(efd);
+		report_skipped("mevent_wake", "mevent_add failed");
+		return;
+	}
+
+	samples = calloc(num_samples, sizeof(uint64_t));
+	if (samples == NULL) {
+		mevent_delete_close(evp);
+		report_skipped("mevent_wake", "out of memory");
+		return;
+	}
+
+	for (i = -WARMUP_SAMPLES; i < num_samples; i++) {
+		t0 = now_ns();
+		eventfd_write(efd, 1);
+		sem_wait(&mevent_done);
+		if (i >= 0)
+			samples[i] = mevent_t1 - t0;
+	}
+
+	report("mevent_wake", samples, num_samples);
+	free(samples);
+	mevent_delete_close(evp);
+	sem_destroy(&mevent_done);
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n samples]\n"
+		"    -h             print this message\n"
+		"    -n samples     samples per benchmark (default %d)\n",
+		prog, DEFAULT_SAMPLES);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "hn:")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_samples = atoi(optarg);
+			if (num_samples < 1000) {
+				fprintf(stderr, "need at least 1000 samples\n");
+				return 1;
+			}
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	guest_mem = calloc(1, GUEST_MEM_SIZE);
+	if (guest_mem == NULL) {
+		fprintf(stderr, "failed to allocate fake guest memory\n");
+		return 1;
+	}
+
+	printf("{\n  \"unit\": \"ns\",\n  \"benchmarks\": {");
+	bench_vq_chain();
+	bench_blockif();
+	bench_mevent();
+	printf("\n  }\n}\n");
+
+	free(guest_mem);
+	return 0;
+}
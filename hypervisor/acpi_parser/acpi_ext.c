@@ -112,16 +112,36 @@ static void *get_facs_table(const uint8_t *facp_addr)
 	return (void *)facs_addr;
 }
 
-/* @pre mcfg_addr != NULL */
+/* Walk every MCFG allocation entry. The first segment-0 entry becomes the
+ * primary ECAM region (the one exposed to the Service VM); further segment-0
+ * entries are registered as additional regions so buses outside the primary
+ * bus range can still be scanned. Entries for other segment groups are
+ * skipped: BDFs are 16 bits throughout the hypervisor, so devices there
+ * cannot be addressed anyway.
+ *
+ * @pre mcfg_addr != NULL
+ */
 static struct acpi_mcfg_allocation *parse_mcfg_allocation_tables(const uint8_t *mcfg_addr)
 {
-	struct acpi_mcfg_allocation *mcfg_table = NULL;
+	struct acpi_mcfg_allocation *mcfg_table = NULL, *entry;
 	uint32_t length = get_acpi_dt_dword(mcfg_addr, OFFSET_MCFG_LENGTH);
-
-	if (length > OFFSET_MCFG_ENTRY1) {
-		pr_fatal("Multiple PCI segment groups is not supported!");
-	} else {
-		mcfg_table = (struct acpi_mcfg_allocation *)(mcfg_addr + OFFSET_MCFG_ENTRY0_BASE);
+	uint32_t i, nr_entries;
+
+	if (length >= OFFSET_MCFG_ENTRY1) {
+		nr_entries = (length - OFFSET_MCFG_ENTRY0_BASE) / (uint32_t)sizeof(struct acpi_mcfg_allocation);
+
+		for (i = 0U; i < nr_entries; i++) {
+			entry = (struct acpi_mcfg_allocation *)(mcfg_addr + OFFSET_MCFG_ENTRY0_BASE)
+					+ i;
+			if (entry->pci_segment != 0U) {
+				pr_warn("MCFG: PCI segment group %u (bus %x-%x) is not supported, skipped",
+					entry->pci_segment, entry->start_bus_number, entry->end_bus_number);
+			} else if (mcfg_table == NULL) {
+				mcfg_table = entry;
+			} else {
+				add_mmcfg_region((const struct pci_mmcfg_region *)entry);
+			}
+		}
 	}
 	return mcfg_table;
 }
@@ -25,6 +25,7 @@
 #include <asm/vmx.h>
 #include <asm/msr.h>
 #include <ptdev.h>
+#include <dmacpy.h>
 #include <logmsg.h>
 #include <asm/rdt.h>
 #include <asm/sgx.h>
@@ -32,10 +33,12 @@
 #include <vpci.h>
 #include <ivshmem.h>
 #include <asm/rtcm.h>
+#include <asm/host_pm.h>
 #include <reloc.h>
 #include <asm/tsc.h>
 #include <ticks.h>
 #include <delay.h>
+#include <vcpu_watchdog.h>
 
 #define CPU_UP_TIMEOUT		100U /* millisecond */
 #define CPU_DOWN_TIMEOUT	100U /* millisecond */
@@ -189,6 +192,9 @@ void init_pcpu_pre(bool is_bsp)
 			panic("System IOAPIC info is incorrect!");
 		}
 
+		/* needs the per-cpu lapic ids; per-VM page pools are placed by node later */
+		init_numa_nodes();
+
 #ifdef CONFIG_VCAT_ENABLED
 		init_intercepted_cat_msr_list();
 #endif
@@ -231,6 +237,8 @@ void init_pcpu_post(uint16_t pcpu_id)
 
 	init_pcpu_xsave();
 
+	init_hwp();
+
 	if (pcpu_id == BSP_CPU_ID) {
 		/* Print Hypervisor Banner */
 		print_hv_banner();
@@ -271,6 +279,7 @@ void init_pcpu_post(uint16_t pcpu_id)
 		init_ivshmem_shared_memory();
 #endif
 		init_pci_pdev_list(); /* init_iommu must come before this */
+		dmacpy_init();
 		ptdev_init();
 
 		if (init_sgx() != 0) {
@@ -310,6 +319,8 @@ void init_pcpu_post(uint16_t pcpu_id)
 
 	init_sched(pcpu_id);
 
+	init_vcpu_watchdog(pcpu_id);
+
 #ifdef CONFIG_RDT_ENABLED
 	setup_clos(pcpu_id);
 #endif
@@ -355,23 +366,24 @@ static void start_pcpu(uint16_t pcpu_id)
 	cpu_memory_barrier();
 	send_startup_ipi(pcpu_id, startup_paddr);
 
-	/* Wait until the pcpu with pcpu_id is running and set the active bitmap or
-	 * configured time-out has expired
+	/* The trampoline clears secondary_cpu_stack right after loading it
+	 * into RSP, which is the earliest point the slot may be reused. Wait
+	 * only for that hand-off here, so the next AP can be kicked while
+	 * this one is still initializing; full activation is checked for all
+	 * APs together in start_pcpus().
 	 */
 	timeout = CPU_UP_TIMEOUT * 1000U;
-	while (!is_pcpu_active(pcpu_id) && (timeout != 0U)) {
+	stac();
+	while ((read_trampoline_sym(secondary_cpu_stack) != 0UL) && (timeout != 0U)) {
+		clac();
 		/* Delay 10us */
 		udelay(10U);
+		stac();
 
 		/* Decrement timeout value */
 		timeout -= 10U;
 	}
-
-	/* Check to see if expected CPU is actually up */
-	if (!is_pcpu_active(pcpu_id)) {
-		pr_fatal("Secondary CPU%hu failed to come up", pcpu_id);
-		pcpu_set_current_state(pcpu_id, PCPU_STATE_DEAD);
-	}
+	clac();
 }
 
 
@@ -386,21 +398,50 @@ static void start_pcpu(uint16_t pcpu_id)
 bool start_pcpus(uint64_t mask)
 {
 	uint16_t i;
+	uint32_t timeout;
+	uint64_t failed_mask;
 	uint16_t pcpu_id = get_pcpu_id();
 	uint64_t expected_start_mask = mask;
+	uint64_t started_mask = 0UL;
 
 	i = ffs64(expected_start_mask);
 	while (i != INVALID_BIT_INDEX) {
 		bitmap_clear_nolock(i, &expected_start_mask);
 
-		if (pcpu_id == i) {
-			continue; /* Avoid start itself */
+		if (pcpu_id != i) { /* Avoid start itself */
+			/* start_pcpu() returns once the AP owns its stack, so
+			 * the APs kicked here run their initialization
+			 * concurrently.
+			 */
+			start_pcpu(i);
+			bitmap_set_nolock(i, &started_mask);
 		}
 
-		start_pcpu(i);
 		i = ffs64(expected_start_mask);
 	}
 
+	/* Wait until all kicked pcpus are running and have set their bits in
+	 * pcpu_active_bitmap, or the configured time-out has expired
+	 */
+	timeout = CPU_UP_TIMEOUT * 1000U;
+	while (((pcpu_active_bitmap & started_mask) != started_mask) && (timeout != 0U)) {
+		/* Delay 10us */
+		udelay(10U);
+
+		/* Decrement timeout value */
+		timeout -= 10U;
+	}
+
+	/* Check to see if all expected CPUs are actually up */
+	failed_mask = started_mask & ~pcpu_active_bitmap;
+	i = ffs64(failed_mask);
+	while (i != INVALID_BIT_INDEX) {
+		bitmap_clear_nolock(i, &failed_mask);
+		pr_fatal("Secondary CPU%hu failed to come up", i);
+		pcpu_set_current_state(i, PCPU_STATE_DEAD);
+		i = ffs64(failed_mask);
+	}
+
 	return ((pcpu_active_bitmap & mask) == mask);
 }
 
@@ -450,11 +491,6 @@ void stop_pcpus(void)
 	wait_pcpus_offline(mask);
 }
 
-void cpu_do_idle(void)
-{
-	asm_pause();
-}
-
 /**
  * only run on current pcpu
  */
@@ -514,6 +550,65 @@ inline void asm_mwait(uint64_t eax, uint64_t ecx)
 	asm volatile("mwait\n" : : "a" (eax), "c" (ecx));
 }
 
+/* mwait hints: bits [7:4] select the target C-state minus one, see SDM MWAIT */
+#define IDLE_MWAIT_HINT_C1	0x00UL
+#define IDLE_MWAIT_HINT_C6	0x20UL
+
+bool cpu_idle_mwait_armed(uint16_t pcpu_id)
+{
+	return (per_cpu(idle_mwait_armed, pcpu_id) != 0UL);
+}
+
+/* deepest hint the part supports, resolved once from CPUID leaf 5 */
+static uint64_t idle_deep_mwait_hint(void)
+{
+	static uint64_t hint = ~0UL;
+
+	if (hint == ~0UL) {
+		uint32_t eax, ebx, ecx, edx;
+
+		cpuid_subleaf(0x5U, 0x0U, &eax, &ebx, &ecx, &edx);
+		/* edx[27:24] is the number of C6 sub-states mwait knows */
+		hint = (((edx >> 24U) & 0xfU) != 0U) ? IDLE_MWAIT_HINT_C6 : IDLE_MWAIT_HINT_C1;
+	}
+	return hint;
+}
+
+/*
+ * Governed idle, entered from default_idle() with interrupts enabled.
+ *
+ * With monitor/mwait available the idle pCPU arms the monitor on its own
+ * sched_ctl.flags word, so the flag store done by a remote
+ * make_reschedule_request() is itself the wakeup and the notification IPI
+ * can be skipped (see the idle_mwait_armed handshake there). The armed
+ * flag is published with a locked op before flags is re-checked, pairing
+ * with the locked set on the requester side, so a request can never fall
+ * between the check and the mwait.
+ *
+ * The mwait depth follows the pCPU's wakeup-latency class: pCPUs hosting
+ * an RT vCPU stay in C1, power-optimized pCPUs may sink to C6. Offline
+ * and shutdown requests still raise an IPI, which breaks mwait as well.
+ */
+void cpu_do_idle(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	struct sched_control *ctl = &per_cpu(sched_ctl, pcpu_id);
+
+	if (has_monitor_cap()) {
+		uint64_t hint = (per_cpu(idle_class, pcpu_id) == IDLE_CLASS_SHALLOW) ?
+				IDLE_MWAIT_HINT_C1 : idle_deep_mwait_hint();
+
+		bitmap_set_lock(0U, &per_cpu(idle_mwait_armed, pcpu_id));
+		asm_monitor(&ctl->flags, 0UL, 0UL);
+		if (ctl->flags == 0UL) {
+			asm_mwait(hint, 0UL);
+		}
+		bitmap_clear_lock(0U, &per_cpu(idle_mwait_armed, pcpu_id));
+	} else {
+		asm_pause();
+	}
+}
+
 /* wait until *sync == wake_sync */
 void wait_sync_change(volatile const uint64_t *sync, uint64_t wake_sync)
 {
@@ -321,6 +321,68 @@ static uint64_t get_address_mask(uint8_t limit)
 	return ((1UL << limit) - 1UL) & PAGE_MASK;
 }
 
+/* number of low x2APIC ID bits that select a logical processor within the
+ * last level cache domain, derived from CPUID leaf 4
+ */
+static uint32_t llc_id_shift;
+
+static void detect_llc_topology(void)
+{
+	uint32_t subleaf, eax, unused;
+	uint32_t cache_level, max_level = 0U, max_sharing = 1U;
+
+	for (subleaf = 0U; subleaf < 16U; subleaf++) {
+		cpuid_subleaf(CPUID_CACHE_PARAMS, subleaf, &eax, &unused, &unused, &unused);
+		if ((eax & 0x1fU) == 0U) {
+			break;
+		}
+		cache_level = (eax >> 5U) & 0x7U;
+		if (cache_level > max_level) {
+			max_level = cache_level;
+			max_sharing = ((eax >> 14U) & 0xfffU) + 1U;
+		}
+	}
+
+	llc_id_shift = 0U;
+	while ((1U << llc_id_shift) < max_sharing) {
+		llc_id_shift++;
+	}
+}
+
+bool pcpus_share_llc(uint16_t pcpu_id1, uint16_t pcpu_id2)
+{
+	return ((per_cpu(lapic_id, pcpu_id1) >> llc_id_shift) ==
+		(per_cpu(lapic_id, pcpu_id2) >> llc_id_shift));
+}
+
+/* number of low x2APIC ID bits that select a logical processor within a
+ * physical core, from the SMT level of CPUID leaf 0xB
+ */
+static uint32_t smt_id_shift;
+
+static void detect_smt_topology(void)
+{
+	uint32_t subleaf, eax, ebx, ecx, unused;
+
+	for (subleaf = 0U; subleaf < 8U; subleaf++) {
+		cpuid_subleaf(CPUID_EXTEND_TOPOLOGY, subleaf, &eax, &ebx, &ecx, &unused);
+		if (ebx == 0U) {
+			break;
+		}
+		if (((ecx >> 8U) & 0xffU) == 1U) {
+			/* level type SMT */
+			smt_id_shift = eax & 0x1fU;
+			break;
+		}
+	}
+}
+
+bool pcpus_are_smt_siblings(uint16_t pcpu_id1, uint16_t pcpu_id2)
+{
+	return ((per_cpu(lapic_id, pcpu_id1) >> smt_id_shift) ==
+		(per_cpu(lapic_id, pcpu_id2) >> smt_id_shift));
+}
+
 void init_pcpu_capabilities(void)
 {
 	uint32_t eax, unused;
@@ -385,6 +447,10 @@ void init_pcpu_capabilities(void)
 	}
 
 	detect_pcpu_cap();
+
+	detect_llc_topology();
+
+	detect_smt_topology();
 }
 
 static bool is_ept_supported(void)
@@ -407,6 +473,15 @@ bool pcpu_has_vmx_ept_vpid_cap(uint64_t bit_mask)
 	return ((cpu_caps.vmx_ept_vpid & bit_mask) != 0U);
 }
 
+bool is_ept_dirty_logging_supported(void)
+{
+	/* dirty-page tracking needs both the EPT A/D flags and PML
+	 * (Page-Modification Logging) to be available
+	 */
+	return (pcpu_has_vmx_ept_vpid_cap(VMX_EPT_AD) &&
+		is_ctrl_setting_allowed(msr_read(MSR_IA32_VMX_PROCBASED_CTLS2), VMX_PROCBASED_CTLS2_PML));
+}
+
 void init_pcpu_model_name(void)
 {
 	cpuid_subleaf(CPUID_EXTEND_FUNCTION_2, 0x0U,
@@ -518,6 +593,27 @@ static int32_t check_essential_vmx_caps(void)
  * we should supplement which feature/capability we must support
  * here later.
  */
+/*
+ * The board file pledged these features at build time and
+ * pcpu_has_cap_const() call sites no longer test them at run time, so
+ * any disagreement with the real silicon means const-folded and probed
+ * call sites would answer differently for the same feature. Require an
+ * exact match in both directions and refuse to boot otherwise.
+ */
+static bool is_fixed_caps_matched(void)
+{
+	bool ret = true;
+
+#ifdef CONFIG_FIXED_CAPS
+	ret = (((FIXED_CAP_XSAVE != 0U) == pcpu_has_cap(X86_FEATURE_XSAVE)) &&
+		((FIXED_CAP_XSAVES != 0U) == pcpu_has_cap(X86_FEATURE_XSAVES)) &&
+		((FIXED_CAP_WAITPKG != 0U) == pcpu_has_cap(X86_FEATURE_WAITPKG)) &&
+		((FIXED_CAP_KEYLOCKER != 0U) == pcpu_has_cap(X86_FEATURE_KEYLOCKER)));
+#endif
+
+	return ret;
+}
+
 int32_t detect_hardware_support(void)
 {
 	int32_t ret;
@@ -594,6 +690,9 @@ int32_t detect_hardware_support(void)
 	} else if (!pcpu_has_cap(X86_FEATURE_RDRAND)) {
 		printf("%s, RDRAND is not supported\n", __func__);
 		ret = -ENODEV;
+	} else if (!is_fixed_caps_matched()) {
+		printf("%s, fixed-capability pledge does not match this CPU\n", __func__);
+		ret = -ENODEV;
 	} else {
 		ret = check_essential_vmx_caps();
 	}
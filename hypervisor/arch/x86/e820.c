@@ -5,8 +5,14 @@
  */
 
 #include <types.h>
+#include <rtl.h>
+#include <util.h>
+#include <board_info.h>
 #include <acrn_hv_defs.h>
+#include <acpi.h>
+#include <asm/lib/bits.h>
 #include <asm/page.h>
+#include <asm/per_cpu.h>
 #include <asm/e820.h>
 #include <asm/mmu.h>
 #include <boot.h>
@@ -27,69 +33,177 @@ static struct e820_entry hv_e820[E820_MAX_ENTRIES];
 #define DBG_LEVEL_E820	6U
 
 /*
- * @brief reserve some RAM, hide it from Service VM, return its start address
+ * Boards inspected with the config tools may carry a prebuilt copy of this
+ * layout (PREBUILT_E820_* in board_info.h): the firmware memory map recorded
+ * at inspection time, already sorted and in hypervisor e820 types. It is only
+ * trusted when an FNV-1a hash of the map the bootloader passed in matches the
+ * hash recorded alongside it; any difference - a BIOS update, a DIMM change,
+ * or the per-boot churn of EFI boot-services regions - falls back to the
+ * dynamic conversion below.
  *
- * e820_alloc_memory requires 4k alignment, so size_arg will be converted
- * in the function.
+ * The prebuilt layout is the firmware e820 view of the inspected board. On
+ * UEFI boots that match it, it therefore supersedes the EFI-map translation
+ * of init_e820_from_efi_mmap(), so protection of boot-services-backed data
+ * (ESRT, BGRT image) relies on the firmware reserving those regions in its
+ * e820 view - which is the only view a fixed board can prevalidate. Boards
+ * that need the EFI-map-derived reservations should simply not carry a
+ * firmware_map snapshot in their board XML.
+ */
+#ifdef PREBUILT_E820_FW_MAP_HASH
+#define FNV1A_OFFSET_BASIS	0xcbf29ce484222325UL
+#define FNV1A_PRIME		0x00000100000001b3UL
+
+static uint64_t fnv1a_hash(uint64_t hash, const void *data, uint32_t size)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t ret = hash;
+	uint32_t i;
+
+	for (i = 0U; i < size; i++) {
+		ret ^= (uint64_t)bytes[i];
+		ret *= FNV1A_PRIME;
+	}
+
+	return ret;
+}
+
+/* hash the fields rather than the struct so that padding never contributes */
+static uint64_t calc_fw_map_hash(const struct acrn_boot_info *abi)
+{
+	uint64_t hash = FNV1A_OFFSET_BASIS;
+	const struct abi_mmap *mmap = abi->mmap_entry;
+	uint32_t i;
+
+	for (i = 0U; i < abi->mmap_entries; i++) {
+		hash = fnv1a_hash(hash, &mmap[i].baseaddr, 8U);
+		hash = fnv1a_hash(hash, &mmap[i].length, 8U);
+		hash = fnv1a_hash(hash, &mmap[i].type, 4U);
+	}
+
+	return hash;
+}
+
+static const struct e820_entry prebuilt_e820[PREBUILT_E820_NR] = PREBUILT_E820_ENTRIES;
+
+/*
+ * @brief install the prebuilt e820 layout when the firmware map still matches
  *
- * @param size_arg Amount of memory to be found and marked reserved
- * @param max_addr Maximum address below which memory is to be identified
+ * @return true when the prebuilt layout was installed
+ */
+static bool install_prebuilt_e820(const struct acrn_boot_info *abi)
+{
+	bool installed = false;
+
+	if ((abi->mmap_entries != 0U) && (calc_fw_map_hash(abi) == PREBUILT_E820_FW_MAP_HASH)) {
+		(void)memcpy_s(hv_e820, sizeof(hv_e820), prebuilt_e820, sizeof(prebuilt_e820));
+		hv_e820_entries_nr = PREBUILT_E820_NR;
+		dev_dbg(DBG_LEVEL_E820, "firmware map matches inspected board, prebuilt e820 installed");
+		installed = true;
+	} else {
+		pr_warn("firmware map differs from the inspected board, using dynamic e820 path");
+	}
+
+	return installed;
+}
+#endif
+
+/* memory affinity of one SRAT proximity domain */
+struct numa_node_info {
+	uint32_t pxm;
+	uint64_t base;
+	uint64_t end;
+};
+static struct numa_node_info numa_nodes[MAX_NUMA_NODES];
+static uint32_t numa_nodes_nr;
+/* index into numa_nodes for each pCPU, defaults to node 0 */
+static uint32_t pcpu_numa_node[MAX_PCPU_NUM];
+
+/*
+ * @brief try to reserve some RAM within [min_addr, max_addr), hide it from Service VM
  *
- * @pre hv_e820_entries_nr > 0U
- * @return base address of the memory region
+ * The allocation is carved from the highest fitting window. When the window
+ * ends below the top of the backing e820 entry, the entry is split and the
+ * clipped-off top stays usable RAM.
+ *
+ * @pre (size & ~PAGE_MASK) == 0UL
+ * @return base address of the memory region, INVALID_HPA when no room
  */
-uint64_t e820_alloc_memory(uint64_t size_arg, uint64_t max_addr)
+static uint64_t e820_try_alloc_memory(uint64_t size, uint64_t min_addr, uint64_t max_addr)
 {
 	int32_t i;
-	uint64_t size = round_page_up(size_arg);
 	uint64_t ret = INVALID_HPA;
 	struct e820_entry *entry, *new_entry;
 
 	for (i = (int32_t)hv_e820_entries_nr - 1; i >= 0; i--) {
 		entry = &hv_e820[i];
-		uint64_t start, end, length;
+		uint64_t raw_end = entry->baseaddr + entry->length;
+		uint64_t start, end, base, above;
 
-		start = round_page_up(entry->baseaddr);
-		end = round_page_down(entry->baseaddr + entry->length);
-		length = (end > start) ? (end - start) : 0UL;
+		start = max(round_page_up(entry->baseaddr), round_page_up(min_addr));
+		end = min(round_page_down(raw_end), round_page_down(max_addr));
 
-		if ((entry->type == E820_TYPE_RAM) && (length >= size) && ((start + size) <= max_addr)) {
+		if ((entry->type != E820_TYPE_RAM) || (end <= start) || ((end - start) < size)) {
+			continue;
+		}
 
+		/* carve from the top of the usable window */
+		base = end - size;
+		above = (end < round_page_down(raw_end)) ? (raw_end - (base + size)) : 0UL;
 
+		if ((base == round_page_up(entry->baseaddr)) && (above == 0UL)) {
 			/* found exact size of e820 entry */
-			if (length == size) {
+			entry->type = E820_TYPE_RESERVED;
+			ret = base;
+		} else if ((hv_e820_entries_nr + ((above != 0UL) ? 2U : 1U)) <= E820_MAX_ENTRIES) {
+			if (base == entry->baseaddr) {
 				entry->type = E820_TYPE_RESERVED;
-				ret = start;
+				entry->length = size;
 			} else {
-
-				/*
-				 * found entry with available memory larger than requested (length > size)
-				 * Reserve memory if
-				 * 1) hv_e820_entries_nr < E820_MAX_ENTRIES
-				 * 2) if end of this "entry" is <= max_addr
-				 *    use memory from end of this e820 "entry".
-				 */
-
-				if ((hv_e820_entries_nr < E820_MAX_ENTRIES) && (end <= max_addr)) {
-
-					new_entry = &hv_e820[hv_e820_entries_nr];
-					new_entry->type = E820_TYPE_RESERVED;
-					new_entry->baseaddr = end - size;
-					new_entry->length = (entry->baseaddr + entry->length) - new_entry->baseaddr;
-					/* Shrink the existing entry and total available memory */
-					entry->length -= new_entry->length;
-					hv_e820_entries_nr++;
-
-				        ret = new_entry->baseaddr;
-				}
+				new_entry = &hv_e820[hv_e820_entries_nr];
+				new_entry->type = E820_TYPE_RESERVED;
+				new_entry->baseaddr = base;
+				new_entry->length = (above != 0UL) ? size : (raw_end - base);
+				hv_e820_entries_nr++;
+				/* Shrink the existing entry and total available memory */
+				entry->length = base - entry->baseaddr;
 			}
 
-			if (ret != INVALID_HPA) {
-				break;
+			if (above != 0UL) {
+				/* the clipped-off top of the entry stays usable RAM */
+				new_entry = &hv_e820[hv_e820_entries_nr];
+				new_entry->type = E820_TYPE_RAM;
+				new_entry->baseaddr = base + size;
+				new_entry->length = above;
+				hv_e820_entries_nr++;
 			}
+
+			ret = base;
+		}
+
+		if (ret != INVALID_HPA) {
+			break;
 		}
 	}
 
+	return ret;
+}
+
+/*
+ * @brief reserve some RAM, hide it from Service VM, return its start address
+ *
+ * e820_alloc_memory requires 4k alignment, so size_arg will be converted
+ * in the function.
+ *
+ * @param size_arg Amount of memory to be found and marked reserved
+ * @param max_addr Maximum address below which memory is to be identified
+ *
+ * @pre hv_e820_entries_nr > 0U
+ * @return base address of the memory region
+ */
+uint64_t e820_alloc_memory(uint64_t size_arg, uint64_t max_addr)
+{
+	uint64_t ret = e820_try_alloc_memory(round_page_up(size_arg), 0UL, max_addr);
+
 	if ((ret == INVALID_HPA) || (ret == 0UL)) {
 		/* current memory allocation algorithm is to find the available address from the highest
 		 * possible address below max_addr. if ret == 0, means all memory is used up and we have to
@@ -103,6 +217,176 @@ uint64_t e820_alloc_memory(uint64_t size_arg, uint64_t max_addr)
 	return ret;
 }
 
+/*
+ * @brief reserve some RAM close to the pCPUs in the affinity mask
+ *
+ * Prefer RAM from the NUMA node the first pCPU of cpu_affinity belongs to,
+ * fall back to an allocation anywhere when the node is unknown or full.
+ *
+ * @param size_arg Amount of memory to be found and marked reserved
+ * @param cpu_affinity Mask of the pCPUs the memory will mostly be accessed from
+ *
+ * @pre hv_e820_entries_nr > 0U
+ * @return base address of the memory region
+ */
+uint64_t e820_alloc_memory_by_affinity(uint64_t size_arg, uint64_t cpu_affinity)
+{
+	uint64_t size = round_page_up(size_arg);
+	uint64_t ret = INVALID_HPA;
+	uint16_t pcpu_id = ffs64(cpu_affinity);
+
+	if ((numa_nodes_nr > 1U) && (pcpu_id < MAX_PCPU_NUM)) {
+		const struct numa_node_info *node = &numa_nodes[pcpu_numa_node[pcpu_id]];
+
+		ret = e820_try_alloc_memory(size, node->base, node->end);
+		if ((ret == INVALID_HPA) || (ret == 0UL)) {
+			pr_warn("no room on NUMA node %u for 0x%lx bytes, allocating off-node", node->pxm, size);
+			ret = INVALID_HPA;
+		}
+	}
+
+	if (ret == INVALID_HPA) {
+		ret = e820_alloc_memory(size, ~0UL);
+	}
+
+	return ret;
+}
+
+/*
+ * @brief reserve the flight recorder region, return its start address
+ *
+ * The region backs a ring of trace events that must survive a warm reset:
+ * it is carved below 4G from the highest fitting window, which yields the
+ * same address on every boot as long as the firmware memory map does not
+ * change, and it is never cleared here. The extraction tool validates the
+ * recorder header magic before trusting the contents, so a changed address
+ * or a cold boot only results in an empty extraction.
+ *
+ * @param size_arg Amount of memory to be found and marked reserved
+ *
+ * @pre hv_e820_entries_nr > 0U
+ * @return base address of the memory region
+ */
+uint64_t e820_alloc_flight_recorder(uint64_t size_arg)
+{
+	return e820_alloc_memory(size_arg, MEM_4G);
+}
+
+static struct numa_node_info *find_numa_node(uint32_t pxm)
+{
+	struct numa_node_info *node = NULL;
+	uint32_t i;
+
+	for (i = 0U; i < numa_nodes_nr; i++) {
+		if (numa_nodes[i].pxm == pxm) {
+			node = &numa_nodes[i];
+			break;
+		}
+	}
+
+	return node;
+}
+
+static void add_numa_mem_range(uint32_t pxm, uint64_t base, uint64_t length)
+{
+	struct numa_node_info *node = find_numa_node(pxm);
+
+	if (node != NULL) {
+		/* memory of one proximity domain may be reported in several ranges */
+		node->base = min(node->base, base);
+		node->end = max(node->end, base + length);
+	} else if (numa_nodes_nr < MAX_NUMA_NODES) {
+		node = &numa_nodes[numa_nodes_nr];
+		node->pxm = pxm;
+		node->base = base;
+		node->end = base + length;
+		numa_nodes_nr++;
+	} else {
+		pr_warn("SRAT reports more than %u proximity domains, ignoring domain %u", MAX_NUMA_NODES, pxm);
+	}
+}
+
+static void set_pcpu_numa_node(uint32_t apic_id, uint32_t pxm)
+{
+	const struct numa_node_info *node = find_numa_node(pxm);
+	uint16_t i;
+
+	if (node != NULL) {
+		for (i = 0U; i < get_pcpu_nums(); i++) {
+			if (per_cpu(lapic_id, i) == apic_id) {
+				pcpu_numa_node[i] = (uint32_t)(node - numa_nodes);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * @brief build the pCPU-to-memory-node affinity from the ACPI SRAT
+ *
+ * Called on the BSP after the per-cpu lapic ids are known. Platforms without
+ * a SRAT (or with a single proximity domain) keep the flat allocation policy.
+ */
+void init_numa_nodes(void)
+{
+	struct acpi_table_srat *srat = (struct acpi_table_srat *)get_acpi_tbl(ACPI_SIG_SRAT);
+	struct acpi_subtable_header *entry;
+	struct acpi_srat_mem_affinity *mem;
+	struct acpi_srat_cpu_affinity *cpu;
+	struct acpi_srat_x2apic_cpu_affinity *x2apic;
+	void *iterator, *end;
+	uint32_t pxm, i;
+
+	if (srat != NULL) {
+		end = (void *)srat + srat->header.length;
+
+		/* memory affinity entries first: cpu entries refer to the nodes they create */
+		for (iterator = (void *)(srat + 1); iterator < end; iterator += entry->length) {
+			entry = (struct acpi_subtable_header *)iterator;
+			if (entry->length < sizeof(struct acpi_subtable_header)) {
+				break;
+			}
+
+			if (entry->type == ACPI_SRAT_TYPE_MEMORY_AFFINITY) {
+				mem = (struct acpi_srat_mem_affinity *)iterator;
+				if (((mem->flags & ACPI_SRAT_ENABLED) != 0U) && (mem->length != 0UL)) {
+					add_numa_mem_range(mem->proximity_domain, mem->base_address, mem->length);
+				}
+			}
+		}
+
+		for (iterator = (void *)(srat + 1); iterator < end; iterator += entry->length) {
+			entry = (struct acpi_subtable_header *)iterator;
+			if (entry->length < sizeof(struct acpi_subtable_header)) {
+				break;
+			}
+
+			if (entry->type == ACPI_SRAT_TYPE_CPU_AFFINITY) {
+				cpu = (struct acpi_srat_cpu_affinity *)iterator;
+				if ((cpu->flags & ACPI_SRAT_ENABLED) != 0U) {
+					pxm = (uint32_t)cpu->proximity_domain_lo;
+					pxm |= ((uint32_t)cpu->proximity_domain_hi[0] << 8U);
+					pxm |= ((uint32_t)cpu->proximity_domain_hi[1] << 16U);
+					pxm |= ((uint32_t)cpu->proximity_domain_hi[2] << 24U);
+					set_pcpu_numa_node((uint32_t)cpu->apic_id, pxm);
+				}
+			} else if (entry->type == ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY) {
+				x2apic = (struct acpi_srat_x2apic_cpu_affinity *)iterator;
+				if ((x2apic->flags & ACPI_SRAT_ENABLED) != 0U) {
+					set_pcpu_numa_node(x2apic->apic_id, x2apic->proximity_domain);
+				}
+			} else {
+				/* other affinity structures are of no interest */
+			}
+		}
+
+		for (i = 0U; i < numa_nodes_nr; i++) {
+			dev_dbg(DBG_LEVEL_E820, "NUMA node %u: [0x%lx, 0x%lx)",
+				numa_nodes[i].pxm, numa_nodes[i].base, numa_nodes[i].end);
+		}
+	}
+}
+
 static void insert_e820_entry(uint32_t index, uint64_t addr, uint64_t length, uint64_t type)
 {
 	uint32_t i;
@@ -285,12 +569,25 @@ static void alloc_mods_memory(void)
 void init_e820(void)
 {
 	struct acrn_boot_info *abi = get_acrn_boot_info();
+	bool prebuilt = false;
 
 	if (boot_from_uefi(abi)) {
+		/* cache the EFI map even when the prebuilt layout wins: other
+		 * consumers read it through get_efi_mmap_entry() directly.
+		 */
 		init_efi_mmap_entries(&abi->uefi_info);
-		init_e820_from_efi_mmap();
-	} else {
-		init_e820_from_mmap(abi);
+	}
+
+#ifdef PREBUILT_E820_FW_MAP_HASH
+	prebuilt = install_prebuilt_e820(abi);
+#endif
+
+	if (!prebuilt) {
+		if (boot_from_uefi(abi)) {
+			init_e820_from_efi_mmap();
+		} else {
+			init_e820_from_mmap(abi);
+		}
 	}
 
 	calculate_e820_ram_size();
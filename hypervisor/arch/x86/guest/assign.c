@@ -179,9 +179,11 @@ ptirq_build_physical_rte(struct acrn_vm *vm, struct ptirq_remapping_info *entry)
 	int32_t ret;
 
 	if (virt_sid->intx_id.ctlr == INTX_CTLR_IOAPIC) {
-		uint64_t vdmask, pdmask;
+		uint64_t vdmask, pdmask, pid_paddr = 0UL;
 		uint32_t dest, delmode, dest_mask, vector;
 		union ioapic_rte virt_rte;
+		struct acrn_vcpu *vcpu = NULL;
+		uint16_t vid;
 		bool phys;
 
 		vioapic_get_rte(vm, virt_sid->intx_id.gsi, &virt_rte);
@@ -232,6 +234,28 @@ ptirq_build_physical_rte(struct acrn_vm *vm, struct ptirq_remapping_info *entry)
 
 		dest_mask = calculate_logical_dest_mask(pdmask);
 
+		/*
+		 * Edge-triggered single-destination INTx can be delivered in
+		 * posted mode just like MSI, with the guest vector landing
+		 * directly in the destination vCPU's PIR. Level-triggered
+		 * pins stay in remapped mode since the posted IRTE format
+		 * has no trigger mode and the EOI/deassert flow needs the
+		 * hypervisor in the loop.
+		 */
+		vid = ffs64(vdmask);
+		if (is_pi_capable(vm) &&
+			(virt_rte.bits.trigger_mode == IOAPIC_RTE_TRGRMODE_EDGE) &&
+			(vdmask == (1UL << vid)) &&
+			((virt_rte.bits.delivery_mode == IOAPIC_RTE_DELMODE_FIXED) ||
+			 (virt_rte.bits.delivery_mode == IOAPIC_RTE_DELMODE_LOPRI))) {
+			vcpu = vcpu_from_vid(vm, vid);
+		}
+		if (vcpu != NULL) {
+			pid_paddr = hva2hpa(get_pi_desc(vcpu));
+			/* posted mode delivers the guest vector directly */
+			vector = (uint32_t)virt_rte.bits.vector;
+		}
+
 		irte.value.lo_64 = 0UL;
 		irte.value.hi_64 = 0UL;
 		irte.bits.remap.vector = vector;
@@ -241,7 +265,7 @@ ptirq_build_physical_rte(struct acrn_vm *vm, struct ptirq_remapping_info *entry)
 		irte.bits.remap.trigger_mode = rte.bits.trigger_mode;
 
 		intr_src.is_msi = false;
-		intr_src.pid_paddr = 0UL;
+		intr_src.pid_paddr = pid_paddr;
 		intr_src.src.ioapic_id = ioapic_irq_to_ioapic_id(phys_irq);
 		ret = dmar_assign_irte(&intr_src, &irte, entry->irte_idx, &ir_index.index);
 
@@ -507,14 +531,12 @@ void ptirq_softirq(uint16_t pcpu_id)
 {
 	while (1) {
 		struct ptirq_remapping_info *entry = ptirq_dequeue_softirq(pcpu_id);
-		struct msi_info *vmsi;
+		struct msi_info vmsi;
 
 		if (entry == NULL) {
 			break;
 		}
 
-		vmsi = &entry->vmsi;
-
 		/* skip any inactive entry */
 		if (!is_entry_active(entry)) {
 			/* service next item */
@@ -525,15 +547,20 @@ void ptirq_softirq(uint16_t pcpu_id)
 		if (entry->intr_type == PTDEV_INTR_INTX) {
 			ptirq_handle_intx(entry->vm, entry);
 		} else {
-			if (vmsi != NULL) {
-				/* TODO: vmsi destmode check required */
-				(void)vlapic_inject_msi(entry->vm, vmsi->addr.full, vmsi->data.full);
-				dev_dbg(DBG_LEVEL_PTIRQ, "dev-assign: irq=0x%x MSI VR: 0x%x-0x%x",
-					entry->allocated_pirq, vmsi->data.bits.vector,
-					irq_to_vector(entry->allocated_pirq));
-				dev_dbg(DBG_LEVEL_PTIRQ, " vmsi_addr: 0x%lx vmsi_data: 0x%x",
-					vmsi->addr.full, vmsi->data.full);
-			}
+			/* snapshot the vector info so a concurrent remap of
+			 * this entry cannot be observed half-written
+			 */
+			spinlock_obtain(&entry->entry_lock);
+			vmsi = entry->vmsi;
+			spinlock_release(&entry->entry_lock);
+
+			/* TODO: vmsi destmode check required */
+			(void)vlapic_inject_msi(entry->vm, vmsi.addr.full, vmsi.data.full);
+			dev_dbg(DBG_LEVEL_PTIRQ, "dev-assign: irq=0x%x MSI VR: 0x%x-0x%x",
+				entry->allocated_pirq, vmsi.data.bits.vector,
+				irq_to_vector(entry->allocated_pirq));
+			dev_dbg(DBG_LEVEL_PTIRQ, " vmsi_addr: 0x%lx vmsi_data: 0x%x",
+				vmsi.addr.full, vmsi.data.full);
 		}
 
 		handle_x86_tee_int(entry, pcpu_id);
@@ -542,20 +569,29 @@ void ptirq_softirq(uint16_t pcpu_id)
 
 void ptirq_intx_ack(struct acrn_vm *vm, uint32_t virt_gsi, enum intx_ctlr vgsi_ctlr)
 {
-	uint32_t phys_irq;
-	struct ptirq_remapping_info *entry;
+	uint32_t phys_irq = IRQ_INVALID, polarity = 0U;
+	const struct ptirq_remapping_info *entry;
 	DEFINE_INTX_SID(virt_sid, virt_gsi, vgsi_ctlr);
 
+	/* snapshot what the ack needs under the read side and drop the lock
+	 * before poking the virtual controllers, which take their own locks
+	 * that remap paths may hold while writing ptdev_lock
+	 */
+	rwlock_read_obtain(&ptdev_lock);
 	entry = find_ptirq_entry(PTDEV_INTR_INTX, &virt_sid, vm);
 	if (entry != NULL) {
 		phys_irq = entry->allocated_pirq;
+		polarity = entry->polarity;
+	}
+	rwlock_read_release(&ptdev_lock);
 
+	if (phys_irq != IRQ_INVALID) {
 		/* NOTE: only Level trigger will process EOI/ACK and if we got here
 		 * means we have this vioapic or vpic or both enabled
 		 */
 		switch (vgsi_ctlr) {
 		case INTX_CTLR_IOAPIC:
-			if (entry->polarity != 0U) {
+			if (polarity != 0U) {
 				vioapic_set_irqline_lock(vm, virt_gsi, GSI_SET_HIGH);
 			} else {
 				vioapic_set_irqline_lock(vm, virt_gsi, GSI_SET_LOW);
@@ -596,12 +632,22 @@ int32_t ptirq_prepare_msix_remap(struct acrn_vm *vm, uint16_t virt_bdf, uint16_t
 	 * adds the mapping entries at runtime, if the
 	 * entry already be held by others, return error.
 	 */
-	spinlock_obtain(&ptdev_lock);
+	rwlock_write_obtain(&ptdev_lock);
 	entry = add_msix_remapping(vm, virt_bdf, phys_bdf, entry_nr);
-	spinlock_release(&ptdev_lock);
+	rwlock_write_release(&ptdev_lock);
 
 	if (entry != NULL) {
+		uint64_t rflags;
+
 		ret = 0;
+		/* the per-entry lock keeps the remap data consistent against
+		 * injection; remaps of distinct entries stay concurrent.
+		 * Interrupts must be off while it is held: the injection
+		 * side takes this lock from the softirq on the interrupt
+		 * exit path, and the entry's still-live MSI typically
+		 * targets the very pCPU the reprogramming guest runs on.
+		 */
+		spinlock_irqsave_obtain(&entry->entry_lock, &rflags);
 		entry->vmsi = *info;
 
 		/* build physical config MSI, update to info->pmsi_xxx */
@@ -651,6 +697,7 @@ int32_t ptirq_prepare_msix_remap(struct acrn_vm *vm, uint16_t virt_bdf, uint16_t
 				vbdf.bits.b, vbdf.bits.d, vbdf.bits.f, entry_nr, entry->vmsi.data.bits.vector,
 				irq_to_vector(entry->allocated_pirq), entry->vm->vm_id);
 		}
+		spinlock_irqrestore_release(&entry->entry_lock, rflags);
 	}
 
 	return ret;
@@ -686,6 +733,49 @@ static void activate_ioapic_rte(struct acrn_vm *vm,
 	}
 }
 
+/*
+ * Refresh the physical destination of one entry after the vCPU it targets
+ * moved to another pCPU.  Only sources whose physical side we own can chase
+ * the vCPU: remappable-format MSIs are rewritten in place through their
+ * IRTE (the index the device was programmed with does not change) and INTx
+ * pins are reprogrammed in the physical IOAPIC.  Compatibility-format MSIs
+ * keep whatever destination sits in the device registers, and LAPIC
+ * passthrough VMs are left alone since their destinations never depend on
+ * scheduler placement.
+ */
+void ptirq_update_entry_dest(struct ptirq_remapping_info *entry)
+{
+	struct acrn_vm *vm = entry->vm;
+
+	if (entry->intr_type == PTDEV_INTR_MSI) {
+		uint64_t rflags;
+
+		/* the injection softirq takes this lock on the interrupt
+		 * exit path of this pCPU, so it must not be held with
+		 * interrupts enabled
+		 */
+		spinlock_irqsave_obtain(&entry->entry_lock, &rflags);
+		if (is_entry_active(entry) && (entry->irte_idx != INVALID_IRTE_ID) &&
+				!is_lapic_pt_configured(vm)) {
+			struct acrn_vcpu *vcpu = is_single_destination(vm, &entry->vmsi);
+
+			if (is_pi_capable(vm) && (vcpu != NULL)) {
+				ptirq_build_physical_msi(vm, entry,
+					(uint32_t)entry->vmsi.data.bits.vector,
+					hva2hpa(get_pi_desc(vcpu)), entry->irte_idx);
+			} else {
+				ptirq_build_physical_msi(vm, entry,
+					irq_to_vector(entry->allocated_pirq), 0UL, entry->irte_idx);
+			}
+		}
+		spinlock_irqrestore_release(&entry->entry_lock, rflags);
+	} else {
+		if (is_entry_active(entry) && (entry->allocated_pirq != IRQ_INVALID)) {
+			activate_ioapic_rte(vm, entry);
+		}
+	}
+}
+
 /* Main entry for PCI/Legacy device assignment with INTx, calling from vIOAPIC
  * or vPIC
  */
@@ -710,7 +800,7 @@ int32_t ptirq_intx_pin_remap(struct acrn_vm *vm, uint32_t virt_gsi, enum intx_ct
 	/* no remap for vuart intx */
 	if (!is_vuart_intx(vm, virt_sid.intx_id.gsi)) {
 		/* query if we have virt to phys mapping */
-		spinlock_obtain(&ptdev_lock);
+		rwlock_write_obtain(&ptdev_lock);
 		entry = find_ptirq_entry(PTDEV_INTR_INTX, &virt_sid, vm);
 		if (entry == NULL) {
 			if (is_service_vm(vm)) {
@@ -771,7 +861,7 @@ int32_t ptirq_intx_pin_remap(struct acrn_vm *vm, uint32_t virt_gsi, enum intx_ct
 				status = -ENODEV;
 			}
 		}
-		spinlock_release(&ptdev_lock);
+		rwlock_write_release(&ptdev_lock);
 	} else {
 		status = -EINVAL;
 	}
@@ -796,9 +886,9 @@ int32_t ptirq_add_intx_remapping(struct acrn_vm *vm, uint32_t virt_gsi, uint32_t
 	struct ptirq_remapping_info *entry;
 	enum intx_ctlr vgsi_ctlr = pic_pin ? INTX_CTLR_PIC : INTX_CTLR_IOAPIC;
 
-	spinlock_obtain(&ptdev_lock);
+	rwlock_write_obtain(&ptdev_lock);
 	entry = add_intx_remapping(vm, virt_gsi, phys_gsi, vgsi_ctlr);
-	spinlock_release(&ptdev_lock);
+	rwlock_write_release(&ptdev_lock);
 
 	return (entry != NULL) ? 0 : -ENODEV;
 }
@@ -810,9 +900,9 @@ void ptirq_remove_intx_remapping(const struct acrn_vm *vm, uint32_t virt_gsi, bo
 {
 	enum intx_ctlr vgsi_ctlr = pic_pin ? INTX_CTLR_PIC : INTX_CTLR_IOAPIC;
 
-	spinlock_obtain(&ptdev_lock);
+	rwlock_write_obtain(&ptdev_lock);
 	remove_intx_remapping(vm, virt_gsi, vgsi_ctlr);
-	spinlock_release(&ptdev_lock);
+	rwlock_write_release(&ptdev_lock);
 }
 
 /*
@@ -824,9 +914,9 @@ void ptirq_remove_msix_remapping(const struct acrn_vm *vm, uint16_t phys_bdf,
 	uint32_t i;
 
 	for (i = 0U; i < vector_count; i++) {
-		spinlock_obtain(&ptdev_lock);
+		rwlock_write_obtain(&ptdev_lock);
 		remove_msix_remapping(vm, phys_bdf, i);
-		spinlock_release(&ptdev_lock);
+		rwlock_write_release(&ptdev_lock);
 	}
 }
 
@@ -11,11 +11,13 @@
 #include <asm/pgtable.h>
 #include <asm/mmu.h>
 #include <asm/guest/ept.h>
+#include <asm/guest/guest_memory.h>
 #include <asm/vmx.h>
 #include <asm/vtd.h>
 #include <logmsg.h>
 #include <trace.h>
 #include <asm/rtct.h>
+#include <vm_layout.h>
 
 #define DBG_LEVEL_EPT	6U
 
@@ -64,13 +66,40 @@ static uint64_t get_ept_page_num(void)
 	return roundup((EPT_PML4_PAGE_NUM + EPT_PDPT_PAGE_NUM + ept_pd_page_num + ept_pt_page_num), 64U);
 }
 
+/*
+ * Per-VM EPT page pool sizes precomputed by hv_prebuild from the scenario
+ * configuration. Pre-launched VMs have a fixed guest memory size, so their
+ * pools are sized exactly at build time; 0 means the VM's guest address
+ * space follows platform RAM and the pool is sized at boot.
+ */
+static const uint64_t prebuilt_ept_page_num[CONFIG_MAX_VM_NUM] = PREBUILT_EPT_PAGE_NUM;
+
+static uint64_t get_ept_page_num_of_vm(uint16_t vm_id)
+{
+	uint64_t page_num = prebuilt_ept_page_num[vm_id];
+
+	if (page_num == 0UL) {
+		page_num = get_ept_page_num();
+	}
+
+	return page_num;
+}
+
 uint64_t get_total_ept_4k_pages_size(void)
 {
-	return CONFIG_MAX_VM_NUM * (get_ept_page_num()) * PAGE_SIZE;
+	uint16_t vm_id;
+	uint64_t size = 0UL;
+
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		size += get_ept_page_num_of_vm(vm_id) * PAGE_SIZE;
+	}
+
+	return size;
 }
 
 static struct page *ept_pages[CONFIG_MAX_VM_NUM];
 static uint64_t *ept_page_bitmap[CONFIG_MAX_VM_NUM];
+static uint64_t *ept_page_summary[CONFIG_MAX_VM_NUM];
 static struct page ept_dummy_pages[CONFIG_MAX_VM_NUM];
 
 /* ept: extended page pool*/
@@ -78,51 +107,63 @@ static struct page_pool ept_page_pool[CONFIG_MAX_VM_NUM];
 
 static void reserve_ept_bitmap(void)
 {
-	uint32_t i;
+	uint16_t vm_id;
 	uint64_t bitmap_base;
-	uint64_t bitmap_size;
-	uint64_t bitmap_offset;
+	uint64_t bitmap_size = 0UL;
 
-	bitmap_size = (get_ept_page_num() * CONFIG_MAX_VM_NUM) / 8;
-	bitmap_offset = get_ept_page_num() / 8;
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		bitmap_size += get_ept_page_num_of_vm(vm_id) / 8;
+		bitmap_size += PAGE_POOL_SUMMARY_SIZE(get_ept_page_num_of_vm(vm_id) / 64) * sizeof(uint64_t);
+	}
 
 	bitmap_base = e820_alloc_memory(bitmap_size, ~0UL);
 	set_paging_supervisor(bitmap_base, bitmap_size);
 
-	for(i = 0; i < CONFIG_MAX_VM_NUM; i++){
-		ept_page_bitmap[i] = (uint64_t *)(void *)(bitmap_base + bitmap_offset * i);
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		ept_page_bitmap[vm_id] = (uint64_t *)(void *)bitmap_base;
+		bitmap_base += get_ept_page_num_of_vm(vm_id) / 8;
+		ept_page_summary[vm_id] = (uint64_t *)(void *)bitmap_base;
+		bitmap_base += PAGE_POOL_SUMMARY_SIZE(get_ept_page_num_of_vm(vm_id) / 64) * sizeof(uint64_t);
 	}
 }
 
 /*
  * @brief Reserve space for EPT 4K pages from platform E820 table
+ *
+ * Each VM gets its precomputed amount of EPT pages, carved from the NUMA node
+ * its vCPUs are pinned to so that page walks stay local to the VM's socket.
  */
 void reserve_buffer_for_ept_pages(void)
 {
 	uint64_t page_base;
 	uint16_t vm_id;
-	uint32_t offset = 0U;
 
-	page_base = e820_alloc_memory(get_total_ept_4k_pages_size(), ~0UL);
-	set_paging_supervisor(page_base, get_total_ept_4k_pages_size());
 	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
-		ept_pages[vm_id] = (struct page *)(void *)(page_base + offset);
-		/* assume each VM has same amount of EPT pages */
-		offset += get_ept_page_num() * PAGE_SIZE;
+		page_base = e820_alloc_memory_by_affinity(get_ept_page_num_of_vm(vm_id) * PAGE_SIZE,
+				get_vm_config(vm_id)->cpu_affinity);
+		set_paging_supervisor(page_base, get_ept_page_num_of_vm(vm_id) * PAGE_SIZE);
+		ept_pages[vm_id] = (struct page *)(void *)page_base;
 	}
 
 	reserve_ept_bitmap();
 }
 
-/* @pre: The PPT and EPT have same page granularity */
+/* @pre: The PPT and EPT have same page granularity
+ *
+ * The EPT doubles as the VT-d second-level table of the VM's iommu domain
+ * (see create_iommu_domain), so a page size is only usable when every
+ * remapping unit can walk it too, or DMA of an assigned device would fault
+ * on a mapping the CPU handles fine.
+ */
 static inline bool ept_large_page_support(enum _page_table_level level, __unused uint64_t prot)
 {
 	bool support;
 
 	if (level == IA32E_PD) {
-		support = true;
+		support = ((iommu_sllps_capability() & 0x1U) != 0U);
 	} else if (level == IA32E_PDPT) {
-		support = pcpu_has_vmx_ept_vpid_cap(VMX_EPT_1GB_PAGE);
+		support = pcpu_has_vmx_ept_vpid_cap(VMX_EPT_1GB_PAGE) &&
+			((iommu_sllps_capability() & 0x2U) != 0U);
 	} else {
 		support = false;
 	}
@@ -168,18 +209,39 @@ static inline void ept_recover_exe_right(uint64_t *entry)
 	*entry |= EPT_EXE;
 }
 
+/**
+ * @pre vm_id < CONFIG_MAX_VM_NUM
+ * @pre (used != NULL) && (max_used != NULL) && (total != NULL)
+ */
+void get_ept_pool_stats(uint16_t vm_id, uint32_t *used, uint32_t *max_used, uint32_t *total)
+{
+	struct page_pool *pool = &ept_page_pool[vm_id];
+
+	spinlock_obtain(&pool->lock);
+	*used = (uint32_t)pool->used_pages;
+	*max_used = (uint32_t)pool->max_used_pages;
+	*total = (uint32_t)(pool->bitmap_size << 6U);
+	spinlock_release(&pool->lock);
+}
+
 void init_ept_pgtable(struct pgtable *table, uint16_t vm_id)
 {
 	struct acrn_vm *vm = get_vm_from_vmid(vm_id);
 
 	ept_page_pool[vm_id].start_page = ept_pages[vm_id];
-	ept_page_pool[vm_id].bitmap_size = get_ept_page_num() / 64;
+	ept_page_pool[vm_id].bitmap_size = get_ept_page_num_of_vm(vm_id) / 64;
 	ept_page_pool[vm_id].bitmap = ept_page_bitmap[vm_id];
 	ept_page_pool[vm_id].dummy_page = &ept_dummy_pages[vm_id];
 
 	spinlock_init(&ept_page_pool[vm_id].lock);
 	memset((void *)ept_page_pool[vm_id].bitmap, 0, ept_page_pool[vm_id].bitmap_size * sizeof(uint64_t));
+	ept_page_pool[vm_id].summary = ept_page_summary[vm_id];
+	page_pool_init_summary(&ept_page_pool[vm_id]);
 	ept_page_pool[vm_id].last_hint_id = 0UL;
+	/* keep max_used_pages across VM re-creation: it is the high
+	 * watermark since boot used to right-size the reservation */
+	ept_page_pool[vm_id].used_pages = 0UL;
+	register_page_pool("ept", vm_id, &ept_page_pool[vm_id]);
 
 	table->pool = &ept_page_pool[vm_id];
 	table->default_access_right = EPT_RWX;
@@ -304,17 +366,34 @@ int32_t ept_misconfig_vmexit_handler(__unused struct acrn_vcpu *vcpu)
 	return status;
 }
 
-static inline void ept_flush_guest(struct acrn_vm *vm)
+void ept_flush_guest(struct acrn_vm *vm)
 {
-	uint16_t i;
 	struct acrn_vcpu *vcpu;
-	/* Here doesn't do the real flush, just makes the request which will be handled before vcpu vmenter */
+	uint16_t i;
+
+	/* Here doesn't do the real flush, just makes the request which will be handled before vcpu vmenter.
+	 * invept has no range granularity, so one single-context invalidation per vCPU covers any batch
+	 * of region updates; the vCPUs are kicked in a single IPI round.
+	 */
+	vm_make_request(vm, ACRN_REQUEST_EPT_FLUSH);
+
+	/* cached gva->gpa walks were read through the old EPT mapping */
 	foreach_vcpu(i, vm, vcpu) {
-		vcpu_make_request(vcpu, ACRN_REQUEST_EPT_FLUSH);
+		vcpu_invalidate_gva_cache(vcpu);
 	}
+
+	/* the same page tables serve as the VT-d second-level tables of any device
+	 * assigned to this VM (see create_iommu_domain), so pair the invept request
+	 * with a domain-selective IOTLB shootdown; a no-op while no device is attached
+	 */
+	iommu_flush_iotlb(vm->iommu);
 }
 
-void ept_add_mr(struct acrn_vm *vm, uint64_t *pml4_page,
+/**
+ * @pre the caller holds vm->ept_lock and calls ept_flush_guest() once the
+ *      whole batch of region updates is installed.
+ */
+void ept_add_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page,
 	uint64_t hpa, uint64_t gpa, uint64_t size, uint64_t prot_orig)
 {
 	uint64_t prot = prot_orig;
@@ -322,16 +401,27 @@ void ept_add_mr(struct acrn_vm *vm, uint64_t *pml4_page,
 	dev_dbg(DBG_LEVEL_EPT, "%s, vm[%d] hpa: 0x%016lx gpa: 0x%016lx size: 0x%016lx prot: 0x%016x\n",
 			__func__, vm->vm_id, hpa, gpa, size, prot);
 
+	invalidate_pinned_hc_buffers(vm, gpa, size);
+	pgtable_add_map(pml4_page, hpa, gpa, size, prot, &vm->arch_vm.ept_pgtable);
+}
+
+void ept_add_mr(struct acrn_vm *vm, uint64_t *pml4_page,
+	uint64_t hpa, uint64_t gpa, uint64_t size, uint64_t prot_orig)
+{
 	spinlock_obtain(&vm->ept_lock);
 
-	pgtable_add_map(pml4_page, hpa, gpa, size, prot, &vm->arch_vm.ept_pgtable);
+	ept_add_mr_locked(vm, pml4_page, hpa, gpa, size, prot_orig);
 
 	spinlock_release(&vm->ept_lock);
 
 	ept_flush_guest(vm);
 }
 
-void ept_modify_mr(struct acrn_vm *vm, uint64_t *pml4_page,
+/**
+ * @pre the caller holds vm->ept_lock and calls ept_flush_guest() once the
+ *      whole batch of region updates is installed.
+ */
+void ept_modify_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page,
 		uint64_t gpa, uint64_t size,
 		uint64_t prot_set, uint64_t prot_clr)
 {
@@ -339,24 +429,72 @@ void ept_modify_mr(struct acrn_vm *vm, uint64_t *pml4_page,
 
 	dev_dbg(DBG_LEVEL_EPT, "%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
 
+	invalidate_pinned_hc_buffers(vm, gpa, size);
+	pgtable_modify_or_del_map(pml4_page, gpa, size, local_prot, prot_clr, &(vm->arch_vm.ept_pgtable), MR_MODIFY);
+}
+
+void ept_modify_mr(struct acrn_vm *vm, uint64_t *pml4_page,
+		uint64_t gpa, uint64_t size,
+		uint64_t prot_set, uint64_t prot_clr)
+{
 	spinlock_obtain(&vm->ept_lock);
 
-	pgtable_modify_or_del_map(pml4_page, gpa, size, local_prot, prot_clr, &(vm->arch_vm.ept_pgtable), MR_MODIFY);
+	ept_modify_mr_locked(vm, pml4_page, gpa, size, prot_set, prot_clr);
 
 	spinlock_release(&vm->ept_lock);
 
 	ept_flush_guest(vm);
 }
 /**
- * @pre [gpa,gpa+size) has been mapped into host physical memory region
+ * @brief Coalesce fully-populated 4 KiB and 2 MiB runs in [gpa, gpa + size)
+ *        into 2 MiB and 1 GiB mappings
+ *
+ * Post-launched VM RAM is added region by region, so large-page-aligned spans
+ * are usually assembled from smaller mappings. Calling this once after a
+ * batch of ept_add_mr() invocations collapses each such span into a single
+ * PD or PDPT entry, when both EPT and every DMA remapping unit support the
+ * page size. Devices assigned to the VM walk these same tables on every
+ * IOTLB miss, so the promotion shortens DMA translations as well.
  */
-void ept_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
+void ept_promote_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
 {
 	dev_dbg(DBG_LEVEL_EPT, "%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
 
+	pgtable_promote_large_pages(pml4_page, gpa, size, &vm->arch_vm.ept_pgtable);
+}
+
+void ept_promote_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
+{
 	spinlock_obtain(&vm->ept_lock);
 
+	ept_promote_mr_locked(vm, pml4_page, gpa, size);
+
+	spinlock_release(&vm->ept_lock);
+
+	ept_flush_guest(vm);
+}
+
+/**
+ * @pre [gpa,gpa+size) has been mapped into host physical memory region
+ * @pre the caller holds vm->ept_lock and calls ept_flush_guest() once the
+ *      whole batch of region updates is installed.
+ */
+void ept_del_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
+{
+	dev_dbg(DBG_LEVEL_EPT, "%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
+
+	invalidate_pinned_hc_buffers(vm, gpa, size);
 	pgtable_modify_or_del_map(pml4_page, gpa, size, 0UL, 0UL, &(vm->arch_vm.ept_pgtable), MR_DEL);
+}
+
+/**
+ * @pre [gpa,gpa+size) has been mapped into host physical memory region
+ */
+void ept_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
+{
+	spinlock_obtain(&vm->ept_lock);
+
+	ept_del_mr_locked(vm, pml4_page, gpa, size);
 
 	spinlock_release(&vm->ept_lock);
 
@@ -476,3 +614,26 @@ void walk_ept_table(struct acrn_vm *vm, pge_handler cb)
 		}
 	}
 }
+
+static void ept_clear_dirty_pge(uint64_t *pgentry, __unused uint64_t size)
+{
+	*pgentry &= ~EPT_DIRTY;
+}
+
+/**
+ * @brief Clear the dirty flags of all present EPT leaf entries of a VM
+ *
+ * PML only logs a page on a 0 -> 1 transition of its EPT dirty flag, so
+ * clearing the flags re-arms logging for the next dirty-page tracking round.
+ * The EPT flush makes the cleared flags visible to all vCPUs; any entries
+ * still sitting in a per-vCPU PML buffer are drained at the exit the flush
+ * request forces.
+ *
+ * @pre vm != NULL
+ */
+void ept_clear_dirty(struct acrn_vm *vm)
+{
+	walk_ept_table(vm, ept_clear_dirty_pge);
+
+	ept_flush_guest(vm);
+}
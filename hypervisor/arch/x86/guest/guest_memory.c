@@ -222,6 +222,48 @@ static int32_t local_gva2gpa_pae(struct acrn_vcpu *vcpu, struct page_walk_info *
 	return ret;
 }
 
+/*
+ * Per-vCPU cache of recently walked guest pages.
+ *
+ * Instruction emulation with memory operands walks the same or adjacent
+ * pages several times per emulation; the cache turns the repeats into a
+ * lookup. Entries are valid only while their generation matches the
+ * vCPU's, and vmexit_handler() bumps the generation on every VM exit, so
+ * a cached walk never outlives one emulation: guest CR3 writes, INVLPG
+ * and PTE updates by other vCPUs all take effect no later than they
+ * would against the hardware TLB. EPT updates bump it explicitly, see
+ * ept_modify_mr()/ept_del_mr().
+ */
+static bool gva_cache_lookup(const struct acrn_vcpu *vcpu, uint64_t gva, uint32_t key, uint64_t *gpa)
+{
+	const struct gva_cache_entry *ent;
+	uint32_t i;
+	bool hit = false;
+
+	for (i = 0U; i < GVA_CACHE_SIZE; i++) {
+		ent = &vcpu->arch.gva_cache[i];
+		if ((ent->gen == vcpu->arch.gva_cache_gen) &&
+				(ent->gva_page == (gva & PAGE_MASK)) && (ent->access_key == key)) {
+			*gpa = ent->gpa_page | (gva & (PAGE_SIZE_4K - 1UL));
+			hit = true;
+			break;
+		}
+	}
+
+	return hit;
+}
+
+static void gva_cache_insert(struct acrn_vcpu *vcpu, uint64_t gva, uint32_t key, uint64_t gpa)
+{
+	struct gva_cache_entry *ent = &vcpu->arch.gva_cache[vcpu->arch.gva_cache_next];
+
+	vcpu->arch.gva_cache_next = (vcpu->arch.gva_cache_next + 1U) % GVA_CACHE_SIZE;
+	ent->gva_page = gva & PAGE_MASK;
+	ent->gpa_page = gpa & PAGE_MASK;
+	ent->access_key = key;
+	ent->gen = vcpu->arch.gva_cache_gen;
+}
+
 /* Refer to SDM Vol.3A 6-39 section 6.15 for the format of paging fault error
  * code.
  *
@@ -246,6 +288,7 @@ int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 	enum vm_paging_mode pm = get_vcpu_paging_mode(vcpu);
 	struct page_walk_info pw_info;
 	int32_t ret = 0;
+	uint32_t key;
 
 	if ((gpa == NULL) || (err_code == NULL)) {
 		ret = -EINVAL;
@@ -273,24 +316,38 @@ int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 
 		*err_code &=  ~PAGE_FAULT_P_FLAG;
 
-		if (pm == PAGING_MODE_4_LEVEL) {
-			pw_info.width = 9U;
-			ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
-		} else if (pm == PAGING_MODE_3_LEVEL) {
-			pw_info.width = 9U;
-			ret = local_gva2gpa_pae(vcpu, &pw_info, gva, gpa, err_code);
-		} else if (pm == PAGING_MODE_2_LEVEL) {
-			pw_info.width = 10U;
-			pw_info.pse = ((vcpu_get_cr4(vcpu) & CR4_PSE) != 0UL);
-			pw_info.nxe = false;
-			ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
+		/* the walk outcome depends on the paging mode and the access
+		 * attributes, so both take part in the cache key */
+		key = ((uint32_t)pm << 3U) | (pw_info.is_write_access ? 1U : 0U) |
+			(pw_info.is_inst_fetch ? 2U : 0U) |
+			(pw_info.is_user_mode_access ? 4U : 0U);
+
+		if ((pm != PAGING_MODE_0_LEVEL) && gva_cache_lookup(vcpu, gva, key, gpa)) {
+			/* cached walk of the same page under the same attributes */
 		} else {
-			*gpa = gva;
-		}
+			if (pm == PAGING_MODE_4_LEVEL) {
+				pw_info.width = 9U;
+				ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
+			} else if (pm == PAGING_MODE_3_LEVEL) {
+				pw_info.width = 9U;
+				ret = local_gva2gpa_pae(vcpu, &pw_info, gva, gpa, err_code);
+			} else if (pm == PAGING_MODE_2_LEVEL) {
+				pw_info.width = 10U;
+				pw_info.pse = ((vcpu_get_cr4(vcpu) & CR4_PSE) != 0UL);
+				pw_info.nxe = false;
+				ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
+			} else {
+				*gpa = gva;
+			}
 
-		if (ret == -EFAULT) {
-			if (pw_info.is_user_mode_access) {
-				*err_code |= PAGE_FAULT_US_FLAG;
+			if (ret == -EFAULT) {
+				if (pw_info.is_user_mode_access) {
+					*err_code |= PAGE_FAULT_US_FLAG;
+				}
+			} else if ((ret == 0) && (pm != PAGING_MODE_0_LEVEL)) {
+				gva_cache_insert(vcpu, gva, key, *gpa);
+			} else {
+				/* -EINVAL is not cacheable */
 			}
 		}
 	}
@@ -298,6 +355,14 @@ int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 	return ret;
 }
 
+/* host-virtual segments resolved per copy round before any data is moved */
+#define GPA_COPY_SEG_MAX	16U
+
+struct gpa_copy_seg {
+	void *hva;
+	uint32_t len;
+};
+
 static inline uint32_t local_copy_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t gpa,
 	uint32_t size, uint32_t fix_pg_size, bool cp_from_vm)
 {
@@ -333,24 +398,102 @@ static inline uint32_t local_copy_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t
 	return len;
 }
 
+/*
+ * Cached translation lookup over the buffers the guest pinned via
+ * HC_PIN_HC_BUFFER. Lock-free: entries only ever transition to invalid
+ * under concurrent EPT mutation, and the guest contract is the same as
+ * for an unpinned copy (do not unmap a buffer with a call in flight).
+ */
+static inline void *lookup_pinned_hc_buf(struct acrn_vm *vm, uint64_t gpa, uint32_t size)
+{
+	const struct hc_pinned_buf *buf;
+	void *hva = NULL;
+	uint32_t i;
+
+	for (i = 0U; i < MAX_PINNED_HC_BUF_NUM; i++) {
+		buf = &vm->hc_pinned_buf[i];
+		/* gpa/size are independent hypercall arguments here: without
+		 * the wrap check a gpa near the top of the address space
+		 * passes both comparisons and yields an out-of-range HVA
+		 */
+		if (buf->valid && (gpa >= buf->gpa) && ((gpa + size) > gpa) &&
+				((gpa + size) <= (buf->gpa + buf->size))) {
+			hva = buf->hva + (gpa - buf->gpa);
+			break;
+		}
+	}
+
+	return hva;
+}
+
+/*
+ * The GPA range is resolved into host-virtual segments (merging physically
+ * contiguous pages) before any byte is moved, so the copy itself runs as
+ * back-to-back rep-movsb transfers under a single stac()/clac() pair instead
+ * of toggling the protection domain once per page. Ranges inside a pinned
+ * hypercall buffer skip the walk and use the cached translation directly.
+ */
 static inline int32_t copy_gpa(struct acrn_vm *vm, void *h_ptr_arg, uint64_t gpa_arg,
 	uint32_t size_arg, bool cp_from_vm)
 {
+	struct gpa_copy_seg segs[GPA_COPY_SEG_MAX];
 	void *h_ptr = h_ptr_arg;
-	uint32_t len;
-	uint64_t gpa = gpa_arg;
+	uint32_t len, pg_size, offset_in_pg;
+	uint64_t gpa = gpa_arg, hpa;
 	uint32_t size = size_arg;
+	uint32_t i, nr;
 	int32_t err = 0;
+	void *pin_hva = lookup_pinned_hc_buf(vm, gpa, size);
 
-	while (size > 0U) {
-		len = local_copy_gpa(vm, h_ptr, gpa, size, 0U, cp_from_vm);
-		if (len == 0U) {
-			err = -EINVAL;
-			break;
+	if (pin_hva != NULL) {
+		stac();
+		if (cp_from_vm) {
+			(void)memcpy_s(h_ptr, size, pin_hva, size);
+		} else {
+			(void)memcpy_s(pin_hva, size, h_ptr, size);
+		}
+		clac();
+		size = 0U;
+	}
+
+	while ((size > 0U) && (err == 0)) {
+		/* pass 1: precompute the segment list for this round */
+		nr = 0U;
+		while ((size > 0U) && (nr < GPA_COPY_SEG_MAX)) {
+			hpa = local_gpa2hpa(vm, gpa, &pg_size);
+			if (hpa == INVALID_HPA) {
+				pr_err("%s,vm[%hu] gpa 0x%lx,GPA is unmapping",
+					__func__, vm->vm_id, gpa);
+				err = -EINVAL;
+				break;
+			}
+
+			offset_in_pg = (uint32_t)gpa & (pg_size - 1U);
+			len = (size > (pg_size - offset_in_pg)) ? (pg_size - offset_in_pg) : size;
+
+			if ((nr != 0U) && ((segs[nr - 1U].hva + segs[nr - 1U].len) == hpa2hva(hpa))) {
+				/* physically contiguous with the previous page, merge */
+				segs[nr - 1U].len += len;
+			} else {
+				segs[nr].hva = hpa2hva(hpa);
+				segs[nr].len = len;
+				nr++;
+			}
+			gpa += len;
+			size -= len;
+		}
+
+		/* pass 2: move the data of all resolved segments in one go */
+		stac();
+		for (i = 0U; i < nr; i++) {
+			if (cp_from_vm) {
+				(void)memcpy_s(h_ptr, segs[i].len, segs[i].hva, segs[i].len);
+			} else {
+				(void)memcpy_s(segs[i].hva, segs[i].len, h_ptr, segs[i].len);
+			}
+			h_ptr += segs[i].len;
 		}
-		gpa += len;
-		h_ptr += len;
-		size -= len;
+		clac();
 	}
 
 	return err;
@@ -428,6 +571,107 @@ int32_t copy_to_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t gpa, uint32_t size
 	return ret;
 }
 
+/* @pre Pointer vm is non-NULL, pointer iov is non-NULL
+ * @pre every iov entry meets the gpa continuity requirements of
+ *      copy_from_gpa()/copy_to_gpa()
+ */
+int32_t copy_gpa_vectored(struct acrn_vm *vm, const struct gpa_iovec *iov,
+	uint32_t iovcnt, bool cp_from_vm)
+{
+	uint32_t i;
+	int32_t ret = 0;
+
+	for (i = 0U; (i < iovcnt) && (ret == 0); i++) {
+		ret = copy_gpa(vm, iov[i].h_ptr, iov[i].gpa, iov[i].size, cp_from_vm);
+		if (ret != 0) {
+			pr_err("Unable to copy %s VM%d, GPA 0x%llx size %u\n",
+				cp_from_vm ? "from" : "to", vm->vm_id, iov[i].gpa, iov[i].size);
+		}
+	}
+
+	return ret;
+}
+
+int32_t pin_hc_buffer(struct acrn_vm *vm, uint64_t gpa, uint64_t size, uint32_t *handle)
+{
+	uint64_t base_hpa, walked;
+	struct hc_pinned_buf *buf;
+	bool contiguous = true;
+	uint32_t i;
+	int32_t ret = -EINVAL;
+
+	if ((size != 0UL) && mem_aligned_check(gpa, PAGE_SIZE_4K) &&
+			((gpa + size) > gpa)) {
+		/* one cached base covers the region only if it is physically
+		 * contiguous; reject scattered buffers instead of caching a
+		 * translation that is wrong past the first page
+		 */
+		base_hpa = gpa2hpa(vm, gpa);
+		if (base_hpa != INVALID_HPA) {
+			for (walked = PAGE_SIZE_4K; walked < size; walked += PAGE_SIZE_4K) {
+				if (gpa2hpa(vm, gpa + walked) != (base_hpa + walked)) {
+					contiguous = false;
+					break;
+				}
+			}
+
+			if (contiguous) {
+				ret = -ENOSPC;
+				spinlock_obtain(&vm->hc_buf_lock);
+				for (i = 0U; i < MAX_PINNED_HC_BUF_NUM; i++) {
+					buf = &vm->hc_pinned_buf[i];
+					if (!buf->valid) {
+						buf->gpa = gpa;
+						buf->size = size;
+						buf->hva = hpa2hva(base_hpa);
+						buf->valid = true;
+						*handle = i;
+						ret = 0;
+						break;
+					}
+				}
+				spinlock_release(&vm->hc_buf_lock);
+			}
+		}
+	}
+
+	return ret;
+}
+
+int32_t unpin_hc_buffer(struct acrn_vm *vm, uint32_t handle)
+{
+	int32_t ret = -EINVAL;
+
+	if (handle < MAX_PINNED_HC_BUF_NUM) {
+		spinlock_obtain(&vm->hc_buf_lock);
+		vm->hc_pinned_buf[handle].valid = false;
+		spinlock_release(&vm->hc_buf_lock);
+		ret = 0;
+	}
+
+	return ret;
+}
+
+void invalidate_pinned_hc_buffers(struct acrn_vm *vm, uint64_t gpa, uint64_t size)
+{
+	struct hc_pinned_buf *buf;
+	uint32_t i;
+
+	spinlock_obtain(&vm->hc_buf_lock);
+	for (i = 0U; i < MAX_PINNED_HC_BUF_NUM; i++) {
+		buf = &vm->hc_pinned_buf[i];
+		/* a wrapped (gpa + size) means the range runs to the top of
+		 * the address space; invalidate conservatively instead of
+		 * missing the overlap and keeping a stale translation
+		 */
+		if (buf->valid && (gpa < (buf->gpa + buf->size)) &&
+				((buf->gpa < (gpa + size)) || ((gpa + size) < gpa))) {
+			buf->valid = false;
+		}
+	}
+	spinlock_release(&vm->hc_buf_lock);
+}
+
 int32_t copy_from_gva(struct acrn_vcpu *vcpu, void *h_ptr, uint64_t gva,
 	uint32_t size, uint32_t *err_code, uint64_t *fault_addr)
 {
@@ -12,7 +12,10 @@
 #include <logmsg.h>
 #include <asm/vmx.h>
 #include <asm/guest/hyperv.h>
+#include <asm/guest/virq.h>
+#include <asm/guest/vlapic.h>
 #include <asm/tsc.h>
+#include <hypercall.h>
 
 #define DBG_LEVEL_HYPERV		6U
 
@@ -25,6 +28,57 @@
 /* Partition reference TSC MSR (HV_X64_MSR_REFERENCE_TSC) */
 #define CPUID3A_REFERENCE_TSC_MSR	(1U << 9U)
 
+/* Recommend using hypercall for remote TLB flushes */
+#define CPUID4A_REMOTE_TLB_FLUSH	(1U << 2U)
+/* Recommend using the cluster IPI hypercall */
+#define CPUID4A_CLUSTER_IPI		(1U << 10U)
+
+/* Hyper-V hypercall call codes */
+#define HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE	0x0002U
+#define HVCALL_FLUSH_VIRTUAL_ADDRESS_LIST	0x0003U
+#define HVCALL_SEND_IPI				0x000bU
+
+/* Hyper-V hypercall status codes */
+#define HV_STATUS_SUCCESS			0UL
+#define HV_STATUS_INVALID_HYPERCALL_CODE	2UL
+#define HV_STATUS_INVALID_HYPERCALL_INPUT	3UL
+#define HV_STATUS_INVALID_PARAMETER		5UL
+
+/* flags of the TLB flush hypercalls */
+#define HV_FLUSH_ALL_PROCESSORS			(1UL << 0U)
+
+/* reps completed are reported in bits 43:32 of the hypercall result */
+#define HV_HYPERCALL_REP_COMP_SHIFT		32U
+
+union hyperv_hypercall_input {
+	uint64_t val64;
+	struct {
+		uint64_t call_code:16;
+		uint64_t fast:1;
+		uint64_t rsvd1:15;
+		uint64_t rep_count:12;
+		uint64_t rsvd2:4;
+		uint64_t rep_start:12;
+		uint64_t rsvd3:4;
+	};
+};
+
+/* input header of HvFlushVirtualAddressSpace/List, the GVA list of the
+ * rep variant follows the header
+ */
+struct hv_tlb_flush {
+	uint64_t address_space;
+	uint64_t flags;
+	uint64_t processor_mask;
+};
+
+/* input of HvCallSendSyntheticClusterIpi */
+struct hv_send_ipi {
+	uint32_t vector;
+	uint32_t reserved;
+	uint64_t processor_mask;
+};
+
 struct HV_REFERENCE_TSC_PAGE {
 	uint32_t tsc_sequence;
 	uint32_t reserved1;
@@ -111,18 +165,19 @@ hyperv_setup_hypercall_page(const struct acrn_vcpu *vcpu, uint64_t val)
 	 * the basis of the recommendations presented by the hypervisor in CPUID.40000004:EAX.
 	 * A conforming hypervisor must return HV_STATUS_INVALID_HYPERCALL_CODE for any
 	 * unimplemented hypercalls.
-	 * ACRN does not wish to handle any hypercalls at moment, the following hypercall 
-	 * code page is implemented for this purpose.
-	 * inst32[] for 32 bits:
+	 * For 64 bits guests the hypercall page traps into the hypervisor, where
+	 * hyperv_hypercall() handles the implemented calls and returns
+	 * HV_STATUS_INVALID_HYPERCALL_CODE for the rest.
+	 * inst32[] for 32 bits (the 32 bits calling convention is not supported):
 	 * 	mov eax, 0x02 ; HV_STATUS_INVALID_HYPERCALL_CODE
 	 * 	mov edx, 0
 	 * 	ret
 	 * inst64[] for 64 bits:
-	 * 	mov rax, 0x02 ; HV_STATUS_INVALID_HYPERCALL_CODE
+	 * 	vmcall
 	 * 	ret
 	 */
 	const uint8_t inst32[11] = {0xb8U, 0x02U, 0x0U, 0x0U, 0x0U, 0xbaU, 0x0U, 0x0U, 0x0U, 0x0U, 0xc3U};
-	const uint8_t inst64[8] = {0x48U, 0xc7U, 0xc0U, 0x02U, 0x0U, 0x0U, 0x0U, 0xc3U};
+	const uint8_t inst64[4] = {0x0fU, 0x01U, 0xc1U, 0xc3U};
 
 	hypercall.val64 = val;
 
@@ -133,7 +188,7 @@ hyperv_setup_hypercall_page(const struct acrn_vcpu *vcpu, uint64_t val)
 			stac();
 			(void)memset(page_hva, 0U, PAGE_SIZE);
 			if (get_vcpu_mode(vcpu) == CPU_MODE_64BIT) {
-				(void)memcpy_s(page_hva, 8U, inst64, 8U);
+				(void)memcpy_s(page_hva, 4U, inst64, 4U);
 			} else {
 				(void)memcpy_s(page_hva, 11U, inst32, 11U);
 			}
@@ -142,6 +197,128 @@ hyperv_setup_hypercall_page(const struct acrn_vcpu *vcpu, uint64_t val)
 	}
 }
 
+/*
+ * HvFlushVirtualAddressSpace and HvFlushVirtualAddressList.
+ *
+ * The guest TLB entries of every vCPU are tagged with its VPID, so both
+ * variants are served by requesting a single-context VPID flush on each
+ * target vCPU: over-flushing is always correct and the per-address rep
+ * variant gains nothing here. Running targets are kicked and flush before
+ * they re-enter the guest; descheduled targets simply pick the pending
+ * request up on their next VM entry, without ever being interrupted.
+ */
+static uint64_t
+hyperv_flush_tlb(struct acrn_vcpu *vcpu, union hyperv_hypercall_input input,
+		 uint64_t param1, uint64_t param2)
+{
+	struct hv_tlb_flush flush;
+	struct acrn_vcpu *target_vcpu;
+	uint64_t status = HV_STATUS_INVALID_HYPERCALL_INPUT;
+	uint16_t i;
+
+	if (input.fast != 0U) {
+		/* the processor mask does not fit into the two register
+		 * parameters, so a fast call can only flush all processors
+		 */
+		flush.address_space = param1;
+		flush.flags = param2;
+		flush.processor_mask = 0UL;
+	} else if (copy_from_gpa(vcpu->vm, &flush, param1, sizeof(flush)) != 0) {
+		flush.flags = 0UL;
+		flush.processor_mask = 0UL;
+	} else {
+		/* header copied, flags and mask are valid */
+	}
+
+	if (((flush.flags & HV_FLUSH_ALL_PROCESSORS) != 0UL) || (flush.processor_mask != 0UL)) {
+		foreach_vcpu(i, vcpu->vm, target_vcpu) {
+			if (((flush.flags & HV_FLUSH_ALL_PROCESSORS) != 0UL) ||
+					((flush.processor_mask & (1UL << target_vcpu->vcpu_id)) != 0UL)) {
+				vcpu_make_request(target_vcpu, ACRN_REQUEST_VPID_FLUSH);
+			}
+		}
+		/* all requested reps of the list variant are completed */
+		status = HV_STATUS_SUCCESS | (input.rep_count << HV_HYPERCALL_REP_COMP_SHIFT);
+	}
+
+	return status;
+}
+
+/*
+ * HvCallSendSyntheticClusterIpi: deliver a fixed interrupt to every vCPU in
+ * the processor mask with a single VM exit, instead of one exit per target
+ * for the ICR writes of a conventional IPI multicast.
+ */
+static uint64_t
+hyperv_send_ipi(struct acrn_vcpu *vcpu, union hyperv_hypercall_input input,
+		uint64_t param1, uint64_t param2)
+{
+	struct hv_send_ipi ipi;
+	struct acrn_vcpu *target_vcpu;
+	uint64_t status = HV_STATUS_INVALID_HYPERCALL_INPUT;
+	uint16_t i;
+
+	if (input.fast != 0U) {
+		ipi.vector = (uint32_t)param1;
+		ipi.processor_mask = param2;
+	} else if (copy_from_gpa(vcpu->vm, &ipi, param1, sizeof(ipi)) != 0) {
+		ipi.processor_mask = 0UL;
+	} else {
+		/* input copied, vector and mask are valid */
+	}
+
+	if (ipi.processor_mask != 0UL) {
+		if ((ipi.vector < 16U) || (ipi.vector > 255U)) {
+			status = HV_STATUS_INVALID_PARAMETER;
+		} else {
+			foreach_vcpu(i, vcpu->vm, target_vcpu) {
+				if ((ipi.processor_mask & (1UL << target_vcpu->vcpu_id)) != 0UL) {
+					vlapic_set_intr(target_vcpu, ipi.vector, LAPIC_TRIG_EDGE);
+				}
+			}
+			status = HV_STATUS_SUCCESS;
+		}
+	}
+
+	return status;
+}
+
+int32_t
+hyperv_hypercall(struct acrn_vcpu *vcpu)
+{
+	union hyperv_hypercall_input input;
+	uint64_t status;
+	uint64_t param1, param2;
+
+	if (!is_hypercall_from_ring0() || (get_vcpu_mode(vcpu) != CPU_MODE_64BIT)) {
+		vcpu_inject_ud(vcpu);
+	} else {
+		input.val64 = vcpu_get_gpreg(vcpu, CPU_REG_RCX);
+		param1 = vcpu_get_gpreg(vcpu, CPU_REG_RDX);
+		param2 = vcpu_get_gpreg(vcpu, CPU_REG_R8);
+
+		switch (input.call_code) {
+		case HVCALL_FLUSH_VIRTUAL_ADDRESS_SPACE:
+		case HVCALL_FLUSH_VIRTUAL_ADDRESS_LIST:
+			status = hyperv_flush_tlb(vcpu, input, param1, param2);
+			break;
+		case HVCALL_SEND_IPI:
+			status = hyperv_send_ipi(vcpu, input, param1, param2);
+			break;
+		default:
+			status = HV_STATUS_INVALID_HYPERCALL_CODE;
+			break;
+		}
+
+		dev_dbg(DBG_LEVEL_HYPERV, "hv: %s: code=0x%lx status=0x%lx vcpuid=%d vmid=%d",
+			__func__, input.call_code, status, vcpu->vcpu_id, vcpu->vm->vm_id);
+
+		vcpu_set_gpreg(vcpu, CPU_REG_RAX, status);
+	}
+
+	return 0;
+}
+
 int32_t
 hyperv_wrmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t wval)
 {
@@ -270,7 +447,7 @@ hyperv_init_vcpuid_entry(uint32_t leaf, uint32_t subleaf, uint32_t flags,
 		entry->edx = 0U;
 		break;
 	case 0x40000004U: /* HV Recommended hypercall usage */
-		entry->eax = 0U;
+		entry->eax = CPUID4A_REMOTE_TLB_FLUSH | CPUID4A_CLUSTER_IPI;
 		entry->ebx = 0U;
 		entry->ecx = 0U;
 		entry->edx = 0U;
@@ -34,6 +34,7 @@
 #include <asm/guest/vmcs.h>
 #include <asm/mmu.h>
 #include <asm/per_cpu.h>
+#include <asm/tsc.h>
 #include <logmsg.h>
 #include <asm/guest/virq.h>
 
@@ -122,9 +123,11 @@ static const struct instr_emul_vie_op one_byte_opcodes[256] = {
 	[0x0F] = {
 		.op_type = VIE_OP_TYPE_TWO_BYTE
 	},
+#ifndef INSTR_EMUL_MINIMAL
 	[0x2B] = {
 		.op_type = VIE_OP_TYPE_SUB,
 	},
+#endif
 	[0x39] = {
 		.op_type = VIE_OP_TYPE_CMP,
 	},
@@ -153,6 +156,7 @@ static const struct instr_emul_vie_op one_byte_opcodes[256] = {
 		.op_type = VIE_OP_TYPE_MOV,
 		.op_flags = VIE_OP_F_MOFFSET | VIE_OP_F_NO_MODRM,
 	},
+#ifndef INSTR_EMUL_MINIMAL
 	[0xA4] = {
 		.op_type = VIE_OP_TYPE_MOVS,
 		.op_flags = VIE_OP_F_NO_MODRM | VIE_OP_F_CHECK_GVA_DI | VIE_OP_F_BYTE_OP,
@@ -169,6 +173,7 @@ static const struct instr_emul_vie_op one_byte_opcodes[256] = {
 		.op_type = VIE_OP_TYPE_STOS,
 		.op_flags = VIE_OP_F_NO_MODRM
 	},
+#endif
 	[0xC6] = {
 		/* XXX Group 11 extended opcode - not just MOV */
 		.op_type = VIE_OP_TYPE_MOV,
@@ -196,6 +201,7 @@ static const struct instr_emul_vie_op one_byte_opcodes[256] = {
 		.op_type = VIE_OP_TYPE_GROUP1,
 		.op_flags = VIE_OP_F_IMM8,
 	},
+#ifndef INSTR_EMUL_MINIMAL
 	[0x84] = {
 		.op_type = VIE_OP_TYPE_TEST,
 		.op_flags = VIE_OP_F_BYTE_OP,
@@ -203,6 +209,7 @@ static const struct instr_emul_vie_op one_byte_opcodes[256] = {
 	[0x85] = {
 		.op_type = VIE_OP_TYPE_TEST,
 	},
+#endif
 	[0x86] = {
 		.op_type = VIE_OP_TYPE_XCHG,
 	},
@@ -1057,6 +1064,7 @@ static int32_t get_gva_di_check(struct acrn_vcpu *vcpu, struct instr_emul_vie *v
 	return ret;
 }
 
+#ifndef INSTR_EMUL_MINIMAL
 /* MOVs gets the operands from RSI and RDI. Both operands could be memory.
  * With VMX enabled, one of the operand triggers EPT voilation.
  *
@@ -1210,7 +1218,9 @@ static int32_t emulate_stos(struct acrn_vcpu *vcpu, const struct instr_emul_vie
 
 	return 0;
 }
+#endif /* !INSTR_EMUL_MINIMAL */
 
+#ifndef INSTR_EMUL_MINIMAL
 static int32_t emulate_test(struct acrn_vcpu *vcpu, const struct instr_emul_vie *vie)
 {
 	int32_t error;
@@ -1274,6 +1284,7 @@ static int32_t emulate_test(struct acrn_vcpu *vcpu, const struct instr_emul_vie
 
 	return error;
 }
+#endif /* !INSTR_EMUL_MINIMAL */
 
 static int32_t emulate_and(struct acrn_vcpu *vcpu, const struct instr_emul_vie *vie)
 {
@@ -1531,6 +1542,7 @@ static int32_t emulate_cmp(struct acrn_vcpu *vcpu, const struct instr_emul_vie *
 	return ret;
 }
 
+#ifndef INSTR_EMUL_MINIMAL
 static int32_t emulate_sub(struct acrn_vcpu *vcpu, const struct instr_emul_vie *vie)
 {
 	int32_t error;
@@ -1580,6 +1592,7 @@ static int32_t emulate_sub(struct acrn_vcpu *vcpu, const struct instr_emul_vie *
 
 	return error;
 }
+#endif /* !INSTR_EMUL_MINIMAL */
 
 static int32_t emulate_group1(struct acrn_vcpu *vcpu, const struct instr_emul_vie *vie)
 {
@@ -1854,6 +1867,7 @@ static int32_t decode_two_byte_opcode(struct instr_emul_vie *vie)
 		ret = -1;
 	} else {
 		vie->opcode = x;
+		vie->two_byte = 1U;
 		vie->op = two_byte_opcodes[x];
 
 		if (vie->op.op_type == VIE_OP_TYPE_NONE) {
@@ -2346,56 +2360,93 @@ static int32_t instr_check_gva(struct acrn_vcpu *vcpu, enum vm_cpu_mode cpu_mode
 int32_t decode_instruction(struct acrn_vcpu *vcpu, bool full_decode)
 {
 	struct instr_emul_ctxt *emul_ctxt;
+	struct instr_emul_cache_entry *entry;
+	uint64_t cr3, rip;
 	uint32_t csar;
 	int32_t retval;
 	enum vm_cpu_mode cpu_mode;
+	bool cs_d;
 
 	emul_ctxt = &vcpu->inst_ctxt;
-	retval = vie_init(&emul_ctxt->vie, vcpu);
-
-	if (retval < 0) {
-		if (retval != -EFAULT) {
-			pr_err("init vie failed @ 0x%016lx:", vcpu_get_rip(vcpu));
-		}
+	csar = exec_vmread32(VMX_GUEST_CS_ATTR);
+	cpu_mode = get_vcpu_mode(vcpu);
+	cs_d = seg_desc_def32(csar);
+	cr3 = exec_vmread(VMX_GUEST_CR3);
+	rip = vcpu_get_rip(vcpu);
+	entry = &emul_ctxt->cache[(rip >> 2U) & (INSTR_EMUL_CACHE_ENTRIES - 1UL)];
+
+	/* The access direction reported by the exit qualification is known
+	 * before any decoding and must agree with what the cached decode
+	 * implies: a mismatch means the code byte stream changed under the
+	 * same (cr3, rip, length) key, so fall back to a full fetch+decode.
+	 */
+	if (entry->valid && (entry->cr3 == cr3) && (entry->rip == rip) &&
+			(entry->inst_len == vcpu->arch.inst_len) &&
+			(entry->cpu_mode == (uint8_t)cpu_mode) && (entry->cs_d == cs_d) &&
+			(entry->direction == (uint8_t)vcpu->req.reqs.mmio_request.direction)) {
+		/* Cache hit: skip the guest memory fetch and the decode. */
+		(void)memcpy_s(&emul_ctxt->vie, sizeof(struct instr_emul_vie),
+			&entry->vie, sizeof(struct instr_emul_vie));
+		retval = 0;
 	} else {
-		csar = exec_vmread32(VMX_GUEST_CS_ATTR);
-		cpu_mode = get_vcpu_mode(vcpu);
-
-		retval = local_decode_instruction(cpu_mode, seg_desc_def32(csar), &emul_ctxt->vie);
+		entry->valid = false;
+		retval = vie_init(&emul_ctxt->vie, vcpu);
 
-		if (retval != 0) {
-			if (full_decode) {
-				pr_err("decode instruction failed @ 0x%016lx:", vcpu_get_rip(vcpu));
-				vcpu_inject_ud(vcpu);
-				retval = -EFAULT;
+		if (retval < 0) {
+			if (retval != -EFAULT) {
+				pr_err("init vie failed @ 0x%016lx:", vcpu_get_rip(vcpu));
 			}
 		} else {
-			/*
-			 * We do operand check in instruction decode phase and
-			 * inject exception accordingly. In late instruction
-			 * emulation, it will always success.
-			 *
-			 * We only need to do dst check for movs. For other instructions,
-			 * they always has one register and one mmio which trigger EPT
-			 * by access mmio. With VMX enabled, the related check is done
-			 * by VMX itself before hit EPT violation.
-			 *
-			 */
-			if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_CHECK_GVA_DI) != 0U) {
-				retval = instr_check_di(vcpu);
+			retval = local_decode_instruction(cpu_mode, cs_d, &emul_ctxt->vie);
+
+			if (retval != 0) {
+				if (full_decode) {
+					pr_err("decode instruction failed @ 0x%016lx:", vcpu_get_rip(vcpu));
+					vcpu_inject_ud(vcpu);
+					retval = -EFAULT;
+				}
 			} else {
-				retval = instr_check_gva(vcpu, cpu_mode);
+				entry->cr3 = cr3;
+				entry->rip = rip;
+				entry->inst_len = vcpu->arch.inst_len;
+				entry->cpu_mode = (uint8_t)cpu_mode;
+				entry->direction = (uint8_t)vcpu->req.reqs.mmio_request.direction;
+				entry->cs_d = cs_d;
+				(void)memcpy_s(&entry->vie, sizeof(struct instr_emul_vie),
+					&emul_ctxt->vie, sizeof(struct instr_emul_vie));
+				entry->valid = true;
 			}
+		}
+	}
 
-			if (retval >= 0) {
-				/* return the Memory Operand byte size */
-				if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_BYTE_OP) != 0U) {
-					retval = 1;
-				} else if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_WORD_OP) != 0U) {
-					retval = 2;
-				} else {
-					retval = (int32_t)emul_ctxt->vie.opsize;
-				}
+	if (retval == 0) {
+		/*
+		 * We do operand check in instruction decode phase and
+		 * inject exception accordingly. In late instruction
+		 * emulation, it will always success.
+		 *
+		 * We only need to do dst check for movs. For other instructions,
+		 * they always has one register and one mmio which trigger EPT
+		 * by access mmio. With VMX enabled, the related check is done
+		 * by VMX itself before hit EPT violation.
+		 *
+		 * The checks consume live register state, so they run on every
+		 * execution, including decode cache hits.
+		 */
+		if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_CHECK_GVA_DI) != 0U) {
+			retval = instr_check_di(vcpu);
+		} else {
+			retval = instr_check_gva(vcpu, cpu_mode);
+		}
+
+		if (retval >= 0) {
+			/* return the Memory Operand byte size */
+			if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_BYTE_OP) != 0U) {
+				retval = 1;
+			} else if ((emul_ctxt->vie.op.op_flags & VIE_OP_F_WORD_OP) != 0U) {
+				retval = 2;
+			} else {
+				retval = (int32_t)emul_ctxt->vie.opsize;
 			}
 		}
 	}
@@ -2406,8 +2457,11 @@ int32_t decode_instruction(struct acrn_vcpu *vcpu, bool full_decode)
 int32_t emulate_instruction(struct acrn_vcpu *vcpu)
 {
 	struct instr_emul_vie *vie = &vcpu->inst_ctxt.vie;
+	uint64_t entry_tsc;
+	uint32_t prof_idx;
 	int32_t error;
 
+	entry_tsc = rdtsc();
 	if (vie->decoded != 0U) {
 		switch (vie->op.op_type) {
 		case VIE_OP_TYPE_GROUP1:
@@ -2423,24 +2477,30 @@ int32_t emulate_instruction(struct acrn_vcpu *vcpu)
 		case VIE_OP_TYPE_MOVZX:
 			error = emulate_movx(vcpu, vie);
 			break;
+#ifndef INSTR_EMUL_MINIMAL
 		case VIE_OP_TYPE_MOVS:
 			error = emulate_movs(vcpu, vie);
 			break;
 		case VIE_OP_TYPE_STOS:
 			error = emulate_stos(vcpu, vie);
 			break;
+#endif
 		case VIE_OP_TYPE_AND:
 			error = emulate_and(vcpu, vie);
 			break;
+#ifndef INSTR_EMUL_MINIMAL
 		case VIE_OP_TYPE_TEST:
 			error = emulate_test(vcpu, vie);
 			break;
+#endif
 		case VIE_OP_TYPE_OR:
 			error = emulate_or(vcpu, vie);
 			break;
+#ifndef INSTR_EMUL_MINIMAL
 		case VIE_OP_TYPE_SUB:
 			error = emulate_sub(vcpu, vie);
 			break;
+#endif
 		case VIE_OP_TYPE_BITTEST:
 			error = emulate_bittest(vcpu, vie);
 			break;
@@ -2455,6 +2515,11 @@ int32_t emulate_instruction(struct acrn_vcpu *vcpu)
 			error = -EINVAL;
 			break;
 		}
+
+		/* per-opcode execution profile, dumped by the emul_prof shell command */
+		prof_idx = (uint32_t)vie->opcode + ((vie->two_byte != 0U) ? 256U : 0U);
+		per_cpu(instr_emul_hits, get_pcpu_id())[prof_idx] += 1UL;
+		per_cpu(instr_emul_cycles, get_pcpu_id())[prof_idx] += rdtsc() - entry_tsc;
 	} else {
 		error = -EINVAL;
 	}
@@ -716,8 +716,7 @@ static void reset_vvmcs(struct acrn_vcpu *vcpu)
 
 	for (idx = 0U; idx < MAX_ACTIVE_VVMCS_NUM; idx++) {
 		vvmcs = &vcpu->arch.nested.vvmcs[idx];
-		vvmcs->host_state_dirty = false;
-		vvmcs->control_fields_dirty = false;
+		vvmcs->dirty_fields = 0U;
 		vvmcs->vmcs12_gpa = INVALID_GPA;
 		vvmcs->ref_cnt = 0;
 
@@ -917,6 +916,64 @@ int32_t vmread_vmexit_handler(struct acrn_vcpu *vcpu)
 	return 0;
 }
 
+/*
+ * Classify a trapped VMWRITE to a non-shadowed field into the NVMX_DIRTY_*
+ * class consumed by the differential merge on VM-entry/VM-exit emulation.
+ *
+ * Returns 0 for fields that no merge path consumes: host RSP/RIP are read
+ * from VMCS12 unconditionally on every emulated VM-exit, and writes to
+ * shadowed fields never trap in the first place.
+ */
+static uint32_t vmcs12_dirty_class(uint32_t vmcs_field)
+{
+	uint32_t dirty_class;
+
+	switch (vmcs_field) {
+	case VMX_MSR_BITMAP_FULL:
+		dirty_class = NVMX_DIRTY_MSR_BITMAP;
+		break;
+	case VMX_EPT_POINTER_FULL:
+		dirty_class = NVMX_DIRTY_EPT_POINTER;
+		break;
+	case VMX_VPID:
+		dirty_class = NVMX_DIRTY_VPID;
+		break;
+	case VMX_ENTRY_CONTROLS:
+		dirty_class = NVMX_DIRTY_ENTRY_CTLS;
+		break;
+	case VMX_EXIT_CONTROLS:
+		dirty_class = NVMX_DIRTY_EXIT_CTLS;
+		break;
+	case VMX_HOST_CR0:
+	case VMX_HOST_CR3:
+	case VMX_HOST_CR4:
+		dirty_class = NVMX_DIRTY_HOST_CTL_REGS;
+		break;
+	case VMX_HOST_IA32_SYSENTER_CS:
+	case VMX_HOST_IA32_SYSENTER_ESP:
+	case VMX_HOST_IA32_SYSENTER_EIP:
+		dirty_class = NVMX_DIRTY_HOST_SYSENTER;
+		break;
+	case VMX_HOST_IA32_EFER_FULL:
+	case VMX_HOST_IA32_EFER_HIGH:
+		dirty_class = NVMX_DIRTY_HOST_EFER;
+		break;
+	case VMX_HOST_RSP:
+	case VMX_HOST_RIP:
+		dirty_class = 0U;
+		break;
+	default:
+		if (VMX_VMCS_FIELD_TYPE(vmcs_field) == VMX_VMCS_FIELD_TYPE_HOST) {
+			dirty_class = NVMX_DIRTY_HOST_SEGMENTS;
+		} else {
+			dirty_class = 0U;
+		}
+		break;
+	}
+
+	return dirty_class;
+}
+
 /*
  * @brief emulate VMWRITE instruction from L1
  * @pre vcpu != NULL
@@ -947,22 +1004,12 @@ int32_t vmwrite_vmexit_handler(struct acrn_vcpu *vcpu)
 					(void)copy_from_gpa(vcpu->vm, &vmcs_value, gpa, 8U);
 				}
 
-				if (VMX_VMCS_FIELD_TYPE(vmcs_field) == VMX_VMCS_FIELD_TYPE_HOST) {
-					cur_vvmcs->host_state_dirty = true;
-				}
+				cur_vvmcs->dirty_fields |= vmcs12_dirty_class(vmcs_field);
 
-				if ((vmcs_field == VMX_MSR_BITMAP_FULL)
-					|| (vmcs_field == VMX_EPT_POINTER_FULL)
-					|| (vmcs_field == VMX_VPID)
-					|| (vmcs_field == VMX_ENTRY_CONTROLS)
-					|| (vmcs_field == VMX_EXIT_CONTROLS)) {
-					cur_vvmcs->control_fields_dirty = true;
-
-					if (vmcs_field == VMX_EPT_POINTER_FULL) {
-						if (cur_vvmcs->vmcs12.ept_pointer != vmcs_value) {
-							put_vept_desc(cur_vvmcs->vmcs12.ept_pointer);
-							get_vept_desc(vmcs_value);
-						}
+				if (vmcs_field == VMX_EPT_POINTER_FULL) {
+					if (cur_vvmcs->vmcs12.ept_pointer != vmcs_value) {
+						put_vept_desc(cur_vvmcs->vmcs12.ept_pointer);
+						get_vept_desc(vmcs_value);
 					}
 				}
 
@@ -994,36 +1041,55 @@ static void sync_vmcs02_to_vmcs12(struct acrn_vmcs12 *vmcs12)
 }
 
 /*
+ * Merge the non-shadowed control fields that L1 has written since the last
+ * sync. On VMPTRLD of a new VMCS12 all NVMX_DIRTY_CONTROL_FIELDS classes
+ * are marked dirty so the whole set is loaded; on subsequent VM-entries only
+ * the classes touched by trapped VMWRITEs are reloaded.
+ *
  * @pre vcpu != NULL
  * @pre VMCS02 (as an ordinary VMCS) is current
  */
-static void merge_and_sync_control_fields(struct acrn_vcpu *vcpu, struct acrn_vmcs12 *vmcs12)
+static void merge_and_sync_control_fields(struct acrn_vcpu *vcpu, struct acrn_vvmcs *vvmcs)
 {
+	struct acrn_vmcs12 *vmcs12 = &vvmcs->vmcs12;
 	uint64_t value64;
 
 	/* Sync VMCS fields that are not shadowing. Don't need to sync these fields back to VMCS12. */
 
-	exec_vmwrite(VMX_MSR_BITMAP_FULL, gpa2hpa(vcpu->vm, vmcs12->msr_bitmap));
-	exec_vmwrite(VMX_EPT_POINTER_FULL, get_shadow_eptp(vmcs12->ept_pointer));
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_MSR_BITMAP) != 0U) {
+		exec_vmwrite(VMX_MSR_BITMAP_FULL, gpa2hpa(vcpu->vm, vmcs12->msr_bitmap));
+	}
 
-	/* For VM-execution, entry and exit controls */
-	value64 = vmcs12->vm_entry_controls;
-	if ((value64 & VMX_ENTRY_CTLS_LOAD_EFER) != VMX_ENTRY_CTLS_LOAD_EFER) {
-		/*
-		 * L1 hypervisor wishes to use its IA32_EFER for L2 guest so we turn on the
-		 * VMX_ENTRY_CTLS_LOAD_EFER on VMCS02.
-		 */
-		value64 |= VMX_ENTRY_CTLS_LOAD_EFER;
-		exec_vmwrite(VMX_GUEST_IA32_EFER_FULL, vcpu_get_efer(vcpu));
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_EPT_POINTER) != 0U) {
+		exec_vmwrite(VMX_EPT_POINTER_FULL, get_shadow_eptp(vmcs12->ept_pointer));
 	}
 
-	exec_vmwrite(VMX_ENTRY_CONTROLS, value64);
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_ENTRY_CTLS) != 0U) {
+		/* For VM-execution, entry and exit controls */
+		value64 = vmcs12->vm_entry_controls;
+		if ((value64 & VMX_ENTRY_CTLS_LOAD_EFER) != VMX_ENTRY_CTLS_LOAD_EFER) {
+			/*
+			 * L1 hypervisor wishes to use its IA32_EFER for L2 guest so we turn on the
+			 * VMX_ENTRY_CTLS_LOAD_EFER on VMCS02.
+			 */
+			value64 |= VMX_ENTRY_CTLS_LOAD_EFER;
+			exec_vmwrite(VMX_GUEST_IA32_EFER_FULL, vcpu_get_efer(vcpu));
+		}
+
+		exec_vmwrite(VMX_ENTRY_CONTROLS, value64);
+	}
+
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_EXIT_CTLS) != 0U) {
+		/* Host is alway runing in 64-bit mode */
+		value64 = vmcs12->vm_exit_controls | VMX_EXIT_CTLS_HOST_ADDR64;
+		exec_vmwrite(VMX_EXIT_CONTROLS, value64);
+	}
 
-	/* Host is alway runing in 64-bit mode */
-	value64 = vmcs12->vm_exit_controls | VMX_EXIT_CTLS_HOST_ADDR64;
-	exec_vmwrite(VMX_EXIT_CONTROLS, value64);
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_VPID) != 0U) {
+		exec_vmwrite(VMX_VPID, vmcs12->vpid);
+	}
 
-	exec_vmwrite(VMX_VPID, vmcs12->vpid);
+	vvmcs->dirty_fields &= ~NVMX_DIRTY_CONTROL_FIELDS;
 }
 
 /**
@@ -1032,17 +1098,19 @@ static void merge_and_sync_control_fields(struct acrn_vcpu *vcpu, struct acrn_vm
  * @pre vcpu != NULL
  * @pre vmcs02 is current
  */
-static void sync_vmcs12_to_vmcs02(struct acrn_vcpu *vcpu, struct acrn_vmcs12 *vmcs12)
+static void sync_vmcs12_to_vmcs02(struct acrn_vcpu *vcpu, struct acrn_vvmcs *vvmcs)
 {
 	uint64_t val64;
 	uint32_t idx;
 
 	for (idx = 0; idx < MAX_SHADOW_VMCS_FIELDS; idx++) {
-		val64 = vmcs12_read_field(vmcs12, vmcs_shadowing_fields[idx]);
+		val64 = vmcs12_read_field(&vvmcs->vmcs12, vmcs_shadowing_fields[idx]);
 		exec_vmwrite(vmcs_shadowing_fields[idx], val64);
 	}
 
-	merge_and_sync_control_fields(vcpu, vmcs12);
+	/* this VMCS02 starts from scratch, the whole control-field set must be loaded */
+	vvmcs->dirty_fields |= NVMX_DIRTY_CONTROL_FIELDS;
+	merge_and_sync_control_fields(vcpu, vvmcs);
 }
 
 /*
@@ -1142,8 +1210,7 @@ static void clear_vvmcs(struct acrn_vcpu *vcpu, struct acrn_vvmcs *vvmcs)
 	vvmcs->vmcs12_gpa = INVALID_GPA;
 
 	/* Cleanup per VVMCS dirty flags */
-	vvmcs->host_state_dirty = false;
-	vvmcs->control_fields_dirty = false;
+	vvmcs->dirty_fields = 0U;
 }
 
 /*
@@ -1192,7 +1259,7 @@ int32_t vmptrld_vmexit_handler(struct acrn_vcpu *vcpu)
 				get_vept_desc(vvmcs->vmcs12.ept_pointer);
 
 				/* Need to load shadow fields from this new VMCS12 to VMCS02 */
-				sync_vmcs12_to_vmcs02(vcpu, &vvmcs->vmcs12);
+				sync_vmcs12_to_vmcs02(vcpu, vvmcs);
 			} else {
 				vvmcs->ref_cnt += 1U;
 			}
@@ -1326,12 +1393,11 @@ static void set_vmcs01_guest_state(struct acrn_vcpu *vcpu)
 	 * 3. Load Segmentation State
 	 * 4. Non-Register state
 	 */
-	struct acrn_vmcs12 *vmcs12 = &vcpu->arch.nested.current_vvmcs->vmcs12;
+	struct acrn_vvmcs *vvmcs = vcpu->arch.nested.current_vvmcs;
+	struct acrn_vmcs12 *vmcs12 = &vvmcs->vmcs12;
 	struct segment_sel seg;
 
-	if (vcpu->arch.nested.current_vvmcs->host_state_dirty == true) {
-		vcpu->arch.nested.current_vvmcs->host_state_dirty = false;
-
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_HOST_CTL_REGS) != 0U) {
 		/*
 		 * We want vcpu_get_cr0/4() can get the up-to-date values, but we don't
 		 * want to call vcpu_set_cr0/4() to handle the CR0/4 write.
@@ -1344,12 +1410,19 @@ static void set_vmcs01_guest_state(struct acrn_vcpu *vcpu)
 		exec_vmwrite(VMX_GUEST_CR3, vmcs12->host_cr3);
 		exec_vmwrite(VMX_GUEST_DR7, DR7_INIT_VALUE);
 		exec_vmwrite64(VMX_GUEST_IA32_DEBUGCTL_FULL, 0UL);
+	}
+
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_HOST_SYSENTER) != 0U) {
 		exec_vmwrite32(VMX_GUEST_IA32_SYSENTER_CS, vmcs12->host_ia32_sysenter_cs);
 		exec_vmwrite(VMX_GUEST_IA32_SYSENTER_ESP, vmcs12->host_ia32_sysenter_esp);
 		exec_vmwrite(VMX_GUEST_IA32_SYSENTER_EIP, vmcs12->host_ia32_sysenter_eip);
+	}
 
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_HOST_EFER) != 0U) {
 		exec_vmwrite(VMX_GUEST_IA32_EFER_FULL, vmcs12->host_ia32_efer);
+	}
 
+	if ((vvmcs->dirty_fields & NVMX_DIRTY_HOST_SEGMENTS) != 0U) {
 		/*
 		 * type: 11 (Execute/Read, accessed)
 		 * l: 64-bit mode active
@@ -1394,6 +1467,8 @@ static void set_vmcs01_guest_state(struct acrn_vcpu *vcpu)
 		exec_vmwrite32(VMX_GUEST_LDTR_ATTR, 0x10000U);
 	}
 
+	vvmcs->dirty_fields &= ~NVMX_DIRTY_HOST_STATE;
+
 	/*
 	 * For those registers that are managed by the vcpu->reg_updated flag,
 	 * need to write with vcpu_set_xxx() so that vcpu_get_xxx() can get the
@@ -1496,9 +1571,8 @@ static void nested_vmentry(struct acrn_vcpu *vcpu, bool is_launch)
 		/* as an ordinary VMCS, VMCS02 is active and currernt when L2 guest is running */
 		load_va_vmcs(cur_vvmcs->vmcs02);
 
-		if (cur_vvmcs->control_fields_dirty) {
-			cur_vvmcs->control_fields_dirty = false;
-			merge_and_sync_control_fields(vcpu, vmcs12);
+		if ((cur_vvmcs->dirty_fields & NVMX_DIRTY_CONTROL_FIELDS) != 0U) {
+			merge_and_sync_control_fields(vcpu, cur_vvmcs);
 		}
 
 		/* vCPU is in guest mode from this point */
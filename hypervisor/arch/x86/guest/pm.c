@@ -8,6 +8,7 @@
 #include <asm/host_pm.h>
 #include <asm/guest/vm.h>
 #include <asm/io.h>
+#include <delay.h>
 #include <logmsg.h>
 #include <platform_acpi_info.h>
 #include <asm/guest/guest_pm.h>
@@ -171,6 +172,49 @@ static inline void enter_s5(struct acrn_vcpu *vcpu, uint32_t pm1a_cnt_val, uint3
 	make_shutdown_vm_request(pcpu_id);
 }
 
+#define S3_VM_QUIESCE_TIMEOUT_US	(2000U * 1000U)
+#define S3_VM_QUIESCE_POLL_US		1000U
+
+/*
+ * The lifecycle manager is expected to have suspended all user VMs before
+ * the Service VM writes SLP_EN for S3. A user VM which is still running at
+ * that point would have its device state ripped out underneath it by the
+ * physical suspend, so wait a bounded time for every user VM to leave
+ * VM_RUNNING and refuse the transition when one of them fails to quiesce.
+ */
+static bool wait_user_vms_quiesced(void)
+{
+	uint16_t vm_id;
+	uint32_t waited_us = 0U;
+	bool quiesced = false;
+	struct acrn_vm *user_vm;
+
+	while (!quiesced && (waited_us <= S3_VM_QUIESCE_TIMEOUT_US)) {
+		quiesced = true;
+		for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+			user_vm = get_vm_from_vmid(vm_id);
+			if (!is_service_vm(user_vm) && (user_vm->state == VM_RUNNING)) {
+				quiesced = false;
+			}
+		}
+		if (!quiesced) {
+			udelay(S3_VM_QUIESCE_POLL_US);
+			waited_us += S3_VM_QUIESCE_POLL_US;
+		}
+	}
+
+	if (!quiesced) {
+		for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+			user_vm = get_vm_from_vmid(vm_id);
+			if (!is_service_vm(user_vm) && (user_vm->state == VM_RUNNING)) {
+				pr_err("%s: user VM %u is still running, cancel S3 entry",
+					__func__, vm_id);
+			}
+		}
+	}
+	return quiesced;
+}
+
 static inline void enter_s3(struct acrn_vm *vm, uint32_t pm1a_cnt_val, uint32_t pm1b_cnt_val)
 {
 	uint32_t guest_wakeup_vec32;
@@ -183,9 +227,15 @@ static inline void enter_s3(struct acrn_vm *vm, uint32_t pm1a_cnt_val, uint32_t
 	guest_wakeup_vec32 = *(vm->pm.sx_state_data->wake_vector_32);
 	clac();
 
-	pause_vm(vm);	/* pause Service VM before suspend system */
-	host_enter_s3(vm->pm.sx_state_data, pm1a_cnt_val, pm1b_cnt_val);
-	resume_vm_from_s3(vm, guest_wakeup_vec32);	/* jump back to vm */
+	/* barrier before touching the physical S3 rail: a cancelled entry
+	 * simply returns to the Service VM, like a wake event arriving
+	 * before the sleep completed.
+	 */
+	if (wait_user_vms_quiesced()) {
+		pause_vm(vm);	/* pause Service VM before suspend system */
+		host_enter_s3(vm->pm.sx_state_data, pm1a_cnt_val, pm1b_cnt_val);
+		resume_vm_from_s3(vm, guest_wakeup_vec32);	/* jump back to vm */
+	}
 	put_vm_lock(vm);
 }
 
@@ -0,0 +1,41 @@
+/*
+ * ACRN paravirtualized idle coordination.
+ *
+ * A per-vCPU shared flag page where the guest declares how it idles, so
+ * host-side halt polling and a guest running idle=poll (or a
+ * haltpoll-style governor) do not spin two cores for one idle vCPU: the
+ * HLT emulation path blocks immediately for vCPUs that poll internally.
+ *
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/pv_idle.h>
+
+void pv_idle_msr_write(struct acrn_vcpu *vcpu, uint64_t val)
+{
+	vcpu->arch.pv_idle_msr = val;
+	vcpu->arch.pv_idle_page = NULL;
+
+	if ((val & ACRN_PV_IDLE_ENABLE) != 0UL) {
+		vcpu->arch.pv_idle_page = (struct acrn_pv_idle_info *)
+			gpa2hva(vcpu->vm, val & ~ACRN_PV_IDLE_ENABLE);
+	}
+}
+
+bool pv_idle_guest_polling(const struct acrn_vcpu *vcpu)
+{
+	struct acrn_pv_idle_info *pi = vcpu->arch.pv_idle_page;
+	bool polling = false;
+
+	if (pi != NULL) {
+		stac();
+		polling = ((pi->flags & ACRN_PV_IDLE_GUEST_POLLING) != 0U);
+		clac();
+	}
+
+	return polling;
+}
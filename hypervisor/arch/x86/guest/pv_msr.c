@@ -0,0 +1,91 @@
+/*
+ * ACRN paravirtualized MSR shadow page.
+ *
+ * A per-vCPU shared page holding the values of a small read-mostly MSR
+ * set (thermal status, platform info), so guest daemons that poll them
+ * read shared memory instead of taking a vmexit per RDMSR. The shadowed
+ * values are refreshed from the hardware at a bounded rate when the vCPU
+ * is switched in; MSRs outside the set keep the ordinary exit path.
+ *
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <rtl.h>
+#include <asm/guest/vm.h>
+#include <asm/msr.h>
+#include <ticks.h>
+#include <asm/guest/pv_msr.h>
+
+/* a shadowed value is at most this far behind the hardware */
+#define PV_MSR_REFRESH_PERIOD_MS	10UL
+
+/*
+ * The shadowed set: read-only informational MSRs whose values move
+ * slowly (thermal state) or never (platform info). Values are taken
+ * from the pCPU the vCPU runs on, which is where an intercepted read
+ * would have sampled them as well.
+ */
+static const uint32_t pv_msr_shadow_set[] = {
+	MSR_IA32_THERM_STATUS,
+	MSR_IA32_PACKAGE_THERM_STATUS,
+	MSR_TEMPERATURE_TARGET,
+	MSR_PLATFORM_INFO,
+};
+
+/*
+ * Refresh the shadowed values. Called when the vCPU is switched in;
+ * rate-limited so frequent context switches do not turn into hardware
+ * MSR read storms.
+ */
+void pv_msr_update_page(struct acrn_vcpu *vcpu)
+{
+	struct acrn_pv_msr_page *page = vcpu->arch.pv_msr_page;
+	uint64_t now;
+	uint32_t i;
+
+	if (page != NULL) {
+		now = cpu_ticks();
+		if ((now - vcpu->arch.pv_msr_last_refresh) >= (PV_MSR_REFRESH_PERIOD_MS * TICKS_PER_MS)) {
+			vcpu->arch.pv_msr_last_refresh = now;
+			stac();
+			/* odd version tells the guest an update is in flight */
+			page->version++;
+			cpu_write_memory_barrier();
+			for (i = 0U; i < ARRAY_SIZE(pv_msr_shadow_set); i++) {
+				page->entries[i].value = msr_read(pv_msr_shadow_set[i]);
+			}
+			cpu_write_memory_barrier();
+			page->version++;
+			clac();
+		}
+	}
+}
+
+void pv_msr_msr_write(struct acrn_vcpu *vcpu, uint64_t val)
+{
+	struct acrn_pv_msr_page *page;
+	uint32_t i;
+
+	vcpu->arch.pv_msr_msr = val;
+	vcpu->arch.pv_msr_page = NULL;
+
+	if ((val & ACRN_PV_MSR_ENABLE) != 0UL) {
+		page = (struct acrn_pv_msr_page *)gpa2hva(vcpu->vm, val & ~ACRN_PV_MSR_ENABLE);
+
+		stac();
+		(void)memset(page, 0U, sizeof(struct acrn_pv_msr_page));
+		page->nr_entries = ARRAY_SIZE(pv_msr_shadow_set);
+		for (i = 0U; i < ARRAY_SIZE(pv_msr_shadow_set); i++) {
+			page->entries[i].msr = pv_msr_shadow_set[i];
+		}
+		clac();
+
+		vcpu->arch.pv_msr_page = page;
+		/* force an immediate first refresh */
+		vcpu->arch.pv_msr_last_refresh = 0UL;
+		pv_msr_update_page(vcpu);
+	}
+}
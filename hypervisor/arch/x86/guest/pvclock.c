@@ -0,0 +1,113 @@
+/*
+ * ACRN paravirtualized clock.
+ *
+ * A per-vCPU shared time page derived from the host TSC, so guests read
+ * time with one rdtsc and a little arithmetic instead of calibrating at
+ * boot or trapping into the emulated vRTC/HPET. The scale factors come
+ * from the host TSC frequency, which keeps guest images portable across
+ * boards with different TSC rates.
+ *
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <asm/guest/vm.h>
+#include <asm/vmx.h>
+#include <asm/tsc.h>
+#include <asm/guest/pvclock.h>
+
+#define NSEC_PER_SEC	1000000000UL
+
+static uint32_t pvclock_tsc_mul;
+static int8_t pvclock_tsc_shift;
+static bool pvclock_scale_ready;
+
+/* (a * mul) >> 32, with the intermediate product kept in 128 bits */
+static inline uint64_t
+u64_mul_u32_shr32(uint64_t a, uint32_t mul)
+{
+	uint64_t ret, disc;
+
+	asm volatile ("mulq %3" :
+		"=d" (ret), "=a" (disc) :
+		"a" (a), "r" ((uint64_t)mul << 32U));
+
+	return ret;
+}
+
+/*
+ * Derive tsc_to_system_mul/tsc_shift from the host TSC frequency, using
+ * the kvmclock fixed point: shift the frequency into (1e9, 2e9] so the
+ * multiplier lands in [2^31, 2^32).
+ */
+static void pvclock_init_scale(void)
+{
+	uint64_t tsc_hz = (uint64_t)get_tsc_khz() * 1000UL;
+	int8_t shift = 0;
+
+	while (tsc_hz > (2UL * NSEC_PER_SEC)) {
+		tsc_hz >>= 1U;
+		shift--;
+	}
+	while (tsc_hz <= NSEC_PER_SEC) {
+		tsc_hz <<= 1U;
+		shift++;
+	}
+	pvclock_tsc_mul = (uint32_t)((NSEC_PER_SEC << 32U) / tsc_hz);
+	pvclock_tsc_shift = shift;
+	pvclock_scale_ready = true;
+}
+
+static inline uint64_t pvclock_scale_tsc(uint64_t tsc)
+{
+	uint64_t t = (pvclock_tsc_shift < 0) ?
+		(tsc >> (uint8_t)(-pvclock_tsc_shift)) : (tsc << (uint8_t)pvclock_tsc_shift);
+
+	return u64_mul_u32_shr32(t, pvclock_tsc_mul);
+}
+
+/*
+ * Republish the vCPU's time page. Called with this vCPU's VMCS current:
+ * on every context switch in, and after the guest TSC is rewritten (MSR
+ * write or image restore). system_time is derived from the host TSC, so
+ * it stays continuous even when the guest TSC jumps; tsc_timestamp is
+ * resampled so guest-side deltas restart from the new TSC value.
+ */
+void pvclock_update_page(struct acrn_vcpu *vcpu)
+{
+	struct acrn_pvclock_vcpu_time_info *ti = vcpu->arch.pvclock_page;
+	uint64_t host_tsc;
+
+	if (ti != NULL) {
+		host_tsc = rdtsc();
+		stac();
+		/* odd version tells the guest an update is in flight */
+		ti->version++;
+		cpu_write_memory_barrier();
+		ti->tsc_timestamp = host_tsc + exec_vmread64(VMX_TSC_OFFSET_FULL);
+		ti->system_time = pvclock_scale_tsc(host_tsc);
+		ti->tsc_to_system_mul = pvclock_tsc_mul;
+		ti->tsc_shift = pvclock_tsc_shift;
+		ti->flags = 0U;
+		cpu_write_memory_barrier();
+		ti->version++;
+		clac();
+	}
+}
+
+void pvclock_msr_write(struct acrn_vcpu *vcpu, uint64_t val)
+{
+	vcpu->arch.pvclock_msr = val;
+	vcpu->arch.pvclock_page = NULL;
+
+	if ((val & ACRN_PVCLOCK_ENABLE) != 0UL) {
+		if (!pvclock_scale_ready) {
+			pvclock_init_scale();
+		}
+		vcpu->arch.pvclock_page = (struct acrn_pvclock_vcpu_time_info *)
+			gpa2hva(vcpu->vm, val & ~ACRN_PVCLOCK_ENABLE);
+		pvclock_update_page(vcpu);
+	}
+}
@@ -32,6 +32,22 @@ struct trusty_mem {
 	/* The left memory is for trusty's code/data/heap/stack */
 } __aligned(PAGE_SIZE);
 
+/* The virtual seeds and the attestation keybox encryption key are pure
+ * functions of the physical seeds and the VM name, both fixed for the
+ * lifetime of a VM, but walking the HKDF/HMAC pipeline dominates the cost
+ * of a secure world initialization. Keep the derived material per VM and
+ * reuse it when trusty is initialized again after a secure world teardown;
+ * it is wiped together with the secure world.
+ */
+struct trusty_derived_keys {
+	bool valid;
+	uint32_t num_seeds;
+	struct seed_info dseed_list[BOOTLOADER_SEED_MAX_ENTRIES];
+	uint8_t attkb_enc_key[32];
+};
+
+static struct trusty_derived_keys trusty_derived_keys[CONFIG_MAX_VM_NUM];
+
 /**
  * @defgroup trusty_apis Trusty APIs
  *
@@ -93,6 +109,10 @@ void destroy_secure_world(struct acrn_vm *vm, bool need_clr_mem)
 		ept_del_mr(vm, vm->arch_vm.sworld_eptp, gpa_user_vm, size);
 		vm->arch_vm.sworld_eptp = NULL;
 
+		/* the derived keys die with the secure world */
+		(void)memset(&trusty_derived_keys[vm->vm_id], 0U,
+			sizeof(struct trusty_derived_keys));
+
 		/* Restore memory to guest normal world */
 		ept_add_mr(vm, vm->arch_vm.nworld_eptp, hpa, gpa_user_vm, size, EPT_RWX | EPT_WB);
 	} else {
@@ -264,6 +284,7 @@ static bool setup_trusty_info(struct acrn_vcpu *vcpu, uint32_t mem_size, uint64_
 	struct trusty_mem *mem;
 	struct trusty_key_info key_info;
 	struct trusty_startup_param startup_param;
+	struct trusty_derived_keys *keys = &trusty_derived_keys[vcpu->vm->vm_id];
 
 	(void)memset(&key_info, 0U, sizeof(key_info));
 
@@ -276,36 +297,48 @@ static bool setup_trusty_info(struct acrn_vcpu *vcpu, uint32_t mem_size, uint64_
 		(void)memset(rkey, 0U, 64U);
 	}
 
-	/* Derive dvseed from dseed for Trusty */
-	if (derive_virtual_seed(&key_info.dseed_list[0U], &key_info.num_seeds,
-				  NULL, 0U,
-				  (uint8_t *)vcpu->vm->name, strnlen_s(vcpu->vm->name, MAX_VM_NAME_LEN))) {
-		/* Derive encryption key of attestation keybox from dseed */
-		if (derive_attkb_enc_key(key_info.attkb_enc_key)) {
-			/* Prepare trusty startup param */
-			startup_param.size_of_this_struct = sizeof(struct trusty_startup_param);
-			startup_param.mem_size = mem_size;
-			startup_param.tsc_per_ms = TSC_PER_MS;
-			startup_param.trusty_mem_base = TRUSTY_EPT_REBASE_GPA;
-
-			/* According to trusty boot protocol, it will use RDI as the
-			 * address(GPA) of startup_param on boot. Currently, the startup_param
-			 * is put in the first page of trusty memory just followed by key_info.
-			 */
-			vcpu->arch.contexts[SECURE_WORLD].run_ctx.cpu_regs.regs.rdi
-				= (uint64_t)TRUSTY_EPT_REBASE_GPA + sizeof(struct trusty_key_info);
-
-			stac();
-			mem = (struct trusty_mem *)(hpa2hva(mem_base_hpa));
-			(void)memcpy_s((void *)&mem->first_page.key_info, sizeof(struct trusty_key_info),
-				       &key_info, sizeof(key_info));
-			(void)memcpy_s((void *)&mem->first_page.startup_param, sizeof(struct trusty_startup_param),
-				       &startup_param, sizeof(startup_param));
-			clac();
-			success = true;
+	if (!keys->valid) {
+		/* Derive dvseed from dseed for Trusty */
+		if (derive_virtual_seed(&keys->dseed_list[0U], &keys->num_seeds,
+					  NULL, 0U,
+					  (uint8_t *)vcpu->vm->name, strnlen_s(vcpu->vm->name, MAX_VM_NAME_LEN))) {
+			/* Derive encryption key of attestation keybox from dseed */
+			if (derive_attkb_enc_key(keys->attkb_enc_key)) {
+				keys->valid = true;
+			}
 		}
 	}
 
+	if (keys->valid) {
+		key_info.num_seeds = keys->num_seeds;
+		(void)memcpy_s(&key_info.dseed_list[0U], sizeof(key_info.dseed_list),
+			       &keys->dseed_list[0U], sizeof(keys->dseed_list));
+		(void)memcpy_s(key_info.attkb_enc_key, sizeof(key_info.attkb_enc_key),
+			       keys->attkb_enc_key, sizeof(keys->attkb_enc_key));
+
+		/* Prepare trusty startup param */
+		startup_param.size_of_this_struct = sizeof(struct trusty_startup_param);
+		startup_param.mem_size = mem_size;
+		startup_param.tsc_per_ms = TSC_PER_MS;
+		startup_param.trusty_mem_base = TRUSTY_EPT_REBASE_GPA;
+
+		/* According to trusty boot protocol, it will use RDI as the
+		 * address(GPA) of startup_param on boot. Currently, the startup_param
+		 * is put in the first page of trusty memory just followed by key_info.
+		 */
+		vcpu->arch.contexts[SECURE_WORLD].run_ctx.cpu_regs.regs.rdi
+			= (uint64_t)TRUSTY_EPT_REBASE_GPA + sizeof(struct trusty_key_info);
+
+		stac();
+		mem = (struct trusty_mem *)(hpa2hva(mem_base_hpa));
+		(void)memcpy_s((void *)&mem->first_page.key_info, sizeof(struct trusty_key_info),
+			       &key_info, sizeof(key_info));
+		(void)memcpy_s((void *)&mem->first_page.startup_param, sizeof(struct trusty_startup_param),
+			       &startup_param, sizeof(startup_param));
+		clac();
+		success = true;
+	}
+
 	(void)memset(&key_info, 0U, sizeof(key_info));
 
 	return success;
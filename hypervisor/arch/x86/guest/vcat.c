@@ -418,7 +418,8 @@ int32_t write_vclosid(struct acrn_vcpu *vcpu, uint64_t val)
 			 * Here we only need to update the vcpu->arch.msr_area.guest[].value field for IA32_PQR_ASSOC,
 			 * all other vcpu->arch.msr_area fields remains unchanged at runtime.
 			 */
-			vcpu->arch.msr_area.guest[vcpu->arch.msr_area.index_of_pqr_assoc].value = clos2pqr_msr(pclosid);
+			vcpu->arch.msr_area.guest[vcpu->arch.msr_area.index_of_pqr_assoc].value =
+				clos_rmid2pqr_msr(pclosid, vm_rmid(vcpu->vm->vm_id));
 
 			ret = 0;
 		}
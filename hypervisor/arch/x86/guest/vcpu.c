@@ -13,14 +13,22 @@
 #include <logmsg.h>
 #include <asm/cpufeatures.h>
 #include <asm/cpu_caps.h>
+#include <asm/host_pm.h>
 #include <asm/per_cpu.h>
 #include <asm/init.h>
 #include <asm/guest/vm.h>
 #include <asm/guest/vmcs.h>
+#include <asm/notify.h>
 #include <asm/mmu.h>
 #include <lib/sprintf.h>
 #include <asm/lapic.h>
 #include <asm/irq.h>
+#include <asm/tsc.h>
+#include <asm/lib/atomic.h>
+#include <asm/guest/pvclock.h>
+#include <asm/guest/pv_msr.h>
+#include <ptdev.h>
+#include <ticks.h>
 
 /* stack_frame is linked with the sequence of stack operation in arch_switch_to() */
 struct stack_frame {
@@ -222,7 +230,7 @@ void load_iwkey(struct acrn_vcpu *vcpu)
 	uint64_t xmm_save[6];
 
 	/* Only load IWKey with vCPU CR4 keylocker bit enabled */
-	if (pcpu_has_cap(X86_FEATURE_KEYLOCKER) && vcpu->arch.cr4_kl_enabled &&
+	if (pcpu_has_cap_const(X86_FEATURE_KEYLOCKER) && vcpu->arch.cr4_kl_enabled &&
 	    (get_cpu_var(whose_iwkey) != vcpu)) {
 		/* Save/restore xmm0/xmm1/xmm2 during the process */
 		read_xmm_0_2(&xmm_save[0], &xmm_save[2], &xmm_save[4]);
@@ -249,6 +257,8 @@ static void vcpu_reset_internal(struct acrn_vcpu *vcpu, enum reset_mode mode)
 	vcpu->arch.irq_window_enabled = false;
 	vcpu->arch.emulating_lock = false;
 	(void)memset((void *)vcpu->arch.vmcs, 0U, PAGE_SIZE);
+	/* decoded-instruction cache entries belong to the previous guest image */
+	(void)memset((void *)vcpu->inst_ctxt.cache, 0U, sizeof(vcpu->inst_ctxt.cache));
 
 	for (i = 0; i < NR_WORLD; i++) {
 		(void)memset((void *)(&vcpu->arch.contexts[i]), 0U,
@@ -269,6 +279,17 @@ static void vcpu_reset_internal(struct acrn_vcpu *vcpu, enum reset_mode mode)
 
 	init_iwkey(vcpu);
 	vcpu->arch.iwkey_copy_status = 0UL;
+
+	/* counter programming belongs to the previous guest image */
+	(void)memset((void *)&vcpu->arch.vpmu, 0U, sizeof(struct acrn_vpmu));
+
+	/* the time page GPA belongs to the previous guest image */
+	vcpu->arch.pvclock_msr = 0UL;
+	vcpu->arch.pvclock_page = NULL;
+	vcpu->arch.pv_idle_msr = 0UL;
+	vcpu->arch.pv_idle_page = NULL;
+	vcpu->arch.pv_msr_msr = 0UL;
+	vcpu->arch.pv_msr_page = NULL;
 }
 
 struct acrn_vcpu *get_running_vcpu(uint16_t pcpu_id)
@@ -407,6 +428,71 @@ void set_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_regs *vcpu_regs)
 			vcpu_regs->cr0);
 }
 
+/* Snapshot counterpart of set_vcpu_regs. The state read here follows the
+ * acrn_regs layout so it can be fed back through HC_SET_VCPU_REGS on restore.
+ * Segment and descriptor-table state of a launched vCPU lives in the VMCS,
+ * so this must run with the target vCPU's VMCS loaded as current.
+ */
+static void get_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_regs *vcpu_regs)
+{
+	struct run_context *ctx = &(vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx);
+
+	(void)memcpy_s((void *)&(vcpu_regs->gprs), sizeof(struct acrn_gp_regs),
+			(void *)&(ctx->cpu_regs), sizeof(struct acrn_gp_regs));
+
+	vcpu_regs->rip = vcpu_get_rip(vcpu);
+	vcpu_regs->gprs.rsp = vcpu_get_gpreg(vcpu, CPU_REG_RSP);
+	vcpu_regs->rflags = vcpu_get_rflags(vcpu);
+	vcpu_regs->ia32_efer = vcpu_get_efer(vcpu);
+	vcpu_regs->cr0 = vcpu_get_cr0(vcpu);
+	vcpu_regs->cr4 = vcpu_get_cr4(vcpu);
+	vcpu_regs->cr3 = exec_vmread(VMX_GUEST_CR3);
+
+	vcpu_regs->gdt.base = exec_vmread(VMX_GUEST_GDTR_BASE);
+	vcpu_regs->gdt.limit = (uint16_t)exec_vmread32(VMX_GUEST_GDTR_LIMIT);
+	vcpu_regs->idt.base = exec_vmread(VMX_GUEST_IDTR_BASE);
+	vcpu_regs->idt.limit = (uint16_t)exec_vmread32(VMX_GUEST_IDTR_LIMIT);
+
+	vcpu_regs->cs_base = exec_vmread(VMX_GUEST_CS_BASE);
+	vcpu_regs->cs_limit = exec_vmread32(VMX_GUEST_CS_LIMIT);
+	vcpu_regs->cs_ar = exec_vmread32(VMX_GUEST_CS_ATTR);
+	vcpu_regs->cs_sel = exec_vmread16(VMX_GUEST_CS_SEL);
+	vcpu_regs->ss_sel = exec_vmread16(VMX_GUEST_SS_SEL);
+	vcpu_regs->ds_sel = exec_vmread16(VMX_GUEST_DS_SEL);
+	vcpu_regs->es_sel = exec_vmread16(VMX_GUEST_ES_SEL);
+	vcpu_regs->fs_sel = exec_vmread16(VMX_GUEST_FS_SEL);
+	vcpu_regs->gs_sel = exec_vmread16(VMX_GUEST_GS_SEL);
+	vcpu_regs->ldt_sel = exec_vmread16(VMX_GUEST_LDTR_SEL);
+	vcpu_regs->tr_sel = exec_vmread16(VMX_GUEST_TR_SEL);
+}
+
+struct vcpu_regs_snapshot {
+	struct acrn_vcpu *vcpu;
+	struct acrn_regs *regs;
+};
+
+/* the input 'data' must != NULL and indicate a vcpu_regs_snapshot pointer */
+static void snapshot_vcpu_regs_on_pcpu(void *data)
+{
+	struct vcpu_regs_snapshot *snap = data;
+	struct acrn_vcpu *curr = get_running_vcpu(get_pcpu_id());
+
+	load_vmcs(snap->vcpu);
+	get_vcpu_regs(snap->vcpu, snap->regs);
+	if (curr != NULL) {
+		load_vmcs(curr);
+	}
+}
+
+void vcpu_snapshot_regs(struct acrn_vcpu *vcpu, struct acrn_regs *vcpu_regs)
+{
+	uint64_t mask = 0UL;
+	struct vcpu_regs_snapshot snap = { .vcpu = vcpu, .regs = vcpu_regs };
+
+	bitmap_set_nolock(pcpuid_from_vcpu(vcpu), &mask);
+	smp_call_function(mask, snapshot_vcpu_regs_on_pcpu, &snap);
+}
+
 static struct acrn_regs realmode_init_vregs = {
 	.gdt = {
 		.limit = 0xFFFFU,
@@ -569,6 +655,14 @@ int32_t create_vcpu(uint16_t pcpu_id, struct acrn_vm *vm, struct acrn_vcpu **rtn
 		 */
 		per_cpu(vcpu_array, pcpu_id)[vm->vm_id] = vcpu;
 
+		/* a pCPU serving an RT vCPU must wake fast: restrict its idle
+		 * governor to C1. RT placement is static per scenario config,
+		 * so the class is never relaxed at runtime.
+		 */
+		if (is_rt_vm(vm)) {
+			per_cpu(idle_class, pcpu_id) = IDLE_CLASS_SHALLOW;
+		}
+
 		/*
 		 * Use vm_id as the index to indicate the posted interrupt IRQ/vector pair that are
 		 * assigned to this vCPU:
@@ -579,8 +673,8 @@ int32_t create_vcpu(uint16_t pcpu_id, struct acrn_vm *vm, struct acrn_vcpu **rtn
 		 */
 		vcpu->arch.pid.control.bits.nv = POSTED_INTR_VECTOR + vm->vm_id;
 
-		/* ACRN does not support vCPU migration, one vCPU always runs on
-		 * the same pCPU, so PI's ndst is never changed after startup.
+		/* PI's ndst tracks the pCPU the vCPU lives on; it only changes
+		 * afterwards when vcpu_migrate() hands the vCPU to another pCPU.
 		 */
 		vcpu->arch.pid.control.bits.ndst = per_cpu(lapic_id, pcpu_id);
 
@@ -801,6 +895,30 @@ void kick_vcpu(struct acrn_vcpu *vcpu)
 	}
 }
 
+void kick_vcpus(struct acrn_vm *vm)
+{
+	uint16_t i, pcpu_id;
+	struct acrn_vcpu *vcpu;
+	uint32_t ipi_mask = 0U;
+
+	foreach_vcpu(i, vm, vcpu) {
+		pcpu_id = pcpuid_from_vcpu(vcpu);
+		if ((get_pcpu_id() != pcpu_id) &&
+			(per_cpu(vmcs_run, pcpu_id) == vcpu->arch.vmcs)) {
+			if (is_lapic_pt_enabled(vcpu)) {
+				/* INIT signals cannot be multicast */
+				send_single_init(pcpu_id);
+			} else {
+				ipi_mask |= (1U << pcpu_id);
+			}
+		}
+	}
+
+	if (ipi_mask != 0U) {
+		send_dest_ipi_mask(ipi_mask, NOTIFY_VCPU_VECTOR);
+	}
+}
+
 /*
  * @pre (&vcpu->stack[CONFIG_STACK_SIZE] & (CPU_STACK_ALIGN - 1UL)) == 0
  */
@@ -865,16 +983,23 @@ void zombie_vcpu(struct acrn_vcpu *vcpu, enum vcpu_state new_state)
 
 void save_xsave_area(__unused struct acrn_vcpu *vcpu, struct ext_context *ectx)
 {
-	if (pcpu_has_cap(X86_FEATURE_XSAVES)) {
+	if (pcpu_has_cap_const(X86_FEATURE_XSAVES)) {
 		ectx->xcr0 = read_xcr(0);
 		write_xcr(0, ectx->xcr0 | XSAVE_SSE);
+		/* XSAVES applies the init and modified optimizations in
+		 * hardware: components in their init state are skipped, and
+		 * when this pCPU's last XRSTORS came from this same area (the
+		 * common case for a vCPU bouncing between runnable and
+		 * blocked on one pCPU) unmodified components are not written
+		 * back either, so no software XINUSE tracking is needed here.
+		 */
 		xsaves(&ectx->xs_area, UINT64_MAX);
 	}
 }
 
 void rstore_xsave_area(const struct acrn_vcpu *vcpu, const struct ext_context *ectx)
 {
-	if (pcpu_has_cap(X86_FEATURE_XSAVES)) {
+	if (pcpu_has_cap_const(X86_FEATURE_XSAVES)) {
 		/*
 		 * Restore XSAVE area if any of the following conditions is met:
 		 * 1. "vcpu->launched" is false (state initialization for guest)
@@ -912,6 +1037,43 @@ static void context_switch_out(struct thread_object *prev)
 	ectx->tsc_aux = msr_read(MSR_IA32_TSC_AUX);
 
 	save_xsave_area(vcpu, ectx);
+
+	vpmu_switch_out(vcpu);
+
+	/* drop the frequency floor while no vCPU runs here */
+	hwp_apply_min_perf(0U);
+}
+
+/*
+ * Runs at schedule-decision time, before the outgoing vCPU's state is
+ * saved: start pulling the incoming vCPU's VMCS and saved context into
+ * this core's cache so the VMPTRLD and the MSR/XRSTORS sequence in
+ * context_switch_in() hit warm lines instead of stalling on DRAM or on
+ * dirty lines still sitting in the cache of the pCPU this vCPU last ran
+ * on. Only the head of the XSAVE area is touched by hand; the rest
+ * streams in behind the demand accesses of XRSTORS.
+ */
+static void context_prefetch(struct thread_object *next)
+{
+	struct acrn_vcpu *vcpu = container_of(next, struct acrn_vcpu, thread_obj);
+	struct ext_context *ectx = &(vcpu->arch.contexts[vcpu->arch.cur_context].ext_ctx);
+	const uint8_t *p;
+	uint32_t i;
+
+	prefetcht0(vcpu->arch.vmcs);
+
+	/* the saved MSRs between the head of the extended context and the
+	 * XSAVE area, then the XSAVE legacy region and header which XRSTORS
+	 * reads first
+	 */
+	p = (const uint8_t *)ectx;
+	for (i = 0U; i < offsetof(struct ext_context, xs_area); i += CACHE_LINE_SIZE) {
+		prefetcht0(p + i);
+	}
+	p = (const uint8_t *)&ectx->xs_area;
+	for (i = 0U; i < (XSAVE_LEGACY_AREA_SIZE + XSAVE_HEADER_AREA_SIZE); i += CACHE_LINE_SIZE) {
+		prefetcht0(p + i);
+	}
 }
 
 static void context_switch_in(struct thread_object *next)
@@ -922,6 +1084,8 @@ static void context_switch_in(struct thread_object *next)
 
 	load_vmcs(vcpu);
 
+	hwp_apply_min_perf(vcpu->vm->hwp_min_perf);
+
 	msr_write(MSR_IA32_STAR, ectx->ia32_star);
 	msr_write(MSR_IA32_CSTAR, ectx->ia32_cstar);
 	msr_write(MSR_IA32_LSTAR, ectx->ia32_lstar);
@@ -929,7 +1093,7 @@ static void context_switch_in(struct thread_object *next)
 	msr_write(MSR_IA32_KERNEL_GS_BASE, ectx->ia32_kernel_gs_base);
 	msr_write(MSR_IA32_TSC_AUX, ectx->tsc_aux);
 
-	if (pcpu_has_cap(X86_FEATURE_WAITPKG)) {
+	if (pcpu_has_cap_const(X86_FEATURE_WAITPKG)) {
 		vmsr_val = vcpu_get_guest_msr(vcpu, MSR_IA32_UMWAIT_CONTROL);
 		if (vmsr_val != msr_read(MSR_IA32_UMWAIT_CONTROL)) {
 			msr_write(MSR_IA32_UMWAIT_CONTROL, vmsr_val);
@@ -939,6 +1103,66 @@ static void context_switch_in(struct thread_object *next)
 	load_iwkey(vcpu);
 
 	rstore_xsave_area(vcpu, ectx);
+
+	vpmu_switch_in(vcpu);
+
+	/* republish the PV time page so clock reads on this pCPU stay fresh */
+	pvclock_update_page(vcpu);
+	/* resample the shadowed read-mostly MSRs on this pCPU */
+	pv_msr_update_page(vcpu);
+}
+
+/*
+ * Hand a vCPU thread over to another pCPU. Runs on the pCPU the vCPU last
+ * ran on, under both pCPUs' scheduler locks, with the vCPU not running:
+ * VMCLEAR must execute on the pCPU where the VMCS may still be cached. The
+ * cleared VMCS keeps its guest state in memory, so the destination only
+ * needs a VMPTRLD (done by load_vmcs at the next context_switch_in) plus
+ * rebuilt host state fields.
+ *
+ * @pre get_pcpu_id() == the pCPU this vCPU last ran on
+ */
+static bool vcpu_migrate(struct thread_object *obj, uint16_t dest_pcpu_id)
+{
+	struct acrn_vcpu *vcpu = container_of(obj, struct acrn_vcpu, thread_obj);
+	uint16_t src_pcpu_id = get_pcpu_id();
+	uint64_t old_ctl, new_ctl;
+	bool ret = false;
+
+	/* the per-pCPU lookup array has one slot per VM; refuse to co-locate
+	 * two vCPUs of the same VM, posted-interrupt handling relies on it
+	 */
+	if (per_cpu(vcpu_array, dest_pcpu_id)[vcpu->vm->vm_id] == NULL) {
+		if (vcpu->launched) {
+			clear_va_vmcs(vcpu->arch.vmcs);
+			if (per_cpu(vmcs_run, src_pcpu_id) == (void *)vcpu->arch.vmcs) {
+				per_cpu(vmcs_run, src_pcpu_id) = NULL;
+			}
+			vcpu_make_request(vcpu, ACRN_REQUEST_INIT_HOST_STATE);
+			/* re-evaluate interrupts which were posted to the source
+			 * pCPU while the vCPU was waiting there
+			 */
+			vcpu_make_request(vcpu, ACRN_REQUEST_EVENT);
+		}
+		per_cpu(vcpu_array, src_pcpu_id)[vcpu->vm->vm_id] = NULL;
+		per_cpu(vcpu_array, dest_pcpu_id)[vcpu->vm->vm_id] = vcpu;
+
+		/* posted notifications must chase the vCPU; devices keep
+		 * setting ON with locked ops on the control qword, so swing
+		 * NDST with a cmpxchg loop instead of a plain store
+		 */
+		do {
+			old_ctl = vcpu->arch.pid.control.value;
+			new_ctl = (old_ctl & 0xffffffffUL) |
+				((uint64_t)per_cpu(lapic_id, dest_pcpu_id) << 32U);
+		} while (atomic_cmpxchg64(&vcpu->arch.pid.control.value, old_ctl, new_ctl) != old_ctl);
+
+		/* remapped-format IRTEs and IOAPIC RTEs follow lazily in batches */
+		ptirq_notify_vcpu_placement(vcpu->vm->vm_id);
+		ret = true;
+	}
+
+	return ret;
 }
 
 
@@ -951,6 +1175,11 @@ void launch_vcpu(struct acrn_vcpu *vcpu)
 	uint16_t pcpu_id = pcpuid_from_vcpu(vcpu);
 
 	pr_dbg("vcpu%hu scheduled on pcpu%hu", vcpu->vcpu_id, pcpu_id);
+
+	if (is_vcpu_bsp(vcpu) && (vcpu->vm->first_vcpu_launch_tsc == 0UL)) {
+		vcpu->vm->first_vcpu_launch_tsc = rdtsc();
+	}
+
 	vcpu_set_state(vcpu, VCPU_RUNNING);
 	wake_thread(&vcpu->thread_obj);
 
@@ -970,11 +1199,25 @@ int32_t prepare_vcpu(struct acrn_vm *vm, uint16_t pcpu_id)
 		vcpu->thread_obj.sched_ctl = &per_cpu(sched_ctl, pcpu_id);
 		vcpu->thread_obj.thread_entry = vcpu_thread;
 		vcpu->thread_obj.pcpu_id = pcpu_id;
+		/* opted-in vCPUs may float within the VM's affinity mask, all
+		 * others stay hard-pinned to their creation pCPU
+		 */
+		if ((get_vm_config(vm->vm_id)->guest_flags & GUEST_FLAG_VCPU_MIGRATION) != 0UL) {
+			vcpu->thread_obj.cpu_affinity = get_vm_config(vm->vm_id)->cpu_affinity;
+			vcpu->thread_obj.migrate = vcpu_migrate;
+		}
 		/* vcpu->thread_obj.notify_mode is initialized in vcpu_reset_internal() when create vcpu */
 		vcpu->thread_obj.host_sp = build_stack_frame(vcpu);
 		vcpu->thread_obj.switch_out = context_switch_out;
 		vcpu->thread_obj.switch_in = context_switch_in;
+		vcpu->thread_obj.prefetch = context_prefetch;
 		vcpu->thread_obj.priority = get_vm_config(vm->vm_id)->vm_prio;
+		/* only consumed by deadline-aware scheduler classes; zeroes
+		 * keep the class defaults
+		 */
+		vcpu->thread_obj.reserve_runtime = us_to_ticks(get_vm_config(vm->vm_id)->edf_runtime_us);
+		vcpu->thread_obj.reserve_period = us_to_ticks(get_vm_config(vm->vm_id)->edf_period_us);
+		vcpu->thread_obj.reserve_deadline = us_to_ticks(get_vm_config(vm->vm_id)->edf_deadline_us);
 		init_thread_data(&vcpu->thread_obj);
 		for (i = 0; i < VCPU_EVENT_NUM; i++) {
 			init_event(&vcpu->events[i]);
@@ -984,6 +1227,37 @@ int32_t prepare_vcpu(struct acrn_vm *vm, uint16_t pcpu_id)
 	return ret;
 }
 
+/*
+ * @brief Hot-add one vCPU to a created or running VM.
+ *
+ * The per-VM vcpu_array is statically allocated, so the "pool" of
+ * hot-addable vCPUs is the array's unused tail: hot-add materializes the
+ * next free slot through prepare_vcpu(), which pre-builds the execution
+ * contexts and scheduling state; the VMCS is assembled on the vCPU's
+ * first switch-in like any AP created at launch. The new vCPU stays in
+ * VCPU_OFFLINE until the guest BSP onlines it with INIT-SIPI.
+ *
+ * @pre vm != NULL
+ */
+int32_t hotadd_vcpu(struct acrn_vm *vm, uint16_t pcpu_id)
+{
+	int32_t ret = -1;
+
+	get_vm_lock(vm);
+	if ((is_created_vm(vm) || (vm->state == VM_RUNNING)) &&
+		(vm->hw.created_vcpus < MAX_VCPUS_PER_VM) &&
+		(pcpu_id < get_pcpu_nums()) &&
+		((vm->hw.cpu_affinity & (1UL << pcpu_id)) == 0UL)) {
+		ret = prepare_vcpu(vm, pcpu_id);
+		if (ret == 0) {
+			vm->hw.cpu_affinity |= (1UL << pcpu_id);
+		}
+	}
+	put_vm_lock(vm);
+
+	return ret;
+}
+
 /**
  * @pre vcpu != NULL
  */
@@ -14,44 +14,78 @@
 #include <asm/vmx.h>
 #include <asm/sgx.h>
 #include <asm/tsc.h>
+#include <asm/guest/pvclock.h>
+#include <asm/guest/pv_idle.h>
+#include <asm/guest/pv_msr.h>
 #include <logmsg.h>
 #include <asm/rdt.h>
 #include <asm/guest/vcat.h>
+#include <asm/guest/vpmu.h>
 
-static inline const struct vcpuid_entry *local_find_vcpuid_entry(const struct acrn_vcpu *vcpu,
+/* sort/lookup key: leaf in the high 32 bits, subleaf in the low 32 bits.
+ * An entry that does not check the subleaf serves every subleaf of its
+ * leaf and sorts as subleaf 0.
+ */
+static inline uint64_t vcpuid_entry_key(const struct vcpuid_entry *entry)
+{
+	uint64_t subleaf = (((entry->flags & CPUID_CHECK_SUBLEAF) != 0U) ? entry->subleaf : 0U);
+
+	return (((uint64_t)entry->leaf << 32U) | subleaf);
+}
+
+static inline bool match_vcpuid_entry(const struct vcpuid_entry *entry, uint32_t leaf, uint32_t subleaf)
+{
+	return ((entry->leaf == leaf) &&
+		(((entry->flags & CPUID_CHECK_SUBLEAF) == 0U) || (entry->subleaf == subleaf)));
+}
+
+static inline const struct vcpuid_entry *local_find_vcpuid_entry(struct acrn_vcpu *vcpu,
 					uint32_t leaf, uint32_t subleaf)
 {
-	uint32_t i = 0U, nr, half;
+	uint32_t lo = 0U, hi, mid;
+	uint64_t key = (((uint64_t)leaf << 32U) | subleaf);
 	const struct vcpuid_entry *found_entry = NULL;
 	struct acrn_vm *vm = vcpu->vm;
 
-	nr = vm->vcpuid_entry_nr;
-	half = nr >> 1U;
-	if (vm->vcpuid_entries[half].leaf < leaf) {
-		i = half;
-	}
-
-	for (; i < nr; i++) {
-		const struct vcpuid_entry *tmp = (const struct vcpuid_entry *)(&vm->vcpuid_entries[i]);
-
-		if (tmp->leaf < leaf) {
-			continue;
-		} else if (tmp->leaf == leaf) {
-			if (((tmp->flags & CPUID_CHECK_SUBLEAF) != 0U) && (tmp->subleaf != subleaf)) {
-				continue;
+	/* topology probe loops and feature-detect loops re-query the same
+	 * leaf back to back, so try the last hit before searching
+	 */
+	if (match_vcpuid_entry(&vm->vcpuid_entries[vcpu->vcpuid_last_idx], leaf, subleaf)) {
+		found_entry = &vm->vcpuid_entries[vcpu->vcpuid_last_idx];
+	} else {
+		/* the table is sorted by key: binary-search the lower bound,
+		 * i.e. the first entry whose key is not below the lookup key
+		 */
+		hi = vm->vcpuid_entry_nr;
+		while (lo < hi) {
+			mid = (lo + hi) >> 1U;
+			if (vcpuid_entry_key(&vm->vcpuid_entries[mid]) < key) {
+				lo = mid + 1U;
+			} else {
+				hi = mid;
 			}
-			found_entry = tmp;
-			break;
+		}
+
+		if ((lo < vm->vcpuid_entry_nr) && match_vcpuid_entry(&vm->vcpuid_entries[lo], leaf, subleaf)) {
+			found_entry = &vm->vcpuid_entries[lo];
+		} else if ((lo > 0U) && match_vcpuid_entry(&vm->vcpuid_entries[lo - 1U], leaf, subleaf)) {
+			/* an any-subleaf entry sorts as subleaf 0, below a
+			 * non-zero lookup subleaf of the same leaf
+			 */
+			found_entry = &vm->vcpuid_entries[lo - 1U];
 		} else {
-			/* tmp->leaf > leaf */
-			break;
+			/* no entry for this leaf/subleaf */
+		}
+
+		if (found_entry != NULL) {
+			vcpu->vcpuid_last_idx = (uint32_t)(found_entry - vm->vcpuid_entries);
 		}
 	}
 
 	return found_entry;
 }
 
-static inline const struct vcpuid_entry *find_vcpuid_entry(const struct acrn_vcpu *vcpu,
+static inline const struct vcpuid_entry *find_vcpuid_entry(struct acrn_vcpu *vcpu,
 					uint32_t leaf_arg, uint32_t subleaf)
 {
 	const struct vcpuid_entry *entry;
@@ -216,10 +250,13 @@ static void init_vcpuid_entry(uint32_t leaf, uint32_t subleaf,
 	 * This leaf returns the extended information of ACRN hypervisor.
 	 *
 	 * EAX: Guest capability flags
+	 *      Bit 0: per-vCPU PV clock time page, enabled via ACRN_MSR_PVCLOCK.
+	 *      Bit 1: per-vCPU PV idle coordination page, enabled via ACRN_MSR_PV_IDLE.
+	 *      Bit 2: per-vCPU PV MSR shadow page, enabled via ACRN_MSR_PV_MSR.
 	 * EBX, ECX, EDX: RESERVED (reserved fields are set to zero).
 	 */
 	case 0x40000001U:
-		entry->eax = 0U;
+		entry->eax = ACRN_CPUID_CAP_PVCLOCK | ACRN_CPUID_CAP_PV_IDLE | ACRN_CPUID_CAP_PV_MSR;
 		entry->ebx = 0U;
 		entry->ecx = 0U;
 		entry->edx = 0U;
@@ -490,6 +527,28 @@ static int32_t set_vcpuid_extended_function(struct acrn_vm *vm)
 	return result;
 }
 
+/* keep the table sorted by (leaf, subleaf) so lookup can binary-search it.
+ * The build below appends leaves in ascending order already, but subleaves
+ * of one leaf may arrive out of order (e.g. leaf 10h); the table is small
+ * and built once per VM, an insertion sort is plenty.
+ */
+static void sort_vcpuid_entries(struct acrn_vm *vm)
+{
+	uint32_t i, j;
+	struct vcpuid_entry tmp;
+
+	for (i = 1U; i < vm->vcpuid_entry_nr; i++) {
+		tmp = vm->vcpuid_entries[i];
+		for (j = i; j > 0U; j--) {
+			if (vcpuid_entry_key(&vm->vcpuid_entries[j - 1U]) <= vcpuid_entry_key(&tmp)) {
+				break;
+			}
+			vm->vcpuid_entries[j] = vm->vcpuid_entries[j - 1U];
+		}
+		vm->vcpuid_entries[j] = tmp;
+	}
+}
+
 static inline bool is_percpu_related(uint32_t leaf)
 {
 	return ((leaf == 0x1U) || (leaf == 0xbU) || (leaf == 0xdU) || (leaf == 0x19U) || (leaf == 0x80000001U) || (leaf == 0x2U) || (leaf == 0x1aU));
@@ -559,12 +618,18 @@ int32_t set_vcpuid_entries(struct acrn_vm *vm)
 			case 0x12U:
 				result = set_vcpuid_sgx(vm);
 				break;
-			/* These features are disabled */
-			/* PMU is not supported except for core partition VM, like RTVM */
+			/* PMU is hidden unless passed through (core partition VM,
+			 * like RTVM) or virtualized (GUEST_FLAG_VPMU) */
 			case 0x0aU:
 				if (is_pmu_pt_configured(vm)) {
 					init_vcpuid_entry(i, 0U, 0U, &entry);
 					result = set_vcpuid_entry(vm, &entry);
+				} else if (is_vpmu_configured(vm) && is_vpmu_avail()) {
+					init_vcpuid_entry(i, 0U, 0U, &entry);
+					vpmu_get_cpuid_0ah(&entry.eax, &entry.ebx, &entry.ecx, &entry.edx);
+					result = set_vcpuid_entry(vm, &entry);
+				} else {
+					/* leave the leaf all zeroes */
 				}
 				break;
 
@@ -603,6 +668,10 @@ int32_t set_vcpuid_entries(struct acrn_vm *vm)
 		if (result == 0) {
 			result = set_vcpuid_extended_function(vm);
 		}
+
+		if (result == 0) {
+			sort_vcpuid_entries(vm);
+		}
 	}
 
 	return result;
@@ -760,7 +829,7 @@ static void guest_cpuid_19h(struct acrn_vcpu *vcpu, uint32_t *eax, uint32_t *ebx
 	}
 }
 
-static void guest_cpuid_80000001h(const struct acrn_vcpu *vcpu,
+static void guest_cpuid_80000001h(struct acrn_vcpu *vcpu,
 	uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
 {
 	const struct vcpuid_entry *entry_check = find_vcpuid_entry(vcpu, 0x80000000U, 0);
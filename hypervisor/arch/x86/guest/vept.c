@@ -42,6 +42,7 @@ static uint64_t calc_sept_page_num(void)
 static struct page_pool sept_page_pool;
 static struct page *sept_pages;
 static uint64_t *sept_page_bitmap;
+static uint64_t *sept_page_summary;
 
 /*
  * @brief Reserve space for SEPT pages from platform E820 table
@@ -57,6 +58,8 @@ static void init_vept_pool(void)
 
 	sept_pages = (struct page *)page_base;
 	sept_page_bitmap = (uint64_t*)e820_alloc_memory((calc_sept_page_num() / 64U), ~0UL);
+	sept_page_summary = (uint64_t *)e820_alloc_memory(
+		PAGE_POOL_SUMMARY_SIZE(calc_sept_page_num() / 64U) * sizeof(uint64_t), ~0UL);
 }
 
 static bool is_present_ept_entry(uint64_t ept_entry)
@@ -105,6 +108,136 @@ static void free_sept_table(uint64_t *shadow_eptp)
 	}
 }
 
+/*
+ * @brief Re-validate a shadow EPT against the guest EPT it caches
+ *
+ * Emulated INVEPT used to drop the whole shadow paging structure, which made
+ * L1 pay an EPT-violation storm to rebuild the L2 working set after every
+ * invalidation. Instead, walk the shadow tables in lockstep with the guest
+ * tables: entries whose guest counterparts are unchanged are kept, so repeated
+ * L2 entries reuse the cached translations; entries whose guest counterparts
+ * were removed or re-pointed are released or refreshed.
+ *
+ * @pre vcpu != NULL && desc != NULL && desc->shadow_eptp != 0UL
+ * @pre The caller holds vept_desc_bucket_lock and has called stac()
+ */
+static void resync_sept_table(struct acrn_vcpu *vcpu, struct vept_desc *desc)
+{
+	uint64_t *shadow_pml4e, *shadow_pdpte, *shadow_pde, *shadow_pte;
+	uint64_t *guest_pml4_page, *guest_pdpt_page, *guest_pd_page, *guest_pt_page;
+	uint64_t guest_entry, hpa;
+	uint64_t i, j, k, m;
+
+	guest_pml4_page = gpa2hva(vcpu->vm, desc->guest_eptp & PAGE_MASK);
+	if (guest_pml4_page == NULL) {
+		/* The guest PML4 page itself is gone, nothing can be kept */
+		free_sept_table((void *)(desc->shadow_eptp & PAGE_MASK));
+	} else {
+		for (i = 0UL; i < PTRS_PER_PML4E; i++) {
+			shadow_pml4e = pml4e_offset((void *)(desc->shadow_eptp & PAGE_MASK), i << PML4E_SHIFT);
+			if (!is_present_ept_entry(*shadow_pml4e)) {
+				continue;
+			}
+			guest_entry = guest_pml4_page[i];
+			guest_pdpt_page = is_present_ept_entry(guest_entry) ?
+				gpa2hva(vcpu->vm, guest_entry & EPT_ENTRY_PFN_MASK) : NULL;
+			if (guest_pdpt_page == NULL) {
+				/* The guest PML4E is gone, release the whole sub-tree under it */
+				for (j = 0UL; j < PTRS_PER_PDPTE; j++) {
+					shadow_pdpte = pdpte_offset(shadow_pml4e, j << PDPTE_SHIFT);
+					if (!is_present_ept_entry(*shadow_pdpte) ||
+					    is_leaf_ept_entry(*shadow_pdpte, IA32E_PDPT)) {
+						continue;
+					}
+					for (k = 0UL; k < PTRS_PER_PDE; k++) {
+						shadow_pde = pde_offset(shadow_pdpte, k << PDE_SHIFT);
+						if (!is_present_ept_entry(*shadow_pde) ||
+						    is_leaf_ept_entry(*shadow_pde, IA32E_PD)) {
+							continue;
+						}
+						free_page(&sept_page_pool,
+							(struct page *)((*shadow_pde) & EPT_ENTRY_PFN_MASK));
+					}
+					free_page(&sept_page_pool, (struct page *)((*shadow_pdpte) & EPT_ENTRY_PFN_MASK));
+				}
+				free_page(&sept_page_pool, (struct page *)((*shadow_pml4e) & EPT_ENTRY_PFN_MASK));
+				*shadow_pml4e = 0UL;
+				continue;
+			}
+			*shadow_pml4e = (guest_entry & ~EPT_ENTRY_PFN_MASK) | ((*shadow_pml4e) & EPT_ENTRY_PFN_MASK);
+			for (j = 0UL; j < PTRS_PER_PDPTE; j++) {
+				shadow_pdpte = pdpte_offset(shadow_pml4e, j << PDPTE_SHIFT);
+				if (!is_present_ept_entry(*shadow_pdpte) ||
+				    is_leaf_ept_entry(*shadow_pdpte, IA32E_PDPT)) {
+					continue;
+				}
+				guest_entry = guest_pdpt_page[j];
+				guest_pd_page = (is_present_ept_entry(guest_entry) &&
+						!is_leaf_ept_entry(guest_entry, IA32E_PDPT)) ?
+					gpa2hva(vcpu->vm, guest_entry & EPT_ENTRY_PFN_MASK) : NULL;
+				if (guest_pd_page == NULL) {
+					/* The guest PDPTE is gone, release the sub-tree under it */
+					for (k = 0UL; k < PTRS_PER_PDE; k++) {
+						shadow_pde = pde_offset(shadow_pdpte, k << PDE_SHIFT);
+						if (!is_present_ept_entry(*shadow_pde) ||
+						    is_leaf_ept_entry(*shadow_pde, IA32E_PD)) {
+							continue;
+						}
+						free_page(&sept_page_pool,
+							(struct page *)((*shadow_pde) & EPT_ENTRY_PFN_MASK));
+					}
+					free_page(&sept_page_pool, (struct page *)((*shadow_pdpte) & EPT_ENTRY_PFN_MASK));
+					*shadow_pdpte = 0UL;
+					continue;
+				}
+				*shadow_pdpte = (guest_entry & ~EPT_ENTRY_PFN_MASK) |
+					((*shadow_pdpte) & EPT_ENTRY_PFN_MASK);
+				for (k = 0UL; k < PTRS_PER_PDE; k++) {
+					shadow_pde = pde_offset(shadow_pdpte, k << PDE_SHIFT);
+					if (!is_present_ept_entry(*shadow_pde) ||
+					    is_leaf_ept_entry(*shadow_pde, IA32E_PD)) {
+						continue;
+					}
+					guest_entry = guest_pd_page[k];
+					guest_pt_page = (is_present_ept_entry(guest_entry) &&
+							!is_leaf_ept_entry(guest_entry, IA32E_PD)) ?
+						gpa2hva(vcpu->vm, guest_entry & EPT_ENTRY_PFN_MASK) : NULL;
+					if (guest_pt_page == NULL) {
+						/* The guest PDE is gone, release the page table under it */
+						free_page(&sept_page_pool,
+							(struct page *)((*shadow_pde) & EPT_ENTRY_PFN_MASK));
+						*shadow_pde = 0UL;
+						continue;
+					}
+					*shadow_pde = (guest_entry & ~EPT_ENTRY_PFN_MASK) |
+						((*shadow_pde) & EPT_ENTRY_PFN_MASK);
+					for (m = 0UL; m < PTRS_PER_PTE; m++) {
+						shadow_pte = pte_offset(shadow_pde, m << PTE_SHIFT);
+						if (!is_present_ept_entry(*shadow_pte)) {
+							continue;
+						}
+						guest_entry = guest_pt_page[m];
+						hpa = is_present_ept_entry(guest_entry) ?
+							gpa2hpa(vcpu->vm, guest_entry & EPT_ENTRY_PFN_MASK) :
+							INVALID_HPA;
+						if (hpa == INVALID_HPA) {
+							*shadow_pte = 0UL;
+						} else {
+							/* Refresh attributes and HPA from the guest PTE */
+							*shadow_pte = (guest_entry & ~EPT_ENTRY_PFN_MASK) |
+								(hpa & EPT_ENTRY_PFN_MASK);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	desc->generation++;
+	dev_dbg(VETP_LOG_LEVEL, "[%s], vept_desc[%llx] shadow_eptp[%llx] generation[%llx]",
+			__func__, desc, desc->shadow_eptp, desc->generation);
+}
+
 /*
  * @brief Convert a guest EPTP to the associated vept_desc.
  * @return struct vept_desc * if existed.
@@ -509,9 +642,13 @@ int32_t invept_vmexit_handler(struct acrn_vcpu *vcpu)
 				if (desc->shadow_eptp != 0UL) {
 					/*
 					 * Since ACRN does not know which paging entries are changed,
-					 * Remove all the shadow EPT entries that ACRN created for L2 VM
+					 * re-validate all the shadow EPT entries against the guest
+					 * EPT instead of dropping them, so that the unchanged part
+					 * of the L2 working set keeps its translations.
 					 */
-					free_sept_table((void *)(desc->shadow_eptp & PAGE_MASK));
+					stac();
+					resync_sept_table(vcpu, desc);
+					clac();
 					invept((void *)(desc->shadow_eptp & PAGE_MASK));
 				}
 				spinlock_release(&vept_desc_bucket_lock);
@@ -525,13 +662,15 @@ int32_t invept_vmexit_handler(struct acrn_vcpu *vcpu)
 			 * Invalidate all shadow EPTPs of L1 VM
 			 * TODO: Invalidating all L2 vCPU associated EPTPs is enough. How?
 			 */
+			stac();
 			for (i = 0L; i < CONFIG_MAX_GUEST_EPT_NUM; i++) {
 				if (vept_desc_bucket[i].guest_eptp != 0UL) {
 					desc = &vept_desc_bucket[i];
-					free_sept_table((void *)(desc->shadow_eptp & PAGE_MASK));
+					resync_sept_table(vcpu, desc);
 					invept((void *)(desc->shadow_eptp & PAGE_MASK));
 				}
 			}
+			clac();
 			spinlock_release(&vept_desc_bucket_lock);
 			nested_vmx_result(VMsucceed, 0);
 		} else {
@@ -551,7 +690,10 @@ void init_vept(void)
         sept_page_pool.dummy_page = NULL;
 	spinlock_init(&sept_page_pool.lock);
 	memset((void *)sept_page_pool.bitmap, 0, sept_page_pool.bitmap_size * sizeof(uint64_t));
+	sept_page_pool.summary = sept_page_summary;
+	page_pool_init_summary(&sept_page_pool);
 	sept_page_pool.last_hint_id = 0UL;
+	register_page_pool("sept", 0U, &sept_page_pool);
 
 	spinlock_init(&vept_desc_bucket_lock);
 }
@@ -133,6 +133,18 @@ void vcpu_make_request(struct acrn_vcpu *vcpu, uint16_t eventid)
 	kick_vcpu(vcpu);
 }
 
+/* post the request to every vCPU of the VM, then kick them in one IPI round */
+void vm_make_request(struct acrn_vm *vm, uint16_t eventid)
+{
+	uint16_t i;
+	struct acrn_vcpu *vcpu;
+
+	foreach_vcpu(i, vm, vcpu) {
+		bitmap_set_lock(eventid, &vcpu->arch.pending_req);
+	}
+	kick_vcpus(vm);
+}
+
 /* Return true if an unhandled request is cancelled, false otherwise. */
 bool vcpu_try_cancel_request(struct acrn_vcpu *vcpu, uint16_t eventid)
 {
@@ -368,6 +380,13 @@ int32_t acrn_handle_pending_request(struct acrn_vcpu *vcpu)
 			init_vmcs(vcpu);
 		}
 
+		/* after migration the host state fields of the (preserved) VMCS
+		 * still point at the previous pCPU's GDT, TSS and stack
+		 */
+		if (bitmap_test_and_clear_lock(ACRN_REQUEST_INIT_HOST_STATE, pending_req_bits)) {
+			init_host_state();
+		}
+
 		if (bitmap_test_and_clear_lock(ACRN_REQUEST_TRP_FAULT, pending_req_bits)) {
 			pr_fatal("Triple fault happen -> shutdown!");
 			ret = -EFAULT;
@@ -391,6 +410,10 @@ int32_t acrn_handle_pending_request(struct acrn_vcpu *vcpu)
 				flush_vpid_single(arch->vpid);
 			}
 
+			if (bitmap_test_and_clear_lock(ACRN_REQUEST_DIRTY_TRACK, pending_req_bits)) {
+				vcpu_set_vmcs_pml(vcpu);
+			}
+
 			if (bitmap_test_and_clear_lock(ACRN_REQUEST_EOI_EXIT_BITMAP_UPDATE, pending_req_bits)) {
 				vcpu_set_vmcs_eoi_exit(vcpu);
 			}
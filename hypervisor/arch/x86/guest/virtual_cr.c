@@ -307,8 +307,16 @@ static void vmx_write_cr0(struct acrn_vcpu *vcpu, uint64_t value)
 				}
 			}
 
-			if ((cr0_changed_bits & (CR0_PG | CR0_WP | CR0_CD)) != 0UL) {
+			/* only CR0.CD changes the effective memory type (via
+			 * the IA32_PAT emulation above) and thus needs the
+			 * EPT-wide invalidation; PG/WP only affect linear
+			 * translations, for which flushing the vCPU's VPID
+			 * (linear and combined mappings) is sufficient
+			 */
+			if ((cr0_changed_bits & CR0_CD) != 0UL) {
 				vcpu_make_request(vcpu, ACRN_REQUEST_EPT_FLUSH);
+			} else if ((cr0_changed_bits & (CR0_PG | CR0_WP)) != 0UL) {
+				vcpu_make_request(vcpu, ACRN_REQUEST_VPID_FLUSH);
 			}
 
 			mask = cr0_trap_and_passthru_mask | cr0_passthru_mask;
@@ -376,7 +384,12 @@ static void vmx_write_cr4(struct acrn_vcpu *vcpu, uint64_t cr4)
 					vcpu_inject_gp(vcpu, 0U);
 				}
 			}
-			vcpu_make_request(vcpu, ACRN_REQUEST_EPT_FLUSH);
+			/* the trap-and-passthru CR4 bits (PSE/PAE/SMEP/SMAP/
+			 * PKE/PKS/KL) all shape linear translations only and
+			 * leave the EPT memory type untouched, so flushing
+			 * this vCPU's VPID is sufficient
+			 */
+			vcpu_make_request(vcpu, ACRN_REQUEST_VPID_FLUSH);
 		}
 
 		if (!err_found && ((cr4_changed_bits & CR4_PCIDE) != 0UL)) {
@@ -163,17 +163,20 @@ static inline uint32_t vlapic_find_isrv(const struct acrn_vlapic *vlapic)
 	const struct lapic_regs *lapic = &(vlapic->apic_page);
 	uint32_t i, val, bitpos, isrv = 0U;
 	const struct lapic_reg *isrptr;
+	/* isr[0] is skipped: vectors below 32 are never in service */
+	uint32_t smry = vlapic->isr_smry & 0xfeU;
 
 	isrptr = &lapic->isr[0];
 
-	/* i ranges effectively from 7 to 1 */
-	for (i = 7U; i > 0U; i--) {
+	while (smry != 0U) {
+		i = (uint32_t)fls32(smry);
 		val = isrptr[i].v;
 		if (val != 0U) {
 			bitpos = (uint32_t)fls32(val);
 			isrv = (i << 5U) | bitpos;
 			break;
 		}
+		smry &= ~(1U << i);
 	}
 
 	return isrv;
@@ -489,6 +492,9 @@ static void apicv_basic_accept_intr(struct acrn_vlapic *vlapic, uint32_t vector,
 
 	/* If the interrupt is set, don't try to do it again */
 	if (!bitmap32_test_and_set_lock((uint16_t)(vector & 0x1fU), &irrptr[idx].v)) {
+		/* publish the summary bit after the IRR bit so that a
+		 * concurrent scan on the target vCPU never misses it */
+		bitmap32_set_lock((uint16_t)idx, &vlapic->irr_smry);
 		/* update TMR if interrupt trigger mode has changed */
 		vlapic_set_tmr(vlapic, vector, level);
 		vcpu_make_request(vlapic2vcpu(vlapic), ACRN_REQUEST_EVENT);
@@ -811,6 +817,9 @@ vlapic_process_eoi(struct acrn_vlapic *vlapic)
 		i = (vector >> 5U);
 		bitpos = (vector & 0x1fU);
 		bitmap32_clear_nolock((uint16_t)bitpos, &isrptr[i].v);
+		if (isrptr[i].v == 0U) {
+			bitmap32_clear_nolock((uint16_t)i, &vlapic->isr_smry);
+		}
 
 		dev_dbg(DBG_LEVEL_VLAPIC, "EOI vector %u", vector);
 		vlapic_dump_isr(vlapic, "vlapic_process_eoi");
@@ -1194,7 +1203,14 @@ static void vlapic_write_icrlo(struct acrn_vlapic *vlapic)
 	}
 }
 
-static inline uint32_t vlapic_find_highest_irr(const struct acrn_vlapic *vlapic)
+/*
+ * Scan the vIRR registers selected by 'smry' (bit i covers irr[i]) for the
+ * highest pending vector. Callers on the software injection path pass the
+ * cached irr_smry; callers that may run with APICv virtual interrupt
+ * delivery enabled must pass the full mask, since in that case the
+ * hardware updates the vIRR without maintaining the summary.
+ */
+static inline uint32_t vlapic_scan_irr(const struct acrn_vlapic *vlapic, uint32_t smry)
 {
 	const struct lapic_regs *lapic = &(vlapic->apic_page);
 	uint32_t i, val, bitpos, vec = 0U;
@@ -1202,19 +1218,27 @@ static inline uint32_t vlapic_find_highest_irr(const struct acrn_vlapic *vlapic)
 
 	irrptr = &lapic->irr[0];
 
-	/* i ranges effectively from 7 to 1 */
-	for (i = 7U; i > 0U; i--) {
+	/* irr[0] is skipped: vectors below 32 are never pending */
+	smry &= 0xfeU;
+	while (smry != 0U) {
+		i = (uint32_t)fls32(smry);
 		val = irrptr[i].v;
 		if (val != 0U) {
 			bitpos = (uint32_t)fls32(val);
 			vec = (i * 32U) + bitpos;
 			break;
 		}
+		smry &= ~(1U << i);
 	}
 
 	return vec;
 }
 
+static inline uint32_t vlapic_find_highest_irr(const struct acrn_vlapic *vlapic)
+{
+	return vlapic_scan_irr(vlapic, 0xffU);
+}
+
 /**
  * @brief Find a deliverable virtual interrupts for vLAPIC in irr.
  *
@@ -1235,7 +1259,7 @@ static bool vlapic_find_deliverable_intr(const struct acrn_vlapic *vlapic, uint3
 	uint32_t vec;
 	bool ret = false;
 
-	vec = vlapic_find_highest_irr(vlapic);
+	vec = vlapic_scan_irr(vlapic, vlapic->irr_smry);
 	if (prio(vec) > prio(lapic->ppr.v)) {
 		ret = true;
 		if (vecptr != NULL) {
@@ -1275,11 +1299,20 @@ static void vlapic_get_deliverable_intr(struct acrn_vlapic *vlapic, uint32_t vec
 
 	irrptr = &lapic->irr[0];
 	bitmap32_clear_lock((uint16_t)(vector & 0x1fU), &irrptr[idx].v);
+	if (irrptr[idx].v == 0U) {
+		bitmap32_clear_lock((uint16_t)idx, &vlapic->irr_smry);
+		/* a remote vCPU may have posted a new vector in this word
+		 * in between; recheck so its summary bit is never lost */
+		if (irrptr[idx].v != 0U) {
+			bitmap32_set_lock((uint16_t)idx, &vlapic->irr_smry);
+		}
+	}
 
 	vlapic_dump_irr(vlapic, "vlapic_get_deliverable_intr");
 
 	isrptr = &lapic->isr[0];
 	bitmap32_set_nolock((uint16_t)(vector & 0x1fU), &isrptr[idx].v);
+	bitmap32_set_nolock((uint16_t)idx, &vlapic->isr_smry);
 	vlapic_dump_isr(vlapic, "vlapic_get_deliverable_intr");
 
 	vlapic->isrv = vector;
@@ -1597,6 +1630,8 @@ vlapic_reset(struct acrn_vlapic *vlapic, const struct acrn_apicv_ops *ops, enum
 	vlapic->svr_last = lapic->svr.v;
 
 	vlapic->isrv = 0U;
+	vlapic->irr_smry = 0U;
+	vlapic->isr_smry = 0U;
 
 	vlapic->ops = ops;
 }
@@ -2200,6 +2235,14 @@ void vlapic_create(struct acrn_vcpu *vcpu, uint16_t pcpu_id)
 	/* Set vLAPIC ID to be same as pLAPIC ID */
 	vlapic->vapic_id = per_cpu(lapic_id, pcpu_id);
 
+	/* publish the posted-interrupt descriptor for IPI virtualization;
+	 * an ID beyond the table simply keeps the ICR-write exit path
+	 */
+	if (vlapic->vapic_id < PID_PTR_TABLE_ENTRY_NUM) {
+		vcpu->vm->arch_vm.pid_ptr_table[vlapic->vapic_id] =
+			hva2hpa((void *)get_pi_desc(vcpu)) | PID_PTR_ENTRY_VALID;
+	}
+
 	dev_dbg(DBG_LEVEL_VLAPIC, "vlapic APIC ID : 0x%04x", vlapic->vapic_id);
 }
 
@@ -2415,6 +2458,16 @@ int32_t apic_access_vmexit_handler(struct acrn_vcpu *vcpu)
 	 * described in Section 29.4 and may cause a VM exit.
 	 * 3 = linear access (read or write) during event delivery
 	 */
+	if ((access_type == TYPE_LINEAR_APIC_INST_READ) || (access_type == TYPE_LINEAR_APIC_INST_WRITE)) {
+		/* stamp the direction before decoding: the decode path consults
+		 * it both for the page-fault error code on translation faults
+		 * and for validating decode cache hits
+		 */
+		mmio = &vcpu->req.reqs.mmio_request;
+		mmio->direction = (access_type == TYPE_LINEAR_APIC_INST_WRITE) ?
+			ACRN_IOREQ_DIR_WRITE : ACRN_IOREQ_DIR_READ;
+	}
+
 	if (((access_type == TYPE_LINEAR_APIC_INST_READ) || (access_type == TYPE_LINEAR_APIC_INST_WRITE)) &&
 			(decode_instruction(vcpu, true) >= 0)) {
 		vlapic = vcpu_vlapic(vcpu);
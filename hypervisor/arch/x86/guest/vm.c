@@ -38,6 +38,10 @@
 #include <vgpio.h>
 #include <asm/rtcm.h>
 #include <asm/irq.h>
+#include <asm/notify.h>
+#include <asm/tsc.h>
+#include <schedule.h>
+#include <dmacpy.h>
 #include <uart16550.h>
 #ifdef CONFIG_SECURITY_VM_FIXUP
 #include <quirks/security_vm_fixup.h>
@@ -156,6 +160,18 @@ bool is_pmu_pt_configured(const struct acrn_vm *vm)
 	return ((vm_config->guest_flags & GUEST_FLAG_PMU_PASSTHROUGH) != 0U);
 }
 
+/**
+ * @pre vm != NULL && vm_config != NULL && vm->vmid < CONFIG_MAX_VM_NUM
+ */
+bool is_vpmu_configured(const struct acrn_vm *vm)
+{
+	struct acrn_vm_config *vm_config = get_vm_config(vm->vm_id);
+
+	/* PMU passthrough supersedes the emulated vPMU */
+	return ((vm_config->guest_flags & GUEST_FLAG_VPMU) != 0U) &&
+		((vm_config->guest_flags & GUEST_FLAG_PMU_PASSTHROUGH) == 0U);
+}
+
 
 /**
  * @pre vm != NULL && vm_config != NULL && vm->vmid < CONFIG_MAX_VM_NUM
@@ -650,8 +666,20 @@ int32_t create_vm(uint16_t vm_id, uint64_t pcpu_bitmap, struct acrn_vm_config *v
 	vm->vm_id = vm_id;
 	vm->hw.created_vcpus = 0U;
 
+	/* launch-phase profiling, served via HC_GET_LAUNCH_PROFILE */
+	vm->create_vm_entry_tsc = rdtsc();
+	vm->create_vm_exit_tsc = 0UL;
+	vm->first_vcpu_launch_tsc = 0UL;
+
 	init_ept_pgtable(&vm->arch_vm.ept_pgtable, vm->vm_id);
 	vm->arch_vm.nworld_eptp = pgtable_create_root(&vm->arch_vm.ept_pgtable);
+	/* fresh EPT: the memory-type layout cached by the vMTRR code is stale */
+	vm->arch_vm.vmtrr_ept_synced = false;
+
+	/* invalidate stale PID pointers of a previous incarnation; the
+	 * vCPUs republish their descriptors in vlapic_create()
+	 */
+	(void)memset((void *)&vm->arch_vm.pid_ptr_table, 0U, sizeof(vm->arch_vm.pid_ptr_table));
 
 	(void)memcpy_s(&vm->name[0], MAX_VM_NAME_LEN, &vm_config->name[0], MAX_VM_NAME_LEN);
 
@@ -701,12 +729,16 @@ int32_t create_vm(uint16_t vm_id, uint64_t pcpu_bitmap, struct acrn_vm_config *v
 		spinlock_init(&vm->vlapic_mode_lock);
 		spinlock_init(&vm->ept_lock);
 		spinlock_init(&vm->emul_mmio_lock);
+		spinlock_init(&vm->wc_mmio_lock);
 		spinlock_init(&vm->arch_vm.iwkey_backup_lock);
 
 		vm->arch_vm.vlapic_mode = VM_VLAPIC_XAPIC;
 		vm->arch_vm.vm_mwait_cap = has_monitor_cap();
 		vm->intr_inject_delay_delta = 0UL;
+		vm->intr_rate_limit_cost = 0UL;
 		vm->nr_emul_mmio_regions = 0U;
+		vm->nr_wc_mmio_ranges = 0U;
+		vm->wc_mmio_ring = NULL;
 		vm->vcpuid_entry_nr = 0U;
 
 		/* Set up IO bit-mask such that VM exit occurs on
@@ -770,6 +802,10 @@ int32_t create_vm(uint16_t vm_id, uint64_t pcpu_bitmap, struct acrn_vm_config *v
 		}
 	}
 
+	if ((status == 0) && !sched_affinity_admissible(vm_id, vm_config->guest_flags, pcpu_bitmap)) {
+		status = -EINVAL;
+	}
+
 	if (status == 0) {
 		/* We have assumptions:
 		 *   1) vcpus used by Service VM has been offlined by DM before User VM re-use it.
@@ -804,6 +840,10 @@ int32_t create_vm(uint16_t vm_id, uint64_t pcpu_bitmap, struct acrn_vm_config *v
 		(void)memset(vm->arch_vm.nworld_eptp, 0U, PAGE_SIZE);
 	}
 
+	if (status == 0) {
+		vm->create_vm_exit_tsc = rdtsc();
+	}
+
 	return status;
 }
 
@@ -835,7 +875,7 @@ static int32_t offline_lapic_pt_enabled_pcpus(const struct acrn_vm *vm, uint64_t
 
 	if (bitmap_test(this_pcpu_id, &mask)) {
 		bitmap_clear_nolock(this_pcpu_id, &mask);
-		if (vm->state == VM_POWERED_OFF) {
+		if (vm->state == VM_TEARING_DOWN) {
 			/*
 			 * If the current pcpu needs to offline itself,
 			 * it will be done after shutdown_vm() completes
@@ -867,6 +907,133 @@ static int32_t offline_lapic_pt_enabled_pcpus(const struct acrn_vm *vm, uint64_t
 }
 
 /*
+ * Parallel guest RAM scrub.
+ *
+ * A pre-launched VM's memory regions are hypervisor managed host memory;
+ * sanitize them on shutdown so a later occupant of those frames can't
+ * read stale guest data. The range is split across the dead VM's own
+ * (now idle) pCPUs via smp_call_function, and each slice is wiped with
+ * non-temporal stores so the scrub doesn't evict the working set of the
+ * still running VMs.
+ */
+struct mem_scrub_work {
+	uint64_t base_hpa;
+	uint64_t size;
+	uint64_t pcpu_mask;
+};
+
+static void scrub_vm_memory_slice(void *data)
+{
+	const struct mem_scrub_work *work = (const struct mem_scrub_work *)data;
+	uint16_t nr_cpus = bitmap_weight(work->pcpu_mask);
+	uint16_t slot = bitmap_weight(work->pcpu_mask & ((1UL << get_pcpu_id()) - 1UL));
+	uint64_t slice = round_page_up(work->size / nr_cpus);
+	uint64_t offset = slice * slot;
+
+	if (offset < work->size) {
+		stac();
+		(void)memset_nt(hpa2hva(work->base_hpa + offset), 0U,
+			min(slice, work->size - offset));
+		clac();
+	}
+}
+
+static void scrub_vm_memory(const struct acrn_vm_config *vm_config)
+{
+	struct mem_scrub_work work;
+	uint64_t i;
+
+	work.pcpu_mask = vm_config->cpu_affinity & get_active_pcpu_bitmap()
+			& ~(1UL << get_pcpu_id());
+
+	for (i = 0UL; i < vm_config->memory.region_num; i++) {
+		work.base_hpa = vm_config->memory.host_regions[i].start_hpa;
+		work.size = vm_config->memory.host_regions[i].size_hpa;
+
+		/* prefer the copy-offload engine so the wipe costs no CPU time */
+		if (dmacpy_fill(work.base_hpa, 0UL, work.size) == 0) {
+			continue;
+		}
+
+		if (work.pcpu_mask != 0UL) {
+			smp_call_function(work.pcpu_mask, scrub_vm_memory_slice, &work);
+		} else {
+			stac();
+			(void)memset_nt(hpa2hva(work.base_hpa), 0U, work.size);
+			clac();
+		}
+	}
+}
+
+/*
+ * Deferred half of VM destruction: page-table teardown and the memory
+ * scrub dominate the shutdown cost (EPT unwinding plus wiping the whole
+ * guest RAM), but nothing references either once the VM is fenced, so
+ * they run here in idle-thread context on one of the dead VM's own
+ * pCPUs. The VM slot stays in VM_TEARING_DOWN until this completes;
+ * only then does it become VM_POWERED_OFF and eligible for re-creation.
+ *
+ * @pre vm != NULL
+ * @pre vm->state == VM_TEARING_DOWN
+ */
+static void vm_teardown(struct acrn_vm *vm)
+{
+	struct acrn_vm_config *vm_config = get_vm_config(vm->vm_id);
+
+	/* Free EPT allocated resources assigned to VM */
+	destroy_ept(vm);
+
+	if (is_prelaunched_vm(vm)) {
+		scrub_vm_memory(vm_config);
+	}
+	if (!is_static_configured_vm(vm)) {
+		memset(vm_config->name, 0U, MAX_VM_NAME_LEN);
+	}
+
+	vm->state = VM_POWERED_OFF;
+
+	if (is_ready_for_system_shutdown()) {
+		/* If no any guest running, shutdown system */
+		shutdown_system();
+	}
+}
+
+void make_teardown_vm_request(uint16_t pcpu_id)
+{
+	bitmap_set_lock(NEED_TEARDOWN_VM, &per_cpu(pcpu_flag, pcpu_id));
+	if (get_pcpu_id() != pcpu_id) {
+		send_single_ipi(pcpu_id, NOTIFY_VCPU_VECTOR);
+	}
+}
+
+bool need_teardown_vm(uint16_t pcpu_id)
+{
+	return bitmap_test_and_clear_lock(NEED_TEARDOWN_VM, &per_cpu(pcpu_flag, pcpu_id));
+}
+
+void vm_teardown_from_idle(uint16_t pcpu_id)
+{
+	uint16_t vm_id;
+	uint64_t *vms = &per_cpu(teardown_vm_bitmap, pcpu_id);
+	struct acrn_vm *vm;
+
+	for (vm_id = fls64(*vms); vm_id < CONFIG_MAX_VM_NUM; vm_id = fls64(*vms)) {
+		vm = get_vm_from_vmid(vm_id);
+		get_vm_lock(vm);
+		if (vm->state == VM_TEARING_DOWN) {
+			vm_teardown(vm);
+		}
+		put_vm_lock(vm);
+		bitmap_clear_nolock(vm_id, vms);
+	}
+}
+
+/*
+ * Synchronous half of VM destruction: fence the VM (stop and offline its
+ * vCPUs, detach interrupts and emulated/passthrough devices) and hand the
+ * expensive resource reclaim to vm_teardown() so the caller - typically
+ * the Service VM's destroy hypercall - returns without waiting for it.
+ *
  * @pre vm != NULL
  * @pre vm->state == VM_PAUSED
  */
@@ -874,12 +1041,21 @@ int32_t shutdown_vm(struct acrn_vm *vm)
 {
 	uint16_t i;
 	uint64_t mask;
+	uint16_t teardown_pcpu;
 	struct acrn_vcpu *vcpu = NULL;
 	struct acrn_vm_config *vm_config = NULL;
 	int32_t ret = 0;
 
 	/* Only allow shutdown paused vm */
-	vm->state = VM_POWERED_OFF;
+	vm->state = VM_TEARING_DOWN;
+
+	/* the stats page belongs to the Service VM, stop writing into it */
+	vm->stats_page = NULL;
+
+	/* likewise for the dirty-page tracking bitmap */
+	vm->dirty_track_active = false;
+	vm->dirty_bitmap = NULL;
+	vm->dirty_bitmap_size = 0UL;
 
 	if (is_service_vm(vm)) {
 		sbuf_reset();
@@ -893,14 +1069,20 @@ int32_t shutdown_vm(struct acrn_vm *vm)
 
 	deinit_emul_io(vm);
 
-	/* Free EPT allocated resources assigned to VM */
-	destroy_ept(vm);
-
 	mask = lapic_pt_enabled_pcpu_bitmap(vm);
 	if (mask != 0UL) {
 		ret = offline_lapic_pt_enabled_pcpus(vm, mask);
 	}
 
+	/* pick the reclaim pCPU while the vCPU mapping is still valid; it
+	 * must stay online, but the current pCPU may just have scheduled
+	 * its own offline above (lapic_pt VM shutting itself down) - fall
+	 * back to the BSP in that case */
+	teardown_pcpu = pcpuid_from_vcpu(vcpu_from_vid(vm, BSP_CPU_ID));
+	if ((teardown_pcpu == get_pcpu_id()) && bitmap_test(teardown_pcpu, &mask)) {
+		teardown_pcpu = BSP_CPU_ID;
+	}
+
 	foreach_vcpu(i, vm, vcpu) {
 		offline_vcpu(vcpu);
 	}
@@ -908,14 +1090,10 @@ int32_t shutdown_vm(struct acrn_vm *vm)
 	/* after guest_flags not used, then clear it */
 	vm_config = get_vm_config(vm->vm_id);
 	vm_config->guest_flags &= ~DM_OWNED_GUEST_FLAG_MASK;
-	if (!is_static_configured_vm(vm)) {
-		memset(vm_config->name, 0U, MAX_VM_NAME_LEN);
-	}
 
-	if (is_ready_for_system_shutdown()) {
-		/* If no any guest running, shutdown system */
-		shutdown_system();
-	}
+	/* the dead VM's pCPUs are idle now; reclaim the rest there */
+	bitmap_set_lock(vm->vm_id, &per_cpu(teardown_vm_bitmap, teardown_pcpu));
+	make_teardown_vm_request(teardown_pcpu);
 
 	/* Return status to caller */
 	return ret;
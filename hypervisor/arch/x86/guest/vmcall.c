@@ -11,6 +11,9 @@
 #include <asm/guest/vm.h>
 #include <asm/guest/virq.h>
 #include <asm/guest/optee.h>
+#ifdef CONFIG_HYPERV_ENABLED
+#include <asm/guest/hyperv.h>
+#endif
 #include <acrn_hv_defs.h>
 #include <hypercall.h>
 #include <trace.h>
@@ -38,6 +41,12 @@ static const struct hc_dispatch hc_dispatch_table[] = {
 		.handler = hcall_service_vm_offline_cpu},
 	[HC_IDX(HC_SET_CALLBACK_VECTOR)] = {
 		.handler = hcall_set_callback_vector},
+	[HC_IDX(HC_SETUP_VM_STATS)] = {
+		.handler = hcall_setup_vm_stats},
+	[HC_IDX(HC_SET_RDT_CONFIG)] = {
+		.handler = hcall_set_rdt_config},
+	[HC_IDX(HC_PIN_HC_BUFFER)] = {
+		.handler = hcall_pin_hc_buffer},
 	[HC_IDX(HC_CREATE_VM)] = {
 		.handler = hcall_create_vm},
 	[HC_IDX(HC_DESTROY_VM)] = {
@@ -50,6 +59,10 @@ static const struct hc_dispatch hc_dispatch_table[] = {
 		.handler = hcall_pause_vm},
 	[HC_IDX(HC_SET_VCPU_REGS)] = {
 		.handler = hcall_set_vcpu_regs},
+	[HC_IDX(HC_GET_LAUNCH_PROFILE)] = {
+		.handler = hcall_get_launch_profile},
+	[HC_IDX(HC_GET_VCPU_REGS)] = {
+		.handler = hcall_get_vcpu_regs},
 	[HC_IDX(HC_CREATE_VCPU)] = {
 		.handler = hcall_create_vcpu},
 	[HC_IDX(HC_SET_IRQLINE)] = {
@@ -64,6 +77,8 @@ static const struct hc_dispatch hc_dispatch_table[] = {
 		.handler = hcall_set_vm_memory_regions},
 	[HC_IDX(HC_VM_WRITE_PROTECT_PAGE)] = {
 		.handler = hcall_write_protect_page},
+	[HC_IDX(HC_VM_DIRTY_TRACK)] = {
+		.handler = hcall_vm_dirty_track},
 	[HC_IDX(HC_VM_GPA2HPA)] = {
 		.handler = hcall_gpa_to_hpa},
 	[HC_IDX(HC_ASSIGN_PCIDEV)] = {
@@ -84,6 +99,8 @@ static const struct hc_dispatch hc_dispatch_table[] = {
 		.handler = hcall_reset_ptdev_intr_info},
 	[HC_IDX(HC_PM_GET_CPU_STATE)] = {
 		.handler = hcall_get_cpu_pm_state},
+	[HC_IDX(HC_SET_PERF_PROFILE)] = {
+		.handler = hcall_set_perf_profile},
 	[HC_IDX(HC_VM_INTR_MONITOR)] = {
 		.handler = hcall_vm_intr_monitor},
 	[HC_IDX(HC_SETUP_SBUF)] = {
@@ -185,6 +202,8 @@ struct acrn_vm *parse_target_vm(struct acrn_vm *service_vm, uint64_t hcall_id, u
 	case HC_SETUP_HV_NPK_LOG:
 	case HC_PROFILING_OPS:
 	case HC_GET_HW_INFO:
+	case HC_SET_RDT_CONFIG:
+	case HC_PIN_HC_BUFFER:
 		target_vm = service_vm;
 		break;
 	default:
@@ -203,21 +222,17 @@ struct acrn_vm *parse_target_vm(struct acrn_vm *service_vm, uint64_t hcall_id, u
 	return target_vm;
 }
 
-static int32_t dispatch_hypercall(struct acrn_vcpu *vcpu)
+static int32_t dispatch_one_hypercall(struct acrn_vcpu *vcpu, uint64_t hcall_id, uint64_t param1, uint64_t param2)
 {
 	int32_t ret = -ENOTTY;
 	struct acrn_vm *vm = vcpu->vm;
-	uint64_t guest_flags = get_vm_config(vm->vm_id)->guest_flags;  /* hypercall ID from guest */
-	uint64_t hcall_id = vcpu_get_gpreg(vcpu, CPU_REG_R8);  /* hypercall ID from guest */
+	uint64_t guest_flags = get_vm_config(vm->vm_id)->guest_flags;
 
 	if (HC_IDX(hcall_id) < ARRAY_SIZE(hc_dispatch_table)) {
 		const struct hc_dispatch *dispatch = &(hc_dispatch_table[HC_IDX(hcall_id)]);
 		uint64_t permission_flags = dispatch->permission_flags;
 
 		if (dispatch->handler != NULL) {
-			uint64_t param1 = vcpu_get_gpreg(vcpu, CPU_REG_RDI);  /* hypercall param1 from guest */
-			uint64_t param2 = vcpu_get_gpreg(vcpu, CPU_REG_RSI);  /* hypercall param2 from guest */
-
 			if ((permission_flags == 0UL) && is_service_vm(vm) && !is_ree_vm(vm)) {
 				/* A permission_flags of 0 indicates that this hypercall is for Service VM to manage
 				 * post-launched VMs.
@@ -247,6 +262,72 @@ static int32_t dispatch_hypercall(struct acrn_vcpu *vcpu)
 	return ret;
 }
 
+/*
+ * HC_BATCH: execute a guest-provided sequence of hypercalls with one VM exit.
+ * gpa points to an array of struct acrn_batch_entry, nr_entries long. The
+ * per-entry status is written back in place and the walk continues across
+ * sub-call failures, so the caller gets a result for every entry.
+ */
+static int32_t dispatch_batch_hypercall(struct acrn_vcpu *vcpu, uint64_t gpa, uint64_t nr_entries)
+{
+	struct acrn_batch_entry entry;
+	uint64_t i, entry_gpa;
+	int32_t ret = 0;
+
+	if ((nr_entries == 0UL) || (nr_entries > ACRN_BATCH_MAX_ENTRIES)) {
+		ret = -EINVAL;
+	} else {
+		for (i = 0UL; i < nr_entries; i++) {
+			entry_gpa = gpa + (i * sizeof(struct acrn_batch_entry));
+			if (copy_from_gpa(vcpu->vm, &entry, entry_gpa, sizeof(entry)) != 0) {
+				ret = -EFAULT;
+				break;
+			}
+
+			if (entry.hcall_id == HC_BATCH) {
+				/* nested batches are not allowed */
+				entry.status = -EINVAL;
+			} else {
+				entry.status = (int64_t)dispatch_one_hypercall(vcpu, entry.hcall_id,
+						entry.param1, entry.param2);
+			}
+
+			if (copy_to_gpa(vcpu->vm, &entry.status,
+					entry_gpa + offsetof(struct acrn_batch_entry, status),
+					sizeof(entry.status)) != 0) {
+				ret = -EFAULT;
+				break;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int32_t dispatch_hypercall(struct acrn_vcpu *vcpu)
+{
+	int32_t ret;
+	uint64_t hcall_id = vcpu_get_gpreg(vcpu, CPU_REG_R8);  /* hypercall ID from guest */
+	uint64_t param1 = vcpu_get_gpreg(vcpu, CPU_REG_RDI);  /* hypercall param1 from guest */
+	uint64_t param2 = vcpu_get_gpreg(vcpu, CPU_REG_RSI);  /* hypercall param2 from guest */
+
+	if (hcall_id == HC_BATCH) {
+		/* The batch is dispatched outside the table so that no target VM
+		 * lock is held across it: each sub-call is permission checked and
+		 * locked individually by dispatch_one_hypercall().
+		 */
+		if (is_service_vm(vcpu->vm) && !is_ree_vm(vcpu->vm)) {
+			ret = dispatch_batch_hypercall(vcpu, param1, param2);
+		} else {
+			ret = -ENOTTY;
+		}
+	} else {
+		ret = dispatch_one_hypercall(vcpu, hcall_id, param1, param2);
+	}
+
+	return ret;
+}
+
 /*
  * Pass return value to Service VM by register rax.
  * This function should always return 0 since we shouldn't
@@ -270,21 +351,34 @@ int32_t vmcall_vmexit_handler(struct acrn_vcpu *vcpu)
 	 *    guest flags. Attempts to invoke an unpermitted hypercall will make a vCPU see -EINVAL as the return
 	 *    value. No exception is triggered in this case.
 	 */
-	if (!is_service_vm(vm) && !is_guest_hypercall(vm)) {
-		vcpu_inject_ud(vcpu);
-		ret = -ENODEV;
-	} else if (!is_hypercall_from_ring0()) {
-		vcpu_inject_gp(vcpu, 0U);
-		ret = -EACCES;
+#ifdef CONFIG_HYPERV_ENABLED
+	if (vm->arch_vm.hyperv.hypercall_page.enabled != 0UL) {
+		/* the guest runs on the Hyper-V enlightenment surface, `vmcall`
+		 * comes from its hypercall page and follows the Hyper-V calling
+		 * convention; hyperv_hypercall() places the call status in RAX
+		 * itself
+		 */
+		ret = hyperv_hypercall(vcpu);
 	} else {
-		ret = dispatch_hypercall(vcpu);
-	}
+#else
+	{
+#endif
+		if (!is_service_vm(vm) && !is_guest_hypercall(vm)) {
+			vcpu_inject_ud(vcpu);
+			ret = -ENODEV;
+		} else if (!is_hypercall_from_ring0()) {
+			vcpu_inject_gp(vcpu, 0U);
+			ret = -EACCES;
+		} else {
+			ret = dispatch_hypercall(vcpu);
+		}
 
-	if ((ret != -EACCES) && (ret != -ENODEV)) {
-		vcpu_set_gpreg(vcpu, CPU_REG_RAX, (uint64_t)ret);
-	}
-	if (ret < 0) {
-		pr_err("ret=%d hypercall=0x%lx failed in %s\n", ret, hypcall_id, __func__);
+		if ((ret != -EACCES) && (ret != -ENODEV)) {
+			vcpu_set_gpreg(vcpu, CPU_REG_RAX, (uint64_t)ret);
+		}
+		if (ret < 0) {
+			pr_err("ret=%d hypercall=0x%lx failed in %s\n", ret, hypcall_id, __func__);
+		}
 	}
 	TRACE_2L(TRACE_VMEXIT_VMCALL, vm->vm_id, hypcall_id);
 
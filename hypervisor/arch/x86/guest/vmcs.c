@@ -17,6 +17,7 @@
 #include <asm/cpu_caps.h>
 #include <asm/cpufeatures.h>
 #include <asm/guest/vmexit.h>
+#include <timer.h>
 #include <logmsg.h>
 
 /* rip, rsp, ia32_efer and rflags are written to VMCS in start_vcpu */
@@ -322,7 +323,8 @@ static void init_exec_ctrl(struct acrn_vcpu *vcpu)
 	value32 = check_vmx_ctrl(MSR_IA32_VMX_PROCBASED_CTLS2,
 			VMX_PROCBASED_CTLS2_VAPIC | VMX_PROCBASED_CTLS2_EPT |VMX_PROCBASED_CTLS2_VPID |
 			VMX_PROCBASED_CTLS2_RDTSCP | VMX_PROCBASED_CTLS2_UNRESTRICT | VMX_PROCBASED_CTLS2_XSVE_XRSTR |
-			VMX_PROCBASED_CTLS2_PAUSE_LOOP | VMX_PROCBASED_CTLS2_UWAIT_PAUSE);
+			VMX_PROCBASED_CTLS2_PAUSE_LOOP | VMX_PROCBASED_CTLS2_UWAIT_PAUSE |
+			VMX_PROCBASED_CTLS2_BUS_LOCK);
 
 	/* SDM Vol3, 25.3,  setting "enable INVPCID" VM-execution to 1 with "INVLPG exiting" disabled,
 	 * passes-through INVPCID instruction to guest if the instruction is supported.
@@ -362,8 +364,26 @@ static void init_exec_ctrl(struct acrn_vcpu *vcpu)
 
 	/* Set up tertiary processor based VM execution controls */
 	if ((exec_vmread32(VMX_PROC_VM_EXEC_CONTROLS) & VMX_PROCBASED_CTLS_TERTIARY) != 0U) {
-		/* Enable KeyLocker if support */
-		value64 = check_vmx_ctrl_64(MSR_IA32_VMX_PROCBASED_CTLS3, VMX_PROCBASED_CTLS3_LOADIWKEY);
+		uint64_t ctrl3_req = VMX_PROCBASED_CTLS3_LOADIWKEY;
+
+		/* IPI virtualization: unicast fixed IPIs between running
+		 * vCPUs post and notify entirely in hardware, keyed off the
+		 * per-VM PID-pointer table. INIT/SIPI, broadcasts and IDs
+		 * with no valid PID pointer still take the ICR-write exit
+		 * and the software delivery path. The notification reuses
+		 * the posted-interrupt machinery, so require full APICv.
+		 */
+		if (is_apicv_advanced_feature_supported()) {
+			ctrl3_req |= VMX_PROCBASED_CTLS3_IPI_VIRT;
+		}
+
+		value64 = check_vmx_ctrl_64(MSR_IA32_VMX_PROCBASED_CTLS3, ctrl3_req);
+		if ((value64 & VMX_PROCBASED_CTLS3_IPI_VIRT) != 0UL) {
+			exec_vmwrite64(VMX_PID_POINTER_TABLE_FULL,
+					hva2hpa((void *)&vm->arch_vm.pid_ptr_table));
+			exec_vmwrite16(VMX_LAST_PID_POINTER_INDEX,
+					(uint16_t)(PID_PTR_TABLE_ENTRY_NUM - 1U));
+		}
 
 		exec_vmwrite64(VMX_PROC_VM_EXEC_CONTROLS3_FULL, value64);
 		pr_dbg("VMX_PROC_VM_EXEC_CONTROLS3: 0x%llx ", value64);
@@ -396,6 +416,12 @@ static void init_exec_ctrl(struct acrn_vcpu *vcpu)
 	 * on VMX_EPT_VPID_CAP
 	 */
 	value64 = hva2hpa(vm->arch_vm.nworld_eptp) | (3UL << 3U) | 6UL;
+	if (is_ept_dirty_logging_supported()) {
+		/* enable EPT accessed/dirty flags, required by PML based
+		 * dirty-page tracking
+		 */
+		value64 |= (1UL << 6U);
+	}
 	exec_vmwrite64(VMX_EPT_POINTER_FULL, value64);
 	pr_dbg("VMX_EPT_POINTER: 0x%016lx ", value64);
 
@@ -570,6 +596,34 @@ void init_vmcs(struct acrn_vcpu *vcpu)
 	init_guest_state(vcpu);
 	init_entry_ctrl(vcpu);
 	init_exit_ctrl(vcpu);
+
+	if (vcpu->vm->dirty_track_active) {
+		/* a reinitialized VMCS starts with PML disabled, re-arm it */
+		vcpu_set_vmcs_pml(vcpu);
+	}
+}
+
+/**
+ * @brief Sync the PML configuration of the current VMCS with the VM's
+ *        dirty-page tracking state
+ *
+ * The logging buffer and index are per-vCPU VMCS state, so this must run in
+ * the context of the owning vCPU; it is triggered via ACRN_REQUEST_DIRTY_TRACK.
+ *
+ * @pre vcpu->arch.vmcs is the current VMCS on this pcpu
+ */
+void vcpu_set_vmcs_pml(struct acrn_vcpu *vcpu)
+{
+	uint32_t value32 = exec_vmread32(VMX_PROC_VM_EXEC_CONTROLS2);
+
+	if (vcpu->vm->dirty_track_active) {
+		exec_vmwrite64(VMX_PML_ADDR_FULL, hva2hpa((void *)vcpu->pml_log));
+		exec_vmwrite16(VMX_GUEST_PML_INDEX, (uint16_t)(PML_LOG_ENTRIES - 1U));
+		value32 |= VMX_PROCBASED_CTLS2_PML;
+	} else {
+		value32 &= ~VMX_PROCBASED_CTLS2_PML;
+	}
+	exec_vmwrite32(VMX_PROC_VM_EXEC_CONTROLS2, value32);
 }
 
 /**
@@ -627,6 +681,13 @@ void switch_apicv_mode_x2apic(struct acrn_vcpu *vcpu)
 		}
 		exec_vmwrite32(VMX_PROC_VM_EXEC_CONTROLS2, value32);
 
+		/*
+		 * The guest owns the physical TSC deadline from now on: hand the
+		 * housekeeping timers of this pCPU over to the BSP before the
+		 * IA32_TSC_DEADLINE interception is dropped below.
+		 */
+		migrate_percpu_timers();
+
 		update_msr_bitmap_x2apic_passthru(vcpu);
 
 		/*
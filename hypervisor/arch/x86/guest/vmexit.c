@@ -17,28 +17,29 @@
 #include <asm/guest/lock_instr_emul.h>
 #include <asm/guest/ept.h>
 #include <asm/guest/vept.h>
+#include <asm/guest/pv_idle.h>
 #include <asm/vtd.h>
 #include <asm/cpuid.h>
 #include <asm/guest/vcpuid.h>
+#include <asm/tsc.h>
+#include <asm/lib/bits.h>
+#include <ticks.h>
 #include <trace.h>
+#include <vm_stats.h>
 #include <asm/rtcm.h>
 #include <debug/console.h>
 
-/*
- * According to "SDM APPENDIX C VMX BASIC EXIT REASONS",
- * there are 65 Basic Exit Reasons.
- */
-#define NR_VMX_EXIT_REASONS	70U
-
 static int32_t triple_fault_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t unhandled_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t xsetbv_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t wbinvd_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t undefined_vmexit_handler(struct acrn_vcpu *vcpu);
-static int32_t pause_vmexit_handler(__unused struct acrn_vcpu *vcpu);
+static int32_t pause_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t hlt_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t mtf_vmexit_handler(struct acrn_vcpu *vcpu);
+static int32_t pml_full_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t loadiwkey_vmexit_handler(struct acrn_vcpu *vcpu);
+static int32_t bus_lock_vmexit_handler(struct acrn_vcpu *vcpu);
 static int32_t init_signal_vmexit_handler(__unused struct acrn_vcpu *vcpu);
 
 /* VM Dispatch table for Exit condition handling */
@@ -200,27 +201,159 @@ static const struct vm_exit_dispatch dispatch_table[NR_VMX_EXIT_REASONS] = {
 	[VMX_EXIT_REASON_RDSEED] = {
 		.handler = unhandled_vmexit_handler},
 	[VMX_EXIT_REASON_PAGE_MODIFICATION_LOG_FULL] = {
-		.handler = unhandled_vmexit_handler},
+		.handler = pml_full_vmexit_handler},
 	[VMX_EXIT_REASON_XSAVES] = {
 		.handler = unhandled_vmexit_handler},
 	[VMX_EXIT_REASON_XRSTORS] = {
 		.handler = unhandled_vmexit_handler},
 	[VMX_EXIT_REASON_LOADIWKEY] = {
-		.handler = loadiwkey_vmexit_handler}
+		.handler = loadiwkey_vmexit_handler},
+	[VMX_EXIT_REASON_BUS_LOCK] = {
+		.handler = bus_lock_vmexit_handler}
 };
 
+/*
+ * Account the cycles one dispatch->handler invocation took against the
+ * per-vCPU, per-exit-reason log2 histogram. The record is also pushed to
+ * the trace buffer so that acrntrace captures carry the same data.
+ */
+static void vmexit_stat_record(struct acrn_vcpu *vcpu, uint16_t basic_exit_reason, uint64_t cycles)
+{
+	struct vmexit_stat *stat = &vcpu->vmexit_stats[basic_exit_reason];
+	uint16_t bucket = (cycles != 0UL) ? fls64(cycles) : 0U;
+
+	if (bucket >= VMEXIT_HIST_NR_BUCKETS) {
+		bucket = VMEXIT_HIST_NR_BUCKETS - 1U;
+	}
+	stat->count++;
+	stat->total_cycles += cycles;
+	stat->hist[bucket]++;
+
+	TRACE_2L(TRACE_VMEXIT_LATENCY, (uint64_t)basic_exit_reason, cycles);
+}
+
+/*
+ * Exit-storm detection and mitigation.
+ *
+ * A guest driver hammering an intercepted MSR or MMIO register can push a
+ * vCPU into millions of exits per second; the hypervisor time spent in the
+ * dispatch path then starves sibling vCPUs sharing the pCPU. Track an EWMA
+ * of the per-vCPU exit rate over fixed TSC windows; while it stays above
+ * the storm threshold, throttle the offender by yielding the pCPU to a
+ * runnable sibling on every STORM_YIELD_INTERVAL-th exit (the exits
+ * themselves become the slow path), log the onset with the dominant exit
+ * reason and notify the Service VM via its notification vector so an
+ * operator-facing agent can react. Hysteresis on the clear threshold keeps
+ * the mitigation from flapping at the boundary.
+ */
+#define STORM_WINDOW_MS		10UL
+#define STORM_EWMA_WEIGHT	3U	/* new window weighs 1/8 */
+#define STORM_THRESHOLD		20000U	/* exits per window, ~2M exits/s */
+#define STORM_YIELD_INTERVAL	128U
+
+static uint16_t vmexit_dominant_reason(const struct acrn_vcpu *vcpu)
+{
+	uint64_t max_cnt = 0UL;
+	uint16_t reason = 0U, i;
+
+	for (i = 0U; i < NR_VMX_EXIT_REASONS; i++) {
+		if (vcpu->vmexit_stats[i].count > max_cnt) {
+			max_cnt = vcpu->vmexit_stats[i].count;
+			reason = i;
+		}
+	}
+
+	return reason;
+}
+
+static void vmexit_storm_check(struct acrn_vcpu *vcpu)
+{
+	uint64_t now = rdtsc();
+
+	vcpu->storm_window_exits++;
+	if ((now - vcpu->storm_window_start) >= (STORM_WINDOW_MS * TSC_PER_MS)) {
+		uint32_t ewma = vcpu->storm_ewma;
+
+		ewma -= ewma >> STORM_EWMA_WEIGHT;
+		ewma += vcpu->storm_window_exits >> STORM_EWMA_WEIGHT;
+		vcpu->storm_ewma = ewma;
+		vcpu->storm_window_exits = 0U;
+		vcpu->storm_window_start = now;
+
+		if (!vcpu->storm_active && (ewma > STORM_THRESHOLD)) {
+			vcpu->storm_active = true;
+			pr_warn("exit storm on vm%u vcpu%u: ~%u exits per %lums, dominant reason 0x%x",
+				vcpu->vm->vm_id, vcpu->vcpu_id, ewma, STORM_WINDOW_MS,
+				vmexit_dominant_reason(vcpu));
+			if (!is_service_vm(vcpu->vm)) {
+				arch_fire_hsm_interrupt();
+			}
+		} else if (vcpu->storm_active && (ewma < (STORM_THRESHOLD / 2U))) {
+			vcpu->storm_active = false;
+			pr_warn("exit storm on vm%u vcpu%u subsided", vcpu->vm->vm_id, vcpu->vcpu_id);
+		}
+	}
+
+	if (vcpu->storm_active) {
+		vcpu->storm_yield_cnt++;
+		if ((vcpu->storm_yield_cnt % STORM_YIELD_INTERVAL) == 0U) {
+			yield_current();
+		}
+	}
+}
+
+/*
+ * Drain the PML buffer of this vCPU into the dirty bitmap shared with the
+ * Service VM. Done on every VM exit while dirty-page tracking is active, so
+ * the buffer never has to be harvested from a remote pCPU and pausing the
+ * VM is enough to make the bitmap complete.
+ */
+static void vmexit_pml_flush(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	uint64_t gfn, bitmap_bits = vm->dirty_bitmap_size << 3U;
+	uint16_t index = exec_vmread16(VMX_GUEST_PML_INDEX);
+	uint16_t i;
+
+	/* the logging index starts at PML_LOG_ENTRIES - 1 and decrements on
+	 * each logged entry, wrapping to 0xFFFF when the buffer is full, so
+	 * the valid entries are index + 1 ... PML_LOG_ENTRIES - 1
+	 */
+	index = (index == 0xFFFFU) ? 0U : (uint16_t)(index + 1U);
+
+	if (index < PML_LOG_ENTRIES) {
+		stac();
+		for (i = index; i < PML_LOG_ENTRIES; i++) {
+			gfn = vcpu->pml_log[i] >> PAGE_SHIFT;
+			if (gfn < bitmap_bits) {
+				bitmap_set_lock((uint16_t)(gfn & 0x3FUL), &vm->dirty_bitmap[gfn >> 6U]);
+			}
+		}
+		clac();
+		exec_vmwrite16(VMX_GUEST_PML_INDEX, (uint16_t)(PML_LOG_ENTRIES - 1U));
+	}
+}
+
 int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 {
 	struct vm_exit_dispatch *dispatch = NULL;
 	uint16_t basic_exit_reason;
+	uint64_t tsc_enter;
 	int32_t ret;
 
+	/* per-pCPU total, used to verify that an isolated core stays exit-free */
+	get_cpu_var(vmexit_cnt)++;
+
 	if (get_pcpu_id() != pcpuid_from_vcpu(vcpu)) {
 		pr_fatal("vcpu is not running on its pcpu!");
 		ret = -EINVAL;
 	} else if (is_vcpu_in_l2_guest(vcpu)) {
 		ret = nested_vmexit_handler(vcpu);
 	} else {
+		/* the guest ran since the last exit: cached gva->gpa walks
+		 * are stale the same way hardware TLB entries could be */
+		vcpu_invalidate_gva_cache(vcpu);
+
 		/* Obtain interrupt info */
 		vcpu->arch.idt_vectoring_info = exec_vmread32(VMX_IDT_VEC_INFO_FIELD);
 		/* Filter out HW exception & NMI */
@@ -244,6 +377,10 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 			}
 		}
 
+		if (vcpu->vm->dirty_track_active) {
+			vmexit_pml_flush(vcpu);
+		}
+
 		/* Calculate basic exit reason (low 16-bits) */
 		basic_exit_reason = (uint16_t)(vcpu->arch.exit_reason & 0xFFFFU);
 
@@ -264,6 +401,8 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 				vcpu->arch.exit_qualification = exec_vmread(VMX_EXIT_QUALIFICATION);
 			}
 
+			tsc_enter = rdtsc();
+
 			/* exit dispatch handling */
 			if (basic_exit_reason == VMX_EXIT_REASON_EXTERNAL_INTERRUPT) {
 				/* Handling external_interrupt should disable intr */
@@ -279,6 +418,12 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 			} else {
 				ret = dispatch->handler(vcpu);
 			}
+
+			vmexit_stat_record(vcpu, basic_exit_reason, rdtsc() - tsc_enter);
+
+			vmexit_storm_check(vcpu);
+
+			vm_stats_publish(vcpu);
 		}
 	}
 
@@ -302,6 +447,14 @@ static int32_t unhandled_vmexit_handler(struct acrn_vcpu *vcpu)
 	return 0;
 }
 
+static int32_t pml_full_vmexit_handler(__unused struct acrn_vcpu *vcpu)
+{
+	/* the common exit path already drained the full PML buffer and reset
+	 * the logging index, nothing left to do but resume the guest
+	 */
+	return 0;
+}
+
 /* MTF is currently only used for split-lock emulation */
 static int32_t mtf_vmexit_handler(struct acrn_vcpu *vcpu)
 {
@@ -327,15 +480,116 @@ static int32_t triple_fault_vmexit_handler(struct acrn_vcpu *vcpu)
 	return 0;
 }
 
-static int32_t pause_vmexit_handler(__unused struct acrn_vcpu *vcpu)
+/*
+ * A bus-lock exit is trap-like: the locked access already completed and
+ * guest RIP points past it, so RIP must not be advanced again. The exit
+ * itself is counted by vmexit_stat_record(); what happens beyond that is
+ * the per-VM bus_lock_policy, which exists so one tenant's split-locked
+ * atomics cannot keep stalling the socket under an RT partition.
+ */
+static int32_t bus_lock_vmexit_handler(struct acrn_vcpu *vcpu)
 {
+	struct acrn_vm_config *vm_config = get_vm_config(vcpu->vm->vm_id);
+	uint64_t cnt = vcpu->vmexit_stats[VMX_EXIT_REASON_BUS_LOCK].count;
+
+	vcpu_retain_rip(vcpu);
+
+	/* rate limited: a guest spinning on a split-locked atomic takes
+	 * this exit at bus-lock frequency */
+	if ((cnt & 0xffUL) == 0UL) {
+		pr_warn("VM%d vcpu%hu executed a bus locking instruction @ guest RIP 0x%016lx (%lu so far)",
+			vcpu->vm->vm_id, vcpu->vcpu_id, vcpu_get_rip(vcpu), cnt);
+	}
+
+	if (!is_service_vm(vcpu->vm)) {
+		switch (vm_config->bus_lock_policy) {
+		case ACRN_BUS_LOCK_POLICY_YIELD:
+			/* give the pCPU to a well-behaved thread; the offender
+			 * is throttled to roughly one bus lock per timeslice */
+			yield_current();
+			break;
+		case ACRN_BUS_LOCK_POLICY_KILL:
+			pr_fatal("VM%d: shut down by bus-lock policy @ guest RIP 0x%016lx",
+				vcpu->vm->vm_id, vcpu_get_rip(vcpu));
+			triple_fault_shutdown_vm(vcpu);
+			break;
+		default:
+			/* ACRN_BUS_LOCK_POLICY_LOG: nothing beyond the counters */
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int32_t pause_vmexit_handler(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vcpu *sibling;
+	uint16_t i;
+
+	/* A PAUSE-loop exit hints the guest is spinning on a lock whose
+	 * holder was preempted. Boost a runnable (i.e. preempted) sibling
+	 * vCPU of the same VM on its pCPU before yielding, so the probable
+	 * holder gets to release the lock instead of the spinner burning
+	 * its remaining timeslice.
+	 */
+	foreach_vcpu(i, vcpu->vm, sibling) {
+		if ((sibling != vcpu) && (sibling->thread_obj.status == THREAD_STS_RUNNABLE)) {
+			yield_to(&sibling->thread_obj);
+			break;
+		}
+	}
+
 	yield_current();
 	return 0;
 }
 
+/* adaptive halt-polling window bounds, in microseconds */
+#define HALT_POLL_BASE_US	10U
+#define HALT_POLL_MAX_US	200U
+
+static inline bool vcpu_has_pending_wakeup(struct acrn_vcpu *vcpu)
+{
+	return ((vcpu->arch.pending_req != 0UL) || vlapic_has_pending_intr(vcpu));
+}
+
+/*
+ * Spin for an adaptive number of TSC cycles before truly blocking a halted
+ * vCPU: a wakeup that arrives within the window avoids the sleep/wake and
+ * context switch cost entirely. The window doubles after a successful poll
+ * and halves after a wasted one, so busy guests converge on polling and
+ * mostly-idle ones fall back to blocking right away. Polling is abandoned
+ * as soon as the pCPU has other work to run.
+ */
 static int32_t hlt_vmexit_handler(struct acrn_vcpu *vcpu)
 {
-	if ((vcpu->arch.pending_req == 0UL) && (!vlapic_has_pending_intr(vcpu))) {
+	bool woken = vcpu_has_pending_wakeup(vcpu);
+
+	/* a guest that declares it polls in its own idle loop has already
+	 * paid a poll window before this HLT; polling here again would just
+	 * burn a second window for the same idle period
+	 */
+	if (!woken && (vcpu->halt_poll_cycles != 0UL) && !pv_idle_guest_polling(vcpu)) {
+		uint64_t poll_start = rdtsc();
+
+		while ((rdtsc() - poll_start) < vcpu->halt_poll_cycles) {
+			if (vcpu_has_pending_wakeup(vcpu)) {
+				woken = true;
+				break;
+			}
+			if (need_reschedule(pcpuid_from_vcpu(vcpu))) {
+				break;
+			}
+			asm_pause();
+		}
+	}
+
+	if (woken) {
+		vcpu->halt_poll_cycles = min(max(vcpu->halt_poll_cycles * 2UL,
+				us_to_ticks(HALT_POLL_BASE_US)), us_to_ticks(HALT_POLL_MAX_US));
+	} else {
+		vcpu->halt_poll_cycles = (vcpu->halt_poll_cycles > us_to_ticks(HALT_POLL_BASE_US)) ?
+				(vcpu->halt_poll_cycles >> 1U) : 0UL;
 		wait_event(&vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]);
 	}
 	return 0;
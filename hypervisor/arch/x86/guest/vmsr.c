@@ -17,12 +17,16 @@
 #include <asm/guest/guest_pm.h>
 #include <asm/guest/ucode.h>
 #include <asm/guest/nested.h>
+#include <asm/guest/pvclock.h>
+#include <asm/guest/pv_idle.h>
+#include <asm/guest/pv_msr.h>
 #include <asm/cpufeatures.h>
 #include <asm/rdt.h>
 #include <asm/tsc.h>
 #include <trace.h>
 #include <logmsg.h>
 #include <asm/guest/vcat.h>
+#include <asm/guest/vpmu.h>
 
 #define INTERCEPT_DISABLE		(0U)
 #define INTERCEPT_READ			(1U << 0U)
@@ -310,6 +314,80 @@ static void enable_msr_interception(uint8_t *bitmap, uint32_t msr_arg, uint32_t
 	}
 }
 
+/* an intercepted MSR is flipped to passthrough once it fired this often */
+#define MSR_AUTO_PT_THRESHOLD		0x10000UL
+
+/*
+ * Vetted MSRs that the auto-passthrough engine may flip to passthrough in
+ * the MSR bitmap of a vCPU once they turn out hot. Only MSRs whose current
+ * emulation is side-effect free and equivalent to direct hardware access
+ * belong here; residual_mode keeps the interception that is still required.
+ */
+static const struct msr_pt_policy {
+	uint32_t msr;
+	uint32_t residual_mode;	/* interception kept after the flip */
+} msr_pt_allowlist[] = {
+	/* the emulation already writes the hardware MSR on every guest write
+	 * and reads return the value the vCPU last wrote
+	 */
+	{ MSR_IA32_UMWAIT_CONTROL, INTERCEPT_DISABLE },
+	/* reads return the hardware microcode revision anyway; writes keep
+	 * trapping so the microcode update trigger protocol stays emulated
+	 */
+	{ MSR_IA32_BIOS_SIGN_ID, INTERCEPT_WRITE },
+};
+
+static void try_msr_auto_passthrough(struct acrn_vcpu *vcpu, struct msr_exit_stat *stat)
+{
+	uint32_t i;
+
+	for (i = 0U; i < ARRAY_SIZE(msr_pt_allowlist); i++) {
+		if (msr_pt_allowlist[i].msr == stat->msr) {
+			enable_msr_interception(vcpu->arch.msr_bitmap, stat->msr,
+				msr_pt_allowlist[i].residual_mode);
+			stat->passthrough = 1U;
+			pr_info("%s: vm%d vcpu%hu: hot MSR 0x%x flipped to passthrough (residual mode %u)",
+				__func__, vcpu->vm->vm_id, vcpu->vcpu_id, stat->msr,
+				msr_pt_allowlist[i].residual_mode);
+			break;
+		}
+	}
+}
+
+/*
+ * Account one rdmsr/wrmsr exit against the per-vCPU MSR frequency table
+ * (shown by the "msrexit" shell command) and kick the auto-passthrough
+ * engine when an allowlisted MSR crosses the hotness threshold.
+ */
+static void msr_exit_stat_record(struct acrn_vcpu *vcpu, uint32_t msr, bool is_write)
+{
+	struct msr_exit_stat *stat = NULL;
+	uint32_t i;
+
+	for (i = 0U; i < (MSR_EXIT_STATS_ENTRIES - 1U); i++) {
+		stat = &vcpu->msr_exit_stats[i];
+		if (((stat->rd_count | stat->wr_count) == 0UL) || (stat->msr == msr)) {
+			stat->msr = msr;
+			break;
+		}
+	}
+	if (i == (MSR_EXIT_STATS_ENTRIES - 1U)) {
+		stat = &vcpu->msr_exit_stats[i];
+		stat->msr = MSR_EXIT_STATS_OTHER;
+	}
+
+	if (is_write) {
+		stat->wr_count++;
+	} else {
+		stat->rd_count++;
+	}
+
+	if ((stat->passthrough == 0U) && (stat->msr != MSR_EXIT_STATS_OTHER) &&
+			((stat->rd_count + stat->wr_count) == MSR_AUTO_PT_THRESHOLD)) {
+		try_msr_auto_passthrough(vcpu, stat);
+	}
+}
+
 /*
  * Enable read and write msr interception for x2APIC MSRs
  */
@@ -331,31 +409,39 @@ static void prepare_auto_msr_area(struct acrn_vcpu *vcpu)
 {
 	vcpu->arch.msr_area.count = 0U;
 
-	/* in HV, disable perf/PMC counting, just count in guest VM */
-	if (is_pmu_pt_configured(vcpu->vm)) {
+	/* in HV, disable perf/PMC counting, just count in guest VM; the vPMU
+	 * also routes the guest's IA32_PERF_GLOBAL_CTRL through this entry so
+	 * emulated counters only tick in non-root mode
+	 */
+	if (is_pmu_pt_configured(vcpu->vm) || is_vpmu_configured(vcpu->vm)) {
 		vcpu->arch.msr_area.guest[vcpu->arch.msr_area.count].msr_index = MSR_IA32_PERF_GLOBAL_CTRL;
 		vcpu->arch.msr_area.guest[vcpu->arch.msr_area.count].value = 0;
 		vcpu->arch.msr_area.host[vcpu->arch.msr_area.count].msr_index = MSR_IA32_PERF_GLOBAL_CTRL;
 		vcpu->arch.msr_area.host[vcpu->arch.msr_area.count].value = 0;
+		vcpu->arch.msr_area.index_of_perf_global_ctrl = vcpu->arch.msr_area.count;
 		vcpu->arch.msr_area.count++;
 	}
 
-	if (is_platform_rdt_capable()) {
+	if (is_platform_rdt_capable() || is_platform_cmt_capable()) {
 		struct acrn_vm_config *cfg = get_vm_config(vcpu->vm->vm_id);
-		uint16_t vcpu_clos;
+		uint16_t vcpu_clos = hv_clos;
+		uint16_t rmid = vm_rmid(vcpu->vm->vm_id);
 
-		ASSERT(cfg->pclosids != NULL, "error, cfg->pclosids is NULL");
+		if (is_platform_rdt_capable()) {
+			ASSERT(cfg->pclosids != NULL, "error, cfg->pclosids is NULL");
 
-		vcpu_clos = cfg->pclosids[vcpu->vcpu_id%cfg->num_pclosids];
+			vcpu_clos = cfg->pclosids[vcpu->vcpu_id%cfg->num_pclosids];
+		}
 
 		/* RDT: only load/restore MSR_IA32_PQR_ASSOC when hv and guest have different settings
 		 * vCAT: always load/restore MSR_IA32_PQR_ASSOC
+		 * CMT/MBM: also switch it to track the VM's RMID while it runs
 		 */
-		if (is_vcat_configured(vcpu->vm) || (vcpu_clos != hv_clos)) {
+		if (is_vcat_configured(vcpu->vm) || (vcpu_clos != hv_clos) || (rmid != 0U)) {
 			vcpu->arch.msr_area.guest[vcpu->arch.msr_area.count].msr_index = MSR_IA32_PQR_ASSOC;
-			vcpu->arch.msr_area.guest[vcpu->arch.msr_area.count].value = clos2pqr_msr(vcpu_clos);
+			vcpu->arch.msr_area.guest[vcpu->arch.msr_area.count].value = clos_rmid2pqr_msr(vcpu_clos, rmid);
 			vcpu->arch.msr_area.host[vcpu->arch.msr_area.count].msr_index = MSR_IA32_PQR_ASSOC;
-			vcpu->arch.msr_area.host[vcpu->arch.msr_area.count].value = clos2pqr_msr(hv_clos);
+			vcpu->arch.msr_area.host[vcpu->arch.msr_area.count].value = clos_rmid2pqr_msr(hv_clos, 0U);
 			vcpu->arch.msr_area.index_of_pqr_assoc = vcpu->arch.msr_area.count;
 			vcpu->arch.msr_area.count++;
 
@@ -573,6 +659,8 @@ int32_t rdmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 	/* Read the msr value */
 	msr = (uint32_t)vcpu_get_gpreg(vcpu, CPU_REG_RCX);
 
+	msr_exit_stat_record(vcpu, msr, false);
+
 	/* Do the required processing for each msr case */
 	switch (msr) {
 #ifdef CONFIG_HYPERV_ENABLED
@@ -586,6 +674,21 @@ int32_t rdmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 		break;
 	}
 #endif
+	case ACRN_MSR_PVCLOCK:
+	{
+		v = vcpu->arch.pvclock_msr;
+		break;
+	}
+	case ACRN_MSR_PV_IDLE:
+	{
+		v = vcpu->arch.pv_idle_msr;
+		break;
+	}
+	case ACRN_MSR_PV_MSR:
+	{
+		v = vcpu->arch.pv_msr_msr;
+		break;
+	}
 	case MSR_IA32_TSC_DEADLINE:
 	{
 		v = vlapic_get_tsc_deadline_msr(vcpu_vlapic(vcpu));
@@ -698,7 +801,7 @@ int32_t rdmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 	case MSR_IA32_UMWAIT_CONTROL:
 	{
 		/* Feature X86_FEATURE_WAITPKG is always presented */
-		if (pcpu_has_cap(X86_FEATURE_WAITPKG)) {
+		if (pcpu_has_cap_const(X86_FEATURE_WAITPKG)) {
 			v = vcpu_get_guest_msr(vcpu, msr);
 		} else {
 			err = -EACCES;
@@ -730,6 +833,18 @@ int32_t rdmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 		break;
 	}
 #endif
+	case MSR_IA32_PMC0 ... (MSR_IA32_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_A_PMC0 ... (MSR_IA32_A_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_PERFEVTSEL0 ... (MSR_IA32_PERFEVTSEL0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_FIXED_CTR0 ... (MSR_IA32_FIXED_CTR0 + VPMU_NUM_FIXED_CTRS - 1U):
+	case MSR_IA32_FIXED_CTR_CTL:
+	case MSR_IA32_PERF_GLOBAL_STATUS:
+	case MSR_IA32_PERF_GLOBAL_CTRL:
+	case MSR_IA32_PERF_GLOBAL_OVF_CTRL:
+	{
+		err = vpmu_rdmsr(vcpu, msr, &v);
+		break;
+	}
 	default:
 	{
 		if (is_x2apic_msr(msr)) {
@@ -825,6 +940,11 @@ static void set_guest_tsc(struct acrn_vcpu *vcpu, uint64_t guest_tsc)
 	exec_vmwrite64(VMX_TSC_OFFSET_FULL, tsc_delta);
 
 	set_tsc_msr_interception(vcpu, tsc_delta != 0UL);
+
+	/* the PV time page anchors on the guest TSC; resample it so the
+	 * timeline stays continuous across a restore-time TSC rewrite
+	 */
+	pvclock_update_page(vcpu);
 }
 
 /*
@@ -935,6 +1055,8 @@ int32_t wrmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 	v = (vcpu_get_gpreg(vcpu, CPU_REG_RDX) << 32U) |
 		vcpu_get_gpreg(vcpu, CPU_REG_RAX);
 
+	msr_exit_stat_record(vcpu, msr, true);
+
 	/* Do the required processing for each msr case */
 	switch (msr) {
 #ifdef CONFIG_HYPERV_ENABLED
@@ -948,6 +1070,21 @@ int32_t wrmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 		break;
 	}
 #endif
+	case ACRN_MSR_PVCLOCK:
+	{
+		pvclock_msr_write(vcpu, v);
+		break;
+	}
+	case ACRN_MSR_PV_IDLE:
+	{
+		pv_idle_msr_write(vcpu, v);
+		break;
+	}
+	case ACRN_MSR_PV_MSR:
+	{
+		pv_msr_msr_write(vcpu, v);
+		break;
+	}
 	case MSR_IA32_TSC_DEADLINE:
 	{
 		vlapic_set_tsc_deadline_msr(vcpu_vlapic(vcpu), v);
@@ -1097,7 +1234,7 @@ int32_t wrmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 	case MSR_IA32_UMWAIT_CONTROL:
 	{
 		/* Feature X86_FEATURE_WAITPKG is always presented */
-		if (pcpu_has_cap(X86_FEATURE_WAITPKG)) {
+		if (pcpu_has_cap_const(X86_FEATURE_WAITPKG)) {
 			vcpu_set_guest_msr(vcpu, msr, v);
 			msr_write(msr, v);
 		} else {
@@ -1131,6 +1268,18 @@ int32_t wrmsr_vmexit_handler(struct acrn_vcpu *vcpu)
 		break;
 	}
 #endif
+	case MSR_IA32_PMC0 ... (MSR_IA32_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_A_PMC0 ... (MSR_IA32_A_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_PERFEVTSEL0 ... (MSR_IA32_PERFEVTSEL0 + VPMU_NUM_GP_CTRS - 1U):
+	case MSR_IA32_FIXED_CTR0 ... (MSR_IA32_FIXED_CTR0 + VPMU_NUM_FIXED_CTRS - 1U):
+	case MSR_IA32_FIXED_CTR_CTL:
+	case MSR_IA32_PERF_GLOBAL_STATUS:
+	case MSR_IA32_PERF_GLOBAL_CTRL:
+	case MSR_IA32_PERF_GLOBAL_OVF_CTRL:
+	{
+		err = vpmu_wrmsr(vcpu, msr, v);
+		break;
+	}
 	default:
 	{
 		if (is_x2apic_msr(msr)) {
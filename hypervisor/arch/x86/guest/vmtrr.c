@@ -167,15 +167,40 @@ static void update_ept_mem_type(const struct acrn_vmtrr *vmtrr)
 {
 	uint8_t type;
 	uint64_t start, size;
+	uint64_t effective[FIXED_RANGE_MTRR_NUM];
 	uint32_t i, j;
+	bool fixed_applied = is_mtrr_enabled(vmtrr) && is_fixed_range_mtrr_enabled(vmtrr);
 	struct acrn_vm *vm = vmtrr2vcpu(vmtrr)->vm;
 
+	/*
+	 * Change-impact check: EPT is per VM while MTRRs are per vCPU, and
+	 * every vCPU walks the same SDM MP update sequence during guest
+	 * boot. Compute the effective per-subrange layout this write asks
+	 * for and skip the rebuild if it matches what is already applied.
+	 * Guests serialize the update sequence across processors (SDM Vol 3,
+	 * 11.11.8), so no lock is taken around the compare-and-apply.
+	 */
+	for (i = 0U; i < FIXED_RANGE_MTRR_NUM; i++) {
+		effective[i] = fixed_applied ? vmtrr->fixed_range[i].value :
+			((uint64_t)get_default_memory_type(vmtrr) * 0x0101010101010101UL);
+	}
+	if (vm->arch_vm.vmtrr_ept_synced) {
+		for (i = 0U; i < FIXED_RANGE_MTRR_NUM; i++) {
+			if (effective[i] != vm->arch_vm.vmtrr_applied_type[i]) {
+				break;
+			}
+		}
+		if (i == FIXED_RANGE_MTRR_NUM) {
+			return;
+		}
+	}
+
 	/*
 	 * Intel SDM, Vol 3, 11.11.2.1 Section "IA32_MTRR_DEF_TYPE MSR":
 	 * - when def_type.E is clear, UC memory type is applied
 	 * - when def_type.FE is clear, MTRRdefType.type is applied
 	 */
-	if (!is_mtrr_enabled(vmtrr) || !is_fixed_range_mtrr_enabled(vmtrr)) {
+	if (!fixed_applied) {
 		update_ept(vm, 0U, MAX_FIXED_RANGE_ADDR, get_default_memory_type(vmtrr));
 	} else {
 		/* Deal with fixed-range MTRRs only */
@@ -199,6 +224,11 @@ static void update_ept_mem_type(const struct acrn_vmtrr *vmtrr)
 			update_ept(vm, start, size, type);
 		}
 	}
+
+	for (i = 0U; i < FIXED_RANGE_MTRR_NUM; i++) {
+		vm->arch_vm.vmtrr_applied_type[i] = effective[i];
+	}
+	vm->arch_vm.vmtrr_ept_synced = true;
 }
 
 /* virtual MTRR MSR write API */
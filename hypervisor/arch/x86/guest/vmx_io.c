@@ -14,7 +14,12 @@
 #include <asm/guest/vmexit.h>
 #include <asm/vmx.h>
 #include <asm/guest/ept.h>
+#include <asm/guest/virq.h>
+#include <asm/guest/guest_memory.h>
 #include <asm/pgtable.h>
+#include <asm/mmu.h>
+#include <asm/per_cpu.h>
+#include <asm/lib/bits.h>
 #include <trace.h>
 #include <logmsg.h>
 
@@ -48,7 +53,8 @@ emulate_pio_complete(struct acrn_vcpu *vcpu, const struct io_request *io_req)
 	const struct acrn_pio_request *pio_req = &io_req->reqs.pio_request;
 	uint64_t mask = 0xFFFFFFFFUL >> (32UL - (8UL * pio_req->size));
 
-	if (pio_req->direction == ACRN_IOREQ_DIR_READ) {
+	/* an INS lands in guest memory, not in RAX */
+	if ((pio_req->direction == ACRN_IOREQ_DIR_READ) && (!io_req->is_pio_string)) {
 		uint64_t value = (uint64_t)pio_req->value;
 		uint64_t rax = vcpu_get_gpreg(vcpu, CPU_REG_RAX);
 
@@ -58,6 +64,138 @@ emulate_pio_complete(struct acrn_vcpu *vcpu, const struct io_request *io_req)
 }
 
 
+/* cap on elements one exit may move for a REP INS/OUTS; a capped REP
+ * retains RIP so the guest re-executes the instruction for the rest
+ */
+#define PIO_STR_MAX_ELEMENTS	1024UL
+
+#define RFLAGS_DF		(1UL << 10U)
+
+/* update a string-op register (RSI/RDI/RCX) with the operand-width
+ * semantics of the guest: 16-bit updates leave the upper bits alone,
+ * 32-bit updates zero-extend
+ */
+static void set_pio_string_gpreg(struct acrn_vcpu *vcpu, uint32_t reg,
+		uint64_t value, uint64_t addr_mask)
+{
+	uint64_t v = value & addr_mask;
+
+	if (addr_mask == 0xFFFFUL) {
+		v |= vcpu_get_gpreg(vcpu, reg) & ~addr_mask;
+	}
+	vcpu_set_gpreg(vcpu, reg, v);
+}
+
+/**
+ * @brief Emulate a (REP) INS/OUTS within one VM exit
+ *
+ * The one-element-per-exit path makes REP string I/O (e.g. an IDE probe
+ * loop doing REP INSW) pay a full exit round-trip per element. Here the
+ * whole rep count is moved within a single exit: hypervisor handled
+ * ports invoke their handler per element, DM backed ports still take one
+ * ioreq round-trip per element but no longer a VM exit each.
+ *
+ * Faults and the batching cap follow the architectural partial-progress
+ * model of REP: registers are updated for the elements completed so far
+ * and RIP is retained so the guest re-executes the instruction.
+ *
+ * @pre io_req->io_type == ACRN_IOREQ_TYPE_PORTIO
+ */
+static int32_t emulate_pio_string(struct acrn_vcpu *vcpu, struct io_request *io_req, uint64_t exit_qual)
+{
+	struct acrn_pio_request *pio_req = &io_req->reqs.pio_request;
+	uint32_t err_code, value;
+	uint64_t fault_addr, gva, count, addr_mask, done = 0UL;
+	int64_t step;
+	int32_t ret, status = 0;
+	bool is_in = (pio_req->direction == ACRN_IOREQ_DIR_READ);
+	bool rep = (vm_exit_io_instruction_is_rep_prefixed(exit_qual) != 0UL);
+	bool stop_early = false;
+	uint32_t str_reg = is_in ? CPU_REG_RDI : CPU_REG_RSI;
+
+	/* VMX instruction info bits 9:7: 0/1/2 = 16/32/64 bit addressing */
+	switch ((exec_vmread32(VMX_INSTR_INFO) >> 7U) & 0x7U) {
+	case 0U:
+		addr_mask = 0xFFFFUL;
+		break;
+	case 1U:
+		addr_mask = 0xFFFFFFFFUL;
+		break;
+	default:
+		addr_mask = ~0UL;
+		break;
+	}
+
+	count = 1UL;
+	if (rep) {
+		/* REP with a zero count is an architectural no-op */
+		count = vcpu_get_gpreg(vcpu, CPU_REG_RCX) & addr_mask;
+	}
+	if (count > PIO_STR_MAX_ELEMENTS) {
+		count = PIO_STR_MAX_ELEMENTS;
+		stop_early = true;
+	}
+
+	gva = exec_vmread(VMX_GUEST_LINEAR_ADDR);
+	step = ((vcpu_get_rflags(vcpu) & RFLAGS_DF) != 0UL) ?
+		-(int64_t)pio_req->size : (int64_t)pio_req->size;
+
+	while (done < count) {
+		io_req->io_type = ACRN_IOREQ_TYPE_PORTIO;
+		if (!is_in) {
+			value = 0U;
+			err_code = 0U;
+			ret = copy_from_gva(vcpu, &value, gva, (uint32_t)pio_req->size,
+				&err_code, &fault_addr);
+			if (ret < 0) {
+				if (ret == -EFAULT) {
+					vcpu_inject_pf(vcpu, fault_addr, err_code);
+				}
+				stop_early = true;
+				break;
+			}
+			pio_req->value = value;
+		}
+
+		status = emulate_io(vcpu, io_req);
+		if (status != 0) {
+			break;
+		}
+
+		if (is_in) {
+			value = pio_req->value;
+			err_code = PAGE_FAULT_WR_FLAG;
+			ret = copy_to_gva(vcpu, &value, gva, (uint32_t)pio_req->size,
+				&err_code, &fault_addr);
+			if (ret < 0) {
+				if (ret == -EFAULT) {
+					vcpu_inject_pf(vcpu, fault_addr, err_code);
+				}
+				stop_early = true;
+				break;
+			}
+		}
+
+		gva += (uint64_t)step;
+		done++;
+	}
+
+	if (done != 0UL) {
+		set_pio_string_gpreg(vcpu, str_reg,
+			vcpu_get_gpreg(vcpu, str_reg) + (done * (uint64_t)step), addr_mask);
+		if (rep) {
+			set_pio_string_gpreg(vcpu, CPU_REG_RCX,
+				vcpu_get_gpreg(vcpu, CPU_REG_RCX) - done, addr_mask);
+		}
+	}
+
+	if (stop_early && (status == 0)) {
+		vcpu_retain_rip(vcpu);
+	}
+
+	return status;
+}
+
 /**
  * @brief The handler of VM exits on I/O instructions
  *
@@ -75,12 +213,15 @@ int32_t pio_instr_vmexit_handler(struct acrn_vcpu *vcpu)
 	exit_qual = vcpu->arch.exit_qualification;
 
 	io_req->io_type = ACRN_IOREQ_TYPE_PORTIO;
+	io_req->is_pio_string = (vm_exit_io_instruction_is_string(exit_qual) != 0UL);
 	pio_req->size = vm_exit_io_instruction_size(exit_qual) + 1UL;
 	pio_req->address = vm_exit_io_instruction_port_number(exit_qual);
 	if (vm_exit_io_instruction_access_direction(exit_qual) == 0UL) {
-		mask = 0xFFFFFFFFU >> (32U - (8U * pio_req->size));
 		pio_req->direction = ACRN_IOREQ_DIR_WRITE;
-		pio_req->value = (uint32_t)vcpu_get_gpreg(vcpu, CPU_REG_RAX) & mask;
+		if (!io_req->is_pio_string) {
+			mask = 0xFFFFFFFFU >> (32U - (8U * pio_req->size));
+			pio_req->value = (uint32_t)vcpu_get_gpreg(vcpu, CPU_REG_RAX) & mask;
+		}
 	} else {
 		pio_req->direction = ACRN_IOREQ_DIR_READ;
 	}
@@ -91,11 +232,27 @@ int32_t pio_instr_vmexit_handler(struct acrn_vcpu *vcpu)
 		(uint32_t)pio_req->size,
 		(uint32_t)cur_context_idx);
 
-	status = emulate_io(vcpu, io_req);
+	if (io_req->is_pio_string) {
+		status = emulate_pio_string(vcpu, io_req, exit_qual);
+	} else {
+		status = emulate_io(vcpu, io_req);
+	}
 
 	return status;
 }
 
+/* one increment per fault in the bucket covering [2^n, 2^(n+1)) */
+static inline void ept_heatmap_count(uint64_t gpa, bool spurious)
+{
+	uint16_t bucket = (gpa != 0UL) ? fls64(gpa) : 0U;
+
+	if (spurious) {
+		get_cpu_var(ept_heatmap_spurious)[bucket]++;
+	} else {
+		get_cpu_var(ept_heatmap_mmio)[bucket]++;
+	}
+}
+
 int32_t ept_violation_vmexit_handler(struct acrn_vcpu *vcpu)
 {
 	int32_t status = -EINVAL, ret;
@@ -122,6 +279,7 @@ int32_t ept_violation_vmexit_handler(struct acrn_vcpu *vcpu)
 				gpa & PAGE_MASK, PAGE_SIZE, EPT_EXE, 0UL);
 		}
 		vcpu_retain_rip(vcpu);
+		ept_heatmap_count(gpa, true);
 		status = 0;
 	} else {
 
@@ -151,6 +309,7 @@ int32_t ept_violation_vmexit_handler(struct acrn_vcpu *vcpu)
 		mmio_req->address = gpa;
 
 		ret = decode_instruction(vcpu, true);
+		ept_heatmap_count(gpa, (ret <= 0));
 		if (ret > 0) {
 			mmio_req->size = (uint64_t)ret;
 			/*
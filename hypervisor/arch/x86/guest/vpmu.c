@@ -0,0 +1,534 @@
+/*
+ * ACRN virtual Performance Monitoring Unit.
+ *
+ * Emulates the architectural PMU (version 2) for VMs configured with
+ * GUEST_FLAG_VPMU, so in-guest profilers can program the fixed and
+ * general purpose counters without the raw passthrough that
+ * GUEST_FLAG_PMU_PASSTHROUGH grants to partitioned RTVMs.
+ *
+ * The guest-programmed counters are loaded into hardware while the vCPU
+ * runs and written back at context switch out. IA32_PERF_GLOBAL_CTRL is
+ * threaded through the VMX auto MSR load lists: the VM-entry list applies
+ * the guest value and the VM-exit list zeroes it again, so the counters
+ * only tick in non-root mode and never observe hypervisor execution.
+ * Overflow PMIs arrive at the hypervisor's PMI vector and are reflected
+ * into the guest through its LVT performance counter entry.
+ *
+ * The hypervisor's own sampling profiler multiplexes with guests by
+ * priority: when a profiling session claims the PMU, guest counters are
+ * parked (saved and frozen) and resume transparently when the session
+ * ends. While parked, a vPMU vCPU's VM-entries keep the global enable
+ * cleared, so the profiler does not observe the guest-mode execution of
+ * those vCPUs; everything else is sampled normally.
+ *
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <lib/util.h>
+#include <asm/cpuid.h>
+#include <asm/cpu_caps.h>
+#include <asm/cpufeatures.h>
+#include <asm/msr.h>
+#include <asm/irq.h>
+#include <asm/apicreg.h>
+#include <asm/per_cpu.h>
+#include <asm/guest/vcpu.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/vlapic.h>
+#include <asm/guest/vpmu.h>
+#include <irq.h>
+#include <logmsg.h>
+
+#define PERF_EVTSEL_ANY_THREAD		(1UL << 21U)
+/* per fixed counter nibble: ring enable bits + PMI, AnyThread reserved */
+#define VPMU_FIXED_CTRL_BITS		0xbUL
+#define PERF_CAP_FW_WRITE		(1UL << 13U)
+
+/* hardware capabilities, probed once on the BSP from CPUID leaf 0AH */
+static struct {
+	uint8_t version;
+	uint8_t num_gp_ctrs;
+	uint8_t gp_ctr_width;
+	uint8_t evt_vec_len;
+	uint8_t num_fixed_ctrs;
+	uint8_t fixed_ctr_width;
+	uint32_t events_mask;	/* CPUID.0AH:EBX, unavailable arch events */
+	bool full_width_wr;	/* IA32_A_PMCx writes supported */
+} vpmu_caps;
+
+/* the vCPU whose vPMU is bound to this pCPU between switch in and out */
+static struct acrn_vcpu *vpmu_bound_vcpu[MAX_PCPU_NUM];
+
+/* set per-pCPU while the hypervisor profiler owns the PMU hardware */
+static bool hv_owns_pmu[MAX_PCPU_NUM];
+
+static inline uint64_t vpmu_gp_ctr_mask(void)
+{
+	return (1UL << vpmu_caps.gp_ctr_width) - 1UL;
+}
+
+static inline uint64_t vpmu_fixed_ctr_mask(void)
+{
+	return (1UL << vpmu_caps.fixed_ctr_width) - 1UL;
+}
+
+/* valid bits of IA32_PERF_GLOBAL_CTRL/STATUS for the exposed counters */
+static inline uint64_t vpmu_global_bits(void)
+{
+	uint64_t gp = (1UL << vpmu_caps.num_gp_ctrs) - 1UL;
+	uint64_t fixed = (1UL << vpmu_caps.num_fixed_ctrs) - 1UL;
+
+	return gp | (fixed << 32U);
+}
+
+static inline uint64_t vpmu_fixed_ctrl_mask(void)
+{
+	uint64_t mask = 0UL;
+	uint32_t i;
+
+	for (i = 0U; i < vpmu_caps.num_fixed_ctrs; i++) {
+		mask |= VPMU_FIXED_CTRL_BITS << (i * 4U);
+	}
+
+	return mask;
+}
+
+bool is_vpmu_avail(void)
+{
+	return (vpmu_caps.version != 0U);
+}
+
+void vpmu_get_cpuid_0ah(uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	*eax = (uint32_t)vpmu_caps.version
+		| ((uint32_t)vpmu_caps.num_gp_ctrs << 8U)
+		| ((uint32_t)vpmu_caps.gp_ctr_width << 16U)
+		| ((uint32_t)vpmu_caps.evt_vec_len << 24U);
+	*ebx = vpmu_caps.events_mask;
+	*ecx = 0U;
+	*edx = (uint32_t)vpmu_caps.num_fixed_ctrs
+		| ((uint32_t)vpmu_caps.fixed_ctr_width << 5U);
+}
+
+/*
+ * Program the guest's counter state into hardware. The guest
+ * IA32_PERF_GLOBAL_CTRL goes through the VM-entry auto-load list rather
+ * than a direct write, so nothing counts until the next VM-entry.
+ */
+static void vpmu_load_hw(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	struct msr_store_area *area = &vcpu->arch.msr_area;
+	uint32_t i;
+
+	for (i = 0U; i < vpmu_caps.num_gp_ctrs; i++) {
+		msr_write(MSR_IA32_PERFEVTSEL0 + i, vpmu->evtsel[i]);
+		if (vpmu_caps.full_width_wr) {
+			msr_write(MSR_IA32_A_PMC0 + i, vpmu->gp_ctr[i]);
+		} else {
+			/* legacy counter writes sign-extend bit 31; the low
+			 * half is the best that can be restored
+			 */
+			msr_write(MSR_IA32_PMC0 + i, vpmu->gp_ctr[i] & 0x7fffffffUL);
+		}
+	}
+
+	for (i = 0U; i < vpmu_caps.num_fixed_ctrs; i++) {
+		msr_write(MSR_IA32_FIXED_CTR0 + i, vpmu->fixed_ctr[i] & 0x7fffffffUL);
+	}
+	msr_write(MSR_IA32_FIXED_CTR_CTL, vpmu->fixed_ctrl);
+
+	area->guest[area->index_of_perf_global_ctrl].value = vpmu->global_ctrl;
+
+	/* unmask the host LVT entry so overflows reach PMI_VECTOR */
+	msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR);
+
+	vpmu->hw_loaded = true;
+}
+
+/*
+ * Write the live counter values back into the vCPU's state and freeze
+ * them. The host side of the auto MSR lists already zeroed
+ * IA32_PERF_GLOBAL_CTRL at the last VM-exit, so the counters are not
+ * ticking here; zeroing the auto-load guest value keeps them off across
+ * the next VM-entry of this vCPU should it run before a reload.
+ */
+static void vpmu_save_hw(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	struct msr_store_area *area = &vcpu->arch.msr_area;
+	uint64_t ovf;
+	uint32_t i;
+
+	for (i = 0U; i < vpmu_caps.num_gp_ctrs; i++) {
+		vpmu->gp_ctr[i] = msr_read(MSR_IA32_PMC0 + i) & vpmu_gp_ctr_mask();
+	}
+	for (i = 0U; i < vpmu_caps.num_fixed_ctrs; i++) {
+		vpmu->fixed_ctr[i] = msr_read(MSR_IA32_FIXED_CTR0 + i) & vpmu_fixed_ctr_mask();
+	}
+
+	/* fold overflows that raced with the switch into the guest status */
+	ovf = msr_read(MSR_IA32_PERF_GLOBAL_STATUS) & vpmu_global_bits();
+	if (ovf != 0UL) {
+		vpmu->global_status |= ovf;
+		msr_write(MSR_IA32_PERF_GLOBAL_OVF_CTRL, ovf);
+	}
+
+	area->guest[area->index_of_perf_global_ctrl].value = 0UL;
+
+	msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR | APIC_LVT_M);
+
+	vpmu->hw_loaded = false;
+}
+
+void vpmu_switch_in(struct acrn_vcpu *vcpu)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+
+	if (is_vpmu_configured(vcpu->vm) && (vpmu_caps.version != 0U)) {
+		vpmu_bound_vcpu[pcpu_id] = vcpu;
+		/* IA32_PERF_GLOBAL_CTRL gates all exposed counters, so an
+		 * all-zero value means nothing would count: load lazily from
+		 * the wrmsr path instead of paying the MSR writes here
+		 */
+		if (!hv_owns_pmu[pcpu_id] && (vcpu->arch.vpmu.global_ctrl != 0UL)) {
+			vpmu_load_hw(vcpu);
+		}
+	}
+}
+
+void vpmu_switch_out(struct acrn_vcpu *vcpu)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+
+	if (vpmu_bound_vcpu[pcpu_id] == vcpu) {
+		if (vcpu->arch.vpmu.hw_loaded) {
+			vpmu_save_hw(vcpu);
+		}
+		vpmu_bound_vcpu[pcpu_id] = NULL;
+	}
+}
+
+void vpmu_hv_claim_pcpu(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	struct acrn_vcpu *vcpu = vpmu_bound_vcpu[pcpu_id];
+
+	hv_owns_pmu[pcpu_id] = true;
+	if ((vcpu != NULL) && vcpu->arch.vpmu.hw_loaded) {
+		vpmu_save_hw(vcpu);
+	}
+}
+
+void vpmu_hv_release_pcpu(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	struct acrn_vcpu *vcpu = vpmu_bound_vcpu[pcpu_id];
+
+	hv_owns_pmu[pcpu_id] = false;
+	if ((vcpu != NULL) && !vcpu->arch.vpmu.hw_loaded &&
+			(vcpu->arch.vpmu.global_ctrl != 0UL)) {
+		vpmu_load_hw(vcpu);
+	}
+}
+
+bool vpmu_handle_pmi(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	struct acrn_vcpu *vcpu = vpmu_bound_vcpu[pcpu_id];
+	bool handled = false;
+
+	if (!hv_owns_pmu[pcpu_id] && (vcpu != NULL) && vcpu->arch.vpmu.hw_loaded) {
+		uint64_t ovf = msr_read(MSR_IA32_PERF_GLOBAL_STATUS) & vpmu_global_bits();
+
+		if (ovf != 0UL) {
+			vcpu->arch.vpmu.global_status |= ovf;
+			msr_write(MSR_IA32_PERF_GLOBAL_OVF_CTRL, ovf);
+			/* the PMI set the LVT mask bit; re-arm for the next one */
+			msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR);
+			(void)vlapic_set_local_intr(vcpu->vm, vcpu->vcpu_id, APIC_LVT_PMC);
+			handled = true;
+		}
+	}
+
+	return handled;
+}
+
+/* write a general purpose counter, mirroring to hardware when loaded */
+static void vpmu_write_gp_ctr(struct acrn_vpmu *vpmu, uint32_t idx, uint64_t val)
+{
+	vpmu->gp_ctr[idx] = val & vpmu_gp_ctr_mask();
+	if (vpmu->hw_loaded) {
+		if (vpmu_caps.full_width_wr) {
+			msr_write(MSR_IA32_A_PMC0 + idx, vpmu->gp_ctr[idx]);
+		} else {
+			msr_write(MSR_IA32_PMC0 + idx, vpmu->gp_ctr[idx] & 0x7fffffffUL);
+		}
+	}
+}
+
+int32_t vpmu_rdmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t *rval)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	int32_t err = 0;
+	uint64_t v = 0UL;
+	uint32_t idx;
+
+	if (!is_vpmu_configured(vcpu->vm) || (vpmu_caps.version == 0U)) {
+		err = -EACCES;
+	} else {
+		switch (msr) {
+		case MSR_IA32_PMC0 ... (MSR_IA32_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+		case MSR_IA32_A_PMC0 ... (MSR_IA32_A_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+		{
+			idx = (msr >= MSR_IA32_A_PMC0) ? (msr - MSR_IA32_A_PMC0) : (msr - MSR_IA32_PMC0);
+			if (idx < vpmu_caps.num_gp_ctrs) {
+				v = vpmu->hw_loaded ?
+					(msr_read(MSR_IA32_PMC0 + idx) & vpmu_gp_ctr_mask()) :
+					vpmu->gp_ctr[idx];
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_PERFEVTSEL0 ... (MSR_IA32_PERFEVTSEL0 + VPMU_NUM_GP_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_PERFEVTSEL0;
+			if (idx < vpmu_caps.num_gp_ctrs) {
+				v = vpmu->evtsel[idx];
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_FIXED_CTR0 ... (MSR_IA32_FIXED_CTR0 + VPMU_NUM_FIXED_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_FIXED_CTR0;
+			if (idx < vpmu_caps.num_fixed_ctrs) {
+				v = vpmu->hw_loaded ?
+					(msr_read(MSR_IA32_FIXED_CTR0 + idx) & vpmu_fixed_ctr_mask()) :
+					vpmu->fixed_ctr[idx];
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_FIXED_CTR_CTL:
+		{
+			v = vpmu->fixed_ctrl;
+			break;
+		}
+		case MSR_IA32_PERF_GLOBAL_CTRL:
+		{
+			v = vpmu->global_ctrl;
+			break;
+		}
+		case MSR_IA32_PERF_GLOBAL_STATUS:
+		{
+			v = vpmu->global_status;
+			if (vpmu->hw_loaded) {
+				v |= msr_read(MSR_IA32_PERF_GLOBAL_STATUS) & vpmu_global_bits();
+			}
+			break;
+		}
+		case MSR_IA32_PERF_GLOBAL_OVF_CTRL:
+		{
+			v = 0UL;
+			break;
+		}
+		default:
+		{
+			err = -EACCES;
+			break;
+		}
+		}
+	}
+
+	*rval = v;
+
+	return err;
+}
+
+int32_t vpmu_wrmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t wval)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	struct msr_store_area *area = &vcpu->arch.msr_area;
+	int32_t err = 0;
+	uint32_t idx;
+
+	if (!is_vpmu_configured(vcpu->vm) || (vpmu_caps.version == 0U)) {
+		err = -EACCES;
+	} else {
+		switch (msr) {
+		case MSR_IA32_PMC0 ... (MSR_IA32_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_PMC0;
+			if (idx < vpmu_caps.num_gp_ctrs) {
+				/* legacy counter writes sign-extend bit 31 */
+				uint64_t v = wval & 0xffffffffUL;
+
+				if ((v & 0x80000000UL) != 0UL) {
+					v |= ~0xffffffffUL;
+				}
+				vpmu_write_gp_ctr(vpmu, idx, v);
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_A_PMC0 ... (MSR_IA32_A_PMC0 + VPMU_NUM_GP_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_A_PMC0;
+			if (idx < vpmu_caps.num_gp_ctrs) {
+				vpmu_write_gp_ctr(vpmu, idx, wval);
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_PERFEVTSEL0 ... (MSR_IA32_PERFEVTSEL0 + VPMU_NUM_GP_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_PERFEVTSEL0;
+			if ((idx >= vpmu_caps.num_gp_ctrs) || ((wval & ~0xffffffffUL) != 0UL)) {
+				err = -EACCES;
+			} else {
+				/* AnyThread would count sibling hyperthreads
+				 * that may belong to other VMs; strip it
+				 */
+				vpmu->evtsel[idx] = wval & ~PERF_EVTSEL_ANY_THREAD;
+				if (vpmu->hw_loaded) {
+					msr_write(MSR_IA32_PERFEVTSEL0 + idx, vpmu->evtsel[idx]);
+				}
+			}
+			break;
+		}
+		case MSR_IA32_FIXED_CTR0 ... (MSR_IA32_FIXED_CTR0 + VPMU_NUM_FIXED_CTRS - 1U):
+		{
+			idx = msr - MSR_IA32_FIXED_CTR0;
+			if (idx < vpmu_caps.num_fixed_ctrs) {
+				vpmu->fixed_ctr[idx] = wval & vpmu_fixed_ctr_mask();
+				if (vpmu->hw_loaded) {
+					msr_write(MSR_IA32_FIXED_CTR0 + idx,
+						vpmu->fixed_ctr[idx] & 0x7fffffffUL);
+				}
+			} else {
+				err = -EACCES;
+			}
+			break;
+		}
+		case MSR_IA32_FIXED_CTR_CTL:
+		{
+			if ((wval & ~vpmu_fixed_ctrl_mask()) != 0UL) {
+				err = -EACCES;
+			} else {
+				vpmu->fixed_ctrl = wval;
+				if (vpmu->hw_loaded) {
+					msr_write(MSR_IA32_FIXED_CTR_CTL, wval);
+				}
+			}
+			break;
+		}
+		case MSR_IA32_PERF_GLOBAL_CTRL:
+		{
+			if ((wval & ~vpmu_global_bits()) != 0UL) {
+				err = -EACCES;
+			} else {
+				vpmu->global_ctrl = wval;
+				if (vpmu->hw_loaded) {
+					area->guest[area->index_of_perf_global_ctrl].value = wval;
+				} else if (!hv_owns_pmu[get_pcpu_id()] && (wval != 0UL)) {
+					/* first enable after a lazy switch in */
+					vpmu_load_hw(vcpu);
+				} else {
+					/* parked: applied when the profiler lets go */
+				}
+			}
+			break;
+		}
+		case MSR_IA32_PERF_GLOBAL_OVF_CTRL:
+		{
+			if ((wval & ~vpmu_global_bits()) != 0UL) {
+				err = -EACCES;
+			} else {
+				vpmu->global_status &= ~wval;
+				if (vpmu->hw_loaded) {
+					msr_write(MSR_IA32_PERF_GLOBAL_OVF_CTRL, wval);
+				}
+			}
+			break;
+		}
+		default:
+		{
+			/* MSR_IA32_PERF_GLOBAL_STATUS and the rest are read-only
+			 * or not virtualized
+			 */
+			err = -EACCES;
+			break;
+		}
+		}
+	}
+
+	return err;
+}
+
+#ifndef PROFILING_ON
+static uint32_t vpmu_pmi_irq = IRQ_INVALID;
+
+static void vpmu_pmi_handler(__unused uint32_t irq, __unused void *data)
+{
+	if (!vpmu_handle_pmi()) {
+		/* stray overflow with no guest owner: quiesce the hardware */
+		msr_write(MSR_IA32_PERF_GLOBAL_OVF_CTRL,
+			msr_read(MSR_IA32_PERF_GLOBAL_STATUS));
+	}
+}
+#endif
+
+/* pcpu_id is only consulted when this build owns the PMI irq line */
+void vpmu_setup(__unused uint16_t pcpu_id)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	/* the probe runs on every pCPU rather than only the BSP: an AP may
+	 * reach launch_vms() and build a vPMU guest's CPUID leaves before the
+	 * BSP gets here, and the PMU enumeration is identical on all cores so
+	 * the redundant writes are benign
+	 */
+	cpuid_subleaf(0x0aU, 0U, &eax, &ebx, &ecx, &edx);
+	if ((eax & 0xffU) >= 2U) {
+		/* expose version 2: global control/status plus the fixed
+		 * counters, which is what guest perf tools need
+		 */
+		vpmu_caps.version = 2U;
+		vpmu_caps.num_gp_ctrs = (uint8_t)min((eax >> 8U) & 0xffU, VPMU_NUM_GP_CTRS);
+		vpmu_caps.gp_ctr_width = (uint8_t)((eax >> 16U) & 0xffU);
+		vpmu_caps.evt_vec_len = (uint8_t)((eax >> 24U) & 0xffU);
+		vpmu_caps.events_mask = ebx;
+		vpmu_caps.num_fixed_ctrs = (uint8_t)min(edx & 0x1fU, VPMU_NUM_FIXED_CTRS);
+		vpmu_caps.fixed_ctr_width = (uint8_t)((edx >> 5U) & 0xffU);
+		if (pcpu_has_cap(X86_FEATURE_PDCM)) {
+			vpmu_caps.full_width_wr =
+				((msr_read(MSR_IA32_PERF_CAPABILITIES) & PERF_CAP_FW_WRITE) != 0UL);
+		}
+
+#ifndef PROFILING_ON
+		/* with PROFILING_ON the profiler owns PMI_IRQ and forwards
+		 * guest-owned PMIs to vpmu_handle_pmi()
+		 */
+		if ((pcpu_id == BSP_CPU_ID) && (vpmu_pmi_irq == IRQ_INVALID)) {
+			int32_t retval = request_irq(PMI_IRQ, vpmu_pmi_handler, NULL, IRQF_NONE);
+
+			if (retval < 0) {
+				pr_err("%s: failed to add PMI isr", __func__);
+				vpmu_caps.version = 0U;
+			} else {
+				vpmu_pmi_irq = (uint32_t)retval;
+			}
+		}
+#endif
+	}
+}
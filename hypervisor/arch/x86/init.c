@@ -11,10 +11,12 @@
 #include <shell.h>
 #include <asm/vmx.h>
 #include <asm/guest/vm.h>
+#include <asm/guest/vpmu.h>
 #include <logmsg.h>
 #include <asm/seed.h>
 #include <asm/boot/ld_sym.h>
 #include <boot.h>
+#include <trace.h>
 
 /* boot_regs store the multiboot info magic and address, defined in
    arch/x86/boot/cpu_primary.S.
@@ -48,6 +50,8 @@ static void init_debug_post(uint16_t pcpu_id)
 		/* Initialize the shell */
 		shell_init();
 		console_setup_timer();
+
+		init_flight_recorder();
 	}
 
 	profiling_setup();
@@ -58,6 +62,8 @@ static void init_guest_mode(uint16_t pcpu_id)
 {
 	vmx_on();
 
+	vpmu_setup(pcpu_id);
+
 	launch_vms(pcpu_id);
 }
 
@@ -23,6 +23,17 @@ static struct x86_irq_data irq_data[NR_IRQS];
 
 static uint32_t vector_to_irq[NR_MAX_VECTOR + 1];
 
+/* descriptors handed over by the generic layer in init_irq_descs_arch() */
+static struct irq_desc *irq_descs_base;
+
+/*
+ * Generation of the registration state mirrored by the per-pCPU dispatch
+ * tables. Bumped whenever an irq action, trigger mode or vector binding
+ * changes; a pCPU whose private generation lags rebuilds its snapshot on
+ * the next interrupt it takes.
+ */
+static uint64_t irq_disp_generation = 1UL;
+
 typedef void (*spurious_handler_t)(uint32_t vector);
 
 spurious_handler_t spurious_handler;
@@ -148,24 +159,24 @@ static void handle_spurious_interrupt(uint32_t vector)
 	}
 }
 
-static inline bool irq_need_mask(const struct irq_desc *desc)
+static inline bool irq_need_mask(uint32_t irq, uint32_t flags)
 {
 	/* level triggered gsi should be masked */
-	return (((desc->flags & IRQF_LEVEL) != 0U)
-		&& is_ioapic_irq(desc->irq));
+	return (((flags & IRQF_LEVEL) != 0U)
+		&& is_ioapic_irq(irq));
 }
 
-static inline bool irq_need_unmask(const struct irq_desc *desc)
+static inline bool irq_need_unmask(uint32_t irq, uint32_t flags)
 {
 	/* level triggered gsi for non-ptdev should be unmasked */
-	return (((desc->flags & IRQF_LEVEL) != 0U)
-		&& ((desc->flags & IRQF_PT) == 0U)
-		&& is_ioapic_irq(desc->irq));
+	return (((flags & IRQF_LEVEL) != 0U)
+		&& ((flags & IRQF_PT) == 0U)
+		&& is_ioapic_irq(irq));
 }
 
 void pre_irq_arch(const struct irq_desc *desc)
 {
-	if (irq_need_mask(desc))  {
+	if (irq_need_mask(desc->irq, desc->flags))  {
 		ioapic_gsi_mask_irq(desc->irq);
 	}
 
@@ -175,38 +186,125 @@ void pre_irq_arch(const struct irq_desc *desc)
 
 void post_irq_arch(const struct irq_desc *desc)
 {
-	if (irq_need_unmask(desc)) {
+	if (irq_need_unmask(desc->irq, desc->flags)) {
 		ioapic_gsi_unmask_irq(desc->irq);
 	}
 }
 
+void sync_irq_dispatch_arch(void)
+{
+	uint64_t rflags;
+
+	spinlock_irqsave_obtain(&x86_irq_spinlock, &rflags);
+	irq_disp_generation++;
+	spinlock_irqrestore_release(&x86_irq_spinlock, rflags);
+}
+
+/*
+ * Rebuild this pCPU's private dispatch table from the shared registration
+ * state. The shared arrays are read lockless, same as the existing lockless
+ * use of irq_alloc_bitmap in do_irq(): the generation is sampled before the
+ * copy, so a registration change racing with the copy leaves the stored
+ * generation stale and forces another rebuild on the next interrupt.
+ */
+static void build_irq_dispatch_table(uint16_t pcpu_id)
+{
+	struct irq_dispatch_entry *tbl = per_cpu(irq_disp_table, pcpu_id);
+	uint64_t gen = irq_disp_generation;
+	uint32_t vr;
+
+	for (vr = 0U; vr <= NR_MAX_VECTOR; vr++) {
+		struct irq_dispatch_entry *ent = &tbl[vr];
+		uint32_t irq = vector_to_irq[vr];
+
+		if ((irq < NR_IRQS) && (irq_data[irq].vector == vr)) {
+			const struct irq_desc *desc = &irq_descs_base[irq];
+
+			ent->irq = irq;
+			ent->flags = desc->flags;
+			ent->action = desc->action;
+			ent->priv_data = desc->priv_data;
+		} else {
+			ent->irq = IRQ_INVALID;
+			ent->flags = IRQF_NONE;
+			ent->action = NULL;
+			ent->priv_data = NULL;
+		}
+	}
+
+	per_cpu(irq_disp_gen, pcpu_id) = gen;
+}
+
 void dispatch_interrupt(const struct intr_excp_ctx *ctx)
 {
+	uint16_t pcpu_id = get_pcpu_id();
 	uint32_t vr = ctx->vector;
-	uint32_t irq = vector_to_irq[vr];
-	struct x86_irq_data *irqd;
 
-	/* The value from vector_to_irq[] must be:
-	 * IRQ_INVALID, which means the vector is not allocated;
-	 * or
-	 * < NR_IRQS, which is the irq number it bound with;
-	 * Any other value means there is something wrong.
-	 */
-	if (irq < NR_IRQS) {
-		irqd = &irq_data[irq];
+	if (per_cpu(irq_disp_gen, pcpu_id) != irq_disp_generation) {
+		/* Registration state changed since the last rebuild: take the
+		 * generic shared-descriptor path once, then refresh the
+		 * private snapshot for subsequent interrupts.
+		 */
+		uint32_t irq = vector_to_irq[vr];
+
+		/* The value from vector_to_irq[] must be:
+		 * IRQ_INVALID, which means the vector is not allocated;
+		 * or
+		 * < NR_IRQS, which is the irq number it bound with;
+		 * Any other value means there is something wrong.
+		 */
+		if (irq < NR_IRQS) {
+			struct x86_irq_data *irqd = &irq_data[irq];
+
+			if (vr == irqd->vector) {
+#ifdef PROFILING_ON
+				/* Saves ctx info into irq_desc */
+				irqd->ctx_rip = ctx->rip;
+				irqd->ctx_rflags = ctx->rflags;
+				irqd->ctx_cs = ctx->cs;
+#endif
+				/* Call the generic IRQ handling routine */
+				do_irq(irq);
+			}
+		} else {
+			handle_spurious_interrupt(vr);
+		}
 
-		if (vr == irqd->vector) {
+		build_irq_dispatch_table(pcpu_id);
+	} else {
+		const struct irq_dispatch_entry *ent =
+			&per_cpu(irq_disp_table, pcpu_id)[vr];
+
+		if (ent->irq < NR_IRQS) {
 #ifdef PROFILING_ON
+			struct x86_irq_data *irqd = &irq_data[ent->irq];
+
 			/* Saves ctx info into irq_desc */
 			irqd->ctx_rip = ctx->rip;
 			irqd->ctx_rflags = ctx->rflags;
 			irqd->ctx_cs = ctx->cs;
 #endif
-			/* Call the generic IRQ handling routine */
-			do_irq(irq);
+			per_cpu(irq_count, pcpu_id)[ent->irq]++;
+
+			if (irq_need_mask(ent->irq, ent->flags)) {
+				ioapic_gsi_mask_irq(ent->irq);
+			}
+
+			/* Send EOI to LAPIC/IOAPIC IRR */
+			send_lapic_eoi();
+
+			if (ent->action != NULL) {
+				ent->action(ent->irq, ent->priv_data);
+			}
+
+			if (irq_need_unmask(ent->irq, ent->flags)) {
+				ioapic_gsi_unmask_irq(ent->irq);
+			}
+
+			do_softirq();
+		} else {
+			handle_spurious_interrupt(vr);
 		}
-	} else {
-		handle_spurious_interrupt(vr);
 	}
 }
 
@@ -217,6 +315,8 @@ void init_irq_descs_arch(struct irq_desc descs[])
 {
 	uint32_t i;
 
+	irq_descs_base = descs;
+
 	/*
 	 * Fill in #CONFIG_MAX_VM_NUM posted interrupt specific irq and vector pairs
 	 * at runtime
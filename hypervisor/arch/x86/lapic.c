@@ -40,6 +40,9 @@
 #define INTR_LAPIC_ICR_ALL_INC_SELF    0x2U
 #define INTR_LAPIC_ICR_ALL_EX_SELF     0x3U
 
+/* x2APIC logical destination: upper half cluster id, lower half member bitmap */
+#define X2APIC_LDR_CLUSTER_ID_MASK     0xFFFF0000U
+
 union lapic_base_msr {
 	uint64_t value;
 	struct {
@@ -241,13 +244,44 @@ send_startup_ipi(uint16_t dest_pcpu_id, uint64_t cpu_startup_start_address)
 
 void send_dest_ipi_mask(uint32_t dest_mask, uint32_t vector)
 {
-	uint16_t pcpu_id;
+	union apic_icr icr;
+	uint16_t pcpu_id, i;
 	uint32_t mask = dest_mask;
+	uint32_t others, cluster_id, logical_dest;
 
+	/*
+	 * One logical-mode ICR write reaches every target pCPU within the
+	 * same x2APIC cluster: the destination is the cluster id plus the
+	 * OR of the per-CPU logical ids, as cached at lapic init. This cuts
+	 * an N-target IPI (e.g. an EPT shootdown) to one ICR write per
+	 * cluster of 16 cores instead of one per core.
+	 */
 	pcpu_id = ffs64(mask);
 	while (pcpu_id < MAX_PCPU_NUM) {
 		bitmap32_clear_nolock(pcpu_id, &mask);
-		send_single_ipi(pcpu_id, vector);
+		if (is_pcpu_active(pcpu_id)) {
+			logical_dest = per_cpu(lapic_ldr, pcpu_id);
+			cluster_id = logical_dest & X2APIC_LDR_CLUSTER_ID_MASK;
+
+			/* fold the remaining targets of this cluster in */
+			others = mask;
+			i = ffs64(others);
+			while (i < MAX_PCPU_NUM) {
+				bitmap32_clear_nolock(i, &others);
+				if (is_pcpu_active(i) &&
+					((per_cpu(lapic_ldr, i) & X2APIC_LDR_CLUSTER_ID_MASK) == cluster_id)) {
+					logical_dest |= per_cpu(lapic_ldr, i);
+					bitmap32_clear_nolock(i, &mask);
+				}
+				i = ffs64(others);
+			}
+
+			icr.value_32.hi_32 = logical_dest;
+			icr.value_32.lo_32 = vector | (INTR_LAPIC_ICR_LOGICAL << 11U);
+			msr_write(MSR_IA32_EXT_APIC_ICR, icr.value);
+		} else {
+			pr_err("pcpu_id %d not in active!", pcpu_id);
+		}
 		pcpu_id = ffs64(mask);
 	}
 }
@@ -3,6 +3,7 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 #include <types.h>
+#include <util.h>
 
 static inline void memset_erms(void *base, uint8_t v, size_t n)
 {
@@ -24,6 +25,51 @@ void *memset(void *base, uint8_t v, size_t n)
 	return base;
 }
 
+/*
+ * Fill memory with non-temporal stores, bypassing the caches. Intended
+ * for bulk ranges (guest RAM scrubbing) that won't be touched again
+ * soon, so the scrub doesn't evict the working set of the other pCPUs.
+ * Unaligned head and tail bytes fall back to regular stores.
+ */
+void *memset_nt(void *base, uint8_t v, size_t n)
+{
+	uint8_t *p = (uint8_t *)base;
+	size_t left = n;
+	size_t head, bulk;
+	uint64_t v64 = v * 0x0101010101010101UL;
+
+	if ((base != NULL) && (n != 0U)) {
+		head = ((uint64_t)p & 7UL);
+		if (head != 0UL) {
+			head = min(8UL - head, left);
+			memset_erms(p, v, head);
+			p += head;
+			left -= head;
+		}
+
+		bulk = left & ~7UL;
+		if (bulk != 0UL) {
+			size_t cnt = bulk;
+
+			asm volatile ("1: movnti %2, (%0)\n"
+					"   add $8, %0\n"
+					"   sub $8, %1\n"
+					"   jnz 1b\n"
+					"   sfence\n"
+					: "+r"(p), "+r"(cnt)
+					: "r"(v64)
+					: "memory");
+			left -= bulk;
+		}
+
+		if (left != 0UL) {
+			memset_erms(p, v, left);
+		}
+	}
+
+	return base;
+}
+
 static inline void memcpy_erms(void *d, const void *s, size_t slen)
 {
 	asm volatile ("rep; movsb"
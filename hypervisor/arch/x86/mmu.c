@@ -151,8 +151,11 @@ void enable_paging(void)
 {
 	uint64_t tmp64 = 0UL;
 
-	/* Initialize IA32_PAT according to ISDM 11.12.4 Programming the PAT */
-	msr_write(MSR_IA32_PAT, PAT_POWER_ON_VALUE);
+	/* Initialize IA32_PAT according to ISDM 11.12.4 Programming the PAT.
+	 * The host layout differs from the power-on value only in entry 1,
+	 * which provides WC for producer-only shared buffer mappings.
+	 */
+	msr_write(MSR_IA32_PAT, PAT_HOST_VALUE);
 
 	/*
 	 * Enable MSR IA32_EFER.NXE bit,to prevent
@@ -231,6 +234,35 @@ void set_paging_x(uint64_t base, uint64_t size)
 		base_aligned, size_aligned, 0UL, PAGE_NX, &ppt_pgtable, MR_MODIFY);
 }
 
+/*
+ * Remap [base, base + size) write-combining in the hypervisor page
+ * tables, at 4-KByte granularity. Hypervisor stores to the range then
+ * go through the WC buffers instead of allocating cache lines, so
+ * streaming writers (the trace/log sbufs) stop evicting LLC lines that
+ * belong to other cache partitions. The caller is responsible for
+ * flushing stale TLB entries on every pCPU that touches the range.
+ */
+void set_paging_wc(uint64_t base, uint64_t size)
+{
+	uint64_t region_end = base + size;
+	uint64_t base_aligned = round_page_down(base);
+	uint64_t size_aligned = round_page_up(region_end) - base_aligned;
+
+	pgtable_modify_or_del_map((uint64_t *)ppt_mmu_pml4_addr,
+		base_aligned, size_aligned, PAGE_CACHE_WC, PAGE_CACHE_MASK, &ppt_pgtable, MR_MODIFY);
+}
+
+/* Restore the default write-back attribute on [base, base + size). */
+void set_paging_wb(uint64_t base, uint64_t size)
+{
+	uint64_t region_end = base + size;
+	uint64_t base_aligned = round_page_down(base);
+	uint64_t size_aligned = round_page_up(region_end) - base_aligned;
+
+	pgtable_modify_or_del_map((uint64_t *)ppt_mmu_pml4_addr,
+		base_aligned, size_aligned, PAGE_CACHE_WB, PAGE_CACHE_MASK, &ppt_pgtable, MR_MODIFY);
+}
+
 void allocate_ppt_pages(void)
 {
        uint64_t page_base;
@@ -240,7 +272,11 @@ void allocate_ppt_pages(void)
 
        ppt_page_pool.start_page = (struct page *)(void *)page_base;
        ppt_page_pool.bitmap_size = get_ppt_page_num() / 64;
+       ppt_page_pool.summary = (uint64_t *)e820_alloc_memory(
+               PAGE_POOL_SUMMARY_SIZE(ppt_page_pool.bitmap_size) * sizeof(uint64_t), MEM_4G);
+       page_pool_init_summary(&ppt_page_pool);
        ppt_page_pool.dummy_page = NULL;
+       register_page_pool("ppt", 0U, &ppt_page_pool);
 }
 
 void init_paging(void)
@@ -6,25 +6,82 @@
 #include <types.h>
 #include <asm/lib/bits.h>
 #include <asm/page.h>
+#include <asm/vm_config.h>
 #include <logmsg.h>
 
 
+#define BITMAP_WORD_FULL	(~0UL)
+
+/**
+ * @brief Initialize the optional summary level of a pool's bitmap
+ *
+ * Must be called after bitmap/bitmap_size/summary are set and the leaf
+ * bitmap has been cleared. Summary bits behind the last leaf word do not
+ * back any pages and are marked permanently full so the scan never
+ * selects them.
+ */
+void page_pool_init_summary(struct page_pool *pool)
+{
+	uint64_t idx, summary_bits;
+
+	summary_bits = PAGE_POOL_SUMMARY_SIZE(pool->bitmap_size) << 6U;
+	(void)memset(pool->summary, 0U,
+		PAGE_POOL_SUMMARY_SIZE(pool->bitmap_size) * sizeof(uint64_t));
+	for (idx = pool->bitmap_size; idx < summary_bits; idx++) {
+		bitmap_set_nolock((uint16_t)(idx & 0x3fUL), pool->summary + (idx >> 6U));
+	}
+}
+
+/* caller holds pool->lock; mark page (idx << 6U) + bit allocated and
+ * propagate a newly filled leaf word into the summary */
+static void page_pool_set_used(struct page_pool *pool, uint64_t idx, uint64_t bit)
+{
+	bitmap_set_nolock((uint16_t)bit, pool->bitmap + idx);
+	if ((pool->summary != NULL) && (*(pool->bitmap + idx) == BITMAP_WORD_FULL)) {
+		bitmap_set_nolock((uint16_t)(idx & 0x3fUL), pool->summary + (idx >> 6U));
+	}
+	pool->used_pages++;
+	if (pool->used_pages > pool->max_used_pages) {
+		pool->max_used_pages = pool->used_pages;
+	}
+}
+
 struct page *alloc_page(struct page_pool *pool)
 {
 	struct page *page = NULL;
 	uint64_t loop_idx, idx, bit;
 
 	spinlock_obtain(&pool->lock);
-	for (loop_idx = pool->last_hint_id;
-		loop_idx < (pool->last_hint_id + pool->bitmap_size); loop_idx++) {
-		idx = loop_idx % pool->bitmap_size;
-		if (*(pool->bitmap + idx) != ~0UL) {
-			bit = ffz64(*(pool->bitmap + idx));
-			bitmap_set_nolock(bit, pool->bitmap + idx);
-			page = pool->start_page + ((idx << 6U) + bit);
-
-			pool->last_hint_id = idx;
-			break;
+	if (pool->summary != NULL) {
+		/* two-level scan: find the first not-full leaf word through
+		 * the summary, starting at the word the pool cursor points
+		 * to so sequential bursts keep their locality */
+		uint64_t summary_nr = PAGE_POOL_SUMMARY_SIZE(pool->bitmap_size);
+		uint64_t start = pool->last_hint_id >> 6U;
+		uint64_t sum_idx;
+
+		for (loop_idx = 0UL; loop_idx < summary_nr; loop_idx++) {
+			sum_idx = (start + loop_idx) % summary_nr;
+			if (*(pool->summary + sum_idx) != BITMAP_WORD_FULL) {
+				idx = (sum_idx << 6U) + ffz64(*(pool->summary + sum_idx));
+				bit = ffz64(*(pool->bitmap + idx));
+				page = pool->start_page + ((idx << 6U) + bit);
+				page_pool_set_used(pool, idx, bit);
+				pool->last_hint_id = idx;
+				break;
+			}
+		}
+	} else {
+		for (loop_idx = pool->last_hint_id;
+			loop_idx < (pool->last_hint_id + pool->bitmap_size); loop_idx++) {
+			idx = loop_idx % pool->bitmap_size;
+			if (*(pool->bitmap + idx) != BITMAP_WORD_FULL) {
+				bit = ffz64(*(pool->bitmap + idx));
+				page = pool->start_page + ((idx << 6U) + bit);
+				page_pool_set_used(pool, idx, bit);
+				pool->last_hint_id = idx;
+				break;
+			}
 		}
 	}
 	spinlock_release(&pool->lock);
@@ -44,6 +101,65 @@ struct page *alloc_page(struct page_pool *pool)
 	return page;
 }
 
+/**
+ * @brief Allocate a run of physically contiguous pages in one scan
+ *
+ * Built for bulk consumers like pagetable construction, where grabbing
+ * the run once is cheaper than re-scanning the pool per page. Full leaf
+ * words (and, through the summary, full groups of 64 leaf words) are
+ * skipped in one step.
+ *
+ * @return base of the zeroed run, or NULL when no run of @page_num free
+ *	   pages exists; callers fall back to single-page allocation
+ */
+struct page *alloc_pages_contiguous(struct page_pool *pool, uint64_t page_num)
+{
+	struct page *page = NULL;
+	uint64_t total = pool->bitmap_size << 6U;
+	uint64_t i = 0UL, j, idx;
+	uint64_t run_start = 0UL, run_len = 0UL;
+
+	spinlock_obtain(&pool->lock);
+	while ((i < total) && (page == NULL)) {
+		idx = i >> 6U;
+		if ((i & 0x3fUL) == 0UL) {
+			if ((pool->summary != NULL) && ((idx & 0x3fUL) == 0UL) &&
+				(*(pool->summary + (idx >> 6U)) == BITMAP_WORD_FULL)) {
+				run_len = 0UL;
+				i += (64UL << 6U);
+				continue;
+			}
+			if (*(pool->bitmap + idx) == BITMAP_WORD_FULL) {
+				run_len = 0UL;
+				i += 64UL;
+				continue;
+			}
+		}
+		if (bitmap_test((uint16_t)(i & 0x3fUL), pool->bitmap + idx)) {
+			run_len = 0UL;
+		} else {
+			if (run_len == 0UL) {
+				run_start = i;
+			}
+			run_len++;
+			if (run_len == page_num) {
+				for (j = run_start; j <= i; j++) {
+					page_pool_set_used(pool, j >> 6U, j & 0x3fUL);
+				}
+				page = pool->start_page + run_start;
+				pool->last_hint_id = run_start >> 6U;
+			}
+		}
+		i++;
+	}
+	spinlock_release(&pool->lock);
+
+	if (page != NULL) {
+		(void)memset(page, 0U, page_num * PAGE_SIZE);
+	}
+	return page;
+}
+
 /*
  *@pre: ((page - pool->start_page) >> 6U) < pool->bitmap_size
  */
@@ -55,5 +171,72 @@ void free_page(struct page_pool *pool, struct page *page)
 	idx = (page - pool->start_page) >> 6U;
 	bit = (page - pool->start_page) & 0x3fUL;
 	bitmap_clear_nolock(bit, pool->bitmap + idx);
+	if (pool->summary != NULL) {
+		bitmap_clear_nolock((uint16_t)(idx & 0x3fUL), pool->summary + (idx >> 6U));
+	}
+	pool->used_pages--;
+	spinlock_release(&pool->lock);
+}
+
+void free_pages(struct page_pool *pool, struct page *page, uint64_t page_num)
+{
+	uint64_t i;
+
+	for (i = 0UL; i < page_num; i++) {
+		free_page(pool, page + i);
+	}
+}
+
+/* every pool registers itself at init so utilization can be audited at
+ * runtime; ppt + sept + one EPT pool per VM bounds the table */
+#define PAGE_POOL_REG_NR	(CONFIG_MAX_VM_NUM + 2U)
+
+static struct {
+	const char *name;
+	uint16_t id;
+	struct page_pool *pool;
+} page_pool_registry[PAGE_POOL_REG_NR];
+static uint32_t page_pool_reg_nr;
+
+void register_page_pool(const char *name, uint16_t id, struct page_pool *pool)
+{
+	uint32_t i;
+	bool found = false;
+
+	/* per-VM pools re-run their init on VM re-creation */
+	for (i = 0U; i < page_pool_reg_nr; i++) {
+		if (page_pool_registry[i].pool == pool) {
+			found = true;
+			break;
+		}
+	}
+
+	if (!found && (page_pool_reg_nr < PAGE_POOL_REG_NR)) {
+		page_pool_registry[page_pool_reg_nr].name = name;
+		page_pool_registry[page_pool_reg_nr].id = id;
+		page_pool_registry[page_pool_reg_nr].pool = pool;
+		page_pool_reg_nr++;
+	}
+}
+
+uint32_t get_page_pool_nr(void)
+{
+	return page_pool_reg_nr;
+}
+
+/**
+ * @pre idx < get_page_pool_nr()
+ * @pre info != NULL
+ */
+void get_page_pool_info(uint32_t idx, struct page_pool_info *info)
+{
+	struct page_pool *pool = page_pool_registry[idx].pool;
+
+	info->name = page_pool_registry[idx].name;
+	info->id = page_pool_registry[idx].id;
+	spinlock_obtain(&pool->lock);
+	info->total_pages = pool->bitmap_size << 6U;
+	info->used_pages = pool->used_pages;
+	info->max_used_pages = pool->max_used_pages;
 	spinlock_release(&pool->lock);
 }
@@ -477,12 +477,22 @@ void *pgtable_create_trusty_root(const struct pgtable *table,
 	 * Normal World.PD/PT are shared in both Secure world's EPT
 	 * and Normal World's EPT
 	 */
-	pml4_base = pgtable_create_root(table);
-
-	/* The trusty memory is remapped to guest physical address
-	 * of gpa_rebased to gpa_rebased + size
+	/* The two top-level tables are always consumed together: grab them
+	 * in one pool scan, falling back to single-page allocation when
+	 * the pool holds no adjacent pair anymore.
 	 */
-	sub_table_addr = alloc_page(table->pool);
+	pml4_base = (void *)alloc_pages_contiguous(table->pool, 2UL);
+	if (pml4_base != NULL) {
+		sanitize_pte((uint64_t *)pml4_base, table);
+		sub_table_addr = (void *)(((struct page *)pml4_base) + 1);
+	} else {
+		pml4_base = pgtable_create_root(table);
+
+		/* The trusty memory is remapped to guest physical address
+		 * of gpa_rebased to gpa_rebased + size
+		 */
+		sub_table_addr = alloc_page(table->pool);
+	}
 	sworld_pml4e = hva2hpa(sub_table_addr) | prot_table_present;
 	set_pgentry((uint64_t *)pml4_base, sworld_pml4e, table);
 
@@ -548,3 +558,122 @@ const uint64_t *pgtable_lookup_entry(uint64_t *pml4_page, uint64_t addr, uint64_
 
 	return pret;
 }
+
+/*
+ * Try to coalesce one fully-populated PT into a single 2 MiB mapping.
+ *
+ * Promotion requires all 512 PTEs to be present, physically contiguous,
+ * identically-attributed and 2 MiB aligned. On success the PD entry is
+ * switched to a large page and the PT page is released back to the pool.
+ * The execute right is re-tweaked on the new large entry so the "Machine
+ * Check on Page Size Change" mitigation is preserved, exactly as on the
+ * add-mapping path.
+ */
+static void try_to_promote_pde(uint64_t *pde, const struct pgtable *table)
+{
+	uint64_t *pt_page = pde_page_vaddr(*pde);
+	uint64_t base_paddr = (*pt_page) & PDE_PFN_MASK;
+	uint64_t attr = (*pt_page) & ~PDE_PFN_MASK & ~PAGE_PSE;
+	uint64_t large_attr = attr;
+	uint64_t index;
+	bool can_promote = true;
+
+	if (pgentry_present(table, (*pt_page)) &&
+			mem_aligned_check(base_paddr, PDE_SIZE) &&
+			table->large_page_support(IA32E_PD, attr)) {
+		for (index = 1UL; index < PTRS_PER_PTE; index++) {
+			uint64_t pte = pt_page[index];
+
+			if ((!pgentry_present(table, pte)) ||
+					((pte & PDE_PFN_MASK) != (base_paddr + (index * PTE_SIZE))) ||
+					(((pte & ~PDE_PFN_MASK) & ~PAGE_PSE) != attr)) {
+				can_promote = false;
+				break;
+			}
+		}
+
+		if (can_promote) {
+			table->tweak_exe_right(&large_attr);
+			set_pgentry(pde, base_paddr | large_attr | PAGE_PSE, table);
+			free_page(table->pool, (void *)pt_page);
+		}
+	}
+}
+
+/*
+ * Try to coalesce one fully-populated PD into a single 1 GiB mapping.
+ *
+ * Promotion requires all 512 PDEs to be present 2 MiB large pages which are
+ * physically contiguous, identically-attributed and 1 GiB aligned. On success
+ * the PDPT entry is switched to a large page and the PD page is released back
+ * to the pool.
+ */
+static void try_to_promote_pdpte(uint64_t *pdpte, const struct pgtable *table)
+{
+	uint64_t *pd_page = pdpte_page_vaddr(*pdpte);
+	uint64_t base_paddr = (*pd_page) & PDE_PFN_MASK;
+	uint64_t attr = (*pd_page) & ~PDE_PFN_MASK;
+	uint64_t index;
+	bool can_promote = true;
+
+	if (pgentry_present(table, (*pd_page)) && (pde_large(*pd_page) != 0UL) &&
+			mem_aligned_check(base_paddr, PDPTE_SIZE) &&
+			table->large_page_support(IA32E_PDPT, attr)) {
+		for (index = 1UL; index < PTRS_PER_PDE; index++) {
+			uint64_t pde = pd_page[index];
+
+			if ((!pgentry_present(table, pde)) || (pde_large(pde) == 0UL) ||
+					((pde & PDE_PFN_MASK) != (base_paddr + (index * PDE_SIZE))) ||
+					((pde & ~PDE_PFN_MASK) != attr)) {
+				can_promote = false;
+				break;
+			}
+		}
+
+		if (can_promote) {
+			set_pgentry(pdpte, base_paddr | attr, table);
+			free_page(table->pool, (void *)pd_page);
+		}
+	}
+}
+
+/*
+ * Walk [vaddr_base, vaddr_base + size) and promote every PT which became a
+ * fully-populated run of 4 KiB pages into a 2 MiB mapping, then every PD
+ * which became (or already was) a fully-populated run of 2 MiB pages into
+ * a 1 GiB mapping. Intended to run after a batch of add-mappings, e.g. once
+ * all regions of a hcall_set_vm_memory_regions() request have been
+ * installed. The caller is responsible for flushing the translation caches
+ * afterwards.
+ */
+void pgtable_promote_large_pages(uint64_t *pml4_page, uint64_t vaddr_base, uint64_t size,
+		const struct pgtable *table)
+{
+	uint64_t vaddr = vaddr_base & PDPTE_MASK;
+	uint64_t vaddr_end = vaddr_base + size;
+	uint64_t *pml4e, *pdpte, *pd_page, *pde;
+	uint64_t index;
+
+	dev_dbg(DBG_LEVEL_MMU, "%s, vaddr: 0x%lx, size: 0x%lx\n", __func__, vaddr_base, size);
+
+	while (vaddr < vaddr_end) {
+		pml4e = pml4e_offset(pml4_page, vaddr);
+		if (pgentry_present(table, (*pml4e))) {
+			pdpte = pdpte_offset(pml4e, vaddr);
+			if (pgentry_present(table, (*pdpte)) && (pdpte_large(*pdpte) == 0UL)) {
+				/* collapse full 4 KiB runs first, which may in
+				 * turn make the whole PD promotable
+				 */
+				pd_page = pdpte_page_vaddr(*pdpte);
+				for (index = 0UL; index < PTRS_PER_PDE; index++) {
+					pde = pd_page + index;
+					if (pgentry_present(table, (*pde)) && (pde_large(*pde) == 0UL)) {
+						try_to_promote_pde(pde, table);
+					}
+				}
+				try_to_promote_pdpte(pdpte, table);
+			}
+		}
+		vaddr += PDPTE_SIZE;
+	}
+}
@@ -7,6 +7,8 @@
 #include <asm/default_acpi_info.h>
 #include <platform_acpi_info.h>
 #include <asm/per_cpu.h>
+#include <asm/cpu.h>
+#include <asm/cpuid.h>
 #include <asm/io.h>
 #include <asm/msr.h>
 #include <asm/pgtable.h>
@@ -88,6 +90,63 @@ struct acpi_reset_reg *get_host_reset_reg_data(void)
 	return &host_reset_reg;
 }
 
+/*
+ * Hardware P-states (HWP): once HWP is enabled, a frequency floor request
+ * is a single MSR write taking effect in microseconds, as opposed to the
+ * ACPI Px path which routes through the Service VM and takes milliseconds.
+ * The hypervisor owns MSR_IA32_HWP_REQUEST and applies a per-VM minimum
+ * performance level on vCPU context-switch-in, so an RT partition ramps to
+ * its floor the moment it becomes runnable.
+ */
+static bool hwp_active;
+static uint8_t hwp_highest_perf;
+static uint8_t hwp_lowest_perf;
+
+void hwp_apply_min_perf(uint8_t min_perf)
+{
+	uint64_t req;
+
+	if (hwp_active) {
+		if ((min_perf < hwp_lowest_perf) || (min_perf > hwp_highest_perf)) {
+			min_perf = hwp_lowest_perf;
+		}
+		/* min = requested floor, max = highest, desired = 0 keeps the
+		 * selection autonomous above the floor, EPP = 0x80 (balanced)
+		 */
+		req = (uint64_t)min_perf | ((uint64_t)hwp_highest_perf << 8U) | (0x80UL << 24U);
+		if (get_cpu_var(hwp_request) != req) {
+			get_cpu_var(hwp_request) = req;
+			msr_write(MSR_IA32_HWP_REQUEST, req);
+		}
+	}
+}
+
+bool is_hwp_active(void)
+{
+	return hwp_active;
+}
+
+void init_hwp(void)
+{
+	uint32_t eax, unused;
+	uint64_t caps;
+
+	cpuid_subleaf(CPUID_THERMAL_POWER, 0U, &eax, &unused, &unused, &unused);
+	if ((eax & CPUID_EAX_HWP) != 0U) {
+		/* enabling HWP is one-way until reset */
+		msr_write(MSR_IA32_PM_ENABLE, 1UL);
+		if (get_pcpu_id() == BSP_CPU_ID) {
+			caps = msr_read(MSR_IA32_HWP_CAPABILITIES);
+			hwp_highest_perf = (uint8_t)caps;
+			hwp_lowest_perf = (uint8_t)(caps >> 24U);
+			hwp_active = true;
+		}
+		/* start fully autonomous at the hardware minimum floor */
+		get_cpu_var(hwp_request) = 0UL;
+		hwp_apply_min_perf(0U);
+	}
+}
+
 void restore_msrs(void)
 {
 #ifdef STACK_PROTECTOR
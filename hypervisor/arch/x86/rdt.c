@@ -74,12 +74,138 @@ static void setup_res_clos_msr(uint16_t pcpu_id, struct rdt_type *info, struct r
 	}
 }
 
+/* Cache Monitoring Technology / Memory Bandwidth Monitoring (CMT/MBM):
+ * each VM is assigned RMID vm_id + 1, programmed into IA32_PQR_ASSOC next
+ * to the CLOS; RMID 0 stays with the hypervisor and unmonitored VMs.
+ */
+#define CMT_EVENT_L3_OCCUPANCY	1U
+#define CMT_EVENT_MBM_TOTAL	2U
+
+static uint32_t cmt_max_rmid;
+static uint32_t cmt_scale_factor;
+static uint32_t cmt_event_mask;
+
+static void init_cmt_cap(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	if (pcpu_has_cap(X86_FEATURE_RDT_M)) {
+		cpuid_subleaf(CPUID_RDT_MONITORING, 0U, &eax, &ebx, &ecx, &edx);
+		if ((edx & (1U << 1U)) != 0U) {	/* L3 monitoring supported */
+			cpuid_subleaf(CPUID_RDT_MONITORING, 1U, &eax, &ebx, &ecx, &edx);
+			cmt_max_rmid = ecx;
+			cmt_scale_factor = ebx;
+			cmt_event_mask = edx;
+		}
+	}
+}
+
+bool is_platform_cmt_capable(void)
+{
+	return (cmt_max_rmid != 0U);
+}
+
+uint16_t vm_rmid(uint16_t vm_id)
+{
+	uint16_t rmid = vm_id + 1U;
+
+	return (((uint32_t)rmid <= cmt_max_rmid) ? rmid : 0U);
+}
+
+uint64_t clos_rmid2pqr_msr(uint16_t clos, uint16_t rmid)
+{
+	return ((uint64_t)clos << 32U) | (uint64_t)rmid;
+}
+
+/*
+ * Counters are tracked per RMID per L3 domain, so this must run on a pCPU
+ * in the domain of interest; the stats path samples from the vCPU thread,
+ * which satisfies that naturally.
+ */
+static uint64_t read_qm_counter(uint16_t rmid, uint32_t event)
+{
+	uint64_t ctr = 0UL;
+
+	if ((rmid != 0U) && ((cmt_event_mask & (1U << (event - 1U))) != 0U)) {
+		msr_write(MSR_IA32_QM_EVTSEL, ((uint64_t)rmid << 32U) | (uint64_t)event);
+		ctr = msr_read(MSR_IA32_QM_CTR);
+		/* bit 63: error, bit 62: data unavailable */
+		if ((ctr & 0xc000000000000000UL) != 0UL) {
+			ctr = 0UL;
+		} else {
+			ctr *= cmt_scale_factor;
+		}
+	}
+
+	return ctr;
+}
+
+uint64_t read_vm_cache_occupancy(uint16_t vm_id)
+{
+	return read_qm_counter(vm_rmid(vm_id), CMT_EVENT_L3_OCCUPANCY);
+}
+
+uint64_t read_vm_mem_bw_total(uint16_t vm_id)
+{
+	return read_qm_counter(vm_rmid(vm_id), CMT_EVENT_MBM_TOTAL);
+}
+
+/*
+ * Reprogram one CLOS of an RDT resource at runtime. The new value is
+ * written through to every domain instance of the resource and kept in
+ * clos_config_array, so a later setup_clos (S3 resume) reapplies it.
+ */
+int32_t write_rdt_config(uint32_t res, uint16_t clos, uint64_t value)
+{
+	struct rdt_type *info;
+	struct rdt_ins *ins;
+	uint32_t i;
+	int32_t ret = -EINVAL;
+
+	if (res < RDT_NUM_RESOURCES) {
+		info = &res_cap_info[res];
+		ret = (info->num_ins > 0U) ? 0 : -ENODEV;
+		for (i = 0U; (ret == 0) && (i < info->num_ins); i++) {
+			ins = &info->ins_array[i];
+			if ((uint32_t)clos >= ins->num_clos_config) {
+				ret = -EINVAL;
+			} else if (info->res_id == RDT_RESID_MBA) {
+				if (value > ins->res.membw.mba_max) {
+					ret = -EINVAL;
+				}
+			} else {
+				if ((value == 0UL) || ((value >> ins->res.cache.cbm_len) != 0UL)) {
+					ret = -EINVAL;
+				}
+			}
+		}
+		if (ret == 0) {
+			for (i = 0U; i < info->num_ins; i++) {
+				ins = &info->ins_array[i];
+				if (info->res_id == RDT_RESID_MBA) {
+					ins->clos_config_array[clos].mba_delay = (uint32_t)value;
+				} else {
+					ins->clos_config_array[clos].clos_mask = (uint32_t)value;
+				}
+				/* CLOS MSRs are domain wide - one write per instance */
+				msr_write_pcpu(info->msr_base + clos, value, (uint16_t)ffs64(ins->cpu_mask));
+			}
+		}
+	}
+
+	return ret;
+}
+
 void setup_clos(uint16_t pcpu_id)
 {
 	uint16_t i, j;
 	struct rdt_type *info;
 	struct rdt_ins *ins;
 
+	if (pcpu_id == BSP_CPU_ID) {
+		init_cmt_cap();
+	}
+
 	for (i = 0U; i < RDT_NUM_RESOURCES; i++) {
 		info = &res_cap_info[i];
 		for (j = 0U; j < info->num_ins; j++) {
@@ -145,4 +271,34 @@ bool is_platform_rdt_capable(void)
 {
 	return false;
 }
+
+bool is_platform_cmt_capable(void)
+{
+	return false;
+}
+
+uint16_t vm_rmid(__unused uint16_t vm_id)
+{
+	return 0U;
+}
+
+uint64_t clos_rmid2pqr_msr(__unused uint16_t clos, __unused uint16_t rmid)
+{
+	return 0UL;
+}
+
+uint64_t read_vm_cache_occupancy(__unused uint16_t vm_id)
+{
+	return 0UL;
+}
+
+uint64_t read_vm_mem_bw_total(__unused uint16_t vm_id)
+{
+	return 0UL;
+}
+
+int32_t write_rdt_config(__unused uint32_t res, __unused uint16_t clos, __unused uint64_t value)
+{
+	return -ENODEV;
+}
 #endif
@@ -131,6 +131,8 @@ struct dmar_drhd_rt {
 	/* MAX_IR_ENTRIES is roundup (to power of 2) of CONFIG_MAX_PT_IRQ_ENTRIES. */
 	uint64_t irte_alloc_bitmap[MAX_IR_ENTRIES / 64U];
 	uint64_t irte_reserved_bitmap[MAX_IR_ENTRIES / 64U];
+	/* allocation rotor: no free entry exists below this index */
+	uint16_t irte_alloc_hint;
 	uint64_t qi_queue;
 	uint16_t qi_tail;
 
@@ -185,6 +187,10 @@ static inline void *get_ir_table(uint32_t dmar_index)
 
 static struct dmar_drhd_rt dmar_drhd_units[MAX_DRHDS];
 static bool iommu_page_walk_coherent = true;
+/* second-level superpage sizes every enabled DRHD supports, SLLPS encoding:
+ * bit 0 = 2MiB, bit 1 = 1GiB; narrowed at unit registration
+ */
+static uint8_t iommu_sllps = 0x3U;
 static struct dmar_info *platform_dmar_info = NULL;
 
 /* Domain id 0 is reserved in some cases per VT-d */
@@ -428,6 +434,32 @@ static void dmar_disable_translation(struct dmar_drhd_rt *dmar_unit)
 	spinlock_release(&(dmar_unit->lock));
 }
 
+/*
+ * The context tables are statically allocated, so every root entry can be
+ * populated once at unit registration. Attaching a device (e.g. each VF of
+ * a PF being enabled) then only writes its own context entry, instead of
+ * also setting up and flushing the root entry for a first-seen bus.
+ */
+static void dmar_prepare_root_entries(struct dmar_drhd_rt *dmar_unit)
+{
+	struct dmar_entry *root_table = (struct dmar_entry *)hpa2hva(dmar_unit->root_table_addr);
+	struct dmar_entry *root_entry;
+	uint64_t context_table_addr, lo_64;
+	uint32_t bus;
+
+	for (bus = 0U; bus < ACFG_MAX_PCI_BUS_NUM; bus++) {
+		root_entry = root_table + bus;
+		context_table_addr = hva2hpa(get_ctx_table(dmar_unit->index, (uint8_t)bus)) >> PAGE_SHIFT;
+		lo_64 = dmar_set_bitslice(0UL,
+				ROOT_ENTRY_LOWER_CTP_MASK, ROOT_ENTRY_LOWER_CTP_POS, context_table_addr);
+		lo_64 = dmar_set_bitslice(lo_64,
+				ROOT_ENTRY_LOWER_PRESENT_MASK, ROOT_ENTRY_LOWER_PRESENT_POS, 1UL);
+		root_entry->hi_64 = 0UL;
+		root_entry->lo_64 = lo_64;
+	}
+	iommu_flush_cache(root_table, ACFG_MAX_PCI_BUS_NUM * (uint32_t)sizeof(struct dmar_entry));
+}
+
 static int32_t dmar_register_hrhd(struct dmar_drhd_rt *dmar_unit)
 {
 	int32_t ret = 0;
@@ -485,6 +517,10 @@ static int32_t dmar_register_hrhd(struct dmar_drhd_rt *dmar_unit)
 		if ((iommu_ecap_c(dmar_unit->ecap) == 0U) && (!dmar_unit->drhd->ignore)) {
 			iommu_page_walk_coherent = false;
 		}
+		if (!dmar_unit->drhd->ignore) {
+			iommu_sllps &= iommu_cap_super_page_val(dmar_unit->cap);
+		}
+		dmar_prepare_root_entries(dmar_unit);
 		dmar_disable_translation(dmar_unit);
 	}
 
@@ -541,36 +577,69 @@ static struct dmar_drhd_rt *device_to_dmaru(uint8_t bus, uint8_t devfun)
 	return dmaru;
 }
 
-static void dmar_issue_qi_request(struct dmar_drhd_rt *dmar_unit, struct dmar_entry invalidate_desc)
+enum dmar_qi_mode {
+	DMAR_QI_SYNC = 0,	/* append a wait descriptor and spin until hardware completes */
+	DMAR_QI_ASYNC,		/* submit to hardware without waiting for completion */
+	DMAR_QI_BATCH,		/* queue only, submitted along with a later non-batch request */
+};
+
+/* @pre the caller holds dmar_unit->lock */
+static void dmar_qi_queue_desc(struct dmar_drhd_rt *dmar_unit, struct dmar_entry invalidate_desc)
 {
 	struct dmar_entry *invalidate_desc_ptr;
-	uint32_t qi_status = 0U;
-	uint64_t start;
+	uint64_t start = cpu_ticks();
 
-	spinlock_obtain(&(dmar_unit->lock));
+	/* async and batched requests may leave descriptors in flight, so keep one
+	 * slot free to never let the tail catch up with the hardware head
+	 */
+	while ((uint16_t)iommu_read32(dmar_unit, DMAR_IQH_REG) ==
+			((dmar_unit->qi_tail + DMAR_QI_INV_ENTRY_SIZE) % DMAR_INVALIDATION_QUEUE_SIZE)) {
+		if ((cpu_ticks() - start) > TICKS_PER_MS) {
+			pr_err("DMAR QI queue full! @ %s", __func__);
+			break;
+		}
+		asm_pause();
+	}
 
 	invalidate_desc_ptr = (struct dmar_entry *)(dmar_unit->qi_queue + dmar_unit->qi_tail);
 
 	invalidate_desc_ptr->hi_64 = invalidate_desc.hi_64;
 	invalidate_desc_ptr->lo_64 = invalidate_desc.lo_64;
 	dmar_unit->qi_tail = (dmar_unit->qi_tail + DMAR_QI_INV_ENTRY_SIZE) % DMAR_INVALIDATION_QUEUE_SIZE;
+}
 
-	invalidate_desc_ptr++;
+static void dmar_issue_qi_request(struct dmar_drhd_rt *dmar_unit, struct dmar_entry invalidate_desc,
+	enum dmar_qi_mode mode)
+{
+	struct dmar_entry wait_desc;
+	uint32_t qi_status = 0U;
+	uint64_t start;
 
-	invalidate_desc_ptr->hi_64 = hva2hpa(&qi_status);
-	invalidate_desc_ptr->lo_64 = DMAR_INV_WAIT_DESC_LOWER;
-	dmar_unit->qi_tail = (dmar_unit->qi_tail + DMAR_QI_INV_ENTRY_SIZE) % DMAR_INVALIDATION_QUEUE_SIZE;
+	spinlock_obtain(&(dmar_unit->lock));
 
-	qi_status = DMAR_INV_STATUS_INCOMPLETE;
-	iommu_write32(dmar_unit, DMAR_IQT_REG, dmar_unit->qi_tail);
+	dmar_qi_queue_desc(dmar_unit, invalidate_desc);
 
-	start = cpu_ticks();
-	while (qi_status != DMAR_INV_STATUS_COMPLETED) {
-		if ((cpu_ticks() - start) > TICKS_PER_MS) {
-			pr_err("DMAR OP Timeout! @ %s", __func__);
-			break;
+	if (mode != DMAR_QI_BATCH) {
+		if (mode == DMAR_QI_SYNC) {
+			wait_desc.hi_64 = hva2hpa(&qi_status);
+			wait_desc.lo_64 = DMAR_INV_WAIT_DESC_LOWER;
+			qi_status = DMAR_INV_STATUS_INCOMPLETE;
+			dmar_qi_queue_desc(dmar_unit, wait_desc);
+		}
+
+		/* hardware fetches batched descriptors queued before this one as well */
+		iommu_write32(dmar_unit, DMAR_IQT_REG, dmar_unit->qi_tail);
+
+		if (mode == DMAR_QI_SYNC) {
+			start = cpu_ticks();
+			while (qi_status != DMAR_INV_STATUS_COMPLETED) {
+				if ((cpu_ticks() - start) > TICKS_PER_MS) {
+					pr_err("DMAR OP Timeout! @ %s", __func__);
+					break;
+				}
+				asm_pause();
+			}
 		}
-		asm_pause();
 	}
 
 	spinlock_release(&(dmar_unit->lock));
@@ -581,9 +650,10 @@ static void dmar_issue_qi_request(struct dmar_drhd_rt *dmar_unit, struct dmar_en
  * sid: source id
  * fm: function mask
  * cirg: cache-invalidation request granularity
+ * mode: completion mode of the queued-invalidation request
  */
 static void dmar_invalid_context_cache(struct dmar_drhd_rt *dmar_unit,
-	uint16_t did, uint16_t sid, uint8_t fm, enum dmar_cirg_type cirg)
+	uint16_t did, uint16_t sid, uint8_t fm, enum dmar_cirg_type cirg, enum dmar_qi_mode mode)
 {
 	struct dmar_entry invalidate_desc;
 
@@ -606,17 +676,17 @@ static void dmar_invalid_context_cache(struct dmar_drhd_rt *dmar_unit,
 	}
 
 	if (invalidate_desc.lo_64 != 0UL) {
-		dmar_issue_qi_request(dmar_unit, invalidate_desc);
+		dmar_issue_qi_request(dmar_unit, invalidate_desc, mode);
 	}
 }
 
 static void dmar_invalid_context_cache_global(struct dmar_drhd_rt *dmar_unit)
 {
-	dmar_invalid_context_cache(dmar_unit, 0U, 0U, 0U, DMAR_CIRG_GLOBAL);
+	dmar_invalid_context_cache(dmar_unit, 0U, 0U, 0U, DMAR_CIRG_GLOBAL, DMAR_QI_SYNC);
 }
 
 static void dmar_invalid_iotlb(struct dmar_drhd_rt *dmar_unit, uint16_t did, uint64_t address, uint8_t am,
-			       bool hint, enum dmar_iirg_type iirg)
+			       bool hint, enum dmar_iirg_type iirg, enum dmar_qi_mode mode)
 {
 	/* set Drain Reads & Drain Writes,
 	 * if hardware doesn't support it, will be ignored by hardware
@@ -649,7 +719,7 @@ static void dmar_invalid_iotlb(struct dmar_drhd_rt *dmar_unit, uint16_t did, uin
 	}
 
 	if (invalidate_desc.lo_64 != 0UL) {
-		dmar_issue_qi_request(dmar_unit, invalidate_desc);
+		dmar_issue_qi_request(dmar_unit, invalidate_desc, mode);
 	}
 }
 
@@ -660,7 +730,7 @@ static void dmar_invalid_iotlb(struct dmar_drhd_rt *dmar_unit, uint16_t did, uin
  */
 static void dmar_invalid_iotlb_global(struct dmar_drhd_rt *dmar_unit)
 {
-	dmar_invalid_iotlb(dmar_unit, 0U, 0UL, 0U, false, DMAR_IIRG_GLOBAL);
+	dmar_invalid_iotlb(dmar_unit, 0U, 0UL, 0U, false, DMAR_IIRG_GLOBAL, DMAR_QI_SYNC);
 }
 
 /* @pre dmar_unit->ir_table_addr != NULL */
@@ -686,7 +756,7 @@ static void dmar_set_intr_remap_table(struct dmar_drhd_rt *dmar_unit)
 }
 
 static void dmar_invalid_iec(struct dmar_drhd_rt *dmar_unit, uint16_t intr_index,
-				uint8_t index_mask, bool is_global)
+				uint8_t index_mask, bool is_global, enum dmar_qi_mode mode)
 {
 	struct dmar_entry invalidate_desc;
 
@@ -700,13 +770,13 @@ static void dmar_invalid_iec(struct dmar_drhd_rt *dmar_unit, uint16_t intr_index
 	}
 
 	if (invalidate_desc.lo_64 != 0UL) {
-		dmar_issue_qi_request(dmar_unit, invalidate_desc);
+		dmar_issue_qi_request(dmar_unit, invalidate_desc, mode);
 	}
 }
 
 static void dmar_invalid_iec_global(struct dmar_drhd_rt *dmar_unit)
 {
-	dmar_invalid_iec(dmar_unit, 0U, 0U, true);
+	dmar_invalid_iec(dmar_unit, 0U, 0U, true, DMAR_QI_SYNC);
 }
 
 /* @pre dmar_unit->root_table_addr != NULL */
@@ -1001,6 +1071,131 @@ static bool is_dmar_unit_valid(const struct dmar_drhd_rt *dmar_unit, union pci_b
 	return valid;
 }
 
+/* number of context entries referencing each domain's translation table;
+ * while it is zero no IOTLB can hold a translation tagged with the domain id,
+ * so iommu_flush_iotlb() may skip the invalidation altogether
+ */
+static uint32_t iommu_dev_cnt[MAX_DOMAIN_NUM];
+
+/* array of all iommu domains, indexed by domain id; a destroyed domain is
+ * zeroed, so trans_table_ptr == 0UL marks a slot as unused
+ */
+static struct iommu_domain iommu_domains[MAX_DOMAIN_NUM];
+
+/*
+ * DMA remapping statistics, kept per domain. The DRHDs modeled here
+ * predate the VT-d performance monitoring extension, so IOTLB pressure
+ * is inferred from the invalidation traffic the hypervisor itself
+ * drives: every domain-selective shootdown is counted and its
+ * synchronous completion latency recorded, both per domain and in a
+ * global power-of-two latency histogram.
+ */
+struct dmar_domain_stats {
+	uint64_t iotlb_inv_cnt;
+	uint64_t ctx_inv_cnt;
+	uint64_t inv_ticks;
+	uint64_t inv_max_ticks;
+};
+static struct dmar_domain_stats dmar_domain_stats[MAX_DOMAIN_NUM];
+static uint64_t dmar_inv_lat_hist[IOMMU_INV_LAT_BUCKETS];
+
+static void dmar_account_invalidation(uint16_t domain_id, uint64_t ticks)
+{
+	struct dmar_domain_stats *stats = &dmar_domain_stats[domain_id];
+	uint64_t lat_us = ticks_to_us(ticks);
+	uint32_t bucket = 0U;
+
+	stats->iotlb_inv_cnt++;
+	stats->inv_ticks += ticks;
+	if (ticks > stats->inv_max_ticks) {
+		stats->inv_max_ticks = ticks;
+	}
+
+	/* bucket n holds latencies in [2^(n-1), 2^n) us, bucket 0 is <1us */
+	while ((bucket < (IOMMU_INV_LAT_BUCKETS - 1U)) && (lat_us >= (1UL << bucket))) {
+		bucket++;
+	}
+	dmar_inv_lat_hist[bucket]++;
+}
+
+/*
+ * Walk a domain's second-level translation table (the VM's EPT) and
+ * count leaf mappings by size. A 4KiB-dominated mix is what thrashes
+ * the IOTLB on high-rate devices, which is exactly what this is meant
+ * to expose. Debug path only: the live tables are read without locking,
+ * so a concurrent EPT update may be missed or double-counted.
+ */
+static void dmar_count_page_sizes(const struct iommu_domain *domain,
+		uint64_t *nr_4k, uint64_t *nr_2m, uint64_t *nr_1g)
+{
+	const uint64_t *pml4, *pdpt, *pd, *pt;
+	uint64_t i, j, k, m;
+
+	pml4 = (const uint64_t *)hpa2hva(domain->trans_table_ptr);
+	for (i = 0UL; i < (1UL << LEVEL_WIDTH); i++) {
+		if ((pml4[i] & EPT_RWX) == 0UL) {
+			continue;
+		}
+		pdpt = pml4e_page_vaddr(pml4[i]);
+		for (j = 0UL; j < (1UL << LEVEL_WIDTH); j++) {
+			if ((pdpt[j] & EPT_RWX) == 0UL) {
+				continue;
+			}
+			if (pdpte_large(pdpt[j]) != 0UL) {
+				(*nr_1g)++;
+				continue;
+			}
+			pd = pdpte_page_vaddr(pdpt[j]);
+			for (k = 0UL; k < (1UL << LEVEL_WIDTH); k++) {
+				if ((pd[k] & EPT_RWX) == 0UL) {
+					continue;
+				}
+				if (pde_large(pd[k]) != 0UL) {
+					(*nr_2m)++;
+					continue;
+				}
+				pt = pde_page_vaddr(pd[k]);
+				for (m = 0UL; m < (1UL << LEVEL_WIDTH); m++) {
+					if ((pt[m] & EPT_RWX) != 0UL) {
+						(*nr_4k)++;
+					}
+				}
+			}
+		}
+	}
+}
+
+void iommu_get_domain_stats(uint16_t vm_id, bool count_pages, struct iommu_domain_stats *stats)
+{
+	uint16_t did = vmid_to_domainid(vm_id);
+	const struct dmar_domain_stats *src = &dmar_domain_stats[did];
+
+	(void)memset(stats, 0U, sizeof(*stats));
+	stats->dev_cnt = iommu_dev_cnt[did];
+	stats->iotlb_inv_cnt = src->iotlb_inv_cnt;
+	stats->ctx_inv_cnt = src->ctx_inv_cnt;
+	stats->inv_total_us = ticks_to_us(src->inv_ticks);
+	stats->inv_max_us = ticks_to_us(src->inv_max_ticks);
+	if (count_pages && (iommu_domains[did].trans_table_ptr != 0UL)) {
+		dmar_count_page_sizes(&iommu_domains[did],
+			&stats->nr_4k, &stats->nr_2m, &stats->nr_1g);
+	}
+}
+
+uint8_t iommu_sllps_capability(void)
+{
+	return iommu_sllps;
+}
+
+void iommu_get_inv_lat_hist(uint64_t hist[IOMMU_INV_LAT_BUCKETS])
+{
+	uint32_t i;
+
+	for (i = 0U; i < IOMMU_INV_LAT_BUCKETS; i++) {
+		hist[i] = dmar_inv_lat_hist[i];
+	}
+}
+
 /* @pre bus < ACFG_MAX_PCI_BUS_NUM */
 static int32_t iommu_attach_device(const struct iommu_domain *domain, uint8_t bus, uint8_t devfun)
 {
@@ -1024,27 +1219,9 @@ static int32_t iommu_attach_device(const struct iommu_domain *domain, uint8_t bu
 		root_table = (struct dmar_entry *)hpa2hva(dmar_unit->root_table_addr);
 		root_entry = root_table + bus;
 
-		if (dmar_get_bitslice(root_entry->lo_64,
-					ROOT_ENTRY_LOWER_PRESENT_MASK,
-					ROOT_ENTRY_LOWER_PRESENT_POS) == 0UL) {
-			/* create context table for the bus if not present */
-			context_table_addr = hva2hpa(get_ctx_table(dmar_unit->index, bus));
-
-			context_table_addr = context_table_addr >> PAGE_SHIFT;
-
-			lo_64 = dmar_set_bitslice(lo_64,
-					ROOT_ENTRY_LOWER_CTP_MASK, ROOT_ENTRY_LOWER_CTP_POS, context_table_addr);
-			lo_64 = dmar_set_bitslice(lo_64,
-					ROOT_ENTRY_LOWER_PRESENT_MASK, ROOT_ENTRY_LOWER_PRESENT_POS, 1UL);
-
-			root_entry->hi_64 = 0UL;
-			root_entry->lo_64 = lo_64;
-			iommu_flush_cache(root_entry, sizeof(struct dmar_entry));
-		} else {
-			context_table_addr = dmar_get_bitslice(root_entry->lo_64,
-					ROOT_ENTRY_LOWER_CTP_MASK, ROOT_ENTRY_LOWER_CTP_POS);
-		}
-
+		/* all root entries are populated at unit registration */
+		context_table_addr = dmar_get_bitslice(root_entry->lo_64,
+				ROOT_ENTRY_LOWER_CTP_MASK, ROOT_ENTRY_LOWER_CTP_POS);
 		context_table_addr = context_table_addr << PAGE_SHIFT;
 
 		context = (struct dmar_entry *)hpa2hva(context_table_addr);
@@ -1071,6 +1248,7 @@ static int32_t iommu_attach_device(const struct iommu_domain *domain, uint8_t bu
 			context_entry->hi_64 = hi_64;
 			context_entry->lo_64 = lo_64;
 			iommu_flush_cache(context_entry, sizeof(struct dmar_entry));
+			iommu_dev_cnt[vmid_to_domainid(domain->vm_id)]++;
 			ret = 0;
 		}
 	} else {
@@ -1125,10 +1303,16 @@ static int32_t iommu_detach_device(const struct iommu_domain *domain, uint8_t bu
 			context_entry->hi_64 = 0UL;
 			iommu_flush_cache(context_entry, sizeof(struct dmar_entry));
 
+			/* batch the context-cache descriptor with the IOTLB one so that
+			 * the pair is covered by a single wait descriptor
+			 */
 			dmar_invalid_context_cache(dmar_unit, vmid_to_domainid(domain->vm_id), sid.value, 0U,
-							DMAR_CIRG_DEVICE);
+							DMAR_CIRG_DEVICE, DMAR_QI_BATCH);
 			dmar_invalid_iotlb(dmar_unit, vmid_to_domainid(domain->vm_id), 0UL, 0U, false,
-							DMAR_IIRG_DOMAIN);
+							DMAR_IIRG_DOMAIN, DMAR_QI_SYNC);
+			iommu_dev_cnt[vmid_to_domainid(domain->vm_id)]--;
+			dmar_domain_stats[vmid_to_domainid(domain->vm_id)].ctx_inv_cnt++;
+			dmar_domain_stats[vmid_to_domainid(domain->vm_id)].iotlb_inv_cnt++;
 		}
 	} else {
 		if (is_dmar_unit_ignored(dmar_unit)) {
@@ -1160,7 +1344,6 @@ static void do_action_for_iommus(void (*action)(struct dmar_drhd_rt *))
 
 struct iommu_domain *create_iommu_domain(uint16_t vm_id, uint64_t translation_table, uint32_t addr_width)
 {
-	static struct iommu_domain iommu_domains[MAX_DOMAIN_NUM];
 	struct iommu_domain *domain;
 
 	/* TODO: check if a domain with the vm_id exists */
@@ -1222,6 +1405,25 @@ int32_t move_pt_device(const struct iommu_domain *from_domain, const struct iomm
 	return status;
 }
 
+void iommu_flush_iotlb(const struct iommu_domain *domain)
+{
+	struct dmar_drhd_rt *dmar_unit;
+	uint64_t start;
+	uint32_t i;
+
+	if ((domain != NULL) && (iommu_dev_cnt[vmid_to_domainid(domain->vm_id)] != 0U)) {
+		start = cpu_ticks();
+		for (i = 0U; i < platform_dmar_info->drhd_count; i++) {
+			dmar_unit = &dmar_drhd_units[i];
+			if (!dmar_unit->drhd->ignore) {
+				dmar_invalid_iotlb(dmar_unit, vmid_to_domainid(domain->vm_id), 0UL, 0U, false,
+							DMAR_IIRG_DOMAIN, DMAR_QI_SYNC);
+			}
+		}
+		dmar_account_invalidation(vmid_to_domainid(domain->vm_id), cpu_ticks() - start);
+	}
+}
+
 void enable_iommu(void)
 {
 	do_action_for_iommus(enable_dmar);
@@ -1274,23 +1476,43 @@ int32_t init_iommu(void)
 /* Allocate continuous IRTEs specified by num, num can be 1, 2, 4, 8, 16, 32 */
 static uint16_t alloc_irtes(struct dmar_drhd_rt *dmar_unit, const uint16_t num)
 {
-	uint16_t irte_idx;
+	uint16_t irte_idx, start;
 	uint64_t mask = (1UL << num) - 1U;
 	uint64_t test_mask;
+	bool found = false, wrapped = false;
 
 	ASSERT((bitmap_weight(num) == 1U) && (num <= 32U));
 
 	spinlock_obtain(&dmar_unit->lock);
-	for (irte_idx = 0U; irte_idx < MAX_IR_ENTRIES; irte_idx += num) {
+	/* start the scan at the rotor instead of index 0, so that a burst of
+	 * allocations (e.g. bringing up the vectors of a batch of VFs) does
+	 * not rescan the already-allocated low entries every time
+	 */
+	start = (uint16_t)((dmar_unit->irte_alloc_hint + (num - 1U)) & ~(num - 1U));
+	irte_idx = start;
+	while (!found) {
+		if (irte_idx >= MAX_IR_ENTRIES) {
+			if (wrapped) {
+				break;
+			}
+			wrapped = true;
+			irte_idx = 0U;
+		}
+		if (wrapped && (irte_idx >= start)) {
+			break;
+		}
 		test_mask = mask << (irte_idx & 0x3FU);
 		if ((dmar_unit->irte_alloc_bitmap[irte_idx >> 6U] & test_mask) == 0UL) {
 			dmar_unit->irte_alloc_bitmap[irte_idx >> 6U] |= test_mask;
-			break;
+			dmar_unit->irte_alloc_hint = irte_idx + num;
+			found = true;
+		} else {
+			irte_idx += num;
 		}
 	}
 	spinlock_release(&dmar_unit->lock);
 
-	return (irte_idx < MAX_IR_ENTRIES) ? irte_idx: INVALID_IRTE_ID;
+	return found ? irte_idx : INVALID_IRTE_ID;
 }
 
 static bool is_irte_reserved(const struct dmar_drhd_rt *dmar_unit, uint16_t index)
@@ -1382,7 +1604,7 @@ int32_t dmar_assign_irte(const struct intr_source *intr_src, union dmar_ir_entry
 				*ir_entry = *irte;
 			}
 			iommu_flush_cache(ir_entry, sizeof(union dmar_ir_entry));
-			dmar_invalid_iec(dmar_unit, *idx_out, 0U, false);
+			dmar_invalid_iec(dmar_unit, *idx_out, 0U, false, DMAR_QI_SYNC);
 		}
 		ret = 0;
 	}
@@ -1408,11 +1630,17 @@ void dmar_free_irte(const struct intr_source *intr_src, uint16_t index)
 		ir_entry->bits.remap.present = 0x0UL;
 
 		iommu_flush_cache(ir_entry, sizeof(union dmar_ir_entry));
-		dmar_invalid_iec(dmar_unit, index, 0U, false);
+		/* the IRTE is already not present and descriptors are processed in
+		 * order, so the teardown path need not wait for the invalidation
+		 */
+		dmar_invalid_iec(dmar_unit, index, 0U, false, DMAR_QI_ASYNC);
 
 		if (!is_irte_reserved(dmar_unit, index)) {
 			spinlock_obtain(&dmar_unit->lock);
 			bitmap_clear_nolock(index & 0x3FU, &dmar_unit->irte_alloc_bitmap[index >> 6U]);
+			if (index < dmar_unit->irte_alloc_hint) {
+				dmar_unit->irte_alloc_hint = index;
+			}
 			spinlock_release(&dmar_unit->lock);
 		}
 	}
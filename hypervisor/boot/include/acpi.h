@@ -59,6 +59,12 @@
 #define ACPI_SIG_TPM2            "TPM2" /* Trusted Platform Module hardware interface table */
 #define ACPI_SIG_RTCT            "PTCT" /* Platform Tuning Configuration Table (Real-Time Configuration Table) */
 #define ACPI_SIG_RTCT_V2         "RTCT" /* Platform Tuning Configuration Table (Real-Time Configuration Table) V2 */
+#define ACPI_SIG_SRAT            "SRAT" /* System Resource Affinity Table */
+
+#define ACPI_SRAT_TYPE_CPU_AFFINITY         0U
+#define ACPI_SRAT_TYPE_MEMORY_AFFINITY      1U
+#define ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY  2U
+#define ACPI_SRAT_ENABLED                   1U
 
 struct packed_gas {
 	uint8_t 	space_id;
@@ -192,6 +198,46 @@ struct acpi_madt_ioapic {
 	uint32_t  gsi_base;
 } __packed;
 
+struct acpi_table_srat {
+	struct acpi_table_header       header;
+	/* must be 1, for backward compatibility */
+	uint32_t                       table_revision;
+	uint64_t                       reserved;
+} __packed;
+
+struct acpi_srat_cpu_affinity {
+	struct acpi_subtable_header    header;
+	/* bits [7:0] of the proximity domain */
+	uint8_t                        proximity_domain_lo;
+	uint8_t                        apic_id;
+	uint32_t                       flags;
+	uint8_t                        local_sapic_eid;
+	/* bits [31:8] of the proximity domain */
+	uint8_t                        proximity_domain_hi[3];
+	uint32_t                       clock_domain;
+} __packed;
+
+struct acpi_srat_mem_affinity {
+	struct acpi_subtable_header    header;
+	uint32_t                       proximity_domain;
+	uint16_t                       reserved;
+	uint64_t                       base_address;
+	uint64_t                       length;
+	uint32_t                       reserved1;
+	uint32_t                       flags;
+	uint64_t                       reserved2;
+} __packed;
+
+struct acpi_srat_x2apic_cpu_affinity {
+	struct acpi_subtable_header    header;
+	uint16_t                       reserved;
+	uint32_t                       proximity_domain;
+	uint32_t                       apic_id;
+	uint32_t                       flags;
+	uint32_t                       clock_domain;
+	uint32_t                       reserved2;
+} __packed;
+
 struct acpi_table_dmar {
 	/* Common ACPI table header */
 	struct acpi_table_header  header;
@@ -4,14 +4,31 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 #include <asm/cpu.h>
+#include <asm/lib/atomic.h>
 #include <schedule.h>
 #include <event.h>
 #include <logmsg.h>
 
+/*
+ * Event signaling with lock-free fast paths.
+ *
+ * The signal count is kept in an atomic counter; signaling an event nobody
+ * waits on and consuming a signal which already fired are each a single
+ * locked RMW. The per-event lock is only taken when a waiter really has to
+ * block, so the hot ioreq completion path (DM handles the access and
+ * signals before the vCPU thread ever waits, or vice versa with a short
+ * sleep) no longer bounces a lock between the two sides.
+ *
+ * The locked RMWs are full barriers: the waiter decrements the counter
+ * before deciding to block, the signaler increments it before checking for
+ * a waiter, so whichever comes second sees the other and takes the slow
+ * path, where the lock serializes publishing and waking waiting_thread.
+ */
+
 void init_event(struct sched_event *event)
 {
 	spinlock_init(&event->lock);
-	event->nqueued = 0;
+	event->counter = 0;
 	event->waiting_thread = NULL;
 }
 
@@ -20,7 +37,7 @@ void reset_event(struct sched_event *event)
 	uint64_t rflag;
 
 	spinlock_irqsave_obtain(&event->lock, &rflag);
-	event->nqueued = 0;
+	event->counter = 0;
 	event->waiting_thread = NULL;
 	spinlock_irqrestore_release(&event->lock, rflag);
 }
@@ -30,28 +47,32 @@ void wait_event(struct sched_event *event)
 {
 	uint64_t rflag;
 
-	spinlock_irqsave_obtain(&event->lock, &rflag);
-	ASSERT((event->waiting_thread == NULL), "only support exclusive waiting");
-	event->waiting_thread = sched_get_current(get_pcpu_id());
-	event->nqueued++;
-	while ((event->nqueued > 0) && (event->waiting_thread != NULL)) {
-		sleep_thread(event->waiting_thread);
-		spinlock_irqrestore_release(&event->lock, rflag);
-		schedule();
+	/* fast path: consume a signal which already fired */
+	if (atomic_dec_return(&event->counter) < 0) {
 		spinlock_irqsave_obtain(&event->lock, &rflag);
+		ASSERT((event->waiting_thread == NULL), "only support exclusive waiting");
+		event->waiting_thread = sched_get_current(get_pcpu_id());
+		while ((event->counter < 0) && (event->waiting_thread != NULL)) {
+			sleep_thread(event->waiting_thread);
+			spinlock_irqrestore_release(&event->lock, rflag);
+			schedule();
+			spinlock_irqsave_obtain(&event->lock, &rflag);
+		}
+		event->waiting_thread = NULL;
+		spinlock_irqrestore_release(&event->lock, rflag);
 	}
-	event->waiting_thread = NULL;
-	spinlock_irqrestore_release(&event->lock, rflag);
 }
 
 void signal_event(struct sched_event *event)
 {
 	uint64_t rflag;
 
-	spinlock_irqsave_obtain(&event->lock, &rflag);
-	event->nqueued--;
-	if (event->waiting_thread != NULL) {
-		wake_thread(event->waiting_thread);
+	/* fast path: nobody consumed this signal yet, so nobody can block on it */
+	if (atomic_inc_return(&event->counter) <= 0) {
+		spinlock_irqsave_obtain(&event->lock, &rflag);
+		if (event->waiting_thread != NULL) {
+			wake_thread(event->waiting_thread);
+		}
+		spinlock_irqrestore_release(&event->lock, rflag);
 	}
-	spinlock_irqrestore_release(&event->lock, rflag);
 }
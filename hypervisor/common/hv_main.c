@@ -14,10 +14,14 @@
 #include <sprintf.h>
 #include <trace.h>
 #include <logmsg.h>
+#include <shell.h>
+#include <ticks.h>
+#include <asm/msr.h>
 
 void vcpu_thread(struct thread_object *obj)
 {
 	struct acrn_vcpu *vcpu = container_of(obj, struct acrn_vcpu, thread_obj);
+	uint64_t now;
 	int32_t ret = 0;
 
 	do {
@@ -71,6 +75,17 @@ void vcpu_thread(struct thread_object *obj)
 		}
 
 		profiling_post_vmexit_handler(vcpu);
+
+		/* heartbeat for the stall detector, see vcpu_watchdog.c; the
+		 * PMU sample also lands in the stats page so a Service VM
+		 * watchdog sees progress of guests that rarely exit
+		 */
+		vcpu->hb_exit_cnt++;
+		now = cpu_ticks();
+		if ((now - vcpu->hb_sample_tsc) >= TICKS_PER_MS) {
+			vcpu->hb_sample_tsc = now;
+			vcpu->hb_inst_retired = msr_read(MSR_IA32_FIXED_CTR0);
+		}
 	} while (1);
 }
 
@@ -85,8 +100,12 @@ void default_idle(__unused struct thread_object *obj)
 			cpu_dead();
 		} else if (need_shutdown_vm(pcpu_id)) {
 			shutdown_vm_from_idle(pcpu_id);
+		} else if (need_teardown_vm(pcpu_id)) {
+			vm_teardown_from_idle(pcpu_id);
 		} else {
 			CPU_IRQ_ENABLE_ON_CONFIG();
+			/* run any staged shell command at the lowest priority */
+			shell_idle_process();
 			cpu_do_idle();
 			CPU_IRQ_DISABLE_ON_CONFIG();
 		}
@@ -14,6 +14,8 @@
 #include <asm/lapic.h>
 #include <asm/guest/assign.h>
 #include <asm/guest/ept.h>
+#include <asm/guest/virq.h>
+#include <asm/cpu_caps.h>
 #include <asm/mmu.h>
 #include <hypercall.h>
 #include <errno.h>
@@ -22,10 +24,14 @@
 #include <mmio_dev.h>
 #include <ivshmem.h>
 #include <vmcs9900.h>
+#include <vm_stats.h>
 #include <asm/rtcm.h>
 #include <asm/irq.h>
 #include <ticks.h>
 #include <asm/cpuid.h>
+#include <asm/tsc.h>
+#include <asm/host_pm.h>
+#include <asm/rdt.h>
 #include <vroot_port.h>
 
 #define DBG_LEVEL_HYCALL	6U
@@ -395,10 +401,81 @@ int32_t hcall_set_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
 	return ret;
 }
 
-int32_t hcall_create_vcpu(__unused struct acrn_vcpu *vcpu, __unused struct acrn_vm *target_vm,
-		__unused uint64_t param1, __unused uint64_t param2)
+/**
+ * @brief get vcpu regs
+ *
+ * Snapshot the vcpu regs. It reads the architectural state of a vcpu of a
+ * paused VM back into the same layout consumed by hcall_set_vcpu_regs, so
+ * a saved vcpu can later be restored through HC_SET_VCPU_REGS.
+ * The function will return -1 if the target VM is not paused, the vcpu
+ * doesn't exist or it has never been launched.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 guest physical address. This gpa points to
+ *              struct acrn_vcpu_regs with vcpu_id filled in by the caller
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_get_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
 {
-	return 0;
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_vcpu_regs vcpu_regs;
+	struct acrn_vcpu *target_vcpu;
+	int32_t ret = -1;
+
+	/* Only snapshot while target_vm is paused so the state is stable */
+	if (is_paused_vm(target_vm) && (param2 != 0U)) {
+		if (copy_from_gpa(vm, &vcpu_regs, param2, sizeof(vcpu_regs)) != 0) {
+		} else if (vcpu_regs.vcpu_id >= target_vm->hw.created_vcpus) {
+			pr_err("%s: invalid vcpu_id for get_vcpu_regs\n", __func__);
+		} else {
+			target_vcpu = vcpu_from_vid(target_vm, vcpu_regs.vcpu_id);
+			/* a vcpu which never entered the guest has no VMCS
+			 * derived state worth saving.
+			 */
+			if ((target_vcpu->state != VCPU_OFFLINE) && target_vcpu->launched) {
+				(void)memset(&vcpu_regs.vcpu_regs, 0U, sizeof(struct acrn_regs));
+				vcpu_snapshot_regs(target_vcpu, &vcpu_regs.vcpu_regs);
+				ret = copy_to_gpa(vm, &vcpu_regs, param2, sizeof(vcpu_regs));
+			}
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * @brief hot-add a vcpu to the target VM
+ *
+ * Materialize one more vCPU on a created or running post-launched VM;
+ * the guest onlines it with INIT-SIPI once the Service VM announces it.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 guest physical address of a struct acrn_vcpu_create
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_create_vcpu(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_vcpu_create cv;
+	int32_t ret = -1;
+
+	if (param2 != 0U) {
+		if (copy_from_gpa(vm, &cv, param2, sizeof(cv)) != 0) {
+			pr_err("%s: Unable to copy param from vm %d\n", __func__, vm->vm_id);
+		} else {
+			ret = hotadd_vcpu(target_vm, cv.pcpu_id);
+		}
+	}
+
+	return ret;
 }
 
 /**
@@ -542,7 +619,22 @@ int32_t hcall_notify_ioreq_finish(__unused struct acrn_vcpu *vcpu, struct acrn_v
 		dev_dbg(DBG_LEVEL_HYCALL, "[%d] NOTIFY_FINISH for vcpu %d",
 			target_vm->vm_id, vcpu_id);
 
-		if (vcpu_id >= target_vm->hw.created_vcpus) {
+		if (vcpu_id == (uint16_t)ACRN_IOREQ_VCPUID_ALL) {
+			uint16_t i;
+
+			/*
+			 * Batched completion reaping: wake up every requestor vCPU whose
+			 * slot has reached the COMPLETE state, so the Service VM can fold
+			 * the per-request notification round-trips into one hypercall.
+			 */
+			foreach_vcpu(i, target_vm, target_vcpu) {
+				if ((get_io_req_state(target_vm, i) == ACRN_IOREQ_STATE_COMPLETE) &&
+				    (!target_vm->sw.is_polling_ioreq)) {
+					signal_event(&target_vcpu->events[VCPU_EVENT_IOREQ]);
+				}
+			}
+			ret = 0;
+		} else if (vcpu_id >= target_vm->hw.created_vcpus) {
 			pr_err("%s, failed to get VCPU %d context from VM %d\n",
 				__func__, vcpu_id, target_vm->vm_id);
 		} else {
@@ -605,12 +697,16 @@ static void add_vm_memory_region(struct acrn_vm *vm, struct acrn_vm *target_vm,
 	}
 
 	/* create gpa to hpa EPT mapping */
-	ept_add_mr(target_vm, pml4_page, hpa, region->gpa, region->size, prot);
+	ept_add_mr_locked(target_vm, pml4_page, hpa, region->gpa, region->size, prot);
 }
 
 /**
  *@pre is_service_vm(vm)
  */
+/**
+ * @pre the caller holds target_vm->ept_lock and flushes the guest TLB once
+ *      the whole batch of regions is installed.
+ */
 static int32_t set_vm_memory_region(struct acrn_vm *vm,
 	struct acrn_vm *target_vm, const struct vm_memory_region *region)
 {
@@ -628,7 +724,7 @@ static int32_t set_vm_memory_region(struct acrn_vm *vm,
 			}
 		} else {
 			if (ept_is_valid_mr(target_vm, region->gpa, region->size)) {
-				ept_del_mr(target_vm, pml4_page, region->gpa, region->size);
+				ept_del_mr_locked(target_vm, pml4_page, region->gpa, region->size);
 				ret = 0;
 			}
 		}
@@ -657,27 +753,65 @@ int32_t hcall_set_vm_memory_regions(struct acrn_vcpu *vcpu, struct acrn_vm *targ
 {
 	struct acrn_vm *vm = vcpu->vm;
 	struct set_regions regions;
-	struct vm_memory_region mr;
-	uint32_t idx;
+	struct vm_memory_region mrs[8];
+	struct gpa_iovec iov[ARRAY_SIZE(mrs)];
+	uint64_t add_start = ~0UL, add_end = 0UL;
+	uint32_t idx, i, nr;
 	int32_t ret = -1;
 
 	if (copy_from_gpa(vm, &regions, param1, sizeof(regions)) == 0) {
 
 		if (!is_poweroff_vm(target_vm) &&
 		    (is_severity_pass(target_vm->vm_id) || (target_vm->state != VM_RUNNING))) {
+			/*
+			 * A launch of a large post-launched VM delivers thousands of
+			 * region descriptors in one call. Apply them all under a single
+			 * EPT lock acquisition and issue one guest TLB invalidation at
+			 * the end instead of one per region.
+			 */
+			spinlock_obtain(&target_vm->ept_lock);
 			idx = 0U;
 			while (idx < regions.mr_num) {
-				if (copy_from_gpa(vm, &mr, regions.regions_gpa + idx * sizeof(mr), sizeof(mr)) != 0) {
+				/* fetch the descriptors a batch at a time, in one vectored copy */
+				nr = min(regions.mr_num - idx, (uint32_t)ARRAY_SIZE(mrs));
+				for (i = 0U; i < nr; i++) {
+					iov[i].h_ptr = &mrs[i];
+					iov[i].gpa = regions.regions_gpa + ((idx + i) * sizeof(mrs[0]));
+					iov[i].size = sizeof(mrs[0]);
+				}
+				if (copy_gpa_vectored(vm, iov, nr, true) != 0) {
 					pr_err("%s: Copy mr entry fail from vm\n", __func__);
 					break;
 				}
 
-				ret = set_vm_memory_region(vm, target_vm, &mr);
+				for (i = 0U; i < nr; i++) {
+					ret = set_vm_memory_region(vm, target_vm, &mrs[i]);
+					if (ret < 0) {
+						break;
+					}
+					if (mrs[i].type == MR_ADD) {
+						add_start = min(add_start, mrs[i].gpa);
+						add_end = max(add_end, mrs[i].gpa + mrs[i].size);
+					}
+				}
 				if (ret < 0) {
 					break;
 				}
-				idx++;
+				idx += nr;
+			}
+
+			/*
+			 * The regions are added piecemeal, so 1 GiB-aligned spans are
+			 * assembled from 2 MiB mappings. Coalesce them now that the
+			 * whole batch is installed.
+			 */
+			if ((ret == 0) && (add_end > add_start)) {
+				ept_promote_mr_locked(target_vm, (uint64_t *)target_vm->arch_vm.nworld_eptp,
+					add_start, add_end - add_start);
 			}
+			spinlock_release(&target_vm->ept_lock);
+
+			ept_flush_guest(target_vm);
 		} else {
 			pr_err("%p %s:target_vm is invalid or Targeting to service vm", target_vm, __func__);
 		}
@@ -761,6 +895,70 @@ int32_t hcall_write_protect_page(struct acrn_vcpu *vcpu, struct acrn_vm *target_
 	return ret;
 }
 
+/**
+ * @brief Control EPT dirty-page tracking of a VM
+ *
+ * Start logs every dirtied 4K guest page as a set bit in the Service VM
+ * provided bitmap, harvest re-arms the logging for the next round after the
+ * caller read and cleared the bitmap bits, stop disables the logging.
+ * The dirty bits of the EPT leaf entries are cleared on start/harvest so
+ * that PML logs the pages dirtied from that point on.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param1 not used
+ * @param param2 guest physical address. This gpa points to struct acrn_dirty_track_param
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_vm_dirty_track(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_dirty_track_param dirty_track;
+	uint64_t hpa;
+	int32_t ret = -EINVAL;
+
+	if (!is_poweroff_vm(target_vm) && is_ept_dirty_logging_supported() &&
+			(copy_from_gpa(vm, &dirty_track, param2, sizeof(dirty_track)) == 0)) {
+		switch (dirty_track.cmd) {
+		case ACRN_DIRTY_TRACK_START:
+			if ((dirty_track.bitmap_size != 0UL) &&
+					mem_aligned_check(dirty_track.bitmap_gpa, 8UL)) {
+				hpa = gpa2hpa(vm, dirty_track.bitmap_gpa);
+				if (hpa != INVALID_HPA) {
+					target_vm->dirty_bitmap = (uint64_t *)hpa2hva(hpa);
+					target_vm->dirty_bitmap_size = dirty_track.bitmap_size;
+					ept_clear_dirty(target_vm);
+					target_vm->dirty_track_active = true;
+					vm_make_request(target_vm, ACRN_REQUEST_DIRTY_TRACK);
+					ret = 0;
+				}
+			}
+			break;
+		case ACRN_DIRTY_TRACK_HARVEST:
+			if (target_vm->dirty_track_active) {
+				ept_clear_dirty(target_vm);
+				ret = 0;
+			}
+			break;
+		case ACRN_DIRTY_TRACK_STOP:
+			if (target_vm->dirty_track_active) {
+				target_vm->dirty_track_active = false;
+				vm_make_request(target_vm, ACRN_REQUEST_DIRTY_TRACK);
+				ret = 0;
+			}
+			break;
+		default:
+			pr_err("%s: invalid cmd %u", __func__, dirty_track.cmd);
+			break;
+		}
+	}
+
+	return ret;
+}
+
 /**
  * @brief translate guest physical address to host physical address
  *
@@ -1102,6 +1300,34 @@ int32_t hcall_get_cpu_pm_state(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm
 	return ret;
 }
 
+/**
+ * @brief Set a VM's HWP performance profile.
+ *
+ * The given minimum performance level is programmed into
+ * MSR_IA32_HWP_REQUEST whenever one of the target VM's vCPUs is switched
+ * in, guaranteeing a frequency floor from the first instruction. A value
+ * of 0 returns the VM to the hardware minimum (fully autonomous HWP).
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 HWP minimum performance level (0 - 255)
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_set_perf_profile(__unused struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	int32_t ret = -1;
+
+	if (is_hwp_active() && !is_poweroff_vm(target_vm) && (param2 <= 255UL)) {
+		target_vm->hwp_min_perf = (uint8_t)param2;
+		ret = 0;
+	}
+
+	return ret;
+}
+
 /**
  * @brief Get VCPU a VM's interrupt count data.
  *
@@ -1140,6 +1366,17 @@ int32_t hcall_vm_intr_monitor(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
 						intr_hdr->buffer[0] * TICKS_PER_MS;
 					break;
 
+				case INTR_CMD_SET_RATE_LIMIT:
+					/* buffer[0] is interrupts per second per entry, if 0 to cancel */
+					target_vm->intr_rate_limit_cost = (intr_hdr->buffer[0] == 0UL) ?
+						0UL : ((TICKS_PER_MS * 1000UL) / intr_hdr->buffer[0]);
+					break;
+
+				case INTR_CMD_GET_STORM_DATA:
+					intr_hdr->buf_cnt = ptirq_get_storm_data(target_vm,
+						intr_hdr->buffer, intr_hdr->buf_cnt);
+					break;
+
 				default:
 					/* if cmd wrong it goes here should not happen */
 					break;
@@ -1154,6 +1391,147 @@ int32_t hcall_vm_intr_monitor(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
 	return status;
 }
 
+/**
+ * @brief Register a run-state statistics page for a VM.
+ *
+ * The page is one page of Service VM memory; once registered, the
+ * target VM's vCPUs publish their scheduling and VM exit counters into
+ * it (see struct acrn_vm_stats). Passing a GPA of 0 unregisters the
+ * page.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param1 not used
+ * @param param2 guest physical address of one page of Service VM
+ *              memory, page aligned, or 0 to unregister
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_setup_vm_stats(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	int32_t status = -EINVAL;
+	uint64_t hpa;
+
+	if (!is_poweroff_vm(target_vm)) {
+		if (param2 == 0UL) {
+			status = vm_stats_setup(target_vm, NULL);
+		} else if (mem_aligned_check(param2, PAGE_SIZE)) {
+			hpa = gpa2hpa(vm, param2);
+			if (hpa != INVALID_HPA) {
+				status = vm_stats_setup(target_vm,
+					(struct acrn_vm_stats *)hpa2hva(hpa));
+			}
+		} else {
+			/* status initialized to -EINVAL */
+		}
+	}
+
+	return status;
+}
+
+/**
+ * @brief Reprogram one RDT CLOS at runtime.
+ *
+ * Writes a new capacity bitmask (L3/L2 CAT) or delay throttling value
+ * (MBA) into one CLOS on every domain instance of the resource, so a
+ * VM's cache or memory bandwidth allocation can be changed without a
+ * reboot. The layout of the parameter structure is struct
+ * acrn_rdt_config.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param param2 guest physical address of struct acrn_rdt_config
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_set_rdt_config(struct acrn_vcpu *vcpu, __unused struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_rdt_config cfg;
+	int32_t ret = -EINVAL;
+
+	if (copy_from_gpa(vcpu->vm, &cfg, param2, sizeof(cfg)) == 0) {
+		ret = write_rdt_config(cfg.res, cfg.clos, cfg.value);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Register or drop a pinned hypercall argument buffer
+ *
+ * The Service VM pins its stable argument buffers once; later hypercalls
+ * whose GPA parameters fall inside a pinned region skip the EPT walk in
+ * copy_from_gpa()/copy_to_gpa() and use the cached translation.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm unused
+ * @param param1 unused
+ * @param param2 guest physical address. This gpa points to struct acrn_hc_buf_pin
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_pin_hc_buffer(struct acrn_vcpu *vcpu, __unused struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_hc_buf_pin pin;
+	int32_t ret = -EINVAL;
+
+	if (copy_from_gpa(vcpu->vm, &pin, param2, sizeof(pin)) == 0) {
+		if (pin.op == ACRN_HC_BUF_PIN) {
+			ret = pin_hc_buffer(vcpu->vm, pin.gpa, pin.size, &pin.handle);
+			if (ret == 0) {
+				ret = copy_to_gpa(vcpu->vm, &pin, param2, sizeof(pin));
+			}
+		} else if (pin.op == ACRN_HC_BUF_UNPIN) {
+			ret = unpin_hc_buffer(vcpu->vm, pin.handle);
+		} else {
+			/* bad op, keep -EINVAL */
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Get the launch-phase timestamps of a VM.
+ *
+ * Copies the TSC stamps the hypervisor recorded while bringing the
+ * target VM up (create_vm entry/exit, first wake of the BSP) into a
+ * Service VM provided struct acrn_vm_launch_profile, so the device
+ * model can print one merged guest launch timeline. Stamps of phases
+ * that have not happened yet read as 0.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 guest physical address of struct acrn_vm_launch_profile
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_get_launch_profile(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+		__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm_launch_profile profile;
+	int32_t ret = -EINVAL;
+
+	if (!is_poweroff_vm(target_vm)) {
+		(void)memset(&profile, 0U, sizeof(profile));
+		profile.tsc_khz = get_tsc_khz();
+		profile.create_vm_entry = target_vm->create_vm_entry_tsc;
+		profile.create_vm_exit = target_vm->create_vm_exit_tsc;
+		profile.first_vcpu_launch = target_vm->first_vcpu_launch_tsc;
+
+		ret = copy_to_gpa(vcpu->vm, &profile, param2, sizeof(profile));
+	}
+
+	return ret;
+}
+
 /**
  * @brief set upcall notifier vector
  *
@@ -94,6 +94,7 @@ void free_irq(uint32_t irq)
 
 		free_irq_arch(irq);
 		free_irq_num(irq);
+		sync_irq_dispatch_arch();
 	}
 }
 
@@ -145,6 +146,7 @@ int32_t request_irq(uint32_t req_irq, irq_action_t action_fn, void *priv_data,
 				desc->priv_data = priv_data;
 				desc->action = action_fn;
 				spinlock_irqrestore_release(&desc->lock, rflags);
+				sync_irq_dispatch_arch();
 				ret = (int32_t)irq;
 			} else {
 				ret = -EBUSY;
@@ -171,6 +173,7 @@ void set_irq_trigger_mode(uint32_t irq, bool is_level_triggered)
 			desc->flags &= ~IRQF_LEVEL;
 		}
 		spinlock_irqrestore_release(&desc->lock, rflags);
+		sync_irq_dispatch_arch();
 	}
 }
 
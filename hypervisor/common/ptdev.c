@@ -12,15 +12,27 @@
 #include <irq.h>
 #include <logmsg.h>
 #include <asm/vtd.h>
+#include <asm/guest/assign.h>
 #include <ticks.h>
 
 #define PTIRQ_ENTRY_HASHBITS	9U
 #define PTIRQ_ENTRY_HASHSIZE	(1U << PTIRQ_ENTRY_HASHBITS)
 
+/* a storming entry stays hardware-masked for this long before retry */
+#define PTIRQ_RATE_MASK_MS	100UL
+/* bucket depth: bursts up to this many milliseconds at the configured
+ * rate pass through unthrottled
+ */
+#define PTIRQ_RATE_BURST_MS	20UL
+
 #define PTIRQ_BITMAP_ARRAY_SIZE	INT_DIV_ROUNDUP(CONFIG_MAX_PT_IRQ_ENTRIES, 64U)
 struct ptirq_remapping_info ptirq_entries[CONFIG_MAX_PT_IRQ_ENTRIES];
 static uint64_t ptirq_entry_bitmaps[PTIRQ_BITMAP_ARRAY_SIZE];
-spinlock_t ptdev_lock = { .head = 0U, .tail = 0U, };
+/* current/peak number of allocated entries, maintained under the ptdev_lock
+ * write side; the peak is used to right-size CONFIG_MAX_PT_IRQ_ENTRIES */
+static uint32_t ptirq_used_entries;
+static uint32_t ptirq_max_used_entries;
+rwlock_t ptdev_lock = { .rin = 0U, .rout = 0U, .win = 0U, .wout = 0U, };
 
 static struct ptirq_entry_head {
 	struct hlist_head list;
@@ -40,6 +52,7 @@ static inline uint16_t ptirq_alloc_entry_id(void)
 	return (id < CONFIG_MAX_PT_IRQ_ENTRIES) ? id: INVALID_PTDEV_ENTRY_ID;
 }
 
+/* @pre caller holds ptdev_lock, read side is enough for lookup-only users */
 struct ptirq_remapping_info *find_ptirq_entry(uint32_t intr_type,
 		const union source_id *sid, const struct acrn_vm *vm)
 {
@@ -91,6 +104,133 @@ static void ptirq_intr_delay_callback(void *data)
 	ptirq_enqueue_softirq(entry);
 }
 
+static inline uint64_t ptirq_rate_burst_ticks(const struct ptirq_remapping_info *entry)
+{
+	uint64_t burst = PTIRQ_RATE_BURST_MS * TICKS_PER_MS;
+
+	/* keep at least one interrupt's worth, or low limits never pass */
+	return (burst < entry->vm->intr_rate_limit_cost) ? entry->vm->intr_rate_limit_cost : burst;
+}
+
+/*
+ * Token bucket, all quantities in TSC ticks: elapsed wall time refills
+ * the bucket up to a burst's worth and each interrupt drains
+ * intr_rate_limit_cost. Runs in the entry's interrupt context only.
+ */
+static bool ptirq_rate_limit_exceeded(struct ptirq_remapping_info *entry)
+{
+	uint64_t cost = entry->vm->intr_rate_limit_cost;
+	uint64_t cap = ptirq_rate_burst_ticks(entry);
+	uint64_t now = cpu_ticks();
+	bool exceeded = false;
+
+	entry->rate_tokens += now - entry->rate_refill_ts;
+	entry->rate_refill_ts = now;
+	if (entry->rate_tokens > cap) {
+		entry->rate_tokens = cap;
+	}
+
+	if (entry->rate_tokens < cost) {
+		exceeded = true;
+	} else {
+		entry->rate_tokens -= cost;
+	}
+
+	return exceeded;
+}
+
+static void ptirq_rate_unmask_callback(void *data)
+{
+	struct ptirq_remapping_info *entry = (struct ptirq_remapping_info *) data;
+
+	/* grant a full bucket so the retry is not masked immediately */
+	entry->rate_tokens = ptirq_rate_burst_ticks(entry);
+	entry->rate_refill_ts = cpu_ticks();
+	entry->rate_masked = false;
+	if (entry->mask_cb != NULL) {
+		entry->mask_cb(entry, false);
+	}
+}
+
+/*
+ * Deferred destination chasing for migrated vCPUs.
+ *
+ * The balancer may move a vCPU several times in quick succession and every
+ * IRTE rewrite costs an interrupt entry cache flush, so a migration only
+ * marks the owning VM stale and arms a settle timer.  While migrations keep
+ * arriving the timer pushes the batch out again - placement that is still
+ * churning is not worth chasing - but only up to a bound, so a permanently
+ * busy balancer cannot starve the refresh.  When the window finally closes,
+ * every active entry of the stale VMs is refreshed in one pass.
+ */
+#define PTIRQ_DEST_SETTLE_MS	10UL
+#define PTIRQ_DEST_MAX_DEFER	8U
+
+static spinlock_t ptirq_dest_lock = { .head = 0U, .tail = 0U, };
+static struct hv_timer ptirq_dest_timer;
+static uint64_t ptirq_dest_stale_vms;
+static uint32_t ptirq_dest_gen;
+static uint32_t ptirq_dest_gen_seen;
+static uint32_t ptirq_dest_defers;
+
+static void ptirq_dest_update_callback(__unused void *data)
+{
+	struct ptirq_remapping_info *entry;
+	uint64_t stale_vms, bmap, rflags;
+	uint16_t word, bit, idx;
+
+	spinlock_irqsave_obtain(&ptirq_dest_lock, &rflags);
+	if ((ptirq_dest_gen != ptirq_dest_gen_seen) && (ptirq_dest_defers < PTIRQ_DEST_MAX_DEFER)) {
+		/* more vCPUs moved inside the settle window, wait again */
+		ptirq_dest_gen_seen = ptirq_dest_gen;
+		ptirq_dest_defers++;
+		update_timer(&ptirq_dest_timer, cpu_ticks() + (PTIRQ_DEST_SETTLE_MS * TICKS_PER_MS), 0UL);
+		(void)add_timer(&ptirq_dest_timer);
+		stale_vms = 0UL;
+	} else {
+		stale_vms = ptirq_dest_stale_vms;
+		ptirq_dest_stale_vms = 0UL;
+		ptirq_dest_defers = 0U;
+	}
+	spinlock_irqrestore_release(&ptirq_dest_lock, rflags);
+
+	if (stale_vms != 0UL) {
+		for (word = 0U; word < PTIRQ_BITMAP_ARRAY_SIZE; word++) {
+			bmap = ptirq_entry_bitmaps[word];
+			bit = ffs64(bmap);
+			while (bit < 64U) {
+				bitmap_clear_nolock(bit, &bmap);
+				idx = (word << 6U) + bit;
+				if (idx >= CONFIG_MAX_PT_IRQ_ENTRIES) {
+					break;
+				}
+				entry = &ptirq_entries[idx];
+				if (is_entry_active(entry) && (entry->vm != NULL) &&
+						bitmap_test(entry->vm->vm_id, &stale_vms)) {
+					ptirq_update_entry_dest(entry);
+				}
+				bit = ffs64(bmap);
+			}
+		}
+	}
+}
+
+void ptirq_notify_vcpu_placement(uint16_t vm_id)
+{
+	uint64_t rflags;
+
+	spinlock_irqsave_obtain(&ptirq_dest_lock, &rflags);
+	bitmap_set_nolock(vm_id, &ptirq_dest_stale_vms);
+	ptirq_dest_gen++;
+	if (!timer_is_started(&ptirq_dest_timer)) {
+		ptirq_dest_gen_seen = ptirq_dest_gen;
+		ptirq_dest_defers = 0U;
+		update_timer(&ptirq_dest_timer, cpu_ticks() + (PTIRQ_DEST_SETTLE_MS * TICKS_PER_MS), 0UL);
+		(void)add_timer(&ptirq_dest_timer);
+	}
+	spinlock_irqrestore_release(&ptirq_dest_lock, rflags);
+}
+
 struct ptirq_remapping_info *ptirq_dequeue_softirq(uint16_t pcpu_id)
 {
 	uint64_t rflags;
@@ -130,12 +270,20 @@ struct ptirq_remapping_info *ptirq_alloc_entry(struct acrn_vm *vm, uint32_t intr
 		entry->vm = vm;
 		entry->intr_count = 0UL;
 		entry->irte_idx = INVALID_IRTE_ID;
+		spinlock_init(&entry->entry_lock);
 
 		INIT_LIST_HEAD(&entry->softirq_node);
 
 		initialize_timer(&entry->intr_delay_timer, ptirq_intr_delay_callback, entry, 0UL, 0UL);
+		initialize_timer(&entry->rate_unmask_timer, ptirq_rate_unmask_callback, entry, 0UL, 0UL);
+		entry->rate_refill_ts = cpu_ticks();
 
 		entry->active = false;
+
+		ptirq_used_entries++;
+		if (ptirq_used_entries > ptirq_max_used_entries) {
+			ptirq_max_used_entries = ptirq_used_entries;
+		}
 	} else {
 		pr_err("Alloc ptdev irq entry failed");
 	}
@@ -150,13 +298,21 @@ void ptirq_release_entry(struct ptirq_remapping_info *entry)
 	CPU_INT_ALL_DISABLE(&rflags);
 	list_del_init(&entry->softirq_node);
 	del_timer(&entry->intr_delay_timer);
+	del_timer(&entry->rate_unmask_timer);
 	CPU_INT_ALL_RESTORE(rflags);
 
 	bitmap_clear_lock((entry->ptdev_entry_id) & 0x3FU, &ptirq_entry_bitmaps[entry->ptdev_entry_id >> 6U]);
+	ptirq_used_entries--;
 
 	(void)memset((void *)entry, 0U, sizeof(struct ptirq_remapping_info));
 }
 
+void ptirq_get_entry_stats(uint32_t *used, uint32_t *max_used)
+{
+	*used = ptirq_used_entries;
+	*max_used = ptirq_max_used_entries;
+}
+
 /* interrupt context */
 static void ptirq_interrupt_handler(__unused uint32_t irq, void *data)
 {
@@ -170,6 +326,25 @@ static void ptirq_interrupt_handler(__unused uint32_t irq, void *data)
 	if (!is_service_vm(entry->vm)) {
 		entry->intr_count++;
 
+		/*
+		 * Storm containment: when the rate budget is spent, mask
+		 * the source in hardware and arm the unmask retry timer.
+		 * The interrupt that tripped the limit is still delivered
+		 * so the guest driver can quiesce the device.
+		 */
+		if ((entry->vm->intr_rate_limit_cost != 0UL) && (entry->mask_cb != NULL) &&
+				(!entry->rate_masked) && ptirq_rate_limit_exceeded(entry)) {
+			entry->rate_masked = true;
+			entry->rate_masked_count++;
+			entry->mask_cb(entry, true);
+			update_timer(&entry->rate_unmask_timer,
+					cpu_ticks() + (PTIRQ_RATE_MASK_MS * TICKS_PER_MS), 0UL);
+			(void)add_timer(&entry->rate_unmask_timer);
+			pr_warn("vm%d: intr storm on pirq%u, masked for %lums (%lu times so far)",
+					entry->vm->vm_id, entry->allocated_pirq,
+					PTIRQ_RATE_MASK_MS, entry->rate_masked_count);
+		}
+
 		/* if delta > 0, set the delay TSC, dequeue to handle */
 		if (entry->vm->intr_inject_delay_delta > 0UL) {
 
@@ -234,6 +409,7 @@ void ptdev_init(void)
 {
 	if (get_pcpu_id() == BSP_CPU_ID) {
 		register_softirq(SOFTIRQ_PTDEV, ptirq_softirq);
+		initialize_timer(&ptirq_dest_timer, ptirq_dest_update_callback, NULL, 0UL, 0UL);
 	}
 	INIT_LIST_HEAD(&get_cpu_var(softirq_dev_entry_list));
 }
@@ -241,19 +417,30 @@ void ptdev_init(void)
 void ptdev_release_all_entries(const struct acrn_vm *vm)
 {
 	struct ptirq_remapping_info *entry;
-	uint16_t idx;
-
-	/* VM already down */
-	for (idx = 0U; idx < CONFIG_MAX_PT_IRQ_ENTRIES; idx++) {
-		entry = &ptirq_entries[idx];
-		if ((entry->vm == vm) && is_entry_active(entry)) {
-			spinlock_obtain(&ptdev_lock);
-			if (entry->release_cb != NULL) {
-				entry->release_cb(entry);
+	uint64_t bmap;
+	uint16_t word, bit, idx;
+
+	/* VM already down; only visit allocated entries */
+	for (word = 0U; word < PTIRQ_BITMAP_ARRAY_SIZE; word++) {
+		bmap = ptirq_entry_bitmaps[word];
+		bit = ffs64(bmap);
+		while (bit < 64U) {
+			bitmap_clear_nolock(bit, &bmap);
+			idx = (word << 6U) + bit;
+			if (idx >= CONFIG_MAX_PT_IRQ_ENTRIES) {
+				break;
 			}
-			ptirq_deactivate_entry(entry);
-			ptirq_release_entry(entry);
-			spinlock_release(&ptdev_lock);
+			entry = &ptirq_entries[idx];
+			if ((entry->vm == vm) && is_entry_active(entry)) {
+				rwlock_write_obtain(&ptdev_lock);
+				if (entry->release_cb != NULL) {
+					entry->release_cb(entry);
+				}
+				ptirq_deactivate_entry(entry);
+				ptirq_release_entry(entry);
+				rwlock_write_release(&ptdev_lock);
+			}
+			bit = ffs64(bmap);
 		}
 	}
 
@@ -262,24 +449,74 @@ void ptdev_release_all_entries(const struct acrn_vm *vm)
 uint32_t ptirq_get_intr_data(const struct acrn_vm *target_vm, uint64_t *buffer, uint32_t buffer_cnt)
 {
 	uint32_t index = 0U;
-	uint16_t i;
+	uint64_t bmap;
+	uint16_t word, bit, idx;
 	struct ptirq_remapping_info *entry;
 
-	for (i = 0U; i < CONFIG_MAX_PT_IRQ_ENTRIES; i++) {
-		entry = &ptirq_entries[i];
-		if (!is_entry_active(entry) || (entry->allocated_pirq == IRQ_INVALID)) {
-			continue;
+	for (word = 0U; word < PTIRQ_BITMAP_ARRAY_SIZE; word++) {
+		bmap = ptirq_entry_bitmaps[word];
+		bit = ffs64(bmap);
+		while ((bit < 64U) && (index <= (buffer_cnt - 2U))) {
+			bitmap_clear_nolock(bit, &bmap);
+			idx = (word << 6U) + bit;
+			if (idx >= CONFIG_MAX_PT_IRQ_ENTRIES) {
+				break;
+			}
+			entry = &ptirq_entries[idx];
+			if (is_entry_active(entry) &&
+				(entry->allocated_pirq != IRQ_INVALID) &&
+				(entry->vm == target_vm)) {
+				buffer[index] = entry->allocated_pirq;
+				buffer[index + 1U] = entry->intr_count;
+				index += 2U;
+			}
+			bit = ffs64(bmap);
 		}
-		if (entry->vm == target_vm) {
-			buffer[index] = entry->allocated_pirq;
-			buffer[index + 1U] = entry->intr_count;
+	}
 
-			index += 2U;
-			if (index > (buffer_cnt - 2U)) {
+	return index;
+}
+
+uint32_t ptirq_get_storm_data(const struct acrn_vm *target_vm, uint64_t *buffer, uint32_t buffer_cnt)
+{
+	uint32_t index = 0U;
+	uint64_t bmap;
+	uint16_t word, bit, idx;
+	struct ptirq_remapping_info *entry;
+
+	for (word = 0U; word < PTIRQ_BITMAP_ARRAY_SIZE; word++) {
+		bmap = ptirq_entry_bitmaps[word];
+		bit = ffs64(bmap);
+		while ((bit < 64U) && (index <= (buffer_cnt - 2U))) {
+			bitmap_clear_nolock(bit, &bmap);
+			idx = (word << 6U) + bit;
+			if (idx >= CONFIG_MAX_PT_IRQ_ENTRIES) {
 				break;
 			}
+			entry = &ptirq_entries[idx];
+			if (is_entry_active(entry) &&
+				(entry->allocated_pirq != IRQ_INVALID) &&
+				(entry->vm == target_vm)) {
+				buffer[index] = entry->allocated_pirq;
+				buffer[index + 1U] = entry->rate_masked_count;
+				index += 2U;
+			}
+			bit = ffs64(bmap);
 		}
 	}
 
 	return index;
 }
+
+void ptirq_set_mask_cb(const struct acrn_vm *vm, uint16_t virt_bdf, uint16_t entry_nr, ptirq_arch_mask_fn_t cb)
+{
+	struct ptirq_remapping_info *entry;
+	DEFINE_MSI_SID(virt_sid, virt_bdf, entry_nr);
+
+	rwlock_write_obtain(&ptdev_lock);
+	entry = find_ptirq_entry(PTDEV_INTR_MSI, &virt_sid, vm);
+	if (entry != NULL) {
+		entry->mask_cb = cb;
+	}
+	rwlock_write_release(&ptdev_lock);
+}
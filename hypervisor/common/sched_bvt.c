@@ -5,7 +5,9 @@
  */
 
 #include <list.h>
+#include <asm/lib/bits.h>
 #include <asm/per_cpu.h>
+#include <asm/cpu_caps.h>
 #include <schedule.h>
 #include <ticks.h>
 
@@ -114,6 +116,50 @@ static int64_t get_svt(struct thread_object *obj)
 	return svt;
 }
 
+/*
+ * Push one waiting thread to an idle pCPU which shares the LLC and is
+ * covered by the thread's cpu_affinity. The contended side pushes rather
+ * than the idle side stealing for two reasons: the migrate hand-off of a
+ * vCPU thread must run on the pCPU its VMCS was last active on, and an
+ * idle pCPU runs tickless so it has no periodic hook to steal from. The
+ * victim is the runqueue tail - the thread with the weakest virtual time
+ * claim, hence the one that would wait longest here.
+ */
+static void balance_runqueue(struct sched_control *ctl)
+{
+	struct sched_bvt_control *bvt_ctl = (struct sched_bvt_control *)ctl->priv;
+	struct thread_object *victim = NULL;
+	struct thread_object *tail, *curr;
+	uint16_t pcpu_id = ctl->pcpu_id;
+	uint64_t rflags;
+	uint16_t i;
+
+	obtain_schedule_lock(pcpu_id, &rflags);
+	if (!list_empty(&bvt_ctl->runqueue)) {
+		tail = container_of(bvt_ctl->runqueue.prev, struct thread_object, data);
+		if ((tail != ctl->curr_obj) && ((tail->cpu_affinity & ~(1UL << pcpu_id)) != 0UL)) {
+			victim = tail;
+		}
+	}
+	release_schedule_lock(pcpu_id, rflags);
+
+	/* candidate selection is racy by design - migrate_thread revalidates
+	 * the victim under both pCPUs' scheduler locks
+	 */
+	if (victim != NULL) {
+		for (i = 0U; i < get_pcpu_nums(); i++) {
+			if ((i != pcpu_id) && bitmap_test(i, &victim->cpu_affinity) &&
+					pcpus_share_llc(pcpu_id, i)) {
+				curr = sched_get_current(i);
+				if ((curr != NULL) && is_idle_thread(curr)) {
+					migrate_thread(victim, i);
+					break;
+				}
+			}
+		}
+	}
+}
+
 static void sched_tick_handler(void *param)
 {
 	struct sched_control  *ctl = (struct sched_control *)param;
@@ -123,6 +169,8 @@ static void sched_tick_handler(void *param)
 	uint16_t pcpu_id = get_pcpu_id();
 	uint64_t rflags;
 
+	balance_runqueue(ctl);
+
 	obtain_schedule_lock(pcpu_id, &rflags);
 	current = ctl->curr_obj;
 
@@ -157,15 +205,13 @@ static int sched_bvt_init(struct sched_control *ctl)
 	ctl->priv = bvt_ctl;
 	INIT_LIST_HEAD(&bvt_ctl->runqueue);
 
-	/* The tick_timer is periodically */
+	/* The periodic tick_timer only gets armed from pick_next when there
+	 * is competition for this pCPU, so a pCPU hosting a sole thread
+	 * stays tickless.
+	 */
 	initialize_timer(&bvt_ctl->tick_timer, sched_tick_handler, ctl,
 			cpu_ticks() + tick_period, tick_period);
 
-	if (add_timer(&bvt_ctl->tick_timer) < 0) {
-		pr_err("Failed to add schedule tick timer!");
-		ret = -1;
-	}
-
 	return ret;
 }
 
@@ -231,7 +277,9 @@ static struct thread_object *sched_bvt_pick_next(struct sched_control *ctl)
 	struct thread_object *next = NULL;
 	struct thread_object *current = ctl->curr_obj;
 	uint64_t now_tsc = cpu_ticks();
+	uint64_t tick_period = BVT_MCU_MS * TICKS_PER_MS;
 	uint64_t delta_mcu = 0U;
+	bool need_tick = false;
 
 	if (!is_idle_thread(current)) {
 		update_vt(current);
@@ -258,6 +306,7 @@ static struct thread_object *sched_bvt_pick_next(struct sched_control *ctl)
 			second_data = (struct sched_bvt_data *)second_obj->data;
 			delta_mcu = second_data->evt - first_data->evt;
 			first_data->run_countdown = v2p(delta_mcu, first_data->vt_ratio) + BVT_CSA_MCU;
+			need_tick = true;
 		} else {
 			first_data->run_countdown = UINT64_MAX;
 		}
@@ -267,6 +316,21 @@ static struct thread_object *sched_bvt_pick_next(struct sched_control *ctl)
 		next = &get_cpu_var(idle);
 	}
 
+	/* NOHZ-style tick control: the mcu accounting tick is only useful
+	 * while a second thread is runnable on this pCPU. A sole thread
+	 * (run_countdown is UINT64_MAX) or the idle loop runs without any
+	 * periodic scheduler interrupt; a wakeup which deepens the runqueue
+	 * forces a reschedule, which re-arms the tick right here.
+	 */
+	if (need_tick) {
+		if (!timer_is_started(&bvt_ctl->tick_timer)) {
+			update_timer(&bvt_ctl->tick_timer, now_tsc + tick_period, tick_period);
+			(void)add_timer(&bvt_ctl->tick_timer);
+		}
+	} else {
+		del_timer(&bvt_ctl->tick_timer);
+	}
+
 	return next;
 }
 
@@ -275,6 +339,25 @@ static void sched_bvt_sleep(struct thread_object *obj)
 	runqueue_remove(obj);
 }
 
+/*
+ * Pull a runnable object to the head of the runqueue by granting it the
+ * same virtual time credit a thread gets when waking from a long sleep
+ * (SVT minus one context switch allowance). Used by directed yield when
+ * a PAUSE-loop exit hints that this object holds a lock the current
+ * thread is spinning on; the unfairness is bounded by the CSA.
+ */
+static void sched_bvt_prioritize(struct thread_object *obj)
+{
+	struct sched_bvt_data *data = (struct sched_bvt_data *)obj->data;
+
+	if (is_inqueue(obj)) {
+		data->avt = get_svt(obj) - BVT_CSA_MCU;
+		data->evt = data->avt;
+		runqueue_remove(obj);
+		runqueue_add(obj);
+	}
+}
+
 static void sched_bvt_wake(struct thread_object *obj)
 {
 	struct sched_bvt_data *data;
@@ -299,5 +382,6 @@ struct acrn_scheduler sched_bvt = {
 	.pick_next	= sched_bvt_pick_next,
 	.sleep		= sched_bvt_sleep,
 	.wake		= sched_bvt_wake,
+	.prioritize	= sched_bvt_prioritize,
 	.deinit		= sched_bvt_deinit,
 };
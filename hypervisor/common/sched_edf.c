@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <list.h>
+#include <asm/per_cpu.h>
+#include <schedule.h>
+#include <ticks.h>
+
+/* class defaults, used for threads whose VM configures no reservation */
+#define EDF_RUNTIME_MS		4UL
+#define EDF_PERIOD_MS		10UL
+
+/* the full bandwidth of one pCPU, in per-mille; admission limit */
+#define EDF_TOTAL_BW		1000UL
+
+/*
+ * Each thread is a constant bandwidth server (CBS): it receives
+ * runtime_cycles of budget every period_cycles and competes with the
+ * earliest absolute deadline first. An exhausted budget is recharged
+ * with the deadline pushed one period out, so a misbehaving thread can
+ * never consume more than its reserved fraction of the pCPU.
+ */
+struct sched_edf_data {
+	/* keep list as the first item */
+	struct list_head list;
+
+	/* budget replenished every period */
+	uint64_t runtime_cycles;
+	uint64_t period_cycles;
+	/* relative deadline, defaults to the period */
+	uint64_t deadline_cycles;
+
+	/* absolute deadline the thread currently competes with */
+	uint64_t abs_deadline;
+	uint64_t last_cycles;
+	/* budget left in the current period */
+	int64_t left_cycles;
+};
+
+/*
+ * @pre obj != NULL
+ * @pre obj->data != NULL
+ */
+static bool is_inqueue(struct thread_object *obj)
+{
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+	return !list_empty(&data->list);
+}
+
+/*
+ * @pre obj != NULL
+ * @pre obj->data != NULL
+ * @pre obj->sched_ctl != NULL
+ * @pre obj->sched_ctl->priv != NULL
+ */
+static void runqueue_add(struct thread_object *obj)
+{
+	struct sched_edf_control *edf_ctl =
+		(struct sched_edf_control *)obj->sched_ctl->priv;
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+	struct list_head *pos;
+	struct thread_object *iter_obj;
+	struct sched_edf_data *iter_data;
+
+	/* the runqueue is ordered by absolute deadline, earliest first */
+	if (list_empty(&edf_ctl->runqueue)) {
+		list_add(&data->list, &edf_ctl->runqueue);
+	} else {
+		list_for_each(pos, &edf_ctl->runqueue) {
+			iter_obj = container_of(pos, struct thread_object, data);
+			iter_data = (struct sched_edf_data *)iter_obj->data;
+			if (iter_data->abs_deadline > data->abs_deadline) {
+				list_add_node(&data->list, pos->prev, pos);
+				break;
+			}
+		}
+		if (!is_inqueue(obj)) {
+			list_add_tail(&data->list, &edf_ctl->runqueue);
+		}
+	}
+}
+
+/*
+ * @pre obj != NULL
+ * @pre obj->data != NULL
+ */
+static void runqueue_remove(struct thread_object *obj)
+{
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+
+	list_del_init(&data->list);
+}
+
+/*
+ * CBS recharge after the budget ran dry: refill the budget and push the
+ * deadline out one period per refill, demoting the thread behind the
+ * servers that still hold budget. Counted per recharge so the Service
+ * VM can spot reservations sized too small for their workload.
+ *
+ * @pre obj != NULL
+ * @pre obj->data != NULL
+ */
+static void cbs_recharge(struct thread_object *obj)
+{
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+
+	while (data->left_cycles <= 0) {
+		data->left_cycles += (int64_t)data->runtime_cycles;
+		data->abs_deadline += data->period_cycles;
+	}
+	obj->overrun_cnt++;
+}
+
+static void sched_tick_handler(void *param)
+{
+	struct sched_control *ctl = (struct sched_control *)param;
+	struct sched_edf_control *edf_ctl = (struct sched_edf_control *)ctl->priv;
+	struct sched_edf_data *data, *first_data;
+	struct thread_object *current, *first_obj;
+	uint16_t pcpu_id = get_pcpu_id();
+	uint64_t now = cpu_ticks();
+	uint64_t rflags;
+	bool resched = false;
+
+	obtain_schedule_lock(pcpu_id, &rflags);
+	current = ctl->curr_obj;
+	/* If no vCPU start scheduling, ignore this tick */
+	if (current != NULL) {
+		if (!(is_idle_thread(current) && list_empty(&edf_ctl->runqueue))) {
+			if (is_idle_thread(current)) {
+				resched = true;
+			} else {
+				data = (struct sched_edf_data *)current->data;
+				/* consume the left_cycles of current thread_object */
+				data->left_cycles -= (int64_t)(now - data->last_cycles);
+				data->last_cycles = now;
+				if (data->left_cycles <= 0) {
+					resched = true;
+				} else if (!list_empty(&edf_ctl->runqueue)) {
+					/* preempt when a pending thread's deadline
+					 * got ahead of the running one's */
+					first_obj = get_first_item(&edf_ctl->runqueue,
+							struct thread_object, data);
+					first_data = (struct sched_edf_data *)first_obj->data;
+					if ((first_obj != current) &&
+						(first_data->abs_deadline < data->abs_deadline)) {
+						resched = true;
+					}
+				}
+			}
+			if (resched) {
+				make_reschedule_request(pcpu_id, DEL_MODE_IPI);
+			}
+		}
+	}
+	release_schedule_lock(pcpu_id, rflags);
+}
+
+/*
+ * @pre ctl->pcpu_id == get_pcpu_id()
+ */
+static int sched_edf_init(struct sched_control *ctl)
+{
+	struct sched_edf_control *edf_ctl = &per_cpu(sched_edf_ctl, ctl->pcpu_id);
+	uint64_t tick_period = TICKS_PER_MS;
+	int ret = 0;
+
+	ASSERT(get_pcpu_id() == ctl->pcpu_id, "Init scheduler on wrong CPU!");
+
+	ctl->priv = edf_ctl;
+	INIT_LIST_HEAD(&edf_ctl->runqueue);
+	edf_ctl->used_bw = 0UL;
+
+	/* The tick_timer is periodically */
+	initialize_timer(&edf_ctl->tick_timer, sched_tick_handler, ctl,
+			cpu_ticks() + tick_period, tick_period);
+
+	if (add_timer(&edf_ctl->tick_timer) < 0) {
+		pr_err("Failed to add schedule tick timer!");
+		ret = -1;
+	}
+	return ret;
+}
+
+static void sched_edf_deinit(struct sched_control *ctl)
+{
+	struct sched_edf_control *edf_ctl = (struct sched_edf_control *)ctl->priv;
+	del_timer(&edf_ctl->tick_timer);
+}
+
+static void sched_edf_init_data(struct thread_object *obj)
+{
+	struct sched_edf_control *edf_ctl = &per_cpu(sched_edf_ctl, obj->pcpu_id);
+	struct sched_edf_data *data;
+	uint64_t bw;
+
+	data = (struct sched_edf_data *)obj->data;
+	INIT_LIST_HEAD(&data->list);
+	data->runtime_cycles = (obj->reserve_runtime != 0UL) ?
+			obj->reserve_runtime : (EDF_RUNTIME_MS * TICKS_PER_MS);
+	data->period_cycles = (obj->reserve_period != 0UL) ?
+			obj->reserve_period : (EDF_PERIOD_MS * TICKS_PER_MS);
+	data->deadline_cycles = (obj->reserve_deadline != 0UL) ?
+			obj->reserve_deadline : data->period_cycles;
+
+	/* admission control: a reservation this pCPU can no longer carry is
+	 * demoted to the class defaults. Thread data init has no failure
+	 * path, so the demotion is loud rather than fatal and shows up in
+	 * the overrun counter once the demoted thread needs more than the
+	 * default bandwidth.
+	 */
+	bw = (data->runtime_cycles * EDF_TOTAL_BW) / data->period_cycles;
+	if ((edf_ctl->used_bw + bw) > EDF_TOTAL_BW) {
+		pr_err("%s: reservation of %s overcommits pCPU%u, using defaults",
+			__func__, obj->name, obj->pcpu_id);
+		data->runtime_cycles = EDF_RUNTIME_MS * TICKS_PER_MS;
+		data->period_cycles = EDF_PERIOD_MS * TICKS_PER_MS;
+		data->deadline_cycles = data->period_cycles;
+		bw = (data->runtime_cycles * EDF_TOTAL_BW) / data->period_cycles;
+	}
+	edf_ctl->used_bw += bw;
+
+	data->left_cycles = (int64_t)data->runtime_cycles;
+	data->abs_deadline = cpu_ticks() + data->deadline_cycles;
+}
+
+static void sched_edf_deinit_data(struct thread_object *obj)
+{
+	struct sched_edf_control *edf_ctl = &per_cpu(sched_edf_ctl, obj->pcpu_id);
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+	uint64_t bw;
+
+	/* hand the admitted bandwidth back */
+	bw = (data->runtime_cycles * EDF_TOTAL_BW) / data->period_cycles;
+	edf_ctl->used_bw = (edf_ctl->used_bw > bw) ? (edf_ctl->used_bw - bw) : 0UL;
+}
+
+static struct thread_object *sched_edf_pick_next(struct sched_control *ctl)
+{
+	struct sched_edf_control *edf_ctl = (struct sched_edf_control *)ctl->priv;
+	struct thread_object *next = NULL;
+	struct thread_object *current = NULL;
+	struct sched_edf_data *data;
+	uint64_t now = cpu_ticks();
+
+	current = ctl->curr_obj;
+	/* Ignore the idle object, inactive objects */
+	if (!is_idle_thread(current) && is_inqueue(current)) {
+		data = (struct sched_edf_data *)current->data;
+		data->left_cycles -= (int64_t)(now - data->last_cycles);
+		if (data->left_cycles <= 0) {
+			cbs_recharge(current);
+		}
+		/* reposition under the (possibly postponed) deadline */
+		runqueue_remove(current);
+		runqueue_add(current);
+	}
+
+	/* the head of the runqueue holds the earliest deadline; take the
+	 * idle object when nothing is runnable */
+	if (!list_empty(&edf_ctl->runqueue)) {
+		next = get_first_item(&edf_ctl->runqueue, struct thread_object, data);
+		data = (struct sched_edf_data *)next->data;
+		data->last_cycles = now;
+		if (data->left_cycles <= 0) {
+			cbs_recharge(next);
+		}
+	} else {
+		next = &get_cpu_var(idle);
+	}
+
+	return next;
+}
+
+static void sched_edf_sleep(struct thread_object *obj)
+{
+	runqueue_remove(obj);
+}
+
+static void sched_edf_wake(struct thread_object *obj)
+{
+	struct sched_edf_data *data = (struct sched_edf_data *)obj->data;
+	uint64_t now = cpu_ticks();
+
+	/* CBS wakeup rule: keep the remaining budget and deadline only when
+	 * spending that budget before the deadline cannot exceed the
+	 * reserved bandwidth; otherwise start a fresh period from now.
+	 */
+	if ((data->left_cycles <= 0) || (data->abs_deadline <= now) ||
+		(((uint64_t)data->left_cycles * data->period_cycles) >
+		 ((data->abs_deadline - now) * data->runtime_cycles))) {
+		data->left_cycles = (int64_t)data->runtime_cycles;
+		data->abs_deadline = now + data->deadline_cycles;
+	}
+	data->last_cycles = now;
+	runqueue_add(obj);
+}
+
+struct acrn_scheduler sched_edf = {
+	.name		= "sched_edf",
+	.init		= sched_edf_init,
+	.init_data	= sched_edf_init_data,
+	.pick_next	= sched_edf_pick_next,
+	.sleep		= sched_edf_sleep,
+	.wake		= sched_edf_wake,
+	.deinit_data	= sched_edf_deinit_data,
+	.deinit		= sched_edf_deinit,
+};
@@ -12,7 +12,12 @@
 #include <asm/lapic.h>
 #include <schedule.h>
 #include <sprintf.h>
+#include <ticks.h>
+#include <trace.h>
 #include <asm/irq.h>
+#include <asm/cpu_caps.h>
+#include <asm/vm_config.h>
+#include <logmsg.h>
 
 bool is_idle_thread(const struct thread_object *obj)
 {
@@ -32,6 +37,20 @@ static inline bool is_running(const struct thread_object *obj)
 
 static inline void set_thread_status(struct thread_object *obj, enum thread_object_state status)
 {
+	uint64_t now = cpu_ticks();
+
+	/* charge the time since the last transition to the state being left */
+	if (obj->status == THREAD_STS_RUNNING) {
+		obj->run_cycles += now - obj->state_tsc;
+	} else if (obj->status == THREAD_STS_RUNNABLE) {
+		obj->runnable_cycles += now - obj->state_tsc;
+	} else {
+		/* blocked time is not accounted */
+	}
+	if (status == THREAD_STS_RUNNING) {
+		obj->sched_in_cnt++;
+	}
+	obj->state_tsc = now;
 	obj->status = status;
 }
 
@@ -61,6 +80,70 @@ uint16_t sched_get_pcpuid(const struct thread_object *obj)
 	return obj->pcpu_id;
 }
 
+/*
+ * Admission check for the topology constraints a VM is configured with
+ * (GUEST_FLAG_EXCLUSIVE_CORE, GUEST_FLAG_NO_SMT_SHARING and
+ * GUEST_FLAG_SAME_LLC). The constraints are checked against the static
+ * cpu_affinity of every other configured VM, so a violating layout is
+ * refused at VM creation instead of surfacing later as jitter on the
+ * victim's vCPUs. The config tools flag the same violations at build
+ * time; this is the runtime backstop for affinity masks narrowed
+ * through the create-VM hypercall.
+ */
+bool sched_affinity_admissible(uint16_t vm_id, uint64_t guest_flags, uint64_t pcpu_bitmap)
+{
+	uint64_t others = 0UL, tmp, sib;
+	uint16_t id, pcpu1, pcpu2;
+	bool admissible = true;
+
+	for (id = 0U; id < CONFIG_MAX_VM_NUM; id++) {
+		if (id != vm_id) {
+			others |= get_vm_config(id)->cpu_affinity;
+		}
+	}
+
+	if (((guest_flags & GUEST_FLAG_EXCLUSIVE_CORE) != 0UL) &&
+			((pcpu_bitmap & others) != 0UL)) {
+		pr_err("vm %u: pcpus 0x%lx are configured exclusive but shared with other VMs",
+			vm_id, pcpu_bitmap & others);
+		admissible = false;
+	}
+
+	if ((guest_flags & GUEST_FLAG_NO_SMT_SHARING) != 0UL) {
+		tmp = pcpu_bitmap;
+		while (tmp != 0UL) {
+			pcpu1 = ffs64(tmp);
+			bitmap_clear_nolock(pcpu1, &tmp);
+			sib = others & ~pcpu_bitmap;
+			while (sib != 0UL) {
+				pcpu2 = ffs64(sib);
+				bitmap_clear_nolock(pcpu2, &sib);
+				if (pcpus_are_smt_siblings(pcpu1, pcpu2)) {
+					pr_err("vm %u: pcpu %u shares a physical core with pcpu %u of another VM",
+						vm_id, pcpu1, pcpu2);
+					admissible = false;
+				}
+			}
+		}
+	}
+
+	if ((guest_flags & GUEST_FLAG_SAME_LLC) != 0UL) {
+		pcpu1 = ffs64(pcpu_bitmap);
+		tmp = pcpu_bitmap;
+		while (tmp != 0UL) {
+			pcpu2 = ffs64(tmp);
+			bitmap_clear_nolock(pcpu2, &tmp);
+			if (!pcpus_share_llc(pcpu1, pcpu2)) {
+				pr_err("vm %u: pcpus %u and %u do not share the last level cache",
+					vm_id, pcpu1, pcpu2);
+				admissible = false;
+			}
+		}
+	}
+
+	return admissible;
+}
+
 void init_sched(uint16_t pcpu_id)
 {
 	struct sched_control *ctl = &per_cpu(sched_ctl, pcpu_id);
@@ -80,6 +163,9 @@ void init_sched(uint16_t pcpu_id)
 #endif
 #ifdef CONFIG_SCHED_PRIO
 	ctl->scheduler = &sched_prio;
+#endif
+#ifdef CONFIG_SCHED_EDF
+	ctl->scheduler = &sched_edf;
 #endif
 	if (ctl->scheduler->init != NULL) {
 		ctl->scheduler->init(ctl);
@@ -135,7 +221,13 @@ void make_reschedule_request(uint16_t pcpu_id, uint16_t delmode)
 	if (get_pcpu_id() != pcpu_id) {
 		switch (delmode) {
 		case DEL_MODE_IPI:
-			send_single_ipi(pcpu_id, NOTIFY_VCPU_VECTOR);
+			/* if the target pCPU sits in governed idle with the
+			 * monitor armed on ctl->flags, the locked set above
+			 * has already woken it; the IPI would only add cost
+			 */
+			if (!cpu_idle_mwait_armed(pcpu_id)) {
+				send_single_ipi(pcpu_id, NOTIFY_VCPU_VECTOR);
+			}
 			break;
 		case DEL_MODE_INIT:
 			send_single_init(pcpu_id);
@@ -170,6 +262,16 @@ void schedule(void)
 
 	/* If we picked different sched object, switch context */
 	if (prev != next) {
+		uint64_t name[2];
+
+		(void)memcpy_s(name, sizeof(name), next->name, sizeof(name));
+		TRACE_2L(TRACE_SCHED_NEXT, name[0], name[1]);
+
+		/* start pulling next's context in while prev's is saved */
+		if (next->prefetch != NULL) {
+			next->prefetch(next);
+		}
+
 		if (prev != NULL) {
 			if (prev->switch_out != NULL) {
 				prev->switch_out(prev);
@@ -248,6 +350,73 @@ void yield_current(void)
 	make_reschedule_request(get_pcpu_id(), DEL_MODE_IPI);
 }
 
+/*
+ * Boost a runnable thread on its own pCPU so it is picked next there.
+ * Nothing happens if the thread is already running or blocked, or if
+ * its scheduler has no notion of a priority boost.
+ */
+void yield_to(struct thread_object *obj)
+{
+	uint16_t pcpu_id = obj->pcpu_id;
+	struct acrn_scheduler *scheduler = per_cpu(sched_ctl, pcpu_id).scheduler;
+	uint64_t rflag;
+
+	obtain_schedule_lock(pcpu_id, &rflag);
+	if ((obj->status == THREAD_STS_RUNNABLE) && (scheduler->prioritize != NULL)) {
+		scheduler->prioritize(obj);
+		make_reschedule_request(pcpu_id, DEL_MODE_IPI);
+	}
+	release_schedule_lock(pcpu_id, rflag);
+}
+
+/*
+ * Move a waiting thread to another pCPU within its cpu_affinity. The
+ * thread's migrate callback may veto the move and also performs the arch
+ * specific hand-off (e.g. flushing the VMCS of a vCPU thread), which is
+ * why this must run on the pCPU the thread currently belongs to. Nothing
+ * happens if the thread is running, blocked or re-homed concurrently.
+ *
+ * @pre get_pcpu_id() == obj->pcpu_id
+ */
+void migrate_thread(struct thread_object *obj, uint16_t dest_pcpu_id)
+{
+	uint16_t src_pcpu_id = obj->pcpu_id;
+	uint16_t first, second;
+	uint64_t rflag;
+	bool moved = true;
+
+	if (src_pcpu_id != dest_pcpu_id) {
+		/* obtain both pCPUs' locks in a fixed order to avoid deadlock
+		 * with a balancer running the opposite direction
+		 */
+		first = (src_pcpu_id < dest_pcpu_id) ? src_pcpu_id : dest_pcpu_id;
+		second = (src_pcpu_id < dest_pcpu_id) ? dest_pcpu_id : src_pcpu_id;
+		obtain_schedule_lock(first, &rflag);
+		spinlock_obtain(&per_cpu(sched_ctl, second).scheduler_lock);
+
+		if ((obj->pcpu_id == src_pcpu_id) && (obj->status == THREAD_STS_RUNNABLE) &&
+				bitmap_test(dest_pcpu_id, &obj->cpu_affinity) &&
+				(get_scheduler(src_pcpu_id)->sleep != NULL) &&
+				(get_scheduler(dest_pcpu_id)->wake != NULL)) {
+			get_scheduler(src_pcpu_id)->sleep(obj);
+			if (obj->migrate != NULL) {
+				moved = obj->migrate(obj, dest_pcpu_id);
+			}
+			if (moved) {
+				obj->pcpu_id = dest_pcpu_id;
+				obj->sched_ctl = &per_cpu(sched_ctl, dest_pcpu_id);
+				get_scheduler(dest_pcpu_id)->wake(obj);
+				make_reschedule_request(dest_pcpu_id, DEL_MODE_IPI);
+			} else {
+				get_scheduler(src_pcpu_id)->wake(obj);
+			}
+		}
+
+		spinlock_release(&per_cpu(sched_ctl, second).scheduler_lock);
+		release_schedule_lock(first, rflag);
+	}
+}
+
 void run_thread(struct thread_object *obj)
 {
 	uint64_t rflag;
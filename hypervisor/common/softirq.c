@@ -8,8 +8,20 @@
 #include <asm/lib/bits.h>
 #include <asm/cpu.h>
 #include <asm/per_cpu.h>
+#include <asm/lapic.h>
+#include <ticks.h>
 #include <softirq.h>
 
+/*
+ * Budget for one do_softirq() invocation. Softirqs run with interrupts
+ * re-enabled on the exit path of every interrupt, so without a bound a
+ * timer storm can extend a vCPU's exit handling arbitrarily. Once the
+ * budget is burnt the remaining pending bits are left set and a self
+ * notification IPI is sent, so the leftovers are drained in a fresh
+ * bounded pass on the next interrupt window instead of this one.
+ */
+#define SOFTIRQ_BUDGET_US	20U
+
 static softirq_handler softirq_handlers[NR_SOFTIRQS];
 
 void init_softirq(void)
@@ -32,17 +44,26 @@ void fire_softirq(uint16_t nr)
 	bitmap_set_lock(nr, &per_cpu(softirq_pending, get_pcpu_id()));
 }
 
-static void do_softirq_internal(uint16_t cpu_id)
+static bool do_softirq_internal(uint16_t cpu_id, uint64_t deadline)
 {
 	volatile uint64_t *softirq_pending_bitmap =
 			&per_cpu(softirq_pending, cpu_id);
 	uint16_t nr = ffs64(*softirq_pending_bitmap);
+	uint64_t start, now = cpu_ticks();
+	bool budget_left = true;
 
-	while (nr < NR_SOFTIRQS) {
+	while ((nr < NR_SOFTIRQS) && budget_left) {
 		bitmap_clear_lock(nr, softirq_pending_bitmap);
+		start = now;
 		(*softirq_handlers[nr])(cpu_id);
+		now = cpu_ticks();
+		per_cpu(softirq_cycles, cpu_id)[nr] += now - start;
+		per_cpu(softirq_cnt, cpu_id)[nr]++;
+		budget_left = (now < deadline);
 		nr = ffs64(*softirq_pending_bitmap);
 	}
+
+	return budget_left;
 }
 
 /*
@@ -51,15 +72,25 @@ static void do_softirq_internal(uint16_t cpu_id)
 void do_softirq(void)
 {
 	uint16_t cpu_id = get_pcpu_id();
+	uint64_t deadline;
+	bool budget_left;
 
 	if (per_cpu(softirq_servicing, cpu_id) == 0U) {
 		per_cpu(softirq_servicing, cpu_id) = 1U;
+		deadline = cpu_ticks() + us_to_ticks(SOFTIRQ_BUDGET_US);
 
 		CPU_IRQ_ENABLE_ON_CONFIG();
-		do_softirq_internal(cpu_id);
+		budget_left = do_softirq_internal(cpu_id, deadline);
 		CPU_IRQ_DISABLE_ON_CONFIG();
 
-		do_softirq_internal(cpu_id);
+		if (budget_left) {
+			budget_left = do_softirq_internal(cpu_id, deadline);
+		}
+
+		if (!budget_left && (per_cpu(softirq_pending, cpu_id) != 0UL)) {
+			per_cpu(softirq_overrun_cnt, cpu_id)++;
+			send_single_ipi(cpu_id, NOTIFY_VCPU_VECTOR);
+		}
 		per_cpu(softirq_servicing, cpu_id) = 0U;
 	}
 }
@@ -14,6 +14,7 @@
 #include <softirq.h>
 #include <trace.h>
 #include <asm/irq.h>
+#include <asm/notify.h>
 #include <ticks.h>
 #include <hw/hw_timer.h>
 
@@ -52,43 +53,115 @@ static void run_timer(const struct hv_timer *timer)
 	TRACE_2L(TRACE_TIMER_ACTION_PCKUP, timer->timeout, 0UL);
 }
 
-static inline void update_physical_timer(struct per_cpu_timers *cpu_timer)
+static inline uint64_t timer_jiffy(uint64_t tsc)
 {
-	struct hv_timer *timer = NULL;
+	return tsc >> TIMER_WHEEL_SHIFT;
+}
 
-	/* find the next event timer */
-	if (!list_empty(&cpu_timer->timer_list)) {
-		timer = container_of((&cpu_timer->timer_list)->next,
-			struct hv_timer, node);
+static void update_physical_timer(struct per_cpu_timers *cpu_timer)
+{
+	uint64_t deadline = 0UL;
+	uint64_t slot, boundary;
+	uint32_t i, level;
+	const struct list_head *pos;
+	struct list_head *bucket;
+	const struct hv_timer *timer;
+
+	/* the earliest exact deadline lives in the first non-empty level 0 bucket */
+	for (i = 0U; i < TIMER_WHEEL_SLOTS; i++) {
+		slot = (cpu_timer->last_jiffy + i) & (TIMER_WHEEL_SLOTS - 1UL);
+		if ((cpu_timer->occupancy[0U] & (1UL << slot)) != 0UL) {
+			bucket = &cpu_timer->wheel[0U][slot];
+			if (list_empty(bucket)) {
+				/* clear the hint bit left behind by del_timer() */
+				cpu_timer->occupancy[0U] &= ~(1UL << slot);
+			} else {
+				list_for_each(pos, bucket) {
+					timer = container_of(pos, struct hv_timer, node);
+					if ((deadline == 0UL) || (timer->timeout < deadline)) {
+						deadline = timer->timeout;
+					}
+				}
+				break;
+			}
+		}
+	}
 
+	/* higher levels only need an interrupt at their next cascade point */
+	for (level = 1U; level < TIMER_WHEEL_LEVELS; level++) {
+		if (cpu_timer->occupancy[level] != 0UL) {
+			boundary = ((cpu_timer->last_jiffy >> (TIMER_WHEEL_SLOT_BITS * level)) + 1UL)
+					<< ((TIMER_WHEEL_SLOT_BITS * level) + TIMER_WHEEL_SHIFT);
+			if ((deadline == 0UL) || (boundary < deadline)) {
+				deadline = boundary;
+			}
+		}
+	}
+
+	if ((deadline != 0UL) && (!cpu_timer->pt_tsc_deadline)) {
 		/* it is okay to program a expired time */
-		msr_write(MSR_IA32_TSC_DEADLINE, timer->timeout);
+		msr_write(MSR_IA32_TSC_DEADLINE, deadline);
 	}
+	cpu_timer->deadline = deadline;
 }
 
 /*
- * return true if we add the timer on the timer_list head
+ * Hash the timer into the wheel bucket matching its deadline: level n covers
+ * deltas of [64^n, 64^(n+1)) base buckets, so insertion is O(1) regardless of
+ * how many timers are armed on this pCPU.
  */
-static bool local_add_timer(struct per_cpu_timers *cpu_timer,
+static void local_add_timer(struct per_cpu_timers *cpu_timer,
 			struct hv_timer *timer)
 {
-	struct list_head *pos, *prev;
-	struct hv_timer *tmp;
-	uint64_t tsc = timer->timeout;
-
-	prev = &cpu_timer->timer_list;
-	list_for_each(pos, &cpu_timer->timer_list) {
-		tmp = container_of(pos, struct hv_timer, node);
-		if (tmp->timeout < tsc) {
-			prev = &tmp->node;
-		} else {
-			break;
+	uint64_t exp = timer_jiffy(timer->timeout);
+	uint64_t delta = (exp > cpu_timer->last_jiffy) ? (exp - cpu_timer->last_jiffy) : 0UL;
+	uint64_t slot;
+	uint32_t level = 0U;
+
+	if (delta == 0UL) {
+		/* already due: keep it at the current wheel position */
+		exp = cpu_timer->last_jiffy;
+	} else if (delta >= (1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))) {
+		/* beyond the wheel horizon: park it at the far edge, it will cascade again */
+		exp = cpu_timer->last_jiffy + (1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1UL;
+		level = TIMER_WHEEL_LEVELS - 1U;
+	} else {
+		while (delta >= (1UL << (TIMER_WHEEL_SLOT_BITS * (level + 1U)))) {
+			level++;
 		}
 	}
 
-	list_add(&timer->node, prev);
+	slot = (exp >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1UL);
+	list_add(&timer->node, &cpu_timer->wheel[level][slot]);
+	cpu_timer->occupancy[level] |= (1UL << slot);
+}
+
+/*
+ * Move the timers parked at the current cascade point of each higher level
+ * down into their finer-grained buckets.
+ */
+static void cascade_timers(struct per_cpu_timers *cpu_timer)
+{
+	const struct list_head *pos, *n;
+	struct list_head *bucket;
+	struct hv_timer *timer;
+	uint64_t slot;
+	uint32_t level;
 
-	return (prev == &cpu_timer->timer_list);
+	for (level = 1U; level < TIMER_WHEEL_LEVELS; level++) {
+		if ((cpu_timer->last_jiffy & ((1UL << (TIMER_WHEEL_SLOT_BITS * level)) - 1UL)) != 0UL) {
+			break;
+		}
+		slot = (cpu_timer->last_jiffy >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1UL);
+		bucket = &cpu_timer->wheel[level][slot];
+		list_for_each_safe(pos, n, bucket) {
+			timer = container_of(pos, struct hv_timer, node);
+			list_del_init(&timer->node);
+			local_add_timer(cpu_timer, timer);
+			cpu_timer->stats_cascaded++;
+		}
+		cpu_timer->occupancy[level] &= ~(1UL << slot);
+	}
 }
 
 int32_t add_timer(struct hv_timer *timer)
@@ -112,9 +185,14 @@ int32_t add_timer(struct hv_timer *timer)
 		cpu_timer = &per_cpu(cpu_timers, pcpu_id);
 
 		CPU_INT_ALL_DISABLE(&rflags);
-		/* update the physical timer if we're on the timer_list head */
-		if (local_add_timer(cpu_timer, timer)) {
-			update_physical_timer(cpu_timer);
+		local_add_timer(cpu_timer, timer);
+		cpu_timer->stats_added++;
+		/* update the physical timer if this is the new earliest deadline */
+		if ((cpu_timer->deadline == 0UL) || (timer->timeout < cpu_timer->deadline)) {
+			if (!cpu_timer->pt_tsc_deadline) {
+				msr_write(MSR_IA32_TSC_DEADLINE, timer->timeout);
+			}
+			cpu_timer->deadline = timer->timeout;
 		}
 		CPU_INT_ALL_RESTORE(rflags);
 
@@ -169,12 +247,83 @@ void del_timer(struct hv_timer *timer)
 	CPU_INT_ALL_RESTORE(rflags);
 }
 
+/* unlink every armed timer of this pCPU, wheel position is kept untouched */
+static void collect_percpu_timers(struct per_cpu_timers *cpu_timer, struct list_head *moved)
+{
+	const struct list_head *pos, *n;
+	struct hv_timer *timer;
+	uint32_t level, slot;
+
+	for (level = 0U; level < TIMER_WHEEL_LEVELS; level++) {
+		for (slot = 0U; slot < TIMER_WHEEL_SLOTS; slot++) {
+			list_for_each_safe(pos, n, &cpu_timer->wheel[level][slot]) {
+				timer = container_of(pos, struct hv_timer, node);
+				list_del_init(&timer->node);
+				list_add_tail(&timer->node, moved);
+			}
+		}
+		cpu_timer->occupancy[level] = 0UL;
+	}
+}
+
+/* runs on the BSP in interrupt context via smp_call_function() */
+static void takeover_percpu_timers(void *data)
+{
+	struct per_cpu_timers *cpu_timer = &get_cpu_var(cpu_timers);
+	struct list_head *moved = (struct list_head *)data;
+	const struct list_head *pos, *n;
+	struct hv_timer *timer;
+
+	list_for_each_safe(pos, n, moved) {
+		timer = container_of(pos, struct hv_timer, node);
+		list_del_init(&timer->node);
+		local_add_timer(cpu_timer, timer);
+	}
+
+	/* let the softirq service already-due timers and reprogram the deadline */
+	fire_softirq(SOFTIRQ_TIMER);
+}
+
+void migrate_percpu_timers(void)
+{
+	struct per_cpu_timers *cpu_timer = &get_cpu_var(cpu_timers);
+	struct list_head moved;
+	uint64_t rflags;
+
+	INIT_LIST_HEAD(&moved);
+
+	CPU_INT_ALL_DISABLE(&rflags);
+	if (!cpu_timer->pt_tsc_deadline) {
+		cpu_timer->pt_tsc_deadline = true;
+		collect_percpu_timers(cpu_timer, &moved);
+		cpu_timer->deadline = 0UL;
+		/* disarm our deadline before the guest gets direct access to the MSR */
+		msr_write(MSR_IA32_TSC_DEADLINE, 0UL);
+	}
+	CPU_INT_ALL_RESTORE(rflags);
+
+	if (!list_empty(&moved)) {
+		smp_call_function((1UL << BSP_CPU_ID), takeover_percpu_timers, &moved);
+	}
+}
+
 static void init_percpu_timer(uint16_t pcpu_id)
 {
 	struct per_cpu_timers *cpu_timer;
+	uint32_t level, slot;
 
 	cpu_timer = &per_cpu(cpu_timers, pcpu_id);
-	INIT_LIST_HEAD(&cpu_timer->timer_list);
+	for (level = 0U; level < TIMER_WHEEL_LEVELS; level++) {
+		for (slot = 0U; slot < TIMER_WHEEL_SLOTS; slot++) {
+			INIT_LIST_HEAD(&cpu_timer->wheel[level][slot]);
+		}
+		cpu_timer->occupancy[level] = 0UL;
+	}
+	cpu_timer->last_jiffy = timer_jiffy(cpu_ticks());
+	cpu_timer->deadline = 0UL;
+	cpu_timer->pt_tsc_deadline = false;
+	cpu_timer->stats_added = 0UL;
+	cpu_timer->stats_cascaded = 0UL;
 }
 
 static void timer_softirq(uint16_t pcpu_id)
@@ -182,36 +331,66 @@ static void timer_softirq(uint16_t pcpu_id)
 	struct per_cpu_timers *cpu_timer;
 	struct hv_timer *timer;
 	const struct list_head *pos, *n;
+	struct list_head *bucket;
 	uint32_t tries = MAX_TIMER_ACTIONS;
 	uint64_t current_tsc = cpu_ticks();
+	uint64_t now_jiffy = timer_jiffy(current_tsc);
+	uint64_t slot, pending;
 
 	/* handle passed timer */
 	cpu_timer = &per_cpu(cpu_timers, pcpu_id);
 
-	/* This is to make sure we are not blocked due to delay inside func()
-	 * force to exit irq handler after we serviced >31 timers
+	/* Advance the wheel up to the current bucket, draining every bucket on
+	 * the way: timers in buckets behind the wheel position are all due, the
+	 * current bucket needs an exact deadline check.
+	 *
+	 * The tries guard makes sure we are not blocked due to delay inside
+	 * func(): force to exit irq handler after we serviced >31 timers.
 	 * caller used to local_add_timer() for periodic timer, if there is a delay
 	 * inside func(), it will infinitely loop here, because new added timer
 	 * already passed due to previously func()'s delay.
 	 */
-	list_for_each_safe(pos, n, &cpu_timer->timer_list) {
-		timer = container_of(pos, struct hv_timer, node);
-		/* timer expried */
-		tries--;
-		if ((timer->timeout <= current_tsc) && (tries != 0U)) {
-			del_timer(timer);
+	while (tries != 0U) {
+		slot = cpu_timer->last_jiffy & (TIMER_WHEEL_SLOTS - 1UL);
+		bucket = &cpu_timer->wheel[0U][slot];
+		list_for_each_safe(pos, n, bucket) {
+			timer = container_of(pos, struct hv_timer, node);
+			/* timer expried */
+			if ((timer->timeout <= current_tsc) && (tries != 0U)) {
+				tries--;
+				del_timer(timer);
+
+				run_timer(timer);
+
+				if (timer->mode == TICK_MODE_PERIODIC) {
+					/* update periodic timer fire tsc */
+					timer->timeout += timer->period_in_cycle;
+					local_add_timer(cpu_timer, timer);
+				} else {
+					timer->timeout = 0UL;
+				}
+			}
+		}
+		if (list_empty(bucket)) {
+			cpu_timer->occupancy[0U] &= ~(1UL << slot);
+		}
 
-			run_timer(timer);
+		if (cpu_timer->last_jiffy >= now_jiffy) {
+			break;
+		}
 
-			if (timer->mode == TICK_MODE_PERIODIC) {
-				/* update periodic timer fire tsc */
-				timer->timeout += timer->period_in_cycle;
-				(void)local_add_timer(cpu_timer, timer);
-			} else {
-				timer->timeout = 0UL;
-			}
+		/* jump over an all-empty tail of the current 64-bucket window */
+		pending = (slot < (TIMER_WHEEL_SLOTS - 1UL)) ?
+				(cpu_timer->occupancy[0U] >> (slot + 1UL)) : 0UL;
+		if (pending == 0UL) {
+			cpu_timer->last_jiffy = min((cpu_timer->last_jiffy |
+					(TIMER_WHEEL_SLOTS - 1UL)) + 1UL, now_jiffy);
 		} else {
-			break;
+			cpu_timer->last_jiffy++;
+		}
+
+		if ((cpu_timer->last_jiffy & (TIMER_WHEEL_SLOTS - 1UL)) == 0UL) {
+			cascade_timers(cpu_timer);
 		}
 	}
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <asm/cpu.h>
+#include <asm/msr.h>
+#include <asm/cpuid.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/vmx_io.h>
+#include <schedule.h>
+#include <timer.h>
+#include <ticks.h>
+#include <logmsg.h>
+#include <vcpu_watchdog.h>
+
+/*
+ * Sub-millisecond stall detector for vCPUs.
+ *
+ * Every vCPU thread maintains a heartbeat: an exit counter bumped on
+ * each serviced VM exit and an INST_RETIRED.ANY sample from the fixed
+ * PMU counter of its pCPU (see vcpu_thread()). A periodic timer on the
+ * BSP scans all active vCPUs and flags two kinds of wedges:
+ *
+ *  - a vCPU whose thread is schedulable but whose heartbeat stops
+ *    moving. Before reporting, the detector kicks the vCPU once: a
+ *    healthy guest takes the forced exit and the heartbeat advances,
+ *    so only a thread stuck inside the hypervisor is reported.
+ *  - a vCPU whose I/O request has been sitting with the device model
+ *    longer than the DM ever legitimately needs, i.e. a hung DM.
+ *
+ * Reports go to the log and, for post-launched VMs, ring the HSM
+ * callback vector so a Service VM policy agent (life_mngr) can fence
+ * or restart the guest. Guest-logical hangs (a guest happily spinning)
+ * retire instructions and are out of scope here; they belong to the
+ * guest-side heartbeat that life_mngr polls from the stats page.
+ */
+
+/* detector tick, in microseconds */
+#define WDT_TICK_PERIOD_US	500UL
+
+/* ticks without heartbeat progress before the vCPU is kicked once */
+#define WDT_PROBE_TICKS		4U
+
+/* ticks without progress (probe included) before a stall is reported */
+#define WDT_REPORT_TICKS	40U
+
+/* ticks an ioreq may sit with the DM before the DM counts as hung */
+#define WDT_IOREQ_TICKS		200U
+
+static struct hv_timer wdt_timer;
+
+static void wdt_report(struct acrn_vcpu *vcpu, const char *what)
+{
+	vcpu->wdt_reported = true;
+	pr_warn("watchdog: vm%d vcpu%d %s", vcpu->vm->vm_id, vcpu->vcpu_id, what);
+
+	if (!is_service_vm(vcpu->vm)) {
+		arch_fire_hsm_interrupt();
+	}
+}
+
+static void wdt_check_vcpu(struct acrn_vcpu *vcpu, uint64_t now)
+{
+	bool progress = (vcpu->hb_exit_cnt != vcpu->wdt_seen_exit_cnt) ||
+			(vcpu->hb_inst_retired != vcpu->wdt_seen_inst_retired);
+	uint64_t ioreq_start = vcpu->hb_ioreq_start_tsc;
+
+	if (progress) {
+		vcpu->wdt_seen_exit_cnt = vcpu->hb_exit_cnt;
+		vcpu->wdt_seen_inst_retired = vcpu->hb_inst_retired;
+		vcpu->wdt_stall_ticks = 0U;
+		vcpu->wdt_probed = false;
+		if (vcpu->wdt_reported && (ioreq_start == 0UL)) {
+			vcpu->wdt_reported = false;
+			pr_info("watchdog: vm%d vcpu%d recovered",
+				vcpu->vm->vm_id, vcpu->vcpu_id);
+		}
+	} else if ((ioreq_start != 0UL) &&
+			((now - ioreq_start) >= us_to_ticks((uint32_t)(WDT_IOREQ_TICKS * WDT_TICK_PERIOD_US)))) {
+		/* blocked on the DM, not on the hypervisor */
+		vcpu->wdt_stall_ticks = 0U;
+		if (!vcpu->wdt_reported) {
+			wdt_report(vcpu, "ioreq not served, device model hung?");
+		}
+	} else if (vcpu->thread_obj.status != THREAD_STS_BLOCKED) {
+		vcpu->wdt_stall_ticks++;
+		if ((vcpu->wdt_stall_ticks == WDT_PROBE_TICKS) && !vcpu->wdt_probed) {
+			/* force an exit; a healthy guest resumes and the
+			 * heartbeat moves before the report threshold
+			 */
+			vcpu->wdt_probed = true;
+			kick_vcpu(vcpu);
+		}
+		if ((vcpu->wdt_stall_ticks >= WDT_REPORT_TICKS) && !vcpu->wdt_reported) {
+			wdt_report(vcpu, "no progress after probe, vcpu thread stalled");
+		}
+	} else {
+		/* blocked and no ioreq outstanding: idle (HLT), not stalled */
+		vcpu->wdt_stall_ticks = 0U;
+		vcpu->wdt_probed = false;
+	}
+}
+
+static void wdt_tick_handler(__unused void *data)
+{
+	struct acrn_vcpu *vcpu;
+	struct acrn_vm *vm;
+	uint64_t now = cpu_ticks();
+	uint16_t vm_id, i;
+
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		vm = get_vm_from_vmid(vm_id);
+		if (is_poweroff_vm(vm)) {
+			continue;
+		}
+		foreach_vcpu(i, vm, vcpu) {
+			if (vcpu->state == VCPU_RUNNING) {
+				wdt_check_vcpu(vcpu, now);
+			}
+		}
+	}
+}
+
+void init_vcpu_watchdog(uint16_t pcpu_id)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint64_t period;
+
+	/* the instructions-retired heartbeat needs fixed counter 0,
+	 * present since architectural PMU version 2
+	 */
+	cpuid_subleaf(0xAU, 0U, &eax, &ebx, &ecx, &edx);
+	if ((eax & 0xFFU) >= 2U) {
+		msr_write(MSR_IA32_FIXED_CTR0, 0UL);
+		msr_write(MSR_IA32_FIXED_CTR_CTL,
+			msr_read(MSR_IA32_FIXED_CTR_CTL) | 0x3UL);
+		msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+			msr_read(MSR_IA32_PERF_GLOBAL_CTRL) | (1UL << 32U));
+	}
+
+	if (pcpu_id == BSP_CPU_ID) {
+		period = us_to_ticks((uint32_t)WDT_TICK_PERIOD_US);
+		initialize_timer(&wdt_timer, wdt_tick_handler, NULL,
+				cpu_ticks() + period, period);
+		if (add_timer(&wdt_timer) != 0) {
+			pr_err("Failed to add vcpu watchdog timer");
+		}
+	}
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <asm/cpu.h>
+#include <asm/rdt.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/ept.h>
+#include <asm/vtd.h>
+#include <schedule.h>
+#include <ticks.h>
+#include <vm_stats.h>
+
+/* a vCPU republishes its slot at most once per this interval */
+#define VM_STATS_PUBLISH_PERIOD_MS	10UL
+
+/**
+ * @pre vm != NULL
+ */
+int32_t vm_stats_setup(struct acrn_vm *vm, struct acrn_vm_stats *page)
+{
+	if (page != NULL) {
+		/* initialize the page before it becomes visible to the
+		 * publishing vCPUs */
+		stac();
+		(void)memset(page, 0U, sizeof(struct acrn_vm_stats));
+		page->version = ACRN_VM_STATS_VERSION;
+		page->nr_vcpu = vm->hw.created_vcpus;
+		clac();
+	}
+	vm->stats_page = page;
+
+	return 0;
+}
+
+/**
+ * Copy the vCPU's scheduling and VM exit counters into its seqlock
+ * protected slot. Only the owning vCPU writes its slot, so slots never
+ * contend; the seq field tells the Service VM reader when it raced an
+ * update. Publication is rate-limited so the cost stays off the exit
+ * fast path.
+ *
+ * @pre vcpu != NULL
+ */
+void vm_stats_publish(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vm_stats *page = vcpu->vm->stats_page;
+	struct acrn_vcpu_stats *entry;
+	const struct thread_object *obj = &vcpu->thread_obj;
+	uint64_t now, vmexit_cnt = 0UL;
+	uint32_t i, ept_used, ept_max_used, ept_total;
+	struct iommu_domain_stats dstats;
+
+	if ((page != NULL) && (vcpu->vcpu_id < ACRN_VM_STATS_MAX_VCPUS)) {
+		now = cpu_ticks();
+		if ((now - vcpu->stats_publish_tsc) >= (VM_STATS_PUBLISH_PERIOD_MS * TICKS_PER_MS)) {
+			vcpu->stats_publish_tsc = now;
+
+			for (i = 0U; i < NR_VMX_EXIT_REASONS; i++) {
+				vmexit_cnt += vcpu->vmexit_stats[i].count;
+			}
+
+			/* the BSP also refreshes the per-VM header fields; each
+			 * one is a single aligned write so no seqlock is needed */
+			if (vcpu->vcpu_id == 0U) {
+				get_ept_pool_stats(vcpu->vm->vm_id, &ept_used, &ept_max_used, &ept_total);
+				iommu_get_domain_stats(vcpu->vm->vm_id, false, &dstats);
+				stac();
+				page->ept_pages_used = ept_used;
+				page->ept_pages_max_used = ept_max_used;
+				page->ept_pages_total = ept_total;
+				page->iotlb_inv_cnt = (uint32_t)dstats.iotlb_inv_cnt;
+				page->iotlb_inv_max_us = (uint32_t)dstats.inv_max_us;
+				clac();
+			}
+
+			entry = &page->vcpu[vcpu->vcpu_id];
+			stac();
+			entry->seq++;		/* odd: update in progress */
+			cpu_write_memory_barrier();
+			entry->last_update_tsc = now;
+			entry->run_cycles = obj->run_cycles;
+			entry->runnable_cycles = obj->runnable_cycles;
+			entry->vmexit_cnt = vmexit_cnt;
+			entry->sched_in_cnt = obj->sched_in_cnt;
+			entry->budget_overrun_cnt = obj->overrun_cnt;
+			entry->bus_lock_cnt = vcpu->vmexit_stats[VMX_EXIT_REASON_BUS_LOCK].count;
+			/* sampled here so the read hits this vCPU's own L3 domain */
+			entry->l3_occupancy_bytes = read_vm_cache_occupancy(vcpu->vm->vm_id);
+			entry->mem_bw_total_bytes = read_vm_mem_bw_total(vcpu->vm->vm_id);
+			entry->inst_retired = vcpu->hb_inst_retired;
+			cpu_write_memory_barrier();
+			entry->seq++;		/* even again: entry consistent */
+			clac();
+		}
+	}
+}
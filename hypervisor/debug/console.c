@@ -17,6 +17,7 @@
 #include <console.h>
 #include <boot.h>
 #include <dbg_cmd.h>
+#include <sbuf.h>
 
 struct hv_timer console_timer;
 
@@ -25,6 +26,75 @@ struct hv_timer console_timer;
 #define GUEST_CONSOLE_TO_HV_SWITCH_KEY      0       /* CTRL + SPACE */
 uint16_t console_vmid = ACRN_INVALID_VMID;
 
+/*
+ * Per-VM console scrollback.
+ *
+ * Every VM's console vuart is drained on each console timer kick, whether
+ * or not it is the displayed one, so the first lines a crashing guest
+ * prints are captured even while the console is pointed elsewhere.
+ * Switching with vm_console only changes which captured stream is echoed.
+ *
+ * The ring reuses the shared_buf layout (the payload starts SBUF_HEAD_SIZE
+ * after the header) in overwrite mode, but stays hypervisor-private; the
+ * vm_console_dump shell command replays it, and every completed line is
+ * mirrored into the hypervisor log so acrnlog persists the scrollback.
+ */
+#define VM_CONSOLE_SCROLLBACK_SIZE	2048U
+#define VM_CONSOLE_LINE_LEN		120U
+
+struct vm_console_sbuf {
+	struct shared_buf hdr;
+	char buf[VM_CONSOLE_SCROLLBACK_SIZE];
+	char line[VM_CONSOLE_LINE_LEN];	/* staging for the log mirror */
+	uint32_t line_len;
+};
+
+static struct vm_console_sbuf vm_console_sbufs[CONFIG_MAX_VM_NUM];
+
+static void vm_console_scrollback_init(void)
+{
+	struct shared_buf *sb;
+	uint16_t vmid;
+
+	for (vmid = 0U; vmid < CONFIG_MAX_VM_NUM; vmid++) {
+		sb = &vm_console_sbufs[vmid].hdr;
+		sb->magic = SBUF_MAGIC;
+		sb->ele_size = 1U;
+		sb->ele_num = VM_CONSOLE_SCROLLBACK_SIZE;
+		sb->size = VM_CONSOLE_SCROLLBACK_SIZE;
+		sb->flags = OVERWRITE_EN;
+	}
+}
+
+static void vm_console_scrollback_putc(uint16_t vmid, char ch)
+{
+	struct vm_console_sbuf *vcs = &vm_console_sbufs[vmid];
+	struct shared_buf *sb = &vcs->hdr;
+	uint32_t next_tail;
+
+	/* single producer/consumer, both on the console timer context,
+	 * so the overwrite mode needs no extra locking here */
+	next_tail = sbuf_next_ptr(sb->tail, sb->ele_size, sb->size);
+	if (next_tail == sb->head) {
+		sb->head = sbuf_next_ptr(sb->head, sb->ele_size, sb->size);
+	}
+	*((char *)sb + SBUF_HEAD_SIZE + sb->tail) = ch;
+	sb->tail = next_tail;
+
+	/* mirror completed lines into the log for acrnlog export */
+	if ((ch == '\n') || (vcs->line_len == (VM_CONSOLE_LINE_LEN - 1U))) {
+		vcs->line[vcs->line_len] = '\0';
+		if (vcs->line_len > 0U) {
+			pr_info("vm%hu console: %s", vmid, vcs->line);
+		}
+		vcs->line_len = 0U;
+	}
+	if ((ch != '\n') && (ch != '\r')) {
+		vcs->line[vcs->line_len] = ch;
+		vcs->line_len++;
+	}
+}
+
 static void parse_hvdbg_cmdline(void)
 {
 	const char *start = NULL;
@@ -55,6 +125,8 @@ void console_init(void)
 	/*Parse cmdline to get UART setting*/
 	parse_hvdbg_cmdline();
 
+	vm_console_scrollback_init();
+
 	/*
 	 * Enable UART as early as possible.
 	 * Then we could use printf for debugging on early boot stage.
@@ -109,16 +181,54 @@ static void vuart_console_rx_chars(struct acrn_vuart *vu)
 
 }
 
-/**
- * @pre vu != NULL
+/*
+ * Drain the console vuart of every running VM into its scrollback ring;
+ * only the VM the console is pointed at is echoed to the physical uart.
  */
-static void vuart_console_tx_chars(struct acrn_vuart *vu)
+static void vm_console_capture(void)
 {
-	char c = vuart_getchar(vu);
+	struct acrn_vm *vm;
+	struct acrn_vuart *vu;
+	uint16_t vmid;
+	char c;
 
-	while(c != -1) {
-		printf("%c", c);
+	for (vmid = 0U; vmid < CONFIG_MAX_VM_NUM; vmid++) {
+		vm = get_vm_from_vmid(vmid);
+		if (is_poweroff_vm(vm)) {
+			continue;
+		}
+		vu = vm_console_vuart(vm);
+		if (!vu->active) {
+			continue;
+		}
 		c = vuart_getchar(vu);
+		while (c != -1) {
+			vm_console_scrollback_putc(vmid, c);
+			if (vmid == console_vmid) {
+				printf("%c", c);
+			}
+			c = vuart_getchar(vu);
+		}
+	}
+}
+
+/*
+ * Replay the captured scrollback of a VM to the physical uart; the ring
+ * keeps being filled behind the cursor, so a dump taken while the guest
+ * is printing may miss the newest characters, never the oldest ones.
+ */
+void vm_console_scrollback_dump(uint16_t vmid)
+{
+	struct shared_buf *sb;
+	uint32_t pos;
+
+	if (vmid < CONFIG_MAX_VM_NUM) {
+		sb = &vm_console_sbufs[vmid].hdr;
+		pos = sb->head;
+		while (pos != sb->tail) {
+			printf("%c", *((char *)sb + SBUF_HEAD_SIZE + pos));
+			pos = sbuf_next_ptr(pos, sb->ele_size, sb->size);
+		}
 	}
 }
 
@@ -144,13 +254,17 @@ static void console_timer_callback(__unused void *data)
 {
 	struct acrn_vuart *vu;
 
+	/* Flush console messages staged by do_logmsg() on all pCPUs */
+	console_log_drain();
+
+	/* Capture every VM's console output; the displayed one is echoed */
+	vm_console_capture();
+
 	/* Kick HV-Shell and Uart-Console tasks */
 	vu = vuart_console_active();
 	if (vu != NULL) {
 		/* serial Console Rx operation */
 		vuart_console_rx_chars(vu);
-		/* serial Console Tx operation */
-		vuart_console_tx_chars(vu);
 	} else {
 		shell_kick();
 	}
@@ -197,6 +311,8 @@ void console_vmexit_callback(struct acrn_vcpu *vcpu)
 void suspend_console(void)
 {
 	del_timer(&console_timer);
+	/* flush anything staged before the timer goes away */
+	console_log_drain();
 }
 
 void resume_console(void)
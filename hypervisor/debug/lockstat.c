@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <ticks.h>
+#include <lockstat.h>
+#include <asm/cpu.h>
+#include <asm/per_cpu.h>
+#include <asm/lib/atomic.h>
+
+#define LOCKSTAT_MAX_SITES	32U
+
+static struct lock_stat *lockstat_sites[LOCKSTAT_MAX_SITES];
+static uint32_t lockstat_site_nr;
+static spinlock_t lockstat_registry_lock = { .head = 0U, .tail = 0U };
+
+/*
+ * The acquisition timestamp cannot live in the (site-shared) lock_stat record
+ * since different instances of a site's lock can be held on several pCPUs at
+ * once. Row 0 is shared by sites which did not get a registry slot.
+ */
+static uint64_t lockstat_hold_start[LOCKSTAT_MAX_SITES + 1U][MAX_PCPU_NUM];
+
+static void lockstat_register(struct lock_stat *stat)
+{
+	spinlock_obtain(&lockstat_registry_lock);
+	if (!stat->registered) {
+		if (lockstat_site_nr < LOCKSTAT_MAX_SITES) {
+			lockstat_sites[lockstat_site_nr] = stat;
+			lockstat_site_nr++;
+			stat->id = (uint16_t)lockstat_site_nr;
+		}
+		stat->registered = true;
+	}
+	spinlock_release(&lockstat_registry_lock);
+}
+
+/*
+ * Same ticket protocol as spinlock_obtain(), with the spin iterations counted.
+ * Both may be used on the same lock: sites left uninstrumented simply do not
+ * show up in the statistics.
+ */
+void lockstat_obtain(spinlock_t *lock, struct lock_stat *stat)
+{
+	uint32_t ticket = 1U;
+	uint64_t spins = 0UL;
+
+	if (!stat->registered) {
+		lockstat_register(stat);
+	}
+
+	asm volatile ("   lock xaddl %0, %1\n"
+			: "+r" (ticket), "+m" (lock->head)
+			:
+			: "cc", "memory");
+	while (*((volatile uint32_t *)&lock->tail) != ticket) {
+		asm_pause();
+		spins++;
+	}
+	/* keep the critical section behind the acquiring read */
+	asm volatile ("" ::: "memory");
+
+	atomic_inc64(&stat->acquisitions);
+	if (spins != 0UL) {
+		atomic_inc64(&stat->contended);
+		(void)atomic_add64_return((int64_t *)&stat->spins, (int64_t)spins);
+	}
+	lockstat_hold_start[stat->id][get_pcpu_id()] = cpu_ticks();
+}
+
+void lockstat_release(spinlock_t *lock, struct lock_stat *stat)
+{
+	uint64_t hold = cpu_ticks() - lockstat_hold_start[stat->id][get_pcpu_id()];
+
+	/* racy read-modify-write across holders: a lost update costs one sample */
+	if (hold > stat->max_hold) {
+		stat->max_hold = hold;
+	}
+
+	spinlock_release(lock);
+}
+
+uint32_t lockstat_get_site_nr(void)
+{
+	return lockstat_site_nr;
+}
+
+const struct lock_stat *lockstat_get_site(uint32_t idx)
+{
+	return (idx < lockstat_site_nr) ? lockstat_sites[idx] : NULL;
+}
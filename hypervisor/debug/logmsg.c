@@ -11,6 +11,7 @@
 #include <asm/per_cpu.h>
 #include <npk_log.h>
 #include <logmsg.h>
+#include <console.h>
 #include <ticks.h>
 
 /* buf size should be identical to the size in hvlog option, which is
@@ -20,34 +21,225 @@
 
 struct acrn_logmsg_ctl {
 	int32_t seq;
-	spinlock_t lock;
 };
 
 static struct acrn_logmsg_ctl logmsg_ctl;
 
+/*
+ * Burst-tolerant log rate limiting. Each pCPU owns two token buckets,
+ * one for messages of LOG_ERROR severity and above and one for the
+ * rest, refilled to the full budget once per window. A guest that can
+ * trigger emulation warnings at will (e.g. through a flood of vUART
+ * writes) exhausts the warning budget of the pCPU its vCPU runs on and
+ * is silenced there, while logging from every other pCPU - and errors
+ * on the storming one - proceeds unaffected. A suppressed message costs
+ * one branch and a counter increment; the count is reported in a
+ * summary message when the window rolls over. LOG_FATAL is never
+ * suppressed.
+ */
+#define LOGMSG_RATE_WINDOW_US	1000000UL
+#define LOGMSG_RATE_BUDGET	128U
+
+struct log_rate_bucket {
+	uint32_t tokens;
+	uint32_t suppressed;
+};
+
+struct log_rate_ctl {
+	uint64_t window_start_us;
+	struct log_rate_bucket buckets[2];	/* 0: LOG_ERROR and more severe, 1: the rest */
+};
+
+static struct log_rate_ctl log_rate[MAX_PCPU_NUM];
+
 void init_logmsg()
 {
+	uint16_t pcpu_id;
+	uint32_t i;
+
 	logmsg_ctl.seq = 0;
 
-	spinlock_init(&(logmsg_ctl.lock));
+	for (pcpu_id = 0U; pcpu_id < MAX_PCPU_NUM; pcpu_id++) {
+		spinlock_init(&(per_cpu(console_log_ring, pcpu_id).lock));
+		for (i = 0U; i < 2U; i++) {
+			log_rate[pcpu_id].buckets[i].tokens = LOGMSG_RATE_BUDGET;
+		}
+	}
+}
+
+/*
+ * Stage a console-bound message in the calling pCPU's ring. The console
+ * timer drains it to the UART later, so the logging caller never blocks
+ * on the UART or contends with other pCPUs for it.
+ */
+static void console_log_stage(const char *msg, uint32_t len)
+{
+	struct console_log_ring *ring = &get_cpu_var(console_log_ring);
+	uint64_t rflags;
+	uint32_t i;
+
+	spinlock_irqsave_obtain(&(ring->lock), &rflags);
+	if ((len + 2U) <= (CONSOLE_LOG_RING_SIZE - (ring->tail - ring->head))) {
+		for (i = 0U; i < len; i++) {
+			ring->buf[(ring->tail + i) & (CONSOLE_LOG_RING_SIZE - 1U)] = msg[i];
+		}
+		ring->buf[(ring->tail + len) & (CONSOLE_LOG_RING_SIZE - 1U)] = '\n';
+		ring->buf[(ring->tail + len + 1U) & (CONSOLE_LOG_RING_SIZE - 1U)] = '\r';
+		ring->tail += (len + 2U);
+	} else {
+		ring->dropped++;
+	}
+	spinlock_irqrestore_release(&(ring->lock), rflags);
+}
+
+/*
+ * Raw staging for the shell's deferred output: nothing is appended and
+ * the number of bytes accepted is returned, so a thread-context caller
+ * can wait for the console timer to drain the ring and resubmit the
+ * rest instead of dropping it.
+ */
+uint32_t console_log_stage_raw(const char *s, uint32_t len)
+{
+	struct console_log_ring *ring = &get_cpu_var(console_log_ring);
+	uint64_t rflags;
+	uint32_t room, n, i;
+
+	spinlock_irqsave_obtain(&(ring->lock), &rflags);
+	room = CONSOLE_LOG_RING_SIZE - (ring->tail - ring->head);
+	n = (len < room) ? len : room;
+	for (i = 0U; i < n; i++) {
+		ring->buf[(ring->tail + i) & (CONSOLE_LOG_RING_SIZE - 1U)] = s[i];
+	}
+	ring->tail += n;
+	spinlock_irqrestore_release(&(ring->lock), rflags);
+
+	return n;
+}
+
+/*
+ * Flush all pCPUs' staged console messages to the UART; runs in the
+ * console timer context only. Each ring is copied out in chunks under
+ * its lock, but the slow UART write itself runs with no lock held so
+ * producers never spin behind it.
+ */
+void console_log_drain(void)
+{
+	char chunk[LOG_MESSAGE_MAX_SIZE];
+	struct console_log_ring *ring;
+	uint64_t rflags;
+	uint32_t n, dropped;
+	uint16_t pcpu_id;
+
+	for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+		ring = &per_cpu(console_log_ring, pcpu_id);
+		do {
+			n = 0U;
+			spinlock_irqsave_obtain(&(ring->lock), &rflags);
+			while ((ring->head != ring->tail) && (n < sizeof(chunk))) {
+				chunk[n] = ring->buf[ring->head & (CONSOLE_LOG_RING_SIZE - 1U)];
+				ring->head++;
+				n++;
+			}
+			dropped = ring->dropped;
+			ring->dropped = 0U;
+			spinlock_irqrestore_release(&(ring->lock), rflags);
+
+			if (n > 0U) {
+				(void)console_write(chunk, n);
+			}
+		} while (n == sizeof(chunk));
+
+		if (dropped != 0U) {
+			printf("[cpu=%hu: %u console messages dropped]\n\r",
+					pcpu_id, dropped);
+		}
+	}
+}
+
+/* fan a formatted message in the calling pCPU's logbuf out to the
+ * enabled sinks
+ */
+static void logmsg_emit(uint32_t severity, char *buffer, uint32_t len, uint16_t pcpu_id)
+{
+	/* Check whether output to NPK */
+	if (severity <= npk_loglevel) {
+		npk_log_write(buffer, len);
+	}
+
+	/* Check whether output to stdout */
+	if (severity <= console_loglevel) {
+		if (severity == LOG_FATAL) {
+			/* the system may not survive to the next console timer
+			 * kick, write fatal messages out synchronously */
+			(void)console_write(buffer, len);
+			(void)console_write("\n\r", 2U);
+		} else {
+			console_log_stage(buffer, len);
+		}
+	}
+
+	/* Check whether output to memory */
+	if (severity <= mem_loglevel) {
+		uint32_t i, chunks;
+		struct shared_buf *sbuf = per_cpu(sbuf, pcpu_id)[ACRN_HVLOG];
+
+		/* If sbuf is not ready, we just drop the massage */
+		if (sbuf != NULL) {
+			chunks = ((len - 1U) / LOG_ENTRY_SIZE) + 1U;
+			/* zero the tail of the last chunk so stale bytes from
+			 * earlier messages never reach the log consumer */
+			(void)memset(buffer + len, 0U,
+				(chunks * LOG_ENTRY_SIZE) - len);
+
+			for (i = 0U; i < chunks; i++) {
+				(void)sbuf_put(ACRN_HVLOG, (uint8_t *)buffer +
+							(i * LOG_ENTRY_SIZE));
+			}
+		}
+	}
+}
+
+/*
+ * Roll the rate limiting window of the calling pCPU over: report how
+ * many messages each bucket suppressed and refill the budgets. The
+ * summary is formatted in the pCPU's logbuf, which the caller has not
+ * started using yet.
+ */
+static void log_rate_rollover(struct log_rate_ctl *rctl, uint64_t timestamp,
+		char *buffer, uint16_t pcpu_id)
+{
+	uint32_t i, len, severity;
+
+	rctl->window_start_us = timestamp;
+	for (i = 0U; i < 2U; i++) {
+		struct log_rate_bucket *bkt = &rctl->buckets[i];
+
+		if (bkt->suppressed != 0U) {
+			severity = (i == 0U) ? LOG_ERROR : LOG_WARNING;
+			len = (uint32_t)snprintf(buffer, LOG_MESSAGE_MAX_SIZE,
+				"[%luus][cpu=%hu][sev=%u][seq=%u]:logmsg: %u messages rate limited",
+				timestamp, pcpu_id, severity,
+				atomic_inc_return(&logmsg_ctl.seq), bkt->suppressed);
+			logmsg_emit(severity, buffer, len, pcpu_id);
+			bkt->suppressed = 0U;
+		}
+		bkt->tokens = LOGMSG_RATE_BUDGET;
+	}
 }
 
 void do_logmsg(uint32_t severity, const char *fmt, ...)
 {
 	va_list args;
-	uint64_t timestamp, rflags;
+	uint64_t timestamp;
 	uint16_t pcpu_id;
-	bool do_console_log;
-	bool do_mem_log;
-	bool do_npk_log;
+	struct log_rate_ctl *rctl;
+	struct log_rate_bucket *bkt;
 	char *buffer;
+	uint32_t len;
 	struct thread_object *current;
 
-	do_console_log = (severity <= console_loglevel);
-	do_mem_log = (severity <= mem_loglevel);
-	do_npk_log = (severity <= npk_loglevel);
-
-	if (!do_console_log && !do_mem_log && !do_npk_log) {
+	if ((severity > console_loglevel) && (severity > mem_loglevel) &&
+			(severity > npk_loglevel)) {
 		return;
 	}
 
@@ -60,49 +252,40 @@ void do_logmsg(uint32_t severity, const char *fmt, ...)
 	/* Get CPU ID */
 	pcpu_id = get_pcpu_id();
 	buffer = per_cpu(logbuf, pcpu_id);
-	current = sched_get_current(pcpu_id);
-
-	(void)memset(buffer, 0U, LOG_MESSAGE_MAX_SIZE);
-	/* Put time-stamp, CPU ID and severity into buffer */
-	snprintf(buffer, LOG_MESSAGE_MAX_SIZE, "[%luus][cpu=%hu][%s][sev=%u][seq=%u]:",
-			timestamp, pcpu_id, current->name, severity, atomic_inc_return(&logmsg_ctl.seq));
-
-	/* Put message into remaining portion of local buffer */
-	va_start(args, fmt);
-	vsnprintf(buffer + strnlen_s(buffer, LOG_MESSAGE_MAX_SIZE),
-		LOG_MESSAGE_MAX_SIZE
-		- strnlen_s(buffer, LOG_MESSAGE_MAX_SIZE), fmt, args);
-	va_end(args);
 
-	/* Check whether output to NPK */
-	if (do_npk_log) {
-		npk_log_write(buffer, strnlen_s(buffer, LOG_MESSAGE_MAX_SIZE));
+	rctl = &log_rate[pcpu_id];
+	if ((timestamp - rctl->window_start_us) >= LOGMSG_RATE_WINDOW_US) {
+		log_rate_rollover(rctl, timestamp, buffer, pcpu_id);
 	}
 
-	/* Check whether output to stdout */
-	if (do_console_log) {
-		spinlock_irqsave_obtain(&(logmsg_ctl.lock), &rflags);
-
-		/* Send buffer to stdout */
-		printf("%s\n\r", buffer);
-
-		spinlock_irqrestore_release(&(logmsg_ctl.lock), rflags);
+	if (severity != LOG_FATAL) {
+		bkt = &rctl->buckets[(severity <= LOG_ERROR) ? 0U : 1U];
+		if (bkt->tokens == 0U) {
+			bkt->suppressed++;
+			return;
+		}
+		bkt->tokens--;
 	}
 
-	/* Check whether output to memory */
-	if (do_mem_log) {
-		uint32_t i, msg_len;
-		struct shared_buf *sbuf = per_cpu(sbuf, pcpu_id)[ACRN_HVLOG];
+	current = sched_get_current(pcpu_id);
 
-		/* If sbuf is not ready, we just drop the massage */
-		if (sbuf != NULL) {
-			msg_len = strnlen_s(buffer, LOG_MESSAGE_MAX_SIZE);
+	/* Put time-stamp, CPU ID and severity into buffer. Both formatting
+	 * calls return the length that would be written, so track it instead
+	 * of re-scanning the buffer with strnlen_s afterwards.
+	 */
+	len = (uint32_t)snprintf(buffer, LOG_MESSAGE_MAX_SIZE, "[%luus][cpu=%hu][%s][sev=%u][seq=%u]:",
+			timestamp, pcpu_id, current->name, severity, atomic_inc_return(&logmsg_ctl.seq));
 
-			for (i = 0U; i < (((msg_len - 1U) / LOG_ENTRY_SIZE) + 1U);
-					i++) {
-				(void)sbuf_put(sbuf, (uint8_t *)buffer +
-							(i * LOG_ENTRY_SIZE));
-			}
-		}
+	/* Put message into remaining portion of local buffer */
+	if (len < (LOG_MESSAGE_MAX_SIZE - 1U)) {
+		va_start(args, fmt);
+		len += (uint32_t)vsnprintf(buffer + len,
+			LOG_MESSAGE_MAX_SIZE - len, fmt, args);
+		va_end(args);
 	}
+	if (len > (LOG_MESSAGE_MAX_SIZE - 1U)) {
+		len = LOG_MESSAGE_MAX_SIZE - 1U;
+	}
+
+	logmsg_emit(severity, buffer, len, pcpu_id);
 }
@@ -13,9 +13,11 @@
 #include <asm/vmx.h>
 #include <asm/cpuid.h>
 #include <asm/guest/vm.h>
+#include <asm/guest/vpmu.h>
 #include <sprintf.h>
 #include <logmsg.h>
 #include <ticks.h>
+#include <trace.h>
 
 #define DBG_LEVEL_PROFILING		5U
 #define DBG_LEVEL_ERR_PROFILING		3U
@@ -29,14 +31,80 @@
 #define LVT_PERFCTR_BIT_MASK		0x10000U
 #define VALID_DEBUGCTL_BIT_MASK		0x1801U
 
+/* Lightweight self-sampling driven by the shell "sample" command: FIXED_CTR1
+ * (unhalted core cycles) raises a PMI every hv_sampling_period cycles and the
+ * handler streams one TRACE_PMU_SAMPLE record into the per-CPU trace sbuf, so
+ * hypervisor hot spots can be analyzed with acrntrace alone, without the
+ * external SEP tool chain.
+ */
+#define SAMPLING_FIXED_CTR1_EN		0xB0UL	/* ring0 + ring3 enable, PMI on overflow */
+#define SAMPLING_FIXED_CTR1_MASK	0xF0UL
+#define SAMPLING_GLOBAL_CTRL_BIT	(1UL << 33U)	/* EN_FIXED_CTR1 */
+#define SAMPLING_CTR_MASK		((1UL << 48U) - 1UL)
+#define SAMPLING_MIN_PERIOD		10000UL
+
+/* Cross-core HITM sampling driven by the shell "hitm" command: PMC0 counts
+ * MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM - loads served from a modified line in
+ * another core's cache, the signature of (false) sharing between vCPUs - and
+ * raises a PMI every hv_hitm_period events. The handler translates the
+ * sampled guest RIP to a guest physical address, streams one
+ * TRACE_HITM_SAMPLE record into the per-CPU trace sbuf so acrntrace can
+ * build a heatmap offline, and aggregates a small per-VM hot-cacheline
+ * table for the shell report. The PEBS data-linear-address machinery is
+ * deliberately not used here: in VMX non-root operation the DS area pointer
+ * is translated through guest paging, so a hypervisor-owned PEBS buffer
+ * cannot be harvested safely while the event fires in the guest.
+ */
+#define HITM_EVTSEL			(0xD2UL | (0x04UL << 8U) | (1UL << 16U) | \
+						(1UL << 17U) | (1UL << 20U) | (1UL << 22U))
+#define HITM_GLOBAL_CTRL_BIT		(1UL << 0U)	/* EN_PMC0 */
+#define HITM_MIN_PERIOD			100UL
+#define HITM_CACHELINE_MASK		(~0x3FUL)
+
 static uint64_t sep_collection_switch;
 static uint64_t socwatch_collection_switch;
 static bool in_pmu_profiling;
+static uint64_t hv_sampling_period;	/* in cycles, 0 means sampling is off */
+static uint64_t hv_hitm_period;		/* in HITM events, 0 means sampling is off */
+
+static spinlock_t hitm_site_lock = { .head = 0U, .tail = 0U };
+static struct hitm_site hitm_sites[HITM_SITE_NUM];
+static uint64_t hitm_sites_overflow;
 
 static uint32_t profiling_pmi_irq = IRQ_INVALID;
 
 extern struct irq_desc irq_desc_array[NR_IRQS];
 
+/*
+ * Account one HITM sample against the (vm_id, cacheline) it hit. The table
+ * is small on purpose: a false-sharing workload hammers a handful of lines,
+ * and anything beyond that is still visible in the raw trace records.
+ */
+static void profiling_hitm_record(uint16_t vm_id, uint64_t cacheline)
+{
+	uint32_t i;
+
+	spinlock_obtain(&hitm_site_lock);
+	for (i = 0U; i < HITM_SITE_NUM; i++) {
+		if ((hitm_sites[i].count != 0UL) &&
+			(hitm_sites[i].cacheline == cacheline) &&
+			(hitm_sites[i].vm_id == vm_id)) {
+			hitm_sites[i].count++;
+			break;
+		}
+		if (hitm_sites[i].count == 0UL) {
+			hitm_sites[i].cacheline = cacheline;
+			hitm_sites[i].vm_id = vm_id;
+			hitm_sites[i].count = 1UL;
+			break;
+		}
+	}
+	if (i == HITM_SITE_NUM) {
+		hitm_sites_overflow++;
+	}
+	spinlock_release(&hitm_site_lock);
+}
+
 static void profiling_initialize_vmsw(void)
 {
 	dev_dbg(DBG_LEVEL_PROFILING, "%s: entering cpu%d",
@@ -113,6 +181,11 @@ static void profiling_enable_pmu(void)
 		return;
 	}
 
+	/* the profiler has priority over guest vPMU use: park any guest
+	 * counters currently loaded on this pCPU
+	 */
+	vpmu_hv_claim_pcpu();
+
 	/* Unmask LAPIC LVT entry for PMC register */
 	lvt_perf_ctr = (uint32_t) msr_read(MSR_IA32_EXT_APIC_LVT_PMI);
 	dev_dbg(DBG_LEVEL_PROFILING, "%s: 0x%x, 0x%lx",
@@ -217,6 +290,9 @@ static void profiling_disable_pmu(void)
 
 		ss->pmu_state = PMU_SETUP;
 
+		/* hand the PMU hardware back to any parked guest vPMU */
+		vpmu_hv_release_pcpu();
+
 		dev_dbg(DBG_LEVEL_PROFILING, "%s: exiting cpu%d",
 			__func__,  get_pcpu_id());
 	} else {
@@ -381,11 +457,11 @@ static int32_t profiling_generate_data(int32_t collector, uint32_t type)
 			}
 
 			for (i = 0U; i < (((DATA_HEADER_SIZE - 1U) / SEP_BUF_ENTRY_SIZE) + 1U); i++) {
-				(void)sbuf_put(sbuf, (uint8_t *)&pkt_header + i * SEP_BUF_ENTRY_SIZE);
+				(void)sbuf_put(ACRN_SEP, (uint8_t *)&pkt_header + i * SEP_BUF_ENTRY_SIZE);
 			}
 
 			for (i = 0U; i < (((payload_size - 1U) / SEP_BUF_ENTRY_SIZE) + 1U); i++) {
-				(void)sbuf_put(sbuf, (uint8_t *)payload + i * SEP_BUF_ENTRY_SIZE);
+				(void)sbuf_put(ACRN_SEP, (uint8_t *)payload + i * SEP_BUF_ENTRY_SIZE);
 			}
 
 			ss->samples_logged++;
@@ -587,6 +663,84 @@ static void profiling_pmi_handler(uint32_t irq, __unused void *data)
 			__func__, get_pcpu_id());
 		return;
 	}
+
+	/* PMIs raised by guest-owned vPMU counters are reflected into the
+	 * guest and are not profiling samples
+	 */
+	if (vpmu_handle_pmi()) {
+		return;
+	}
+
+	/* Lightweight self-sampling path: freeze the counters, log one trace
+	 * record per overflowed counter and re-arm. Kept deliberately small
+	 * so that the PMI cost itself does not distort the profile.
+	 */
+	if ((hv_sampling_period != 0UL) || (hv_hitm_period != 0UL)) {
+		uint64_t rip, aux, ovf;
+		bool from_guest = false;
+		uint64_t reason = get_cpu_var(profiling_info.vm_info).vmexit_reason;
+
+		msr_write(MSR_IA32_PERF_GLOBAL_CTRL, 0UL);
+		ovf = msr_read(MSR_IA32_PERF_GLOBAL_STATUS);
+
+		/* same guest/hypervisor attribution rule as the SEP path below */
+		if ((reason == VMX_EXIT_REASON_EXTERNAL_INTERRUPT) &&
+			((uint64_t)get_cpu_var(profiling_info.vm_info).external_vector
+				== PMI_VECTOR)) {
+			rip = get_cpu_var(profiling_info.vm_info).guest_rip;
+			aux = ((uint64_t)get_cpu_var(profiling_info.vm_info).guest_vm_id << 32U)
+				| (reason << 1U) | 1UL;
+			from_guest = true;
+			get_cpu_var(profiling_info.vm_info).vmexit_reason = 0U;
+			get_cpu_var(profiling_info.vm_info).external_vector = -1;
+		} else {
+			const struct x86_irq_data *irqd = irq_desc_array[irq].arch_data;
+
+			rip = irqd->ctx_rip;
+			aux = reason << 1U;
+		}
+
+		if ((hv_sampling_period != 0UL) && ((ovf & SAMPLING_GLOBAL_CTRL_BIT) != 0UL)) {
+			TRACE_2L(TRACE_PMU_SAMPLE, rip, aux);
+			msr_write(MSR_IA32_FIXED_CTR1,
+				(SAMPLING_CTR_MASK + 1UL - hv_sampling_period) & SAMPLING_CTR_MASK);
+		}
+
+		if ((hv_hitm_period != 0UL) && ((ovf & HITM_GLOBAL_CTRL_BIT) != 0UL)) {
+			uint64_t addr = rip & HITM_CACHELINE_MASK;
+			uint16_t vm_id = 0xFFFFU;
+
+			if (from_guest) {
+				struct acrn_vcpu *vcpu = get_running_vcpu(get_pcpu_id());
+				uint64_t gpa = 0UL;
+				uint32_t err_code = 0U;
+
+				/* the PMI skid lands the sampled RIP a few
+				 * instructions past the load that took the
+				 * HITM snoop; its code cacheline still pins
+				 * down the sharing site uniquely */
+				if ((vcpu != NULL) && (gva2gpa(vcpu, rip, &gpa, &err_code) == 0)) {
+					addr = gpa & HITM_CACHELINE_MASK;
+				}
+				vm_id = (uint16_t)(aux >> 32U);
+			}
+			TRACE_2L(TRACE_HITM_SAMPLE, addr, aux);
+			profiling_hitm_record(vm_id, addr);
+			/* legacy PMC writes sign-extend bit 31, which re-arms
+			 * the full-width counter for any sane period */
+			msr_write(MSR_IA32_PMC0,
+				(0x100000000UL - hv_hitm_period) & 0xFFFFFFFFUL);
+		}
+
+		msr_write(MSR_IA32_PERF_GLOBAL_OVF_CTRL, ovf & PERF_OVF_BIT_MASK);
+		/* unmask LVT PMI and restart the armed counters */
+		msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR);
+		msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+			((hv_sampling_period != 0UL) ? SAMPLING_GLOBAL_CTRL_BIT : 0UL) |
+			((hv_hitm_period != 0UL) ? HITM_GLOBAL_CTRL_BIT : 0UL));
+		return;
+	}
+
 	/* Stop all the counters first */
 	msr_write(MSR_IA32_PERF_GLOBAL_CTRL, 0x0U);
 
@@ -732,6 +886,10 @@ static void profiling_start_pmu(void)
 		return;
 	}
 
+	/* an external SEP collection takes precedence over self-sampling */
+	profiling_sampling_stop();
+	profiling_hitm_stop();
+
 	for (i = 0U; i < pcpu_nums; i++) {
 		if (per_cpu(profiling_info.s_state, i).pmu_state != PMU_SETUP) {
 			pr_err("%s: invalid pmu_state %u on cpu%d",
@@ -805,6 +963,155 @@ static void profiling_stop_pmu(void)
 
 }
 
+/*
+ * Program FIXED_CTR1 for self-sampling on the current CPU
+ */
+static void profiling_sampling_enable_pcpu(__unused void *data)
+{
+	uint64_t ctl = msr_read(MSR_IA32_FIXED_CTR_CTL);
+
+	msr_write(MSR_IA32_FIXED_CTR1,
+		(SAMPLING_CTR_MASK + 1UL - hv_sampling_period) & SAMPLING_CTR_MASK);
+	msr_write(MSR_IA32_FIXED_CTR_CTL,
+		(ctl & ~SAMPLING_FIXED_CTR1_MASK) | SAMPLING_FIXED_CTR1_EN);
+	msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR);
+	msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+		msr_read(MSR_IA32_PERF_GLOBAL_CTRL) | SAMPLING_GLOBAL_CTRL_BIT);
+}
+
+/*
+ * Stop FIXED_CTR1 and mask the PMI on the current CPU
+ */
+static void profiling_sampling_disable_pcpu(__unused void *data)
+{
+	msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+		msr_read(MSR_IA32_PERF_GLOBAL_CTRL) & ~SAMPLING_GLOBAL_CTRL_BIT);
+	msr_write(MSR_IA32_FIXED_CTR_CTL,
+		msr_read(MSR_IA32_FIXED_CTR_CTL) & ~SAMPLING_FIXED_CTR1_MASK);
+	/* the LVT entry is shared with the HITM sampler */
+	if (hv_hitm_period == 0UL) {
+		msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR | LVT_PERFCTR_BIT_MASK);
+	}
+}
+
+/*
+ * Program PMC0 for HITM sampling on the current CPU
+ */
+static void profiling_hitm_enable_pcpu(__unused void *data)
+{
+	msr_write(MSR_IA32_PMC0, (0x100000000UL - hv_hitm_period) & 0xFFFFFFFFUL);
+	msr_write(MSR_IA32_PERFEVTSEL0, HITM_EVTSEL);
+	msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR);
+	msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+		msr_read(MSR_IA32_PERF_GLOBAL_CTRL) | HITM_GLOBAL_CTRL_BIT);
+}
+
+/*
+ * Stop PMC0 and mask the PMI on the current CPU
+ */
+static void profiling_hitm_disable_pcpu(__unused void *data)
+{
+	msr_write(MSR_IA32_PERF_GLOBAL_CTRL,
+		msr_read(MSR_IA32_PERF_GLOBAL_CTRL) & ~HITM_GLOBAL_CTRL_BIT);
+	msr_write(MSR_IA32_PERFEVTSEL0, 0UL);
+	/* the LVT entry is shared with the cycle sampler */
+	if (hv_sampling_period == 0UL) {
+		msr_write(MSR_IA32_EXT_APIC_LVT_PMI, PMI_VECTOR | LVT_PERFCTR_BIT_MASK);
+	}
+}
+
+/*
+ * Start streaming PMU samples into the per-CPU trace sbuf, one sample
+ * every 'period' unhalted core cycles. The PMU is shared hardware: refuse
+ * to start while a SEP collection owns the counters.
+ */
+int32_t profiling_sampling_start(uint64_t period)
+{
+	int32_t ret = 0;
+
+	if (in_pmu_profiling) {
+		ret = -EBUSY;
+	} else if ((period < SAMPLING_MIN_PERIOD) || (hv_sampling_period != 0UL)) {
+		ret = -EINVAL;
+	} else {
+		hv_sampling_period = period;
+		smp_call_function(get_active_pcpu_bitmap(),
+			profiling_sampling_enable_pcpu, NULL);
+	}
+
+	return ret;
+}
+
+/*
+ * Stop PMU self-sampling on all CPUs
+ */
+void profiling_sampling_stop(void)
+{
+	if (hv_sampling_period != 0UL) {
+		hv_sampling_period = 0UL;
+		smp_call_function(get_active_pcpu_bitmap(),
+			profiling_sampling_disable_pcpu, NULL);
+	}
+}
+
+uint64_t profiling_sampling_period(void)
+{
+	return hv_sampling_period;
+}
+
+/*
+ * Start cross-core HITM sampling on all CPUs, one sample every 'period'
+ * HITM snoops. The hot-cacheline table from any previous run is discarded.
+ * As with cycle sampling, an external SEP collection owns the counters.
+ */
+int32_t profiling_hitm_start(uint64_t period)
+{
+	int32_t ret = 0;
+
+	if (in_pmu_profiling) {
+		ret = -EBUSY;
+	} else if ((period < HITM_MIN_PERIOD) || (hv_hitm_period != 0UL)) {
+		ret = -EINVAL;
+	} else {
+		spinlock_obtain(&hitm_site_lock);
+		(void)memset(hitm_sites, 0U, sizeof(hitm_sites));
+		hitm_sites_overflow = 0UL;
+		spinlock_release(&hitm_site_lock);
+
+		hv_hitm_period = period;
+		smp_call_function(get_active_pcpu_bitmap(),
+			profiling_hitm_enable_pcpu, NULL);
+	}
+
+	return ret;
+}
+
+/*
+ * Stop HITM sampling on all CPUs; the aggregated table stays readable
+ */
+void profiling_hitm_stop(void)
+{
+	if (hv_hitm_period != 0UL) {
+		hv_hitm_period = 0UL;
+		smp_call_function(get_active_pcpu_bitmap(),
+			profiling_hitm_disable_pcpu, NULL);
+	}
+}
+
+uint64_t profiling_hitm_period(void)
+{
+	return hv_hitm_period;
+}
+
+const struct hitm_site *profiling_hitm_site(uint32_t idx)
+{
+	return (idx < HITM_SITE_NUM) ? &hitm_sites[idx] : NULL;
+}
+
+uint64_t profiling_hitm_overflow(void)
+{
+	return hitm_sites_overflow;
+}
 
 /*
  * Performs MSR operations on all the CPU's
@@ -1320,7 +1627,8 @@ void profiling_pre_vmexit_handler(struct acrn_vcpu *vcpu)
 	exit_reason = vcpu->arch.exit_reason & 0xFFFFUL;
 
 	if ((get_cpu_var(profiling_info.s_state).pmu_state == PMU_RUNNING) ||
-		(get_cpu_var(profiling_info.soc_state) == SW_RUNNING)) {
+		(get_cpu_var(profiling_info.soc_state) == SW_RUNNING) ||
+		(hv_sampling_period != 0UL)) {
 
 		get_cpu_var(profiling_info.vm_info).vmexit_tsc = cpu_ticks();
 		get_cpu_var(profiling_info.vm_info).vmexit_reason
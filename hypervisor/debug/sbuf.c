@@ -14,6 +14,54 @@
 #include <errno.h>
 #include <asm/cpu.h>
 #include <asm/per_cpu.h>
+#include <asm/mmu.h>
+#include <asm/notify.h>
+
+/*
+ * Shared buffers are written from the hypervisor and only ever read
+ * back through the consumer's own mapping in the Service VM, so the
+ * hypervisor maps them write-combining: trace/log stores then drain
+ * through the WC buffers instead of allocating LLC lines. On a
+ * CAT-partitioned platform this keeps heavy tracing from evicting
+ * lines that belong to the RT cache partition, since per-page CLOS
+ * steering does not exist in the architecture - cache allocation
+ * follows the CLOS of the core doing the fill, not the page.
+ *
+ * The attribute change must reach every pCPU that produces into the
+ * buffer, so stale (write-back) translations are shot down with a
+ * broadcast flush after each remap.
+ */
+struct sbuf_mem_range {
+	uint64_t base;
+	uint64_t size;
+};
+
+static void sbuf_flush_tlb_fn(void *data)
+{
+	const struct sbuf_mem_range *range = (const struct sbuf_mem_range *)data;
+
+	flush_tlb_range(range->base, range->size);
+}
+
+static void sbuf_set_mem_attr(struct shared_buf *sbuf, bool wc)
+{
+	struct sbuf_mem_range range;
+	uint64_t size;
+
+	stac();
+	size = (uint64_t)SBUF_HEAD_SIZE + sbuf->size;
+	clac();
+
+	if (wc) {
+		set_paging_wc((uint64_t)sbuf, size);
+	} else {
+		set_paging_wb((uint64_t)sbuf, size);
+	}
+
+	range.base = (uint64_t)sbuf;
+	range.size = size;
+	smp_call_function(get_active_pcpu_bitmap(), sbuf_flush_tlb_fn, &range);
+}
 
 uint32_t sbuf_next_ptr(uint32_t pos_arg,
 		uint32_t span, uint32_t scope)
@@ -42,50 +90,101 @@ uint32_t sbuf_next_ptr(uint32_t pos_arg,
  * negative:	failed.
  */
 
-uint32_t sbuf_put(struct shared_buf *sbuf, uint8_t *data)
+uint32_t sbuf_put(uint32_t sbuf_id, uint8_t *data)
 {
+	struct shared_buf *sbuf = get_cpu_var(sbuf)[sbuf_id];
+	struct sbuf_shadow *shadow = &get_cpu_var(sbuf_shadow)[sbuf_id];
 	void *to;
 	uint32_t next_tail;
-	uint32_t ele_size;
-	bool trigger_overwrite = false;
-
-	stac();
-	next_tail = sbuf_next_ptr(sbuf->tail, sbuf->ele_size, sbuf->size);
-	/* if this write would trigger overrun */
-	if (next_tail == sbuf->head) {
-		/* accumulate overrun count if necessary */
-		sbuf->overrun_cnt += sbuf->flags & OVERRUN_CNT_EN;
-		if ((sbuf->flags & OVERWRITE_EN) == 0U) {
-			/* if not enable over write, return here. */
-			clac();
-			return 0;
-		}
-		trigger_overwrite = true;
-	}
+	uint32_t ele_size = 0U;
 
-	to = (void *)sbuf + SBUF_HEAD_SIZE + sbuf->tail;
+	if (sbuf != NULL) {
+		stac();
+		if ((sbuf->flags & OVERWRITE_EN) != 0U) {
+			/* Overwrite mode moves the shared head from the producer side
+			 * and requires external locking anyway, so it keeps working on
+			 * the shared positions directly.
+			 */
+			bool trigger_overwrite = false;
 
-	(void)memcpy_s(to, sbuf->ele_size, data, sbuf->ele_size);
-
-	if (trigger_overwrite) {
-		sbuf->head = sbuf_next_ptr(sbuf->head,
-				sbuf->ele_size, sbuf->size);
+			next_tail = sbuf_next_ptr(sbuf->tail, sbuf->ele_size, sbuf->size);
+			if (next_tail == sbuf->head) {
+				sbuf->overrun_cnt += sbuf->flags & OVERRUN_CNT_EN;
+				trigger_overwrite = true;
+			}
+			to = (void *)sbuf + SBUF_HEAD_SIZE + sbuf->tail;
+			(void)memcpy_s(to, sbuf->ele_size, data, sbuf->ele_size);
+			/* the buffer is mapped WC: drain the weakly ordered
+			 * stores before the new tail becomes visible */
+			cpu_write_memory_barrier();
+			if (trigger_overwrite) {
+				sbuf->head = sbuf_next_ptr(sbuf->head,
+						sbuf->ele_size, sbuf->size);
+			}
+			sbuf->tail = next_tail;
+			ele_size = sbuf->ele_size;
+		} else {
+			next_tail = sbuf_next_ptr(shadow->tail, shadow->ele_size, shadow->size);
+			/* the cached head may lag the consumer but never lead it, so
+			 * only an apparent overrun needs the shared header re-read */
+			if (next_tail == shadow->head) {
+				shadow->head = sbuf->head;
+			}
+			if (next_tail == shadow->head) {
+				/* buffer full: drop the element and account for it */
+				shadow->dropped++;
+				if ((sbuf->flags & OVERRUN_CNT_EN) != 0U) {
+					sbuf->overrun_cnt++;
+				}
+			} else {
+				to = (void *)sbuf + SBUF_HEAD_SIZE + shadow->tail;
+				(void)memcpy_s(to, shadow->ele_size, data, shadow->ele_size);
+				shadow->tail = next_tail;
+				/* the buffer is mapped WC: drain the weakly ordered
+				 * stores before the new tail becomes visible */
+				cpu_write_memory_barrier();
+				sbuf->tail = next_tail;
+				ele_size = shadow->ele_size;
+			}
+		}
+		clac();
 	}
-	sbuf->tail = next_tail;
-
-	ele_size = sbuf->ele_size;
-	clac();
 
 	return ele_size;
 }
 
 int32_t sbuf_share_setup(uint16_t pcpu_id, uint32_t sbuf_id, uint64_t *hva)
 {
+	struct shared_buf *sbuf = (struct shared_buf *)hva;
+	struct shared_buf *old_sbuf;
+	struct sbuf_shadow *shadow;
+
 	if ((pcpu_id >= get_pcpu_nums()) || (sbuf_id >= ACRN_SBUF_ID_MAX)) {
 		return -EINVAL;
 	}
 
-	per_cpu(sbuf, pcpu_id)[sbuf_id] = (struct shared_buf *) hva;
+	/* the pages of a torn down or replaced buffer go back to the
+	 * Service VM as ordinary memory; make them write-back again */
+	old_sbuf = per_cpu(sbuf, pcpu_id)[sbuf_id];
+	if ((old_sbuf != NULL) && (old_sbuf != sbuf)) {
+		sbuf_set_mem_attr(old_sbuf, false);
+	}
+
+	shadow = &per_cpu(sbuf_shadow, pcpu_id)[sbuf_id];
+	(void)memset(shadow, 0U, sizeof(*shadow));
+	if (sbuf != NULL) {
+		/* snapshot the geometry: the put path must not depend on fields
+		 * the consumer side could change under our feet */
+		stac();
+		shadow->tail = sbuf->tail;
+		shadow->head = sbuf->head;
+		shadow->ele_size = sbuf->ele_size;
+		shadow->size = sbuf->size;
+		clac();
+		sbuf_set_mem_attr(sbuf, true);
+	}
+
+	per_cpu(sbuf, pcpu_id)[sbuf_id] = sbuf;
 	pr_info("%s share sbuf for pCPU[%u] with sbuf_id[%u] setup successfully",
 			__func__, pcpu_id, sbuf_id);
 
@@ -94,11 +193,18 @@ int32_t sbuf_share_setup(uint16_t pcpu_id, uint32_t sbuf_id, uint64_t *hva)
 
 void sbuf_reset(void)
 {
+	struct shared_buf *sbuf;
 	uint16_t pcpu_id, sbuf_id;
 
 	for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
 		for (sbuf_id = 0U; sbuf_id < ACRN_SBUF_ID_MAX; sbuf_id++) {
+			sbuf = per_cpu(sbuf, pcpu_id)[sbuf_id];
+			if (sbuf != NULL) {
+				sbuf_set_mem_attr(sbuf, false);
+			}
 			per_cpu(sbuf, pcpu_id)[sbuf_id] = 0U;
+			(void)memset(&per_cpu(sbuf_shadow, pcpu_id)[sbuf_id], 0U,
+					sizeof(struct sbuf_shadow));
 		}
 	}
 }
@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <asm/lib/bits.h>
 #include "shell_priv.h"
+#include <asm/cpu.h>
 #include <asm/irq.h>
 #include <console.h>
 #include <asm/per_cpu.h>
@@ -15,13 +16,17 @@
 #include <asm/cpuid.h>
 #include <asm/ioapic.h>
 #include <ptdev.h>
+#include <asm/page.h>
+#include <asm/vtd.h>
 #include <asm/guest/vm.h>
 #include <sprintf.h>
 #include <logmsg.h>
 #include <version.h>
 #include <shell.h>
+#include <lockstat.h>
 #include <asm/guest/vmcs.h>
 #include <asm/host_pm.h>
+#include <ticks.h>
 
 #define TEMP_STR_SIZE		60U
 #define MAX_STR_SIZE		256U
@@ -35,6 +40,11 @@ static char shell_log_buf[SHELL_LOG_BUF_SIZE];
  */
 #define SHELL_INPUT_LINE_OTHER(v)	(((v) + 1U) & 0x1U)
 
+/* console kicks a staged command may wait for the BSP idle thread
+ * before the kick context runs it itself
+ */
+#define SHELL_DEFER_TIMEOUT_KICKS	100U
+
 static int32_t shell_cmd_help(__unused int32_t argc, __unused char **argv);
 static int32_t shell_version(__unused int32_t argc, __unused char **argv);
 static int32_t shell_list_vm(__unused int32_t argc, __unused char **argv);
@@ -43,6 +53,7 @@ static int32_t shell_vcpu_dumpreg(int32_t argc, char **argv);
 static int32_t shell_dump_host_mem(int32_t argc, char **argv);
 static int32_t shell_dump_guest_mem(int32_t argc, char **argv);
 static int32_t shell_to_vm_console(int32_t argc, char **argv);
+static int32_t shell_dump_vm_console(int32_t argc, char **argv);
 static int32_t shell_show_cpu_int(__unused int32_t argc, __unused char **argv);
 static int32_t shell_show_ptdev_info(__unused int32_t argc, __unused char **argv);
 static int32_t shell_show_vioapic_info(int32_t argc, char **argv);
@@ -52,6 +63,19 @@ static int32_t shell_cpuid(int32_t argc, char **argv);
 static int32_t shell_reboot(int32_t argc, char **argv);
 static int32_t shell_rdmsr(int32_t argc, char **argv);
 static int32_t shell_wrmsr(int32_t argc, char **argv);
+static int32_t shell_vmexit_stats(int32_t argc, char **argv);
+static int32_t shell_msrexit_stats(int32_t argc, char **argv);
+static int32_t shell_show_timer_stats(__unused int32_t argc, __unused char **argv);
+static int32_t shell_show_softirq_stats(__unused int32_t argc, __unused char **argv);
+static int32_t shell_show_ept_heatmap(int32_t argc, char **argv);
+static int32_t shell_show_emul_prof(int32_t argc, char **argv);
+static int32_t shell_show_lockstat(__unused int32_t argc, __unused char **argv);
+static int32_t shell_show_poolstat(__unused int32_t argc, __unused char **argv);
+static int32_t shell_show_iommustat(__unused int32_t argc, __unused char **argv);
+#ifdef PROFILING_ON
+static int32_t shell_sample_pmu(int32_t argc, char **argv);
+static int32_t shell_sample_hitm(int32_t argc, char **argv);
+#endif
 
 static struct shell_cmd shell_cmds[] = {
 	{
@@ -102,6 +126,12 @@ static struct shell_cmd shell_cmds[] = {
 		.help_str	= SHELL_CMD_VM_CONSOLE_HELP,
 		.fcn		= shell_to_vm_console,
 	},
+	{
+		.str		= SHELL_CMD_VM_CONSOLE_DUMP,
+		.cmd_param	= SHELL_CMD_VM_CONSOLE_DUMP_PARAM,
+		.help_str	= SHELL_CMD_VM_CONSOLE_DUMP_HELP,
+		.fcn		= shell_dump_vm_console,
+	},
 	{
 		.str		= SHELL_CMD_INTERRUPT,
 		.cmd_param	= SHELL_CMD_INTERRUPT_PARAM,
@@ -156,6 +186,74 @@ static struct shell_cmd shell_cmds[] = {
 		.help_str	= SHELL_CMD_WRMSR_HELP,
 		.fcn		= shell_wrmsr,
 	},
+	{
+		.str		= SHELL_CMD_VMEXIT,
+		.cmd_param	= SHELL_CMD_VMEXIT_PARAM,
+		.help_str	= SHELL_CMD_VMEXIT_HELP,
+		.fcn		= shell_vmexit_stats,
+	},
+	{
+		.str		= SHELL_CMD_MSREXIT,
+		.cmd_param	= SHELL_CMD_MSREXIT_PARAM,
+		.help_str	= SHELL_CMD_MSREXIT_HELP,
+		.fcn		= shell_msrexit_stats,
+	},
+	{
+		.str		= SHELL_CMD_TIMER,
+		.cmd_param	= SHELL_CMD_TIMER_PARAM,
+		.help_str	= SHELL_CMD_TIMER_HELP,
+		.fcn		= shell_show_timer_stats,
+	},
+	{
+		.str		= SHELL_CMD_SOFTIRQ,
+		.cmd_param	= SHELL_CMD_SOFTIRQ_PARAM,
+		.help_str	= SHELL_CMD_SOFTIRQ_HELP,
+		.fcn		= shell_show_softirq_stats,
+	},
+	{
+		.str		= SHELL_CMD_EPTMAP,
+		.cmd_param	= SHELL_CMD_EPTMAP_PARAM,
+		.help_str	= SHELL_CMD_EPTMAP_HELP,
+		.fcn		= shell_show_ept_heatmap,
+	},
+	{
+		.str		= SHELL_CMD_EMUL_PROF,
+		.cmd_param	= SHELL_CMD_EMUL_PROF_PARAM,
+		.help_str	= SHELL_CMD_EMUL_PROF_HELP,
+		.fcn		= shell_show_emul_prof,
+	},
+	{
+		.str		= SHELL_CMD_LOCKSTAT,
+		.cmd_param	= SHELL_CMD_LOCKSTAT_PARAM,
+		.help_str	= SHELL_CMD_LOCKSTAT_HELP,
+		.fcn		= shell_show_lockstat,
+	},
+	{
+		.str		= SHELL_CMD_POOLSTAT,
+		.cmd_param	= SHELL_CMD_POOLSTAT_PARAM,
+		.help_str	= SHELL_CMD_POOLSTAT_HELP,
+		.fcn		= shell_show_poolstat,
+	},
+	{
+		.str		= SHELL_CMD_IOMMUSTAT,
+		.cmd_param	= SHELL_CMD_IOMMUSTAT_PARAM,
+		.help_str	= SHELL_CMD_IOMMUSTAT_HELP,
+		.fcn		= shell_show_iommustat,
+	},
+#ifdef PROFILING_ON
+	{
+		.str		= SHELL_CMD_SAMPLE,
+		.cmd_param	= SHELL_CMD_SAMPLE_PARAM,
+		.help_str	= SHELL_CMD_SAMPLE_HELP,
+		.fcn		= shell_sample_pmu,
+	},
+	{
+		.str		= SHELL_CMD_HITM,
+		.cmd_param	= SHELL_CMD_HITM_PARAM,
+		.help_str	= SHELL_CMD_HITM_HELP,
+		.fcn		= shell_sample_hitm,
+	},
+#endif
 };
 
 /* The initial log level*/
@@ -250,9 +348,24 @@ static char shell_getc(void)
 
 static void shell_puts(const char *string_ptr)
 {
-	/* Output the string */
-	(void)console_write(string_ptr, strnlen_s(string_ptr,
-				SHELL_STRING_MAX_LEN));
+	uint32_t len = (uint32_t)strnlen_s(string_ptr, SHELL_STRING_MAX_LEN);
+	uint32_t done = 0U;
+
+	if (p_shell->deferred_output) {
+		/* Executing in the idle thread: stage through the console
+		 * ring and let the console timer pace the UART, waiting for
+		 * the drain when a large dump fills the ring.
+		 */
+		while (done < len) {
+			done += console_log_stage_raw(string_ptr + done, len - done);
+			if (done < len) {
+				asm_pause();
+			}
+		}
+	} else {
+		/* Output the string */
+		(void)console_write(string_ptr, len);
+	}
 }
 
 static uint16_t sanitize_vmid(uint16_t vmid)
@@ -423,9 +536,40 @@ static int32_t shell_process_cmd(const char *p_input_line)
 	return status;
 }
 
-static int32_t shell_process(void)
+/* batch syntax: 'cmd1; cmd2' runs the commands in order; destructive to
+ * the line, like the argv split below it
+ */
+static int32_t shell_process_line(char *p_line)
+{
+	int32_t status = 0;
+	char *cmd = p_line;
+	char *p, *next;
+
+	while (cmd != NULL) {
+		next = NULL;
+		for (p = cmd; *p != '\0'; p++) {
+			if (*p == ';') {
+				*p = '\0';
+				next = p + 1;
+				break;
+			}
+		}
+
+		/* skip leading blanks so 'cmd1; cmd2' parses naturally */
+		while (*cmd == ' ') {
+			cmd++;
+		}
+		if (*cmd != '\0') {
+			status = shell_process_cmd(cmd);
+		}
+		cmd = next;
+	}
+
+	return status;
+}
+
+static void shell_process(void)
 {
-	int32_t status;
 	char *p_input_line;
 
 	/* Check for the repeat command character in active input line.
@@ -446,41 +590,87 @@ static int32_t shell_process(void)
 			SHELL_INPUT_LINE_OTHER(p_shell->input_line_active);
 	}
 
-	/* Process command */
-	status = shell_process_cmd(p_input_line);
+	/* Stage the line for the BSP idle thread instead of executing on
+	 * the console polling context, so a heavyweight dump never stalls
+	 * exit processing on this pCPU.
+	 */
+	(void)strncpy_s(p_shell->deferred_line, SHELL_CMD_MAX_LEN + 1U,
+			p_input_line, SHELL_CMD_MAX_LEN);
+	p_shell->deferred_age = 0U;
+	p_shell->deferred_pending = true;
 
-	/* Now that the command is processed, zero fill the input buffer */
+	/* Now that the command is staged, zero fill the input buffer */
 	(void)memset((void *) p_shell->input_line[p_shell->input_line_active],
 			0, SHELL_CMD_MAX_LEN + 1U);
+}
 
-	/* Process command and return result to caller */
-	return status;
+/* claim and run the staged command; the claim is done with interrupts
+ * disabled as the console timer's fallback path can interrupt the idle
+ * thread on the same pCPU
+ */
+static void shell_run_deferred(bool stage_output)
+{
+	char line[SHELL_CMD_MAX_LEN + 1U];
+	bool claimed = false;
+	uint64_t rflags;
+
+	CPU_INT_ALL_DISABLE(&rflags);
+	if (p_shell->deferred_pending) {
+		(void)strncpy_s(line, SHELL_CMD_MAX_LEN + 1U,
+				p_shell->deferred_line, SHELL_CMD_MAX_LEN);
+		p_shell->deferred_pending = false;
+		claimed = true;
+	}
+	CPU_INT_ALL_RESTORE(rflags);
+
+	if (claimed) {
+		p_shell->deferred_output = stage_output;
+		(void)shell_process_line(line);
+		p_shell->deferred_output = false;
+	}
 }
 
+void shell_idle_process(void)
+{
+	if ((get_pcpu_id() == BSP_CPU_ID) && p_shell->deferred_pending) {
+		shell_run_deferred(true);
+	}
+}
 
 void shell_kick(void)
 {
 	static bool is_cmd_cmplt = true;
 
-	/* At any given instance, UART may be owned by the HV
-	 * OR by the guest that has enabled the vUart.
-	 * Show HV shell prompt ONLY when HV owns the
-	 * serial port.
-	 */
-	/* Prompt the user for a selection. */
-	if (is_cmd_cmplt) {
-		shell_puts(SHELL_PROMPT_STR);
-	}
+	if (p_shell->deferred_pending) {
+		/* The BSP idle thread normally picks the command up; if the
+		 * BSP never idles (e.g. it hosts a lapic-pt RT vcpu) run it
+		 * here after a grace period so the shell cannot wedge.
+		 */
+		p_shell->deferred_age++;
+		if (p_shell->deferred_age >= SHELL_DEFER_TIMEOUT_KICKS) {
+			shell_run_deferred(false);
+		}
+	} else {
+		/* At any given instance, UART may be owned by the HV
+		 * OR by the guest that has enabled the vUart.
+		 * Show HV shell prompt ONLY when HV owns the
+		 * serial port.
+		 */
+		/* Prompt the user for a selection. */
+		if (is_cmd_cmplt) {
+			shell_puts(SHELL_PROMPT_STR);
+		}
 
-	/* Get user's input */
-	is_cmd_cmplt = shell_input_line();
+		/* Get user's input */
+		is_cmd_cmplt = shell_input_line();
 
-	/* If user has pressed the ENTER then process
-	 * the command
-	 */
-	if (is_cmd_cmplt) {
-		/* Process current input line. */
-		(void)shell_process();
+		/* If user has pressed the ENTER then stage
+		 * the command
+		 */
+		if (is_cmd_cmplt) {
+			/* Stage current input line. */
+			shell_process();
+		}
 	}
 }
 
@@ -848,6 +1038,428 @@ out:
 	return status;
 }
 
+static int32_t shell_vmexit_stats(int32_t argc, char **argv)
+{
+	int32_t status = 0;
+	uint16_t vm_id, vcpu_id, pcpu_id;
+	uint32_t reason, bucket;
+	struct acrn_vm *vm;
+	struct acrn_vcpu *vcpu;
+	struct vmexit_stat *stat;
+	char temp_str[MAX_STR_SIZE];
+
+	if (argc == 1) {
+		/* per-pCPU totals, to verify that an isolated core stays exit-free */
+		shell_puts("\r\nPCPU_ID      TOTAL_VMEXIT\r\n");
+		for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+			snprintf(temp_str, MAX_STR_SIZE, "%-12hu %-12lu\r\n",
+				pcpu_id, per_cpu(vmexit_cnt, pcpu_id));
+			shell_puts(temp_str);
+		}
+	} else if ((argc != 3) && (argc != 4)) {
+		shell_puts("Please enter cmd with <vm_id, vcpu_id> [clear]\r\n");
+		status = -EINVAL;
+	} else {
+		status = strtol_deci(argv[1]);
+		if (status >= 0) {
+			vm_id = sanitize_vmid((uint16_t)status);
+			vcpu_id = (uint16_t)strtol_deci(argv[2]);
+			vm = get_vm_from_vmid(vm_id);
+			if (is_poweroff_vm(vm)) {
+				shell_puts("No vm found in the input <vm_id, vcpu_id>\r\n");
+				status = -EINVAL;
+			} else if (vcpu_id >= vm->hw.created_vcpus) {
+				shell_puts("vcpu id is out of range\r\n");
+				status = -EINVAL;
+			} else {
+				vcpu = vcpu_from_vid(vm, vcpu_id);
+				if ((argc == 4) && (strcmp(argv[3], "clear") == 0)) {
+					(void)memset(vcpu->vmexit_stats, 0U, sizeof(vcpu->vmexit_stats));
+					shell_puts("vmexit data cleared\r\n");
+				} else {
+					snprintf(temp_str, MAX_STR_SIZE,
+						"\r\nVM %hu vCPU %hu, histogram buckets are log2(cycles)\r\n"
+						"REASON      COUNT        TOTAL_CYCLES       HIST(bucket:count)\r\n",
+						vm_id, vcpu_id);
+					shell_puts(temp_str);
+					for (reason = 0U; reason < NR_VMX_EXIT_REASONS; reason++) {
+						stat = &vcpu->vmexit_stats[reason];
+						if (stat->count != 0UL) {
+							snprintf(temp_str, MAX_STR_SIZE, "%-11u %-12lu %-18lu",
+								reason, stat->count, stat->total_cycles);
+							shell_puts(temp_str);
+							for (bucket = 0U; bucket < VMEXIT_HIST_NR_BUCKETS; bucket++) {
+								if (stat->hist[bucket] != 0U) {
+									snprintf(temp_str, MAX_STR_SIZE, " %u:%u",
+										bucket, stat->hist[bucket]);
+									shell_puts(temp_str);
+								}
+							}
+							shell_puts("\r\n");
+						}
+					}
+				}
+				status = 0;
+			}
+		}
+	}
+
+	return status;
+}
+
+static int32_t shell_msrexit_stats(int32_t argc, char **argv)
+{
+	int32_t status = 0;
+	uint16_t vm_id, vcpu_id;
+	uint32_t i;
+	struct acrn_vm *vm;
+	struct acrn_vcpu *vcpu;
+	struct msr_exit_stat *stat;
+	char temp_str[MAX_STR_SIZE];
+
+	if ((argc != 3) && (argc != 4)) {
+		shell_puts("Please enter cmd with <vm_id, vcpu_id> [clear]\r\n");
+		status = -EINVAL;
+	} else {
+		status = strtol_deci(argv[1]);
+		if (status >= 0) {
+			vm_id = sanitize_vmid((uint16_t)status);
+			vcpu_id = (uint16_t)strtol_deci(argv[2]);
+			vm = get_vm_from_vmid(vm_id);
+			if (is_poweroff_vm(vm)) {
+				shell_puts("No vm found in the input <vm_id, vcpu_id>\r\n");
+				status = -EINVAL;
+			} else if (vcpu_id >= vm->hw.created_vcpus) {
+				shell_puts("vcpu id is out of range\r\n");
+				status = -EINVAL;
+			} else {
+				vcpu = vcpu_from_vid(vm, vcpu_id);
+				if ((argc == 4) && (strcmp(argv[3], "clear") == 0)) {
+					(void)memset(vcpu->msr_exit_stats, 0U, sizeof(vcpu->msr_exit_stats));
+					shell_puts("msrexit data cleared\r\n");
+				} else {
+					snprintf(temp_str, MAX_STR_SIZE,
+						"\r\nVM %hu vCPU %hu\r\nMSR          READS        WRITES       PT\r\n",
+						vm_id, vcpu_id);
+					shell_puts(temp_str);
+					for (i = 0U; i < MSR_EXIT_STATS_ENTRIES; i++) {
+						stat = &vcpu->msr_exit_stats[i];
+						if ((stat->rd_count | stat->wr_count) != 0UL) {
+							if (stat->msr == MSR_EXIT_STATS_OTHER) {
+								snprintf(temp_str, MAX_STR_SIZE,
+									"%-12s %-12lu %-12lu -\r\n",
+									"other", stat->rd_count, stat->wr_count);
+							} else {
+								snprintf(temp_str, MAX_STR_SIZE,
+									"0x%08x   %-12lu %-12lu %u\r\n",
+									stat->msr, stat->rd_count, stat->wr_count,
+									stat->passthrough);
+							}
+							shell_puts(temp_str);
+						}
+					}
+				}
+				status = 0;
+			}
+		}
+	}
+
+	return status;
+}
+
+static int32_t shell_show_timer_stats(__unused int32_t argc, __unused char **argv)
+{
+	uint16_t pcpu_id;
+	struct per_cpu_timers *cpu_timer;
+	char temp_str[MAX_STR_SIZE];
+
+	shell_puts("\r\nCPU_ID      ADDED        CASCADED     OCCUPANCY(L0/L1/L2/L3)\r\n");
+	for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+		cpu_timer = &per_cpu(cpu_timers, pcpu_id);
+		snprintf(temp_str, MAX_STR_SIZE, "%-11hu %-12lu %-12lu %016lx/%016lx/%016lx/%016lx\r\n",
+			pcpu_id, cpu_timer->stats_added, cpu_timer->stats_cascaded,
+			cpu_timer->occupancy[0U], cpu_timer->occupancy[1U],
+			cpu_timer->occupancy[2U], cpu_timer->occupancy[3U]);
+		shell_puts(temp_str);
+	}
+
+	return 0;
+}
+
+static int32_t shell_show_ept_heatmap(int32_t argc, char **argv)
+{
+	uint16_t pcpu_id;
+	uint32_t bucket;
+	uint64_t mmio, spurious, start, end;
+	char temp_str[MAX_STR_SIZE];
+
+	if ((argc == 2) && (strcmp(argv[1], "clear") == 0)) {
+		for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+			(void)memset(per_cpu(ept_heatmap_mmio, pcpu_id), 0U,
+				sizeof(per_cpu(ept_heatmap_mmio, pcpu_id)));
+			(void)memset(per_cpu(ept_heatmap_spurious, pcpu_id), 0U,
+				sizeof(per_cpu(ept_heatmap_spurious, pcpu_id)));
+		}
+		shell_puts("\r\nEPT heatmap cleared\r\n");
+	} else {
+		shell_puts("\r\nGPA_RANGE                              MMIO         SPURIOUS\r\n");
+		for (bucket = 0U; bucket < 64U; bucket++) {
+			mmio = 0UL;
+			spurious = 0UL;
+			for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+				mmio += per_cpu(ept_heatmap_mmio, pcpu_id)[bucket];
+				spurious += per_cpu(ept_heatmap_spurious, pcpu_id)[bucket];
+			}
+			if ((mmio | spurious) != 0UL) {
+				start = (bucket == 0U) ? 0UL : (1UL << bucket);
+				end = (bucket < 63U) ? ((1UL << (bucket + 1U)) - 1UL) : ~0UL;
+				snprintf(temp_str, MAX_STR_SIZE, "0x%016lx-0x%016lx  %-12lu %-12lu\r\n",
+					start, end, mmio, spurious);
+				shell_puts(temp_str);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int32_t shell_show_emul_prof(int32_t argc, char **argv)
+{
+	uint16_t pcpu_id;
+	uint32_t idx;
+	uint64_t hits, cycles;
+	char temp_str[MAX_STR_SIZE];
+
+	if ((argc == 2) && (strcmp(argv[1], "clear") == 0)) {
+		for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+			(void)memset(per_cpu(instr_emul_hits, pcpu_id), 0U,
+				sizeof(per_cpu(instr_emul_hits, pcpu_id)));
+			(void)memset(per_cpu(instr_emul_cycles, pcpu_id), 0U,
+				sizeof(per_cpu(instr_emul_cycles, pcpu_id)));
+		}
+		shell_puts("\r\nInstruction emulation profile cleared\r\n");
+	} else {
+		shell_puts("\r\nOPCODE      HITS         CYCLES       CYCLES/HIT\r\n");
+		for (idx = 0U; idx < 512U; idx++) {
+			hits = 0UL;
+			cycles = 0UL;
+			for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+				hits += per_cpu(instr_emul_hits, pcpu_id)[idx];
+				cycles += per_cpu(instr_emul_cycles, pcpu_id)[idx];
+			}
+			if (hits != 0UL) {
+				snprintf(temp_str, MAX_STR_SIZE, "%s%02x       %-12lu %-12lu %-12lu\r\n",
+					(idx >= 256U) ? "0f " : "   ", idx & 0xFFU,
+					hits, cycles, cycles / hits);
+				shell_puts(temp_str);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int32_t shell_show_softirq_stats(__unused int32_t argc, __unused char **argv)
+{
+	uint16_t pcpu_id;
+	char temp_str[MAX_STR_SIZE];
+
+	shell_puts("\r\nCPU_ID      TIMER_US     TIMER_CNT    PTDEV_US     PTDEV_CNT    OVERRUN\r\n");
+	for (pcpu_id = 0U; pcpu_id < get_pcpu_nums(); pcpu_id++) {
+		snprintf(temp_str, MAX_STR_SIZE, "%-11hu %-12lu %-12lu %-12lu %-12lu %-12lu\r\n",
+			pcpu_id,
+			ticks_to_us(per_cpu(softirq_cycles, pcpu_id)[SOFTIRQ_TIMER]),
+			per_cpu(softirq_cnt, pcpu_id)[SOFTIRQ_TIMER],
+			ticks_to_us(per_cpu(softirq_cycles, pcpu_id)[SOFTIRQ_PTDEV]),
+			per_cpu(softirq_cnt, pcpu_id)[SOFTIRQ_PTDEV],
+			per_cpu(softirq_overrun_cnt, pcpu_id));
+		shell_puts(temp_str);
+	}
+
+	return 0;
+}
+
+static int32_t shell_show_lockstat(__unused int32_t argc, __unused char **argv)
+{
+	uint32_t i;
+	const struct lock_stat *stat;
+	char temp_str[MAX_STR_SIZE];
+
+	shell_puts("\r\nLOCK_SITE        ACQUISITIONS CONTENDED    SPINS        MAX_HOLD_CYCLES\r\n");
+	for (i = 0U; i < lockstat_get_site_nr(); i++) {
+		stat = lockstat_get_site(i);
+		snprintf(temp_str, MAX_STR_SIZE, "%-16s %-12lu %-12lu %-12lu %-12lu\r\n",
+			stat->name, stat->acquisitions, stat->contended,
+			stat->spins, stat->max_hold);
+		shell_puts(temp_str);
+	}
+
+	return 0;
+}
+
+static int32_t shell_show_poolstat(__unused int32_t argc, __unused char **argv)
+{
+	uint32_t i, used, max_used;
+	struct page_pool_info info;
+	char temp_str[MAX_STR_SIZE];
+
+	shell_puts("\r\nPOOL         ID    USED         MAX_USED     TOTAL\r\n");
+	for (i = 0U; i < get_page_pool_nr(); i++) {
+		get_page_pool_info(i, &info);
+		snprintf(temp_str, MAX_STR_SIZE, "%-12s %-5hu %-12lu %-12lu %-12lu\r\n",
+			info.name, info.id, info.used_pages,
+			info.max_used_pages, info.total_pages);
+		shell_puts(temp_str);
+	}
+
+	ptirq_get_entry_stats(&used, &max_used);
+	snprintf(temp_str, MAX_STR_SIZE, "%-12s %-5hu %-12u %-12u %-12u\r\n",
+		"ptirq", 0U, used, max_used, CONFIG_MAX_PT_IRQ_ENTRIES);
+	shell_puts(temp_str);
+
+	return 0;
+}
+
+static int32_t shell_show_iommustat(__unused int32_t argc, __unused char **argv)
+{
+	uint64_t hist[IOMMU_INV_LAT_BUCKETS];
+	struct iommu_domain_stats stats;
+	char temp_str[MAX_STR_SIZE];
+	uint64_t avg_us;
+	uint16_t vm_id;
+	uint32_t i;
+
+	shell_puts("\r\nVM    DEVS  CTX_INV    IOTLB_INV  AVG_US  MAX_US  "
+		"4K_MAPS    2M_MAPS    1G_MAPS\r\n");
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		iommu_get_domain_stats(vm_id, true, &stats);
+		if ((stats.dev_cnt == 0U) && (stats.iotlb_inv_cnt == 0UL)) {
+			continue;
+		}
+		avg_us = (stats.iotlb_inv_cnt != 0UL) ?
+			(stats.inv_total_us / stats.iotlb_inv_cnt) : 0UL;
+		snprintf(temp_str, MAX_STR_SIZE,
+			"%-5hu %-5u %-10lu %-10lu %-7lu %-7lu %-10lu %-10lu %-10lu\r\n",
+			vm_id, stats.dev_cnt, stats.ctx_inv_cnt, stats.iotlb_inv_cnt,
+			avg_us, stats.inv_max_us, stats.nr_4k, stats.nr_2m, stats.nr_1g);
+		shell_puts(temp_str);
+	}
+
+	iommu_get_inv_lat_hist(hist);
+	shell_puts("\r\nIOTLB shootdown latency (us):\r\n");
+	for (i = 0U; i < IOMMU_INV_LAT_BUCKETS; i++) {
+		if (i == (IOMMU_INV_LAT_BUCKETS - 1U)) {
+			snprintf(temp_str, MAX_STR_SIZE, ">=%-4u %lu\r\n",
+				1U << (i - 1U), hist[i]);
+		} else {
+			snprintf(temp_str, MAX_STR_SIZE, "<%-5u %lu\r\n",
+				1U << i, hist[i]);
+		}
+		shell_puts(temp_str);
+	}
+
+	return 0;
+}
+
+#ifdef PROFILING_ON
+static int32_t shell_sample_pmu(int32_t argc, char **argv)
+{
+	char temp_str[MAX_STR_SIZE];
+	uint64_t period;
+	int32_t ret = 0;
+
+	if (argc == 1) {
+		period = profiling_sampling_period();
+		if (period != 0UL) {
+			snprintf(temp_str, MAX_STR_SIZE,
+				"PMU sampling is on, period %lu cycles\r\n", period);
+		} else {
+			snprintf(temp_str, MAX_STR_SIZE, "PMU sampling is off\r\n");
+		}
+		shell_puts(temp_str);
+	} else if (strcmp(argv[1], "off") == 0) {
+		profiling_sampling_stop();
+		shell_puts("PMU sampling stopped\r\n");
+	} else {
+		period = (uint64_t)strtol_deci(argv[1]);
+		ret = profiling_sampling_start(period);
+		if (ret == 0) {
+			snprintf(temp_str, MAX_STR_SIZE,
+				"PMU sampling started, period %lu cycles\r\n", period);
+			shell_puts(temp_str);
+		} else if (ret == -EBUSY) {
+			shell_puts("PMU is owned by an active SEP collection\r\n");
+		} else {
+			shell_puts("invalid period, or sampling already running\r\n");
+		}
+	}
+
+	return ret;
+}
+
+static int32_t shell_sample_hitm(int32_t argc, char **argv)
+{
+	char temp_str[MAX_STR_SIZE];
+	uint64_t period;
+	int32_t ret = 0;
+
+	if (argc == 1) {
+		const struct hitm_site *site;
+		uint32_t i;
+
+		period = profiling_hitm_period();
+		if (period != 0UL) {
+			snprintf(temp_str, MAX_STR_SIZE,
+				"HITM sampling is on, period %lu events\r\n", period);
+		} else {
+			snprintf(temp_str, MAX_STR_SIZE, "HITM sampling is off\r\n");
+		}
+		shell_puts(temp_str);
+
+		shell_puts("\r\nVM     GPA_CACHELINE      SAMPLES\r\n");
+		for (i = 0U; i < HITM_SITE_NUM; i++) {
+			site = profiling_hitm_site(i);
+			if ((site == NULL) || (site->count == 0UL)) {
+				continue;
+			}
+			if (site->vm_id == 0xFFFFU) {
+				snprintf(temp_str, MAX_STR_SIZE,
+					"VMM    0x%016lx %-12lu\r\n",
+					site->cacheline, site->count);
+			} else {
+				snprintf(temp_str, MAX_STR_SIZE,
+					"%-6hu 0x%016lx %-12lu\r\n",
+					site->vm_id, site->cacheline, site->count);
+			}
+			shell_puts(temp_str);
+		}
+		if (profiling_hitm_overflow() != 0UL) {
+			snprintf(temp_str, MAX_STR_SIZE,
+				"(table full, %lu samples not aggregated - see trace)\r\n",
+				profiling_hitm_overflow());
+			shell_puts(temp_str);
+		}
+	} else if (strcmp(argv[1], "off") == 0) {
+		profiling_hitm_stop();
+		shell_puts("HITM sampling stopped\r\n");
+	} else {
+		period = (uint64_t)strtol_deci(argv[1]);
+		ret = profiling_hitm_start(period);
+		if (ret == 0) {
+			snprintf(temp_str, MAX_STR_SIZE,
+				"HITM sampling started, period %lu events\r\n", period);
+			shell_puts(temp_str);
+		} else if (ret == -EBUSY) {
+			shell_puts("PMU is owned by an active SEP collection\r\n");
+		} else {
+			shell_puts("invalid period, or sampling already running\r\n");
+		}
+	}
+
+	return ret;
+}
+#endif
+
 static int32_t shell_dump_host_mem(int32_t argc, char **argv)
 {
 	uint64_t *hva;
@@ -980,6 +1592,28 @@ static int32_t shell_to_vm_console(int32_t argc, char **argv)
 	return 0;
 }
 
+static int32_t shell_dump_vm_console(int32_t argc, char **argv)
+{
+	uint16_t vm_id = 0U;
+	struct acrn_vm *vm;
+
+	if (argc == 2) {
+		vm_id = sanitize_vmid((uint16_t)strtol_deci(argv[1]));
+	}
+
+	vm = get_vm_from_vmid(vm_id);
+	if (is_poweroff_vm(vm)) {
+		shell_puts("VM is not valid \n");
+		return -EINVAL;
+	}
+
+	/* the scrollback is captured continuously, so output printed while
+	 * the console was pointed at another VM is replayed here too */
+	vm_console_scrollback_dump(vm_id);
+
+	return 0;
+}
+
 /**
  * @brief Get the interrupt statistics
  *
@@ -33,6 +33,14 @@ struct shell {
 	uint32_t input_line_active;	/* Active input line index */
 	struct shell_cmd *cmds;	/* cmds supported */
 	uint32_t cmd_count;		/* Count of cmds supported */
+
+	/* a completed line is staged here for the BSP idle thread, so
+	 * command execution never runs on the console polling context
+	 */
+	char deferred_line[SHELL_CMD_MAX_LEN + 1U];
+	volatile bool deferred_pending;
+	bool deferred_output;	/* stage output through the console ring */
+	uint32_t deferred_age;	/* console kicks spent waiting for pickup */
 };
 
 /* Shell Command list with parameters and help description */
@@ -69,6 +77,10 @@ struct shell {
 #define SHELL_CMD_VM_CONSOLE_HELP	"Switch to the VM's console. Use [Ctrl+Spacebar] to return to the ACRN shell "\
 					"console"
 
+#define SHELL_CMD_VM_CONSOLE_DUMP	"vm_console_dump"
+#define SHELL_CMD_VM_CONSOLE_DUMP_PARAM	"<vm id>"
+#define SHELL_CMD_VM_CONSOLE_DUMP_HELP	"Replay the captured console scrollback of the VM"
+
 #define SHELL_CMD_INTERRUPT		"int"
 #define SHELL_CMD_INTERRUPT_PARAM	NULL
 #define SHELL_CMD_INTERRUPT_HELP	"List interrupt information per CPU"
@@ -102,6 +114,57 @@ struct shell {
 #define SHELL_CMD_RDMSR_PARAM		"[-p<pcpu_id>]	<msr_index>"
 #define SHELL_CMD_RDMSR_HELP		"Read the MSR at msr_index (in hexadecimal) for CPU ID pcpu_id"
 
+#define SHELL_CMD_VMEXIT		"vmexit"
+#define SHELL_CMD_VMEXIT_PARAM		"[<vm id, vcpu id> [clear]]"
+#define SHELL_CMD_VMEXIT_HELP		"Show total VM exits per pCPU, or per-exit-reason count and TSC-cycle "\
+					"latency histogram for a specific vCPU, or clear the accumulated data"
+
+#define SHELL_CMD_MSREXIT		"msrexit"
+#define SHELL_CMD_MSREXIT_PARAM		"<vm id, vcpu id> [clear]"
+#define SHELL_CMD_MSREXIT_HELP		"Show which intercepted MSRs actually fire on a vCPU (read/write exit "\
+					"counts and auto-passthrough state), or clear the accumulated data"
+
+#define SHELL_CMD_TIMER			"timer"
+#define SHELL_CMD_TIMER_PARAM		NULL
+#define SHELL_CMD_TIMER_HELP		"Show per-CPU timer wheel statistics (armed timers and cascade events)"
+
+#define SHELL_CMD_SOFTIRQ		"softirq"
+#define SHELL_CMD_SOFTIRQ_PARAM		NULL
+#define SHELL_CMD_SOFTIRQ_HELP		"Show per-CPU softirq statistics (cycles and runs per type, budget overruns)"
+
+#define SHELL_CMD_EPTMAP		"eptmap"
+#define SHELL_CMD_EPTMAP_PARAM		"[clear]"
+#define SHELL_CMD_EPTMAP_HELP		"Show the EPT violation GPA heatmap (power-of-two buckets, MMIO vs "\
+					"spurious faults, summed over pCPUs), or clear the accumulated data"
+
+#define SHELL_CMD_EMUL_PROF		"emul_prof"
+#define SHELL_CMD_EMUL_PROF_PARAM	"[clear]"
+#define SHELL_CMD_EMUL_PROF_HELP	"Show per-opcode instruction emulation counts and cycles (summed over "\
+					"pCPUs), or clear the accumulated data"
+
+#define SHELL_CMD_LOCKSTAT		"lockstat"
+#define SHELL_CMD_LOCKSTAT_PARAM	NULL
+#define SHELL_CMD_LOCKSTAT_HELP		"Show per-site spinlock contention statistics"
+
+#define SHELL_CMD_POOLSTAT		"poolstat"
+#define SHELL_CMD_POOLSTAT_PARAM	NULL
+#define SHELL_CMD_POOLSTAT_HELP		"Show static pool utilization and high watermarks"
+
+#define SHELL_CMD_IOMMUSTAT		"iommustat"
+#define SHELL_CMD_IOMMUSTAT_PARAM	NULL
+#define SHELL_CMD_IOMMUSTAT_HELP	"Show per-domain DMA remapping statistics, the mapped page-size mix "\
+					"and the IOTLB invalidation latency histogram"
+
+#define SHELL_CMD_SAMPLE		"sample"
+#define SHELL_CMD_SAMPLE_PARAM		"[<period>|off]"
+#define SHELL_CMD_SAMPLE_HELP		"Control PMU self-sampling: one (RIP, exit reason) trace record every "\
+					"<period> core cycles, captured with acrntrace"
+
+#define SHELL_CMD_HITM			"hitm"
+#define SHELL_CMD_HITM_PARAM		"[<period>|off]"
+#define SHELL_CMD_HITM_HELP		"Control cross-core HITM sampling: trace one guest cacheline address "\
+					"every <period> HITM snoops and show the per-VM hot-cacheline table"
+
 #define SHELL_CMD_WRMSR			"wrmsr"
 #define SHELL_CMD_WRMSR_PARAM		"[-p<pcpu_id>]	<msr_index> <value>"
 #define SHELL_CMD_WRMSR_HELP		"Write value (in hexadecimal) to the MSR at msr_index (in hexadecimal) for CPU"\
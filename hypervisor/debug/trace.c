@@ -6,7 +6,12 @@
 
 #include <types.h>
 #include <asm/per_cpu.h>
+#include <asm/e820.h>
+#include <asm/mmu.h>
+#include <asm/tsc.h>
+#include <asm/lib/atomic.h>
 #include <ticks.h>
+#include <logmsg.h>
 #include <trace.h>
 
 #define TRACE_CUSTOM			0xFCU
@@ -39,6 +44,73 @@ struct trace_entry {
 	} payload;
 } __aligned(8);
 
+/*
+ * Flight recorder: an always-on ring of high-priority events in a
+ * warm-reset persistent region (see e820_alloc_flight_recorder). The
+ * header and entries are left in place across boots so that the last
+ * events before a watchdog reset can be extracted from the Service VM
+ * after the system comes back.
+ */
+#define FR_MAGIC		0x4452434C46565248UL	/* "HVFLCRD" + version tag */
+#define FR_VERSION		1U
+#define FR_REGION_SIZE		(2UL * 1024UL * 1024UL)
+
+struct fr_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t entry_num;	/* capacity of the ring */
+	uint64_t write_cnt;	/* total entries written, slot = write_cnt % entry_num */
+	uint32_t boot_cnt;	/* incremented each boot that found a valid header */
+	uint32_t tsc_khz;	/* to convert entry timestamps of the last boot */
+	uint64_t reserved[4];	/* pads the header to one entry slot pair */
+};
+
+static struct fr_header *fr_hdr;
+static struct trace_entry *fr_ring;
+
+/* only high-priority events go to the (small) flight recorder */
+static inline bool fr_event(uint32_t evid)
+{
+	return (evid == TRACE_VM_EXIT) || (evid == TRACE_VM_ENTER) ||
+	       (evid == TRACE_SCHED_NEXT) ||
+	       ((evid >= TRACE_VMEXIT_ENTRY) && (evid <= TRACE_VMEXIT_LATENCY));
+}
+
+static inline void fr_put(const struct trace_entry *entry)
+{
+	uint64_t cnt = (uint64_t)atomic_xadd64((int64_t *)&fr_hdr->write_cnt, 1);
+
+	(void)memcpy_s(&fr_ring[cnt % fr_hdr->entry_num], sizeof(*entry),
+		       entry, sizeof(*entry));
+}
+
+void init_flight_recorder(void)
+{
+	uint64_t base = e820_alloc_flight_recorder(FR_REGION_SIZE);
+	struct fr_header *hdr = (struct fr_header *)hpa2hva(base);
+
+	if ((hdr->magic == FR_MAGIC) && (hdr->version == FR_VERSION) &&
+	    (hdr->entry_num == ((FR_REGION_SIZE - sizeof(*hdr)) / sizeof(struct trace_entry))) &&
+	    (hdr->write_cnt < ~0UL / 2UL)) {
+		/* warm reset with intact contents: keep recording into the
+		 * same ring so the pre-reset tail stays extractable */
+		hdr->boot_cnt++;
+	} else {
+		(void)memset(hdr, 0U, FR_REGION_SIZE);
+		hdr->magic = FR_MAGIC;
+		hdr->version = FR_VERSION;
+		hdr->entry_num = (FR_REGION_SIZE - sizeof(*hdr)) / sizeof(struct trace_entry);
+	}
+	hdr->tsc_khz = get_tsc_khz();
+
+	fr_ring = (struct trace_entry *)(hdr + 1);
+	/* publish the header last: fr_hdr != NULL enables the write path */
+	fr_hdr = hdr;
+
+	pr_info("flight recorder at 0x%lx, %u entries, boot %u",
+		base, hdr->entry_num, hdr->boot_cnt);
+}
+
 static inline bool trace_check(uint16_t cpu_id)
 {
 	if (per_cpu(sbuf, cpu_id)[ACRN_TRACE] == NULL) {
@@ -50,13 +122,16 @@ static inline bool trace_check(uint16_t cpu_id)
 
 static inline void trace_put(uint16_t cpu_id, uint32_t evid, uint32_t n_data, struct trace_entry *entry)
 {
-	struct shared_buf *sbuf = per_cpu(sbuf, cpu_id)[ACRN_TRACE];
-
 	entry->tsc = cpu_ticks();
 	entry->id = evid;
 	entry->n_data = (uint8_t)n_data;
 	entry->cpu = (uint8_t)cpu_id;
-	(void)sbuf_put(sbuf, (uint8_t *)entry);
+	if (trace_check(cpu_id)) {
+		(void)sbuf_put(ACRN_TRACE, (uint8_t *)entry);
+	}
+	if ((fr_hdr != NULL) && fr_event(evid)) {
+		fr_put(entry);
+	}
 }
 
 void TRACE_2L(uint32_t evid, uint64_t e, uint64_t f)
@@ -64,7 +139,7 @@ void TRACE_2L(uint32_t evid, uint64_t e, uint64_t f)
 	struct trace_entry entry;
 	uint16_t cpu_id = get_pcpu_id();
 
-	if (!trace_check(cpu_id)) {
+	if (!trace_check(cpu_id) && ((fr_hdr == NULL) || !fr_event(evid))) {
 		return;
 	}
 
@@ -78,7 +153,7 @@ void TRACE_4I(uint32_t evid, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
 	struct trace_entry entry;
 	uint16_t cpu_id = get_pcpu_id();
 
-	if (!trace_check(cpu_id)) {
+	if (!trace_check(cpu_id) && ((fr_hdr == NULL) || !fr_event(evid))) {
 		return;
 	}
 
@@ -94,7 +169,7 @@ void TRACE_6C(uint32_t evid, uint8_t a1, uint8_t a2, uint8_t a3, uint8_t a4, uin
 	struct trace_entry entry;
 	uint16_t cpu_id = get_pcpu_id();
 
-	if (!trace_check(cpu_id)) {
+	if (!trace_check(cpu_id) && ((fr_hdr == NULL) || !fr_event(evid))) {
 		return;
 	}
 
@@ -117,7 +192,7 @@ static inline void TRACE_16STR(uint32_t evid, const char name[])
 	uint16_t cpu_id = get_pcpu_id();
 	size_t len, i;
 
-	if (!trace_check(cpu_id)) {
+	if (!trace_check(cpu_id) && ((fr_hdr == NULL) || !fr_event(evid))) {
 		return;
 	}
 
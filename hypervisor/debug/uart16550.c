@@ -210,27 +210,30 @@ char uart16550_getc(void)
 	return ret;
 }
 
+/* All 16550-compatible parts have at least this much TX FIFO once
+ * FCR_FIFOE is set (done in uart16550_init).
+ */
+#define UART16550_TX_FIFO_DEPTH		16U
+
 /**
+ * Wait until the TX FIFO has fully drained, after which up to
+ * UART16550_TX_FIFO_DEPTH bytes can be pushed back-to-back without
+ * polling LSR for each of them.
+ *
  * @pre uart->enabled == true
  */
-static void uart16550_putc(char c)
+static uint32_t uart16550_wait_tx_fifo(void)
 {
-	uint8_t temp;
-	uint32_t reg;
-
-	/* Ensure there are no further Transmit buffer write requests */
-	do {
-		reg = uart16550_read_reg(uart, UART16550_LSR);
-	} while ((reg & LSR_THRE) == 0U || (reg & LSR_TEMT) == 0U);
+	while ((uart16550_read_reg(uart, UART16550_LSR) & LSR_THRE) == 0U) {
+	}
 
-	temp = (uint8_t)c;
-	/* Transmit the character. */
-	uart16550_write_reg(uart, (uint32_t)temp, UART16550_THR);
+	return UART16550_TX_FIFO_DEPTH;
 }
 
 size_t uart16550_puts(const char *buf, uint32_t len)
 {
 	uint32_t i;
+	uint32_t fifo_avail = 0U;
 	uint64_t rflags;
 
 	if (!uart.enabled) {
@@ -239,11 +242,19 @@ size_t uart16550_puts(const char *buf, uint32_t len)
 
 	spinlock_irqsave_obtain(&uart.tx_lock, &rflags);
 	for (i = 0U; i < len; i++) {
+		if (fifo_avail == 0U) {
+			fifo_avail = uart16550_wait_tx_fifo();
+		}
 		/* Transmit character */
-		uart16550_putc(*buf);
+		uart16550_write_reg(uart, (uint32_t)(uint8_t)*buf, UART16550_THR);
+		fifo_avail--;
 		if (*buf == '\n') {
+			if (fifo_avail == 0U) {
+				fifo_avail = uart16550_wait_tx_fifo();
+			}
 			/* Append '\r', no need change the len */
-			uart16550_putc('\r');
+			uart16550_write_reg(uart, (uint32_t)'\r', UART16550_THR);
+			fifo_avail--;
 		}
 		buf++;
 	}
@@ -4,9 +4,11 @@
  */
 
 #include <asm/guest/vm.h>
+#include <asm/guest/guest_memory.h>
 #include <asm/irq.h>
 #include <errno.h>
 #include <logmsg.h>
+#include <ticks.h>
 
 #define DBG_LEVEL_IOREQ	6U
 
@@ -95,6 +97,20 @@ int32_t acrn_insert_request(struct acrn_vcpu *vcpu, const struct io_request *io_
 		acrn_io_req = &req_buf->req_slot[cur];
 		/* ACRN insert request to HSM and inject upcall */
 		acrn_io_req->type = io_req->io_type;
+		/* placement hint: tell the DM where the requestor runs right now */
+		acrn_io_req->client_pcpu_id = (uint32_t)pcpuid_from_vcpu(vcpu);
+		/* port I/O and PCI config accesses are typically spun on by the
+		 * requestor, MMIO leans towards bulk data paths; the DM may
+		 * service the two classes from separate queues
+		 */
+		acrn_io_req->latency_class = ((io_req->io_type == ACRN_IOREQ_TYPE_MMIO) ||
+				(io_req->io_type == ACRN_IOREQ_TYPE_WP)) ?
+			ACRN_IOREQ_CLASS_BULK : ACRN_IOREQ_CLASS_LATENCY;
+		/* let the DM propagate the requestor's scheduling class to
+		 * the thread servicing this request
+		 */
+		acrn_io_req->requestor_class = is_rt_vm(vcpu->vm) ?
+			ACRN_IOREQ_REQUESTOR_RT : ACRN_IOREQ_REQUESTOR_NORMAL;
 		(void)memcpy_s(&acrn_io_req->reqs, sizeof(acrn_io_req->reqs),
 			&io_req->reqs, sizeof(acrn_io_req->reqs));
 		if (vcpu->vm->sw.is_polling_ioreq) {
@@ -113,6 +129,11 @@ int32_t acrn_insert_request(struct acrn_vcpu *vcpu, const struct io_request *io_
 		 */
 		set_io_req_state(vcpu->vm, vcpu->vcpu_id, ACRN_IOREQ_STATE_PENDING);
 
+		/* let the vCPU watchdog see how long the DM sits on this
+		 * request, see vcpu_watchdog.c
+		 */
+		vcpu->hb_ioreq_start_tsc = cpu_ticks();
+
 		/* signal HSM */
 		arch_fire_hsm_interrupt();
 
@@ -131,6 +152,8 @@ int32_t acrn_insert_request(struct acrn_vcpu *vcpu, const struct io_request *io_
 		} else {
 			wait_event(&vcpu->events[VCPU_EVENT_IOREQ]);
 		}
+
+		vcpu->hb_ioreq_start_tsc = 0UL;
 	} else {
 		ret = -EINVAL;
 	}
@@ -397,10 +420,10 @@ hv_emulate_pio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 {
 	int32_t status = -ENODEV;
 	uint16_t port, size;
-	uint32_t idx;
+	uint8_t leaf_idx, entry;
 	struct acrn_vm *vm = vcpu->vm;
 	struct acrn_pio_request *pio_req = &io_req->reqs.pio_request;
-	struct vm_io_handler_desc *handler;
+	const struct vm_io_handler_desc *handler;
 	io_read_fn_t io_read = NULL;
 	io_write_fn_t io_write = NULL;
 
@@ -412,20 +435,19 @@ hv_emulate_pio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 	port = (uint16_t)pio_req->address;
 	size = (uint16_t)pio_req->size;
 
-	for (idx = 0U; idx < EMUL_PIO_IDX_MAX; idx++) {
-		handler = &(vm->emul_pio[idx]);
-
-		if ((port < handler->port_start) || (port >= handler->port_end)) {
-			continue;
-		}
-
-		if (handler->io_read != NULL) {
-			io_read = handler->io_read;
-		}
-		if (handler->io_write != NULL) {
-			io_write = handler->io_write;
+	/* direct-indexed lookup in the radix built at registration time */
+	leaf_idx = vm->emul_pio_root[port >> EMUL_PIO_RADIX_SHIFT];
+	if (leaf_idx != 0U) {
+		entry = vm->emul_pio_leaf[leaf_idx - 1U][port & (EMUL_PIO_RADIX_LEAF_SIZE - 1U)];
+		if (entry != 0U) {
+			handler = &(vm->emul_pio[entry - 1U]);
+			if (handler->io_read != NULL) {
+				io_read = handler->io_read;
+			}
+			if (handler->io_write != NULL) {
+				io_write = handler->io_write;
+			}
 		}
-		break;
 	}
 
 	if ((pio_req->direction == ACRN_IOREQ_DIR_WRITE) && (io_write != NULL)) {
@@ -515,6 +537,120 @@ hv_emulate_mmio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 	return status;
 }
 
+/**
+ * @brief Register a coalesced doorbell range for \p vm
+ *
+ * res[0] of \p mmiodev carries the doorbell GPA range and res[1] the guest
+ * page holding the acrn_coalesced_mmio_ring shared with the DM. All ranges
+ * of a VM share the ring page supplied by the first registration.
+ *
+ * @pre vm != NULL && mmiodev != NULL
+ *
+ * @retval 0 Range registered successfully.
+ * @retval -EINVAL Invalid ring page, empty range or no free slot.
+ */
+int32_t register_coalesced_mmio(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev)
+{
+	int32_t ret = -EINVAL;
+	struct acrn_coalesced_mmio_ring *ring;
+	const struct acrn_mmiores *range = &mmiodev->res[0];
+
+	ring = (struct acrn_coalesced_mmio_ring *)gpa2hva(vm, mmiodev->res[1].user_vm_pa);
+	if ((ring != NULL) && (range->size != 0UL)) {
+		spinlock_obtain(&vm->wc_mmio_lock);
+		if (vm->nr_wc_mmio_ranges < MAX_WC_MMIO_RANGES) {
+			if (vm->wc_mmio_ring == NULL) {
+				vm->wc_mmio_ring = ring;
+			}
+			if (vm->wc_mmio_ring == ring) {
+				vm->wc_mmio_ranges[vm->nr_wc_mmio_ranges].start = range->user_vm_pa;
+				vm->wc_mmio_ranges[vm->nr_wc_mmio_ranges].end =
+					range->user_vm_pa + range->size;
+				vm->nr_wc_mmio_ranges++;
+				ret = 0;
+			}
+		}
+		spinlock_release(&vm->wc_mmio_lock);
+	}
+
+	return ret;
+}
+
+/**
+ * @brief Unregister a coalesced doorbell range of \p vm
+ *
+ * @pre vm != NULL && mmiodev != NULL
+ *
+ * @retval 0 Range found and removed.
+ * @retval -EINVAL No matching range registered.
+ */
+int32_t unregister_coalesced_mmio(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev)
+{
+	uint16_t i;
+	int32_t ret = -EINVAL;
+	const struct acrn_mmiores *range = &mmiodev->res[0];
+
+	spinlock_obtain(&vm->wc_mmio_lock);
+	for (i = 0U; i < vm->nr_wc_mmio_ranges; i++) {
+		if ((vm->wc_mmio_ranges[i].start == range->user_vm_pa) &&
+			(vm->wc_mmio_ranges[i].end == (range->user_vm_pa + range->size))) {
+			vm->nr_wc_mmio_ranges--;
+			vm->wc_mmio_ranges[i] = vm->wc_mmio_ranges[vm->nr_wc_mmio_ranges];
+			if (vm->nr_wc_mmio_ranges == 0U) {
+				vm->wc_mmio_ring = NULL;
+			}
+			ret = 0;
+			break;
+		}
+	}
+	spinlock_release(&vm->wc_mmio_lock);
+
+	return ret;
+}
+
+/**
+ * Absorb a doorbell write into the coalesced ring shared with the DM.
+ *
+ * Returns true if the write was recorded and needs no I/O request. False
+ * means the access is no registered doorbell write or the ring is full;
+ * the caller then delivers a regular I/O request, and since the DM drains
+ * the ring before handling any request, write ordering is preserved.
+ */
+static bool coalesce_mmio_write(struct acrn_vcpu *vcpu, const struct acrn_mmio_request *mmio_req)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_coalesced_mmio_ring *ring;
+	uint32_t last;
+	uint16_t i;
+	bool absorbed = false;
+
+	if ((mmio_req->direction == ACRN_IOREQ_DIR_WRITE) && (vm->wc_mmio_ring != NULL)) {
+		spinlock_obtain(&vm->wc_mmio_lock);
+		for (i = 0U; i < vm->nr_wc_mmio_ranges; i++) {
+			if ((mmio_req->address >= vm->wc_mmio_ranges[i].start) &&
+				((mmio_req->address + mmio_req->size) <= vm->wc_mmio_ranges[i].end)) {
+				ring = vm->wc_mmio_ring;
+				stac();
+				last = ring->last;
+				if (((last + 1U) % (uint32_t)ACRN_COALESCED_MMIO_MAX) != ring->first) {
+					ring->entry[last].address = mmio_req->address;
+					ring->entry[last].value = mmio_req->value;
+					ring->entry[last].size = (uint32_t)mmio_req->size;
+					/* the entry must be visible before the producer index moves */
+					cpu_write_memory_barrier();
+					ring->last = (last + 1U) % (uint32_t)ACRN_COALESCED_MMIO_MAX;
+					absorbed = true;
+				}
+				clac();
+				break;
+			}
+		}
+		spinlock_release(&vm->wc_mmio_lock);
+	}
+
+	return absorbed;
+}
+
 /**
  * @brief Emulate \p io_req for \p vcpu
  *
@@ -563,23 +699,29 @@ emulate_io(struct acrn_vcpu *vcpu, struct io_request *io_req)
 	}
 
 	if ((status == -ENODEV) && (vm_config->load_order == POST_LAUNCHED_VM)) {
-		/*
-		 * No handler from HV side, search from HSM in Service VM
-		 *
-		 * ACRN insert request to HSM and inject upcall.
-		 */
-		status = acrn_insert_request(vcpu, io_req);
-		if (status == 0) {
-			dm_emulate_io_complete(vcpu);
+		if ((io_req->io_type == ACRN_IOREQ_TYPE_MMIO) &&
+			coalesce_mmio_write(vcpu, &io_req->reqs.mmio_request)) {
+			/* absorbed into the coalesced ring; no DM round trip */
+			status = 0;
 		} else {
-			/* here for both IO & MMIO, the direction, address,
-			 * size definition is same
+			/*
+			 * No handler from HV side, search from HSM in Service VM
+			 *
+			 * ACRN insert request to HSM and inject upcall.
 			 */
-			struct acrn_pio_request *pio_req = &io_req->reqs.pio_request;
+			status = acrn_insert_request(vcpu, io_req);
+			if (status == 0) {
+				dm_emulate_io_complete(vcpu);
+			} else {
+				/* here for both IO & MMIO, the direction, address,
+				 * size definition is same
+				 */
+				struct acrn_pio_request *pio_req = &io_req->reqs.pio_request;
 
-			pr_fatal("%s Err: access dir %d, io_type %d, addr = 0x%lx, size=%lu", __func__,
-				pio_req->direction, io_req->io_type,
-				pio_req->address, pio_req->size);
+				pr_fatal("%s Err: access dir %d, io_type %d, addr = 0x%lx, size=%lu", __func__,
+					pio_req->direction, io_req->io_type,
+					pio_req->address, pio_req->size);
+			}
 		}
 	}
 
@@ -600,6 +742,10 @@ emulate_io(struct acrn_vcpu *vcpu, struct io_request *io_req)
 void register_pio_emulation_handler(struct acrn_vm *vm, uint32_t pio_idx,
 		const struct vm_io_range *range, io_read_fn_t io_read_fn_ptr, io_write_fn_t io_write_fn_ptr)
 {
+	uint32_t port;
+	uint16_t root;
+	uint8_t leaf_idx, *entry;
+
 	if (is_service_vm(vm)) {
 		deny_guest_pio_access(vm, range->base, range->len);
 	}
@@ -607,6 +753,29 @@ void register_pio_emulation_handler(struct acrn_vm *vm, uint32_t pio_idx,
 	vm->emul_pio[pio_idx].port_end = range->base + range->len;
 	vm->emul_pio[pio_idx].io_read = io_read_fn_ptr;
 	vm->emul_pio[pio_idx].io_write = io_write_fn_ptr;
+
+	/* pre-decode the range into the radix so hv_emulate_pio() never scans */
+	for (port = range->base; port < ((uint32_t)range->base + range->len); port++) {
+		root = (uint16_t)(port >> EMUL_PIO_RADIX_SHIFT);
+		leaf_idx = vm->emul_pio_root[root];
+		if (leaf_idx == 0U) {
+			if (vm->nr_emul_pio_leaves >= EMUL_PIO_RADIX_LEAVES) {
+				pr_err("%s: out of PIO radix leaves, port 0x%x not pre-decoded",
+					__func__, port);
+				break;
+			}
+			vm->nr_emul_pio_leaves++;
+			leaf_idx = vm->nr_emul_pio_leaves;
+			vm->emul_pio_root[root] = leaf_idx;
+		}
+		entry = &vm->emul_pio_leaf[leaf_idx - 1U][port & (EMUL_PIO_RADIX_LEAF_SIZE - 1U)];
+		/* the former linear scan picked the lowest matching index;
+		 * keep that behavior when registered ranges overlap
+		 */
+		if ((*entry == 0U) || (((uint32_t)*entry - 1U) > pio_idx)) {
+			*entry = (uint8_t)(pio_idx + 1U);
+		}
+	}
 }
 
 /**
@@ -730,4 +899,7 @@ void deinit_emul_io(struct acrn_vm *vm)
 {
 	(void)memset(vm->emul_mmio, 0U, sizeof(vm->emul_mmio));
 	(void)memset(vm->emul_pio, 0U, sizeof(vm->emul_pio));
+	(void)memset(vm->emul_pio_root, 0U, sizeof(vm->emul_pio_root));
+	(void)memset(vm->emul_pio_leaf, 0U, sizeof(vm->emul_pio_leaf));
+	vm->nr_emul_pio_leaves = 0U;
 }
@@ -10,6 +10,7 @@
 #include <asm/pgtable.h>
 #include <asm/guest/vm.h>
 #include <asm/guest/ept.h>
+#include <io_req.h>
 #include <debug/logmsg.h>
 
 
@@ -18,19 +19,28 @@ int32_t assign_mmio_dev(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev)
 	int32_t i, ret = 0;
 	const struct acrn_mmiores *res;
 
-	for (i = 0; i < MMIODEV_RES_NUM; i++) {
-		res = &mmiodev->res[i];
-		if (mem_aligned_check(res->user_vm_pa, PAGE_SIZE) &&
-			mem_aligned_check(res->host_pa, PAGE_SIZE) &&
-			mem_aligned_check(res->size, PAGE_SIZE)) {
-			ept_add_mr(vm, (uint64_t *)vm->arch_vm.nworld_eptp, res->host_pa,
-				is_service_vm(vm) ? res->host_pa : res->user_vm_pa,
-				res->size, EPT_RWX | (res->mem_type & EPT_MT_MASK));
-		} else {
-			pr_err("%s invalid mmio res[%d] gpa:0x%lx hpa:0x%lx size:0x%lx",
-				__FUNCTION__, i, res->user_vm_pa, res->host_pa, res->size);
-			ret = -EINVAL;
-			break;
+	/*
+	 * A coalesced doorbell registration rides the same conduit from the
+	 * DM but maps nothing into the EPT; the doorbell range keeps trapping
+	 * and its writes are absorbed into the shared ring instead.
+	 */
+	if ((mmiodev->res[0].mem_type & ACRN_MEM_TYPE_WC_DOORBELL) != 0UL) {
+		ret = register_coalesced_mmio(vm, mmiodev);
+	} else {
+		for (i = 0; i < MMIODEV_RES_NUM; i++) {
+			res = &mmiodev->res[i];
+			if (mem_aligned_check(res->user_vm_pa, PAGE_SIZE) &&
+				mem_aligned_check(res->host_pa, PAGE_SIZE) &&
+				mem_aligned_check(res->size, PAGE_SIZE)) {
+				ept_add_mr(vm, (uint64_t *)vm->arch_vm.nworld_eptp, res->host_pa,
+					is_service_vm(vm) ? res->host_pa : res->user_vm_pa,
+					res->size, EPT_RWX | (res->mem_type & EPT_MT_MASK));
+			} else {
+				pr_err("%s invalid mmio res[%d] gpa:0x%lx hpa:0x%lx size:0x%lx",
+					__FUNCTION__, i, res->user_vm_pa, res->host_pa, res->size);
+				ret = -EINVAL;
+				break;
+			}
 		}
 	}
 
@@ -43,18 +53,22 @@ int32_t deassign_mmio_dev(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev
 	uint64_t gpa;
 	const struct acrn_mmiores *res;
 
-	for (i = 0; i < MMIODEV_RES_NUM; i++) {
-		res = &mmiodev->res[i];
-		gpa = is_service_vm(vm) ? res->host_pa : res->user_vm_pa;
-		if (ept_is_valid_mr(vm, gpa, res->size)) {
-			if (mem_aligned_check(gpa, PAGE_SIZE) &&
-				mem_aligned_check(res->size, PAGE_SIZE)) {
-				ept_del_mr(vm, (uint64_t *)vm->arch_vm.nworld_eptp, gpa, res->size);
-			} else {
-				pr_err("%s invalid mmio res[%d] gpa:0x%lx hpa:0x%lx size:0x%lx",
-					__FUNCTION__, i, res->user_vm_pa, res->host_pa, res->size);
-				ret = -EINVAL;
-				break;
+	if ((mmiodev->res[0].mem_type & ACRN_MEM_TYPE_WC_DOORBELL) != 0UL) {
+		ret = unregister_coalesced_mmio(vm, mmiodev);
+	} else {
+		for (i = 0; i < MMIODEV_RES_NUM; i++) {
+			res = &mmiodev->res[i];
+			gpa = is_service_vm(vm) ? res->host_pa : res->user_vm_pa;
+			if (ept_is_valid_mr(vm, gpa, res->size)) {
+				if (mem_aligned_check(gpa, PAGE_SIZE) &&
+					mem_aligned_check(res->size, PAGE_SIZE)) {
+					ept_del_mr(vm, (uint64_t *)vm->arch_vm.nworld_eptp, gpa, res->size);
+				} else {
+					pr_err("%s invalid mmio res[%d] gpa:0x%lx hpa:0x%lx size:0x%lx",
+						__FUNCTION__, i, res->user_vm_pa, res->host_pa, res->size);
+					ret = -EINVAL;
+					break;
+				}
 			}
 		}
 	}
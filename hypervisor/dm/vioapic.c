@@ -36,6 +36,10 @@
 #include <asm/guest/assign.h>
 #include <logmsg.h>
 #include <asm/ioapic.h>
+#include <lockstat.h>
+
+/* one record for all vioapic instances, see the 'lockstat' shell command */
+static struct lock_stat vioapic_lockstat = { .name = "vioapic" };
 
 #define	RTBL_RO_BITS	((uint32_t)0x00004000U | (uint32_t)0x00001000U) /*Remote IRR and Delivery Status bits*/
 
@@ -49,6 +53,35 @@ static inline struct acrn_vioapics *vm_ioapics(const struct acrn_vm *vm)
 	return (struct acrn_vioapics *)&(vm->arch_vm.vioapics);
 }
 
+/*
+ * vector -> pins reverse index. Every pin is chained under the vector
+ * programmed in its RTE, so that EOI processing only visits the pins
+ * which can match instead of scanning the whole redirection table.
+ *
+ * @pre the caller holds vioapic->lock
+ */
+static void vioapic_chain_vector(struct acrn_single_vioapic *vioapic, uint32_t pin, uint32_t vector)
+{
+	vioapic->pin_next[pin] = vioapic->vec_head[vector];
+	vioapic->vec_head[vector] = (uint8_t)pin;
+}
+
+/**
+ * @pre the caller holds vioapic->lock
+ */
+static void vioapic_unchain_vector(struct acrn_single_vioapic *vioapic, uint32_t pin, uint32_t vector)
+{
+	uint8_t *pprev = &vioapic->vec_head[vector];
+
+	while ((*pprev != VIOAPIC_INVALID_PIN) && (*pprev != (uint8_t)pin)) {
+		pprev = &vioapic->pin_next[*pprev];
+	}
+	if (*pprev == (uint8_t)pin) {
+		*pprev = vioapic->pin_next[pin];
+		vioapic->pin_next[pin] = VIOAPIC_INVALID_PIN;
+	}
+}
+
 /**
  * @pre pin < vioapic->chipinfo.nr_pins
  */
@@ -95,15 +128,18 @@ vioapic_set_pinstate(struct acrn_single_vioapic *vioapic, uint32_t pin, uint32_t
 		rte = vioapic->rtbl[pin];
 		old_lvl = (uint32_t)bitmap_test((uint16_t)(pin & 0x3FU), &vioapic->pin_state[pin >> 6U]);
 		if (level == 0U) {
-			/* clear pin_state and deliver interrupt according to polarity */
-			bitmap_clear_nolock((uint16_t)(pin & 0x3FU), &vioapic->pin_state[pin >> 6U]);
+			/* clear pin_state and deliver interrupt according to polarity.
+			 * The bitmap words are shared by pins guarded by different
+			 * rtbl_lock instances, hence the locked bitmap operations.
+			 */
+			bitmap_clear_lock((uint16_t)(pin & 0x3FU), &vioapic->pin_state[pin >> 6U]);
 			if ((rte.bits.intr_polarity == IOAPIC_RTE_INTPOL_ALO)
 				&& (old_lvl != level)) {
 				vioapic_generate_intr(vioapic, pin);
 			}
 		} else {
 			/* set pin_state and deliver intrrupt according to polarity */
-			bitmap_set_nolock((uint16_t)(pin & 0x3FU), &vioapic->pin_state[pin >> 6U]);
+			bitmap_set_lock((uint16_t)(pin & 0x3FU), &vioapic->pin_state[pin >> 6U]);
 			if ((rte.bits.intr_polarity == IOAPIC_RTE_INTPOL_AHI)
 				&& (old_lvl != level)) {
 				vioapic_generate_intr(vioapic, pin);
@@ -140,7 +176,7 @@ vgsi_to_vioapic_and_vpin(const struct acrn_vm *vm, uint32_t vgsi, uint32_t *vpin
  * @brief Set vIOAPIC IRQ line status.
  *
  * Similar with vioapic_set_irqline_lock(),but would not make sure
- * operation be done with ioapic lock.
+ * operation be done with the per-pin rtbl lock.
  *
  * @param[in] vm        Pointer to target VM
  * @param[in] vgsi   	Target GSI number
@@ -200,11 +236,12 @@ vioapic_set_irqline_lock(const struct acrn_vm *vm, uint32_t vgsi, uint32_t opera
 {
 	uint64_t rflags;
 	struct acrn_single_vioapic *vioapic;
+	uint32_t pin;
 
-	vioapic = vgsi_to_vioapic_and_vpin(vm, vgsi, NULL);
-	spinlock_irqsave_obtain(&(vioapic->lock), &rflags);
+	vioapic = vgsi_to_vioapic_and_vpin(vm, vgsi, &pin);
+	lockstat_irqsave_obtain(&(vioapic->rtbl_lock[pin]), &vioapic_lockstat, &rflags);
 	vioapic_set_irqline_nolock(vm, vgsi, operation);
-	spinlock_irqrestore_release(&(vioapic->lock), rflags);
+	lockstat_irqrestore_release(&(vioapic->rtbl_lock[pin]), &vioapic_lockstat, rflags);
 }
 
 static uint32_t
@@ -250,14 +287,25 @@ vioapic_indirect_read(struct acrn_single_vioapic *vioapic, uint32_t addr)
 				 * update virtual 'Remote IRR' field each time when guest wants to read I/O
 				 * REDIRECTION TABLE REGISTERS
 				 */
-				struct ptirq_remapping_info *entry = NULL;
+				const struct ptirq_remapping_info *entry = NULL;
 				union ioapic_rte phys_rte = {};
+				uint32_t phys_irq = 0U;
+				bool mapped = false;
 				DEFINE_INTX_SID(virt_sid, vioapic->rtbl[pin].bits.vector, INTX_CTLR_IOAPIC);
 
+				rwlock_read_obtain(&ptdev_lock);
 				entry = find_ptirq_entry(PTDEV_INTR_INTX, &virt_sid, vioapic->vm);
 				if (entry != NULL) {
-					ioapic_get_rte(entry->allocated_pirq, &phys_rte);
+					phys_irq = entry->allocated_pirq;
+					mapped = true;
+				}
+				rwlock_read_release(&ptdev_lock);
+
+				if (mapped) {
+					ioapic_get_rte(phys_irq, &phys_rte);
+					spinlock_obtain(&(vioapic->rtbl_lock[pin]));
 					vioapic->rtbl[pin].bits.remote_irr = phys_rte.bits.remote_irr;
+					spinlock_release(&(vioapic->rtbl_lock[pin]));
 				}
 			}
 			ret = vioapic->rtbl[pin].u.lo_32;
@@ -285,8 +333,9 @@ static inline bool vioapic_need_intr(const struct acrn_single_vioapic *vioapic,
 
 /*
  * Due to the race between vcpus and vioapic->lock could be accessed from softirq, ensure to do
- * spinlock_irqsave_obtain(&(vioapic->lock), &rflags) & spinlock_irqrestore_release(&(vioapic->lock), rflags)
- * by caller.
+ * lockstat_irqsave_obtain(&(vioapic->lock), &vioapic_lockstat, &rflags) &
+ * lockstat_irqrestore_release(&(vioapic->lock), &vioapic_lockstat, rflags)
+ * by caller. The per-pin rtbl lock is taken here, nested inside vioapic->lock.
  */
 static void vioapic_indirect_write(struct acrn_single_vioapic *vioapic, uint32_t addr, uint32_t data)
 {
@@ -362,6 +411,11 @@ static void vioapic_indirect_write(struct acrn_single_vioapic *vioapic, uint32_t
 		}
 
 		if (wire_mode_valid) {
+			spinlock_obtain(&(vioapic->rtbl_lock[pin]));
+			if (last.bits.vector != new.bits.vector) {
+				vioapic_unchain_vector(vioapic, pin, (uint32_t)last.bits.vector);
+				vioapic_chain_vector(vioapic, pin, (uint32_t)new.bits.vector);
+			}
 			vioapic->rtbl[pin] = new;
 			dev_dbg(DBG_LEVEL_VIOAPIC, "ioapic pin%hhu: redir table entry %#lx",
 				pin, vioapic->rtbl[pin].full);
@@ -386,6 +440,7 @@ static void vioapic_indirect_write(struct acrn_single_vioapic *vioapic, uint32_t
 				dev_dbg(DBG_LEVEL_VIOAPIC, "ioapic pin%hhu: asserted at rtbl write", pin);
 				vioapic_generate_intr(vioapic, pin);
 			}
+			spinlock_release(&(vioapic->rtbl_lock[pin]));
 		}
 	}
 }
@@ -399,7 +454,7 @@ vioapic_mmio_rw(struct acrn_single_vioapic *vioapic, uint64_t gpa,
 
 	offset = (uint32_t)(gpa - vioapic->chipinfo.addr);
 
-	spinlock_irqsave_obtain(&(vioapic->lock), &rflags);
+	lockstat_irqsave_obtain(&(vioapic->lock), &vioapic_lockstat, &rflags);
 
 	/* The IOAPIC specification allows 32-bit wide accesses to the
 	 * IOAPIC_REGSEL (offset 0) and IOAPIC_WINDOW (offset 16) registers.
@@ -428,7 +483,7 @@ vioapic_mmio_rw(struct acrn_single_vioapic *vioapic, uint64_t gpa,
 		break;
 	}
 
-	spinlock_irqrestore_release(&(vioapic->lock), rflags);
+	lockstat_irqrestore_release(&(vioapic->lock), &vioapic_lockstat, rflags);
 }
 
 /*
@@ -437,9 +492,10 @@ vioapic_mmio_rw(struct acrn_single_vioapic *vioapic, uint64_t gpa,
 static void
 vioapic_process_eoi(struct acrn_single_vioapic *vioapic, uint32_t vector)
 {
-	uint32_t pin, pincount = vioapic->chipinfo.nr_pins;
+	uint64_t ack_pins[STATE_BITMAP_SIZE] = { 0UL };
 	union ioapic_rte rte;
 	uint64_t rflags;
+	uint32_t pin;
 
 	if ((vector < VECTOR_DYNAMIC_START) || (vector > NR_MAX_VECTOR)) {
 		pr_err("vioapic_process_eoi: invalid vector %u", vector);
@@ -447,37 +503,44 @@ vioapic_process_eoi(struct acrn_single_vioapic *vioapic, uint32_t vector)
 
 	dev_dbg(DBG_LEVEL_VIOAPIC, "ioapic processing eoi for vector %u", vector);
 
-	/* notify device to ack if assigned pin */
-	for (pin = 0U; pin < pincount; pin++) {
-		rte = vioapic->rtbl[pin];
-		if ((rte.bits.vector != vector) ||
-			(rte.bits.remote_irr == 0U)) {
-			continue;
+	/*
+	 * Only the pins chained under this vector can match, so walk the
+	 * reverse index instead of the whole redirection table. The pending
+	 * pins are collected first so that the devices can be notified to
+	 * ack without any vioapic lock held, as the ack path takes the
+	 * ptdev locks.
+	 */
+	lockstat_irqsave_obtain(&(vioapic->lock), &vioapic_lockstat, &rflags);
+	for (pin = vioapic->vec_head[vector]; pin != VIOAPIC_INVALID_PIN; pin = vioapic->pin_next[pin]) {
+		if (vioapic->rtbl[pin].bits.remote_irr != 0U) {
+			bitmap_set_nolock((uint16_t)(pin & 0x3FU), &ack_pins[pin >> 6U]);
 		}
-
-		ptirq_intx_ack(vioapic->vm, vioapic->chipinfo.gsi_base + pin, INTX_CTLR_IOAPIC);
 	}
+	lockstat_irqrestore_release(&(vioapic->lock), &vioapic_lockstat, rflags);
 
-	/*
-	 * XXX keep track of the pins associated with this vector instead
-	 * of iterating on every single pin each time.
-	 */
-	spinlock_irqsave_obtain(&(vioapic->lock), &rflags);
-	for (pin = 0U; pin < pincount; pin++) {
-		rte = vioapic->rtbl[pin];
-		if ((rte.bits.vector != vector) ||
-			(rte.bits.remote_irr == 0U)) {
-			continue;
+	/* notify device to ack if assigned pin */
+	for (pin = 0U; pin < vioapic->chipinfo.nr_pins; pin++) {
+		if (bitmap_test((uint16_t)(pin & 0x3FU), &ack_pins[pin >> 6U])) {
+			ptirq_intx_ack(vioapic->vm, vioapic->chipinfo.gsi_base + pin, INTX_CTLR_IOAPIC);
 		}
+	}
 
-		vioapic->rtbl[pin].bits.remote_irr = 0U;
-		if (vioapic_need_intr(vioapic, (uint16_t)pin)) {
-			dev_dbg(DBG_LEVEL_VIOAPIC,
-				"ioapic pin%hhu: asserted at eoi", pin);
-			vioapic_generate_intr(vioapic, pin);
+	/* the instance lock keeps the index stable while the chain is walked */
+	lockstat_irqsave_obtain(&(vioapic->lock), &vioapic_lockstat, &rflags);
+	for (pin = vioapic->vec_head[vector]; pin != VIOAPIC_INVALID_PIN; pin = vioapic->pin_next[pin]) {
+		spinlock_obtain(&(vioapic->rtbl_lock[pin]));
+		rte = vioapic->rtbl[pin];
+		if ((rte.bits.vector == vector) && (rte.bits.remote_irr != 0U)) {
+			vioapic->rtbl[pin].bits.remote_irr = 0U;
+			if (vioapic_need_intr(vioapic, (uint16_t)pin)) {
+				dev_dbg(DBG_LEVEL_VIOAPIC,
+					"ioapic pin%hhu: asserted at eoi", pin);
+				vioapic_generate_intr(vioapic, pin);
+			}
 		}
+		spinlock_release(&(vioapic->rtbl_lock[pin]));
 	}
-	spinlock_irqrestore_release(&(vioapic->lock), rflags);
+	lockstat_irqrestore_release(&(vioapic->lock), &vioapic_lockstat, rflags);
 }
 
 void vioapic_broadcast_eoi(const struct acrn_vm *vm, uint32_t vector)
@@ -499,11 +562,20 @@ void vioapic_broadcast_eoi(const struct acrn_vm *vm, uint32_t vector)
 static void reset_one_vioapic(struct acrn_single_vioapic *vioapic)
 {
 	uint32_t pin, pincount;
+	uint32_t vector;
 
-	/* Initialize all redirection entries to mask all interrupts */
+	for (vector = 0U; vector <= NR_MAX_VECTOR; vector++) {
+		vioapic->vec_head[vector] = VIOAPIC_INVALID_PIN;
+	}
+
+	/* Initialize all redirection entries to mask all interrupts.
+	 * Every pin is chained under the vector of its RTE, vector 0 here.
+	 */
 	pincount = vioapic->chipinfo.nr_pins;
 	for (pin = 0U; pin < pincount; pin++) {
 		vioapic->rtbl[pin].full = MASK_ALL_INTERRUPTS;
+		vioapic->pin_next[pin] = VIOAPIC_INVALID_PIN;
+		vioapic_chain_vector(vioapic, pin, 0U);
 	}
 	vioapic->chipinfo.id = 0U;
 	vioapic->ioregsel = 0U;
@@ -529,6 +601,7 @@ vioapic_init(struct acrn_vm *vm)
 
 	struct ioapic_info *vioapic_info;
 	uint8_t vioapic_index;
+	uint32_t pin;
 	struct acrn_single_vioapic *vioapic = NULL;
 
 	if (is_service_vm(vm)) {
@@ -541,6 +614,9 @@ vioapic_init(struct acrn_vm *vm)
 	for (vioapic_index = 0U; vioapic_index < vm->arch_vm.vioapics.ioapic_num; vioapic_index++) {
 		vioapic = &vm->arch_vm.vioapics.vioapic_array[vioapic_index];
 		spinlock_init(&(vioapic->lock));
+		for (pin = 0U; pin < REDIR_ENTRIES_HW; pin++) {
+			spinlock_init(&(vioapic->rtbl_lock[pin]));
+		}
 		vioapic->chipinfo = vioapic_info[vioapic_index];
 
 		vioapic->vm = vm;
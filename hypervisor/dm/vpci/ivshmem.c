@@ -33,6 +33,13 @@
 #define	IVSHMEM_IRQ_STA_REG	0x4U
 #define	IVSHMEM_IV_POS_REG	0x8U
 #define	IVSHMEM_DOORBELL_REG	0xcU
+#define	IVSHMEM_POLL_CTRL_REG	0x10U
+
+/* The peer declares it is actively polling the shared region */
+#define	IVSHMEM_POLL_ACTIVE	0x1U
+
+/* Doorbell peer ID that targets every bound peer of the region */
+#define	IVSHMEM_BROADCAST_PEER_ID	0xffffU
 
 static struct ivshmem_shm_region mem_regions[8] = {
 	IVSHMEM_SHM_REGIONS
@@ -49,7 +56,7 @@ union ivshmem_doorbell {
 struct ivshmem_device {
 	struct pci_vdev* pcidev;
 	union {
-		uint32_t data[4];
+		uint32_t data[5];
 		struct {
 			uint32_t irq_mask;
 			uint32_t irq_state;
@@ -61,6 +68,13 @@ struct ivshmem_device {
 
 			/* Writing doorbell register requests to interrupt a peer */
 			union ivshmem_doorbell doorbell;
+
+			/*
+			 * While IVSHMEM_POLL_ACTIVE is set, doorbells aimed at
+			 * this device are latched in irq_state instead of
+			 * injected as MSI, like event_idx suppression.
+			 */
+			uint32_t poll_ctrl;
 		} regs;
 	} mmio;
 	struct ivshmem_shm_region *region;
@@ -144,7 +158,15 @@ static void ivshmem_server_notify_peer(struct ivshmem_device *src_ivs_dev, uint1
 	if (dest_peer_id < MAX_IVSHMEM_PEER_NUM) {
 
 		dest_ivs_dev = region->doorbell_peers[dest_peer_id];
-		if ((dest_ivs_dev != NULL) && vpci_vmsix_enabled(dest_ivs_dev->pcidev)
+		if ((dest_ivs_dev != NULL) && (vector_index < 32U)
+			&& ((dest_ivs_dev->mmio.regs.poll_ctrl & IVSHMEM_POLL_ACTIVE) != 0U)) {
+			/*
+			 * The peer is spinning on the shared region; latch the
+			 * vector so it can be picked up from IVSHMEM_IRQ_STA_REG
+			 * and save the MSI injection.
+			 */
+			bitmap32_set_lock(vector_index, &dest_ivs_dev->mmio.regs.irq_state);
+		} else if ((dest_ivs_dev != NULL) && vpci_vmsix_enabled(dest_ivs_dev->pcidev)
 			&& (vector_index < dest_ivs_dev->pcidev->msix.table_count)) {
 
 			entry = &(dest_ivs_dev->pcidev->msix.table_entries[vector_index]);
@@ -163,6 +185,25 @@ static void ivshmem_server_notify_peer(struct ivshmem_device *src_ivs_dev, uint1
 	}
 }
 
+/*
+ * One doorbell write fans out to every bound peer of the region, so a
+ * producer with several consumers pays a single VM exit per batch.
+ *
+ * @pre src_ivs_dev != NULL
+ */
+static void ivshmem_server_notify_all_peers(struct ivshmem_device *src_ivs_dev, uint16_t vector_index)
+{
+	uint16_t peer_id;
+	struct ivshmem_shm_region *region = src_ivs_dev->region;
+
+	for (peer_id = 0U; peer_id < MAX_IVSHMEM_PEER_NUM; peer_id++) {
+		if ((region->doorbell_peers[peer_id] != NULL)
+			&& (region->doorbell_peers[peer_id] != src_ivs_dev)) {
+			ivshmem_server_notify_peer(src_ivs_dev, peer_id, vector_index);
+		}
+	}
+}
+
 /*
  * @post vdev->priv_data != NULL
  */
@@ -201,17 +242,25 @@ static int32_t ivshmem_mmio_handler(struct io_request *io_req, void *data)
 		 * is Write-Only register, they are used for interrupt.
 		 */
 		if (mmio->direction == ACRN_IOREQ_DIR_READ) {
-			if (offset != IVSHMEM_DOORBELL_REG) {
+			if (offset == IVSHMEM_IRQ_STA_REG) {
+				/* read fetches and clears the latched vectors */
+				mmio->value = (uint64_t)atomic_readandclear32(&ivs_dev->mmio.regs.irq_state);
+			} else if ((offset != IVSHMEM_DOORBELL_REG) && (offset < sizeof(ivs_dev->mmio.data))) {
 				mmio->value = ivs_dev->mmio.data[offset >> 2U];
 			} else {
 				mmio->value = 0UL;
 			}
 		} else {
-			if (offset != IVSHMEM_IV_POS_REG) {
+			if ((offset != IVSHMEM_IV_POS_REG) && (offset < sizeof(ivs_dev->mmio.data))) {
 				if (offset == IVSHMEM_DOORBELL_REG) {
 					doorbell.val = mmio->value;
-					ivshmem_server_notify_peer(ivs_dev, doorbell.reg.peer_id,
-						doorbell.reg.vector_index);
+					if (doorbell.reg.peer_id == IVSHMEM_BROADCAST_PEER_ID) {
+						ivshmem_server_notify_all_peers(ivs_dev,
+							doorbell.reg.vector_index);
+					} else {
+						ivshmem_server_notify_peer(ivs_dev, doorbell.reg.peer_id,
+							doorbell.reg.vector_index);
+					}
 				} else {
 					ivs_dev->mmio.data[offset >> 2U] = mmio->value;
 				}
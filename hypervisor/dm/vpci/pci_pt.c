@@ -96,27 +96,81 @@ static void mask_one_msix_vector(const struct pci_vdev *vdev, uint32_t index)
 	clac();
 }
 
+/*
+ * Storm-containment hook invoked from the ptirq layer (interrupt or
+ * timer context): mask or restore the physical vector of a rate-limited
+ * MSI-X entry. Restore writes back the guest's own view of vector
+ * control, so a vector the guest masked in the meantime stays masked.
+ * A concurrent guest remap may also unmask early, which is harmless as
+ * the next storming interrupt re-arms containment.
+ */
+static void pt_msix_mask_entry(const struct ptirq_remapping_info *entry, bool mask)
+{
+	union pci_bdf bdf = {.value = entry->virt_sid.msi_id.bdf};
+	uint32_t index = entry->virt_sid.msi_id.entry_nr;
+	struct msix_table_entry *pentry;
+	struct pci_vdev *vdev;
+
+	vdev = pci_find_vdev(&entry->vm->vpci, bdf);
+	if ((vdev != NULL) && (vdev->pdev != NULL) && (index < vdev->msix.table_count)) {
+		if (mask) {
+			mask_one_msix_vector(vdev, index);
+		} else {
+			pentry = get_msix_table_entry(vdev, index);
+			stac();
+			mmio_write32(vdev->msix.table_entries[index].vector_control,
+					(void *)&(pentry->vector_control));
+			clac();
+		}
+	}
+}
+
 
 /**
  * @pre vdev != NULL
  * @pre vdev->vpci != NULL
  * @pre vdev->pdev != NULL
  */
-static void remap_one_vmsix_entry(const struct pci_vdev *vdev, uint32_t index)
+static void remap_one_vmsix_entry(struct pci_vdev *vdev, uint32_t index)
 {
 	const struct msix_table_entry *ventry;
 	struct msix_table_entry *pentry;
+	struct pci_msix *msix = &vdev->msix;
 	struct msi_info info = {};
 	int32_t ret;
 
-	mask_one_msix_vector(vdev, index);
-	ventry = &vdev->msix.table_entries[index];
-	if ((ventry->vector_control & PCIM_MSIX_VCTRL_MASK) == 0U) {
-		info.addr.full = vdev->msix.table_entries[index].addr;
-		info.data.full = vdev->msix.table_entries[index].data;
+	ventry = &msix->table_entries[index];
+	if ((ventry->vector_control & PCIM_MSIX_VCTRL_MASK) != 0U) {
+		/*
+		 * Guests program a vector as a masked multi-dword sequence
+		 * and flip the mask bit last. Keep the physical vector
+		 * masked and let the unmask trigger one remap for the
+		 * whole update.
+		 */
+		mask_one_msix_vector(vdev, index);
+	} else if (msix->remapped_valid[index] && (ventry->addr == msix->remapped_addr[index])
+			&& (ventry->data == msix->remapped_data[index])) {
+		/*
+		 * Mask toggled without touching address/data (irqbalance
+		 * does this in storms): the remap and the programmed
+		 * physical address/data still hold, only unmask.
+		 */
+		pentry = get_msix_table_entry(vdev, index);
+		stac();
+		mmio_write32(ventry->vector_control, (void *)&(pentry->vector_control));
+		clac();
+	} else {
+		mask_one_msix_vector(vdev, index);
+		info.addr.full = ventry->addr;
+		info.data.full = ventry->data;
 
+		/* use the IRTE block reserved at device discovery (e.g. for
+		 * SR-IOV VFs) when it covers this vector
+		 */
 		ret = ptirq_prepare_msix_remap(vpci2vm(vdev->vpci), vdev->bdf.value, vdev->pdev->bdf.value,
-					       (uint16_t)index, &info, INVALID_IRTE_ID);
+					       (uint16_t)index, &info,
+					       (index < (uint32_t)vdev->pdev->irte_count) ?
+					       (uint16_t)(vdev->pdev->irte_start + index) : INVALID_IRTE_ID);
 		if (ret == 0) {
 			/* Write the table entry to the physical structure */
 			pentry = get_msix_table_entry(vdev, index);
@@ -131,8 +185,16 @@ static void remap_one_vmsix_entry(const struct pci_vdev *vdev, uint32_t index)
 			mmio_write32((uint32_t)(info.addr.full >> 32U), (void *)((char *)&(pentry->addr) + 4U));
 
 			mmio_write32(info.data.full, (void *)&(pentry->data));
-			mmio_write32(vdev->msix.table_entries[index].vector_control, (void *)&(pentry->vector_control));
+			mmio_write32(ventry->vector_control, (void *)&(pentry->vector_control));
 			clac();
+
+			msix->remapped_addr[index] = ventry->addr;
+			msix->remapped_data[index] = ventry->data;
+			msix->remapped_valid[index] = true;
+
+			/* the mapped entry is now eligible for storm containment */
+			ptirq_set_mask_cb(vpci2vm(vdev->vpci), vdev->bdf.value,
+					(uint16_t)index, pt_msix_mask_entry);
 		}
 	}
 
@@ -182,6 +244,7 @@ static void vdev_pt_unmap_msix(struct pci_vdev *vdev)
 		msix->table_entries[i].vector_control = PCIM_MSIX_VCTRL_MASK;
 		msix->table_entries[i].addr = 0U;
 		msix->table_entries[i].data = 0U;
+		msix->remapped_valid[i] = false;
 	}
 
 	if (msix->mmio_gpa != 0UL) {
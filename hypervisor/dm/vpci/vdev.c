@@ -76,23 +76,83 @@ void pci_vdev_write_vcfg(struct pci_vdev *vdev, uint32_t offset, uint32_t bytes,
 /**
  * @pre vpci != NULL
  * @pre vpci->pci_vdev_cnt <= CONFIG_MAX_PCI_DEV_NUM
+ *
+ * The lookup is lock-free: a bus with a lookup leaf is resolved by a plain
+ * indexed load, and a leaf always covers its entire bus, so the hash list is
+ * only walked for buses that never got one. The hash walk itself is also safe
+ * without vpci->lock because vdev structures are never freed and hlist_del()
+ * keeps the removed node's next pointer intact.
  */
 struct pci_vdev *pci_find_vdev(struct acrn_vpci *vpci, union pci_bdf vbdf)
 {
 	struct pci_vdev *vdev = NULL, *tmp;
 	struct hlist_node *n;
+	const uint16_t *leaf = vpci->bus_lookup[vbdf.bits.b];
+
+	if (leaf != NULL) {
+		uint16_t idx = leaf[vbdf.value & 0xFFU];
 
-	hlist_for_each(n, &vpci->vdevs_hlist_heads[hash64(vbdf.value, VDEV_LIST_HASHBITS)]) {
-		tmp = hlist_entry(n, struct pci_vdev, link);
-		if (bdf_is_equal(vbdf, tmp->bdf)) {
-			vdev = tmp;
-			break;
+		if (idx != 0U) {
+			vdev = &vpci->pci_vdevs[idx - 1U];
+		}
+	} else {
+		hlist_for_each(n, &vpci->vdevs_hlist_heads[hash64(vbdf.value, VDEV_LIST_HASHBITS)]) {
+			tmp = hlist_entry(n, struct pci_vdev, link);
+			if (bdf_is_equal(vbdf, tmp->bdf)) {
+				vdev = tmp;
+				break;
+			}
 		}
 	}
 
 	return vdev;
 }
 
+/**
+ * @brief Publish a vdev in the BDF-indexed lookup table.
+ *
+ * A leaf is allocated for the vdev's bus on first use; its entry is filled
+ * before the leaf pointer is published so a concurrent lock-free lookup either
+ * misses the vdev or finds it through a consistent leaf. When the leaf pool is
+ * exhausted the bus permanently stays on the hash list slow path. A vdev whose
+ * vBDF is still unassigned is not published.
+ *
+ * @pre vpci != NULL
+ * @pre vdev != NULL
+ */
+void vpci_lookup_insert(struct acrn_vpci *vpci, struct pci_vdev *vdev)
+{
+	uint16_t *leaf = vpci->bus_lookup[vdev->bdf.bits.b];
+	uint16_t idx = (uint16_t)((vdev - vpci->pci_vdevs) + 1);
+
+	if (vdev->bdf.value != UNASSIGNED_VBDF) {
+		if (leaf != NULL) {
+			leaf[vdev->bdf.value & 0xFFU] = idx;
+		} else if (vpci->lookup_leaf_cnt < VPCI_LOOKUP_LEAF_NUM) {
+			leaf = vpci->lookup_leaves[vpci->lookup_leaf_cnt];
+			vpci->lookup_leaf_cnt++;
+			leaf[vdev->bdf.value & 0xFFU] = idx;
+			vpci->bus_lookup[vdev->bdf.bits.b] = leaf;
+		} else {
+			/* no leaf left, this bus is served by the hash list */
+		}
+	}
+}
+
+/**
+ * @brief Withdraw a vBDF from the BDF-indexed lookup table.
+ *
+ * @pre vpci != NULL
+ */
+void vpci_lookup_remove(struct acrn_vpci *vpci, union pci_bdf vbdf)
+{
+	uint16_t *leaf = vpci->bus_lookup[vbdf.bits.b];
+
+	if (leaf != NULL) {
+		leaf[vbdf.value & 0xFFU] = 0U;
+	}
+}
+
 static bool is_pci_mem_bar_base_valid(struct acrn_vm *vm, uint64_t base)
 {
 	struct acrn_vpci *vpci = &vm->vpci;
@@ -76,8 +76,11 @@ void init_vmsix_on_msi(struct pci_vdev *vdev)
 	struct pci_pdev *pdev = vdev->pdev;
 	uint32_t i;
 
-	/* irte_count > 1 only when the device needs vMSI-x on MSI emulation and IRTEs are reserved successfully */
-	if (pdev->irte_count > 1U) {
+	/* the device needs vMSI-x on MSI emulation when IRTEs were reserved
+	 * for its MSI vectors; devices with a real MSI-X capability carry
+	 * reserved IRTEs too (e.g. SR-IOV VFs) but are not emulated
+	 */
+	if ((pdev->irte_count > 1U) && (pdev->msix.capoff == 0U)) {
 		/* find an unused BAR */
 		for (i = 0U; i < vdev->nr_bars; i++) {
 			if (vdev->vbars[i].base_hpa == 0UL){
@@ -84,7 +84,7 @@ static bool vpci_pio_cfgaddr_write(struct acrn_vcpu *vcpu, uint16_t addr, size_t
 		cfg_addr->value = val & (~0x7f000003U);
 
 		if (is_postlaunched_vm(vcpu->vm)) {
-			const struct pci_vdev *vdev;
+			struct pci_vdev *vdev;
 
 			vbdf.value = cfg_addr->bits.bdf;
 			vdev = find_available_vdev(vpci, vbdf);
@@ -95,6 +95,10 @@ static bool vpci_pio_cfgaddr_write(struct acrn_vcpu *vcpu, uint16_t addr, size_t
 			if ((vdev == NULL) || is_quirk_ptdev(vdev)) {
 				ret = false;
 			}
+
+			if (vdev != NULL) {
+				spinlock_release(&vdev->cfg_lock);
+			}
 		}
 	}
 
@@ -281,9 +285,9 @@ void deinit_vpci(struct acrn_vm *vm)
 			vdev->vdev_ops->deinit_vdev(vdev);
 
 			if (parent_vdev != NULL) {
-				spinlock_obtain(&parent_vdev->vpci->lock);
+				spinlock_obtain(&parent_vdev->cfg_lock);
 				parent_vdev->vdev_ops->init_vdev(parent_vdev);
-				spinlock_release(&parent_vdev->vpci->lock);
+				spinlock_release(&parent_vdev->cfg_lock);
 			}
 		}
 	}
@@ -344,25 +348,41 @@ static void remove_vdev_pt_iommu_domain(const struct pci_vdev *vdev)
  *        If the vdev's vpci is NULL, the vdev is a orphan/zombie instance, it can't
  *        be accessed by any vpci.
  *
+ * The lookup itself is lock-free; on success the vdev is returned with its
+ * cfg_lock held so that the availability decision stays valid until the caller
+ * finishes the config-space access and releases the lock.
+ *
  * @param vpci Pointer to a specified vpci structure
  * @param bdf  Indicate the vdev's BDF
  *
  * @pre vpci != NULL
  *
- * @return Return a available vdev instance, otherwise return NULL
+ * @return Return a available vdev instance with its cfg_lock held, otherwise return NULL
  */
 static struct pci_vdev *find_available_vdev(struct acrn_vpci *vpci, union pci_bdf bdf)
 {
 	struct pci_vdev *vdev = pci_find_vdev(vpci, bdf);
 
-	if ((vdev != NULL) && (vdev->user != vdev)) {
-		if (vdev->user != NULL) {
-			/* the Service VM is able to access, if and only if the Service VM has higher severity than the User VM. */
-			if (get_vm_severity(vpci2vm(vpci)->vm_id) <
-					get_vm_severity(vpci2vm(vdev->user->vpci)->vm_id)) {
-				vdev = NULL;
+	if (vdev != NULL) {
+		const struct pci_vdev *user;
+		bool available = true;
+
+		spinlock_obtain(&vdev->cfg_lock);
+		user = vdev->user;
+		if (user != vdev) {
+			if (user != NULL) {
+				/* the Service VM is able to access, if and only if the Service VM has higher severity than the User VM. */
+				if (get_vm_severity(vpci2vm(vpci)->vm_id) <
+						get_vm_severity(vpci2vm(user->vpci)->vm_id)) {
+					available = false;
+				}
+			} else {
+				available = false;
 			}
-		} else {
+		}
+
+		if (!available) {
+			spinlock_release(&vdev->cfg_lock);
 			vdev = NULL;
 		}
 	}
@@ -578,10 +598,10 @@ static int32_t vpci_read_cfg(struct acrn_vpci *vpci, union pci_bdf bdf,
 	int32_t ret = 0;
 	struct pci_vdev *vdev;
 
-	spinlock_obtain(&vpci->lock);
 	vdev = find_available_vdev(vpci, bdf);
 	if (vdev != NULL) {
 		ret = vdev->vdev_ops->read_vdev_cfg(vdev, offset, bytes, val);
+		spinlock_release(&vdev->cfg_lock);
 	} else {
 		if (is_postlaunched_vm(vpci2vm(vpci))) {
 			ret = -ENODEV;
@@ -592,7 +612,6 @@ static int32_t vpci_read_cfg(struct acrn_vpci *vpci, union pci_bdf bdf,
 			/* no action: e.g., PCI scan */
 		}
 	}
-	spinlock_release(&vpci->lock);
 	return ret;
 }
 
@@ -605,10 +624,10 @@ static int32_t vpci_write_cfg(struct acrn_vpci *vpci, union pci_bdf bdf,
 	int32_t ret = 0;
 	struct pci_vdev *vdev;
 
-	spinlock_obtain(&vpci->lock);
 	vdev = find_available_vdev(vpci, bdf);
 	if (vdev != NULL) {
 		ret = vdev->vdev_ops->write_vdev_cfg(vdev, offset, bytes, val);
+		spinlock_release(&vdev->cfg_lock);
 	} else {
 		if (is_postlaunched_vm(vpci2vm(vpci))) {
 			ret = -ENODEV;
@@ -620,7 +639,6 @@ static int32_t vpci_write_cfg(struct acrn_vpci *vpci, union pci_bdf bdf,
 				bdf.bits.b, bdf.bits.d, bdf.bits.f, offset, val);
 		}
 	}
-	spinlock_release(&vpci->lock);
 	return ret;
 }
 
@@ -652,8 +670,8 @@ struct pci_vdev *vpci_init_vdev(struct acrn_vpci *vpci, struct acrn_vm_pci_dev_c
 	vdev->pdev = dev_config->pdev;
 	vdev->pci_dev_config = dev_config;
 	vdev->phyfun = parent_pf_vdev;
+	spinlock_init(&vdev->cfg_lock);
 
-	hlist_add_head(&vdev->link, &vpci->vdevs_hlist_heads[hash64(dev_config->vbdf.value, VDEV_LIST_HASHBITS)]);
 	if (dev_config->vdev_ops != NULL) {
 		vdev->vdev_ops = dev_config->vdev_ops;
 	} else {
@@ -665,6 +683,14 @@ struct pci_vdev *vpci_init_vdev(struct acrn_vpci *vpci, struct acrn_vm_pci_dev_c
 
 	vdev->vdev_ops->init_vdev(vdev);
 
+	/*
+	 * Publish the vdev for lookup only after it is fully initialized: a
+	 * lock-free config-space access racing with creation must either miss
+	 * the device or see a complete one.
+	 */
+	hlist_add_head(&vdev->link, &vpci->vdevs_hlist_heads[hash64(dev_config->vbdf.value, VDEV_LIST_HASHBITS)]);
+	vpci_lookup_insert(vpci, vdev);
+
 	return vdev;
 }
 
@@ -709,8 +735,16 @@ int32_t vpci_assign_pcidev(struct acrn_vm *tgt_vm, struct acrn_pcidev *pcidev)
 
 	bdf.value = pcidev->phys_bdf;
 	service_vm = get_service_vm();
-	spinlock_obtain(&service_vm->vpci.lock);
 	vdev_in_service_vm = pci_find_vdev(&service_vm->vpci, bdf);
+	if (vdev_in_service_vm != NULL) {
+		/*
+		 * Hold the Service VM vdev's cfg_lock across the user transition:
+		 * it drains in-flight Service VM config-space accesses (the vpci
+		 * lock no longer covers the dispatch path) and serializes
+		 * concurrent assignments of the same device.
+		 */
+		spinlock_obtain(&vdev_in_service_vm->cfg_lock);
+	}
 	if ((vdev_in_service_vm != NULL) && (vdev_in_service_vm->user == vdev_in_service_vm) &&
 			(vdev_in_service_vm->pdev != NULL) &&
 			!is_host_bridge(vdev_in_service_vm->pdev) && !is_bridge(vdev_in_service_vm->pdev)) {
@@ -749,10 +783,12 @@ int32_t vpci_assign_pcidev(struct acrn_vm *tgt_vm, struct acrn_pcidev *pcidev)
 
 		if (ret == 0) {
 			vdev->flags |= pcidev->type;
-			vdev->bdf.value = pcidev->virt_bdf;
 			/*We should re-add the vdev to hashlist since its vbdf has changed */
+			vpci_lookup_remove(vpci, vdev->bdf);
+			vdev->bdf.value = pcidev->virt_bdf;
 			hlist_del(&vdev->link);
 			hlist_add_head(&vdev->link, &vpci->vdevs_hlist_heads[hash64(vdev->bdf.value, VDEV_LIST_HASHBITS)]);
+			vpci_lookup_insert(vpci, vdev);
 			vdev->parent_user = vdev_in_service_vm;
 			vdev_in_service_vm->user = vdev;
 		} else {
@@ -767,7 +803,9 @@ int32_t vpci_assign_pcidev(struct acrn_vm *tgt_vm, struct acrn_pcidev *pcidev)
 			pcidev->virt_bdf >> 8U, (pcidev->virt_bdf >> 3U) & 0x1fU, pcidev->virt_bdf & 0x7U);
 		ret = -ENODEV;
 	}
-	spinlock_release(&service_vm->vpci.lock);
+	if (vdev_in_service_vm != NULL) {
+		spinlock_release(&vdev_in_service_vm->cfg_lock);
+	}
 
 	return ret;
 }
@@ -790,12 +828,15 @@ int32_t vpci_deassign_pcidev(struct acrn_vm *tgt_vm, struct acrn_pcidev *pcidev)
 			(vdev->pdev->bdf.value == pcidev->phys_bdf)) {
 		parent_vdev = vdev->parent_user;
 
+		/* drain in-flight config-space accesses to the leaving vdev */
+		spinlock_obtain(&vdev->cfg_lock);
 		vdev->vdev_ops->deinit_vdev(vdev);
+		spinlock_release(&vdev->cfg_lock);
 
 		if (parent_vdev != NULL) {
-			spinlock_obtain(&parent_vdev->vpci->lock);
+			spinlock_obtain(&parent_vdev->cfg_lock);
 			parent_vdev->vdev_ops->init_vdev(parent_vdev);
-			spinlock_release(&parent_vdev->vpci->lock);
+			spinlock_release(&parent_vdev->cfg_lock);
 		}
 	} else {
 		pr_fatal("%s, can't find PCI device %x:%x.%x for vm[%d] %x:%x.%x\n", __func__,
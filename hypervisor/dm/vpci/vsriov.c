@@ -31,6 +31,7 @@
 #include <ptdev.h>
 #include <vpci.h>
 #include <asm/pci_dev.h>
+#include <asm/vtd.h>
 #include <logmsg.h>
 #include <delay.h>
 
@@ -79,6 +80,36 @@ static void init_sriov_vf_bar(struct pci_vdev *pf_vdev)
 	init_vdev_pt(pf_vdev, true);
 }
 
+/**
+ * Reserve a contiguous IRTE block covering the VF's whole MSI-X table, so
+ * that bringing the vectors up later (and again on every re-assignment of
+ * the VF) finds its remap state preallocated instead of taking the
+ * allocator once per vector.
+ *
+ * @pre vf_pdev != NULL
+ */
+static void reserve_vf_irtes(struct pci_pdev *vf_pdev)
+{
+	struct intr_source intr_src;
+	uint16_t num = 1U;
+
+	/* irte_count != 0 means pci_init_pdev already reserved a block for
+	 * vMSI-X on MSI emulation
+	 */
+	if ((vf_pdev->irte_count == 0U) && (vf_pdev->msix.capoff != 0U) &&
+			(vf_pdev->msix.table_count <= 32U)) {
+		while (num < (uint16_t)vf_pdev->msix.table_count) {
+			num <<= 1U;
+		}
+		intr_src.is_msi = true;
+		intr_src.src.msi.value = vf_pdev->bdf.value;
+		if ((dmar_reserve_irte(&intr_src, num, &vf_pdev->irte_start) == 0) &&
+				(vf_pdev->irte_start != INVALID_IRTE_ID)) {
+			vf_pdev->irte_count = num;
+		}
+	}
+}
+
 /**
  * @pre pf_vdev != NULL
  */
@@ -93,6 +124,7 @@ static void create_vf(struct pci_vdev *pf_vdev, union pci_bdf vf_bdf, uint16_t v
 	 */
 	vf_pdev = pci_init_pdev(vf_bdf, pf_vdev->pdev->drhd_index);
 	if (vf_pdev != NULL) {
+		reserve_vf_irtes(vf_pdev);
 		struct acrn_vm_pci_dev_config *dev_cfg;
 
 		dev_cfg = init_one_dev_config(vf_pdev);
@@ -198,6 +230,13 @@ static void enable_vfs(struct pci_vdev *pf_vdev)
 	if ((sub_vid != 0xFFFFU) && (sub_vid != 0U)) {
 		struct pci_vdev *vf_vdev;
 
+		/*
+		 * VF creation adds vdevs to the vpci, so take the vpci lock to
+		 * serialize with the other population writers; the PF's cfg_lock
+		 * is already held here (SRIOV capability write), which is the
+		 * documented lock order.
+		 */
+		spinlock_obtain(&pf_vdev->vpci->lock);
 		num_vfs = read_sriov_reg(pf_vdev, PCIR_SRIOV_NUMVFS);
 		for (idx = 0U; idx < num_vfs; idx++) {
 			vf_bdf.fields.bus = get_vf_bus(pf_vdev, fst_off, stride, idx);
@@ -215,10 +254,13 @@ static void enable_vfs(struct pci_vdev *pf_vdev)
 			} else {
 				/* Re-activate a zombie VF */
 				if (is_zombie_vf(vf_vdev)) {
+					spinlock_obtain(&vf_vdev->cfg_lock);
 					vf_vdev->vdev_ops->init_vdev(vf_vdev);
+					spinlock_release(&vf_vdev->cfg_lock);
 				}
 			}
 		}
+		spinlock_release(&pf_vdev->vpci->lock);
 	} else {
 		/*
 		 * If the VF physical device was not created successfully, the pdev/vdev
@@ -256,8 +298,11 @@ static void disable_vfs(struct pci_vdev *pf_vdev)
 		bdf.fields.devfun = get_vf_devfun(pf_vdev, first, stride, idx);
 		vf_vdev = pci_find_vdev(&vpci2vm(pf_vdev->vpci)->vpci, bdf);
 		if ((vf_vdev != NULL) && (!is_zombie_vf(vf_vdev))) {
-			/* set disabled VF as zombie vdev instance */
+			/* set disabled VF as zombie vdev instance, draining
+			 * in-flight config-space accesses to the VF first */
+			spinlock_obtain(&vf_vdev->cfg_lock);
 			vf_vdev->vdev_ops->deinit_vdev(vf_vdev);
+			spinlock_release(&vf_vdev->cfg_lock);
 		}
 	}
 }
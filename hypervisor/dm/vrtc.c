@@ -459,6 +459,12 @@ static inline bool rtc_halted(struct acrn_vrtc *rtc)
         return ((rtc->rtcdev.reg_b & RTCSB_HALT) != 0U);
 }
 
+static inline bool vrtc_is_time_register(uint32_t offset)
+{
+	return ((offset == RTC_SEC) || (offset == RTC_MIN) || (offset == RTC_HRS) || (offset == RTC_DAY)
+			|| (offset == RTC_MONTH) || (offset == RTC_YEAR) || (offset == RTC_CENTURY));
+}
+
 static uint8_t vrtc_get_reg_c(struct acrn_vrtc *vrtc)
 {
 	uint8_t	ret = vrtc->rtcdev.reg_c;
@@ -510,7 +516,20 @@ static bool vrtc_read(struct acrn_vcpu *vcpu, uint16_t addr, __unused size_t wid
 		pio_req->value = offset;
 	} else {
 		if (is_service_vm(vm)) {
-			pio_req->value = cmos_get_reg_val(offset);
+			if (vrtc_is_time_register(offset) && (vrtc->base_rtctime > 0)
+					&& !rtc_halted(vrtc)) {
+				/*
+				 * Serve time registers from the TSC-derived coarse
+				 * snapshot. Guests polling the RTC at high rate
+				 * otherwise pay a physical CMOS access plus the
+				 * update-in-progress spin on every single read.
+				 */
+				current = vrtc_get_current_time(vrtc);
+				secs_to_rtc(current, vrtc);
+				pio_req->value = *((uint8_t *)&vrtc->rtcdev + offset);
+			} else {
+				pio_req->value = cmos_get_reg_val(offset);
+			}
 		} else {
 			if (offset <= RTC_CENTURY) {
 				current = vrtc_get_current_time(vrtc);
@@ -532,12 +551,6 @@ static bool vrtc_read(struct acrn_vcpu *vcpu, uint16_t addr, __unused size_t wid
 	return ret;
 }
 
-static inline bool vrtc_is_time_register(uint32_t offset)
-{
-	return ((offset == RTC_SEC) || (offset == RTC_MIN) || (offset == RTC_HRS) || (offset == RTC_DAY)
-			|| (offset == RTC_MONTH) || (offset == RTC_YEAR) || (offset == RTC_CENTURY));
-}
-
 /**
  * @pre vcpu != NULL
  * @pre vcpu->vm != NULL
@@ -561,6 +574,10 @@ static bool vrtc_write(struct acrn_vcpu *vcpu, uint16_t addr, size_t width,
 				vrtc_update_basetime(after, current - after);
 			} else {
 				cmos_set_reg_val(vcpu->vm->vrtc.addr, (uint8_t)(value & 0xFFU));
+				if (vrtc->addr == RTC_STATUSB) {
+					/* mirror reg_b so halted clocks fall back to physical reads */
+					vrtc->rtcdev.reg_b = (uint8_t)(value & 0xFFU);
+				}
 			}
 		} else {
 			switch (vrtc->addr) {
@@ -629,12 +646,21 @@ static void vrtc_update_basetime(time_t physical_time, time_t offset)
 
 	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
 		vm = get_vm_from_vmid(vm_id);
-		if (is_rt_vm(vm) || is_prelaunched_vm(vm)) {
+		if (is_service_vm(vm)) {
+			/* the Service VM snapshot mirrors the physical RTC, no offset */
+			spinlock_obtain(&vrtc_rebase_lock);
+			vm->vrtc.base_tsc = cpu_ticks();
+			vm->vrtc.base_rtctime = physical_time;
+			vm->vrtc.last_rtctime = VRTC_BROKEN_TIME;
+			spinlock_release(&vrtc_rebase_lock);
+		} else if (is_rt_vm(vm) || is_prelaunched_vm(vm)) {
 			spinlock_obtain(&vrtc_rebase_lock);
 			vm->vrtc.base_tsc = cpu_ticks();
 			vm->vrtc.base_rtctime = physical_time;
 			vm->vrtc.offset_rtctime += offset;
 			spinlock_release(&vrtc_rebase_lock);
+		} else {
+			/* post-launched VMs keep their own DM-provided time base */
 		}
 	}
 }
@@ -702,6 +728,14 @@ void vrtc_init(struct acrn_vm *vm)
 	register_pio_emulation_handler(vm, RTC_PIO_IDX, &range, vrtc_read, vrtc_write);
 
 	if (is_service_vm(vm)) {
+		/*
+		 * The Service VM also gets a coarse snapshot so its time
+		 * register reads are served from the TSC instead of going
+		 * to the physical CMOS on every exit; the calibrate timer
+		 * rebases the snapshot periodically.
+		 */
+		vrtc_set_basetime(&vm->vrtc);
+		vm->vrtc.base_tsc = cpu_ticks();
 		calibrate_setup_timer();
 	} else {
 		vrtc_set_basetime(&vm->vrtc);
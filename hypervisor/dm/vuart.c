@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <util.h>
 #include <pci.h>
 #include <uart16550.h>
 #include <console.h>
@@ -227,6 +228,124 @@ static bool send_to_target(struct acrn_vuart *vu, uint8_t value_u8)
 	return ret;
 }
 
+/*
+ * SCR writes drive the bulk mode handshake documented in vuart.h.
+ * Called with the vuart lock held.
+ */
+static void vuart_bulk_scr_write(struct acrn_vuart *vu, uint8_t value_u8)
+{
+	if (vu->bulk_hshake == 0U) {
+		if (value_u8 == VUART_BULK_MAGIC0) {
+			vu->bulk_hshake = 1U;
+		} else {
+			/* any other value drops back to the plain scratch register */
+			vu->bulk_mode = false;
+			vu->scr = value_u8;
+		}
+	} else if (vu->bulk_hshake == 1U) {
+		if (value_u8 == VUART_BULK_MAGIC1) {
+			vu->bulk_gpa = 0UL;
+			vu->bulk_hshake = 2U;
+		} else {
+			vu->bulk_hshake = 0U;
+			vu->scr = value_u8;
+		}
+	} else {
+		vu->bulk_gpa |= ((uint64_t)value_u8) << ((vu->bulk_hshake - 2U) * 8U);
+		vu->bulk_hshake++;
+		if (vu->bulk_hshake == 10U) {
+			vu->bulk_hshake = 0U;
+			if ((vu->bulk_gpa != 0UL) && mem_aligned_check(vu->bulk_gpa, PAGE_SIZE)) {
+				vu->bulk_mode = true;
+				vu->scr = VUART_BULK_STA_ACTIVE;
+			} else {
+				vu->bulk_mode = false;
+				vu->scr = VUART_BULK_STA_ERROR;
+			}
+		}
+	}
+}
+
+/*
+ * Move pending bytes out of the sender's bulk TX ring in one shot: into
+ * the peer's bulk RX ring when the peer negotiated bulk mode as well,
+ * through the peer's legacy RX FIFO otherwise. Called without holding
+ * the sender's lock, like the THR fast path in vuart_write_reg.
+ */
+static void vuart_bulk_kick(struct acrn_vuart *vu)
+{
+	struct acrn_vuart *t_vu = vu->target_vu;
+	uint8_t bounce[256U];
+	uint32_t hdr[4U], t_hdr[4U];
+	uint32_t head, tail, pending, space, run, i, moved = 0U;
+	uint64_t src_buf, dst_buf;
+	uint64_t rflags;
+
+	if ((t_vu != NULL) && (copy_from_gpa(vu->vm, hdr, vu->bulk_gpa, 16U) == 0)) {
+		head = hdr[0U] % VUART_BULK_BUF_SIZE;
+		tail = hdr[1U] % VUART_BULK_BUF_SIZE;
+		pending = ((tail + VUART_BULK_BUF_SIZE) - head) % VUART_BULK_BUF_SIZE;
+		src_buf = vu->bulk_gpa + offsetof(struct vuart_bulk_ring, tx_buf);
+
+		if ((pending != 0U) && t_vu->bulk_mode
+				&& (copy_from_gpa(t_vu->vm, t_hdr, t_vu->bulk_gpa, 16U) == 0)) {
+			uint32_t rx_head = t_hdr[2U] % VUART_BULK_BUF_SIZE;
+			uint32_t rx_tail = t_hdr[3U] % VUART_BULK_BUF_SIZE;
+
+			space = (VUART_BULK_BUF_SIZE - 1U)
+				- (((rx_tail + VUART_BULK_BUF_SIZE) - rx_head) % VUART_BULK_BUF_SIZE);
+			dst_buf = t_vu->bulk_gpa + offsetof(struct vuart_bulk_ring, rx_buf);
+
+			while ((moved < pending) && (moved < space)) {
+				run = min(min(pending - moved, space - moved), (uint32_t)sizeof(bounce));
+				run = min(run, VUART_BULK_BUF_SIZE - head);
+				run = min(run, VUART_BULK_BUF_SIZE - rx_tail);
+				if ((copy_from_gpa(vu->vm, bounce, src_buf + head, run) != 0)
+						|| (copy_to_gpa(t_vu->vm, bounce, dst_buf + rx_tail, run) != 0)) {
+					break;
+				}
+				head = (head + run) % VUART_BULK_BUF_SIZE;
+				rx_tail = (rx_tail + run) % VUART_BULK_BUF_SIZE;
+				moved += run;
+			}
+
+			if (moved != 0U) {
+				(void)copy_to_gpa(t_vu->vm, &rx_tail,
+					t_vu->bulk_gpa + offsetof(struct vuart_bulk_ring, rx_tail), 4U);
+				(void)copy_to_gpa(vu->vm, &head,
+					vu->bulk_gpa + offsetof(struct vuart_bulk_ring, tx_head), 4U);
+				/* one in-band doorbell byte batches any amount of ring data */
+				(void)send_to_target(t_vu, VUART_BULK_KICK);
+			}
+		} else if (pending != 0U) {
+			/* legacy fallback: the peer still reads byte-at-a-time from its RX FIFO */
+			while ((moved < pending) && !fifo_isfull(&t_vu->rxfifo)) {
+				run = min(pending - moved, 64U);
+				run = min(run, VUART_BULK_BUF_SIZE - head);
+				if (copy_from_gpa(vu->vm, bounce, src_buf + head, run) != 0) {
+					break;
+				}
+				obtain_vuart_lock(t_vu, rflags);
+				if (t_vu->active) {
+					for (i = 0U; i < run; i++) {
+						fifo_putchar(&t_vu->rxfifo, (char)bounce[i]);
+					}
+					vuart_toggle_intr(t_vu);
+				}
+				release_vuart_lock(t_vu, rflags);
+				head = (head + run) % VUART_BULK_BUF_SIZE;
+				moved += run;
+			}
+			if (moved != 0U) {
+				(void)copy_to_gpa(vu->vm, &head,
+					vu->bulk_gpa + offsetof(struct vuart_bulk_ring, tx_head), 4U);
+			}
+		} else {
+			/* nothing pending, treat the kick as a no-op */
+		}
+	}
+}
+
 static uint8_t get_modem_status(uint8_t mcr)
 {
 	uint8_t msr;
@@ -361,7 +480,7 @@ static void write_reg(struct acrn_vuart *vu, uint16_t reg, uint8_t value_u8)
 			 */
 			break;
 		case UART16550_SCR:
-			vu->scr = value_u8;
+			vuart_bulk_scr_write(vu, value_u8);
 			break;
 		default:
 			/*
@@ -395,6 +514,9 @@ void vuart_write_reg(struct acrn_vuart *vu, uint16_t offset, uint8_t value_u8)
 			vuart_toggle_intr(vu);
 			release_vuart_lock(vu, rflags);
 		}
+	} else if ((offset == UART16550_SCR) && ((vu->lcr & LCR_DLAB) == 0U)
+		&& vu->bulk_mode && (vu->bulk_hshake == 0U) && (value_u8 == VUART_BULK_KICK)) {
+		vuart_bulk_kick(vu);
 	} else {
 		write_reg(vu, offset, value_u8);
 	}
@@ -580,6 +702,9 @@ static void setup_vuart(struct acrn_vm *vm, uint16_t vuart_idx)
 	init_vuart_lock(vu);
 	vu->thre_int_pending = true;
 	vu->ier = 0U;
+	vu->bulk_mode = false;
+	vu->bulk_hshake = 0U;
+	vu->bulk_gpa = 0UL;
 	vuart_toggle_intr(vu);
 	vu->target_vu = NULL;
 }
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Copy-offload through an Intel CBDMA (I/OAT) engine.
+ *
+ * The hypervisor claims the first supported DMA function it finds during
+ * PCI enumeration (the function is marked HV owned, so it is never handed
+ * to a guest) and drives a single channel in polled mode: one descriptor
+ * is posted at a time and completion is observed through the channel's
+ * status writeback. That is enough for the bulk-copy users - guest RAM
+ * scrub on VM shutdown today, snapshot/migration copies later - which are
+ * multi-MiB transfers where descriptor batching would not change the
+ * picture but would complicate error handling.
+ *
+ * All callers must treat -ENODEV as "engine not present, use the CPU
+ * path"; a channel error retires the engine for the lifetime of the boot
+ * and subsequent calls fail the same way.
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <asm/lib/spinlock.h>
+#include <asm/io.h>
+#include <asm/mmu.h>
+#include <asm/pgtable.h>
+#include <pci.h>
+#include <dmacpy.h>
+#include <common/delay.h>
+#include <util.h>
+#include <logmsg.h>
+
+/* MMIO register layout, channel 0 registers follow the common block */
+#define DMACPY_REG_CHANCNT	0x00U	/* 8-bit, number of channels */
+#define DMACPY_REG_XFERCAP	0x01U	/* 8-bit, log2 of max transfer */
+#define DMACPY_REG_CHAN_BASE	0x80U	/* first channel's register block */
+#define DMACPY_REG_CHANCTRL	0x00U	/* 16-bit */
+#define DMACPY_REG_CHANCMD	0x04U	/* 8-bit */
+#define DMACPY_REG_DMACOUNT	0x06U	/* 16-bit, count of valid descriptors */
+#define DMACPY_REG_CHANSTS	0x08U	/* 64-bit */
+#define DMACPY_REG_CHAINADDR	0x10U	/* 64-bit, descriptor chain HPA */
+#define DMACPY_REG_CHANCMP	0x18U	/* 64-bit, completion writeback HPA */
+#define DMACPY_REG_CHANERR	0x28U	/* 32-bit */
+
+#define DMACPY_CHANCMD_START	0x01U
+#define DMACPY_CHANCMD_RESET	0x20U
+
+#define DMACPY_CHANSTS_STATUS	0x7UL
+#define DMACPY_CHANSTS_HALTED	0x3UL
+#define DMACPY_CHANSTS_ADDR	(~0x3fUL)	/* last completed descriptor */
+
+/* descriptor control bits */
+#define DMACPY_CTL_CP_STS	(1U << 3U)	/* write completion status */
+#define DMACPY_CTL_FENCE	(1U << 4U)
+#define DMACPY_CTL_OP_COPY	(0x00U << 24U)
+#define DMACPY_CTL_OP_FILL	(0x01U << 24U)
+
+/* supported device IDs, all vendor 0x8086 */
+#define DMACPY_VENDOR_INTEL	0x8086U
+static const uint16_t dmacpy_dev_ids[] = {
+	0x2021U,	/* Skylake-SP / Cascade Lake CBDMA */
+	0x6f20U,	/* Broadwell-DE/EP CBDMA */
+	0x2f20U,	/* Haswell-EP CBDMA */
+	0x0e20U,	/* Ivy Bridge-EP CBDMA */
+};
+
+struct dmacpy_desc {
+	uint32_t size;
+	uint32_t ctl;
+	uint64_t src_addr;	/* fill pattern for OP_FILL */
+	uint64_t dst_addr;
+	uint64_t next;
+	uint64_t rsvd[4];
+};
+
+/* two descriptors chained in a ring, so the completion writeback address
+ * distinguishes the latest transfer from the previous one
+ */
+static struct dmacpy_desc dmacpy_ring[2] __aligned(64U);
+static uint64_t dmacpy_comp __aligned(64U);	/* status writeback target */
+
+static spinlock_t dmacpy_lock = { .head = 0U, .tail = 0U };
+static void *dmacpy_chan_base;	/* NULL until probed, NULL again if retired */
+static uint64_t dmacpy_max_xfer;
+static uint16_t dmacpy_issued;
+static uint32_t dmacpy_ring_idx;
+
+static inline void *dmacpy_chan_reg(uint32_t offset)
+{
+	return (void *)((uint8_t *)dmacpy_chan_base + offset);
+}
+
+bool is_dmacpy_pdev(union pci_bdf bdf)
+{
+	uint32_t vendor, device, i;
+	bool found = false;
+
+	vendor = pci_pdev_read_cfg(bdf, PCIR_VENDOR, 2U);
+	if (vendor == DMACPY_VENDOR_INTEL) {
+		device = pci_pdev_read_cfg(bdf, PCIR_DEVICE, 2U);
+		for (i = 0U; i < ARRAY_SIZE(dmacpy_dev_ids); i++) {
+			if (device == (uint32_t)dmacpy_dev_ids[i]) {
+				found = true;
+				break;
+			}
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Retire the engine after a channel error or timeout. Callers fall back
+ * to their CPU paths from then on; no attempt is made to recover the
+ * channel at runtime.
+ */
+static void dmacpy_retire(const char *reason)
+{
+	pr_err("dmacpy: channel %s, retiring engine (CHANERR 0x%x)", reason,
+		mmio_read32(dmacpy_chan_reg(DMACPY_REG_CHANERR)));
+	dmacpy_chan_base = NULL;
+}
+
+static int32_t dmacpy_run_desc(uint32_t ctl, uint64_t src, uint64_t dst, uint32_t size)
+{
+	struct dmacpy_desc *desc = &dmacpy_ring[dmacpy_ring_idx];
+	uint64_t desc_hpa = hva2hpa(desc);
+	uint64_t sts, timeout_us;
+	int32_t ret = 0;
+
+	desc->size = size;
+	desc->ctl = ctl | DMACPY_CTL_CP_STS | DMACPY_CTL_FENCE;
+	desc->src_addr = src;
+	desc->dst_addr = dst;
+
+	dmacpy_issued++;
+	mmio_write16(dmacpy_issued, dmacpy_chan_reg(DMACPY_REG_DMACOUNT));
+	mmio_write8(DMACPY_CHANCMD_START, dmacpy_chan_reg(DMACPY_REG_CHANCMD));
+
+	/* CBDMA moves several GiB/s; a microsecond per 4KiB plus slack is
+	 * a generous bound before declaring the channel wedged
+	 */
+	timeout_us = ((uint64_t)size >> 12U) + 1000UL;
+	while (((dmacpy_comp & DMACPY_CHANSTS_ADDR) != (desc_hpa & DMACPY_CHANSTS_ADDR)) &&
+			(timeout_us != 0UL)) {
+		sts = mmio_read64(dmacpy_chan_reg(DMACPY_REG_CHANSTS));
+		if ((sts & DMACPY_CHANSTS_STATUS) == DMACPY_CHANSTS_HALTED) {
+			break;
+		}
+		udelay(1U);
+		timeout_us--;
+	}
+
+	if ((dmacpy_comp & DMACPY_CHANSTS_ADDR) != (desc_hpa & DMACPY_CHANSTS_ADDR)) {
+		dmacpy_retire((timeout_us == 0UL) ? "timed out" : "halted");
+		ret = -EIO;
+	}
+
+	dmacpy_ring_idx = (dmacpy_ring_idx + 1U) & 1U;
+	return ret;
+}
+
+static int32_t dmacpy_submit(uint32_t op, uint64_t src, uint64_t dst, uint64_t size)
+{
+	uint64_t off = 0UL, chunk;
+	int32_t ret = -ENODEV;
+
+	if (((dst | src | size) & 0x7UL) != 0UL) {
+		ret = -EINVAL;
+	} else {
+		spinlock_obtain(&dmacpy_lock);
+		if (dmacpy_chan_base != NULL) {
+			ret = 0;
+			while ((off < size) && (ret == 0)) {
+				chunk = min(size - off, dmacpy_max_xfer);
+				ret = dmacpy_run_desc(op,
+					(op == DMACPY_CTL_OP_FILL) ? src : (src + off),
+					dst + off, (uint32_t)chunk);
+				off += chunk;
+			}
+		}
+		spinlock_release(&dmacpy_lock);
+	}
+
+	return ret;
+}
+
+int32_t dmacpy_copy(uint64_t dst_hpa, uint64_t src_hpa, uint64_t size)
+{
+	return dmacpy_submit(DMACPY_CTL_OP_COPY, src_hpa, dst_hpa, size);
+}
+
+int32_t dmacpy_fill(uint64_t dst_hpa, uint64_t pattern, uint64_t size)
+{
+	return dmacpy_submit(DMACPY_CTL_OP_FILL, pattern, dst_hpa, size);
+}
+
+void dmacpy_init(void)
+{
+	const struct pci_pdev **pdevs = get_hv_owned_pdevs();
+	const struct pci_pdev *pdev = NULL;
+	uint64_t bar_base;
+	uint32_t i, cmd;
+	uint8_t xfercap;
+
+	for (i = 0U; i < get_hv_owned_pdev_num(); i++) {
+		if (is_dmacpy_pdev(pdevs[i]->bdf)) {
+			pdev = pdevs[i];
+			break;
+		}
+	}
+	if (pdev == NULL) {
+		return;
+	}
+
+	/* BAR0 holds the channel registers; 64-bit memory BAR on all
+	 * supported parts
+	 */
+	bar_base = (uint64_t)(pdev->bars[0].phy_bar & PCIM_BAR_MEM_BASE);
+	if ((pdev->bars[0].phy_bar & PCIM_BAR_MEM_64) != 0U) {
+		bar_base |= ((uint64_t)pdev->bars[1].phy_bar << 32U);
+	}
+	if (bar_base == 0UL) {
+		return;
+	}
+
+	cmd = pci_pdev_read_cfg(pdev->bdf, PCIR_COMMAND, 2U);
+	pci_pdev_write_cfg(pdev->bdf, PCIR_COMMAND, 2U,
+		cmd | PCIM_CMD_MEMEN | PCIM_CMD_BUSMASTEREN);
+
+	set_paging_supervisor(bar_base, PAGE_SIZE);
+	dmacpy_chan_base = (void *)((uint8_t *)hpa2hva(bar_base) + DMACPY_REG_CHAN_BASE);
+
+	if (mmio_read8(hpa2hva(bar_base + DMACPY_REG_CHANCNT)) == 0U) {
+		dmacpy_chan_base = NULL;
+		return;
+	}
+	xfercap = mmio_read8(hpa2hva(bar_base + DMACPY_REG_XFERCAP));
+	dmacpy_max_xfer = ((xfercap == 0U) || (xfercap >= 32U)) ? MEM_1M : (1UL << xfercap);
+
+	mmio_write8(DMACPY_CHANCMD_RESET, dmacpy_chan_reg(DMACPY_REG_CHANCMD));
+	udelay(100U);
+
+	dmacpy_ring[0].next = hva2hpa(&dmacpy_ring[1]);
+	dmacpy_ring[1].next = hva2hpa(&dmacpy_ring[0]);
+	mmio_write64(hva2hpa(&dmacpy_ring[0]), dmacpy_chan_reg(DMACPY_REG_CHAINADDR));
+	mmio_write64(hva2hpa(&dmacpy_comp), dmacpy_chan_reg(DMACPY_REG_CHANCMP));
+
+	pr_info("dmacpy: CBDMA %x:%x.%x claimed, max transfer 0x%lx",
+		pdev->bdf.bits.b, pdev->bdf.bits.d, pdev->bdf.bits.f, dmacpy_max_xfer);
+}
@@ -31,11 +31,13 @@
  *
  */
 #include <types.h>
+#include <rtl.h>
 #include <asm/lib/spinlock.h>
 #include <asm/io.h>
 #include <asm/pgtable.h>
 #include <asm/mmu.h>
 #include <pci.h>
+#include <dmacpy.h>
 #include <uart16550.h>
 #include <logmsg.h>
 #include <asm/pci_dev.h>
@@ -43,15 +45,15 @@
 #include <asm/lib/bits.h>
 #include <asm/board.h>
 #include <platform_acpi_info.h>
-#include <hash.h>
 #include <util.h>
 
-#define PDEV_HLIST_HASHBITS 6U
-#define PDEV_HLIST_HASHSIZE (1U << PDEV_HLIST_HASHBITS)
-
 static uint32_t num_pci_pdev;
 static struct pci_pdev pci_pdevs[CONFIG_MAX_PCI_DEV_NUM];
-static struct hlist_head pdevs_hlist_heads[PDEV_HLIST_HASHSIZE];
+/* BDF-indexed lookup table into pci_pdevs[]: one load per lookup, no
+ * hashing or chain walk; 0xFFFF marks a BDF with no probed device
+ */
+#define PDEV_INDEX_INVALID	0xFFFFU
+static uint16_t pdev_index_by_bdf[0x10000];
 
 /* For HV owned pdev */
 static uint32_t num_hv_owned_pci_pdev;
@@ -67,22 +69,53 @@ const struct pci_pdev **get_hv_owned_pdevs(void)
 	return (const struct pci_pdev **)hv_owned_pci_pdevs;
 }
 
-static struct pci_mmcfg_region phys_pci_mmcfg = {
-	.address = DEFAULT_PCI_MMCFG_BASE,
-	.start_bus = DEFAULT_PCI_MMCFG_START_BUS,
-	.end_bus = DEFAULT_PCI_MMCFG_END_BUS,
+/* ECAM regions from the MCFG allocation entries; entry 0 is the primary
+ * region exposed to the Service VM via get_mmcfg_region()
+ */
+static uint32_t num_pci_mmcfg = 1U;
+static struct pci_mmcfg_region phys_pci_mmcfg[PCI_MMCFG_REGION_NUM] = {
+	[0] = {
+		.address = DEFAULT_PCI_MMCFG_BASE,
+		.start_bus = DEFAULT_PCI_MMCFG_START_BUS,
+		.end_bus = DEFAULT_PCI_MMCFG_END_BUS,
+	},
 };
 
+static struct pci_mmcfg_region *bus_to_mmcfg_region(uint8_t bus)
+{
+	struct pci_mmcfg_region *region = NULL;
+	uint32_t i;
+
+	for (i = 0U; i < num_pci_mmcfg; i++) {
+		if ((bus >= phys_pci_mmcfg[i].start_bus) && (bus <= phys_pci_mmcfg[i].end_bus)) {
+			region = &phys_pci_mmcfg[i];
+			break;
+		}
+	}
+	return region;
+}
+
 #ifdef CONFIG_ACPI_PARSE_ENABLED
 void set_mmcfg_region(struct pci_mmcfg_region *region)
 {
-	phys_pci_mmcfg = *region;
+	phys_pci_mmcfg[0] = *region;
+}
+
+void add_mmcfg_region(const struct pci_mmcfg_region *region)
+{
+	if (num_pci_mmcfg < PCI_MMCFG_REGION_NUM) {
+		phys_pci_mmcfg[num_pci_mmcfg] = *region;
+		num_pci_mmcfg++;
+	} else {
+		pr_err("%s: out of ECAM region slots, bus %x-%x dropped",
+			__func__, region->start_bus, region->end_bus);
+	}
 }
 #endif
 
 struct pci_mmcfg_region *get_mmcfg_region(void)
 {
-	return &phys_pci_mmcfg;
+	return &phys_pci_mmcfg[0];
 }
 
 #if defined(HV_DEBUG)
@@ -162,11 +195,14 @@ static const struct pci_cfg_ops pci_pio_cfg_ops = {
 
 /*
  * @pre offset < 0x1000U
- * @pre phys_pci_mmcfg.address 4K-byte alignment
+ * @pre region != NULL
+ * @pre region->address 4K-byte alignment
  */
-static inline uint32_t mmcfg_off_to_address(union pci_bdf bdf, uint32_t offset)
+static inline uint64_t mmcfg_off_to_address(const struct pci_mmcfg_region *region,
+		union pci_bdf bdf, uint32_t offset)
 {
-	return (uint32_t)phys_pci_mmcfg.address + (((uint32_t)bdf.value << 12U) | offset);
+	return region->address + ((((uint32_t)bdf.bits.b - region->start_bus) << 20U) |
+			((uint32_t)bdf.bits.d << 15U) | ((uint32_t)bdf.bits.f << 12U) | offset);
 }
 
 /*
@@ -177,23 +213,26 @@ static inline uint32_t mmcfg_off_to_address(union pci_bdf bdf, uint32_t offset)
  */
 static uint32_t pci_mmcfg_read_cfg(union pci_bdf bdf, uint32_t offset, uint32_t bytes)
 {
-	uint32_t addr = mmcfg_off_to_address(bdf, offset);
-	void *hva = hpa2hva(addr);
-	uint32_t val;
-
+	const struct pci_mmcfg_region *region = bus_to_mmcfg_region(bdf.bits.b);
+	void *hva;
+	uint32_t val = ~0U;
 
 	ASSERT(pci_is_valid_access(offset, bytes), "the offset should be aligned with 2/4 byte\n");
 
-	switch (bytes) {
-	case 1U:
-		val = (uint32_t)mmio_read8(hva);
-		break;
-	case 2U:
-		val = (uint32_t)mmio_read16(hva);
-		break;
-	default:
-		val = mmio_read32(hva);
-		break;
+	if (region != NULL) {
+		hva = hpa2hva(mmcfg_off_to_address(region, bdf, offset));
+
+		switch (bytes) {
+		case 1U:
+			val = (uint32_t)mmio_read8(hva);
+			break;
+		case 2U:
+			val = (uint32_t)mmio_read16(hva);
+			break;
+		default:
+			val = mmio_read32(hva);
+			break;
+		}
 	}
 
 	return val;
@@ -207,20 +246,25 @@ static uint32_t pci_mmcfg_read_cfg(union pci_bdf bdf, uint32_t offset, uint32_t
  */
 static void pci_mmcfg_write_cfg(union pci_bdf bdf, uint32_t offset, uint32_t bytes, uint32_t val)
 {
-	uint32_t addr = mmcfg_off_to_address(bdf, offset);
-	void *hva = hpa2hva(addr);
+	const struct pci_mmcfg_region *region = bus_to_mmcfg_region(bdf.bits.b);
+	void *hva;
 
 	ASSERT(pci_is_valid_access(offset, bytes), "the offset should be aligned with 2/4 byte\n");
-	switch (bytes) {
-	case 1U:
-		mmio_write8((uint8_t)val, hva);
-		break;
-	case 2U:
-		mmio_write16((uint16_t)val, hva);
-		break;
-	default:
-		mmio_write32(val, hva);
-		break;
+
+	if (region != NULL) {
+		hva = hpa2hva(mmcfg_off_to_address(region, bdf, offset));
+
+		switch (bytes) {
+		case 1U:
+			mmio_write8((uint8_t)val, hva);
+			break;
+		case 2U:
+			mmio_write16((uint16_t)val, hva);
+			break;
+		default:
+			mmio_write32(val, hva);
+			break;
+		}
 	}
 }
 
@@ -303,17 +347,9 @@ void pdev_restore_bar(const struct pci_pdev *pdev)
 
 static const struct pci_pdev *pci_find_pdev(uint16_t pbdf)
 {
-	struct hlist_node *n;
-	const struct pci_pdev *found = NULL, *tmp;
+	uint16_t idx = pdev_index_by_bdf[pbdf];
 
-	hlist_for_each (n, &pdevs_hlist_heads[hash64(pbdf, PDEV_HLIST_HASHBITS)]) {
-		tmp = hlist_entry(n, struct pci_pdev, link);
-		if (pbdf == tmp->bdf.value) {
-			found = tmp;
-			break;
-		}
-	}
-	return found;
+	return (idx != PDEV_INDEX_INVALID) ? &pci_pdevs[idx] : NULL;
 }
 
 /* @brief: Find the DRHD index corresponding to a PCI device
@@ -435,6 +471,34 @@ static uint32_t pci_check_override_drhd_index(union pci_bdf pbdf,
  * capabilities) before using this pdev, it needs to use the pdev to initialize a per VM device
  * configuration(acrn_vm_pci_dev_config), call init_one_dev_config or init_all_dev_config to do this.
  */
+/*
+ * Check whether a bridge can have devices behind it before queueing its
+ * secondary bus for a full slot/function probe. Root ports and downstream
+ * switch ports with a slot implemented report hot-plug style presence detect
+ * in the slot status register; when no card is present the 32x8 config reads
+ * on the secondary bus would all come back as master aborts, so skip the bus
+ * entirely. Bridges without the PCIe capability or without a slot (internal
+ * or soldered-down topologies) are always walked.
+ */
+static bool bridge_may_have_devices(const struct pci_pdev *pdev)
+{
+	bool ret = true;
+	uint16_t flags, slotsts, pcie_dev_type;
+
+	if (pdev->pcie_capoff != 0x00UL) {
+		flags = (uint16_t)pci_pdev_read_cfg(pdev->bdf, pdev->pcie_capoff + PCIER_FLAGS, 2U);
+		pcie_dev_type = (flags & PCIEM_FLAGS_TYPE) >> 4;
+
+		if (((pcie_dev_type == PCIEM_TYPE_ROOTPORT) || (pcie_dev_type == PCIEM_TYPE_DOWNPORT))
+				&& ((flags & PCIEM_FLAGS_SLOT) != 0U)) {
+			slotsts = (uint16_t)pci_pdev_read_cfg(pdev->bdf,
+					pdev->pcie_capoff + PCIR_PCIE_SLOTSTS, 2U);
+			ret = ((slotsts & PCIM_PCIE_SLOTSTS_PDS) != 0U);
+		}
+	}
+	return ret;
+}
+
 static void scan_pci_hierarchy(uint8_t bus, uint64_t buses_visited[BUSES_BITMAP_LEN],
 		const struct pci_bdf_mapping_group *const bdfs_from_drhds, uint32_t drhd_index)
 {
@@ -460,7 +524,7 @@ static void scan_pci_hierarchy(uint8_t bus, uint64_t buses_visited[BUSES_BITMAP_
 					&buses_visited[current_bus_index >> 6U]);
 
 		pbdf.bits.b = current_bus_index;
-		if ((pbdf.bits.b < phys_pci_mmcfg.start_bus) || (pbdf.bits.b > phys_pci_mmcfg.end_bus)) {
+		if (bus_to_mmcfg_region(current_bus_index) == NULL) {
 			continue;
 		}
 
@@ -487,7 +551,7 @@ static void scan_pci_hierarchy(uint8_t bus, uint64_t buses_visited[BUSES_BITMAP_
 									current_drhd_index);
 				pdev = pci_init_pdev(pbdf, bdf_drhd_index);
 				/* NOTE: This touch logic change: if a bridge own by HV as its children */
-				if ((pdev != NULL) && is_bridge(pdev)) {
+				if ((pdev != NULL) && is_bridge(pdev) && bridge_may_have_devices(pdev)) {
 					bus_map[e].bus_under_scan =
 						(uint8_t)pci_pdev_read_cfg(pbdf, PCIR_SECBUS_1, 1U);
 					bus_map[e].bus_drhd_index = bdf_drhd_index;
@@ -649,9 +713,14 @@ void init_pci_pdev_list(void)
 	struct pci_bdf_mapping_group bdfs_from_drhds = {.pci_bdf_map_count = 0U};
 	uint32_t drhd_idx_pci_all = INVALID_DRHD_INDEX;
 	uint16_t bus;
+	uint32_t i;
 	bool was_visited = false;
 
-	set_paging_supervisor(phys_pci_mmcfg.address, get_pci_mmcfg_size(&phys_pci_mmcfg));
+	(void)memset(pdev_index_by_bdf, 0xFFU, sizeof(pdev_index_by_bdf));
+
+	for (i = 0U; i < num_pci_mmcfg; i++) {
+		set_paging_supervisor(phys_pci_mmcfg[i].address, get_pci_mmcfg_size(&phys_pci_mmcfg[i]));
+	}
 
 	pci_parse_iommu_devscopes(&bdfs_from_drhds, &drhd_idx_pci_all);
 
@@ -888,17 +957,18 @@ struct pci_pdev *pci_init_pdev(union pci_bdf bdf, uint32_t drhd_index)
 			}
 
 #if (PRE_VM_NUM != 0U)
-			/* HV owned pdev: 1.typ1 pdev if pre-launched VM exist; 2.pci debug uart */
-			is_hv_owned = (hdr_layout == PCIM_HDRTYPE_BRIDGE) || is_pci_dbg_uart(bdf);
+			/* HV owned pdev: 1.typ1 pdev if pre-launched VM exist; 2.pci debug uart; 3.CBDMA engine */
+			is_hv_owned = (hdr_layout == PCIM_HDRTYPE_BRIDGE) || is_pci_dbg_uart(bdf)
+					|| is_dmacpy_pdev(bdf);
 #else
-			/* HV owned pdev: 1.pci debug uart */
-			is_hv_owned = is_pci_dbg_uart(bdf);
+			/* HV owned pdev: 1.pci debug uart; 2.CBDMA engine */
+			is_hv_owned = is_pci_dbg_uart(bdf) || is_dmacpy_pdev(bdf);
 #endif
 			if (is_hv_owned) {
 				hv_owned_pci_pdevs[num_hv_owned_pci_pdev] = pdev;
 				num_hv_owned_pci_pdev++;
 			}
-			hlist_add_head(&pdev->link, &pdevs_hlist_heads[hash64(bdf.value, PDEV_HLIST_HASHBITS)]);
+			pdev_index_by_bdf[bdf.value] = (uint16_t)num_pci_pdev;
 			pdev->drhd_index = drhd_index;
 			num_pci_pdev++;
 			reserve_vmsix_on_msi_irtes(pdev);
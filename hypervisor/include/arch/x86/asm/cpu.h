@@ -321,6 +321,7 @@ enum pcpu_boot_state {
 
 #define	NEED_OFFLINE		(1U)
 #define	NEED_SHUTDOWN_VM	(2U)
+#define	NEED_TEARDOWN_VM	(3U)
 void make_pcpu_offline(uint16_t pcpu_id);
 bool need_offline(uint16_t pcpu_id);
 
@@ -447,8 +448,13 @@ void dispatch_exception(struct intr_excp_ctx *ctx);
  */
 void handle_nmi(__unused struct intr_excp_ctx *ctx);
 
+/* per-pCPU idle wakeup-latency classes, see cpu_do_idle() */
+#define IDLE_CLASS_DEEP		0U	/* power optimized, deep mwait C-state allowed */
+#define IDLE_CLASS_SHALLOW	1U	/* latency critical, C1 only */
+
 /* Function prototypes */
 void cpu_do_idle(void);
+bool cpu_idle_mwait_armed(uint16_t pcpu_id);
 void cpu_dead(void);
 void trampoline_start16(void);
 void load_pcpu_state_data(void);
@@ -599,6 +605,11 @@ static inline void clflushopt(const volatile void *p)
 	asm volatile ("clflushopt (%0)" :: "r"(p));
 }
 
+static inline void prefetcht0(const volatile void *p)
+{
+	asm volatile ("prefetcht0 (%0)" :: "r"(p));
+}
+
 /* Write the task register */
 #define CPU_LTR_EXECUTE(ltr_ptr)                            \
 {                                                           \
@@ -51,8 +51,11 @@ bool is_apl_platform(void);
 bool is_apicv_advanced_feature_supported(void);
 bool pcpu_has_cap(uint32_t bit);
 bool pcpu_has_vmx_ept_vpid_cap(uint64_t bit_mask);
+bool is_ept_dirty_logging_supported(void);
 bool is_apl_platform(void);
 bool has_core_cap(uint32_t bit_mask);
+bool pcpus_share_llc(uint16_t pcpu_id1, uint16_t pcpu_id2);
+bool pcpus_are_smt_siblings(uint16_t pcpu_id1, uint16_t pcpu_id2);
 bool is_ac_enabled(void);
 bool is_gp_enabled(void);
 void init_pcpu_capabilities(void);
@@ -60,6 +63,53 @@ void init_pcpu_model_name(void);
 int32_t detect_hardware_support(void);
 struct cpuinfo_x86 *get_pcpu_info(void);
 
+/*
+ * Fixed-capability builds: on a locked-down platform the board
+ * configuration already knows the CPU feature set, so the hot
+ * capability tests need not read the probed feature words on every
+ * exit.
+ *
+ * pcpu_has_cap_const() is for call sites on the exit and
+ * context-switch paths which pass a literal feature bit: with
+ * CONFIG_FIXED_CAPS the switch below collapses to a compile-time
+ * constant and the branch it guards is folded away. Features outside
+ * the pledged list, and builds without CONFIG_FIXED_CAPS, fall back
+ * to the probed feature words. The pledge is cross-checked against
+ * the real silicon once in detect_hardware_support(), so a stale
+ * board file refuses to boot instead of mis-emulating.
+ */
+#ifdef CONFIG_FIXED_CAPS
+#include <asm/cpufeatures.h>
+#include <board_info.h>
+
+static inline bool pcpu_has_cap_const(uint32_t bit)
+{
+	bool ret;
+
+	switch (bit) {
+	case X86_FEATURE_XSAVE:
+		ret = (FIXED_CAP_XSAVE != 0U);
+		break;
+	case X86_FEATURE_XSAVES:
+		ret = (FIXED_CAP_XSAVES != 0U);
+		break;
+	case X86_FEATURE_WAITPKG:
+		ret = (FIXED_CAP_WAITPKG != 0U);
+		break;
+	case X86_FEATURE_KEYLOCKER:
+		ret = (FIXED_CAP_KEYLOCKER != 0U);
+		break;
+	default:
+		ret = pcpu_has_cap(bit);
+		break;
+	}
+
+	return ret;
+}
+#else
+#define pcpu_has_cap_const(bit)	pcpu_has_cap(bit)
+#endif
+
 /* The bits of MSR IA32_CORE_CAPABILITIES */
 #define CORE_CAP_SPLIT_LOCK    (1U << 5U)      /* support #AC for Split-locked Access */
 #define CORE_CAP_UC_LOCK       (1U << 4U)      /* support #GP for non-guaranteed-atomic-locked access at Non-WB memory */
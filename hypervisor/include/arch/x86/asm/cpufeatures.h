@@ -75,9 +75,11 @@
 #define X86_FEATURE_SMEP	((FEAT_7_0_EBX << 5U) +  7U)
 #define X86_FEATURE_ERMS	((FEAT_7_0_EBX << 5U) +  9U)
 #define X86_FEATURE_INVPCID	((FEAT_7_0_EBX << 5U) + 10U)
+#define X86_FEATURE_RDT_M	((FEAT_7_0_EBX << 5U) + 12U)
 #define X86_FEATURE_RDT_A	((FEAT_7_0_EBX << 5U) + 15U)
 #define X86_FEATURE_SMAP	((FEAT_7_0_EBX << 5U) + 20U)
 #define X86_FEATURE_CLFLUSHOPT	((FEAT_7_0_EBX << 5U) + 23U)
+#define X86_FEATURE_SHA_NI	((FEAT_7_0_EBX << 5U) + 29U)
 
 /* Intel-defined CPU features, CPUID level 0x00000007 (ECX)*/
 #define X86_FEATURE_WAITPKG	((FEAT_7_0_ECX << 5U) +  5U)
@@ -72,6 +72,8 @@
 #define CPUID_EDX_TM1           (1U<<29U)
 #define CPUID_EDX_IA64          (1U<<30U)
 #define CPUID_EDX_PBE           (1U<<31U)
+/* CPUID.06H:EAX.HWP */
+#define CPUID_EAX_HWP           (1U<<7U)
 /* CPUID.07H:EBX.FSGSBASE*/
 #define CPUID_EBX_FSGSBASE      (1U<<0U)
 /* CPUID.07H:EBX.TSC_ADJUST*/
@@ -142,8 +144,12 @@
 #define CPUID_FEATURES          1U
 #define CPUID_TLB               2U
 #define CPUID_SERIALNUM         3U
+#define CPUID_CACHE_PARAMS      4U
+#define CPUID_THERMAL_POWER     6U
 #define CPUID_EXTEND_FEATURE    7U
+#define CPUID_EXTEND_TOPOLOGY   0xBU
 #define CPUID_XSAVE_FEATURES   0xDU
+#define CPUID_RDT_MONITORING   0xFU
 #define CPUID_RDT_ALLOCATION   0x10U
 #define CPUID_MAX_EXTENDED_FUNCTION  0x80000000U
 #define CPUID_EXTEND_FUNCTION_1      0x80000001U
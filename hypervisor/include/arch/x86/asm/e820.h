@@ -18,6 +18,9 @@
 
 #define E820_MAX_ENTRIES	64U
 
+/* maximum number of SRAT proximity domains tracked for page pool placement */
+#define MAX_NUMA_NODES		8U
+
 /** Defines a single entry in an E820 memory map. */
 struct e820_entry {
    /** The base address of the memory range. */
@@ -38,6 +41,12 @@ struct mem_range {
 void init_e820(void);
 
 uint64_t e820_alloc_memory(uint64_t size_arg, uint64_t max_addr);
+/* like e820_alloc_memory, but prefer RAM on the NUMA node of the pCPUs in cpu_affinity */
+uint64_t e820_alloc_memory_by_affinity(uint64_t size_arg, uint64_t cpu_affinity);
+/* reserve the warm-reset persistent flight recorder region below 4G */
+uint64_t e820_alloc_flight_recorder(uint64_t size_arg);
+/* build the pCPU-to-memory-node affinity from the ACPI SRAT, BSP only */
+void init_numa_nodes(void);
 uint64_t get_e820_ram_size(void);
 /* get total number of the e820 entries */
 uint32_t get_e820_entries_count(void);
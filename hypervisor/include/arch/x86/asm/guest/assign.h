@@ -87,6 +87,21 @@ int32_t ptirq_prepare_msix_remap(struct acrn_vm *vm, uint16_t virt_bdf,  uint16_
  */
 int32_t ptirq_intx_pin_remap(struct acrn_vm *vm, uint32_t virt_gsi, enum intx_ctlr vgsi_ctlr);
 
+/**
+ * @brief Refresh the physical destination of a remapping entry.
+ *
+ * Re-derives the destination from the current vCPU-to-pCPU placement and
+ * rewrites the entry's IRTE (for MSI) or physical IOAPIC RTE (for INTx),
+ * so the interrupt follows a migrated vCPU. Entries that cannot be
+ * retargeted without touching device registers are left unchanged.
+ *
+ * @param[in] entry pointer to the remapping entry to refresh
+ *
+ * @pre entry != NULL
+ *
+ */
+void ptirq_update_entry_dest(struct ptirq_remapping_info *entry);
+
 /**
  * @brief Add an interrupt remapping entry for INTx as pre-hold mapping.
  *
@@ -88,6 +88,40 @@ uint64_t service_vm_hpa2gpa(uint64_t hpa);
  */
 void ept_add_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
 		uint64_t gpa, uint64_t size, uint64_t prot_orig);
+/**
+ * @brief Batched variants of the region update APIs
+ *
+ * The caller holds vm->ept_lock across the whole batch and invokes
+ * ept_flush_guest() once after the last update, so that N regions cost one
+ * lock acquisition and one guest TLB invalidation instead of N.
+ */
+void ept_add_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
+		uint64_t gpa, uint64_t size, uint64_t prot_orig);
+void ept_del_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size);
+void ept_modify_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size,
+		uint64_t prot_set, uint64_t prot_clr);
+void ept_promote_mr_locked(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size);
+/**
+ * @brief Request an EPT translation flush on all vCPUs of the VM
+ */
+void ept_flush_guest(struct acrn_vm *vm);
+/**
+ * @brief Clear the dirty flags of all present EPT leaf entries, re-arming
+ *        PML based dirty-page tracking
+ */
+void ept_clear_dirty(struct acrn_vm *vm);
+/**
+ * @brief Promote fully-populated 2 MiB runs into 1 GiB EPT mappings
+ *
+ * @param[in] vm the pointer that points to VM data structure
+ * @param[in] pml4_page The physical address of The EPTP
+ * @param[in] gpa The specified start guest physical address of guest
+ *            physical memory region to be scanned for promotion
+ * @param[in] size The size of guest physical memory region
+ *
+ * @return None
+ */
+void ept_promote_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size);
 /**
  * @brief Guest-physical memory page access right or memory type updating
  *
@@ -165,5 +199,21 @@ void walk_ept_table(struct acrn_vm *vm, pge_handler cb);
 int32_t ept_misconfig_vmexit_handler(__unused struct acrn_vcpu *vcpu);
 
 void init_ept_pgtable(struct pgtable *table, uint16_t vm_id);
+
+/**
+ * @brief Report EPT page pool utilization of a VM
+ *
+ * Returns the current, peak and total number of pagetable pages of the
+ * VM's EPT pool, for the stats page and the 'poolstat' shell command.
+ *
+ * @param[in] vm_id the VM the pool belongs to
+ * @param[out] used pages currently allocated
+ * @param[out] max_used peak of used since boot
+ * @param[out] total pool capacity in pages
+ *
+ * @pre vm_id < CONFIG_MAX_VM_NUM
+ * @pre (used != NULL) && (max_used != NULL) && (total != NULL)
+ */
+void get_ept_pool_stats(uint16_t vm_id, uint32_t *used, uint32_t *max_used, uint32_t *total);
 void reserve_buffer_for_ept_pages(void);
 #endif /* EPT_H */
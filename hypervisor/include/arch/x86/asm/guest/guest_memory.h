@@ -80,6 +80,63 @@ int32_t copy_from_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t gpa, uint32_t si
  * @pre Pointer vm is non-NULL
  */
 int32_t copy_to_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t gpa, uint32_t size);
+/**
+ * @brief One buffer of a vectored GPA copy
+ */
+struct gpa_iovec {
+	void *h_ptr;	/**< start HV address of the HV-side buffer */
+	uint64_t gpa;	/**< start GPA address of the guest-side buffer */
+	uint32_t size;	/**< length of the buffer in bytes */
+};
+/**
+ * @brief Copy a batch of buffers between VM GPA space and HV address space
+ *
+ * Each entry obeys the same GPA continuity requirements as copy_from_gpa()
+ * and copy_to_gpa(); the batch stops at the first failing entry.
+ *
+ * @param[in] vm The pointer that points to VM data structure
+ * @param[in] iov The list of buffers to copy
+ * @param[in] iovcnt The number of entries in \p iov
+ * @param[in] cp_from_vm Copy from the VM into HV buffers if true,
+ *                       from HV buffers into the VM otherwise
+ *
+ * @pre Pointer vm is non-NULL, pointer iov is non-NULL
+ */
+int32_t copy_gpa_vectored(struct acrn_vm *vm, const struct gpa_iovec *iov,
+	uint32_t iovcnt, bool cp_from_vm);
+/**
+ * @brief Cache the GPA->HVA translation of a stable hypercall argument buffer
+ *
+ * Subsequent copy_from_gpa()/copy_to_gpa() calls whose range falls inside
+ * the pinned region use the cached translation instead of walking the EPT.
+ *
+ * @param[in] vm The pointer that points to VM data structure
+ * @param[in] gpa Page-aligned guest-physical base of the region
+ * @param[in] size Size of the region in bytes; the region must be
+ *                 physically contiguous
+ * @param[out] handle Slot handle identifying the pinned region
+ *
+ * @retval 0 on success, -EINVAL on a bad or non-contiguous region,
+ *         -ENOSPC when all pin slots are in use
+ *
+ * @pre Pointer vm is non-NULL, pointer handle is non-NULL
+ */
+int32_t pin_hc_buffer(struct acrn_vm *vm, uint64_t gpa, uint64_t size, uint32_t *handle);
+/**
+ * @brief Drop the cached translation identified by a pin handle
+ *
+ * @pre Pointer vm is non-NULL
+ */
+int32_t unpin_hc_buffer(struct acrn_vm *vm, uint32_t handle);
+/**
+ * @brief Drop cached translations overlapping a mutated GPA range
+ *
+ * Called from the EPT mutation paths so a pinned buffer never outlives
+ * the mapping it was translated under.
+ *
+ * @pre Pointer vm is non-NULL
+ */
+void invalidate_pinned_hc_buffers(struct acrn_vm *vm, uint64_t gpa, uint64_t size);
 /**
  * @brief Copy data from VM GVA space to HV address space
  *
@@ -57,6 +57,7 @@ struct acrn_hyperv {
 	uint64_t			tsc_offset;
 };
 
+int32_t hyperv_hypercall(struct acrn_vcpu *vcpu);
 int32_t hyperv_wrmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t wval);
 int32_t hyperv_rdmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t *rval);
 void hyperv_init_time(struct acrn_vm *vm);
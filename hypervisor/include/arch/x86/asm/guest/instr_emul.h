@@ -80,14 +80,37 @@ struct instr_emul_vie {
 	uint8_t		decoded;	/* set to 1 if successfully decoded */
 
 	uint8_t		opcode;
+	uint8_t		two_byte;	/* set to 1 for a 0x0F-prefixed opcode */
 	struct instr_emul_vie_op	op;			/* opcode description */
 
 	uint64_t	dst_gpa;	/* saved dst operand gpa. Only for movs */
 	uint64_t	gva;		/* saved gva for instruction emulation */
 };
 
+/*
+ * Per-vCPU direct-mapped cache of instruction decode results, keyed by
+ * (CR3, RIP, instruction length, CPU mode). The MMIO accessors of guest
+ * drivers execute the same handful of instructions millions of times, so
+ * caching skips both the guest memory fetch of the opcode bytes and the
+ * decode itself. Keying on the full CR3 value lets an address-space
+ * switch invalidate stale entries implicitly.
+ */
+#define INSTR_EMUL_CACHE_ENTRIES	64U
+
+struct instr_emul_cache_entry {
+	uint64_t cr3;
+	uint64_t rip;
+	uint32_t inst_len;
+	uint8_t cpu_mode;	/* enum vm_cpu_mode */
+	uint8_t direction;	/* ACRN_IOREQ_DIR_* implied by the decode */
+	bool cs_d;
+	bool valid;
+	struct instr_emul_vie vie;
+};
+
 struct instr_emul_ctxt {
 	struct instr_emul_vie vie;
+	struct instr_emul_cache_entry cache[INSTR_EMUL_CACHE_ENTRIES];
 };
 
 int32_t emulate_instruction(struct acrn_vcpu *vcpu);
@@ -330,13 +330,33 @@ int32_t vmlaunch_vmexit_handler(struct acrn_vcpu *vcpu);
 int32_t invvpid_vmexit_handler(struct acrn_vcpu *vcpu);
 
 #ifdef CONFIG_NVMX_ENABLED
+/*
+ * Dirty classes of the VMCS12 fields that are not hardware-shadowed.
+ * Trapped VMWRITEs from L1 are classified into these groups so that the
+ * VM-entry/VM-exit emulation paths merge only the groups L1 has written
+ * since the last sync, instead of reloading the full state every time.
+ */
+#define NVMX_DIRTY_MSR_BITMAP		(1U << 0U)
+#define NVMX_DIRTY_EPT_POINTER		(1U << 1U)
+#define NVMX_DIRTY_VPID			(1U << 2U)
+#define NVMX_DIRTY_ENTRY_CTLS		(1U << 3U)
+#define NVMX_DIRTY_EXIT_CTLS		(1U << 4U)
+#define NVMX_DIRTY_HOST_CTL_REGS	(1U << 5U)	/* host CR0/CR3/CR4 */
+#define NVMX_DIRTY_HOST_SYSENTER	(1U << 6U)	/* host IA32_SYSENTER_CS/ESP/EIP */
+#define NVMX_DIRTY_HOST_EFER		(1U << 7U)
+#define NVMX_DIRTY_HOST_SEGMENTS	(1U << 8U)	/* host selectors and segment bases */
+
+#define NVMX_DIRTY_CONTROL_FIELDS	(NVMX_DIRTY_MSR_BITMAP | NVMX_DIRTY_EPT_POINTER \
+					| NVMX_DIRTY_VPID | NVMX_DIRTY_ENTRY_CTLS | NVMX_DIRTY_EXIT_CTLS)
+#define NVMX_DIRTY_HOST_STATE		(NVMX_DIRTY_HOST_CTL_REGS | NVMX_DIRTY_HOST_SYSENTER \
+					| NVMX_DIRTY_HOST_EFER | NVMX_DIRTY_HOST_SEGMENTS)
+
 struct acrn_vvmcs {
 	uint8_t vmcs02[PAGE_SIZE];	/* VMCS to run L2 and as Link Pointer in VMCS01 */
 	struct acrn_vmcs12 vmcs12;	/* To cache L1's VMCS12*/
 	uint64_t vmcs12_gpa;            /* The corresponding L1 GPA for this VMCS12 */
 	uint32_t ref_cnt;		/* Count of being VMPTRLDed without VMCLEARed */
-	bool host_state_dirty;		/* To indicate need to merge VMCS12 host-state fields to VMCS01 */
-	bool control_fields_dirty;	/* For all other non-host-state fields that need to be merged */
+	uint32_t dirty_fields;		/* NVMX_DIRTY_* classes to be merged to VMCS01/VMCS02 */
 } __aligned(PAGE_SIZE);
 
 #define MAX_ACTIVE_VVMCS_NUM	4
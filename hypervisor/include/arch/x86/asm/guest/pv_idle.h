@@ -0,0 +1,26 @@
+/*
+ * ACRN paravirtualized idle coordination.
+ *
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PV_IDLE_H
+#define PV_IDLE_H
+
+#include <types.h>
+
+struct acrn_vcpu;
+
+/* bit 1 of CPUID.0x40000001:EAX, the PV idle MSR below is available */
+#define ACRN_CPUID_CAP_PV_IDLE		(1U << 1U)
+
+/* guest writes GPA of an acrn_pv_idle_info with bit 0 set to enable */
+#define ACRN_MSR_PV_IDLE		0x40000201U
+#define ACRN_PV_IDLE_ENABLE		(1UL << 0U)
+
+void pv_idle_msr_write(struct acrn_vcpu *vcpu, uint64_t val);
+bool pv_idle_guest_polling(const struct acrn_vcpu *vcpu);
+
+#endif /* PV_IDLE_H */
@@ -0,0 +1,26 @@
+/*
+ * ACRN paravirtualized MSR shadow page.
+ *
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PV_MSR_H
+#define PV_MSR_H
+
+#include <types.h>
+
+struct acrn_vcpu;
+
+/* bit 2 of CPUID.0x40000001:EAX, the PV MSR shadow MSR below is available */
+#define ACRN_CPUID_CAP_PV_MSR		(1U << 2U)
+
+/* guest writes GPA of an acrn_pv_msr_page with bit 0 set to enable */
+#define ACRN_MSR_PV_MSR			0x40000202U
+#define ACRN_PV_MSR_ENABLE		(1UL << 0U)
+
+void pv_msr_msr_write(struct acrn_vcpu *vcpu, uint64_t val);
+void pv_msr_update_page(struct acrn_vcpu *vcpu);
+
+#endif /* PV_MSR_H */
@@ -0,0 +1,26 @@
+/*
+ * ACRN paravirtualized clock.
+ *
+ * Copyright (C) 2023 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef PVCLOCK_H
+#define PVCLOCK_H
+
+#include <types.h>
+
+struct acrn_vcpu;
+
+/* bit 0 of CPUID.0x40000001:EAX, the PV clock MSR below is available */
+#define ACRN_CPUID_CAP_PVCLOCK		(1U << 0U)
+
+/* guest writes GPA of an acrn_pvclock_vcpu_time_info with bit 0 set to enable */
+#define ACRN_MSR_PVCLOCK		0x40000200U
+#define ACRN_PVCLOCK_ENABLE		(1UL << 0U)
+
+void pvclock_msr_write(struct acrn_vcpu *vcpu, uint64_t val);
+void pvclock_update_page(struct acrn_vcpu *vcpu);
+
+#endif /* PVCLOCK_H */
@@ -21,6 +21,7 @@
 #include <asm/guest/virtual_cr.h>
 #include <asm/guest/vlapic.h>
 #include <asm/guest/vmtrr.h>
+#include <asm/guest/vpmu.h>
 #include <schedule.h>
 #include <event.h>
 #include <io_req.h>
@@ -105,6 +106,16 @@
  */
 #define ACRN_REQUEST_SPLIT_LOCK			10U
 
+/**
+ * @brief Request for syncing the PML dirty-page tracking VMCS state
+ */
+#define ACRN_REQUEST_DIRTY_TRACK		11U
+
+/**
+ * @brief Request for rebuilding the VMCS host state after pCPU migration
+ */
+#define ACRN_REQUEST_INIT_HOST_STATE		12U
+
 /**
  * @}
  */
@@ -197,6 +208,38 @@ enum reset_mode;
 
 #define EOI_EXIT_BITMAP_SIZE	256U
 
+/* number of 64-bit GPA entries in the 4K PML (Page-Modification Logging) buffer */
+#define PML_LOG_ENTRIES		512U
+
+/*
+ * According to "SDM APPENDIX C VMX BASIC EXIT REASONS",
+ * the largest basic exit reason handled is 74 (bus lock).
+ */
+#define NR_VMX_EXIT_REASONS	75U
+
+/* log2 TSC-cycle buckets: bucket n holds exits whose handler took [2^n, 2^(n+1)) cycles */
+#define VMEXIT_HIST_NR_BUCKETS	32U
+
+struct vmexit_stat {
+	uint64_t count;
+	uint64_t total_cycles;
+	uint32_t hist[VMEXIT_HIST_NR_BUCKETS];
+};
+
+/* per-vCPU table of intercepted MSR access counts, slots are claimed on
+ * first access; once it is full the last slot aggregates the rest under
+ * the MSR_EXIT_STATS_OTHER pseudo MSR
+ */
+#define MSR_EXIT_STATS_ENTRIES	24U
+#define MSR_EXIT_STATS_OTHER	0xFFFFFFFFU
+
+struct msr_exit_stat {
+	uint32_t msr;
+	uint32_t passthrough;	/* set once auto-passthrough flipped the MSR bitmap */
+	uint64_t rd_count;
+	uint64_t wr_count;
+};
+
 struct guest_cpu_context {
 	struct run_context run_ctx;
 	struct ext_context ext_ctx;
@@ -218,6 +261,7 @@ struct msr_store_area {
 	struct msr_store_entry guest[MSR_AREA_COUNT];
 	struct msr_store_entry host[MSR_AREA_COUNT];
 	uint32_t index_of_pqr_assoc;
+	uint32_t index_of_perf_global_ctrl;
 	uint32_t count;	/* actual count of entries to be loaded/restored during VMEntry/VMExit */
 };
 
@@ -228,6 +272,20 @@ struct iwkey {
 	uint64_t integrity_key[2];
 };
 
+#define GVA_CACHE_SIZE	4U
+
+/* one successfully walked guest page, keyed by the paging mode and access
+ * attributes the walk was performed under; valid only while gen matches
+ * the vCPU's gva_cache_gen, see gva2gpa()
+ */
+struct gva_cache_entry {
+	uint64_t gva_page;
+	uint64_t gpa_page;
+	uint64_t gen;
+	uint32_t access_key;
+	uint32_t reserved;
+};
+
 struct acrn_vcpu_arch {
 	/* vmcs region for this vcpu, MUST be 4KB-aligned. This is VMCS01 when nested VMX is enabled */
 	uint8_t vmcs[PAGE_SIZE];
@@ -246,6 +304,22 @@ struct acrn_vcpu_arch {
 
 	struct acrn_vmtrr vmtrr;
 
+	/* vPMU: guest counter state (GUEST_FLAG_VPMU) */
+	struct acrn_vpmu vpmu;
+
+	/* PV clock: guest-programmed MSR value and mapped time page */
+	uint64_t pvclock_msr;
+	struct acrn_pvclock_vcpu_time_info *pvclock_page;
+
+	/* PV idle coordination: guest-programmed MSR value and mapped flag page */
+	uint64_t pv_idle_msr;
+	struct acrn_pv_idle_info *pv_idle_page;
+
+	/* PV MSR shadow: guest-programmed MSR value, mapped page, last refresh TSC */
+	uint64_t pv_msr_msr;
+	struct acrn_pv_msr_page *pv_msr_page;
+	uint64_t pv_msr_last_refresh;
+
 	int32_t cur_context;
 	struct guest_cpu_context contexts[NR_WORLD];
 
@@ -269,6 +343,15 @@ struct acrn_vcpu_arch {
 	bool emulating_lock;
 	bool xsave_enabled;
 
+	/* gva->gpa translation cache; the generation is bumped on every VM
+	 * exit, so entries never outlive one emulation and guest-side CR3
+	 * writes, INVLPG and remote PTE updates all take effect no later
+	 * than they would against the hardware TLB
+	 */
+	struct gva_cache_entry gva_cache[GVA_CACHE_SIZE];
+	uint64_t gva_cache_gen;
+	uint32_t gva_cache_next;
+
 	/* VCPU context state information */
 	uint32_t exit_reason;
 	uint32_t idt_vectoring_info;
@@ -320,7 +403,49 @@ struct acrn_vcpu {
 	uint64_t reg_cached;
 	uint64_t reg_updated;
 
+	/* index of the last vm->vcpuid_entries hit, CPUID exits tend to
+	 * re-query the same leaf so try it before searching the table
+	 */
+	uint32_t vcpuid_last_idx;
+
+	/* per-exit-reason handler latency accounting, updated on every VM exit */
+	struct vmexit_stat vmexit_stats[NR_VMX_EXIT_REASONS];
+
+	/* which intercepted MSRs actually fire, updated on every MSR exit */
+	struct msr_exit_stat msr_exit_stats[MSR_EXIT_STATS_ENTRIES];
+
+	/* when this vCPU last published its slot of the VM stats page */
+	uint64_t stats_publish_tsc;
+
+	/* adaptive halt-polling window in TSC cycles, 0 means block immediately */
+	uint64_t halt_poll_cycles;
+
+	/* exit-storm monitor, see vmexit_storm_check() */
+	uint64_t storm_window_start;	/* TSC when the current sampling window began */
+	uint32_t storm_window_exits;	/* VM exits in the current window */
+	uint32_t storm_ewma;		/* EWMA of exits per window */
+	uint32_t storm_yield_cnt;	/* exits while a storm is active, for rate-limited yields */
+	bool storm_active;
+
+	/* heartbeat maintained by vcpu_thread(), see vcpu_watchdog.c */
+	uint64_t hb_exit_cnt;		/* exits serviced by the vcpu thread */
+	uint64_t hb_inst_retired;	/* last INST_RETIRED.ANY sample */
+	uint64_t hb_sample_tsc;		/* when hb_inst_retired was sampled */
+	uint64_t hb_ioreq_start_tsc;	/* ioreq handed to the DM, 0 when none */
+
+	/* stall-detector state, written only by the watchdog timer */
+	uint64_t wdt_seen_exit_cnt;
+	uint64_t wdt_seen_inst_retired;
+	uint32_t wdt_stall_ticks;
+	bool wdt_probed;
+	bool wdt_reported;
+
 	struct sched_event events[VCPU_EVENT_NUM];
+
+	/* PML buffer the CPU logs dirtied guest-physical addresses into while
+	 * dirty-page tracking of the VM is active
+	 */
+	uint64_t pml_log[PML_LOG_ENTRIES] __aligned(PAGE_SIZE);
 } __aligned(PAGE_SIZE);
 
 struct vcpu_dump {
@@ -356,6 +481,12 @@ static inline struct acrn_vlapic *vcpu_vlapic(struct acrn_vcpu *vcpu)
 	return &(vcpu->arch.vlapic);
 }
 
+/* drop all cached gva->gpa translations of the vCPU at once */
+static inline void vcpu_invalidate_gva_cache(struct acrn_vcpu *vcpu)
+{
+	vcpu->arch.gva_cache_gen++;
+}
+
 /**
  * @brief Get pointer to PI description.
  *
@@ -585,6 +716,20 @@ void set_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_regs *vcpu_regs);
  */
 void reset_vcpu_regs(struct acrn_vcpu *vcpu, enum reset_mode mode);
 
+/**
+ * @brief snapshot all the vcpu registers
+ *
+ * Read target vCPU's registers back into the acrn_regs layout accepted by
+ * set_vcpu_regs, on the pCPU currently owning the vCPU's VMCS. The caller
+ * must ensure the target vCPU is not running (e.g. the VM is paused).
+ *
+ * @param[inout] vcpu pointer to vcpu data structure
+ * @param[out] vcpu_regs buffer receiving all the registers' value
+ *
+ * @return None
+ */
+void vcpu_snapshot_regs(struct acrn_vcpu *vcpu, struct acrn_regs *vcpu_regs);
+
 bool sanitize_cr0_cr4_pattern(void);
 
 /**
@@ -720,6 +865,18 @@ void launch_vcpu(struct acrn_vcpu *vcpu);
  */
 void kick_vcpu(struct acrn_vcpu *vcpu);
 
+/**
+ * @brief Kick all vCPUs of a VM.
+ *
+ * Kick every launched vCPU of the VM to handle its pending events, using a
+ * single multicast IPI round instead of one IPI per vCPU.
+ *
+ * @param[in] vm pointer to vm data structure
+ *
+ * @return None
+ */
+void kick_vcpus(struct acrn_vm *vm);
+
 /**
  * @brief create a vcpu for the vm and mapped to the pcpu.
  *
@@ -733,6 +890,20 @@ void kick_vcpu(struct acrn_vcpu *vcpu);
  */
 int32_t prepare_vcpu(struct acrn_vm *vm, uint16_t pcpu_id);
 
+/**
+ * @brief hot-add a vcpu to a created or running vm.
+ *
+ * Materialize the next free vcpu_array slot on the given pcpu; the new
+ * vcpu stays offline until the guest BSP onlines it with INIT-SIPI.
+ *
+ * @param[inout] vm pointer to vm data structure
+ * @param[in] pcpu_id which the new vcpu will be mapped
+ *
+ * @retval 0 on success
+ * @retval -1 if the vm state, pcpu or vcpu slots do not allow hot-add
+ */
+int32_t hotadd_vcpu(struct acrn_vm *vm, uint16_t pcpu_id);
+
 /**
  * @brief get physical destination cpu mask
  *
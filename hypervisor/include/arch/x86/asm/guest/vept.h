@@ -36,6 +36,13 @@ struct vept_desc {
 	 */
 	uint64_t shadow_eptp;
 	uint32_t ref_count;
+	/*
+	 * Invalidation epoch of the cached shadow EPT.
+	 * Bumped on every emulated INVEPT which hits this guest EPTP, so the
+	 * debug log can tell translations surviving a re-validation apart
+	 * from ones built before it.
+	 */
+	uint64_t generation;
 };
 
 void init_vept(void);
@@ -71,6 +71,20 @@ struct acrn_vlapic {
 	 */
 	uint32_t	isrv;
 
+	/*
+	 * irr_smry/isr_smry: summary bitmaps over the IRR/ISR registers in
+	 * 'apic_page'; bit i is set when irr[i].v/isr[i].v may hold pending
+	 * bits, so the injection hot path inspects one 32-bit word instead
+	 * of walking eight 16-byte strided registers.
+	 * They are only maintained on the software injection path: when
+	 * APICv virtual interrupt delivery is enabled the hardware updates
+	 * vIRR/vISR without touching them. irr_smry is updated with locked
+	 * operations since remote vCPUs deliver interrupts concurrently;
+	 * isr_smry is only accessed by the owning vCPU.
+	 */
+	uint32_t	irr_smry;
+	uint32_t	isr_smry;
+
 	uint64_t	msr_apicbase;
 
 	const struct acrn_apicv_ops *ops;
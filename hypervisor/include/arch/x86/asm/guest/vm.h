@@ -11,6 +11,10 @@
 #define VM_RESUME		0
 #define VM_LAUNCH		1
 
+/* Max number of coalesced MMIO doorbell ranges per VM */
+#define MAX_WC_MMIO_RANGES	8U
+#define MAX_PINNED_HC_BUF_NUM	8U
+
 #ifndef ASSEMBLER
 
 #include <asm/lib/bits.h>
@@ -88,6 +92,7 @@ enum vm_state {
 	VM_RUNNING,	/* VM running */
 	VM_READY_TO_POWEROFF,     /* RTVM only, it is trying to poweroff by itself */
 	VM_PAUSED,	/* VM paused */
+	VM_TEARING_DOWN,	/* VM fenced, background resource reclaim still in progress */
 };
 
 enum vm_vlapic_mode {
@@ -97,6 +102,12 @@ enum vm_vlapic_mode {
 	VM_VLAPIC_TRANSITION
 };
 
+/* PID-pointer table size for IPI virtualization; one 8-byte entry per
+ * possible vAPIC ID (vAPIC IDs mirror the physical LAPIC IDs)
+ */
+#define PID_PTR_TABLE_ENTRY_NUM	256U
+#define PID_PTR_ENTRY_VALID	0x1UL
+
 struct vm_arch {
 	/* I/O bitmaps A and B for this VM, MUST be 4-Kbyte aligned */
 	uint8_t io_bitmap[PAGE_SIZE*2];
@@ -129,6 +140,21 @@ struct vm_arch {
 	spinlock_t iwkey_backup_lock;	/* Spin-lock used to protect internal key backup/restore */
 	struct iwkey iwkey_backup;
 
+	/* effective fixed-range memory-type layout last applied to EPT by
+	 * the vMTRR emulation; lets the other vCPUs of the VM skip the
+	 * identical rebuild when they each run the SDM MP MTRR update
+	 * sequence during boot
+	 */
+	bool vmtrr_ept_synced;
+	uint64_t vmtrr_applied_type[FIXED_RANGE_MTRR_NUM];
+
+	/* PID-pointer table for IPI virtualization, indexed by vAPIC ID:
+	 * valid entries hold the posted-interrupt descriptor address of
+	 * the matching vCPU, invalid ones keep the VM-exit path. vAPIC
+	 * IDs beyond the table are caught by the last-index VMCS field.
+	 */
+	uint64_t pid_ptr_table[PID_PTR_TABLE_ENTRY_NUM] __aligned(64);
+
 	/* reference to virtual platform to come here (as needed) */
 	bool vm_mwait_cap;
 } __aligned(PAGE_SIZE);
@@ -155,7 +181,20 @@ struct acrn_vm {
 	uint16_t nr_emul_mmio_regions;	/* the emulated mmio_region number */
 	struct mem_io_node emul_mmio[CONFIG_MAX_EMULATED_MMIO_REGIONS];
 
+	spinlock_t wc_mmio_lock;	/* Used to protect coalesced doorbell ranges and ring for a VM */
+	uint16_t nr_wc_mmio_ranges;	/* the registered coalesced doorbell range number */
+	struct wc_mmio_range {
+		uint64_t start;
+		uint64_t end;
+	} wc_mmio_ranges[MAX_WC_MMIO_RANGES];
+	/* HVA of the acrn_coalesced_mmio_ring page shared with the DM */
+	struct acrn_coalesced_mmio_ring *wc_mmio_ring;
+
 	struct vm_io_handler_desc emul_pio[EMUL_PIO_IDX_MAX];
+	/* pre-decoded dispatch over emul_pio[], see EMUL_PIO_RADIX_SHIFT */
+	uint8_t emul_pio_root[EMUL_PIO_RADIX_ROOTS];
+	uint8_t emul_pio_leaf[EMUL_PIO_RADIX_LEAVES][EMUL_PIO_RADIX_LEAF_SIZE];
+	uint8_t nr_emul_pio_leaves;
 
 	char name[MAX_VM_NAME_LEN];
 	struct secure_world_control sworld_control;
@@ -173,6 +212,46 @@ struct acrn_vm {
 	struct acrn_vrtc vrtc;
 
 	uint64_t intr_inject_delay_delta; /* delay of intr injection */
+	uint64_t intr_rate_limit_cost; /* ticks one passthrough intr costs, 0 = no limit */
+
+	/* HVA of the stats page registered by the Service VM via
+	 * HC_SETUP_VM_STATS, NULL when no page is registered
+	 */
+	struct acrn_vm_stats *stats_page;
+
+	/* Pinned hypercall argument buffers registered via HC_PIN_HC_BUFFER:
+	 * cached GPA->HVA translations of stable Service VM buffers that let
+	 * copy_from_gpa()/copy_to_gpa() skip the EPT walk. Entries are
+	 * dropped when EPT mutation touches their range. hc_buf_lock covers
+	 * table mutation; the initialization depends on the clear BSS section
+	 */
+	spinlock_t hc_buf_lock;
+	struct hc_pinned_buf {
+		uint64_t gpa;
+		uint64_t size;
+		void *hva;
+		bool valid;
+	} hc_pinned_buf[MAX_PINNED_HC_BUF_NUM];
+
+	/* PML based dirty-page tracking, controlled via HC_VM_DIRTY_TRACK:
+	 * dirty_bitmap is the HVA of the Service VM provided bitmap, one bit
+	 * per 4K guest page, written only while dirty_track_active is set
+	 */
+	bool dirty_track_active;
+	uint64_t *dirty_bitmap;
+	uint64_t dirty_bitmap_size;
+
+	/* HWP minimum performance level applied while this VM's vCPUs run;
+	 * 0 selects the hardware minimum. Set via HC_SET_PERF_PROFILE.
+	 */
+	uint8_t hwp_min_perf;
+
+	/* TSC stamps of the launch phases, served via HC_GET_LAUNCH_PROFILE;
+	 * 0 means the phase has not happened (yet) for this incarnation
+	 */
+	uint64_t create_vm_entry_tsc;
+	uint64_t create_vm_exit_tsc;
+	uint64_t first_vcpu_launch_tsc;
 } __aligned(PAGE_SIZE);
 
 /*
@@ -227,6 +306,9 @@ static inline uint16_t vmid_2_rel_vmid(uint16_t service_vmid, uint16_t vmid) {
 
 void make_shutdown_vm_request(uint16_t pcpu_id);
 bool need_shutdown_vm(uint16_t pcpu_id);
+void make_teardown_vm_request(uint16_t pcpu_id);
+bool need_teardown_vm(uint16_t pcpu_id);
+void vm_teardown_from_idle(uint16_t pcpu_id);
 int32_t shutdown_vm(struct acrn_vm *vm);
 void poweroff_if_rt_vm(struct acrn_vm *vm);
 void pause_vm(struct acrn_vm *vm);
@@ -257,6 +339,7 @@ void vrtc_init(struct acrn_vm *vm);
 
 bool is_lapic_pt_configured(const struct acrn_vm *vm);
 bool is_pmu_pt_configured(const struct acrn_vm *vm);
+bool is_vpmu_configured(const struct acrn_vm *vm);
 bool is_rt_vm(const struct acrn_vm *vm);
 bool is_stateful_vm(const struct acrn_vm *vm);
 bool is_nvmx_configured(const struct acrn_vm *vm);
@@ -28,6 +28,18 @@
 #define PIO_RESET_REG_IDX		(CF9_PIO_IDX + 1U)
 #define SLEEP_CTL_PIO_IDX		(PIO_RESET_REG_IDX + 1U)
 #define EMUL_PIO_IDX_MAX		(SLEEP_CTL_PIO_IDX + 1U)
+
+/*
+ * Pre-decoded port I/O dispatch: a two-level radix over the 64K port
+ * space, root indexed by (port >> 8), leaves by (port & 0xff). Entries
+ * hold (pio_idx + 1U) so that 0 means "no handler". The table is built
+ * at register_pio_emulation_handler() time; emulated ranges are a
+ * handful of bytes, so one range touches at most two leaves.
+ */
+#define EMUL_PIO_RADIX_SHIFT		8U
+#define EMUL_PIO_RADIX_ROOTS		256U
+#define EMUL_PIO_RADIX_LEAF_SIZE	256U
+#define EMUL_PIO_RADIX_LEAVES		(2U * EMUL_PIO_IDX_MAX)
 /**
  * @brief The handler of VM exits on I/O instructions
  *
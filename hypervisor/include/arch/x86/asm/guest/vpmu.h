@@ -0,0 +1,107 @@
+/*
+ * ACRN virtual Performance Monitoring Unit.
+ *
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef VPMU_H
+#define VPMU_H
+
+#include <types.h>
+
+/* counters exposed to a vPMU guest, clamped against the hardware counts */
+#define VPMU_NUM_GP_CTRS	4U
+#define VPMU_NUM_FIXED_CTRS	3U
+
+/**
+ * @brief Per-vCPU virtual PMU state
+ *
+ * Guest-programmed counter and control register values. While the vCPU
+ * runs and the hypervisor profiler does not own the PMU, the counters
+ * live in hardware; they are written back here on context switch out and
+ * whenever the profiler claims the hardware.
+ */
+struct acrn_vpmu {
+	uint64_t global_ctrl;			/**< IA32_PERF_GLOBAL_CTRL */
+	uint64_t global_status;			/**< IA32_PERF_GLOBAL_STATUS */
+	uint64_t fixed_ctrl;			/**< IA32_FIXED_CTR_CTL */
+	uint64_t evtsel[VPMU_NUM_GP_CTRS];	/**< IA32_PERFEVTSELx */
+	uint64_t gp_ctr[VPMU_NUM_GP_CTRS];	/**< IA32_PMCx */
+	uint64_t fixed_ctr[VPMU_NUM_FIXED_CTRS];	/**< IA32_FIXED_CTRx */
+	bool hw_loaded;				/**< counters currently live in hardware */
+};
+
+struct acrn_vcpu;
+
+/**
+ * @brief Probe PMU hardware capabilities and set up PMI delivery
+ *
+ * Called on every pCPU during init; the capability probe and PMI irq
+ * request only run on the BSP.
+ *
+ * @param[in]	pcpu_id	The id of the physical cpu calling in
+ */
+void vpmu_setup(uint16_t pcpu_id);
+
+/**
+ * @brief Whether the platform PMU is rich enough to virtualize
+ *
+ * @return true if vPMU guests can be supported on this platform
+ */
+bool is_vpmu_avail(void);
+
+/**
+ * @brief Fill the virtual CPUID.0AH leaf for a vPMU guest
+ *
+ * Reports the hardware architectural PMU clamped to the counter counts
+ * the vPMU emulates.
+ */
+void vpmu_get_cpuid_0ah(uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx);
+
+/**
+ * @brief Emulate a guest read of a PMU MSR
+ *
+ * @retval 0 on success, -EACCES if the MSR is not virtualized for this VM
+ */
+int32_t vpmu_rdmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t *rval);
+
+/**
+ * @brief Emulate a guest write of a PMU MSR
+ *
+ * @retval 0 on success, -EACCES on writes to reserved bits or read-only MSRs
+ */
+int32_t vpmu_wrmsr(struct acrn_vcpu *vcpu, uint32_t msr, uint64_t wval);
+
+/**
+ * @brief Load the vCPU's counters into hardware at context switch in
+ */
+void vpmu_switch_in(struct acrn_vcpu *vcpu);
+
+/**
+ * @brief Save the vCPU's counters from hardware at context switch out
+ */
+void vpmu_switch_out(struct acrn_vcpu *vcpu);
+
+/**
+ * @brief Route a PMI to the guest owning the counters on this pCPU
+ *
+ * Called from the PMI irq action. Folds the overflow status into the
+ * bound vCPU's vPMU state and fires its LVT performance counter entry.
+ *
+ * @retval true if the PMI belonged to a guest-owned counter
+ */
+bool vpmu_handle_pmi(void);
+
+/**
+ * @brief Park guest counters on this pCPU while the profiler owns the PMU
+ */
+void vpmu_hv_claim_pcpu(void);
+
+/**
+ * @brief Return the PMU to guest use on this pCPU
+ */
+void vpmu_hv_release_pcpu(void);
+
+#endif /* VPMU_H */
@@ -38,6 +38,9 @@ extern void asm_enter_s3(const struct pm_s_state_data *sstate_data, uint32_t pm1
 extern void restore_s3_context(void);
 struct cpu_state_info *get_cpu_pm_state_info(void);
 struct acpi_reset_reg *get_host_reset_reg_data(void);
+void init_hwp(void);
+bool is_hwp_active(void);
+void hwp_apply_min_perf(uint8_t min_perf);
 void reset_host(void);
 
 #endif	/* HOST_PM_H */
@@ -8,6 +8,7 @@
 #define ARCH_X86_IRQ_H
 
 #include <types.h>
+#include <irq.h>
 
 /**
  * @file arch/x86/asm/irq.h
@@ -89,6 +90,21 @@ struct x86_irq_data {
 #endif
 };
 
+/**
+ * @brief Per-pCPU interrupt dispatch entry
+ *
+ * Each pCPU keeps a private, vector-indexed snapshot of the registered
+ * irq actions so that steady-state interrupt dispatch touches neither
+ * the shared vector_to_irq[]/irq_desc_array[] cachelines nor any lock.
+ * Snapshots are rebuilt lazily when the registration generation changes.
+ */
+struct irq_dispatch_entry {
+	uint32_t irq;		/**< bound irq num, IRQ_INVALID if vector unused */
+	uint32_t flags;		/**< snapshot of irq_desc flags */
+	irq_action_t action;	/**< snapshot of the registered action */
+	void *priv_data;	/**< snapshot of the action private data */
+};
+
 struct intr_excp_ctx;
 
 /**
@@ -130,6 +146,7 @@ void setup_irqs_arch(void);
 void init_interrupt_arch(uint16_t pcpu_id);
 void free_irq_arch(uint32_t irq);
 bool request_irq_arch(uint32_t irq);
+void sync_irq_dispatch_arch(void);
 void pre_irq_arch(const struct irq_desc *desc);
 void post_irq_arch(const struct irq_desc *desc);
 
@@ -158,6 +158,8 @@ void init_paging(void);
 void set_paging_supervisor(uint64_t base, uint64_t size);
 void set_paging_x(uint64_t base, uint64_t size);
 void set_paging_nx(uint64_t base, uint64_t size);
+void set_paging_wc(uint64_t base, uint64_t size);
+void set_paging_wb(uint64_t base, uint64_t size);
 
 /**
  * @brief Specified signle VPID flush
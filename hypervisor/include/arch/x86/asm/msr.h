@@ -633,6 +633,21 @@ void update_msr_bitmap_x2apic_passthru(struct acrn_vcpu *vcpu);
 	(PAT_MEM_TYPE_UCM << 48U) + \
 	(PAT_MEM_TYPE_UC << 56U))
 
+/*
+ * Host PAT: identical to the power-on layout except that entry 1
+ * (selected by PWT alone) holds WC instead of WT. No hypervisor mapping
+ * uses WT, while WC lets producer-only shared buffers (trace/log sbufs)
+ * bypass cache fills. Guests keep seeing PAT_POWER_ON_VALUE.
+ */
+#define PAT_HOST_VALUE	(PAT_MEM_TYPE_WB + \
+	(PAT_MEM_TYPE_WC << 8U) + \
+	(PAT_MEM_TYPE_UCM << 16U) + \
+	(PAT_MEM_TYPE_UC << 24U) + \
+	(PAT_MEM_TYPE_WB << 32U) + \
+	(PAT_MEM_TYPE_WT << 40U) + \
+	(PAT_MEM_TYPE_UCM << 48U) + \
+	(PAT_MEM_TYPE_UC << 56U))
+
 #define PAT_ALL_UC_VALUE (PAT_MEM_TYPE_UC + \
 	(PAT_MEM_TYPE_UC << 8U) + \
 	(PAT_MEM_TYPE_UC << 16U) + \
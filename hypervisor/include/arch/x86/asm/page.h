@@ -37,11 +37,43 @@ struct page_pool {
 	spinlock_t lock;
 	uint64_t bitmap_size;
 	uint64_t *bitmap;
+	/* second bitmap level: one bit per bitmap word, set when that word
+	 * is completely allocated. Allocation scans the summary first, so
+	 * a burst against a fragmented pool skips 4096 pages per summary
+	 * word instead of walking the leaf words linearly. Optional: pools
+	 * that leave it NULL fall back to the flat scan.
+	 */
+	uint64_t *summary;
 	uint64_t last_hint_id;
 
 	struct page *dummy_page;
+
+	/* current/peak number of allocated pages, maintained under lock;
+	 * the peak tells how far the worst-case sizing is from reality */
+	uint64_t used_pages;
+	uint64_t max_used_pages;
 };
 
+/**
+ * @brief Snapshot of one registered page pool, for the 'poolstat' shell command
+ */
+struct page_pool_info {
+	const char *name;	/**< pool name given at registration */
+	uint16_t id;		/**< owner id (vm_id for per-VM pools, 0 otherwise) */
+	uint64_t total_pages;	/**< pool capacity in pages */
+	uint64_t used_pages;	/**< pages currently allocated */
+	uint64_t max_used_pages;	/**< high watermark of used_pages */
+};
+
+/* number of summary words covering the pool's bitmap */
+#define PAGE_POOL_SUMMARY_SIZE(bitmap_size)	(((bitmap_size) + 63UL) >> 6U)
+
 struct page *alloc_page(struct page_pool *pool);
+struct page *alloc_pages_contiguous(struct page_pool *pool, uint64_t page_num);
 void free_page(struct page_pool *pool, struct page *page);
+void free_pages(struct page_pool *pool, struct page *page, uint64_t page_num);
+void page_pool_init_summary(struct page_pool *pool);
+void register_page_pool(const char *name, uint16_t id, struct page_pool *pool);
+uint32_t get_page_pool_nr(void);
+void get_page_pool_info(uint32_t idx, struct page_pool_info *info);
 #endif /* PAGE_H */
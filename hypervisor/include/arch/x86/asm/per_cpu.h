@@ -10,10 +10,12 @@
 #include <types.h>
 #include <sbuf.h>
 #include <irq.h>
+#include <softirq.h>
 #include <timer.h>
 #include <profiling.h>
 #include <logmsg.h>
 #include <schedule.h>
+#include <asm/irq.h>
 #include <asm/notify.h>
 #include <asm/page.h>
 #include <asm/gdt.h>
@@ -26,12 +28,37 @@ struct per_cpu_region {
 	void *vmcs_run;
 #ifdef HV_DEBUG
 	struct shared_buf *sbuf[ACRN_SBUF_ID_MAX];
+	struct sbuf_shadow sbuf_shadow[ACRN_SBUF_ID_MAX];
 	char logbuf[LOG_MESSAGE_MAX_SIZE];
+	struct console_log_ring console_log_ring;
 	uint32_t npk_log_ref;
 #endif
 	uint64_t irq_count[NR_IRQS];
+	/* Private vector-indexed dispatch snapshot; irq_disp_gen lags the
+	 * global registration generation when the snapshot is stale.
+	 */
+	struct irq_dispatch_entry irq_disp_table[NR_MAX_VECTOR + 1U];
+	uint64_t irq_disp_gen;
 	uint64_t softirq_pending;
+	uint64_t softirq_cycles[NR_SOFTIRQS];
+	uint64_t softirq_cnt[NR_SOFTIRQS];
+	uint64_t softirq_overrun_cnt;
 	uint64_t spurious;
+	uint64_t vmexit_cnt;
+	/* EPT violation GPA heatmap: power-of-two buckets indexed by the
+	 * highest set bit of the faulting GPA, split into faults that went
+	 * to MMIO emulation and spurious ones (instruction-fetch restores,
+	 * undecodable accesses). Lock-free: each pCPU touches only its own
+	 * copy; the shell command aggregates across pCPUs.
+	 */
+	uint64_t ept_heatmap_mmio[64];
+	uint64_t ept_heatmap_spurious[64];
+	/* Per-opcode instruction emulation profile: executions of and cycles
+	 * spent in emulate_instruction(), indexed by the opcode byte with
+	 * 0x0F-prefixed opcodes in the upper half. Lock-free as above.
+	 */
+	uint64_t instr_emul_hits[512];
+	uint64_t instr_emul_cycles[512];
 	struct acrn_vcpu *ever_run_vcpu;
 #ifdef STACK_PROTECTOR
 	struct stack_canary stk_canary;
@@ -42,7 +69,10 @@ struct per_cpu_region {
 	struct sched_iorr_control sched_iorr_ctl;
 	struct sched_bvt_control sched_bvt_ctl;
 	struct sched_prio_control sched_prio_ctl;
+	struct sched_edf_control sched_edf_ctl;
 	struct thread_object idle;
+	uint64_t idle_mwait_armed;	/* nonzero while idle mwaits on sched_ctl.flags */
+	uint8_t idle_class;		/* wakeup-latency class, IDLE_CLASS_* */
 	struct host_gdt gdt;
 	struct tss_64 tss;
 	enum pcpu_boot_state boot_state;
@@ -53,6 +83,7 @@ struct per_cpu_region {
 	uint8_t stack[CONFIG_STACK_SIZE] __aligned(16);
 	uint32_t lapic_id;
 	uint32_t lapic_ldr;
+	uint64_t hwp_request;		/* last value written to MSR_IA32_HWP_REQUEST */
 	uint32_t softirq_servicing;
 	struct smp_call_info_data smp_call_info;
 	struct list_head softirq_dev_entry_list;
@@ -60,6 +91,7 @@ struct per_cpu_region {
 	struct profiling_info_wrapper profiling_info;
 #endif
 	uint64_t shutdown_vm_bitmap;
+	uint64_t teardown_vm_bitmap;
 	uint64_t tsc_suspend;
 	struct acrn_vcpu *whose_iwkey;
 	/*
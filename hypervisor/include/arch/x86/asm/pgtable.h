@@ -27,7 +27,8 @@
 
 #define PAGE_CACHE_MASK		(PAGE_PCD | PAGE_PWT)
 #define PAGE_CACHE_WB		0UL
-#define PAGE_CACHE_WT		PAGE_PWT
+/* PAT entry 1 is reprogrammed from WT to WC on the host (see PAT_HOST_VALUE) */
+#define PAGE_CACHE_WC		PAGE_PWT
 #define PAGE_CACHE_UC_MINUS	PAGE_PCD
 #define PAGE_CACHE_UC		(PAGE_PCD | PAGE_PWT)
 
@@ -115,6 +116,9 @@
 /* End of ept_mem_type */
 
 #define EPT_MT_MASK		(7UL << EPT_MT_SHIFT)
+/* EPT accessed/dirty flags, updated by hardware when EPTP bit 6 is set */
+#define EPT_ACCESSED		(1UL << 8U)
+#define EPT_DIRTY		(1UL << 9U)
 #define EPT_VE			(1UL << 63U)
 /* EPT leaf entry bits (bit 52 - bit 63) should be maksed  when calculate PFN */
 #define EPT_PFN_HIGH_MASK	0xFFF0000000000000UL
@@ -335,6 +339,8 @@ void pgtable_add_map(uint64_t *pml4_page, uint64_t paddr_base,
 void pgtable_modify_or_del_map(uint64_t *pml4_page, uint64_t vaddr_base,
 		uint64_t size, uint64_t prot_set, uint64_t prot_clr,
 		const struct pgtable *table, uint32_t type);
+void pgtable_promote_large_pages(uint64_t *pml4_page, uint64_t vaddr_base,
+		uint64_t size, const struct pgtable *table);
 /**
  * @}
  */
@@ -58,4 +58,11 @@ uint64_t clos2pqr_msr(uint16_t clos);
 bool is_platform_rdt_capable(void);
 const struct rdt_ins *get_rdt_res_ins(int res, uint16_t pcpu_id);
 
+bool is_platform_cmt_capable(void);
+uint16_t vm_rmid(uint16_t vm_id);
+uint64_t clos_rmid2pqr_msr(uint16_t clos, uint16_t rmid);
+uint64_t read_vm_cache_occupancy(uint16_t vm_id);
+uint64_t read_vm_mem_bw_total(uint16_t vm_id);
+int32_t write_rdt_config(uint32_t res, uint16_t clos, uint64_t value);
+
 #endif	/* RDT_H */
@@ -29,6 +29,11 @@
 #define SERVICE_VM_IDLE		"idle=halt "
 #endif
 
+/* per-VM reaction to a guest bus lock, see acrn_vm_config.bus_lock_policy */
+#define ACRN_BUS_LOCK_POLICY_LOG	0U	/* count it and warn, rate limited */
+#define ACRN_BUS_LOCK_POLICY_YIELD	1U	/* additionally yield the offending vCPU's pCPU */
+#define ACRN_BUS_LOCK_POLICY_KILL	2U	/* fatal: shut the offending VM down */
+
 #define PCI_DEV_TYPE_PTDEV		(1U << 0U)
 #define PCI_DEV_TYPE_HVEMUL		(1U << 1U)
 #define PCI_DEV_TYPE_SERVICE_VM_EMUL	(1U << 2U)
@@ -166,6 +171,17 @@ struct acrn_vm_config {
 							 * We could add more guest flags in future;
 							 */
 	uint32_t vm_prio;				/* The priority for VM vCPU scheduling */
+	uint32_t edf_runtime_us;			/* (runtime, period, deadline) reservation of each
+							 * vCPU under SCHED_EDF, in microseconds; zeroes
+							 * select the scheduler defaults and a zero
+							 * deadline defaults to the period
+							 */
+	uint32_t edf_period_us;
+	uint32_t edf_deadline_us;
+	uint32_t bus_lock_policy;			/* reaction to guest bus locks (split-locked or
+							 * UC-locked atomics), one of ACRN_BUS_LOCK_POLICY_*;
+							 * zero keeps the logging-only default
+							 */
 	uint16_t companion_vm_id;			/* The companion VM id for this VM */
 	struct acrn_vm_mem_config memory;		/* memory configuration of VM */
 	struct epc_section epc;				/* EPC memory configuration of VM */
@@ -10,6 +10,7 @@
 /* 16-bit control fields */
 #define VMX_VPID						0x00000000U
 #define VMX_POSTED_INTR_VECTOR	0x00000002U
+#define VMX_LAST_PID_POINTER_INDEX	0x00000008U
 /* 16-bit guest-state fields */
 #define VMX_GUEST_ES_SEL    0x00000800U
 #define VMX_GUEST_CS_SEL    0x00000802U
@@ -77,6 +78,8 @@
 
 #define VMX_PROC_VM_EXEC_CONTROLS3_FULL		0x00002034U
 #define VMX_PROC_VM_EXEC_CONTROLS3_HIGH		0x00002035U
+#define VMX_PID_POINTER_TABLE_FULL		0x00002042U
+#define VMX_PID_POINTER_TABLE_HIGH		0x00002043U
 
 /* 64-bit read-only data fields */
 #define VMX_GUEST_PHYSICAL_ADDR_FULL 0x00002400U
@@ -283,6 +286,7 @@
 #define VMX_EXIT_REASON_XSAVES                                       0x0000003FU
 #define VMX_EXIT_REASON_XRSTORS                                      0x00000040U
 #define VMX_EXIT_REASON_LOADIWKEY                                    0x00000045U
+#define VMX_EXIT_REASON_BUS_LOCK                                     0x0000004AU
 
 /* VMX execution control bits (pin based) */
 #define VMX_PINBASED_CTLS_IRQ_EXIT     (1U<<0U)
@@ -338,7 +342,9 @@
 #define VMX_PROCBASED_CTLS2_TSC_SCALING (1U<<25U)
 #define VMX_PROCBASED_CTLS2_UWAIT_PAUSE (1U<<26U)
 #define VMX_PROCBASED_CTLS2_ENCLV_EXIT (1U<<28U)
+#define VMX_PROCBASED_CTLS2_BUS_LOCK   (1U<<30U)
 #define VMX_PROCBASED_CTLS3_LOADIWKEY  (1U<<0U)
+#define VMX_PROCBASED_CTLS3_IPI_VIRT   (1U<<4U)
 
 /* MSR_IA32_VMX_EPT_VPID_CAP: EPT and VPID capability bits */
 #define VMX_EPT_EXECUTE_ONLY		(1UL << 0U)
@@ -602,6 +602,72 @@ struct iommu_domain;
  */
 int32_t move_pt_device(const struct iommu_domain *from_domain, const struct iommu_domain *to_domain, uint8_t bus, uint8_t devfun);
 
+/**
+ * @brief Invalidate all IOTLB entries tagged with an iommu domain's id.
+ *
+ * The EPT of a VM doubles as the second-level translation table of its iommu domain
+ * (see create_iommu_domain), so mappings removed or downgraded in the EPT must be
+ * shot down from the IOTLBs as well. A domain-selective invalidation is issued on
+ * every DMAR unit; nothing is done while no device is attached to the domain, as no
+ * IOTLB can then hold a translation tagged with its domain id.
+ *
+ * @param[in] domain the iommu domain whose cached translations are invalidated, may be NULL
+ *
+ */
+void iommu_flush_iotlb(const struct iommu_domain *domain);
+
+/**
+ * @brief Second-level superpage sizes supported by every enabled DRHD.
+ *
+ * SLLPS encoding: bit 0 set means 2MiB pages, bit 1 set means 1GiB pages. The
+ * EPT of a VM doubles as the VT-d second-level table of its iommu domain, so
+ * EPT construction must not use a page size any remapping unit cannot walk.
+ *
+ * @return the intersection of the SLLPS capability fields of all enabled DRHDs
+ */
+uint8_t iommu_sllps_capability(void);
+
+/* log2 invalidation latency buckets: <1us, <2us, ... <64us, >=64us */
+#define IOMMU_INV_LAT_BUCKETS	8U
+
+struct iommu_domain_stats {
+	uint32_t dev_cnt;	/* context entries referencing the domain */
+	uint64_t iotlb_inv_cnt;
+	uint64_t ctx_inv_cnt;
+	uint64_t inv_total_us;	/* cumulative synchronous shootdown latency */
+	uint64_t inv_max_us;
+	uint64_t nr_4k;		/* leaf mappings by size, see count_pages */
+	uint64_t nr_2m;
+	uint64_t nr_1g;
+};
+
+/**
+ * @brief Report DMA remapping statistics of the iommu domain of a VM.
+ *
+ * The DRHDs modeled here carry no architectural performance counters, so the
+ * numbers describe the invalidation traffic the hypervisor drives on behalf of
+ * the domain. When \p count_pages is true the domain's translation table is
+ * additionally walked to break the mapped space down by page size; the walk
+ * is unlocked and meant for the debug shell, not for hot paths.
+ *
+ * @param[in] vm_id id of the VM whose domain is queried
+ * @param[in] count_pages also walk the translation table for the page-size mix
+ * @param[out] stats the statistics of the domain
+ *
+ * @pre vm_id is valid
+ * @pre stats != NULL
+ */
+void iommu_get_domain_stats(uint16_t vm_id, bool count_pages, struct iommu_domain_stats *stats);
+
+/**
+ * @brief Copy out the global invalidation latency histogram.
+ *
+ * @param[out] hist one counter per IOMMU_INV_LAT_BUCKETS log2 latency bucket
+ *
+ * @pre hist != NULL
+ */
+void iommu_get_inv_lat_hist(uint64_t hist[IOMMU_INV_LAT_BUCKETS]);
+
 /**
  * @brief Create a iommu domain for a VM specified by vm_id.
  *
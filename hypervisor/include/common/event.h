@@ -3,8 +3,12 @@
 #include <asm/lib/spinlock.h>
 
 struct sched_event {
+	/* pending signal count: positive means unconsumed signals, negative
+	 * means a waiter consumed a signal which has not fired yet
+	 */
+	int32_t counter;
+	/* only taken on the blocking slow path */
 	spinlock_t lock;
-	int8_t nqueued;
 	struct thread_object* waiting_thread;
 };
 
@@ -153,6 +153,25 @@ int32_t hcall_pause_vm(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64
  */
 int32_t hcall_set_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
 
+/**
+ * @brief get vcpu regs
+ *
+ * Snapshot the architectural registers of a vcpu of a paused VM into the
+ * same acrn_vcpu_regs layout consumed by hcall_set_vcpu_regs, so the state
+ * can be restored later through HC_SET_VCPU_REGS.
+ * The function will return -1 if the target VM is not paused or the vcpu
+ * doesn't exist.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param1 not used
+ * @param param2 guest physical address. This gpa points to
+ *              struct acrn_vcpu_regs with vcpu_id filled in by the caller
+ *
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_get_vcpu_regs(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
 /**
  * @brief set or clear IRQ line
  *
@@ -246,6 +265,24 @@ int32_t hcall_set_vm_memory_regions(struct acrn_vcpu *vcpu, struct acrn_vm *targ
  */
 int32_t hcall_write_protect_page(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
 
+/**
+ * @brief control EPT dirty-page tracking of a VM
+ *
+ * The Service VM provides a bitmap with one bit per 4K guest page; while
+ * tracking is active the hypervisor sets the bit of every page the guest
+ * dirties, enabling iterative pre-copy of live guest memory.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param1 not used
+ * @param param2 guest physical address. This gpa points to
+ *              struct acrn_dirty_track_param
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_vm_dirty_track(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
 /**
  * @brief translate guest physical address to host physical address
  *
@@ -388,6 +425,18 @@ int32_t hcall_reset_ptdev_intr_info(struct acrn_vcpu *vcpu, struct acrn_vm *targ
  */
 int32_t hcall_get_cpu_pm_state(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
 
+/**
+ * @brief Set a VM's HWP performance profile.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 HWP minimum performance level (0 - 255)
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_set_perf_profile(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
 /**
  * @brief Get VCPU a VM's interrupt count data.
  *
@@ -402,6 +451,69 @@ int32_t hcall_get_cpu_pm_state(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm
  */
 int32_t hcall_vm_intr_monitor(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
 
+/**
+ * @brief Register a run-state statistics page for a VM.
+ *
+ * Registers one page of Service VM memory into which the target VM's
+ * vCPUs publish their scheduling and VM exit counters, laid out as
+ * struct acrn_vm_stats. A GPA of 0 unregisters the page.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param1 not used
+ * @param param2 guest physical address of the page, page aligned, or 0
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_setup_vm_stats(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
+/**
+ * @brief Reprogram one RDT CLOS at runtime.
+ *
+ * Writes a new capacity bitmask (L3/L2 CAT) or delay throttling value
+ * (MBA) into one CLOS on every domain instance of the resource, laid
+ * out as struct acrn_rdt_config.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param param2 guest physical address of struct acrn_rdt_config
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_set_rdt_config(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
+/**
+ * @brief Register or drop a pinned hypercall argument buffer.
+ *
+ * The Service VM pins its stable argument buffers once; later hypercalls
+ * whose GPA parameters fall inside a pinned region skip the EPT walk in
+ * copy_from_gpa()/copy_to_gpa() and use the cached translation.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param param2 guest physical address of struct acrn_hc_buf_pin
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_pin_hc_buffer(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
+/**
+ * @brief Get the launch-phase timestamps of a VM.
+ *
+ * Copies the TSC stamps recorded while bringing the target VM up
+ * (create_vm entry/exit, first wake of the BSP) into a Service VM
+ * provided struct acrn_vm_launch_profile.
+ *
+ * @param vcpu Pointer to vCPU that initiates the hypercall
+ * @param target_vm Pointer to target VM data structure
+ * @param param2 guest physical address of struct acrn_vm_launch_profile
+ *
+ * @pre is_service_vm(vcpu->vm)
+ * @return 0 on success, non-zero on error.
+ */
+int32_t hcall_get_launch_profile(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2);
+
 /**
  * @defgroup trusty_hypercall Trusty Hypercalls
  *
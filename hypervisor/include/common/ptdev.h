@@ -8,6 +8,8 @@
 #define PTDEV_H
 #include <list.h>
 #include <asm/lib/spinlock.h>
+#include <asm/lib/rwlock.h>
+#include <lockstat.h>
 #include <timer.h>
 #include <vacpi.h>
 
@@ -119,6 +121,7 @@ struct msi_info {
 
 struct ptirq_remapping_info;
 typedef void (*ptirq_arch_release_fn_t)(const struct ptirq_remapping_info *entry);
+typedef void (*ptirq_arch_mask_fn_t)(const struct ptirq_remapping_info *entry, bool mask);
 
 /* entry per each allocated irq/vector
  * it represents a pass-thru device's remapping data entry which collecting
@@ -137,6 +140,10 @@ struct ptirq_remapping_info {
 	uint32_t allocated_pirq;
 	uint32_t polarity; /* 0=active high, 1=active low*/
 	struct list_head softirq_node;
+	/* protects vmsi/pmsi against concurrent remap vs. injection, so
+	 * that vectors of distinct entries never serialize on ptdev_lock
+	 */
+	spinlock_t entry_lock;
 	struct msi_info vmsi;
 	struct msi_info pmsi;
 	uint16_t irte_idx;
@@ -144,6 +151,16 @@ struct ptirq_remapping_info {
 	uint64_t intr_count;
 	struct hv_timer intr_delay_timer; /* used for delay intr injection */
 	ptirq_arch_release_fn_t release_cb;
+
+	/* token-bucket storm containment; tokens are TSC ticks and each
+	 * interrupt spends vm->intr_rate_limit_cost of them
+	 */
+	uint64_t rate_tokens;
+	uint64_t rate_refill_ts;
+	bool rate_masked;
+	uint64_t rate_masked_count;
+	struct hv_timer rate_unmask_timer;
+	ptirq_arch_mask_fn_t mask_cb; /* hardware-mask the source, NULL if not maskable */
 };
 
 static inline bool is_entry_active(const struct ptirq_remapping_info *entry)
@@ -152,7 +169,12 @@ static inline bool is_entry_active(const struct ptirq_remapping_info *entry)
 }
 
 extern struct ptirq_remapping_info ptirq_entries[CONFIG_MAX_PT_IRQ_ENTRIES];
-extern spinlock_t ptdev_lock;
+/* phase-fair rwlock over the entry hash and entry lifetime: configuration
+ * paths (add/remove/transfer of remappings) take the write side, lookup-only
+ * paths on the interrupt delivery fast path take the read side so concurrent
+ * MSIs from distinct devices never serialize here
+ */
+extern rwlock_t ptdev_lock;
 
 /**
  * @file ptdev.h
@@ -198,6 +220,18 @@ struct ptirq_remapping_info *find_ptirq_entry(uint32_t intr_type,
  *
  */
 void ptirq_softirq(uint16_t pcpu_id);
+/**
+ * @brief Report ptirq entry pool utilization.
+ *
+ * Returns the number of currently allocated ptirq entries and the high
+ * watermark since boot, for the 'poolstat' shell command.
+ *
+ * @param[out]   used current number of allocated entries
+ * @param[out]   max_used peak number of allocated entries since boot
+ *
+ * @pre used != NULL && max_used != NULL
+ */
+void ptirq_get_entry_stats(uint32_t *used, uint32_t *max_used);
 /**
  * @brief Passthrough device global data structure initialization.
  *
@@ -221,6 +255,19 @@ void ptdev_init(void);
  */
 void ptdev_release_all_entries(const struct acrn_vm *vm);
 
+/**
+ * @brief Note that a vCPU of the given VM changed its pCPU placement.
+ *
+ * Marks the VM's remapping entries as having a possibly stale physical
+ * destination and arms a settle timer; once migrations stop arriving the
+ * entries are refreshed in one batch so passthrough interrupts follow
+ * their vCPU. Cheap enough to call under the scheduler locks.
+ *
+ * @param[in]    vm_id id of the VM owning the migrated vCPU
+ *
+ */
+void ptirq_notify_vcpu_placement(uint16_t vm_id);
+
 /**
  * @brief Dequeue an entry from per cpu ptdev softirq queue.
  *
@@ -287,6 +334,29 @@ void ptirq_deactivate_entry(struct ptirq_remapping_info *entry);
  *
  */
 uint32_t ptirq_get_intr_data(const struct acrn_vm *target_vm, uint64_t *buffer, uint32_t buffer_cnt);
+/**
+ * @brief Get the per-entry storm containment counters, stored as
+ * (pirq, times masked) pairs like ptirq_get_intr_data().
+ *
+ * @param[in]    target_vm the VM to get the storm information.
+ * @param[out]   buffer where the storm information is stored.
+ * @param[in]    buffer_cnt the size of the buffer.
+ *
+ * @retval the actual size the buffer filled with the storm information
+ *
+ */
+uint32_t ptirq_get_storm_data(const struct acrn_vm *target_vm, uint64_t *buffer, uint32_t buffer_cnt);
+/**
+ * @brief Register the hardware mask callback used for interrupt-storm
+ * containment on the MSI entry of virt_bdf/entry_nr, if one is mapped.
+ *
+ * @param[in]    vm the VM owning the entry.
+ * @param[in]    virt_bdf virtual BDF of the passthrough device.
+ * @param[in]    entry_nr MSI/MSI-X vector index.
+ * @param[in]    cb the mask callback, invoked in interrupt/timer context.
+ *
+ */
+void ptirq_set_mask_cb(const struct acrn_vm *vm, uint16_t virt_bdf, uint16_t entry_nr, ptirq_arch_mask_fn_t cb);
 
 /**
   * @}
@@ -39,9 +39,14 @@ enum thread_priority {
 struct thread_object;
 typedef void (*thread_entry_t)(struct thread_object *obj);
 typedef void (*switch_t)(struct thread_object *obj);
+typedef bool (*migrate_t)(struct thread_object *obj, uint16_t dest_pcpu_id);
 struct thread_object {
 	char name[16];
 	uint16_t pcpu_id;
+	/* pCPUs this thread may be migrated to; 0 means hard-pinned */
+	uint64_t cpu_affinity;
+	/* arch hand-off when the thread moves to another pCPU; may veto */
+	migrate_t migrate;
 	struct sched_control *sched_ctl;
 	thread_entry_t thread_entry;
 	volatile enum thread_object_state status;
@@ -51,9 +56,30 @@ struct thread_object {
 	uint64_t host_sp;
 	switch_t switch_out;
 	switch_t switch_in;
+	/* warms the incoming thread's context at schedule-decision time,
+	 * before switch_out runs for the outgoing thread; optional
+	 */
+	switch_t prefetch;
 
 	int priority;
 
+	/* (runtime, period, deadline) reservation in TSC cycles, filled in
+	 * by the thread creator and consumed by deadline-aware scheduler
+	 * classes only; all zero selects the class defaults
+	 */
+	uint64_t reserve_runtime;
+	uint64_t reserve_period;
+	uint64_t reserve_deadline;
+
+	/* run-state accounting, maintained on status transitions under the
+	 * scheduler lock; exported to the Service VM via the VM stats page
+	 */
+	uint64_t state_tsc;		/* when 'status' last changed */
+	uint64_t run_cycles;		/* total cycles in THREAD_STS_RUNNING */
+	uint64_t runnable_cycles;	/* total cycles in THREAD_STS_RUNNABLE */
+	uint64_t sched_in_cnt;		/* number of RUNNING transitions */
+	uint64_t overrun_cnt;		/* reservation budget recharges (EDF/CBS) */
+
 	uint8_t data[THREAD_DATA_SIZE];
 };
 
@@ -112,7 +138,16 @@ struct sched_prio_control {
 	struct list_head prio_queue;
 };
 
+extern struct acrn_scheduler sched_edf;
+struct sched_edf_control {
+	struct list_head runqueue;
+	struct hv_timer tick_timer;
+	/* admitted bandwidth of this pCPU in per-mille, for admission control */
+	uint64_t used_bw;
+};
+
 bool is_idle_thread(const struct thread_object *obj);
+bool sched_affinity_admissible(uint16_t vm_id, uint64_t guest_flags, uint64_t pcpu_bitmap);
 uint16_t sched_get_pcpuid(const struct thread_object *obj);
 struct thread_object *sched_get_current(uint16_t pcpu_id);
 
@@ -132,6 +167,8 @@ void sleep_thread(struct thread_object *obj);
 void sleep_thread_sync(struct thread_object *obj);
 void wake_thread(struct thread_object *obj);
 void yield_current(void);
+void yield_to(struct thread_object *obj);
+void migrate_thread(struct thread_object *obj, uint16_t dest_pcpu_id);
 void schedule(void);
 
 void arch_switch_to(void *prev_sp, void *next_sp);
@@ -30,8 +30,24 @@ enum tick_mode {
 /**
  * @brief Definition of timers for per-cpu
  */
+/*
+ * Armed timers are kept in a per-pCPU hierarchical timer wheel. Level n
+ * buckets span (2^TIMER_WHEEL_SHIFT << (TIMER_WHEEL_SLOT_BITS * n)) TSC
+ * cycles, so insertion is O(1) and expired buckets are walked in order.
+ */
+#define TIMER_WHEEL_LEVELS	4U
+#define TIMER_WHEEL_SLOTS	64U	/* per level, must stay a power of two */
+#define TIMER_WHEEL_SLOT_BITS	6U
+#define TIMER_WHEEL_SHIFT	18U	/* base bucket width: 2^18 TSC cycles */
+
 struct per_cpu_timers {
-	struct list_head timer_list;	/**< it's for runtime active timer list */
+	struct list_head wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];	/**< runtime active timers */
+	uint64_t occupancy[TIMER_WHEEL_LEVELS];	/**< non-empty bucket hints, may carry stale bits */
+	uint64_t last_jiffy;		/**< wheel position, in base buckets */
+	uint64_t deadline;		/**< currently programmed TSC deadline, 0 if none */
+	bool pt_tsc_deadline;		/**< physical TSC deadline handed over to a lapic_pt guest */
+	uint64_t stats_added;		/**< total add_timer() calls on this pCPU */
+	uint64_t stats_cascaded;	/**< timers moved to a lower level by a cascade */
 };
 
 /**
@@ -120,6 +136,19 @@ int32_t add_timer(struct hv_timer *timer);
  */
 void del_timer(struct hv_timer *timer);
 
+/**
+ * @brief Migrate armed timers off the current pCPU to the BSP.
+ *
+ * Called right before the LAPIC timer is passed through to a guest: every
+ * armed housekeeping timer of this pCPU is handed over to the BSP and this
+ * pCPU stops programming MSR_IA32_TSC_DEADLINE, which the guest owns from
+ * then on. The hand-over is undone when the pCPU runs timer_init() again
+ * after being offlined.
+ *
+ * @return None
+ */
+void migrate_percpu_timers(void);
+
 /**
  * @brief Initialize timer.
  *
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef VCPU_WATCHDOG_H
+#define VCPU_WATCHDOG_H
+
+#include <types.h>
+
+/**
+ * @brief Initialize the vCPU watchdog on one pCPU.
+ *
+ * Enables the fixed PMU counter used as the instructions-retired
+ * heartbeat on the calling pCPU; the BSP additionally arms the
+ * periodic stall-detector timer.
+ *
+ * @param pcpu_id the id of the calling pCPU
+ */
+void init_vcpu_watchdog(uint16_t pcpu_id);
+
+#endif /* VCPU_WATCHDOG_H */
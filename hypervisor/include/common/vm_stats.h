@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef VM_STATS_H
+#define VM_STATS_H
+
+#include <acrn_hv_defs.h>
+
+struct acrn_vm;
+struct acrn_vcpu;
+
+/**
+ * @brief Register (or unregister) the stats page of a VM.
+ *
+ * @param vm the VM whose statistics will be published
+ * @param page HVA of one page of Service VM memory, NULL to unregister
+ *
+ * @return 0 on success, non-zero on error.
+ */
+int32_t vm_stats_setup(struct acrn_vm *vm, struct acrn_vm_stats *page);
+
+/**
+ * @brief Publish the calling vCPU's slot of its VM's stats page.
+ *
+ * Called from the VM exit path; rate-limited internally, and a no-op
+ * when no stats page is registered for the VM.
+ *
+ * @pre vcpu != NULL
+ */
+void vm_stats_publish(struct acrn_vcpu *vcpu);
+
+#endif /* VM_STATS_H */
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <types.h>
+#include <asm/lib/spinlock.h>
+
+/**
+ * @brief Contention statistics of one spinlock site
+ *
+ * One record covers a lock site, not a lock instance: all the vioapic locks
+ * share the "vioapic" record for example. A site is wired up by routing its
+ * obtain/release pairs through lockstat_obtain()/lockstat_release() with a
+ * static record; in release builds those collapse to the plain spinlock
+ * operations and the record is unused.
+ */
+struct lock_stat {
+	const char *name;	/**< site name shown by the 'lockstat' shell command */
+	bool registered;	/**< added to the registry on first acquisition */
+	uint16_t id;		/**< registry slot + 1, 0 when the registry was full */
+	uint64_t acquisitions;	/**< total lock acquisitions through this site */
+	uint64_t contended;	/**< acquisitions which found the lock held */
+	uint64_t spins;		/**< total pause iterations spent waiting */
+	uint64_t max_hold;	/**< longest observed hold time in TSC cycles */
+};
+
+#ifdef HV_DEBUG
+void lockstat_obtain(spinlock_t *lock, struct lock_stat *stat);
+void lockstat_release(spinlock_t *lock, struct lock_stat *stat);
+uint32_t lockstat_get_site_nr(void);
+const struct lock_stat *lockstat_get_site(uint32_t idx);
+#else
+static inline void lockstat_obtain(spinlock_t *lock, __unused struct lock_stat *stat)
+{
+	spinlock_obtain(lock);
+}
+
+static inline void lockstat_release(spinlock_t *lock, __unused struct lock_stat *stat)
+{
+	spinlock_release(lock);
+}
+#endif /* HV_DEBUG */
+
+#define lockstat_irqsave_obtain(lock, stat, p_rflags)	\
+	do {						\
+		CPU_INT_ALL_DISABLE(p_rflags);		\
+		lockstat_obtain((lock), (stat));	\
+	} while (0)
+
+#define lockstat_irqrestore_release(lock, stat, rflags)	\
+	do {						\
+		lockstat_release((lock), (stat));	\
+		CPU_INT_ALL_RESTORE(rflags);		\
+	} while (0)
+
+#endif /* LOCKSTAT_H */
@@ -7,6 +7,7 @@
 #ifndef LOGMSG_H
 #define LOGMSG_H
 #include <asm/cpu.h>
+#include <asm/lib/spinlock.h>
 
 /* Logging severity levels */
 #define LOG_FATAL		1U
@@ -24,12 +25,31 @@
 #define LOG_MESSAGE_MAX_SIZE	(4U * LOG_ENTRY_SIZE)
 
 #define DBG_LEVEL_LAPICPT	5U
+
+/* Console-bound messages are staged in a per-CPU ring and drained to the
+ * UART from the console timer context, so the logging caller only pays for
+ * one formatting pass plus a short copy and never waits for the UART.
+ * Must be a power of two.
+ */
+#define CONSOLE_LOG_RING_SIZE	2048U
+
+struct console_log_ring {
+	spinlock_t lock;
+	uint32_t head;		/* consumer position, console context only */
+	uint32_t tail;		/* producer position, owning pCPU only */
+	uint32_t dropped;	/* messages discarded because the ring was full */
+	char buf[CONSOLE_LOG_RING_SIZE];
+};
+
 #if defined(HV_DEBUG)
 
 extern uint16_t console_loglevel;
 extern uint16_t mem_loglevel;
 extern uint16_t npk_loglevel;
 
+void console_log_drain(void);
+uint32_t console_log_stage_raw(const char *s, uint32_t len);
+
 void asm_assert(int32_t line, const char *file, const char *txt);
 
 #define ASSERT(x, ...) \
@@ -18,4 +18,25 @@ void profiling_pre_vmexit_handler(struct acrn_vcpu *vcpu);
 void profiling_post_vmexit_handler(struct acrn_vcpu *vcpu);
 void profiling_setup(void);
 
+#ifdef PROFILING_ON
+int32_t profiling_sampling_start(uint64_t period);
+void profiling_sampling_stop(void);
+uint64_t profiling_sampling_period(void);
+
+#define HITM_SITE_NUM		64U
+
+/* one aggregated cross-core HITM sampling site, keyed by guest cacheline */
+struct hitm_site {
+	uint64_t cacheline;
+	uint64_t count;
+	uint16_t vm_id;
+};
+
+int32_t profiling_hitm_start(uint64_t period);
+void profiling_hitm_stop(void);
+uint64_t profiling_hitm_period(void);
+const struct hitm_site *profiling_hitm_site(uint32_t idx);
+uint64_t profiling_hitm_overflow(void);
+#endif
+
 #endif /* PROFILING_H */
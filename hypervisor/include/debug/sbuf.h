@@ -58,12 +58,29 @@ struct shared_buf {
 	uint32_t padding[6];
 };
 
+/*
+ * Hypervisor-private producer state, one per (pCPU, sbuf_id) pair.
+ *
+ * head and tail of the shared header live on the same cache line, which the
+ * consumer in the Service VM polls continuously; keeping producer-side copies
+ * here means the hot put path touches that line with a single store of the
+ * new tail. The cached head may lag the consumer but never lead it, so a
+ * "buffer full" indication is re-checked against the shared header before an
+ * element is dropped.
+ */
+struct sbuf_shadow {
+	uint32_t tail;		/* exact copy of sbuf->tail, the producer owns it */
+	uint32_t head;		/* stale hint of sbuf->head */
+	uint32_t ele_size;	/* snapshot taken at registration time */
+	uint32_t size;		/* snapshot taken at registration time */
+	uint64_t dropped;	/* elements dropped because the buffer was full */
+};
 
 /**
- *@pre sbuf != NULL
+ *@pre sbuf_id < ACRN_SBUF_ID_MAX
  *@pre data != NULL
  */
-uint32_t sbuf_put(struct shared_buf *sbuf, uint8_t *data);
+uint32_t sbuf_put(uint32_t sbuf_id, uint8_t *data);
 int32_t sbuf_share_setup(uint16_t pcpu_id, uint32_t sbuf_id, uint64_t *hva);
 void sbuf_reset(void);
 uint32_t sbuf_next_ptr(uint32_t pos, uint32_t span, uint32_t scope);
@@ -9,5 +9,6 @@
 
 void shell_init(void);
 void shell_kick(void);
+void shell_idle_process(void);
 
 #endif /* SHELL_H */
@@ -40,6 +40,17 @@
 #define TRACE_VMEXIT_APICV_VIRT_EOI	    (TRACE_VMEXIT_ENTRY + 0x0000003AU)
 
 #define TRACE_VMEXIT_UNHANDLED		0x20000U
+#define TRACE_VMEXIT_LATENCY		0x20001U
+
+/* PMU self-sampling record: e = sampled RIP,
+ * f = (vm_id << 32) | (exit reason << 1) | guest flag */
+#define TRACE_PMU_SAMPLE		0x30000U
+#define TRACE_HITM_SAMPLE		0x30001U
+
+/* scheduler picked a new thread: e/f = name of the next thread */
+#define TRACE_SCHED_NEXT		0x40000U
+
+void init_flight_recorder(void);
 
 void TRACE_2L(uint32_t evid, uint64_t e, uint64_t f);
 void TRACE_4I(uint32_t evid, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
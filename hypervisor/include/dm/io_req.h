@@ -29,6 +29,14 @@ struct io_request {
 	 */
 	uint32_t io_type;
 
+	/**
+	 * @brief Whether the request comes from an INS/OUTS string instruction.
+	 *
+	 * A string read lands in guest memory instead of RAX, so the
+	 * complete-work must not merge the read value into RAX.
+	 */
+	bool is_pio_string;
+
 	/**
 	 * @brief Details of this request in the same format as acrn_io_request.
 	 */
@@ -246,6 +254,31 @@ uint32_t get_hsm_notification_vector(void);
  */
 int32_t emulate_io(struct acrn_vcpu *vcpu, struct io_request *io_req);
 
+/**
+ * @brief Register a coalesced doorbell range for \p vm
+ *
+ * res[0] of \p mmiodev carries the doorbell GPA range and res[1] the guest
+ * page holding the acrn_coalesced_mmio_ring shared with the DM. MMIO writes
+ * falling inside a registered range are absorbed into the ring instead of
+ * being delivered to HSM as individual I/O requests.
+ *
+ * @pre vm != NULL && mmiodev != NULL
+ *
+ * @retval 0 Range registered successfully.
+ * @retval -EINVAL Invalid ring page, empty range or no free slot.
+ */
+int32_t register_coalesced_mmio(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev);
+
+/**
+ * @brief Unregister a coalesced doorbell range of \p vm
+ *
+ * @pre vm != NULL && mmiodev != NULL
+ *
+ * @retval 0 Range found and removed.
+ * @retval -EINVAL No matching range registered.
+ */
+int32_t unregister_coalesced_mmio(struct acrn_vm *vm, const struct acrn_mmiodev *mmiodev);
+
 /**
  * @brief Register a port I/O handler
  *
@@ -52,14 +52,24 @@
  * id field is used to emulate the IOAPIC_ID register of vIOAPIC
  */
 
+#define VIOAPIC_INVALID_PIN	0xFFU
+
 struct acrn_single_vioapic {
+	/* serializes register selection, RTE reprogramming and the vector index */
 	spinlock_t	lock;
 	struct acrn_vm  *vm;
 	struct ioapic_info chipinfo;
 	uint32_t	ioregsel;
 	union ioapic_rte rtbl[REDIR_ENTRIES_HW];
+	/* per-RTE locks: serialize rtbl[pin] and its pin_state bit, so that
+	 * irq line updates and EOIs of distinct pins do not contend */
+	spinlock_t	rtbl_lock[REDIR_ENTRIES_HW];
 	/* pin_state status bitmap: 1 - high, 0 - low */
 	uint64_t pin_state[STATE_BITMAP_SIZE];
+	/* vector -> pins reverse index (256 = NR_MAX_VECTOR + 1 heads),
+	 * chained through pin_next and guarded by 'lock' */
+	uint8_t vec_head[256U];
+	uint8_t pin_next[REDIR_ENTRIES_HW];
 };
 
 /*
@@ -36,6 +36,11 @@
 #define VDEV_LIST_HASHBITS 4U
 #define VDEV_LIST_HASHSIZE (1U << VDEV_LIST_HASHBITS)
 
+#define VPCI_BUS_NUM		256U
+#define VPCI_DEVFUN_NUM		256U
+/* number of per-bus leaves available for the BDF-indexed vdev lookup table */
+#define VPCI_LOOKUP_LEAF_NUM	16U
+
 struct pci_vbar {
 	bool is_mem64hi;	/* this is to indicate the high part of 64 bits MMIO bar */
 	uint64_t size;		/* BAR size */
@@ -69,6 +74,13 @@ struct msixcap {
 
 struct pci_msix {
 	struct msix_table_entry table_entries[CONFIG_MAX_MSIX_TABLE_NUM];
+	/*
+	 * Address/data last handed to ptirq_prepare_msix_remap, so an
+	 * unmask that changes nothing skips the remap transaction.
+	 */
+	uint64_t  remapped_addr[CONFIG_MAX_MSIX_TABLE_NUM];
+	uint32_t  remapped_data[CONFIG_MAX_MSIX_TABLE_NUM];
+	bool      remapped_valid[CONFIG_MAX_MSIX_TABLE_NUM];
 	uint64_t  mmio_gpa;
 	uint64_t  mmio_hpa;
 	uint64_t  mmio_size;
@@ -149,6 +161,14 @@ struct pci_vdev {
 	struct pci_vdev *parent_user;
 	struct pci_vdev *user;	/* NULL means this device is not used or is a zombie VF */
 	struct hlist_node link;
+
+	/*
+	 * Serializes config-space accesses against assignment state transitions
+	 * (user/zombie changes) now that the vdev lookup itself is lock-free.
+	 * Lock order: a vdev's cfg_lock may be held while taking vpci->lock
+	 * (SRIOV VF creation from the PF's capability write), never the reverse.
+	 */
+	spinlock_t cfg_lock;
 	void *priv_data;
 };
 
@@ -177,6 +197,19 @@ struct acrn_vpci {
 	struct pci_mmio_res res64; 	/* 64-bit mmio start/end address */
 	struct pci_vdev pci_vdevs[CONFIG_MAX_PCI_DEV_NUM];
 	struct hlist_head vdevs_hlist_heads [VDEV_LIST_HASHSIZE];
+
+	/*
+	 * BDF-indexed lookup table for the lock-free config-space dispatch path.
+	 * bus_lookup[bus] points at a per-bus leaf whose entries hold
+	 * (index into pci_vdevs) + 1, with 0 meaning no device; entry and leaf
+	 * pointer stores are naturally aligned and thus atomic, so readers walk
+	 * the table without holding any lock. A bus that never got a leaf
+	 * (pool exhausted) falls back to the hash list above. Writers are
+	 * serialized by vpci->lock or run in VM (de)init context.
+	 */
+	uint16_t *bus_lookup[VPCI_BUS_NUM];
+	uint16_t lookup_leaves[VPCI_LOOKUP_LEAF_NUM][VPCI_DEVFUN_NUM];
+	uint32_t lookup_leaf_cnt;
 };
 
 struct acrn_vm;
@@ -47,6 +47,39 @@
 #define COM3_IRQ		6U
 #define COM4_IRQ		7U
 
+/*
+ * Bulk transfer mode, negotiated through the scratch register.
+ *
+ * A guest enters bulk mode by writing VUART_BULK_MAGIC0, VUART_BULK_MAGIC1
+ * and then the 8 bytes (LSB first) of the page-aligned GPA of a page laid
+ * out as struct vuart_bulk_ring to SCR; the resulting status is read back
+ * from SCR. Afterwards the guest produces into tx_buf, advances tx_tail
+ * and writes VUART_BULK_KICK to SCR. One kick moves everything pending to
+ * the peer: into the peer's rx_buf when the peer negotiated bulk mode too
+ * (the peer then finds one in-band VUART_BULK_KICK byte in its legacy RX
+ * FIFO as doorbell), or through the peer's legacy RX FIFO otherwise. Ring
+ * indices are plain offsets into the buffers; head is owned by the
+ * consumer, tail by the producer, and one slot is left unused to tell
+ * full from empty. Any other SCR write leaves bulk mode and restores the
+ * plain scratch register.
+ */
+#define VUART_BULK_MAGIC0	0xACU
+#define VUART_BULK_MAGIC1	0x4EU
+#define VUART_BULK_KICK		0x4BU
+#define VUART_BULK_STA_ACTIVE	0xB1U
+#define VUART_BULK_STA_ERROR	0xBEU
+
+#define VUART_BULK_BUF_SIZE	2040U
+
+struct vuart_bulk_ring {
+	uint32_t tx_head;	/* consumer index, owned by the hypervisor */
+	uint32_t tx_tail;	/* producer index, owned by the guest */
+	uint32_t rx_head;	/* consumer index, owned by the guest */
+	uint32_t rx_tail;	/* producer index, owned by the hypervisor */
+	uint8_t tx_buf[VUART_BULK_BUF_SIZE];
+	uint8_t rx_buf[VUART_BULK_BUF_SIZE];
+};
+
 struct vuart_fifo {
 	char *buf;
 	uint32_t rindex;	/* index to read from */
@@ -75,6 +108,10 @@ struct acrn_vuart {
 	char vuart_tx_buf[TX_BUF_SIZE];
 	bool thre_int_pending;	/* THRE interrupt pending */
 	bool active;
+
+	uint64_t bulk_gpa;	/* GPA of the guest's struct vuart_bulk_ring page */
+	uint8_t bulk_hshake;	/* SCR handshake progress, 0 when idle */
+	bool bulk_mode;
 	struct acrn_vuart *target_vu; /* Pointer to target vuart */
 	struct acrn_vm *vm;
 	struct pci_vdev *vdev;	/* pci vuart */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef DMACPY_H
+#define DMACPY_H
+
+#include <types.h>
+#include <pci.h>
+
+/**
+ * @brief Check whether a PCI function is a CBDMA engine the hypervisor claims.
+ *
+ * Used during PCI enumeration to keep the engine out of any guest.
+ *
+ * @param bdf Physical device BDF
+ *
+ * @return true if the function is a supported DMA engine
+ */
+bool is_dmacpy_pdev(union pci_bdf bdf);
+
+/**
+ * @brief Probe and bring up the copy-offload channel.
+ *
+ * Must be called after init_pci_pdev_list(). Absence of a supported
+ * engine is not an error; the copy/fill APIs then report -ENODEV and
+ * callers keep their CPU paths.
+ */
+void dmacpy_init(void);
+
+/**
+ * @brief Copy a physically contiguous host memory range via the DMA engine.
+ *
+ * @param dst_hpa Destination host physical address, 8 byte aligned
+ * @param src_hpa Source host physical address, 8 byte aligned
+ * @param size    Bytes to copy, multiple of 8
+ *
+ * @return 0 on success, -ENODEV if no usable engine, -EINVAL on bad
+ *         alignment, -EIO if the channel faulted (engine is then retired)
+ */
+int32_t dmacpy_copy(uint64_t dst_hpa, uint64_t src_hpa, uint64_t size);
+
+/**
+ * @brief Fill a physically contiguous host memory range with a pattern.
+ *
+ * @param dst_hpa  Destination host physical address, 8 byte aligned
+ * @param pattern  64 bit fill pattern
+ * @param size     Bytes to fill, multiple of 8
+ *
+ * @return same convention as dmacpy_copy()
+ */
+int32_t dmacpy_fill(uint64_t dst_hpa, uint64_t pattern, uint64_t size);
+
+#endif /* DMACPY_H */
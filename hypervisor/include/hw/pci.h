@@ -69,6 +69,7 @@
 #define PCIR_COMMAND          0x04U
 #define	PCIM_CMD_PORTEN       0x01U
 #define	PCIM_CMD_MEMEN        0x02U
+#define	PCIM_CMD_BUSMASTEREN  0x04U
 #define PCIM_CMD_INTxDIS      0x400U
 #define PCIR_STATUS           0x06U
 #define PCIM_STATUS_CAPPRESENT    0x0010U
@@ -191,9 +192,13 @@
 /* PCI Express Device Type definitions */
 #define PCIER_FLAGS                    0x2U
 #define PCIEM_FLAGS_TYPE               0x00F0U
+#define PCIEM_FLAGS_SLOT               0x0100U
 #define PCIEM_TYPE_ENDPOINT            0x0000U
 #define PCIEM_TYPE_ROOTPORT            0x0004U
+#define PCIEM_TYPE_DOWNPORT            0x0006U
 #define PCIEM_TYPE_ROOT_INT_EP         0x0009U
+#define PCIR_PCIE_SLOTSTS              0x1AU
+#define PCIM_PCIE_SLOTSTS_PDS          0x0040U
 
 #define PCIR_PCIE_DEVCAP2     0x24U
 #define PCIM_PCIE_DEVCAP2_ARI (0x1U << 5U)
@@ -247,6 +252,9 @@ struct pci_mmcfg_region {
 	uint8_t end_bus;	/* Final PCI Bus number */
 } __packed;
 
+/* Maximum # of ECAM regions (MCFG allocation entries) the HV keeps track of */
+#define PCI_MMCFG_REGION_NUM	4U
+
 /* Basic MSIX capability info */
 struct pci_msix_cap {
 	uint32_t  capoff;
@@ -279,7 +287,9 @@ struct pci_pdev {
 
 	/* IOMMU responsible for DMA and Interrupt Remapping for this device */
 	uint32_t drhd_index;
-	/* Used for vMSI-x on MSI emulation */
+	/* IRTE block reserved at device discovery, either for vMSI-x on MSI
+	 * emulation or to pre-provision the MSI-X vectors of an SR-IOV VF
+	 */
 	uint16_t irte_start;
 	uint16_t irte_count;
 
@@ -299,7 +309,6 @@ struct pci_pdev {
 	bool has_pm_reset;
 	bool has_flr;
 	bool has_af_flr;
-	struct hlist_node link;
 };
 
 struct pci_cfg_ops {
@@ -353,6 +362,7 @@ static inline uint64_t get_pci_mmcfg_size(struct pci_mmcfg_region *pci_mmcfg)
 
 #ifdef CONFIG_ACPI_PARSE_ENABLED
 void set_mmcfg_region(struct pci_mmcfg_region *region);
+void add_mmcfg_region(const struct pci_mmcfg_region *region);
 #endif
 struct pci_mmcfg_region *get_mmcfg_region(void);
 
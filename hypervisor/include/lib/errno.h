@@ -25,6 +25,8 @@
 #define EINVAL		22
 /** Indicates the operation is undefined. */
 #define ENOTTY		25
+/** Indicates that no space is left. */
+#define ENOSPC		28
 /** Indicates the operation is obsoleted. */
 #define ENOSYS		38
 /** Indicates that timeout occurs. */
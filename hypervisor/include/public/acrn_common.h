@@ -27,6 +27,9 @@
 
 #define ACRN_IO_REQUEST_MAX		16U
 
+/* Wildcard vCPU ID: reap the completions of all request slots in one notify */
+#define ACRN_IOREQ_VCPUID_ALL		0xFFFFU
+
 #define ACRN_IOREQ_STATE_PENDING	0U
 #define ACRN_IOREQ_STATE_COMPLETE	1U
 #define ACRN_IOREQ_STATE_PROCESSING	2U
@@ -40,6 +43,14 @@
 #define ACRN_IOREQ_DIR_READ		0U
 #define ACRN_IOREQ_DIR_WRITE		1U
 
+/* latency class stamped into acrn_io_request.latency_class */
+#define ACRN_IOREQ_CLASS_LATENCY	0U
+#define ACRN_IOREQ_CLASS_BULK		1U
+
+/* scheduling class of the requestor, stamped into acrn_io_request.requestor_class */
+#define ACRN_IOREQ_REQUESTOR_NORMAL	0U
+#define ACRN_IOREQ_REQUESTOR_RT		1U
+
 
 
 /* IOAPIC device model info */
@@ -62,6 +73,11 @@
 #define GUEST_FLAG_TEE				(1UL << 9U)	/* Whether the VM is TEE VM */
 #define GUEST_FLAG_REE				(1UL << 10U)	/* Whether the VM is REE VM */
 #define GUEST_FLAG_PMU_PASSTHROUGH	(1UL << 11U)    /* Whether PMU is passed through */
+#define GUEST_FLAG_VCPU_MIGRATION	(1UL << 12U)	/* Whether vCPUs may float within the VM's cpu_affinity */
+#define GUEST_FLAG_VPMU			(1UL << 13U)	/* Whether the VM gets an emulated PMU (vPMU) */
+#define GUEST_FLAG_EXCLUSIVE_CORE	(1UL << 14U)	/* Whether the VM's pCPUs are owned exclusively, shared with no other VM */
+#define GUEST_FLAG_NO_SMT_SHARING	(1UL << 15U)	/* Whether SMT siblings of the VM's pCPUs must not run other VMs */
+#define GUEST_FLAG_SAME_LLC		(1UL << 16U)	/* Whether all the VM's pCPUs must share the last level cache */
 
 
 /* TODO: We may need to get this addr from guest ACPI instead of hardcode here */
@@ -293,11 +309,47 @@ struct acrn_io_request {
 	uint32_t completion_polling;
 
 	/**
-	 * @brief Reserved.
+	 * @brief Placement hint: the pCPU the requestor vCPU was running on
+	 * when the hypervisor inserted this request.
+	 *
+	 * The DM may use it to keep its I/O request service thread near the
+	 * requestor so completion wakeups stay core-local.
 	 *
 	 * Byte offset: 8.
 	 */
-	uint32_t reserved0[14];
+	uint32_t client_pcpu_id;
+
+	/**
+	 * @brief Latency class of this request, ACRN_IOREQ_CLASS_*.
+	 *
+	 * Stamped by the hypervisor from the request origin: port I/O and PCI
+	 * config accesses are latency-sensitive (a vCPU typically spins on
+	 * them), MMIO accesses are bulk. The DM may service the classes from
+	 * separate queues so a slow bulk handler does not delay a trivial PIO
+	 * read queued behind it.
+	 *
+	 * Byte offset: 12.
+	 */
+	uint32_t latency_class;
+
+	/**
+	 * @brief Scheduling class of the requestor vCPU, ACRN_IOREQ_REQUESTOR_*.
+	 *
+	 * Stamped by the hypervisor from the requestor VM's guest flags. The
+	 * DM may propagate it to the servicing thread's scheduling policy for
+	 * the duration of the request, so an RT vCPU blocked on I/O is not
+	 * held up by bulk Service VM work preempting its servicer.
+	 *
+	 * Byte offset: 16.
+	 */
+	uint32_t requestor_class;
+
+	/**
+	 * @brief Reserved.
+	 *
+	 * Byte offset: 20.
+	 */
+	uint32_t reserved0[11];
 
 	/**
 	 * @brief Details about this request.
@@ -456,6 +508,100 @@ struct acrn_vcpu_regs {
 	struct acrn_regs vcpu_regs;
 };
 
+/**
+ * @brief Info to hot-add a vcpu to a running VM
+ *
+ * the parameter for HC_CREATE_VCPU
+ */
+struct acrn_vcpu_create {
+	/** the physical CPU that will carry the new vcpu */
+	uint16_t pcpu_id;
+
+	/** reserved space to align to 8 bytes */
+	uint16_t reserved[3];
+};
+
+/**
+ * @brief Per-vCPU paravirtualized clock time info page
+ *
+ * The guest enables it by writing the GPA of this structure (with bit 0
+ * set) to the PV clock MSR. Reads follow the kvmclock math and seqlock:
+ * retry while version is odd or changed across the read, then
+ *
+ *   delta = rdtsc() - tsc_timestamp, shifted left by tsc_shift
+ *           (right if negative)
+ *   time_ns = system_time + ((delta * tsc_to_system_mul) >> 32)
+ *
+ * The hypervisor refreshes the page whenever the vCPU is switched in or
+ * its TSC is rewritten, so time_ns stays continuous across migration
+ * and restore even when the guest TSC jumps.
+ */
+struct acrn_pvclock_vcpu_time_info {
+	uint32_t version;
+	uint32_t pad0;
+	uint64_t tsc_timestamp;
+	uint64_t system_time;
+	uint32_t tsc_to_system_mul;
+	int8_t tsc_shift;
+	uint8_t flags;
+	uint8_t pad[2];
+} __packed;
+
+/* the guest's idle governor polls for work itself (idle=poll or a
+ * haltpoll-style driver), so hypervisor-side halt polling is redundant
+ */
+#define ACRN_PV_IDLE_GUEST_POLLING	(1U << 0U)
+
+/**
+ * @brief Per-vCPU paravirtualized idle coordination page
+ *
+ * The guest enables it by writing the GPA of this structure (with bit 0
+ * set) to the PV idle MSR, then keeps flags up to date as its idle
+ * policy changes. The hypervisor consults the page on HLT: a vCPU that
+ * declares ACRN_PV_IDLE_GUEST_POLLING has already paid its poll window
+ * in guest context, so the vCPU is descheduled immediately instead of
+ * spinning through the adaptive host-side halt-poll window as well.
+ */
+struct acrn_pv_idle_info {
+	/** guest idle-poll intentions, ACRN_PV_IDLE_* flags */
+	uint32_t flags;
+	uint32_t pad[3];
+} __packed;
+
+/* number of entry slots in one acrn_pv_msr_page */
+#define ACRN_PV_MSR_MAX_ENTRIES	16U
+
+/**
+ * @brief One shadowed MSR in the PV MSR page
+ */
+struct acrn_pv_msr_entry {
+	/** MSR index this entry shadows */
+	uint32_t msr;
+	uint32_t pad;
+	/** last value published by the hypervisor */
+	uint64_t value;
+} __packed;
+
+/**
+ * @brief Per-vCPU paravirtualized MSR shadow page
+ *
+ * The guest enables it by writing the GPA of this structure (with bit 0
+ * set) to the PV MSR shadow MSR. The hypervisor fills entries[] with the
+ * MSR indexes it shadows and refreshes the values at a bounded rate while
+ * the vCPU runs. Before a RDMSR of a read-mostly MSR the guest scans the
+ * first nr_entries slots: on a hit it uses the value under the usual
+ * seqlock discipline (retry while version is odd or changed across the
+ * read); on a miss it falls back to the ordinary RDMSR exit path.
+ */
+struct acrn_pv_msr_page {
+	/** seqlock generation, odd while an update is in flight */
+	uint32_t version;
+	/** number of valid slots in entries[] */
+	uint32_t nr_entries;
+	/** the shadowed MSRs */
+	struct acrn_pv_msr_entry entries[ACRN_PV_MSR_MAX_ENTRIES];
+} __packed;
+
 /** Operation types for setting IRQ line */
 #define GSI_SET_HIGH		0U
 #define GSI_SET_LOW		1U
@@ -582,6 +728,10 @@ struct acrn_intr_monitor {
 /** cmd for intr monitor **/
 #define INTR_CMD_GET_DATA 0U
 #define INTR_CMD_DELAY_INT 1U
+/** buffer[0] is the per-entry rate limit (interrupts per second), 0 to cancel */
+#define INTR_CMD_SET_RATE_LIMIT 2U
+/** fills the buffer with (pirq, times storm-masked) pairs */
+#define INTR_CMD_GET_STORM_DATA 3U
 
 /*
  * PRE_LAUNCHED_VM is launched by ACRN hypervisor, with LAPIC_PT;
@@ -681,6 +831,51 @@ struct acrn_mmiodev {
 	} res[MMIODEV_RES_NUM];
 };
 
+/**
+ * @brief Request MMIO write coalescing instead of an EPT mapping
+ *
+ * When this bit is set in the mem_type of res[0], the acrn_mmiodev does not
+ * describe a pass-through MMIO device: res[0] is a doorbell GPA range whose
+ * writes the hypervisor may coalesce, and res[1] is the guest page holding
+ * the acrn_coalesced_mmio_ring the absorbed writes are delivered through.
+ * The bit lies outside the EPT memory type mask.
+ */
+#define ACRN_MEM_TYPE_WC_DOORBELL	(1UL << 8U)
+
+/**
+ * @brief One MMIO write absorbed by the hypervisor
+ */
+struct acrn_coalesced_mmio {
+	/** the gpa the guest wrote to */
+	uint64_t address;
+	/** the value written */
+	uint64_t value;
+	/** the access width in bytes */
+	uint32_t size;
+	/** reserved */
+	uint32_t reserved;
+};
+
+#define ACRN_COALESCED_MMIO_MAX \
+	((4096U - 2U * sizeof(uint32_t)) / sizeof(struct acrn_coalesced_mmio))
+
+/**
+ * @brief Ring of coalesced MMIO writes, occupying one guest page
+ *
+ * The hypervisor is the producer and advances last; the consumer in the
+ * Service VM drains entries and advances first. When the ring is full the
+ * write falls back to a regular I/O request, and the consumer flushes the
+ * ring before handling any I/O request, which preserves write ordering.
+ */
+struct acrn_coalesced_mmio_ring {
+	/** consumer index, owned by the Service VM */
+	uint32_t first;
+	/** producer index, owned by the hypervisor */
+	uint32_t last;
+	/** the coalesced writes */
+	struct acrn_coalesced_mmio entry[ACRN_COALESCED_MMIO_MAX];
+};
+
 /**
  * @brief Info to create or destroy a virtual PCI or legacy device for a VM
  *
@@ -29,6 +29,10 @@
 #define HC_GET_API_VERSION          BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x00UL)
 #define HC_SERVICE_VM_OFFLINE_CPU   BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x01UL)
 #define HC_SET_CALLBACK_VECTOR      BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x02UL)
+#define HC_BATCH                    BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x03UL)
+#define HC_SETUP_VM_STATS           BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x04UL)
+#define HC_SET_RDT_CONFIG           BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x05UL)
+#define HC_PIN_HC_BUFFER            BASE_HC_ID(HC_ID, HC_ID_GEN_BASE + 0x06UL)
 
 /* VM management */
 #define HC_ID_VM_BASE               0x10UL
@@ -39,6 +43,8 @@
 #define HC_CREATE_VCPU              BASE_HC_ID(HC_ID, HC_ID_VM_BASE + 0x04UL)
 #define HC_RESET_VM                 BASE_HC_ID(HC_ID, HC_ID_VM_BASE + 0x05UL)
 #define HC_SET_VCPU_REGS            BASE_HC_ID(HC_ID, HC_ID_VM_BASE + 0x06UL)
+#define HC_GET_LAUNCH_PROFILE       BASE_HC_ID(HC_ID, HC_ID_VM_BASE + 0x07UL)
+#define HC_GET_VCPU_REGS            BASE_HC_ID(HC_ID, HC_ID_VM_BASE + 0x08UL)
 
 /* IRQ and Interrupts */
 #define HC_ID_IRQ_BASE              0x20UL
@@ -56,6 +62,7 @@
 #define HC_VM_GPA2HPA               BASE_HC_ID(HC_ID, HC_ID_MEM_BASE + 0x01UL)
 #define HC_VM_SET_MEMORY_REGIONS    BASE_HC_ID(HC_ID, HC_ID_MEM_BASE + 0x02UL)
 #define HC_VM_WRITE_PROTECT_PAGE    BASE_HC_ID(HC_ID, HC_ID_MEM_BASE + 0x03UL)
+#define HC_VM_DIRTY_TRACK           BASE_HC_ID(HC_ID, HC_ID_MEM_BASE + 0x04UL)
 
 /* PCI assignment*/
 #define HC_ID_PCI_BASE              0x50UL
@@ -87,6 +94,7 @@
 /* Power management */
 #define HC_ID_PM_BASE               0x80UL
 #define HC_PM_GET_CPU_STATE         BASE_HC_ID(HC_ID, HC_ID_PM_BASE + 0x00UL)
+#define HC_SET_PERF_PROFILE         BASE_HC_ID(HC_ID, HC_ID_PM_BASE + 0x01UL)
 
 /* X86 TEE */
 #define HC_ID_TEE_BASE              0x90UL
@@ -183,6 +191,39 @@ struct wp_data {
 	uint64_t gpa;
 } __aligned(8);
 
+/* commands for HC_VM_DIRTY_TRACK */
+#define ACRN_DIRTY_TRACK_START		0U
+#define ACRN_DIRTY_TRACK_HARVEST	1U
+#define ACRN_DIRTY_TRACK_STOP		2U
+
+/**
+ * @brief Info to control EPT dirty-page tracking of a VM
+ *
+ * the parameter for HC_VM_DIRTY_TRACK hypercall. The hypervisor sets one
+ * bit per dirtied 4K guest page in the Service VM provided bitmap; the
+ * caller harvests a round by atomically reading and clearing bitmap bits
+ * after ACRN_DIRTY_TRACK_HARVEST re-armed the logging. Pages dirtied while
+ * a round is in flight show up again in the next round, so the final round
+ * of an iterative pre-copy must be taken with the target VM paused.
+ */
+struct acrn_dirty_track_param {
+	/** ACRN_DIRTY_TRACK_START/HARVEST/STOP */
+	uint32_t cmd;
+
+	/** Reserved */
+	uint32_t reserved;
+
+	/** the guest physical address of the dirty bitmap, one bit per 4K
+	 *  guest page, 8 byte aligned; only used by ACRN_DIRTY_TRACK_START
+	 */
+	uint64_t bitmap_gpa;
+
+	/** size of the bitmap in bytes; writes beyond the pages it covers
+	 *  are not tracked
+	 */
+	uint64_t bitmap_size;
+} __aligned(8);
+
 /**
  * Setup parameter for share buffer, used for HC_SETUP_SBUF hypercall
  */
@@ -286,6 +327,205 @@ struct hc_api_version {
 	uint32_t minor_version;
 } __aligned(8);
 
+/* maximum number of sub-calls in one HC_BATCH hypercall */
+#define ACRN_BATCH_MAX_ENTRIES		64U
+
+/**
+ * One sub-call of the HC_BATCH hypercall
+ *
+ * HC_BATCH takes the GPA of an array of these entries as param1 and the
+ * number of entries as param2, and executes the sub-calls in sequence
+ * with a single VM exit. Nested HC_BATCH sub-calls are rejected.
+ */
+struct acrn_batch_entry {
+	/** hypercall ID of the sub-call */
+	uint64_t hcall_id;
+
+	/** param1 of the sub-call */
+	uint64_t param1;
+
+	/** param2 of the sub-call */
+	uint64_t param2;
+
+	/** return value of the sub-call, filled in by the hypervisor */
+	int64_t status;
+} __aligned(8);
+
+/**
+ * RDT CLOS configuration, used for HC_SET_RDT_CONFIG
+ *
+ * HC_SET_RDT_CONFIG takes the GPA of this structure as param2 and
+ * reprograms one CLOS of one RDT resource on every domain instance.
+ */
+struct acrn_rdt_config {
+	/** resource to program: 0 (L3 cache), 1 (L2 cache) or 2 (MBA) */
+	uint32_t res;
+
+	/** CLOS id to program */
+	uint16_t clos;
+
+	/** Reserved */
+	uint16_t reserved;
+
+	/** capacity bitmask (L3/L2) or delay throttling value (MBA) */
+	uint64_t value;
+} __aligned(8);
+
+/* struct acrn_hc_buf_pin.op */
+#define ACRN_HC_BUF_UNPIN		0U
+#define ACRN_HC_BUF_PIN			1U
+
+/**
+ * Hypercall argument buffer registration, used for HC_PIN_HC_BUFFER
+ *
+ * HC_PIN_HC_BUFFER takes the GPA of this structure as param2. On a pin
+ * the hypervisor caches the GPA->HVA translation of the described
+ * region and fills in the handle; copies from/to any GPA inside a
+ * pinned region then skip the EPT walk. The region must start on a
+ * page boundary and be physically contiguous. Cached translations are
+ * dropped automatically when EPT mutation touches their range.
+ */
+struct acrn_hc_buf_pin {
+	/** ACRN_HC_BUF_PIN or ACRN_HC_BUF_UNPIN */
+	uint32_t op;
+
+	/** region handle: filled in on pin, identifies the region on unpin */
+	uint32_t handle;
+
+	/** guest-physical base of the argument region, page aligned */
+	uint64_t gpa;
+
+	/** size of the region in bytes */
+	uint64_t size;
+} __aligned(8);
+
+/**
+ * TSC stamps of guest launch phases, used for HC_GET_LAUNCH_PROFILE
+ *
+ * HC_GET_LAUNCH_PROFILE takes the relative vm id as param1 and the GPA
+ * of this structure as param2, and fills in the timestamps the
+ * hypervisor recorded while bringing the VM up. Stamps of phases that
+ * have not happened yet read as 0.
+ */
+struct acrn_vm_launch_profile {
+	/** TSC frequency in kHz, for converting stamps to wall time */
+	uint32_t tsc_khz;
+
+	/** Reserved */
+	uint32_t reserved;
+
+	/** TSC when create_vm() was entered */
+	uint64_t create_vm_entry;
+
+	/** TSC when create_vm() returned */
+	uint64_t create_vm_exit;
+
+	/** TSC when the BSP was first woken to run */
+	uint64_t first_vcpu_launch;
+} __aligned(8);
+
+/* layout version of struct acrn_vm_stats */
+#define ACRN_VM_STATS_VERSION		7U
+
+/* number of vcpu slots in one stats page; the slots grew to two cache
+ * lines in version 3, so together with the 64-byte header 31 of them
+ * fit in one 4K page */
+#define ACRN_VM_STATS_MAX_VCPUS		31U
+
+/**
+ * Per-vCPU run-state statistics, published into the VM stats page.
+ *
+ * The seq field follows seqlock conventions: it is odd while the
+ * hypervisor is updating the entry. Readers should re-read the entry
+ * when seq is odd or changed across the read. All counters accumulate
+ * since VM start; rates are obtained by sampling twice.
+ */
+struct acrn_vcpu_stats {
+	/** seqlock generation of this entry */
+	uint32_t seq;
+
+	/** Reserved */
+	uint32_t reserved;
+
+	/** TSC timestamp of the last publication */
+	uint64_t last_update_tsc;
+
+	/** TSC cycles this vCPU spent running on a pCPU */
+	uint64_t run_cycles;
+
+	/** TSC cycles this vCPU was runnable but waiting for a pCPU */
+	uint64_t runnable_cycles;
+
+	/** total number of VM exits of this vCPU */
+	uint64_t vmexit_cnt;
+
+	/** number of times this vCPU was switched in */
+	uint64_t sched_in_cnt;
+
+	/** L3 cache occupancy of the VM in bytes (CMT), 0 if unsupported */
+	uint64_t l3_occupancy_bytes;
+
+	/** total memory bandwidth counter of the VM in bytes (MBM), 0 if unsupported */
+	uint64_t mem_bw_total_bytes;
+
+	/** INST_RETIRED.ANY sampled on the vCPU's pCPU, 0 if the fixed
+	 *  PMU counter is unavailable; advances while the guest makes
+	 *  progress even when it takes no VM exits, so together with
+	 *  vmexit_cnt and last_update_tsc it forms a heartbeat a
+	 *  Service VM watchdog can poll */
+	uint64_t inst_retired;
+
+	/** number of times the vCPU exhausted its scheduling reservation
+	 *  and had its budget recharged with a postponed deadline; only
+	 *  advances under the EDF scheduler class, 0 otherwise. A steadily
+	 *  climbing value means the configured (runtime, period) is too
+	 *  small for the workload */
+	uint64_t budget_overrun_cnt;
+
+	/** number of bus-lock VM exits this vCPU took (split-locked or
+	 *  UC-locked atomics); only advances on processors with bus-lock
+	 *  detection, 0 otherwise */
+	uint64_t bus_lock_cnt;
+} __aligned(64);
+
+/**
+ * VM statistics page shared with the Service VM, registered with the
+ * HC_SETUP_VM_STATS hypercall (param1 = relative vm id, param2 = GPA of
+ * one page of Service VM memory, or 0 to unregister).
+ */
+struct acrn_vm_stats {
+	/** layout version, ACRN_VM_STATS_VERSION */
+	uint32_t version;
+
+	/** number of valid entries in vcpu[] */
+	uint16_t nr_vcpu;
+
+	/** Reserved */
+	uint16_t reserved0;
+
+	/** EPT pagetable pages of this VM currently in use (version 5) */
+	uint32_t ept_pages_used;
+
+	/** high watermark of ept_pages_used since boot (version 5) */
+	uint32_t ept_pages_max_used;
+
+	/** capacity of this VM's EPT page pool (version 5); the gap to
+	 *  ept_pages_max_used is memory recoverable by resizing the pool */
+	uint32_t ept_pages_total;
+
+	/** IOTLB invalidations driven for this VM's iommu domain (version 6) */
+	uint32_t iotlb_inv_cnt;
+
+	/** worst synchronous IOTLB shootdown latency in us (version 6) */
+	uint32_t iotlb_inv_max_us;
+
+	/** Reserved, pads the header to one cache line */
+	uint16_t reserved[18];
+
+	/** per-vCPU statistics, indexed by vcpu id */
+	struct acrn_vcpu_stats vcpu[ACRN_VM_STATS_MAX_VCPUS];
+} __aligned(8);
+
 #define ACRN_PLATFORM_LAPIC_IDS_MAX	64U
 
 /**
@@ -196,6 +196,11 @@ int32_t mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const uint8
     uint32_t a[8];
     uint32_t i;
 
+    if (sha256_ni_supported()) {
+        sha256_ni_transform(ctx->state, data, 1U);
+        return 0;
+    }
+
     for (i = 0U; i < 8U; i++) {
         a[i] = ctx->state[i];
     }
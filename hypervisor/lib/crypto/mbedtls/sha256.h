@@ -121,6 +121,25 @@ int32_t mbedtls_sha256_finish_ret( mbedtls_sha256_context *ctx,
 int32_t mbedtls_internal_sha256_process( mbedtls_sha256_context *ctx,
                                      const uint8_t data[64] );
 
+/**
+ * \brief          Whether this CPU implements the Intel SHA extensions
+ *                 used by sha256_ni_transform().
+ */
+bool sha256_ni_supported( void );
+
+/**
+ * \brief          SHA-NI accelerated block compression, implemented in
+ *                 lib/crypto/sha256_ni.c. Processes \p num_blks
+ *                 consecutive 64-byte blocks into \p state. Must only
+ *                 be called when sha256_ni_supported() returns true.
+ *
+ * \param state    The intermediate digest state, eight 32-bit words.
+ * \param data     The buffer holding the data blocks.
+ * \param num_blks The number of 64-byte blocks to process.
+ */
+void sha256_ni_transform( uint32_t state[8], const uint8_t *data,
+                          size_t num_blks );
+
 /**
  * \brief          This function calculates the SHA-224 or SHA-256
  *                 checksum of a buffer.
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * SHA-256 block compression using the Intel SHA extensions (SHA-NI).
+ *
+ * The hypervisor is compiled with -mno-sse so the compiler never touches
+ * the SIMD registers, but hand written inline assembly may: the guest's
+ * FPU/SIMD state is resident in hardware while we run in VMX root mode,
+ * so every XMM register this routine borrows is spilled to the stack up
+ * front and restored before returning, with interrupts disabled across
+ * the whole transform so no context switch can observe the intermediate
+ * values.
+ *
+ * Register usage follows the conventional SHA-NI schedule: xmm0 carries
+ * the round constant + message sum (implicit operand of sha256rnds2),
+ * xmm1/xmm2 the working state in ABEF/CDGH order, xmm3-xmm6 the rolling
+ * four message schedule quadwords, xmm7 a scratch, xmm8 the byte flip
+ * mask and xmm9/xmm10 the saved state for the final additions.
+ */
+
+#include <types.h>
+#include <rtl.h>
+#include <asm/cpu.h>
+#include <asm/cpu_caps.h>
+#include <asm/cpufeatures.h>
+#include "mbedtls/sha256.h"
+
+#define SHA256_NI_XMM_REGS	11U
+
+/* same K constants as the portable implementation, 16-byte aligned so
+ * they can be used as direct paddd memory operands
+ */
+static const uint32_t sha256_ni_k[64] __aligned(16) =
+{
+	0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U,
+	0x3956C25BU, 0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U,
+	0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U,
+	0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U, 0xC19BF174U,
+	0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU,
+	0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU,
+	0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U,
+	0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U,
+	0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU, 0x53380D13U,
+	0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+	0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U,
+	0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U,
+	0x19A4C116U, 0x1E376C08U, 0x2748774CU, 0x34B0BCB5U,
+	0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+	0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U,
+	0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U,
+};
+
+/* pshufb control to convert each 32bit message word from big endian */
+static const uint8_t sha256_ni_flip_mask[16] __aligned(16) =
+{
+	0x03U, 0x02U, 0x01U, 0x00U, 0x07U, 0x06U, 0x05U, 0x04U,
+	0x0BU, 0x0AU, 0x09U, 0x08U, 0x0FU, 0x0EU, 0x0DU, 0x0CU,
+};
+
+bool sha256_ni_supported(void)
+{
+	return pcpu_has_cap(X86_FEATURE_SHA_NI);
+}
+
+void sha256_ni_transform(uint32_t state[8], const uint8_t *data, size_t num_blks)
+{
+	uint64_t rflags = 0UL;
+	uint8_t xmm_save[SHA256_NI_XMM_REGS * 16U];
+	const uint8_t *in = data;
+	const uint8_t *end = data + (num_blks << 6U);
+
+	if (num_blks != 0UL) {
+		CPU_INT_ALL_DISABLE(&rflags);
+
+		asm volatile (
+			/* spill the guest's live XMM registers */
+			"	movdqu	%%xmm0, 0x00(%[save])\n"
+			"	movdqu	%%xmm1, 0x10(%[save])\n"
+			"	movdqu	%%xmm2, 0x20(%[save])\n"
+			"	movdqu	%%xmm3, 0x30(%[save])\n"
+			"	movdqu	%%xmm4, 0x40(%[save])\n"
+			"	movdqu	%%xmm5, 0x50(%[save])\n"
+			"	movdqu	%%xmm6, 0x60(%[save])\n"
+			"	movdqu	%%xmm7, 0x70(%[save])\n"
+			"	movdqu	%%xmm8, 0x80(%[save])\n"
+			"	movdqu	%%xmm9, 0x90(%[save])\n"
+			"	movdqu	%%xmm10, 0xa0(%[save])\n"
+
+			/* load the digest and swizzle DCBA/HGFE -> ABEF/CDGH */
+			"	movdqu	0x00(%[state]), %%xmm1\n"
+			"	movdqu	0x10(%[state]), %%xmm2\n"
+			"	pshufd	$0xB1, %%xmm1, %%xmm1\n"
+			"	pshufd	$0x1B, %%xmm2, %%xmm2\n"
+			"	movdqa	%%xmm1, %%xmm7\n"
+			"	palignr	$8, %%xmm2, %%xmm1\n"
+			"	pblendw	$0xF0, %%xmm7, %%xmm2\n"
+			"	movdqa	(%[flip]), %%xmm8\n"
+
+			"1:\n"
+			"	movdqa	%%xmm1, %%xmm9\n"
+			"	movdqa	%%xmm2, %%xmm10\n"
+
+			/* rounds 0-3 */
+			"	movdqu	0x00(%[data]), %%xmm0\n"
+			"	pshufb	%%xmm8, %%xmm0\n"
+			"	movdqa	%%xmm0, %%xmm3\n"
+			"	paddd	0x00(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+
+			/* rounds 4-7 */
+			"	movdqu	0x10(%[data]), %%xmm0\n"
+			"	pshufb	%%xmm8, %%xmm0\n"
+			"	movdqa	%%xmm0, %%xmm4\n"
+			"	paddd	0x10(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm4, %%xmm3\n"
+
+			/* rounds 8-11 */
+			"	movdqu	0x20(%[data]), %%xmm0\n"
+			"	pshufb	%%xmm8, %%xmm0\n"
+			"	movdqa	%%xmm0, %%xmm5\n"
+			"	paddd	0x20(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm5, %%xmm4\n"
+
+			/* rounds 12-15 */
+			"	movdqu	0x30(%[data]), %%xmm0\n"
+			"	pshufb	%%xmm8, %%xmm0\n"
+			"	movdqa	%%xmm0, %%xmm6\n"
+			"	paddd	0x30(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm6, %%xmm7\n"
+			"	palignr	$4, %%xmm5, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm3\n"
+			"	sha256msg2	%%xmm6, %%xmm3\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm6, %%xmm5\n"
+
+			/* rounds 16-19 */
+			"	movdqa	%%xmm3, %%xmm0\n"
+			"	paddd	0x40(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm3, %%xmm7\n"
+			"	palignr	$4, %%xmm6, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm4\n"
+			"	sha256msg2	%%xmm3, %%xmm4\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm3, %%xmm6\n"
+
+			/* rounds 20-23 */
+			"	movdqa	%%xmm4, %%xmm0\n"
+			"	paddd	0x50(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm4, %%xmm7\n"
+			"	palignr	$4, %%xmm3, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm5\n"
+			"	sha256msg2	%%xmm4, %%xmm5\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm4, %%xmm3\n"
+
+			/* rounds 24-27 */
+			"	movdqa	%%xmm5, %%xmm0\n"
+			"	paddd	0x60(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm5, %%xmm7\n"
+			"	palignr	$4, %%xmm4, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm6\n"
+			"	sha256msg2	%%xmm5, %%xmm6\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm5, %%xmm4\n"
+
+			/* rounds 28-31 */
+			"	movdqa	%%xmm6, %%xmm0\n"
+			"	paddd	0x70(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm6, %%xmm7\n"
+			"	palignr	$4, %%xmm5, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm3\n"
+			"	sha256msg2	%%xmm6, %%xmm3\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm6, %%xmm5\n"
+
+			/* rounds 32-35 */
+			"	movdqa	%%xmm3, %%xmm0\n"
+			"	paddd	0x80(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm3, %%xmm7\n"
+			"	palignr	$4, %%xmm6, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm4\n"
+			"	sha256msg2	%%xmm3, %%xmm4\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm3, %%xmm6\n"
+
+			/* rounds 36-39 */
+			"	movdqa	%%xmm4, %%xmm0\n"
+			"	paddd	0x90(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm4, %%xmm7\n"
+			"	palignr	$4, %%xmm3, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm5\n"
+			"	sha256msg2	%%xmm4, %%xmm5\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm4, %%xmm3\n"
+
+			/* rounds 40-43 */
+			"	movdqa	%%xmm5, %%xmm0\n"
+			"	paddd	0xa0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm5, %%xmm7\n"
+			"	palignr	$4, %%xmm4, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm6\n"
+			"	sha256msg2	%%xmm5, %%xmm6\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm5, %%xmm4\n"
+
+			/* rounds 44-47 */
+			"	movdqa	%%xmm6, %%xmm0\n"
+			"	paddd	0xb0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm6, %%xmm7\n"
+			"	palignr	$4, %%xmm5, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm3\n"
+			"	sha256msg2	%%xmm6, %%xmm3\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm6, %%xmm5\n"
+
+			/* rounds 48-51 */
+			"	movdqa	%%xmm3, %%xmm0\n"
+			"	paddd	0xc0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm3, %%xmm7\n"
+			"	palignr	$4, %%xmm6, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm4\n"
+			"	sha256msg2	%%xmm3, %%xmm4\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+			"	sha256msg1	%%xmm3, %%xmm6\n"
+
+			/* rounds 52-55 */
+			"	movdqa	%%xmm4, %%xmm0\n"
+			"	paddd	0xd0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm4, %%xmm7\n"
+			"	palignr	$4, %%xmm3, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm5\n"
+			"	sha256msg2	%%xmm4, %%xmm5\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+
+			/* rounds 56-59 */
+			"	movdqa	%%xmm5, %%xmm0\n"
+			"	paddd	0xe0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	movdqa	%%xmm5, %%xmm7\n"
+			"	palignr	$4, %%xmm4, %%xmm7\n"
+			"	paddd	%%xmm7, %%xmm6\n"
+			"	sha256msg2	%%xmm5, %%xmm6\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+
+			/* rounds 60-63 */
+			"	movdqa	%%xmm6, %%xmm0\n"
+			"	paddd	0xf0(%[k]), %%xmm0\n"
+			"	sha256rnds2	%%xmm1, %%xmm2\n"
+			"	pshufd	$0x0E, %%xmm0, %%xmm0\n"
+			"	sha256rnds2	%%xmm2, %%xmm1\n"
+
+			"	paddd	%%xmm9, %%xmm1\n"
+			"	paddd	%%xmm10, %%xmm2\n"
+
+			"	add	$64, %[data]\n"
+			"	cmp	%[end], %[data]\n"
+			"	jne	1b\n"
+
+			/* swizzle ABEF/CDGH back and store the digest */
+			"	pshufd	$0x1B, %%xmm1, %%xmm1\n"
+			"	pshufd	$0xB1, %%xmm2, %%xmm2\n"
+			"	movdqa	%%xmm1, %%xmm7\n"
+			"	pblendw	$0xF0, %%xmm2, %%xmm1\n"
+			"	palignr	$8, %%xmm7, %%xmm2\n"
+			"	movdqu	%%xmm1, 0x00(%[state])\n"
+			"	movdqu	%%xmm2, 0x10(%[state])\n"
+
+			/* hand the guest its XMM registers back */
+			"	movdqu	0x00(%[save]), %%xmm0\n"
+			"	movdqu	0x10(%[save]), %%xmm1\n"
+			"	movdqu	0x20(%[save]), %%xmm2\n"
+			"	movdqu	0x30(%[save]), %%xmm3\n"
+			"	movdqu	0x40(%[save]), %%xmm4\n"
+			"	movdqu	0x50(%[save]), %%xmm5\n"
+			"	movdqu	0x60(%[save]), %%xmm6\n"
+			"	movdqu	0x70(%[save]), %%xmm7\n"
+			"	movdqu	0x80(%[save]), %%xmm8\n"
+			"	movdqu	0x90(%[save]), %%xmm9\n"
+			"	movdqu	0xa0(%[save]), %%xmm10\n"
+			: [data] "+r" (in)
+			: [state] "r" (state), [end] "r" (end),
+			  [k] "r" (sha256_ni_k), [flip] "r" (sha256_ni_flip_mask),
+			  [save] "r" (xmm_save)
+			: "memory", "cc");
+
+		CPU_INT_ALL_RESTORE(rflags);
+
+		/* the spill area held a fragment of guest register state */
+		(void)memset(xmm_save, 0U, sizeof(xmm_save));
+	}
+}
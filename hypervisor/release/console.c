@@ -31,3 +31,4 @@ void console_vmexit_callback(__unused struct acrn_vcpu *vcpu) {}
 
 void shell_init(void) {}
 void shell_kick(void) {}
+void shell_idle_process(void) {}
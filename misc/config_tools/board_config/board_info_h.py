@@ -67,6 +67,23 @@ def find_hi_mmio_window(config):
     print("#define HI_MMIO_SIZE\t\t\t{}UL".format(hex(board_cfg_lib.HI_MMIO_OFFSET)), file=config)
 
 
+# Capability pledges consumed by pcpu_has_cap_const() when CONFIG_FIXED_CAPS
+# is enabled: {macro name: capability id in the board XML}
+FIXED_CAP_FEATURES = {
+    'FIXED_CAP_XSAVE': 'xsave',
+    'FIXED_CAP_XSAVES': 'xsaves',
+    'FIXED_CAP_WAITPKG': 'waitpkg',
+    'FIXED_CAP_KEYLOCKER': 'kl',
+}
+
+def gen_fixed_caps(config):
+
+    caps = board_cfg_lib.get_processor_capabilities()
+    print("", file=config)
+    for macro, cap_id in FIXED_CAP_FEATURES.items():
+        print("#define {}\t\t\t{}U".format(macro, 1 if cap_id in caps else 0), file=config)
+
+
 def generate_file(config):
     # get cpu processor list
     cpu_list = board_cfg_lib.get_processor_info()
@@ -91,6 +108,9 @@ def generate_file(config):
     # generate HI_MMIO_START/HI_MMIO_END
     find_hi_mmio_window(config)
 
+    # generate FIXED_CAP_* pledges for CONFIG_FIXED_CAPS builds
+    gen_fixed_caps(config)
+
     p2sb = common.get_leaf_tag_map_bool(common.SCENARIO_INFO_FILE, "mmio_resources", "p2sb")
     if (common.LOAD_ORDER.get(0) == "PRE_LAUNCHED_VM"
         and board_cfg_lib.is_p2sb_passthru_possible()
@@ -531,6 +531,14 @@ class LEAF_D_1(CPUID):
     leaf = 0xD
 
     xsaveopt = cpuidfield(EAX, 0, 0, doc="XSAVEOPT is available")
+    xsavec = cpuidfield(EAX, 1, 1, doc="Supports XSAVEC and the compacted form of XRSTOR")
+    xsaves = cpuidfield(EAX, 3, 3, doc="Supports XSAVES/XRSTORS and IA32_XSS")
+
+    capability_bits = [
+        "xsaveopt",
+        "xsavec",
+        "xsaves",
+    ]
 
 class LEAF_D_n(CPUID):
     """Processor Extended State Enumeration Main Leaf and Sub-Leaves.
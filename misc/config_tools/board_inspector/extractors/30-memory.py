@@ -4,11 +4,26 @@
 #
 
 import logging
+import struct
 import lxml.etree
 
 from memmapparser import parse_e820, e820
 from extractors.helpers import get_node, add_child
 
+# FNV-1a, field by field in firmware map order; mirrors calc_fw_map_hash() in
+# hypervisor/arch/x86/e820.c so the prebuilt layout is only installed when the
+# map the bootloader hands over is byte-identical to the one inspected here.
+FNV1A_OFFSET_BASIS = 0xcbf29ce484222325
+FNV1A_PRIME = 0x00000100000001b3
+
+def fw_map_hash(e820_table):
+    acc = FNV1A_OFFSET_BASIS
+    for e820_entry in e820_table:
+        length = e820_entry.end - e820_entry.start + 1
+        for byte in struct.pack("<QQI", e820_entry.start, length, e820_entry.type):
+            acc = ((acc ^ byte) * FNV1A_PRIME) & 0xffffffffffffffff
+    return acc
+
 def extract_layout(memory_node):
     e820_table = parse_e820()
     for e820_entry in e820_table:
@@ -18,6 +33,21 @@ def extract_layout(memory_node):
             size = e820_entry.end - e820_entry.start + 1
             add_child(memory_node, "range", start=start, end=end, size=str(size))
 
+def extract_firmware_map(memory_node):
+    e820_table = parse_e820()
+    if any(e820_entry.type == e820.E820_TYPE_UNKNOWN for e820_entry in e820_table):
+        logging.info("The firmware memory map has entries of unrecognized types. A prebuilt e820 layout will not be generated.")
+        return
+
+    fw_map_node = add_child(memory_node, "firmware_map")
+    fw_map_node.set("hash", "0x{:016x}".format(fw_map_hash(e820_table)))
+    for e820_entry in e820_table:
+        start = "0x{:016x}".format(e820_entry.start)
+        size = e820_entry.end - e820_entry.start + 1
+        add_child(fw_map_node, "entry", start=start,
+                  size="0x{:016x}".format(size), type=str(e820_entry.type))
+
 def extract(args, board_etree):
     memory_node = get_node(board_etree, "//memory")
     extract_layout(memory_node)
+    extract_firmware_map(memory_node)
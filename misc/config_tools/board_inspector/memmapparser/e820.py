@@ -10,6 +10,7 @@ E820_TYPE_RAM = 1
 E820_TYPE_RESERVED = 2
 E820_TYPE_ACPI = 3
 E820_TYPE_NVS = 4
+E820_TYPE_UNUSABLE = 5
 E820_TYPE_UNKNOWN = 0xff
 
 name_of_types = {
@@ -17,6 +18,7 @@ name_of_types = {
     E820_TYPE_RESERVED: "Reserved",
     E820_TYPE_ACPI: "ACPI Tables",
     E820_TYPE_NVS: "ACPI Non-volatile Storage",
+    E820_TYPE_UNUSABLE: "Unusable memory",
     E820_TYPE_UNKNOWN: "Unknown E820 type",
 }
 
@@ -7,6 +7,7 @@ import re
 import sys
 import common
 import collections
+import defusedxml.ElementTree as ET
 
 BOARD_NAME = ''
 BIOS_INFO = ['BIOS Information', 'Vendor:', 'Version:', 'Release Date:', 'BIOS Revision:']
@@ -256,6 +257,20 @@ def get_processor_info():
     return tmp_list
 
 
+def get_processor_capabilities():
+    """
+    Get the capability ids common to all processor models in the board XML
+    :return: set of capability id strings
+    """
+    caps = None
+    root = ET.parse(common.BOARD_INFO_FILE).getroot()
+    for model in root.iter('model'):
+        model_caps = {cap.get('id') for cap in model.iter('capability')}
+        caps = model_caps if caps is None else (caps & model_caps)
+
+    return caps if caps is not None else set()
+
+
 def get_native_ttys_info(board_info):
     """
     Get ttySn from board info
@@ -23,8 +23,12 @@ policies = [
     GuestFlagPolicy(".//security_vm = 'y'", "GUEST_FLAG_SECURITY_VM"),
     GuestFlagPolicy(".//vm_type = 'RTVM'", "GUEST_FLAG_RT"),
     GuestFlagPolicy(".//vm_type = 'RTVM' and .//load_order = 'PRE_LAUNCHED_VM'", "GUEST_FLAG_PMU_PASSTHROUGH"),
+    GuestFlagPolicy(".//virtual_pmu_support = 'y'", "GUEST_FLAG_VPMU"),
     GuestFlagPolicy(".//vm_type = 'TEE_VM'", "GUEST_FLAG_TEE"),
     GuestFlagPolicy(".//vm_type = 'REE_VM'", "GUEST_FLAG_REE"),
+    GuestFlagPolicy(".//exclusive_core = 'y'", "GUEST_FLAG_EXCLUSIVE_CORE"),
+    GuestFlagPolicy(".//no_smt_sharing = 'y'", "GUEST_FLAG_NO_SMT_SHARING"),
+    GuestFlagPolicy(".//same_llc = 'y'", "GUEST_FLAG_SAME_LLC"),
 ]
 
 def fn(board_etree, scenario_etree, allocation_etree):
@@ -41,6 +41,7 @@
     <xsl:if test="$physical_address_bits">
       <xsl:value-of select="acrn:define('MAXIMUM_PA_WIDTH', $physical_address_bits[1], 'U')" />
     </xsl:if>
+    <xsl:call-template name="PREBUILT_E820" />
   </xsl:template>
 
   <xsl:template match="allocation-data/acrn-config">
@@ -68,6 +69,25 @@
     <xsl:value-of select="acrn:define('MAX_VMSIX_ON_MSI_PDEVS_NUM', sum(dyn:map(//device, 'acrn:is-vmsix-supported-device(./vendor, ./identifier)')), 'U')" />
   </xsl:template>
 
+  <xsl:template name="PREBUILT_E820">
+    <xsl:if test="count(//memory/firmware_map/entry)">
+      <xsl:value-of select="acrn:define('PREBUILT_E820_FW_MAP_HASH', //memory/firmware_map/@hash, 'UL')" />
+      <xsl:value-of select="acrn:define('PREBUILT_E820_NR', count(//memory/firmware_map/entry), 'U')" />
+      <xsl:text>#define PREBUILT_E820_ENTRIES \&#xa;</xsl:text>
+      <xsl:text>{ \&#xa;</xsl:text>
+      <xsl:for-each select="//memory/firmware_map/entry">
+        <xsl:text>&#9;{ .baseaddr = </xsl:text>
+        <xsl:value-of select="@start" />
+        <xsl:text>UL, .length = </xsl:text>
+        <xsl:value-of select="@size" />
+        <xsl:text>UL, .type = </xsl:text>
+        <xsl:value-of select="@type" />
+        <xsl:text>U }, \&#xa;</xsl:text>
+      </xsl:for-each>
+      <xsl:text>}&#xa;</xsl:text>
+    </xsl:if>
+  </xsl:template>
+
   <xsl:template match="MMIO">
     <xsl:value-of select="acrn:define('MMIO32_START', //MMIO32_START, 'UL')" />
     <xsl:value-of select="acrn:define('MMIO32_END', //MMIO32_END, 'UL')" />
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * acrnbench - microbenchmarks for ACRN hypervisor primitives.
+ *
+ * Runs inside a guest (including the Service VM) and measures the cost
+ * of the paths the hypervisor is on:
+ *
+ *   pio_read   - latency of an intercepted port I/O read (PCI config
+ *                address port 0xCF8, emulated by the vPCI layer)
+ *   mmio_read  - latency of a read from an emulated MMIO page given
+ *                with -m (mapped through /dev/mem)
+ *   hypercall  - round trip of a cheap hypercall through the HSM
+ *                (ACRN_IOCTL_PM_GET_CPU_STATE), Service VM only
+ *   ipi_wake   - cross-vCPU wakeup latency (futex wake between two
+ *                pinned threads, exercising vIPI injection when the
+ *                vCPUs run on different pCPUs)
+ *   timer      - jitter of a 1ms periodic CLOCK_MONOTONIC timer
+ *   tsc_gap    - largest gaps observed in a tight RDTSC loop
+ *                (preemption, steal time and interception artifacts)
+ *
+ * Each benchmark reports min/mean/p50/p99/p999 in TSC cycles as JSON,
+ * so runs before and after a hypervisor change can be diffed by
+ * machine. Unavailable benchmarks (missing privileges or devices) are
+ * reported as skipped instead of failing the whole run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/io.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* mirrors devicemodel/include/public/hsm_ioctl_defs.h */
+#define ACRN_IOCTL_TYPE			0xA2
+#define ACRN_IOCTL_PM_GET_CPU_STATE	_IOWR(ACRN_IOCTL_TYPE, 0x60, uint64_t)
+#define ACRN_PMCMD_GET_PX_CNT		0U
+
+#define DEFAULT_SAMPLES			20000
+#define WARMUP_SAMPLES			200
+#define TIMER_PERIOD_NS			1000000L	/* 1ms */
+
+static int nr_samples = DEFAULT_SAMPLES;
+static uint64_t mmio_addr;
+static int first_bench = 1;
+
+static inline uint64_t rdtsc_start(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t rdtsc_stop(void)
+{
+	uint32_t lo, hi, aux;
+
+	asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t tsc_khz_calibrate(void)
+{
+	struct timespec ts = { 0, 100000000L };	/* 100ms */
+	uint64_t t0, t1;
+
+	t0 = rdtsc_start();
+	nanosleep(&ts, NULL);
+	t1 = rdtsc_stop();
+
+	return (t1 - t0) / 100000;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *samples, int n)
+{
+	uint64_t sum = 0;
+	int i;
+
+	qsort(samples, n, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+
+	printf("%s\n    \"%s\": { \"samples\": %d, \"min\": %lu, \"mean\": %lu, "
+	       "\"p50\": %lu, \"p99\": %lu, \"p999\": %lu }",
+	       first_bench ? "" : ",", name, n, samples[0], sum / n,
+	       samples[n / 2], samples[((long)n * 99) / 100],
+	       samples[((long)n * 999) / 1000]);
+	first_bench = 0;
+}
+
+static void report_skipped(const char *name, const char *why)
+{
+	printf("%s\n    \"%s\": { \"skipped\": \"%s\" }",
+	       first_bench ? "" : ",", name, why);
+	first_bench = 0;
+}
+
+static void bench_pio(uint64_t *samples)
+{
+	uint64_t t0;
+	uint32_t val;
+	int i;
+
+	if (iopl(3) != 0) {
+		report_skipped("pio_read", "iopl failed, run as root");
+		return;
+	}
+
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		t0 = rdtsc_start();
+		val = inl(0xCF8);
+		(void)val;
+		if (i >= 0)
+			samples[i] = rdtsc_stop() - t0;
+	}
+	report("pio_read", samples, nr_samples);
+}
+
+static void bench_mmio(uint64_t *samples)
+{
+	volatile uint32_t *reg;
+	uint64_t t0;
+	uint32_t val;
+	void *map;
+	int fd, i;
+
+	if (mmio_addr == 0) {
+		report_skipped("mmio_read", "no -m address given");
+		return;
+	}
+
+	fd = open("/dev/mem", O_RDWR | O_SYNC);
+	if (fd < 0) {
+		report_skipped("mmio_read", "cannot open /dev/mem");
+		return;
+	}
+
+	map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		   mmio_addr & ~0xFFFUL);
+	close(fd);
+	if (map == MAP_FAILED) {
+		report_skipped("mmio_read", "mmap failed");
+		return;
+	}
+	reg = (volatile uint32_t *)((char *)map + (mmio_addr & 0xFFCUL));
+
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		t0 = rdtsc_start();
+		val = *reg;
+		(void)val;
+		if (i >= 0)
+			samples[i] = rdtsc_stop() - t0;
+	}
+	munmap(map, 4096);
+	report("mmio_read", samples, nr_samples);
+}
+
+static void bench_hypercall(uint64_t *samples)
+{
+	uint64_t t0, cmd;
+	int fd, i;
+
+	fd = open("/dev/acrn_hsm", O_RDWR);
+	if (fd < 0) {
+		report_skipped("hypercall", "cannot open /dev/acrn_hsm");
+		return;
+	}
+
+	cmd = ACRN_PMCMD_GET_PX_CNT;
+	if (ioctl(fd, ACRN_IOCTL_PM_GET_CPU_STATE, &cmd) < 0) {
+		close(fd);
+		report_skipped("hypercall", "PM_GET_CPU_STATE ioctl failed");
+		return;
+	}
+
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		cmd = ACRN_PMCMD_GET_PX_CNT;
+		t0 = rdtsc_start();
+		(void)ioctl(fd, ACRN_IOCTL_PM_GET_CPU_STATE, &cmd);
+		if (i >= 0)
+			samples[i] = rdtsc_stop() - t0;
+	}
+	close(fd);
+	report("hypercall", samples, nr_samples);
+}
+
+/* ipi_wake: waker thread on cpu0 stamps the TSC and futex-wakes the
+ * waiter pinned to cpu1; the waiter samples the TSC when it runs again.
+ * With the two vCPUs on different pCPUs this path goes through vlapic
+ * IPI injection for the rescheduling IPI of the guest kernel. */
+static struct {
+	volatile uint32_t futex_word;
+	volatile uint64_t t_wake;
+	uint64_t *samples;
+	int done;
+} ipi;
+
+static int pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *ipi_waiter(void *arg)
+{
+	int i;
+
+	(void)arg;
+	if (pin_to_cpu(1) != 0)
+		return (void *)1;
+
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		while (__atomic_load_n(&ipi.futex_word, __ATOMIC_ACQUIRE) == 0)
+			syscall(SYS_futex, &ipi.futex_word, FUTEX_WAIT, 0,
+				NULL, NULL, 0);
+		if (i >= 0)
+			ipi.samples[i] = rdtsc_stop() - ipi.t_wake;
+		__atomic_store_n(&ipi.futex_word, 0, __ATOMIC_RELEASE);
+	}
+	ipi.done = 1;
+	return NULL;
+}
+
+static void bench_ipi_wake(uint64_t *samples)
+{
+	struct timespec ts = { 0, 50000L };
+	pthread_t thrd;
+	void *ret;
+
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		report_skipped("ipi_wake", "needs at least 2 cpus");
+		return;
+	}
+	if (pin_to_cpu(0) != 0) {
+		report_skipped("ipi_wake", "cannot pin to cpu0");
+		return;
+	}
+
+	ipi.samples = samples;
+	ipi.done = 0;
+	if (pthread_create(&thrd, NULL, ipi_waiter, NULL) != 0) {
+		report_skipped("ipi_wake", "cannot create waiter thread");
+		return;
+	}
+
+	while (!ipi.done) {
+		/* let the waiter block before waking it */
+		nanosleep(&ts, NULL);
+		ipi.t_wake = rdtsc_start();
+		__atomic_store_n(&ipi.futex_word, 1, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &ipi.futex_word, FUTEX_WAKE, 1,
+			NULL, NULL, 0);
+	}
+
+	pthread_join(thrd, &ret);
+	if (ret != NULL)
+		report_skipped("ipi_wake", "cannot pin to cpu1");
+	else
+		report("ipi_wake", samples, nr_samples);
+}
+
+static void bench_timer(uint64_t *samples, uint64_t tsc_khz)
+{
+	struct timespec next;
+	uint64_t t0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		next.tv_nsec += TIMER_PERIOD_NS;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		t0 = rdtsc_start();
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		if (i >= 0) {
+			uint64_t period = (TIMER_PERIOD_NS * tsc_khz) / 1000000;
+			uint64_t delta = rdtsc_stop() - t0;
+
+			/* jitter: cycles late relative to the period */
+			samples[i] = (delta > period) ? (delta - period) : 0;
+		}
+	}
+	report("timer_jitter", samples, nr_samples);
+}
+
+static void bench_tsc_gap(uint64_t *samples)
+{
+	uint64_t prev, now;
+	int i;
+
+	prev = rdtsc_start();
+	for (i = -WARMUP_SAMPLES; i < nr_samples; i++) {
+		now = rdtsc_stop();
+		if (i >= 0)
+			samples[i] = now - prev;
+		prev = now;
+	}
+	report("tsc_gap", samples, nr_samples);
+}
+
+static void display_usage(void)
+{
+	printf("acrnbench - microbenchmarks for ACRN hypervisor primitives\n"
+	       "[Usage] acrnbench [-n samples] [-m mmio_addr] [-h]\n\n"
+	       "[Options]\n"
+	       "\t-h: print this message\n"
+	       "\t-n: samples per benchmark (default %d)\n"
+	       "\t-m: physical address of an emulated MMIO register to probe\n",
+	       DEFAULT_SAMPLES);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t *samples;
+	uint64_t tsc_khz;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:m:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_samples = atoi(optarg);
+			if (nr_samples <= 0) {
+				fprintf(stderr, "'-n' requires a positive integer\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'm':
+			mmio_addr = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			display_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	samples = calloc(nr_samples, sizeof(uint64_t));
+	if (!samples) {
+		fprintf(stderr, "failed to allocate sample buffer\n");
+		return EXIT_FAILURE;
+	}
+
+	tsc_khz = tsc_khz_calibrate();
+
+	printf("{\n  \"tsc_khz\": %lu,\n  \"benchmarks\": {", tsc_khz);
+
+	bench_pio(samples);
+	bench_mmio(samples);
+	bench_hypercall(samples);
+	bench_ipi_wake(samples);
+	bench_timer(samples, tsc_khz);
+	bench_tsc_gap(samples);
+
+	printf("\n  }\n}\n");
+
+	free(samples);
+	return EXIT_SUCCESS;
+}
@@ -107,7 +107,17 @@ static int cal_log_filepath(char **out, const struct log_t *log,
 /* get_log_file_* only used to copy regular file which can be mmaped */
 static void get_log_file_complete(const char *despath, const char *srcpath)
 {
-	const int ret = do_copy_tail(srcpath, despath, 0);
+	struct stat info;
+	int ret;
+
+	/* large images (guest cores) go through the parallel sparse
+	 * pipeline; everything else stays on the single sendfile path
+	 */
+	if (!stat(srcpath, &info) &&
+	    (size_t)info.st_size >= PARALLEL_COPY_THRESHOLD)
+		ret = do_copy_parallel(srcpath, despath);
+	else
+		ret = do_copy_tail(srcpath, despath, 0);
 
 	if (ret < 0) {
 		LOGE("copy (%s) failed, error (%s)\n", srcpath,
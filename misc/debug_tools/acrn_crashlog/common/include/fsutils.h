@@ -36,6 +36,11 @@
 #define CPBUFFERSIZE            (4 * KB)
 #define PAGE_SIZE               (4 * KB)
 
+/* parallel copy pipeline for large images (guest cores) */
+#define PARALLEL_COPY_CHUNK     (4 * MB)
+#define PARALLEL_COPY_WORKERS   8
+#define PARALLEL_COPY_THRESHOLD ((size_t)64 * MB)
+
 struct mm_file_t {
 	char *path;
 	int fd;
@@ -106,6 +111,17 @@ int file_read_int(const char *filename, unsigned int *pcurrent);
 int file_update_int(const char *filename, unsigned int current,
 			unsigned int max);
 int do_copy_limit(const char *src, const char *des, size_t limitsize);
+
+/**
+ * Copy a large regular file with striped worker threads, skipping all-zero
+ * pages so the destination stays sparse.
+ *
+ * @param src Path of source file.
+ * @param dest Path of destin file.
+ *
+ * @return 0 if successful, or -1 if not.
+ */
+int do_copy_parallel(const char *src, const char *dest);
 int space_available(const char *path, int quota);
 int count_lines_in_file(const char *filename);
 int read_full_binary_file(const char *path, unsigned long *size,
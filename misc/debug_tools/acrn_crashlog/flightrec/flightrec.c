@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/*
+ * Extract the hypervisor flight recorder after a (warm) reboot.
+ *
+ * The hypervisor keeps an always-on ring of high-priority trace events
+ * in an E820-reserved region that is not cleared across warm resets
+ * (see hypervisor/debug/trace.c). This tool maps the region through
+ * /dev/mem, validates the header and writes the events, oldest first,
+ * either as text or as raw entries consumable by the acrntrace scripts.
+ *
+ * The region address is printed by the hypervisor at boot
+ * ("flight recorder at 0x..."); pass it with -b, or let the tool scan
+ * the reserved E820 ranges of /proc/iomem for the header magic.
+ */
+
+/* must match hypervisor/debug/trace.c */
+#define FR_MAGIC		0x4452434C46565248UL
+#define FR_VERSION		1U
+#define FR_REGION_SIZE		(2UL * 1024UL * 1024UL)
+
+struct fr_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t entry_num;
+	uint64_t write_cnt;
+	uint32_t boot_cnt;
+	uint32_t tsc_khz;
+	uint64_t reserved[4];
+};
+
+/* must match struct trace_entry in hypervisor/debug/trace.c */
+struct trace_entry {
+	uint64_t tsc;
+	uint64_t id:48;
+	uint64_t n_data:8;
+	uint64_t cpu:8;
+	union {
+		struct {
+			uint32_t a, b, c, d;
+		} fields_32;
+		struct {
+			uint64_t e;
+			uint64_t f;
+		} fields_64;
+		char str[16];
+	} payload;
+} __attribute__((aligned(8)));
+
+static void display_usage(void)
+{
+	printf("acrnflightrec - extract the hypervisor flight recorder\n"
+	       "[Usage] acrnflightrec [-b base_addr] [-o out_file] [-rh]\n\n"
+	       "[Options]\n"
+	       "\t-h: print this message\n"
+	       "\t-b: physical base address of the recorder region (default: scan /proc/iomem)\n"
+	       "\t-o: write output to this file instead of stdout\n"
+	       "\t-r: dump raw trace entries (acrntrace format) instead of text\n");
+}
+
+static const struct fr_header *map_region(uint64_t base)
+{
+	const struct fr_header *hdr;
+	int fd;
+
+	fd = open("/dev/mem", O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open /dev/mem: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	hdr = mmap(NULL, FR_REGION_SIZE, PROT_READ, MAP_SHARED, fd, base);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		fprintf(stderr, "failed to map 0x%lx: %s\n", base, strerror(errno));
+		return NULL;
+	}
+
+	if (hdr->magic != FR_MAGIC || hdr->version != FR_VERSION ||
+	    hdr->entry_num != (FR_REGION_SIZE - sizeof(*hdr)) / sizeof(struct trace_entry)) {
+		munmap((void *)hdr, FR_REGION_SIZE);
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/* look for the recorder header in the reserved ranges of /proc/iomem */
+static const struct fr_header *scan_iomem(void)
+{
+	const struct fr_header *hdr = NULL;
+	uint64_t start, end;
+	char line[256];
+	FILE *fp;
+
+	fp = fopen("/proc/iomem", "r");
+	if (!fp) {
+		fprintf(stderr, "failed to open /proc/iomem: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strstr(line, "eserved"))
+			continue;
+		if (sscanf(line, "%lx-%lx", &start, &end) != 2)
+			continue;
+		if (end - start + 1 < FR_REGION_SIZE)
+			continue;
+		/* the region is carved from the top of a RAM window */
+		hdr = map_region(end + 1 - FR_REGION_SIZE);
+		if (!hdr && start != end + 1 - FR_REGION_SIZE)
+			hdr = map_region(start);
+		if (hdr)
+			break;
+	}
+
+	fclose(fp);
+	return hdr;
+}
+
+static void dump_text(FILE *out, const struct fr_header *hdr,
+		      const struct trace_entry *ring)
+{
+	uint64_t first, i;
+	const struct trace_entry *te;
+
+	fprintf(out, "# flight recorder: boot_cnt %u, %lu events total, tsc %u kHz\n",
+		hdr->boot_cnt, hdr->write_cnt, hdr->tsc_khz);
+
+	first = (hdr->write_cnt > hdr->entry_num) ?
+		(hdr->write_cnt - hdr->entry_num) : 0;
+	for (i = first; i < hdr->write_cnt; i++) {
+		te = &ring[i % hdr->entry_num];
+		fprintf(out, "%20lu cpu%-3u 0x%-8lx %016lx %016lx\n",
+			te->tsc, (uint32_t)te->cpu, (uint64_t)te->id,
+			te->payload.fields_64.e, te->payload.fields_64.f);
+	}
+}
+
+static void dump_raw(FILE *out, const struct fr_header *hdr,
+		     const struct trace_entry *ring)
+{
+	uint64_t first, i;
+
+	first = (hdr->write_cnt > hdr->entry_num) ?
+		(hdr->write_cnt - hdr->entry_num) : 0;
+	for (i = first; i < hdr->write_cnt; i++)
+		fwrite(&ring[i % hdr->entry_num],
+		       sizeof(struct trace_entry), 1, out);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct fr_header *hdr = NULL;
+	const struct trace_entry *ring;
+	uint64_t base = 0;
+	FILE *out = stdout;
+	int raw = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:o:rh")) != -1) {
+		switch (opt) {
+		case 'b':
+			base = strtoull(optarg, NULL, 0);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				fprintf(stderr, "failed to open %s: %s\n",
+					optarg, strerror(errno));
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		case 'h':
+		default:
+			display_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	hdr = base ? map_region(base) : scan_iomem();
+	if (!hdr) {
+		fprintf(stderr, "no valid flight recorder found%s\n",
+			base ? "" : " (try -b with the address from the hypervisor log)");
+		return EXIT_FAILURE;
+	}
+
+	ring = (const struct trace_entry *)(hdr + 1);
+	if (raw)
+		dump_raw(out, hdr, ring);
+	else
+		dump_text(out, hdr, ring);
+
+	if (out != stdout)
+		fclose(out);
+	munmap((void *)hdr, FR_REGION_SIZE);
+
+	return EXIT_SUCCESS;
+}
@@ -16,10 +16,28 @@
 #include <dirent.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sys/mman.h>
 
 #define LOG_ELEMENT_SIZE        80
 #define LOG_MSG_SIZE		480
 #define DEFAULT_POLL_INTERVAL	100000
+#define HVLOG_PAGE_SIZE		4096
+
+/* mirrors struct shared_buf in hypervisor/include/debug/sbuf.h */
+#define SBUF_MAGIC		0x5aa57aa71aa13aa3ULL
+#define SBUF_HEAD_SIZE		64
+
+struct shared_buf {
+	__u64 magic;
+	__u32 ele_num;		/* number of elements */
+	__u32 ele_size;		/* sizeof of elements */
+	__u32 head;		/* offset from base, to read */
+	__u32 tail;		/* offset from base, to write */
+	__u64 flags;
+	__u32 overrun_cnt;	/* count of overrun */
+	__u32 size;		/* ele_num * ele_size */
+	__u32 padding[6];
+};
 #define LOG_INCOMPLETE_WARNING	"WARNING: logs missing here! "\
 				"Try reducing polling interval"
 
@@ -76,6 +94,9 @@ struct hvlog_dev {
 	int fd;
 	struct hvlog_msg *msg;	/* pointer to msg */
 
+	struct shared_buf *sbuf;	/* mapped ring, NULL if mmap unsupported */
+	size_t sbuf_len;	/* length of the mapping */
+
 	int latched;		/* 1 if an sbuf element latched */
 	char entry_latch[LOG_ELEMENT_SIZE];	/* latch for an sbuf element */
 	struct hvlog_msg latched_msg;	/* latch for parsed msg */
@@ -107,6 +128,69 @@ static int get_dev_cnt(char *prefix)
 	return cnt;
 }
 
+/*
+ * Try to map the sbuf behind the hvlog device into our address space, the
+ * same way acrntrace maps its trace buffers. Map one page first to pick up
+ * the ring geometry from the header, then remap the full buffer. Failure
+ * is fine - the device is then drained through read() as before.
+ */
+static void hvlog_map_dev(struct hvlog_dev *dev, const char *path)
+{
+	struct shared_buf *sbuf;
+	size_t len;
+
+	sbuf = mmap(NULL, HVLOG_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, dev->fd, 0);
+	if (sbuf == MAP_FAILED)
+		return;
+
+	if (sbuf->magic != SBUF_MAGIC || sbuf->ele_size != LOG_ELEMENT_SIZE) {
+		munmap(sbuf, HVLOG_PAGE_SIZE);
+		return;
+	}
+
+	len = (SBUF_HEAD_SIZE + sbuf->size + HVLOG_PAGE_SIZE - 1)
+		& ~((size_t)HVLOG_PAGE_SIZE - 1);
+	munmap(sbuf, HVLOG_PAGE_SIZE);
+
+	sbuf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    dev->fd, 0);
+	if (sbuf == MAP_FAILED)
+		return;
+
+	dev->sbuf = sbuf;
+	dev->sbuf_len = len;
+	printf("%s: sbuf mapped, draining logs without syscalls\n", path);
+}
+
+/*
+ * Fetch one sbuf element, preferring the mapped ring: the hypervisor
+ * publishes a new element by storing tail, so a memcpy plus a head update
+ * drains the buffer without entering the kernel. Fall back to read()
+ * when the device could not be mapped.
+ */
+static int hvlog_fetch_element(struct hvlog_dev *dev, char *buf)
+{
+	struct shared_buf *sbuf = dev->sbuf;
+	__u32 head;
+
+	if (!sbuf)
+		return read(dev->fd, buf, LOG_ELEMENT_SIZE);
+
+	head = sbuf->head;
+	if (head == sbuf->tail)
+		return 0;
+
+	memcpy(buf, (char *)sbuf + SBUF_HEAD_SIZE + head, sbuf->ele_size);
+
+	head += sbuf->ele_size;
+	if (head >= sbuf->size)
+		head = 0;
+	sbuf->head = head;
+
+	return sbuf->ele_size;
+}
+
 /*
  * The function read a complete msg from acrnlog dev.
  * read one more sbuf entry if read an entry doesn't end with '\0'
@@ -138,9 +222,9 @@ struct hvlog_msg *hvlog_read_dev(struct hvlog_dev *dev)
 			memcpy(msg[0], msg[1], sizeof(struct hvlog_msg));
 		} else {
 			ret =
-			    read(dev->fd, &msg[0]->raw[msg[0]->len],
-				 LOG_ELEMENT_SIZE);
-			if (!ret)
+			    hvlog_fetch_element(dev,
+				 &msg[0]->raw[msg[0]->len]);
+			if (ret <= 0)
 				break;
 			/* do we read a new meaasge?
 			 * msg[0]->raw[msg[0]->len format: [%lluus][cpu=%d][sev=%d][seq=%llu]: */
@@ -202,7 +286,12 @@ struct hvlog_dev *hvlog_open_dev(const char *path)
 		goto open_dev;
 	}
 
-	dev->fd = open(path, O_RDONLY);
+	/* mapping the ring needs a writable fd to update the head pointer */
+	dev->fd = open(path, O_RDWR);
+	if (dev->fd >= 0)
+		hvlog_map_dev(dev, path);
+	else
+		dev->fd = open(path, O_RDONLY);
 	if (dev->fd < 0) {
 		printf("%s %d\n", __FUNCTION__, __LINE__);
 		goto open_fd;
@@ -232,6 +321,8 @@ void hvlog_close_dev(struct hvlog_dev *dev)
 
 	if (dev->msg)
 		free(dev->msg);
+	if (dev->sbuf)
+		munmap(dev->sbuf, dev->sbuf_len);
 	if (dev->fd > 0)
 		close(dev->fd);
 	free(dev);
@@ -298,6 +389,44 @@ static struct hvlog_msg *get_min_seq_msg(struct hvlog_data *data, int num_dev)
 	return msg;
 }
 
+/*
+ * Wait for more logs. With mapped rings the producer's tail store is the
+ * doorbell: poll it with exponential backoff, so a burst (e.g. a panic
+ * dump) is picked up within microseconds while an idle system still
+ * settles near the configured polling interval. Without any mapping the
+ * only way to probe a device is read(), so keep the plain sleep. The wait
+ * is bounded either way so read()-only devices are still polled.
+ */
+static void wait_for_logs(struct hvlog_data *data, int num_dev)
+{
+	unsigned long step = 100;
+	struct shared_buf *sbuf;
+	int i, mapped = 0;
+
+	for (i = 0; i < num_dev; i++) {
+		if (data[i].dev && data[i].dev->sbuf)
+			mapped++;
+	}
+	if (!mapped) {
+		usleep(interval);
+		return;
+	}
+
+	while (1) {
+		for (i = 0; i < num_dev; i++) {
+			sbuf = data[i].dev ? data[i].dev->sbuf : NULL;
+			if (sbuf && sbuf->head != sbuf->tail)
+				return;
+		}
+		usleep(step);
+		if (step >= interval)
+			return;
+		step *= 2;
+		if (step > interval)
+			step = interval;
+	}
+}
+
 static int new_log_file(struct hvlog_file *log)
 {
 	char file_name[32] = { };
@@ -356,7 +485,7 @@ static void *cur_read_func(void *arg)
 		hvlog_dev_read_msg(cur, cur_cnt);
 		msg = get_min_seq_msg(cur, cur_cnt);
 		if (!msg) {
-			usleep(interval);
+			wait_for_logs(cur, cur_cnt);
 			continue;
 		}
 
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <signal.h>
 #include <numa.h>
+#include <lz4frame.h>
 
 #include "acrntrace.h"
 
@@ -30,7 +31,7 @@ static int exiting = 0;
 
 /* for opt */
 static uint64_t period = 10000;
-static const char optString[] = "i:hcrt:a:";
+static const char optString[] = "i:hcrt:a:z";
 static const char dev_prefix[] = "acrn_trace_";
 
 static uint32_t flags = FLAG_CLEAR_BUF;
@@ -41,6 +42,20 @@ static int dev_cnt = 0; /* Count of /dev/acrn_trace_xxx devices */
 
 static struct bitmask *cpu_bitmask = NULL;
 
+/* compressed mode: queue of filled chunks handed to the writer thread;
+ * capacity covers every chunk buffer, so enqueuing never blocks and the
+ * only backpressure point is a reader waiting for its own chunk */
+static chunk_t **chunk_queue;
+static int q_head, q_tail, q_len, q_cap;
+static int writer_exit;
+static pthread_t writer_thrd;
+static int out_fd = -1;
+static int out_idx_fd = -1;
+static uint64_t out_off;	/* bytes already written to out_fd */
+static pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t q_notempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t chunk_done = PTHREAD_COND_INITIALIZER;
+
 static void display_usage(void)
 {
 	printf("acrntrace - tool to collect ACRN trace data\n"
@@ -51,7 +66,8 @@ static void display_usage(void)
 	       "\t-t: max time to capture trace data (in second)\n"
 	       "\t-c: clear the buffered old data (deprecated)\n"
 	       "\t-r: capture the buffered old data instead of clearing it\n"
-	       "\t-a: cpu-set: only capture the trace data on these configured cpu-set\n");
+	       "\t-a: cpu-set: only capture the trace data on these configured cpu-set\n"
+	       "\t-z: compress the trace data (LZ4) into a single output file\n");
 }
 
 static void timer_handler(union sigval sv)
@@ -130,6 +146,9 @@ static int parse_opt(int argc, char *argv[])
 		case 'a':
 			cpu_bitmask = numa_parse_cpustring_all(optarg);
 			break;
+		case 'z':
+			flags |= FLAG_COMPRESS;
+			break;
 		case 'h':
 			display_usage();
 			return -EINVAL;
@@ -217,6 +236,253 @@ static int create_trace_file_dir(char *dir)
 	return err;
 }
 
+static int write_full(int fd, const void *buf, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, buf, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("Failed to write trace file, errno %d\n", errno);
+			return -1;
+		}
+		buf += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+/* open <data_file>.idx next to a capture file and write its header;
+ * the index is an accelerator for offline analysis, not part of the
+ * capture, so on failure we log and carry on without one */
+static int idx_create(const char *data_file, uint32_t cpu_cnt)
+{
+	char idx_name[TRACE_FILE_NAME_LEN + 20];
+	idx_hdr_t hdr;
+	int fd;
+
+	if (snprintf(idx_name, sizeof(idx_name), "%s.idx", data_file)
+			>= (int)sizeof(idx_name))
+		printf("WARN: index file name is truncated\n");
+
+	fd = open(idx_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		pr_err("Failed to open %s, err %d - no index\n",
+		       idx_name, errno);
+		return -1;
+	}
+
+	memcpy(hdr.magic, IDX_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = IDX_FILE_VERSION;
+	hdr.cpu_cnt = cpu_cnt;
+	if (write_full(fd, &hdr, sizeof(hdr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* summarize one block of raw trace data into a sidecar index entry and
+ * append it; entries are fixed size so tools can binary-search them */
+static void idx_append(int idx_fd, uint32_t cpu, uint64_t file_off,
+		       const void *data, uint32_t len)
+{
+	const trace_ev_t *ev = data;
+	uint32_t i, n = len / TRACE_ELEMENT_SIZE;
+	idx_entry_t ent;
+
+	if (idx_fd <= 0 || n == 0)
+		return;
+
+	memset(&ent, 0, sizeof(ent));
+	ent.cpu = cpu;
+	ent.len = len;
+	ent.file_off = file_off;
+	ent.min_tsc = ev[0].tsc;
+	for (i = 0; i < n; i++) {
+		if (ev[i].tsc < ent.min_tsc)
+			ent.min_tsc = ev[i].tsc;
+		if (ev[i].tsc > ent.max_tsc)
+			ent.max_tsc = ev[i].tsc;
+		ent.ev_map |= 1UL << (ev[i].id & 63);
+	}
+	ent.ev_cnt = n;
+
+	write_full(idx_fd, &ent, sizeof(ent));
+}
+
+/* compress and interleave the filled chunks into the single output file */
+static void *writer_fn(__attribute__((unused)) void *arg)
+{
+	size_t bound = LZ4F_compressFrameBound(CHUNK_SIZE, NULL);
+	record_hdr_t hdr;
+	chunk_t *chunk;
+	size_t csize;
+	void *cbuf;
+
+	cbuf = malloc(bound);
+	if (!cbuf) {
+		pr_err("Failed to allocate compression buffer\n");
+		return NULL;
+	}
+
+	while (1) {
+		pthread_mutex_lock(&q_lock);
+		while (q_len == 0 && !writer_exit)
+			pthread_cond_wait(&q_notempty, &q_lock);
+		if (q_len == 0) {
+			pthread_mutex_unlock(&q_lock);
+			break;
+		}
+		chunk = chunk_queue[q_head];
+		q_head = (q_head + 1) % q_cap;
+		q_len--;
+		pthread_mutex_unlock(&q_lock);
+
+		csize = LZ4F_compressFrame(cbuf, bound,
+					   chunk->data, chunk->len, NULL);
+		if (LZ4F_isError(csize)) {
+			pr_err("LZ4 compression failed: %s\n",
+			       LZ4F_getErrorName(csize));
+		} else {
+			hdr.cpu = chunk->cpu;
+			hdr.raw_len = chunk->len;
+			hdr.comp_len = csize;
+			hdr.reserved = 0;
+			if (!write_full(out_fd, &hdr, sizeof(hdr)) &&
+			    !write_full(out_fd, cbuf, csize)) {
+				/* index the record while its raw data is
+				 * still at hand, before the chunk is
+				 * recycled to the reader */
+				idx_append(out_idx_fd, chunk->cpu, out_off,
+					   chunk->data, chunk->len);
+				out_off += sizeof(hdr) + csize;
+			}
+		}
+
+		pthread_mutex_lock(&q_lock);
+		chunk->len = 0;
+		chunk->busy = 0;
+		pthread_cond_broadcast(&chunk_done);
+		pthread_mutex_unlock(&q_lock);
+	}
+
+	free(cbuf);
+	return NULL;
+}
+
+static void unlock_q_lock(void *arg)
+{
+	pthread_mutex_unlock((pthread_mutex_t *)arg);
+}
+
+static void submit_chunk(chunk_t *chunk)
+{
+	pthread_mutex_lock(&q_lock);
+	chunk->busy = 1;
+	chunk_queue[q_tail] = chunk;
+	q_tail = (q_tail + 1) % q_cap;
+	q_len++;
+	pthread_cond_signal(&q_notempty);
+	pthread_mutex_unlock(&q_lock);
+}
+
+/*
+ * Switch the reader to its other chunk buffer, waiting for the writer
+ * to release it first. Such waits are the backpressure point of the
+ * pipeline and are counted per cpu.
+ */
+static chunk_t *next_chunk(param_t *param)
+{
+	chunk_t *chunk;
+
+	param->cur_idx ^= 1;
+	chunk = &param->chunks[param->cur_idx];
+
+	pthread_mutex_lock(&q_lock);
+	pthread_cleanup_push(unlock_q_lock, &q_lock);
+	if (chunk->busy)
+		param->stall_cnt++;
+	while (chunk->busy)
+		pthread_cond_wait(&chunk_done, &q_lock);
+	pthread_cleanup_pop(1);
+
+	return chunk;
+}
+
+/* consumer loop of the compressed mode: bulk-drain the sbuf into the
+ * current chunk and hand filled chunks over to the writer thread */
+static void reader_fn_compressed(param_t *param)
+{
+	shared_buf_t *sbuf = param->sbuf;
+	chunk_t *cur = &param->chunks[param->cur_idx];
+	int got;
+
+	while (1) {
+		got = sbuf_read_chunk(sbuf, cur->data + cur->len,
+				      CHUNK_SIZE - cur->len);
+		if (got > 0) {
+			cur->len += got;
+			param->bytes += got;
+			if (cur->len == CHUNK_SIZE) {
+				submit_chunk(cur);
+				cur = next_chunk(param);
+			}
+			continue;
+		}
+
+		/* sbuf drained: push out a partially filled chunk rather
+		 * than sitting on the data for a whole capture session */
+		if (cur->len != 0) {
+			submit_chunk(cur);
+			cur = next_chunk(param);
+		}
+
+		usleep(period);
+	}
+}
+
+/* flush the assembled block: capture file first, then its index entry,
+ * so an entry never describes data that did not reach the disk */
+static void flush_raw_block(param_t *param)
+{
+	if (write_full(param->trace_fd, param->raw_buf, param->raw_fill) == 0)
+		idx_append(param->idx_fd, param->devid, param->data_off,
+			   param->raw_buf, param->raw_fill);
+	param->data_off += param->raw_fill;
+	param->raw_fill = 0;
+}
+
+/* consumer loop of the indexed raw mode: assemble fixed-size blocks so
+ * every index entry covers a bounded slice of the capture file */
+static void reader_fn_raw(param_t *param)
+{
+	shared_buf_t *sbuf = param->sbuf;
+	int got;
+
+	while (1) {
+		got = sbuf_read_chunk(sbuf, param->raw_buf + param->raw_fill,
+				      CHUNK_SIZE - param->raw_fill);
+		if (got > 0) {
+			param->raw_fill += got;
+			if (param->raw_fill == CHUNK_SIZE)
+				flush_raw_block(param);
+			continue;
+		}
+
+		/* sbuf drained: complete the block rather than letting
+		 * data age in the assembly buffer across an idle spell */
+		if (param->raw_fill != 0)
+			flush_raw_block(param);
+
+		usleep(period);
+	}
+}
+
 /* function executed in each consumer thread */
 static void reader_fn(param_t * param)
 {
@@ -234,6 +500,17 @@ static void reader_fn(param_t * param)
 	if (flags & FLAG_CLEAR_BUF)
 		sbuf_clear_buffered(sbuf);
 
+	if (flags & FLAG_COMPRESS) {
+		reader_fn_compressed(param);
+		return;
+	}
+
+	if (param->raw_buf) {
+		reader_fn_raw(param);
+		return;
+	}
+
+	/* no block buffer: unindexed element-wise drain */
 	while (1) {
 		do {
 			ret = sbuf_write(fd, sbuf);
@@ -243,6 +520,91 @@ static void reader_fn(param_t * param)
 	}
 }
 
+/* open the single output file of the compressed mode and start the
+ * writer thread; must run before the reader threads are created */
+static int create_writer(void)
+{
+	char file_name[TRACE_FILE_DIR_LEN + 16];
+	file_hdr_t hdr;
+
+	if (snprintf(file_name, sizeof(file_name), "%s/trace.lz4s",
+		     trace_file_dir) >= (int)sizeof(file_name))
+		printf("WARN: output file name is truncated\n");
+
+	out_fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) {
+		pr_err("Failed to open %s, err %d\n", file_name, errno);
+		return -1;
+	}
+
+	memcpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_FILE_VERSION;
+	hdr.cpu_cnt = dev_cnt;
+	if (write_full(out_fd, &hdr, sizeof(hdr)))
+		return -1;
+	out_off = sizeof(hdr);
+
+	out_idx_fd = idx_create(file_name, dev_cnt);
+
+	q_cap = dev_cnt * CHUNK_NUM;
+	chunk_queue = calloc(q_cap, sizeof(chunk_t *));
+	if (!chunk_queue) {
+		pr_err("Failed to allocate chunk queue\n");
+		return -1;
+	}
+
+	if (pthread_create(&writer_thrd, NULL, writer_fn, NULL)) {
+		pr_err("failed to create writer thread\n");
+		return -1;
+	}
+
+	pr_info("compressed trace data file %s created\n", file_name);
+
+	return 0;
+}
+
+/* drain the chunk queue, stop the writer thread and report the
+ * per-cpu backpressure counters */
+static void destroy_writer(void)
+{
+	uint32_t dev_id;
+	param_t *param;
+
+	if (!(flags & FLAG_COMPRESS) || !writer_thrd)
+		return;
+
+	pthread_mutex_lock(&q_lock);
+	writer_exit = 1;
+	pthread_cond_signal(&q_notempty);
+	pthread_mutex_unlock(&q_lock);
+
+	if (pthread_join(writer_thrd, NULL) != 0)
+		pr_err("failed to join writer thread\n");
+	writer_thrd = 0;
+
+	foreach_dev(dev_id) {
+		if (!numa_bitmask_isbitset(cpu_bitmask, dev_id))
+			continue;
+		param = &reader[dev_id].param;
+		pr_info("cpu%u: %lu bytes captured, %lu writer stalls, %u sbuf overruns\n",
+			dev_id, param->bytes, param->stall_cnt,
+			param->overrun_cnt);
+		free(param->chunks);
+		param->chunks = NULL;
+	}
+
+	free(chunk_queue);
+	chunk_queue = NULL;
+
+	if (out_idx_fd >= 0) {
+		close(out_idx_fd);
+		out_idx_fd = -1;
+	}
+
+	close(out_fd);
+	out_fd = -1;
+}
+
 static int create_reader(reader_struct * reader, uint32_t dev_id)
 {
 	char trace_file_name[TRACE_FILE_NAME_LEN];
@@ -273,18 +635,36 @@ static int create_reader(reader_struct * reader, uint32_t dev_id)
 	       dev_id, reader->param.sbuf->magic, reader->param.sbuf->ele_num,
 	       reader->param.sbuf->ele_size);
 
-	if(snprintf(trace_file_name, TRACE_FILE_NAME_LEN, "%s/%d", trace_file_dir,
-		 dev_id) >= TRACE_FILE_NAME_LEN)
-		printf("WARN: trace file name is truncated\n");
-	reader->param.trace_fd = open(trace_file_name,
-					O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (!reader->param.trace_fd) {
-		pr_err("Failed to open %s, err %d\n", trace_file_name, errno);
-		return -3;
-	}
+	if (flags & FLAG_COMPRESS) {
+		reader->param.chunks = calloc(CHUNK_NUM, sizeof(chunk_t));
+		if (!reader->param.chunks) {
+			pr_err("Failed to allocate chunk buffers, %d\n", dev_id);
+			return -3;
+		}
+		reader->param.chunks[0].cpu = dev_id;
+		reader->param.chunks[1].cpu = dev_id;
+		reader->param.overrun_start = reader->param.sbuf->overrun_cnt;
+	} else {
+		if(snprintf(trace_file_name, TRACE_FILE_NAME_LEN, "%s/%d", trace_file_dir,
+			 dev_id) >= TRACE_FILE_NAME_LEN)
+			printf("WARN: trace file name is truncated\n");
+		reader->param.trace_fd = open(trace_file_name,
+						O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (!reader->param.trace_fd) {
+			pr_err("Failed to open %s, err %d\n", trace_file_name, errno);
+			return -3;
+		}
 
-	pr_info("trace data file %s created for %s\n",
-		trace_file_name, reader->dev_name);
+		reader->param.raw_buf = malloc(CHUNK_SIZE);
+		if (reader->param.raw_buf)
+			reader->param.idx_fd = idx_create(trace_file_name, 1);
+		else
+			pr_err("Failed to allocate block buffer, %d - no index\n",
+			       dev_id);
+
+		pr_info("trace data file %s created for %s\n",
+			trace_file_name, reader->dev_name);
+	}
 
 	if (pthread_create(&reader->thrd, NULL,
 			   (void *)&reader_fn, &reader->param)) {
@@ -305,6 +685,27 @@ static void destory_reader(reader_struct * reader)
 			reader->thrd = 0;
 	}
 
+	if ((flags & FLAG_COMPRESS) && reader->param.chunks) {
+		chunk_t *cur = &reader->param.chunks[reader->param.cur_idx];
+
+		/* hand a partially filled chunk over before the writer
+		 * thread is stopped; its buffer stays valid until
+		 * destroy_writer() */
+		if (!cur->busy && cur->len != 0)
+			submit_chunk(cur);
+		if (reader->param.sbuf)
+			reader->param.overrun_cnt = reader->param.sbuf->overrun_cnt -
+						    reader->param.overrun_start;
+	}
+
+	if (reader->param.raw_buf) {
+		/* complete the block the cancelled reader was assembling */
+		if (reader->param.raw_fill != 0)
+			flush_raw_block(&reader->param);
+		free(reader->param.raw_buf);
+		reader->param.raw_buf = NULL;
+	}
+
 	if (reader->param.sbuf) {
 		munmap(reader->param.sbuf, MMAP_SIZE);
 		reader->param.sbuf = NULL;
@@ -315,6 +716,11 @@ static void destory_reader(reader_struct * reader)
 		reader->dev_fd = 0;
 	}
 
+	if (reader->param.idx_fd > 0) {
+		close(reader->param.idx_fd);
+		reader->param.idx_fd = 0;
+	}
+
 	if (reader->param.trace_fd) {
 		close(reader->param.trace_fd);
 	}
@@ -334,6 +740,8 @@ static void handle_on_exit(void)
 		if (numa_bitmask_isbitset(cpu_bitmask, dev_id))
 			destory_reader(&reader[dev_id]);
 	}
+
+	destroy_writer();
 }
 
 static void signal_exit_handler(int sig)
@@ -390,6 +798,11 @@ int main(int argc, char *argv[])
 
 	/* acquair res for each trace dev */
 	flags |= FLAG_TO_REL;
+
+	if (flags & FLAG_COMPRESS)
+		if (create_writer() < 0)
+			exit(EXIT_FAILURE);
+
 	foreach_dev(dev_id) {
 		if (numa_bitmask_isbitset(cpu_bitmask, dev_id))
 			if (create_reader(&reader[dev_id], dev_id) < 0)
@@ -411,6 +824,8 @@ int main(int argc, char *argv[])
 			destory_reader(&reader[dev_id]);
 	}
 
+	destroy_writer();
+
 	free(reader);
 	flags &= ~FLAG_TO_REL;
 
@@ -38,9 +38,73 @@
  * flags:
  * FLAG_TO_REL   - resources need to be release
  * FLAG_CLEAR_BUF - to clear buffered old data
+ * FLAG_COMPRESS - stream LZ4-compressed data into a single output file
  */
 #define FLAG_TO_REL		(1UL << 0)
 #define FLAG_CLEAR_BUF		(1UL << 1)
+#define FLAG_COMPRESS		(1UL << 2)
+
+/* double buffering for the compressed mode: each reader drains its sbuf
+ * into one chunk while the writer thread compresses the other one */
+#define CHUNK_NUM		2
+#define CHUNK_SIZE		(256 * 1024)
+
+#define TRACE_FILE_MAGIC	"ACRNTRCZ"
+#define TRACE_FILE_VERSION	1
+
+/* header of the compressed trace file */
+typedef struct {
+	char magic[8];		/* TRACE_FILE_MAGIC, not NUL terminated */
+	uint32_t version;	/* TRACE_FILE_VERSION */
+	uint32_t cpu_cnt;	/* number of trace devices on this system */
+} file_hdr_t;
+
+/* each record that follows is this header plus comp_len bytes holding
+ * one LZ4 frame of raw trace data from one cpu */
+typedef struct {
+	uint32_t cpu;		/* trace device the data was read from */
+	uint32_t raw_len;	/* uncompressed payload length */
+	uint32_t comp_len;	/* compressed payload length */
+	uint32_t reserved;
+} record_hdr_t;
+
+typedef struct {
+	uint32_t cpu;
+	volatile uint32_t busy;	/* owned by the writer thread until cleared */
+	uint32_t len;		/* bytes of valid data */
+	uint8_t data[CHUNK_SIZE];
+} chunk_t;
+
+#define IDX_FILE_MAGIC		"ACRNTIDX"
+#define IDX_FILE_VERSION	1
+
+/* header of a sidecar index file, written next to a capture file as
+ * <capture file>.idx */
+typedef struct {
+	char magic[8];		/* IDX_FILE_MAGIC, not NUL terminated */
+	uint32_t version;	/* IDX_FILE_VERSION */
+	uint32_t cpu_cnt;	/* cpus indexed: dev_cnt for trace.lz4s,
+				 * 1 for a per-cpu raw file */
+} idx_hdr_t;
+
+/* One fixed-size entry per block of raw trace data: one record payload
+ * in compressed mode, one reader buffer flush in raw mode. The blocks
+ * of a cpu are appended in capture order, so the tsc range columns can
+ * be binary-searched to a time window without scanning the capture.
+ * ev_map has bit (event id & 63) set for every event in the block: a
+ * clear bit proves the event type is absent, a set bit may be a hash
+ * collision and the block still needs to be read. */
+typedef struct {
+	uint32_t cpu;		/* trace device the block came from */
+	uint32_t len;		/* raw (uncompressed) bytes covered */
+	uint64_t file_off;	/* block start in the capture file; the
+				 * record_hdr_t in compressed mode */
+	uint64_t min_tsc;	/* earliest event timestamp in the block */
+	uint64_t max_tsc;	/* latest event timestamp in the block */
+	uint64_t ev_map;	/* event id presence filter */
+	uint32_t ev_cnt;	/* number of trace events in the block */
+	uint32_t reserved;
+} idx_entry_t;
 
 #define foreach_dev(dev_id)                                       \
         for ((dev_id) = 0; (dev_id) < (dev_cnt); (dev_id)++)
@@ -76,6 +140,20 @@ typedef struct {
 	int trace_fd;
 	shared_buf_t *sbuf;
 	pthread_mutex_t *sbuf_lock;
+
+	/* compressed mode only */
+	chunk_t *chunks;	/* CHUNK_NUM chunk buffers */
+	int cur_idx;		/* chunk currently being filled */
+	uint64_t bytes;		/* raw bytes captured */
+	uint64_t stall_cnt;	/* times the reader waited for the writer */
+	uint32_t overrun_start;	/* sbuf->overrun_cnt when capture started */
+	uint32_t overrun_cnt;	/* overruns during the capture */
+
+	/* raw mode sidecar index */
+	int idx_fd;		/* <trace file>.idx, 0 if indexing is off */
+	uint8_t *raw_buf;	/* block assembly buffer, CHUNK_SIZE bytes */
+	uint32_t raw_fill;	/* bytes buffered in raw_buf */
+	uint64_t data_off;	/* bytes already written to trace_fd */
 } param_t;
 
 typedef struct {
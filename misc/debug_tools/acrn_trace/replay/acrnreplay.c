@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Replay an acrntrace per-pCPU binary stream against the hypervisor's
+ * scheduler sources built as a host library (see sim_env.c / shim/).
+ *
+ * The recorded TRACE_SCHED_NEXT events carry the name of each thread the
+ * production scheduler switched to. The harness reconstructs the wake and
+ * block pattern implied by that timeline, drives the simulated scheduler
+ * with it at the recorded TSC times, and compares every simulated pick
+ * against the recorded decision. A modified scheduler can thus be
+ * evaluated against a real workload trace in CI: agreement rate, queue
+ * depth and tick activity come out without production hardware time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "replay_if.h"
+
+/* one acrntrace record: TSC, event id, two payload words */
+struct trace_record {
+	uint64_t tsc;
+	uint64_t event;
+	uint64_t d1;
+	uint64_t d2;
+};
+
+#define EVENT_ID_MASK		0xffffffffffffUL
+#define TRACE_VM_EXIT		0x10UL
+#define TRACE_VM_ENTER		0x11UL
+#define TRACE_SCHED_NEXT	0x40000UL
+
+#define DEPTH_BUCKETS		8U
+
+static struct {
+	unsigned long switches;
+	unsigned long matches;
+	unsigned long vm_exits;
+	unsigned long depth_hist[DEPTH_BUCKETS];
+	unsigned int max_depth;
+	unsigned long pick_cnt[SIM_MAX_THREADS];
+	unsigned long recorded_cnt[SIM_MAX_THREADS];
+	char names[SIM_MAX_THREADS][SIM_NAME_LEN + 1];
+	int nr_names;
+} stats;
+
+static int is_idle_name(const char *name)
+{
+	return strncmp(name, "idle", 4) == 0;
+}
+
+static int name_slot(const char *name)
+{
+	int i;
+
+	for (i = 0; i < stats.nr_names; i++) {
+		if (strncmp(stats.names[i], name, SIM_NAME_LEN) == 0)
+			return i;
+	}
+	if (stats.nr_names < SIM_MAX_THREADS) {
+		strncpy(stats.names[stats.nr_names], name, SIM_NAME_LEN);
+		return stats.nr_names++;
+	}
+	return -1;
+}
+
+static void replay_switch(uint64_t tsc, const char *next_name, int prev_id)
+{
+	const char *picked;
+	unsigned int depth;
+	int slot, resched;
+
+	sim_set_now(tsc);
+
+	/* a simulated tick may have asked for a reschedule; remember it
+	 * before reconstructing the wake/block pattern
+	 */
+	resched = sim_resched_was_requested();
+
+	if (!is_idle_name(next_name)) {
+		int id = sim_thread_lookup(next_name);
+
+		if (id < 0)
+			id = sim_thread_create(next_name);
+		if (id >= 0 && sim_thread_state(id) == SIM_THREAD_BLOCKED)
+			sim_thread_wake(id);
+	}
+
+	/* the outgoing thread either blocked or was preempted. A switch to
+	 * idle means it blocked for sure; a switch to another thread with
+	 * no tick-driven reschedule pending is treated as blocking too,
+	 * since a runnable thread is only displaced by the tick
+	 */
+	if (prev_id >= 0 && (is_idle_name(next_name) || !resched))
+		sim_thread_block(prev_id);
+
+	picked = sim_pick_next();
+	depth = sim_runqueue_depth();
+
+	stats.switches++;
+	if (strncmp(picked, next_name, SIM_NAME_LEN) == 0 ||
+			(is_idle_name(picked) && is_idle_name(next_name)))
+		stats.matches++;
+
+	if (depth > stats.max_depth)
+		stats.max_depth = depth;
+	stats.depth_hist[depth < DEPTH_BUCKETS ? depth : DEPTH_BUCKETS - 1]++;
+
+	slot = name_slot(picked);
+	if (slot >= 0)
+		stats.pick_cnt[slot]++;
+	slot = name_slot(next_name);
+	if (slot >= 0)
+		stats.recorded_cnt[slot]++;
+}
+
+static int replay_file(const char *path)
+{
+	struct trace_record rec;
+	char name[SIM_NAME_LEN + 1];
+	int prev_id = -1;
+	int seen_sched = 0;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		uint64_t event = rec.event & EVENT_ID_MASK;
+
+		if (event == TRACE_VM_EXIT) {
+			if (seen_sched)
+				stats.vm_exits++;
+			continue;
+		}
+		if (event != TRACE_SCHED_NEXT)
+			continue;
+
+		memcpy(name, &rec.d1, 8);
+		memcpy(name + 8, &rec.d2, 8);
+		name[SIM_NAME_LEN] = '\0';
+
+		seen_sched = 1;
+		replay_switch(rec.tsc, name, prev_id);
+		prev_id = is_idle_name(name) ? -1 : sim_thread_lookup(name);
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static void report(FILE *out)
+{
+	unsigned int i;
+
+	fprintf(out, "acrnreplay: scheduler replay report\n");
+	fprintf(out, "-----------------------------------\n");
+	fprintf(out, "context switches replayed : %lu\n", stats.switches);
+	fprintf(out, "decisions matching trace  : %lu (%.1f%%)\n", stats.matches,
+		stats.switches ? (100.0 * stats.matches) / stats.switches : 0.0);
+	fprintf(out, "vm exits during replay    : %lu\n", stats.vm_exits);
+	fprintf(out, "simulated tick fires      : %lu\n", sim_tick_fires());
+	fprintf(out, "max runqueue depth        : %u\n", stats.max_depth);
+
+	fprintf(out, "\nrunqueue depth after each decision:\n");
+	for (i = 0; i < DEPTH_BUCKETS; i++) {
+		if (stats.depth_hist[i])
+			fprintf(out, "  %s%u : %lu\n",
+				(i == DEPTH_BUCKETS - 1) ? ">=" : "", i, stats.depth_hist[i]);
+	}
+
+	fprintf(out, "\n%-18s %12s %12s\n", "thread", "recorded", "simulated");
+	for (i = 0; i < (unsigned int)stats.nr_names; i++)
+		fprintf(out, "%-18s %12lu %12lu\n", stats.names[i],
+			stats.recorded_cnt[i], stats.pick_cnt[i]);
+}
+
+static void usage(void)
+{
+	printf("Usage: acrnreplay -i <trace_file> [-o <report_file>] [-f <tsc_mhz>]\n"
+	       "Replay one acrntrace per-pCPU binary stream against the scheduler\n"
+	       "sources and report decision agreement and queue depths.\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *ifile = NULL, *ofile = NULL;
+	double tsc_mhz = 1881.6;
+	FILE *out = stdout;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "hi:o:f:")) != -1) {
+		switch (opt) {
+		case 'i':
+			ifile = optarg;
+			break;
+		case 'o':
+			ofile = optarg;
+			break;
+		case 'f':
+			tsc_mhz = atof(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (!ifile) {
+		usage();
+		return 1;
+	}
+
+	sim_init((unsigned long)(tsc_mhz * 1000.0));
+
+	if (replay_file(ifile) < 0)
+		return 1;
+
+	if (ofile) {
+		out = fopen(ofile, "w");
+		if (!out) {
+			perror(ofile);
+			return 1;
+		}
+	}
+	report(out);
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Interface between the trace parser (acrnreplay.c, built against host
+ * headers) and the simulator environment (sim_env.c, built against the
+ * hypervisor headers through the shim). Only plain C types cross it.
+ */
+
+#ifndef REPLAY_IF_H
+#define REPLAY_IF_H
+
+#define SIM_MAX_THREADS		64
+#define SIM_NAME_LEN		16
+
+#define SIM_THREAD_BLOCKED	0
+#define SIM_THREAD_QUEUED	1
+
+/* set up pCPU 0 with the BVT scheduler; tsc_khz scales the mcu/tick */
+void sim_init(unsigned long tsc_khz);
+
+/* register a thread with the scheduler, initially blocked; returns its
+ * id, or -1 when the table is full or the name is already taken
+ */
+int sim_thread_create(const char *name);
+int sim_thread_lookup(const char *name);
+int sim_thread_state(int id);
+
+void sim_thread_wake(int id);
+void sim_thread_block(int id);
+
+/* advance the trace timeline, firing simulated timers that came due */
+void sim_set_now(unsigned long tsc);
+
+/* run the scheduler's pick_next and switch to the decision; returns the
+ * picked thread's name ("idleN" when the runqueue is empty)
+ */
+const char *sim_pick_next(void);
+
+unsigned int sim_runqueue_depth(void);
+
+/* read-and-clear: did a simulated tick request a reschedule since the
+ * last call?
+ */
+int sim_resched_was_requested(void);
+
+unsigned long sim_tick_fires(void);
+
+#endif /* REPLAY_IF_H */
@@ -0,0 +1,18 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness: topology queries answered
+ * from the simulator configuration (sim_env.c).
+ */
+
+#ifndef SIM_CPU_CAPS_H
+#define SIM_CPU_CAPS_H
+
+#include <types.h>
+
+uint16_t get_pcpu_nums(void);
+bool pcpus_share_llc(uint16_t pcpu1, uint16_t pcpu2);
+
+#endif /* SIM_CPU_CAPS_H */
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness: the plain-C subset of the
+ * hypervisor's bit operations that the scheduler sources use.
+ */
+
+#ifndef SIM_BITS_H
+#define SIM_BITS_H
+
+#include <types.h>
+
+static inline bool bitmap_test(uint16_t nr_arg, const volatile uint64_t *addr)
+{
+	return ((*addr) & (1UL << (nr_arg & 0x3fU))) != 0UL;
+}
+
+static inline void bitmap_set_nolock(uint16_t nr_arg, volatile uint64_t *addr)
+{
+	*addr |= (1UL << (nr_arg & 0x3fU));
+}
+
+static inline void bitmap_clear_nolock(uint16_t nr_arg, volatile uint64_t *addr)
+{
+	*addr &= ~(1UL << (nr_arg & 0x3fU));
+}
+
+static inline void bitmap_set_lock(uint16_t nr_arg, volatile uint64_t *addr)
+{
+	bitmap_set_nolock(nr_arg, addr);
+}
+
+static inline void bitmap_clear_lock(uint16_t nr_arg, volatile uint64_t *addr)
+{
+	bitmap_clear_nolock(nr_arg, addr);
+}
+
+#endif /* SIM_BITS_H */
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness. The simulator is
+ * single-threaded, so locks only need to exist as types.
+ */
+
+#ifndef SIM_SPINLOCK_H
+#define SIM_SPINLOCK_H
+
+#include <types.h>
+
+typedef struct _spinlock {
+	uint32_t head;
+	uint32_t tail;
+} spinlock_t;
+
+static inline void spinlock_init(spinlock_t *lock)
+{
+	lock->head = 0U;
+	lock->tail = 0U;
+}
+
+static inline void spinlock_obtain(__unused spinlock_t *lock)
+{
+}
+
+static inline void spinlock_release(__unused spinlock_t *lock)
+{
+}
+
+#endif /* SIM_SPINLOCK_H */
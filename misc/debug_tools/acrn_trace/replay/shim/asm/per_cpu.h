@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness: a per_cpu_region cut down
+ * to what the scheduler classes touch, in ordinary host memory.
+ */
+
+#ifndef SIM_PER_CPU_H
+#define SIM_PER_CPU_H
+
+#include <types.h>
+#include <schedule.h>
+
+#define SIM_MAX_PCPU	8U
+
+struct per_cpu_region {
+	struct sched_control sched_ctl;
+	struct sched_bvt_control sched_bvt_ctl;
+	struct thread_object idle;
+};
+
+extern struct per_cpu_region per_cpu_data[SIM_MAX_PCPU];
+extern uint16_t sim_current_pcpu;
+
+#define per_cpu(name, pcpu_id)	(per_cpu_data[(pcpu_id)].name)
+#define get_cpu_var(name)	per_cpu(name, get_pcpu_id())
+
+static inline uint16_t get_pcpu_id(void)
+{
+	return sim_current_pcpu;
+}
+
+void sim_panic(const char *msg);
+
+#define ASSERT(cond, ...)			\
+	do {					\
+		if (!(cond)) {			\
+			sim_panic(#cond);	\
+		}				\
+	} while (0)
+
+#endif /* SIM_PER_CPU_H */
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness: time is the trace's TSC
+ * timeline, advanced by the replay loop, never the host clock.
+ */
+
+#ifndef SIM_TICKS_H
+#define SIM_TICKS_H
+
+#include <types.h>
+
+extern uint64_t sim_now;
+extern uint64_t sim_tsc_khz;
+
+#define TICKS_PER_MS	sim_tsc_khz
+
+static inline uint64_t cpu_ticks(void)
+{
+	return sim_now;
+}
+
+#endif /* SIM_TICKS_H */
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host-userspace shim for the replay harness: same API as the
+ * hypervisor's timer.h, backed by a simulated timer list that fires
+ * when the replay loop advances the trace timeline (sim_env.c).
+ */
+
+#ifndef SIM_TIMER_H
+#define SIM_TIMER_H
+
+#include <types.h>
+
+typedef void (*timer_handle_t)(void *data);
+
+struct hv_timer {
+	timer_handle_t func;
+	void *priv_data;
+	uint64_t timeout;
+	uint64_t period_in_cycle;
+	bool started;
+};
+
+void initialize_timer(struct hv_timer *timer, timer_handle_t func, void *priv_data,
+		uint64_t timeout, uint64_t period_in_cycle);
+bool timer_is_started(const struct hv_timer *timer);
+bool timer_expired(const struct hv_timer *timer, uint64_t now, uint64_t *delta_to_fire);
+int32_t add_timer(struct hv_timer *timer);
+void del_timer(struct hv_timer *timer);
+void update_timer(struct hv_timer *timer, uint64_t timeout, uint64_t period_in_cycle);
+
+#endif /* SIM_TIMER_H */
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2026 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Simulator environment for replaying exit traces against the real
+ * scheduler sources. sched_bvt.c is compiled unmodified against the shim
+ * headers; this file supplies everything it links against - per-cpu data,
+ * the trace-driven clock, a simulated timer list, and the schedule.c glue
+ * (lock/reschedule/migrate stubs) - plus the thin thread API the trace
+ * parser drives.
+ */
+
+#include <asm/per_cpu.h>
+#include <asm/cpu_caps.h>
+#include <schedule.h>
+#include <ticks.h>
+#include <timer.h>
+#include "replay_if.h"
+
+struct per_cpu_region per_cpu_data[SIM_MAX_PCPU];
+uint16_t sim_current_pcpu = 0U;
+uint64_t sim_now = 0UL;
+uint64_t sim_tsc_khz = 1000000UL;
+
+extern struct acrn_scheduler sched_bvt;
+
+/* host libc, declared here so the hypervisor types.h stays in charge */
+extern int printf(const char *fmt, ...);
+extern void exit(int status);
+extern int strncmp(const char *s1, const char *s2, uint64_t n);
+extern char *strncpy(char *dst, const char *src, uint64_t n);
+
+void sim_panic(const char *msg)
+{
+	printf("sim: assertion failed: %s\n", msg);
+	exit(1);
+}
+
+/* ---- simulated one-shot/periodic timers, fired by sim_set_now() ---- */
+
+#define SIM_MAX_TIMERS	16U
+
+static struct hv_timer *armed_timers[SIM_MAX_TIMERS];
+static uint64_t tick_fires;
+
+void initialize_timer(struct hv_timer *timer, timer_handle_t func, void *priv_data,
+		uint64_t timeout, uint64_t period_in_cycle)
+{
+	timer->func = func;
+	timer->priv_data = priv_data;
+	timer->timeout = timeout;
+	timer->period_in_cycle = period_in_cycle;
+	timer->started = false;
+}
+
+bool timer_is_started(const struct hv_timer *timer)
+{
+	return timer->started;
+}
+
+bool timer_expired(const struct hv_timer *timer, uint64_t now, uint64_t *delta_to_fire)
+{
+	bool ret = (timer->timeout == 0UL) || (now >= timer->timeout);
+
+	if (delta_to_fire != NULL) {
+		*delta_to_fire = ret ? 0UL : (timer->timeout - now);
+	}
+	return ret;
+}
+
+int32_t add_timer(struct hv_timer *timer)
+{
+	uint32_t i;
+	int32_t ret = -1;
+
+	if (!timer->started) {
+		for (i = 0U; i < SIM_MAX_TIMERS; i++) {
+			if (armed_timers[i] == NULL) {
+				armed_timers[i] = timer;
+				timer->started = true;
+				ret = 0;
+				break;
+			}
+		}
+	} else {
+		ret = 0;
+	}
+	return ret;
+}
+
+void del_timer(struct hv_timer *timer)
+{
+	uint32_t i;
+
+	for (i = 0U; i < SIM_MAX_TIMERS; i++) {
+		if (armed_timers[i] == timer) {
+			armed_timers[i] = NULL;
+		}
+	}
+	timer->started = false;
+}
+
+void update_timer(struct hv_timer *timer, uint64_t timeout, uint64_t period_in_cycle)
+{
+	timer->timeout = timeout;
+	timer->period_in_cycle = period_in_cycle;
+}
+
+/* fire every timer due at or before 'now', earliest first, re-arming
+ * periodic ones; mirrors what the physical timer interrupt would do at
+ * each point of the recorded timeline
+ */
+static void sim_run_timers(uint64_t now)
+{
+	struct hv_timer *next;
+	uint32_t i;
+
+	while (true) {
+		next = NULL;
+		for (i = 0U; i < SIM_MAX_TIMERS; i++) {
+			if ((armed_timers[i] != NULL) && (armed_timers[i]->timeout <= now) &&
+					((next == NULL) || (armed_timers[i]->timeout < next->timeout))) {
+				next = armed_timers[i];
+			}
+		}
+		if (next == NULL) {
+			break;
+		}
+
+		if (next->period_in_cycle != 0UL) {
+			next->timeout += next->period_in_cycle;
+		} else {
+			del_timer(next);
+		}
+		tick_fires++;
+		if (next->func != NULL) {
+			next->func(next->priv_data);
+		}
+	}
+}
+
+/* ---- schedule.c glue the scheduler class links against ---- */
+
+static bool resched_requested;
+
+void obtain_schedule_lock(__unused uint16_t pcpu_id, __unused uint64_t *rflag)
+{
+}
+
+void release_schedule_lock(__unused uint16_t pcpu_id, __unused uint64_t rflag)
+{
+}
+
+void make_reschedule_request(__unused uint16_t pcpu_id, __unused uint16_t delmode)
+{
+	resched_requested = true;
+}
+
+void migrate_thread(__unused struct thread_object *obj, __unused uint16_t dest_pcpu_id)
+{
+	/* single replayed pCPU: balance_runqueue never finds a target */
+}
+
+struct thread_object *sched_get_current(uint16_t pcpu_id)
+{
+	return per_cpu_data[pcpu_id].sched_ctl.curr_obj;
+}
+
+bool is_idle_thread(const struct thread_object *obj)
+{
+	return obj == &per_cpu_data[obj->pcpu_id].idle;
+}
+
+uint16_t get_pcpu_nums(void)
+{
+	return 1U;
+}
+
+bool pcpus_share_llc(__unused uint16_t pcpu1, __unused uint16_t pcpu2)
+{
+	return true;
+}
+
+/* ---- thread table and replay API ---- */
+
+static struct thread_object sim_threads[SIM_MAX_THREADS];
+static uint32_t nr_sim_threads;
+
+void sim_init(unsigned long tsc_khz)
+{
+	struct sched_control *ctl = &per_cpu_data[0].sched_ctl;
+	struct thread_object *idle = &per_cpu_data[0].idle;
+
+	sim_tsc_khz = tsc_khz;
+
+	ctl->pcpu_id = 0U;
+	ctl->scheduler = &sched_bvt;
+	(void)ctl->scheduler->init(ctl);
+
+	(void)strncpy(idle->name, "idle0", SIM_NAME_LEN);
+	idle->pcpu_id = 0U;
+	idle->sched_ctl = ctl;
+	ctl->curr_obj = idle;
+}
+
+int sim_thread_lookup(const char *name)
+{
+	uint32_t i;
+	int id = -1;
+
+	for (i = 0U; i < nr_sim_threads; i++) {
+		if (strncmp(sim_threads[i].name, name, SIM_NAME_LEN) == 0) {
+			id = (int)i;
+			break;
+		}
+	}
+	return id;
+}
+
+int sim_thread_create(const char *name)
+{
+	struct thread_object *obj;
+	int id = -1;
+
+	if ((nr_sim_threads < SIM_MAX_THREADS) && (sim_thread_lookup(name) < 0)) {
+		id = (int)nr_sim_threads;
+		obj = &sim_threads[nr_sim_threads];
+		nr_sim_threads++;
+
+		(void)strncpy(obj->name, name, SIM_NAME_LEN);
+		obj->pcpu_id = 0U;
+		obj->cpu_affinity = 1UL;
+		obj->sched_ctl = &per_cpu_data[0].sched_ctl;
+		obj->status = THREAD_STS_BLOCKED;
+		obj->sched_ctl->scheduler->init_data(obj);
+	}
+	return id;
+}
+
+int sim_thread_state(int id)
+{
+	return (sim_threads[id].status == THREAD_STS_BLOCKED) ?
+		SIM_THREAD_BLOCKED : SIM_THREAD_QUEUED;
+}
+
+void sim_thread_wake(int id)
+{
+	struct thread_object *obj = &sim_threads[id];
+
+	if (obj->status == THREAD_STS_BLOCKED) {
+		obj->sched_ctl->scheduler->wake(obj);
+		obj->status = THREAD_STS_RUNNABLE;
+	}
+}
+
+void sim_thread_block(int id)
+{
+	struct thread_object *obj = &sim_threads[id];
+
+	if (obj->status != THREAD_STS_BLOCKED) {
+		obj->sched_ctl->scheduler->sleep(obj);
+		obj->status = THREAD_STS_BLOCKED;
+	}
+}
+
+void sim_set_now(unsigned long tsc)
+{
+	if (tsc > sim_now) {
+		sim_now = tsc;
+	}
+	sim_run_timers(sim_now);
+}
+
+const char *sim_pick_next(void)
+{
+	struct sched_control *ctl = &per_cpu_data[0].sched_ctl;
+	struct thread_object *prev = ctl->curr_obj;
+	struct thread_object *next;
+
+	next = ctl->scheduler->pick_next(ctl);
+	if ((prev != next) && (prev != NULL) && !is_idle_thread(prev) &&
+			(prev->status == THREAD_STS_RUNNING)) {
+		prev->status = THREAD_STS_RUNNABLE;
+	}
+	if (!is_idle_thread(next)) {
+		next->status = THREAD_STS_RUNNING;
+	}
+	ctl->curr_obj = next;
+
+	return next->name;
+}
+
+unsigned int sim_runqueue_depth(void)
+{
+	struct sched_bvt_control *bvt_ctl =
+		(struct sched_bvt_control *)per_cpu_data[0].sched_ctl.priv;
+	struct list_head *pos;
+	unsigned int depth = 0U;
+
+	list_for_each(pos, &bvt_ctl->runqueue) {
+		depth++;
+	}
+	return depth;
+}
+
+int sim_resched_was_requested(void)
+{
+	int ret = resched_requested ? 1 : 0;
+
+	resched_requested = false;
+	return ret;
+}
+
+unsigned long sim_tick_fires(void)
+{
+	return tick_fires;
+}
@@ -71,6 +71,39 @@ int sbuf_write(int fd, shared_buf_t *sbuf)
 	return sbuf->ele_size;
 }
 
+/*
+ * Drain up to max bytes into data in one memcpy, stopping at the wrap
+ * point of the ring; call again to pick up the wrapped part. Returns the
+ * number of bytes copied (always a multiple of ele_size), 0 if the
+ * buffer is empty or max is smaller than one element.
+ */
+int sbuf_read_chunk(shared_buf_t *sbuf, uint8_t *data, uint32_t max)
+{
+	uint32_t avail, run;
+
+	if ((sbuf == NULL) || (data == NULL))
+		return -EINVAL;
+
+	if (sbuf_is_empty(sbuf))
+		return 0;
+
+	/* contiguous run from head up to tail or the end of the ring */
+	avail = (sbuf->tail >= sbuf->head) ?
+		(sbuf->tail - sbuf->head) : (sbuf->size - sbuf->head);
+
+	run = max - (max % sbuf->ele_size);
+	if (run > avail)
+		run = avail;
+	if (run == 0)
+		return 0;
+
+	memcpy(data, (void *)sbuf + SBUF_HEAD_SIZE + sbuf->head, run);
+
+	sbuf->head = sbuf_next_ptr(sbuf->head, run, sbuf->size);
+
+	return run;
+}
+
 int sbuf_clear_buffered(shared_buf_t *sbuf)
 {
 	if (sbuf == NULL)
@@ -0,0 +1,80 @@
+#!/usr/bin/python3
+# -*- coding: UTF-8 -*-
+
+"""
+This script defines the function to convert PMU self-sampling trace data
+(captured with acrntrace while the hypervisor shell "sample" command is
+active) into perf-script compatible text, which can be fed to the standard
+FlameGraph tool chain (stackcollapse-perf.pl / flamegraph.pl) or resolved
+against the hypervisor map file
+"""
+
+import sys
+import struct
+
+# 4 * 64bit per trace entry
+TRCREC = "QQQQ"
+
+PMU_SAMPLE = 0x30000
+
+def analyze_pmu_sample(ifile, ofile, freq):
+    """convert PMU sample trace data to perf-script compatible text
+
+    Args:
+        ifile: input trace data file
+        ofile: output report file, '.perf' is appended
+        freq: TSC frequency of the host where we capture the trace data
+    Returns:
+        None
+    Raises:
+        NA
+    """
+    nr_samples = 0
+    nr_guest = 0
+
+    fd = open(ifile, 'rb')
+    out_name = ofile + '.perf'
+    out = open(out_name, 'w')
+
+    while True:
+        try:
+            line = fd.read(struct.calcsize(TRCREC))
+            if not line:
+                break
+            (tsc, event, rip, aux) = struct.unpack(TRCREC, line)
+
+            cpu = event >> 56
+            event = event & 0xffffffffffff
+
+            if event != PMU_SAMPLE:
+                continue
+
+            # aux = (vm_id << 32) | (exit reason << 1) | guest flag
+            guest = aux & 0x1
+            reason = (aux >> 1) & 0xffff
+            vm_id = (aux >> 32) & 0xffff
+
+            if guest:
+                comm = "vm%d" % (vm_id)
+                nr_guest += 1
+            else:
+                comm = "acrn_hv"
+
+            timestamp = float(tsc) / (float(freq) * 1000 * 1000)
+
+            out.write("%s 0 [%03d] %.6f: cycles:\n" % (comm, cpu, timestamp))
+            out.write("\t%16x [unknown] ([unknown])\n" % (rip))
+            # synthetic caller frame so flame graphs group samples by the
+            # vm exit reason being handled when the PMI hit
+            if reason != 0:
+                out.write("\t%16x vmexit_reason_0x%x ([acrn.hv])\n"
+                          % (0, reason))
+            out.write("\n")
+            nr_samples += 1
+
+        except (IOError, struct.error) as e:
+            sys.exit()
+
+    print ("Total PMU samples: %d (%d guest, %d hypervisor)"
+           % (nr_samples, nr_guest, nr_samples - nr_guest))
+    print ("perf-script compatible output written to %s" % (out_name))
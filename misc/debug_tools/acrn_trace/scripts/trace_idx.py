@@ -0,0 +1,203 @@
+#!/usr/bin/python3
+# -*- coding: UTF-8 -*-
+
+"""
+Reader for the sidecar index files (*.idx) written by acrntrace.
+
+The index holds one fixed-size entry per block of raw trace data with
+the block's file offset, its min/max TSC and a 64-bit event id presence
+filter, so a time window or an event type can be located in a large
+capture without scanning it. Used standalone it prints the per-cpu time
+ranges and the blocks matching a window/event filter; with a raw per-cpu
+capture file it can extract the matching blocks into a trimmed file that
+the other analysis scripts accept as input.
+"""
+
+import sys
+import getopt
+import struct
+import os.path
+
+IDX_MAGIC = b'ACRNTIDX'
+IDX_VERSION = 1
+
+# idx_hdr_t / idx_entry_t in acrntrace.h
+IDX_HDR = "8sII"
+IDX_ENTRY = "IIQQQQII"
+
+def event_bit(ev_id):
+    """map an event id to its bit in the presence filter
+    Args:
+        ev_id: trace event id
+    Return:
+        the ev_map bit for the id
+    """
+    return 1 << (ev_id & 63)
+
+def read_idx(ifile):
+    """parse a sidecar index file
+    Args:
+        ifile: index file name
+    Return:
+        (cpu_cnt, list of entry dicts in file order)
+    """
+    entries = []
+    with open(ifile, 'rb') as fd:
+        hdr = fd.read(struct.calcsize(IDX_HDR))
+        (magic, version, cpu_cnt) = struct.unpack(IDX_HDR, hdr)
+        assert magic == IDX_MAGIC, "not an acrntrace index file"
+        assert version == IDX_VERSION, \
+            "unsupported index version %d" % version
+
+        esize = struct.calcsize(IDX_ENTRY)
+        while True:
+            raw = fd.read(esize)
+            if len(raw) < esize:
+                break
+            (cpu, length, off, min_tsc, max_tsc,
+             ev_map, ev_cnt, _) = struct.unpack(IDX_ENTRY, raw)
+            entries.append({'cpu': cpu, 'len': length, 'off': off,
+                            'min_tsc': min_tsc, 'max_tsc': max_tsc,
+                            'ev_map': ev_map, 'ev_cnt': ev_cnt})
+
+    return (cpu_cnt, entries)
+
+def select_blocks(entries, begin=0, end=(1 << 64) - 1, events=None):
+    """pick the blocks overlapping a tsc window and holding wanted events
+    Args:
+        entries: entry list from read_idx()
+        begin, end: tsc window, inclusive
+        events: list of event ids, None to match any
+    Return:
+        the matching entries, in file order
+    """
+    wanted = 0
+    if events:
+        for ev_id in events:
+            wanted |= event_bit(ev_id)
+
+    # a clear filter bit proves absence; a set one may be a collision,
+    # so the selection can only over-approximate, never drop a block
+    return [e for e in entries
+            if e['max_tsc'] >= begin and e['min_tsc'] <= end
+            and (not events or (e['ev_map'] & wanted))]
+
+def extract_blocks(dfile, ofile, blocks):
+    """copy the selected blocks of a raw capture file into a new file
+    Args:
+        dfile: raw (uncompressed) per-cpu capture file
+        ofile: output file, accepted by the other analysis scripts
+        blocks: entries selected from the matching index
+    Return:
+        bytes written
+    """
+    written = 0
+    with open(dfile, 'rb') as src, open(ofile, 'wb') as dst:
+        for ent in blocks:
+            src.seek(ent['off'])
+            dst.write(src.read(ent['len']))
+            written += ent['len']
+
+    return written
+
+def summarize(cpu_cnt, entries):
+    """print the per-cpu coverage of an index
+    Args:
+        cpu_cnt: cpus the index claims to cover
+        entries: entry list from read_idx()
+    Return:
+        None
+    """
+    print("%d cpu(s), %d block(s)" % (cpu_cnt, len(entries)))
+    print("%-6s %10s %12s %20s %20s" %
+          ("cpu", "blocks", "events", "first_tsc", "last_tsc"))
+    for cpu in sorted(set(e['cpu'] for e in entries)):
+        cpu_ents = [e for e in entries if e['cpu'] == cpu]
+        print("%-6d %10d %12d %20d %20d" %
+              (cpu, len(cpu_ents), sum(e['ev_cnt'] for e in cpu_ents),
+               min(e['min_tsc'] for e in cpu_ents),
+               max(e['max_tsc'] for e in cpu_ents)))
+
+def usage():
+    """print the usage of the script
+    Args: NA
+    Returns: None
+    Raises: NA
+    """
+    print('''
+    [Usage] trace_idx.py [options] [value] ...
+
+    [options]
+    -h: print this message
+    -i, --ifile=[string]: index file (*.idx)
+    -b, --begin=[unsigned int]: select blocks with max_tsc >= begin
+    -e, --end=[unsigned int]: select blocks with min_tsc <= end
+    -v, --event=[unsigned int]: select blocks that may hold this event
+                                id (repeatable; accepts 0x prefix)
+    -d, --dfile=[string]: raw capture file the index belongs to
+    -o, --ofile=[string]: extract the selected blocks of dfile here
+    ''')
+
+def main(argv):
+    """Main enterance function
+    Args:
+        argv: arguments string
+    Returns:
+        None
+    Raises:
+        GetoptError
+    """
+    ifile = ''
+    dfile = ''
+    ofile = ''
+    begin = 0
+    end = (1 << 64) - 1
+    events = []
+    opts_short = "hi:b:e:v:d:o:"
+    opts_long = ["ifile=", "begin=", "end=", "event=", "dfile=", "ofile="]
+
+    try:
+        opts, args = getopt.getopt(argv, opts_short, opts_long)
+    except getopt.GetoptError:
+        usage()
+        sys.exit(1)
+
+    for opt, arg in opts:
+        if opt == '-h':
+            usage()
+            sys.exit()
+        elif opt in ("-i", "--ifile"):
+            ifile = arg
+        elif opt in ("-b", "--begin"):
+            begin = int(arg, 0)
+        elif opt in ("-e", "--end"):
+            end = int(arg, 0)
+        elif opt in ("-v", "--event"):
+            events.append(int(arg, 0))
+        elif opt in ("-d", "--dfile"):
+            dfile = arg
+        elif opt in ("-o", "--ofile"):
+            ofile = arg
+        else:
+            assert False, "unhandled option"
+
+    assert ifile != '', "index file is required"
+
+    (cpu_cnt, entries) = read_idx(ifile)
+    summarize(cpu_cnt, entries)
+
+    blocks = select_blocks(entries, begin, end, events)
+    print("\n%d block(s) selected, %d event(s), %d byte(s)" %
+          (len(blocks), sum(e['ev_cnt'] for e in blocks),
+           sum(e['len'] for e in blocks)))
+
+    if ofile:
+        assert dfile != '', "extraction needs the capture file (-d)"
+        assert os.path.getsize(dfile) >= max(
+            (e['off'] + e['len'] for e in blocks), default=0), \
+            "index does not match the capture file"
+        written = extract_blocks(dfile, ofile, blocks)
+        print("%d byte(s) written to %s" % (written, ofile))
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
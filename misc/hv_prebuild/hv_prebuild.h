@@ -11,3 +11,4 @@
 #include <util.h>
 
 bool sanitize_vm_config(void);
+bool generate_vm_layout(const char *path);
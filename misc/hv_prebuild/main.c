@@ -7,7 +7,7 @@
 #include <types.h>
 #include <hv_prebuild.h>
 
-int32_t main(void)
+int32_t main(int32_t argc, char *argv[])
 {
 	int32_t ret = 0;
 
@@ -18,5 +18,13 @@ int32_t main(void)
 		printf("VM configuration check pass!\n");
 		ret = 0;
 	}
+
+	/* Emit the precomputed VM layout header once the configuration is known good */
+	if ((ret == 0) && (argc >= 2)) {
+		if (!generate_vm_layout(argv[1])) {
+			printf("VM layout generation fail!\n");
+			ret = -1;
+		}
+	}
 	return ret;
 }
@@ -65,6 +65,13 @@ bool sanitize_vm_config(void)
 			ret = false;
 		}
 
+		/* vCPU migration breaks the pinning RT VMs and LAPIC passthrough rely on */
+		if (((vm_config->guest_flags & GUEST_FLAG_VCPU_MIGRATION) != 0UL)
+			&& ((vm_config->guest_flags & (GUEST_FLAG_RT | GUEST_FLAG_LAPIC_PASSTHROUGH)) != 0UL)) {
+			printf("%s: vm%u combines GUEST_FLAG_VCPU_MIGRATION with RT/LAPIC_PASSTHROUGH\n", __func__, vm_id);
+			ret = false;
+		}
+
 		switch (vm_config->load_order) {
 		case PRE_LAUNCHED_VM:
 			/* GUEST_FLAG_LAPIC_PASSTHROUGH must be set if we have GUEST_FLAG_RT set in guest_flags */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <asm/page.h>
+#include <asm/vm_config.h>
+#include <hv_prebuild.h>
+
+#define EPT_MEM_4G	(1UL << 32U)
+
+/*
+ * Mirror of the worst-case EPT sizing formula in
+ * hypervisor/arch/x86/guest/ept.c, with the pre-launched VM's fixed RAM
+ * size from the scenario configuration in place of the platform RAM size
+ * that is only known at boot. The 4G add-on covers the low MMIO hole and
+ * the per-device terms cover 64 bits MMIO BARs, same as at runtime.
+ */
+static uint64_t pre_vm_ept_page_num(const struct acrn_vm_config *vm_config)
+{
+	uint64_t ept_pd_page_num = PD_PAGE_NUM(vm_config->memory.size + EPT_MEM_4G) + CONFIG_MAX_PCI_DEV_NUM * 6U;
+	uint64_t ept_pt_page_num = PT_PAGE_NUM(vm_config->memory.size + EPT_MEM_4G) + CONFIG_MAX_PCI_DEV_NUM * 6U;
+
+	return roundup((PML4_PAGE_NUM(MAX_PHY_ADDRESS_SPACE) + PDPT_PAGE_NUM(MAX_PHY_ADDRESS_SPACE)
+			+ ept_pd_page_num + ept_pt_page_num), 64U);
+}
+
+/* Emit the per-VM layout constants the hypervisor links against */
+bool generate_vm_layout(const char *path)
+{
+	uint16_t vm_id;
+	struct acrn_vm_config *vm_config;
+	bool ret = true;
+	FILE *fp = fopen(path, "w");
+
+	if (fp == NULL) {
+		printf("%s: failed to open %s\n", __func__, path);
+		ret = false;
+	} else {
+		fprintf(fp, "/* Generated by hv_prebuild from the scenario configuration, do not edit. */\n");
+		fprintf(fp, "#ifndef VM_LAYOUT_H\n");
+		fprintf(fp, "#define VM_LAYOUT_H\n\n");
+		fprintf(fp, "/*\n");
+		fprintf(fp, " * Per-VM EPT page pool size in pages. Pre-launched VMs have a fixed\n");
+		fprintf(fp, " * guest memory size, so their pools are sized exactly at build time;\n");
+		fprintf(fp, " * 0 means the VM's guest address space follows platform RAM and the\n");
+		fprintf(fp, " * pool is sized at boot.\n");
+		fprintf(fp, " */\n");
+		fprintf(fp, "#define PREBUILT_EPT_PAGE_NUM\t{\t\\\n");
+		for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+			vm_config = get_vm_config(vm_id);
+			if (vm_config->load_order == PRE_LAUNCHED_VM) {
+				fprintf(fp, "\t%luUL,\t/* VM%u */\t\\\n",
+					pre_vm_ept_page_num(vm_config), vm_id);
+			} else {
+				fprintf(fp, "\t0UL,\t/* VM%u */\t\\\n", vm_id);
+			}
+		}
+		fprintf(fp, "}\n\n");
+		fprintf(fp, "#endif /* VM_LAYOUT_H */\n");
+		(void)fclose(fp);
+	}
+
+	return ret;
+}
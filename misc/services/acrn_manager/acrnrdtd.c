@@ -0,0 +1,439 @@
+/*
+ * ProjectAcrn
+ * Acrnrdtd
+ *
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Closed-loop noisy-neighbor mitigation daemon.
+ *
+ * Samples the per-VM stats pages (which carry the CMT/MBM counters the
+ * hypervisor publishes there) at a fixed interval. When a real-time
+ * VM's measured memory bandwidth drops below its configured floor, the
+ * best-effort VM currently consuming the most bandwidth is treated as
+ * the offender and its CLOS is throttled one MBA step harder through
+ * the ACRN_IOCTL_SET_RDT_CONFIG runtime reallocation ioctl. Once every
+ * real-time VM has met its floor again for long enough, throttled VMs
+ * are relaxed one step at a time. Both directions use consecutive-
+ * sample hysteresis so a single noisy sample never reprograms the
+ * hardware, and every decision is appended to an event log.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include "hsm_ioctl_defs.h"
+
+#define STATS_PAGE_SIZE		4096UL
+
+/* layout version of struct acrn_vm_stats, must match acrn_hv_defs.h */
+#define ACRN_VM_STATS_VERSION	7U
+#define ACRN_VM_STATS_MAX_VCPUS	31U
+
+#define RDTD_MAX_VMS		8
+#define RDTD_MAX_NAME		32
+
+/* mirrors struct acrn_vcpu_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vcpu_stats {
+	uint32_t seq;
+	uint32_t reserved;
+	uint64_t last_update_tsc;
+	uint64_t run_cycles;
+	uint64_t runnable_cycles;
+	uint64_t vmexit_cnt;
+	uint64_t sched_in_cnt;
+	uint64_t l3_occupancy_bytes;
+	uint64_t mem_bw_total_bytes;
+	uint64_t inst_retired;
+	uint64_t budget_overrun_cnt;
+	uint64_t bus_lock_cnt;
+} __attribute__((aligned(64)));
+
+/* mirrors struct acrn_vm_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vm_stats {
+	uint32_t version;
+	uint16_t nr_vcpu;
+	uint16_t reserved0;
+	uint32_t ept_pages_used;
+	uint32_t ept_pages_max_used;
+	uint32_t ept_pages_total;
+	uint32_t iotlb_inv_cnt;
+	uint32_t iotlb_inv_max_us;
+	uint16_t reserved[18];
+	struct acrn_vcpu_stats vcpu[ACRN_VM_STATS_MAX_VCPUS];
+} __attribute__((aligned(8)));
+
+struct mon_vm {
+	char name[RDTD_MAX_NAME];
+	unsigned long long phys_addr;
+	const volatile struct acrn_vm_stats *stats;
+
+	/* VM-wide MBM count and its publication stamp from the last sample */
+	uint64_t prev_mbw_bytes;
+	uint64_t prev_update_tsc;
+	int have_prev;
+
+	/* MB/s over the last interval, 0 until two samples are in */
+	double mbw_mbps;
+	/* latest L3 occupancy, for the event log */
+	uint64_t l3_bytes;
+
+	/* RT VMs: bandwidth reservation to defend */
+	double floor_mbps;
+
+	/* best-effort VMs: CLOS to throttle and current MBA delay */
+	unsigned int clos;
+	unsigned int cur_delay;
+	int breach_cnt;
+	int clear_cnt;
+};
+
+static struct mon_vm rt_vms[RDTD_MAX_VMS];
+static struct mon_vm be_vms[RDTD_MAX_VMS];
+static int nr_rt, nr_be;
+
+static int hsm_fd = -1;
+static FILE *evt_log;
+static volatile sig_atomic_t stop_req;
+
+/* control knobs, overridable on the command line */
+static unsigned long interval_ms = 1000;
+static int tighten_after = 3;	/* consecutive bad samples before throttling */
+static int relax_after = 10;	/* consecutive good samples before relaxing */
+static unsigned int mba_step = 10;
+static unsigned int mba_max_delay = 90;
+
+static void usage(void)
+{
+	printf("acrnrdtd -r name:stats_addr:floor_mbps [-r ...]\n"
+	       "         -b name:stats_addr:clos [-b ...] [options]\n"
+	       "  -r: real-time VM: stats page address and the memory bandwidth\n"
+	       "      floor (MB/s) it must sustain\n"
+	       "  -b: best-effort VM: stats page address and the CLOS it runs in\n"
+	       "  -i: sampling interval in ms, default 1000\n"
+	       "  -t: consecutive breach samples before tightening, default 3\n"
+	       "  -x: consecutive clean samples before relaxing, default 10\n"
+	       "  -s: MBA delay step, default 10\n"
+	       "  -d: MBA delay ceiling, default 90\n"
+	       "  -l: event log file, default /var/log/acrnrdtd.log\n");
+}
+
+static void log_event(const char *fmt, ...)
+{
+	char stamp[32];
+	struct tm tm;
+	time_t now;
+	va_list ap;
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+	fprintf(evt_log, "%s ", stamp);
+
+	va_start(ap, fmt);
+	vfprintf(evt_log, fmt, ap);
+	va_end(ap);
+	fprintf(evt_log, "\n");
+	fflush(evt_log);
+}
+
+/* seqlock read of one vcpu slot; retries while the hypervisor updates it */
+static void read_entry(const volatile struct acrn_vcpu_stats *src,
+		       struct acrn_vcpu_stats *dst)
+{
+	uint32_t seq;
+
+	do {
+		seq = src->seq;
+		__sync_synchronize();
+		dst->last_update_tsc = src->last_update_tsc;
+		dst->l3_occupancy_bytes = src->l3_occupancy_bytes;
+		dst->mem_bw_total_bytes = src->mem_bw_total_bytes;
+		__sync_synchronize();
+	} while (((seq & 1U) != 0U) || (seq != src->seq));
+	dst->seq = seq;
+}
+
+/*
+ * The MBM counters are per-VM (one RMID per VM) but are published into
+ * every vCPU's slot by whichever vCPU thread samples them, so the slot
+ * with the newest publication stamp carries the current VM totals. A VM
+ * whose vCPUs all sit on exit-free isolated cores keeps its old stamp
+ * and simply contributes no new data this interval.
+ */
+static void sample_vm(struct mon_vm *vm, double interval_sec)
+{
+	struct acrn_vcpu_stats cur, best;
+	unsigned int i, nr_vcpu;
+
+	nr_vcpu = vm->stats->nr_vcpu;
+	if (nr_vcpu > ACRN_VM_STATS_MAX_VCPUS)
+		nr_vcpu = ACRN_VM_STATS_MAX_VCPUS;
+
+	memset(&best, 0, sizeof(best));
+	for (i = 0; i < nr_vcpu; i++) {
+		read_entry(&vm->stats->vcpu[i], &cur);
+		if (cur.last_update_tsc > best.last_update_tsc)
+			best = cur;
+	}
+
+	vm->l3_bytes = best.l3_occupancy_bytes;
+	if (vm->have_prev && best.last_update_tsc > vm->prev_update_tsc &&
+	    best.mem_bw_total_bytes >= vm->prev_mbw_bytes) {
+		vm->mbw_mbps = (double)(best.mem_bw_total_bytes - vm->prev_mbw_bytes)
+			       / interval_sec / 1e6;
+	} else {
+		vm->mbw_mbps = 0.0;
+	}
+	vm->prev_mbw_bytes = best.mem_bw_total_bytes;
+	vm->prev_update_tsc = best.last_update_tsc;
+	vm->have_prev = 1;
+}
+
+static int set_mba_delay(struct mon_vm *vm, unsigned int delay)
+{
+	struct acrn_rdt_config conf;
+
+	memset(&conf, 0, sizeof(conf));
+	conf.res = ACRN_RDT_RES_MBA;
+	conf.clos = vm->clos;
+	conf.value = delay;
+
+	if (ioctl(hsm_fd, ACRN_IOCTL_SET_RDT_CONFIG, &conf) < 0) {
+		log_event("error: SET_RDT_CONFIG clos %u delay %u failed: %s",
+			  vm->clos, delay, strerror(errno));
+		return -1;
+	}
+	vm->cur_delay = delay;
+	return 0;
+}
+
+/* the best-effort VM currently pulling the most bandwidth */
+static struct mon_vm *pick_offender(void)
+{
+	struct mon_vm *worst = NULL;
+	int i;
+
+	for (i = 0; i < nr_be; i++) {
+		if (worst == NULL || be_vms[i].mbw_mbps > worst->mbw_mbps)
+			worst = &be_vms[i];
+	}
+	return worst;
+}
+
+static void control_step(void)
+{
+	struct mon_vm *starved = NULL, *offender;
+	unsigned int delay;
+	int i;
+
+	for (i = 0; i < nr_rt; i++) {
+		/* no delta yet (first sample or idle stats page): no verdict */
+		if (rt_vms[i].mbw_mbps > 0.0 &&
+		    rt_vms[i].mbw_mbps < rt_vms[i].floor_mbps) {
+			starved = &rt_vms[i];
+			break;
+		}
+	}
+
+	if (starved != NULL) {
+		offender = pick_offender();
+		if (offender == NULL)
+			return;
+		for (i = 0; i < nr_be; i++)
+			be_vms[i].clear_cnt = 0;
+		offender->breach_cnt++;
+		if (offender->breach_cnt < tighten_after)
+			return;
+		offender->breach_cnt = 0;
+		if (offender->cur_delay >= mba_max_delay)
+			return;
+		delay = offender->cur_delay + mba_step;
+		if (delay > mba_max_delay)
+			delay = mba_max_delay;
+		if (set_mba_delay(offender, delay) == 0) {
+			log_event("tighten %s clos %u mba_delay %u "
+				  "(%s %.0f MB/s < floor %.0f MB/s, offender %.0f MB/s, l3 %lu KB)",
+				  offender->name, offender->clos, delay,
+				  starved->name, starved->mbw_mbps, starved->floor_mbps,
+				  offender->mbw_mbps,
+				  (unsigned long)(offender->l3_bytes / 1024));
+		}
+	} else {
+		for (i = 0; i < nr_be; i++) {
+			struct mon_vm *vm = &be_vms[i];
+
+			vm->breach_cnt = 0;
+			if (vm->cur_delay == 0)
+				continue;
+			vm->clear_cnt++;
+			if (vm->clear_cnt < relax_after)
+				continue;
+			vm->clear_cnt = 0;
+			delay = (vm->cur_delay > mba_step) ?
+				(vm->cur_delay - mba_step) : 0;
+			if (set_mba_delay(vm, delay) == 0) {
+				log_event("relax %s clos %u mba_delay %u",
+					  vm->name, vm->clos, delay);
+			}
+		}
+	}
+}
+
+static int map_stats_page(struct mon_vm *vm, int mem_fd)
+{
+	void *map;
+
+	map = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED, mem_fd,
+		   vm->phys_addr);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap stats page 0x%llx: %s\n",
+			vm->name, vm->phys_addr, strerror(errno));
+		return -1;
+	}
+	vm->stats = (const volatile struct acrn_vm_stats *)map;
+
+	if (vm->stats->version != ACRN_VM_STATS_VERSION) {
+		fprintf(stderr, "%s: unsupported stats page version %u (expect %u); "
+			"is the page registered?\n", vm->name,
+			vm->stats->version, ACRN_VM_STATS_VERSION);
+		return -1;
+	}
+	return 0;
+}
+
+static void sig_handler(int sig)
+{
+	(void)sig;
+	stop_req = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *log_path = "/var/log/acrnrdtd.log";
+	unsigned long long addr, val;
+	char name[RDTD_MAX_NAME];
+	struct sigaction sa;
+	int opt, mem_fd, i;
+
+	while ((opt = getopt(argc, argv, "r:b:i:t:x:s:d:l:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			if (nr_rt >= RDTD_MAX_VMS ||
+			    sscanf(optarg, "%31[^:]:%lli:%lli", name, &addr, &val) != 3) {
+				usage();
+				return 1;
+			}
+			strncpy(rt_vms[nr_rt].name, name, RDTD_MAX_NAME - 1);
+			rt_vms[nr_rt].phys_addr = addr;
+			rt_vms[nr_rt].floor_mbps = (double)val;
+			nr_rt++;
+			break;
+		case 'b':
+			if (nr_be >= RDTD_MAX_VMS ||
+			    sscanf(optarg, "%31[^:]:%lli:%lli", name, &addr, &val) != 3) {
+				usage();
+				return 1;
+			}
+			strncpy(be_vms[nr_be].name, name, RDTD_MAX_NAME - 1);
+			be_vms[nr_be].phys_addr = addr;
+			be_vms[nr_be].clos = (unsigned int)val;
+			nr_be++;
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tighten_after = atoi(optarg);
+			break;
+		case 'x':
+			relax_after = atoi(optarg);
+			break;
+		case 's':
+			mba_step = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			mba_max_delay = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			log_path = optarg;
+			break;
+		case 'h':
+		default:
+			usage();
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (nr_rt == 0 || nr_be == 0 || interval_ms == 0 ||
+	    tighten_after <= 0 || relax_after <= 0 || mba_step == 0) {
+		usage();
+		return 1;
+	}
+
+	evt_log = fopen(log_path, "a");
+	if (evt_log == NULL) {
+		fprintf(stderr, "cannot open %s, logging to stderr\n", log_path);
+		evt_log = stderr;
+	}
+
+	hsm_fd = open("/dev/acrn_hsm", O_RDWR);
+	if (hsm_fd < 0) {
+		perror("open /dev/acrn_hsm");
+		return 1;
+	}
+
+	mem_fd = open("/dev/mem", O_RDONLY | O_SYNC);
+	if (mem_fd < 0) {
+		perror("open /dev/mem");
+		return 1;
+	}
+	for (i = 0; i < nr_rt; i++) {
+		if (map_stats_page(&rt_vms[i], mem_fd) < 0)
+			return 1;
+	}
+	for (i = 0; i < nr_be; i++) {
+		if (map_stats_page(&be_vms[i], mem_fd) < 0)
+			return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_handler;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	log_event("start: %d rt vm(s), %d best-effort vm(s), interval %lu ms, "
+		  "mba step %u max %u", nr_rt, nr_be, interval_ms,
+		  mba_step, mba_max_delay);
+
+	while (!stop_req) {
+		usleep(interval_ms * 1000);
+		for (i = 0; i < nr_rt; i++)
+			sample_vm(&rt_vms[i], (double)interval_ms / 1000.0);
+		for (i = 0; i < nr_be; i++)
+			sample_vm(&be_vms[i], (double)interval_ms / 1000.0);
+		control_step();
+	}
+
+	/* leave the platform unthrottled on the way out */
+	for (i = 0; i < nr_be; i++) {
+		if (be_vms[i].cur_delay != 0)
+			(void)set_mba_delay(&be_vms[i], 0);
+	}
+	log_event("stop");
+
+	close(mem_fd);
+	close(hsm_fd);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * ProjectAcrn
+ * Acrnstat
+ *
+ * Copyright (C) 2018 Intel Corporation.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Sample the per-VM run-state statistics page maintained by the
+ * hypervisor and print per-vCPU utilization, steal time and VM exit
+ * rates. The page is one page of Service VM memory registered with the
+ * HC_SETUP_VM_STATS hypercall (done by the HSM driver); this tool only
+ * maps and reads it, so no serial console or debug shell is needed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+#define STATS_PAGE_SIZE		4096UL
+
+/* layout version of struct acrn_vm_stats, must match acrn_hv_defs.h */
+#define ACRN_VM_STATS_VERSION	7U
+#define ACRN_VM_STATS_MAX_VCPUS	31U
+
+/* mirrors struct acrn_vcpu_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vcpu_stats {
+	uint32_t seq;
+	uint32_t reserved;
+	uint64_t last_update_tsc;
+	uint64_t run_cycles;
+	uint64_t runnable_cycles;
+	uint64_t vmexit_cnt;
+	uint64_t sched_in_cnt;
+	uint64_t l3_occupancy_bytes;
+	uint64_t mem_bw_total_bytes;
+	uint64_t inst_retired;
+	uint64_t budget_overrun_cnt;
+	uint64_t bus_lock_cnt;
+} __attribute__((aligned(64)));
+
+/* mirrors struct acrn_vm_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vm_stats {
+	uint32_t version;
+	uint16_t nr_vcpu;
+	uint16_t reserved0;
+	uint32_t ept_pages_used;
+	uint32_t ept_pages_max_used;
+	uint32_t ept_pages_total;
+	uint32_t iotlb_inv_cnt;
+	uint32_t iotlb_inv_max_us;
+	uint16_t reserved[18];
+	struct acrn_vcpu_stats vcpu[ACRN_VM_STATS_MAX_VCPUS];
+} __attribute__((aligned(8)));
+
+static void usage(void)
+{
+	printf("acrnstat [-i interval_ms] [-c count] [-f tsc_mhz] stats_page_phys_addr\n"
+	       "  -i: sampling interval in ms, default 1000\n"
+	       "  -c: number of samples, default 1 (0 means forever)\n"
+	       "  -f: TSC frequency in MHz, enables exits/s instead of exits/sample\n"
+	       "  stats_page_phys_addr: physical address of the registered stats page\n");
+}
+
+/* seqlock read of one vcpu slot; retries while the hypervisor updates it */
+static void read_entry(const volatile struct acrn_vcpu_stats *src,
+		       struct acrn_vcpu_stats *dst)
+{
+	uint32_t seq;
+
+	do {
+		seq = src->seq;
+		__sync_synchronize();
+		dst->last_update_tsc = src->last_update_tsc;
+		dst->run_cycles = src->run_cycles;
+		dst->runnable_cycles = src->runnable_cycles;
+		dst->vmexit_cnt = src->vmexit_cnt;
+		dst->sched_in_cnt = src->sched_in_cnt;
+		dst->l3_occupancy_bytes = src->l3_occupancy_bytes;
+		dst->mem_bw_total_bytes = src->mem_bw_total_bytes;
+		dst->inst_retired = src->inst_retired;
+		__sync_synchronize();
+	} while (((seq & 1U) != 0U) || (seq != src->seq));
+	dst->seq = seq;
+}
+
+int main(int argc, char *argv[])
+{
+	struct acrn_vcpu_stats prev[ACRN_VM_STATS_MAX_VCPUS];
+	struct acrn_vcpu_stats cur;
+	const volatile struct acrn_vm_stats *stats;
+	int forever;
+	unsigned long long phys_addr, interval_ms = 1000, count = 1;
+	unsigned long long tsc_mhz = 0;
+	uint64_t d_ts, d_run, d_steal, d_exit, d_inst;
+	unsigned int i, nr_vcpu;
+	int opt, fd;
+	void *map;
+
+	while ((opt = getopt(argc, argv, "i:c:f:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'f':
+			tsc_mhz = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage();
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return 1;
+	}
+	phys_addr = strtoull(argv[optind], NULL, 0);
+
+	fd = open("/dev/mem", O_RDONLY | O_SYNC);
+	if (fd < 0) {
+		perror("open /dev/mem");
+		return 1;
+	}
+	map = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, phys_addr);
+	if (map == MAP_FAILED) {
+		perror("mmap stats page");
+		close(fd);
+		return 1;
+	}
+	stats = (const volatile struct acrn_vm_stats *)map;
+
+	if (stats->version != ACRN_VM_STATS_VERSION) {
+		fprintf(stderr, "unsupported stats page version %u (expect %u); "
+			"is the page registered?\n",
+			stats->version, ACRN_VM_STATS_VERSION);
+		munmap(map, STATS_PAGE_SIZE);
+		close(fd);
+		return 1;
+	}
+
+	nr_vcpu = stats->nr_vcpu;
+	if (nr_vcpu > ACRN_VM_STATS_MAX_VCPUS)
+		nr_vcpu = ACRN_VM_STATS_MAX_VCPUS;
+
+	for (i = 0; i < nr_vcpu; i++)
+		read_entry(&stats->vcpu[i], &prev[i]);
+
+	forever = (count == 0);
+	while (forever || count-- > 0) {
+		usleep(interval_ms * 1000);
+
+		printf("%-6s %7s %7s %12s %12s %10s %10s %8s\n", "vCPU", "run%", "steal%",
+		       tsc_mhz ? "exits/s" : "exits", "sched_in", "l3_kb",
+		       tsc_mhz ? "Minst/s" : "Minst", "buslock");
+		for (i = 0; i < nr_vcpu; i++) {
+			read_entry(&stats->vcpu[i], &cur);
+
+			/* deltas over the publication timestamps; a vCPU on an
+			 * exit-free isolated core keeps its old timestamp and
+			 * simply shows no new data
+			 */
+			d_ts = cur.last_update_tsc - prev[i].last_update_tsc;
+			d_run = cur.run_cycles - prev[i].run_cycles;
+			d_steal = cur.runnable_cycles - prev[i].runnable_cycles;
+			d_exit = cur.vmexit_cnt - prev[i].vmexit_cnt;
+			d_inst = cur.inst_retired - prev[i].inst_retired;
+
+			if (d_ts == 0) {
+				printf("%-6u %7s %7s %12s %12s %10s %10s %8s\n",
+				       i, "-", "-", "-", "-", "-", "-", "-");
+			} else {
+				printf("%-6u %7.2f %7.2f %12.0f %12lu %10lu %10.1f %8lu\n", i,
+				       100.0 * (double)d_run / (double)d_ts,
+				       100.0 * (double)d_steal / (double)d_ts,
+				       tsc_mhz ? ((double)d_exit * tsc_mhz * 1e6
+						  / (double)d_ts)
+					       : (double)d_exit,
+				       cur.sched_in_cnt - prev[i].sched_in_cnt,
+				       (unsigned long)(cur.l3_occupancy_bytes / 1024),
+				       tsc_mhz ? ((double)d_inst * tsc_mhz
+						  / (double)d_ts)
+					       : ((double)d_inst / 1e6),
+				       (unsigned long)cur.bus_lock_cnt);
+			}
+			prev[i] = cur;
+		}
+		printf("ept pages: %u used, %u peak, %u total\n",
+		       stats->ept_pages_used, stats->ept_pages_max_used,
+		       stats->ept_pages_total);
+		printf("iotlb invalidations: %u, worst %u us\n",
+		       stats->iotlb_inv_cnt, stats->iotlb_inv_max_us);
+	}
+
+	munmap(map, STATS_PAGE_SIZE);
+	close(fd);
+	return 0;
+}
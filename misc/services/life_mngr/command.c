@@ -37,6 +37,13 @@
 	GEN_CMD_OBJ(USER_VM_REBOOT, USER_VM_REBOOT_ID),\
 	GEN_CMD_OBJ(ACK_USER_VM_REBOOT, ACK_USER_VM_REBOOT_ID),\
 	GEN_CMD_OBJ(REQ_SYS_REBOOT, REQ_SYS_REBOOT_ID), \
+	GEN_CMD_OBJ(DM_STALL, DM_STALL_ID), \
+	GEN_CMD_OBJ(REQ_SYS_SUSPEND, REQ_SYS_SUSPEND_ID), \
+	GEN_CMD_OBJ(USER_VM_SUSPEND, USER_VM_SUSPEND_ID),\
+	GEN_CMD_OBJ(ACK_USER_VM_SUSPEND, ACK_USER_VM_SUSPEND_ID),\
+	GEN_CMD_OBJ(SYS_RESUME, SYS_RESUME_ID), \
+	GEN_CMD_OBJ(USER_VM_RESUME, USER_VM_RESUME_ID),\
+	GEN_CMD_OBJ(ACK_USER_VM_RESUME, ACK_USER_VM_RESUME_ID),\
 
 struct command dm_command_list[CMD_END] = {CMD_OBJS};
 
@@ -21,6 +21,16 @@
 #define USER_VM_REBOOT  "user_vm_reboot"
 #define REQ_SYS_REBOOT "req_sys_reboot"
 #define ACK_REQ_SYS_REBOOT "ack_req_sys_reboot"
+#define DM_STALL "dm_stall"
+#define ACK_DM_STALL "ack_dm_stall"
+#define REQ_SYS_SUSPEND "req_sys_suspend"
+#define ACK_REQ_SYS_SUSPEND "ack_req_sys_suspend"
+#define USER_VM_SUSPEND "user_vm_suspend"
+#define ACK_USER_VM_SUSPEND "ack_user_vm_suspend"
+#define SYS_RESUME "sys_resume"
+#define ACK_SYS_RESUME "ack_sys_resume"
+#define USER_VM_RESUME "user_vm_resume"
+#define ACK_USER_VM_RESUME "ack_user_vm_resume"
 
 #define ACK_REQ_USER_VM_SHUTDOWN  "ack_req_user_vm_shutdown"
 #define ACK_USER_VM_SHUTDOWN "ack_user_vm_shutdown"
@@ -34,6 +44,7 @@
 
 #define POWEROFF "poweroff"
 #define REBOOT "reboot"
+#define SUSPEND "systemctl suspend"
 
 #define CMD_NAME_MAX 32U
 
@@ -52,6 +63,13 @@ enum command_id {
 	USER_VM_REBOOT_ID,
 	ACK_USER_VM_REBOOT_ID,
 	REQ_SYS_REBOOT_ID,
+	DM_STALL_ID,
+	REQ_SYS_SUSPEND_ID,
+	USER_VM_SUSPEND_ID,
+	ACK_USER_VM_SUSPEND_ID,
+	SYS_RESUME_ID,
+	USER_VM_RESUME_ID,
+	ACK_USER_VM_RESUME_ID,
 	CMD_END,
 };
 
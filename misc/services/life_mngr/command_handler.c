@@ -173,6 +173,19 @@ int socket_req_user_vm_reboot_handler(void *arg, int fd)
 {
 	return req_user_vm_shutdown_reboot(arg, fd, USER_VM_REBOOT, ACK_REQ_USER_VM_REBOOT);
 }
+int socket_dm_stall_handler(void *arg, int fd)
+{
+	struct socket_dev *sock = (struct socket_dev *)arg;
+	struct socket_client *client = NULL;
+
+	client = find_socket_client(sock, fd);
+	if (client == NULL)
+		return -1;
+
+	LOG_PRINTF("Device model of user VM (%s) reported a stalled worker thread\n",
+				client->name);
+	return send_socket_ack(arg, fd, ACK_DM_STALL);
+}
 int socket_req_system_shutdown_user_vm_handler(void *arg, int fd)
 {
 	int ret;
@@ -211,6 +224,125 @@ static int is_allowed_sysreboot_channel_dev(struct life_mngr_config *conf, struc
 					TTY_PATH_MAX);
 }
 
+static bool is_suspend_last_channel_dev(struct life_mngr_config *conf, struct channel_dev *c_dev)
+{
+	return strncmp(get_suspend_last_config(conf), get_uart_dev_path(c_dev->uart_device),
+					TTY_PATH_MAX) == 0;
+}
+
+static bool is_resume_first_channel_dev(struct life_mngr_config *conf, struct channel_dev *c_dev)
+{
+	return strncmp(get_resume_first_config(conf), get_uart_dev_path(c_dev->uart_device),
+					TTY_PATH_MAX) == 0;
+}
+
+static int suspend_ack_pending;
+
+static void notify_suspend_uart_channel_dev(struct channel_dev *c_dev)
+{
+	suspend_ack_pending++;
+	start_uart_channel_dev_resend(c_dev, USER_VM_SUSPEND, MIN_RESEND_TIME);
+	(void) send_message_by_uart(c_dev->uart_device, USER_VM_SUSPEND,
+					strlen(USER_VM_SUSPEND));
+	LOG_PRINTF("Send suspend command to user VM (%s)\n", c_dev->name);
+}
+
+static void wait_suspend_acks(int timeout_us)
+{
+	while ((suspend_ack_pending > 0) && (timeout_us > 0)) {
+		usleep(WAIT_RECV);
+		timeout_us -= WAIT_RECV;
+	}
+	if (suspend_ack_pending > 0)
+		LOG_PRINTF("%d user VM(s) did not acknowledge suspend in time\n",
+				suspend_ack_pending);
+}
+
+/**
+ * @brief The handler of system suspend request command on socket in service VM
+ *
+ * Suspend signaling runs in two phases: every connected user VM except the
+ * one named by SUSPEND_LAST_DEV is signaled at once and the guests flush
+ * their state concurrently; the named one (typically the RTVM) is only
+ * signaled after the others acknowledged, so its deadline-sensitive work is
+ * interrupted for the shortest possible window. The socket ACK is sent once
+ * all acknowledgements arrived (or timed out); the requester then drives
+ * the Service VM into S3 itself.
+ */
+int socket_req_suspend_service_vm_handler(void *arg, int fd)
+{
+	struct channel_dev *c_dev = NULL, *last_dev = NULL;
+
+	usleep(LISTEN_INTERVAL + SECOND_TO_US);
+	suspend_ack_pending = 0;
+	pthread_mutex_lock(&channel->tty_conn_list_lock);
+	LIST_FOREACH(c_dev, &channel->tty_conn_head, list) {
+		if (is_suspend_last_channel_dev(&life_conf, c_dev))
+			last_dev = c_dev;
+		else
+			notify_suspend_uart_channel_dev(c_dev);
+	}
+	pthread_mutex_unlock(&channel->tty_conn_list_lock);
+	wait_suspend_acks(SUSPEND_TIMEOUT * SECOND_TO_US);
+	if (last_dev != NULL) {
+		notify_suspend_uart_channel_dev(last_dev);
+		wait_suspend_acks(SUSPEND_TIMEOUT * SECOND_TO_US);
+	}
+	return send_socket_ack(arg, fd, ACK_REQ_SYS_SUSPEND);
+}
+/**
+ * @brief The handler of system resume notification command on socket in service VM
+ *
+ * Invoked from a resume hook in the service VM after it wakes from S3. The
+ * user VM named by RESUME_FIRST_DEV (typically the cluster-display guest)
+ * is notified first so it paints first; the uart traffic itself serves as
+ * the wakeup source for guests which are suspended to idle.
+ */
+int socket_sys_resume_handler(void *arg, int fd)
+{
+	struct channel_dev *c_dev = NULL;
+
+	usleep(LISTEN_INTERVAL + SECOND_TO_US);
+	pthread_mutex_lock(&channel->tty_conn_list_lock);
+	LIST_FOREACH(c_dev, &channel->tty_conn_head, list) {
+		if (is_resume_first_channel_dev(&life_conf, c_dev)) {
+			LOG_PRINTF("Send resume notification to user VM (%s)\n", c_dev->name);
+			(void) send_message_by_uart(c_dev->uart_device, USER_VM_RESUME,
+							strlen(USER_VM_RESUME));
+		}
+	}
+	LIST_FOREACH(c_dev, &channel->tty_conn_head, list) {
+		if (!is_resume_first_channel_dev(&life_conf, c_dev)) {
+			LOG_PRINTF("Send resume notification to user VM (%s)\n", c_dev->name);
+			(void) send_message_by_uart(c_dev->uart_device, USER_VM_RESUME,
+							strlen(USER_VM_RESUME));
+		}
+	}
+	pthread_mutex_unlock(&channel->tty_conn_list_lock);
+	return send_socket_ack(arg, fd, ACK_SYS_RESUME);
+}
+/**
+ * @brief The handler of ACK user vm suspend command of lifecycle manager in service VM
+ *
+ * @param arg uart channel instance
+ * @param fd the file directory of the uart which receives message
+ * @return indicate this command is handled successful or not
+ */
+int ack_user_vm_suspend_cmd_handler(void *arg, int fd)
+{
+	struct channel_dev *c_dev = NULL;
+	struct uart_channel *c = (struct uart_channel *)arg;
+
+	c_dev = find_uart_channel_dev(c, fd);
+	if (c_dev == NULL)
+		return 0;
+	LOG_PRINTF("Receive suspend ACK from user VM (%s)\n", c_dev->name);
+	stop_uart_channel_dev_resend(c_dev);
+	if (suspend_ack_pending > 0)
+		suspend_ack_pending--;
+	return 0;
+}
+
 /**
  * @brief The handler of sync command of lifecycle manager in service VM
  *
@@ -365,6 +497,11 @@ int ack_user_vm_reboot_cmd_handler(void *arg, int fd)
 {
 	return ack_user_vm_cmd(arg, fd, ACK_USER_VM_REBOOT);
 }
+
+int ack_user_vm_resume_cmd_handler(void *arg, int fd)
+{
+	return ack_user_vm_cmd(arg, fd, ACK_USER_VM_RESUME);
+}
 /**
  * @brief The handler of acked sync command of lifecycle manager in user VM
  *
@@ -452,6 +589,57 @@ int user_vm_reboot_cmd_handler(void *arg, int fd)
 	(void) user_vm_shutdown_reboot(c, fd, ACK_USER_VM_REBOOT, true);
 	return 0;
 }
+/**
+ * @brief The handler of suspend command of lifecycle manager in user VM
+ *
+ * Unlike shutdown, the uart channel stays connected: the guest goes
+ * through suspend-to-RAM and keeps talking on the same device after
+ * it has been woken up.
+ *
+ * @param arg uart channel device instance
+ * @param fd the file directory of the uart which receives message
+ * @return indicate this command is handled successful or not
+ */
+int user_vm_suspend_cmd_handler(void *arg, int fd)
+{
+	int ret;
+	struct channel_dev *c_dev = NULL;
+	struct uart_channel *c = (struct uart_channel *)arg;
+
+	c_dev = find_uart_channel_dev(c, fd);
+	if (c_dev == NULL)
+		return 0;
+	ret = send_message_by_uart(c_dev->uart_device, ACK_USER_VM_SUSPEND,
+					strlen(ACK_USER_VM_SUSPEND));
+	if (ret < 0)
+		LOG_WRITE("Failed to send suspend ACK to service VM\n");
+	usleep(2 * WAIT_RECV);
+	LOG_WRITE("User VM starts to suspend\n");
+	ret = system(SUSPEND);
+	if (ret != 0)
+		LOG_PRINTF("Failed to suspend user VM, ret=%d\n", ret);
+	return 0;
+}
+/**
+ * @brief The handler of resume notification command of lifecycle manager in user VM
+ *
+ * @param arg uart channel device instance
+ * @param fd the file directory of the uart which receives message
+ * @return indicate this command is handled successful or not
+ */
+int user_vm_resume_cmd_handler(void *arg, int fd)
+{
+	struct channel_dev *c_dev = NULL;
+	struct uart_channel *c = (struct uart_channel *)arg;
+
+	c_dev = find_uart_channel_dev(c, fd);
+	if (c_dev == NULL)
+		return 0;
+	LOG_WRITE("Receive resume notification from service VM\n");
+	(void) send_message_by_uart(c_dev->uart_device, ACK_USER_VM_RESUME,
+					strlen(ACK_USER_VM_RESUME));
+	return 0;
+}
 /**
  * @brief The handler of ACK timeout command of lifecycle manager in user VM
  *
@@ -29,6 +29,18 @@ int socket_req_user_vm_shutdown_handler(void *arg, int fd);
  * @brief The handler of request user reboot command on socket in service VM
  */
 int socket_req_user_vm_reboot_handler(void *arg, int fd);
+/**
+ * @brief The handler of device model worker stall report on socket in service VM
+ */
+int socket_dm_stall_handler(void *arg, int fd);
+/**
+ * @brief The handler of request system suspend command on socket in service VM
+ */
+int socket_req_suspend_service_vm_handler(void *arg, int fd);
+/**
+ * @brief The handler of system resume notification command on socket in service VM
+ */
+int socket_sys_resume_handler(void *arg, int fd);
 /**
  * @brief The handler of request system shutdown command on socket in user VM
  */
@@ -92,6 +104,24 @@ int ack_user_vm_shutdown_cmd_handler(void *arg, int fd);
  * @return indicate this command is handled successful or not
  */
 int ack_user_vm_reboot_cmd_handler(void *arg, int fd);
+/**
+ * @brief The handler of ACK user vm suspend command of
+ * lifecycle manager in service VM
+ *
+ * @param arg uart channel instance
+ * @param fd the file directory of the uart which receives message
+ * @return indicate this command is handled successful or not
+ */
+int ack_user_vm_suspend_cmd_handler(void *arg, int fd);
+/**
+ * @brief The handler of ACK user vm resume notification command of
+ * lifecycle manager in service VM
+ *
+ * @param arg uart channel instance
+ * @param fd the file directory of the uart which receives message
+ * @return indicate this command is handled successful or not
+ */
+int ack_user_vm_resume_cmd_handler(void *arg, int fd);
 /**
  * @brief The handler of acked sync command of lifecycle manager in user VM
  *
@@ -124,6 +154,14 @@ int user_vm_shutdown_cmd_handler(void *arg, int fd);
  * @brief The handler of user VM reboot command of lifecycle manager in user VM
  */
 int user_vm_reboot_cmd_handler(void *arg, int fd);
+/**
+ * @brief The handler of user VM suspend command of lifecycle manager in user VM
+ */
+int user_vm_suspend_cmd_handler(void *arg, int fd);
+/**
+ * @brief The handler of resume notification command of lifecycle manager in user VM
+ */
+int user_vm_resume_cmd_handler(void *arg, int fd);
 /**
  * @brief The handler of ACK timeout command of lifecycle manager in user VM
  *
@@ -87,6 +87,21 @@ bool load_config(char *conf_path)
 		else if (strncmp(ALLOW_TRIGGER_SYSREBOOT, (const char *)key_str,
 				sizeof(ALLOW_TRIGGER_SYSREBOOT)) == 0)
 			memcpy(life_conf.allow_trigger_sysreboot, value_str, strlen(value_str));
+		else if (strncmp(SUSPEND_LAST_DEV, (const char *)key_str,
+				sizeof(SUSPEND_LAST_DEV)) == 0)
+			memcpy(life_conf.suspend_last_dev, value_str, strlen(value_str));
+		else if (strncmp(RESUME_FIRST_DEV, (const char *)key_str,
+				sizeof(RESUME_FIRST_DEV)) == 0)
+			memcpy(life_conf.resume_first_dev, value_str, strlen(value_str));
+		else if (strncmp(WATCHDOG_STATS_ADDR, (const char *)key_str,
+				sizeof(WATCHDOG_STATS_ADDR)) == 0)
+			memcpy(life_conf.watchdog_stats_addr, value_str, strlen(value_str));
+		else if (strncmp(WATCHDOG_TIMEOUT_MS, (const char *)key_str,
+				sizeof(WATCHDOG_TIMEOUT_MS)) == 0)
+			memcpy(life_conf.watchdog_timeout_ms, value_str, strlen(value_str));
+		else if (strncmp(WATCHDOG_ACTION, (const char *)key_str,
+				sizeof(WATCHDOG_ACTION)) == 0)
+			memcpy(life_conf.watchdog_action, value_str, strlen(value_str));
 		else
 			LOG_PRINTF("Invalid item in the configuration file, key=%s, value=%s\n",
 					key_str, value_str);
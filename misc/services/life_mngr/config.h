@@ -16,6 +16,12 @@
  * request). The default value is 300 seconds (5 minutes).
  */
 #define SHUTDOWN_TIMEOUT 300
+/**
+ * @brief Number of seconds we're willing to wait for user VMs to acknowledge
+ * a suspend request before the next suspend phase is started. The default
+ * value is 10 seconds.
+ */
+#define SUSPEND_TIMEOUT 10
 
 #define LIFE_MNGR_CONFIG_PATH "/etc/life_mngr/life_mngr.conf"
 #define LIFE_MNGR_CONFIG_FOLDER "/etc/life_mngr"
@@ -25,6 +31,11 @@
 #define DEV_NAME "DEV_NAME"
 #define ALLOW_TRIGGER_S5 "ALLOW_TRIGGER_S5"
 #define ALLOW_TRIGGER_SYSREBOOT "ALLOW_TRIGGER_SYSREBOOT"
+#define SUSPEND_LAST_DEV "SUSPEND_LAST_DEV"
+#define RESUME_FIRST_DEV "RESUME_FIRST_DEV"
+#define WATCHDOG_STATS_ADDR "WATCHDOG_STATS_ADDR"
+#define WATCHDOG_TIMEOUT_MS "WATCHDOG_TIMEOUT_MS"
+#define WATCHDOG_ACTION "WATCHDOG_ACTION"
 #define MAX_CONFIG_VALUE_LEN 128
 
 #define CHK_CREAT 1             /* create a directory, if it does not exist */
@@ -36,6 +47,11 @@ struct life_mngr_config {
 	char dev_names[MAX_CONFIG_VALUE_LEN];
 	char allow_trigger_s5[MAX_CONFIG_VALUE_LEN];
 	char allow_trigger_sysreboot[MAX_CONFIG_VALUE_LEN];
+	char suspend_last_dev[MAX_CONFIG_VALUE_LEN];
+	char resume_first_dev[MAX_CONFIG_VALUE_LEN];
+	char watchdog_stats_addr[MAX_CONFIG_VALUE_LEN];
+	char watchdog_timeout_ms[MAX_CONFIG_VALUE_LEN];
+	char watchdog_action[MAX_CONFIG_VALUE_LEN];
 };
 extern struct life_mngr_config life_conf;
 
@@ -53,6 +69,20 @@ static inline char *get_allow_sysreboot_config(struct life_mngr_config *conf)
 {
 	return conf->allow_trigger_sysreboot;
 }
+/**
+ * @brief Get the name of the device of the VM which is suspended last
+ */
+static inline char *get_suspend_last_config(struct life_mngr_config *conf)
+{
+	return conf->suspend_last_dev;
+}
+/**
+ * @brief Get the name of the device of the VM which is notified first on resume
+ */
+static inline char *get_resume_first_config(struct life_mngr_config *conf)
+{
+	return conf->resume_first_dev;
+}
 /**
  * @brief Load configuration item from config file
  *
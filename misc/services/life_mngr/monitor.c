@@ -20,6 +20,7 @@
 #include "command_handler.h"
 #include "log.h"
 #include "config.h"
+#include "watchdog.h"
 
 #define NODE_SIZE 5
 #define S5_SOCKET_DIR "/var/lib/life_mngr"
@@ -95,6 +96,12 @@ int init_socket_server_and_shutdown_commands(bool service_vm)
 						sock_server, USER_VM_SHUTDOWN);
 		register_command_handler(socket_req_user_vm_reboot_handler,
 				sock_server, USER_VM_REBOOT);
+		register_command_handler(socket_dm_stall_handler,
+				sock_server, DM_STALL);
+		register_command_handler(socket_req_suspend_service_vm_handler,
+				sock_server, REQ_SYS_SUSPEND);
+		register_command_handler(socket_sys_resume_handler,
+				sock_server, SYS_RESUME);
 	} else {
 		register_command_handler(socket_req_system_shutdown_user_vm_handler,
 						sock_server, REQ_SYS_SHUTDOWN);
@@ -122,6 +129,8 @@ int init_uart_channel_devs_and_shutdown_commands(bool service_vm, char *uart_dev
 		register_command_handler(ack_timeout_handler, channel, ACK_TIMEOUT);
 		register_command_handler(ack_user_vm_shutdown_cmd_handler, channel, ACK_USER_VM_SHUTDOWN);
 		register_command_handler(ack_user_vm_reboot_cmd_handler, channel, ACK_USER_VM_REBOOT);
+		register_command_handler(ack_user_vm_suspend_cmd_handler, channel, ACK_USER_VM_SUSPEND);
+		register_command_handler(ack_user_vm_resume_cmd_handler, channel, ACK_USER_VM_RESUME);
 
 		ret = create_service_vm_uart_channel_dev(uart_dev_name);
 		if (ret < 0)
@@ -131,6 +140,8 @@ int init_uart_channel_devs_and_shutdown_commands(bool service_vm, char *uart_dev
 		register_command_handler(poweroff_cmd_handler, channel, POWEROFF_CMD);
 		register_command_handler(user_vm_shutdown_cmd_handler, channel, USER_VM_SHUTDOWN);
 		register_command_handler(user_vm_reboot_cmd_handler, channel, USER_VM_REBOOT);
+		register_command_handler(user_vm_suspend_cmd_handler, channel, USER_VM_SUSPEND);
+		register_command_handler(user_vm_resume_cmd_handler, channel, USER_VM_RESUME);
 		register_command_handler(acked_req_shutdown_handler, channel, ACK_REQ_SYS_SHUTDOWN);
 		register_command_handler(ack_timeout_default_handler, channel, ACK_TIMEOUT);
 
@@ -185,7 +196,11 @@ static int start_life_mngr(void)
 	if (strncmp("service_vm", life_conf.vm_type, MAX_CONFIG_VALUE_LEN) == 0) {
 		if ((ret = init_socket_server_and_shutdown_commands(true)) < 0)
 			return ret;
-		ret = init_uart_channel_devs_and_shutdown_commands(true, life_conf.dev_names);
+		if ((ret = init_uart_channel_devs_and_shutdown_commands(true,
+						life_conf.dev_names)) < 0)
+			return ret;
+		/* watch the guest heartbeat in the stats page, if configured */
+		ret = start_watchdog();
 	} else if (strncmp("user_vm", life_conf.vm_type, MAX_CONFIG_VALUE_LEN) == 0) {
 		if ((ret = init_socket_server_and_shutdown_commands(false)) < 0)
 			return ret;
@@ -201,6 +216,7 @@ static int start_life_mngr(void)
 }
 static void stop_life_mngr(void)
 {
+	stop_watchdog();
 	deinit_uart_channel(channel);
 	deinit_socket(sock_server);
 	close_log();
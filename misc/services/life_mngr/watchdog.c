@@ -0,0 +1,209 @@
+/*
+ * Copyright (C)2021 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "config.h"
+#include "watchdog.h"
+
+#define STATS_PAGE_SIZE 4096UL
+#define WATCHDOG_POLL_MS 100U
+#define WATCHDOG_DEFAULT_TIMEOUT_MS 2000U
+
+/* layout version of struct acrn_vm_stats, must match acrn_hv_defs.h */
+#define ACRN_VM_STATS_VERSION 7U
+#define ACRN_VM_STATS_MAX_VCPUS 31U
+
+/* mirrors struct acrn_vcpu_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vcpu_stats {
+	uint32_t seq;
+	uint32_t reserved;
+	uint64_t last_update_tsc;
+	uint64_t run_cycles;
+	uint64_t runnable_cycles;
+	uint64_t vmexit_cnt;
+	uint64_t sched_in_cnt;
+	uint64_t l3_occupancy_bytes;
+	uint64_t mem_bw_total_bytes;
+	uint64_t inst_retired;
+	uint64_t budget_overrun_cnt;
+	uint64_t bus_lock_cnt;
+} __attribute__((aligned(64)));
+
+/* mirrors struct acrn_vm_stats in hypervisor/include/public/acrn_hv_defs.h */
+struct acrn_vm_stats {
+	uint32_t version;
+	uint16_t nr_vcpu;
+	uint16_t reserved0;
+	uint32_t ept_pages_used;
+	uint32_t ept_pages_max_used;
+	uint32_t ept_pages_total;
+	uint32_t iotlb_inv_cnt;
+	uint32_t iotlb_inv_max_us;
+	uint16_t reserved[18];
+	struct acrn_vcpu_stats vcpu[ACRN_VM_STATS_MAX_VCPUS];
+} __attribute__((aligned(8)));
+
+struct vcpu_progress {
+	uint64_t last_update_tsc;
+	uint64_t vmexit_cnt;
+	uint64_t inst_retired;
+	unsigned int stalled_ms;
+};
+
+static pthread_t watchdog_thread;
+static bool watchdog_running;
+static const volatile struct acrn_vm_stats *watchdog_stats;
+static void *watchdog_map;
+static int watchdog_memfd = -1;
+
+/* seqlock read of one vcpu slot; retries while the hypervisor updates it */
+static void read_entry(const volatile struct acrn_vcpu_stats *src,
+			struct acrn_vcpu_stats *dst)
+{
+	uint32_t seq;
+
+	do {
+		seq = src->seq;
+		__sync_synchronize();
+		dst->last_update_tsc = src->last_update_tsc;
+		dst->vmexit_cnt = src->vmexit_cnt;
+		dst->inst_retired = src->inst_retired;
+		__sync_synchronize();
+	} while (((seq & 1U) != 0U) || (seq != src->seq));
+	dst->seq = seq;
+}
+
+static void *watchdog_loop(void *arg)
+{
+	struct vcpu_progress prog[ACRN_VM_STATS_MAX_VCPUS];
+	struct acrn_vcpu_stats cur;
+	unsigned int timeout_ms = WATCHDOG_DEFAULT_TIMEOUT_MS;
+	unsigned int i, nr_vcpu;
+	bool moved, fired = false;
+	int ret;
+
+	(void)arg;
+	if (strlen(life_conf.watchdog_timeout_ms) > 0U)
+		timeout_ms = (unsigned int)strtoul(life_conf.watchdog_timeout_ms, NULL, 0);
+
+	nr_vcpu = watchdog_stats->nr_vcpu;
+	if (nr_vcpu > ACRN_VM_STATS_MAX_VCPUS)
+		nr_vcpu = ACRN_VM_STATS_MAX_VCPUS;
+	memset(prog, 0x0, sizeof(prog));
+
+	LOG_PRINTF("Watchdog: monitoring %u vcpu(s), timeout %u ms\n",
+			nr_vcpu, timeout_ms);
+	while (watchdog_running) {
+		usleep(WATCHDOG_POLL_MS * 1000U);
+		moved = false;
+		for (i = 0U; i < nr_vcpu; i++) {
+			read_entry(&watchdog_stats->vcpu[i], &cur);
+			/**
+			 * A vCPU makes progress when the hypervisor republishes
+			 * its slot with a new exit count or instructions-retired
+			 * sample. An idle (HLT) guest still republishes on its
+			 * timer ticks, so a frozen timestamp means a real hang.
+			 */
+			if ((cur.last_update_tsc != prog[i].last_update_tsc) &&
+				((cur.vmexit_cnt != prog[i].vmexit_cnt) ||
+				(cur.inst_retired != prog[i].inst_retired))) {
+				prog[i].last_update_tsc = cur.last_update_tsc;
+				prog[i].vmexit_cnt = cur.vmexit_cnt;
+				prog[i].inst_retired = cur.inst_retired;
+				prog[i].stalled_ms = 0U;
+				moved = true;
+			} else {
+				prog[i].stalled_ms += WATCHDOG_POLL_MS;
+				if (prog[i].stalled_ms < timeout_ms)
+					moved = true;
+			}
+		}
+		if (moved) {
+			if (fired)
+				LOG_WRITE("Watchdog: guest recovered\n");
+			fired = false;
+		} else if (!fired) {
+			fired = true;
+			LOG_PRINTF("Watchdog: no vcpu progress within %u ms, "
+					"run action (%s)\n", timeout_ms,
+					life_conf.watchdog_action);
+			if (strlen(life_conf.watchdog_action) > 0U) {
+				ret = system(life_conf.watchdog_action);
+				if (ret != 0)
+					LOG_PRINTF("Watchdog: action failed, ret=%d\n", ret);
+			}
+		}
+	}
+	return NULL;
+}
+
+int start_watchdog(void)
+{
+	unsigned long long phys_addr;
+
+	if (strlen(life_conf.watchdog_stats_addr) == 0U)
+		return 0;
+	phys_addr = strtoull(life_conf.watchdog_stats_addr, NULL, 0);
+
+	watchdog_memfd = open("/dev/mem", O_RDONLY | O_SYNC);
+	if (watchdog_memfd < 0) {
+		LOG_PRINTF("Watchdog: failed to open /dev/mem (%d)\n", errno);
+		return -errno;
+	}
+	watchdog_map = mmap(NULL, STATS_PAGE_SIZE, PROT_READ, MAP_SHARED,
+				watchdog_memfd, phys_addr);
+	if (watchdog_map == MAP_FAILED) {
+		LOG_PRINTF("Watchdog: failed to map stats page at %s\n",
+				life_conf.watchdog_stats_addr);
+		close(watchdog_memfd);
+		watchdog_memfd = -1;
+		return -ENOMEM;
+	}
+	watchdog_stats = (const volatile struct acrn_vm_stats *)watchdog_map;
+	if (watchdog_stats->version != ACRN_VM_STATS_VERSION) {
+		LOG_PRINTF("Watchdog: unsupported stats page version %u\n",
+				watchdog_stats->version);
+		stop_watchdog();
+		return -EINVAL;
+	}
+
+	watchdog_running = true;
+	if (pthread_create(&watchdog_thread, NULL, watchdog_loop, NULL) != 0) {
+		LOG_WRITE("Watchdog: failed to create thread\n");
+		watchdog_running = false;
+		stop_watchdog();
+		return -1;
+	}
+	return 0;
+}
+
+void stop_watchdog(void)
+{
+	if (watchdog_running) {
+		watchdog_running = false;
+		pthread_join(watchdog_thread, NULL);
+	}
+	if (watchdog_map != NULL && watchdog_map != MAP_FAILED) {
+		munmap(watchdog_map, STATS_PAGE_SIZE);
+		watchdog_map = NULL;
+		watchdog_stats = NULL;
+	}
+	if (watchdog_memfd >= 0) {
+		close(watchdog_memfd);
+		watchdog_memfd = -1;
+	}
+}
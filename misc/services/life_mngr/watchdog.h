@@ -0,0 +1,24 @@
+/*
+ * Copyright (C)2021 Intel Corporation
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+/**
+ * @brief Start the guest watchdog thread if it is configured
+ *
+ * The watchdog polls the per-VM statistics page maintained by the
+ * hypervisor and runs the configured action when no vCPU of the
+ * monitored VM makes progress within the configured timeout. It is
+ * only meaningful in the service VM; it does nothing when the
+ * WATCHDOG_STATS_ADDR configuration item is absent.
+ *
+ * @return 0 the watchdog is running or not configured
+ * @return negative value fail to start the watchdog
+ */
+int start_watchdog(void);
+/**
+ * @brief Stop the guest watchdog thread
+ */
+void stop_watchdog(void);
+#endif